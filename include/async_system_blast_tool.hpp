@@ -27,13 +27,30 @@
 #define SERVER_SRC_SERVICES_BLAST_INCLUDE_ASYNC_SYSTEM_BLAST_TOOL_HPP_
 
 
+#include <pthread.h>
+
 #include "system_blast_tool.hpp"
-#include "count_async_task.h"
-#include "system_async_task.h"
+#include "blast_process_monitor.hpp"
+
+
+/* forward declaration */
+struct AsyncQueryChunk;
+
 
 /**
  * A class that will run Blast as an asynchronous system process.
  *
+ * The job waits in the shared BlastScheduler's line until there are
+ * enough free cores for it. The process is then launched directly and
+ * handed over to a BlastProcessMonitor which completes the job once the
+ * process has finished, so no thread is tied up waiting for either.
+ *
+ * If the queries are split into chunks, each chunk is searched by its own
+ * process with the job's cores shared between them. As each chunk's process
+ * finishes, its results are merged and the next chunk is launched from the
+ * BlastProcessMonitor's thread, and the job is completed once the last
+ * of them has finished.
+ *
  * @ingroup blast_service
  */
 class BLAST_SERVICE_LOCAL AsyncSystemBlastTool : public SystemBlastTool
@@ -106,6 +123,16 @@ public:
 	virtual OperationStatus GetStatus (bool update_flag = true);
 
 
+	/**
+	 * Stop the Blast process of this AsyncSystemBlastTool or, if it is
+	 * still waiting for cores, take it out of the BlastScheduler's line.
+	 *
+	 * @return <code>true</code> if the job is being stopped,
+	 * <code>false</code> otherwise.
+	 */
+	virtual bool Cancel ();
+
+
 	/**
 	 * Get the results after the AsyncSystemBlastTool has finished
 	 * running.
@@ -123,7 +150,64 @@ private:
 	static const char * const ASBT_LOGFILE_S;
 
 	char *asbt_async_logfile_s;
-	SystemAsyncTask *asbt_task_p;
+
+	/** The process id of the running Blast process or -1 if there isn't one. */
+	pid_t asbt_pid;
+
+	/** The number of cores given to this job by the BlastScheduler or 0 if it doesn't have any. */
+	uint32 asbt_num_cores;
+
+	/** The chunks of the queries if they are searched by separate processes or 0. */
+	ChunkedQuerySearch *asbt_chunked_search_p;
+
+	/** The details passed to the BlastProcessMonitor for each of the chunks. */
+	struct AsyncQueryChunk *asbt_chunks_p;
+
+	/** The arguments that each chunk's query and output files are swapped into. */
+	char **asbt_chunk_args_ss;
+
+	char *asbt_chunk_logfile_s;
+
+	/** The index of the next chunk to launch. */
+	uint32 asbt_next_chunk;
+
+	uint32 asbt_num_running_chunks;
+
+	uint32 asbt_max_running_chunks;
+
+	/** This stays as OS_STARTED until any of the chunks fails. */
+	OperationStatus asbt_chunks_status;
+
+	bool asbt_chunks_cancelled_flag;
+
+	/**
+	 * This guards the chunks' details as the chunks finish, and the
+	 * next ones are launched, on the BlastProcessMonitor's thread.
+	 */
+	pthread_mutex_t asbt_chunks_mutex;
+
+
+	void InitChunks ();
+
+	bool LaunchWatchedBlastProcess ();
+
+	bool LaunchWatchedChunks ();
+
+	void LaunchChunks ();
+
+	void LaunchNextChunk ();
+
+	void FinishChunks ();
+
+	void FailToStart ();
+
+	void FailWithoutCores ();
+
+	static void CoresAvailable (void *data_p, uint32 num_cores);
+
+	static void BlastProcessFinished (void *data_p, const BlastProcessResult *result_p);
+
+	static void ChunkFinished (void *data_p, const BlastProcessResult *result_p);
 };
 
 
@@ -0,0 +1,167 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_batcher.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_BATCHER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_BATCHER_HPP_
+
+#include <pthread.h>
+
+#include "blast_service_api.h"
+#include "linked_list.h"
+#include "operation.h"
+#include "typedefs.h"
+
+
+/**
+ * The function called to run the Blast process for a batch of queries.
+ *
+ * @param data_p The data that was passed to BlastBatcher::RunBatched by
+ * the job that is running the batch.
+ * @param query_filename_s The file containing all of the queries in the batch.
+ * @param output_filename_s The file that the Blast output must be written to.
+ * @param num_jobs The number of jobs whose queries are in the batch, so that
+ * any per-job limits can be scaled up to cover all of them.
+ * @return The OperationStatus of the Blast process.
+ */
+typedef OperationStatus (*BlastBatchRunFn) (void *data_p, const char *query_filename_s, const char *output_filename_s, uint32 num_jobs);
+
+
+/* forward declaration */
+struct BlastBatch;
+
+
+/**
+ * A BlastBatcher merges Blast jobs that arrive close together and that
+ * differ only in their queries into a single Blast process with a
+ * multi-FASTA query. This saves each of them from paying the cost of
+ * opening the database and setting up the search.
+ *
+ * The first job to arrive for a given set of arguments waits for either
+ * the batching window to pass or enough queries to arrive. It then runs
+ * the combined search and splits the single-file JSON output back into
+ * the output file of each of the jobs, numbering each job's queries from
+ * 1 as if it had been run on its own. The log of the Blast process is
+ * copied to each of the jobs too.
+ *
+ * The batch's Blast process is run by the first job and is tracked under
+ * its id. Cancelling any of the jobs, including the first, only detaches
+ * that job from the batch. The process is only stopped once all of the
+ * jobs in the batch have been cancelled.
+ *
+ * A single BlastBatcher is shared by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastBatcher
+{
+public:
+
+	/**
+	 * Get the BlastBatcher that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedBlastBatcher.
+	 *
+	 * @param window_ms How long, in milliseconds, a batch waits for other jobs to join it.
+	 * @param max_queries The number of queries that will cause a batch to be run before
+	 * the window has finished.
+	 * @return The shared BlastBatcher or 0 upon error.
+	 */
+	static BlastBatcher *GetSharedBlastBatcher (uint32 window_ms, uint32 max_queries);
+
+
+	/**
+	 * Release a reference to the shared BlastBatcher. When the last
+	 * reference is released, the batcher is freed.
+	 */
+	static void ReleaseSharedBlastBatcher ();
+
+
+	/**
+	 * Run a Blast search as part of a batch, waiting for the batch to finish.
+	 *
+	 * @param key_s The arguments of the search apart from the query and output files.
+	 * Only searches with the same key are batched together.
+	 * @param job_id_s The id of the job that this search is for.
+	 * @param query_filename_s The query file for this search.
+	 * @param output_filename_s The file where the output for this search will be written
+	 * in single-file JSON format.
+	 * @param log_filename_s The file where the log of the Blast process will be written.
+	 * @param run_fn The function to call if this search ends up running the batch.
+	 * @param run_data_p The data to pass to run_fn.
+	 * @param cancelled_flag_p This will be set to <code>true</code> if the search
+	 * was cancelled with CancelBatched, <code>false</code> otherwise.
+	 * @return The OperationStatus of this search.
+	 */
+	OperationStatus RunBatched (const char *key_s, const char *job_id_s, const char *query_filename_s, const char *output_filename_s, const char *log_filename_s, BlastBatchRunFn run_fn, void *run_data_p, bool *cancelled_flag_p);
+
+
+	/**
+	 * Cancel a search that is part of a batch. If it is waiting for the batch
+	 * to finish, RunBatched returns straight away. The batch carries on for the
+	 * rest of its searches.
+	 *
+	 * @param job_id_s The id of the job that the search is for.
+	 * @param batch_job_id_s A buffer of at least UUID_STRING_BUFFER_SIZE bytes. If every
+	 * search in a running batch has now been cancelled, the id that the batch's
+	 * Blast process is tracked under, which should be used to stop it, will be
+	 * stored here. Otherwise it will be set to an empty string.
+	 * @return <code>true</code> if the search was found in a batch and has been
+	 * cancelled, <code>false</code> otherwise.
+	 */
+	bool CancelBatched (const char *job_id_s, char *batch_job_id_s);
+
+
+private:
+	static BlastBatcher *bb_shared_batcher_p;
+	static uint32 bb_shared_batcher_count;
+	static pthread_mutex_t bb_shared_batcher_mutex;
+
+	uint32 bb_window_ms;
+
+	uint32 bb_max_queries;
+
+	/** The batches that are still accepting new jobs or are running. */
+	LinkedList *bb_batches_p;
+
+	pthread_mutex_t bb_mutex;
+
+	pthread_cond_t bb_cond;
+
+
+	BlastBatcher (uint32 window_ms, uint32 max_queries);
+
+	~BlastBatcher ();
+
+	struct BlastBatch *GetOpenBatch (const char *key_s);
+
+	void CloseBatch (struct BlastBatch *batch_p);
+
+	OperationStatus RunBatch (struct BlastBatch *batch_p, BlastBatchRunFn run_fn, void *run_data_p);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_BATCHER_HPP_ */
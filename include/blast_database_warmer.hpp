@@ -0,0 +1,157 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_database_warmer.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_DATABASE_WARMER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_DATABASE_WARMER_HPP_
+
+#include <pthread.h>
+
+#include "blast_service_api.h"
+#include "blast_service.h"
+#include "jansson.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+struct WarmedDatabase;
+
+
+/**
+ * A BlastDatabaseWarmer runs in the background loading the sequence and
+ * index files of a service's active databases into the page cache so that
+ * the first searches after a restart or a period of memory pressure don't
+ * have to wait for Blast to read them back in from disk.
+ *
+ * The databases are warmed in order of their priority until the memory
+ * budget has been used. At regular intervals the warmer checks how much
+ * of each database is still in the page cache, loading back any parts of
+ * the warmed databases that have been dropped, and writes a report of
+ * this to the service's working directory.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastDatabaseWarmer
+{
+public:
+
+	/**
+	 * Create a BlastDatabaseWarmer and start its thread.
+	 *
+	 * @param data_p The BlastServiceData whose databases will be warmed.
+	 * @param budget The maximum number of bytes of database files to keep warm.
+	 * @param interval_s The number of seconds between each check of the databases.
+	 * If this is 0, then the databases are only warmed once.
+	 * @return The new BlastDatabaseWarmer or 0 upon error.
+	 */
+	static BlastDatabaseWarmer *Create (const BlastServiceData *data_p, uint64 budget, uint32 interval_s);
+
+
+	/**
+	 * Create a BlastDatabaseWarmer and start its thread.
+	 *
+	 * @param data_p The BlastServiceData whose databases will be warmed.
+	 * @param budget The maximum number of bytes of database files to keep warm.
+	 * @param interval_s The number of seconds between each check of the databases.
+	 */
+	BlastDatabaseWarmer (const BlastServiceData *data_p, uint64 budget, uint32 interval_s);
+
+
+	/**
+	 * The BlastDatabaseWarmer destructor. This stops the warmer's
+	 * thread and waits for it to finish.
+	 */
+	~BlastDatabaseWarmer ();
+
+
+	/**
+	 * Get the fraction of a database's files that were in the
+	 * page cache when they were last checked.
+	 *
+	 * @param db_filename_s The filename of the database.
+	 * @return The fraction between 0 and 1 or a negative value if the database
+	 * is not one of the warmer's databases or has not been checked yet.
+	 */
+	double GetResidency (const char *db_filename_s);
+
+
+	/**
+	 * Get the details of how much of each database was in the page
+	 * cache when they were last checked.
+	 *
+	 * @return The newly-allocated JSON array of details for each database
+	 * or <code>NULL</code> upon error.
+	 */
+	json_t *GetResidencyAsJSON ();
+
+
+private:
+	/** The name of the report written to the service's working directory. */
+	static const char * const BDW_REPORT_FILENAME_S;
+
+	/** The number of pages checked and loaded at a time. */
+	static const size_t BDW_PAGES_PER_WINDOW;
+
+	/** The active databases in the order that they will be warmed. */
+	struct WarmedDatabase *bdw_databases_p;
+
+	uint32 bdw_num_databases;
+
+	DatabaseType bdw_type;
+
+	uint64 bdw_budget;
+
+	uint32 bdw_interval_s;
+
+	char *bdw_report_filename_s;
+
+	bool bdw_stop_flag;
+
+	/** This protects bdw_stop_flag and the residency details of the databases. */
+	pthread_mutex_t bdw_mutex;
+
+	pthread_cond_t bdw_cond;
+
+	pthread_t bdw_thread;
+
+
+	static void *RunWarmerThread (void *data_p);
+
+	void Run ();
+
+	bool WaitForNextCheck ();
+
+	bool IsStopping ();
+
+	void CheckDatabase (struct WarmedDatabase *db_p, uint64 *remaining_budget_p);
+
+	bool CheckFile (const char *filename_s, const bool warm_flag, uint64 *size_p, uint64 *resident_size_p);
+
+	bool WriteReport ();
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_DATABASE_WARMER_HPP_ */
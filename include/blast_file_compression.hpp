@@ -0,0 +1,169 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_file_compression.hpp
+ *
+ *  Created on: 26 Oct 2026
+ *      Author: billy
+ *
+ * Once a job has finished, its files in the working directory can be
+ * compressed with zstd into the "seekable" format: the data is split
+ * into independently compressed frames followed by a skippable frame
+ * holding a table of their sizes, so that any range of the original
+ * data can be read by only decompressing the frames that cover it. The
+ * files are still readable with the standard zstd tools.
+ *
+ * A compressed file is stored alongside the name of the original with
+ * BS_COMPRESSED_SUFFIX_S appended and the original is removed. The
+ * functions here that read files look for either form so that callers
+ * don't need to know whether a file has been compressed.
+ *
+ * Compression needs the service to be built with ZSTD_ENABLED.
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_FILE_COMPRESSION_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_FILE_COMPRESSION_HPP_
+
+#include <stddef.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+class BlastResultBuffer;
+
+
+/**
+ * Can files be compressed and decompressed, i.e. was the service
+ * built with zstd support?
+ *
+ * @return <code>true</code> if compression is available, <code>false</code>
+ * otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool IsBlastFileCompressionAvailable (void);
+
+
+/**
+ * Compress a file and then remove the original.
+ *
+ * @param filename_s The file to compress.
+ * @param level The zstd compression level to use.
+ * @return <code>true</code> if the file was compressed successfully,
+ * <code>false</code> if it doesn't exist, is already compressed or upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool CompressBlastFile (const char *filename_s, const int level);
+
+
+/**
+ * Get the filename that a file is stored under once it has been compressed.
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @return The compressed filename which should be freed with FreeCopiedString
+ * or <code>NULL</code> upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL char *GetCompressedBlastFilename (const char *filename_s);
+
+
+/**
+ * Does a file exist either uncompressed or compressed?
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @return <code>true</code> if either form of the file exists, <code>false</code>
+ * otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool DoesBlastFileExist (const char *filename_s);
+
+
+/**
+ * Get the number of bytes that a file takes up on disk in whichever form
+ * it is stored.
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @param size_p Where the size will be stored.
+ * @return <code>true</code> if either form of the file exists, <code>false</code>
+ * otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool GetStoredBlastFileSize (const char *filename_s, uint64 *size_p);
+
+
+/**
+ * Remove both forms of a file.
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @return <code>true</code> if neither form of the file exists any more,
+ * <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool RemoveBlastFile (const char *filename_s);
+
+
+/**
+ * Get the contents of a file, decompressing it if needed. An uncompressed
+ * file is mapped rather than copied onto the heap.
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @return A BlastResultBuffer with the file's contents, which should be deleted
+ * once it is no longer needed, or <code>NULL</code> upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL BlastResultBuffer *ReadBlastFile (const char *filename_s);
+
+
+/**
+ * Get part of the contents of a file, decompressing only the frames that
+ * cover it if the file is compressed.
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @param offset The offset into the uncompressed data to start from.
+ * @param length The maximum number of bytes to get.
+ * @param total_length_p If this is not <code>NULL</code>, the length of the
+ * whole of the uncompressed data will be stored here.
+ * @return A BlastResultBuffer with the requested range, which will be shorter
+ * than length if the end of the data is reached, and which should be deleted
+ * once it is no longer needed, or <code>NULL</code> upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL BlastResultBuffer *ReadBlastFileRange (const char *filename_s, const uint64 offset, const size_t length, uint64 *total_length_p);
+
+
+/**
+ * Make sure that there is an uncompressed copy of a file for an external
+ * program to read.
+ *
+ * @param filename_s The filename of the uncompressed file.
+ * @param temp_filename_ss If the file was compressed, this is set to the name
+ * of a temporary uncompressed copy, which the caller must remove and free
+ * with FreeCopiedString once it has finished with it. Otherwise it is set to
+ * <code>NULL</code> and filename_s can be used as it is.
+ * @return <code>true</code> if an uncompressed form of the file is available,
+ * <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool GetUncompressedBlastFile (const char *filename_s, char **temp_filename_ss);
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_FILE_COMPRESSION_HPP_ */
@@ -35,12 +35,14 @@
 
 // forward declarations
 struct BlastServiceData;
+class BlastResultBuffer;
 
 
 /**
  * This class is for converting the output of a blast
  * job between the available different formats. The
- * input format must be "BLAST archive format (ASN.1)"
+ * input format is given by GetArchiveOutputFormat and
+ * is "BLAST archive format (ASN.1)" by default.
  *
  * @ingroup blast_service
  */
@@ -59,11 +61,12 @@ public:
 	 *
 	 * @param filename_s The full path to the filename to convert.
 	 * @param output_format_code The required output format code.
-	 * @param output_format_code_ss The string for the format code gets stored here.
+	 * @param custom_format_s The custom columns for the output format or <code>NULL</code>
+	 * for the default ones. Different sets of columns get different filenames.
 	 * @return The full path to the output filename for the given output format code
 	 * or 0 upon error.
 	 */
-	static char *GetConvertedOutputFilename (const char * const filename_s, const uint32 output_format_code);
+	static char *GetConvertedOutputFilename (const char * const filename_s, const uint32 output_format_code, const char *custom_format_s);
 
 	/**
 	 * The function to get the converted output as a c-style string.
@@ -77,6 +80,27 @@ public:
 
 
 	static bool IsCustomisableOutputFormat (const uint32 output_format_code);
+
+
+	/**
+	 * Get the output format that the Blast tools need to write their
+	 * results in so that this BlastFormatter can convert them.
+	 *
+	 * @return The output format code which, by default, is BS_DEFAULT_OUTPUT_FORMAT.
+	 */
+	virtual uint32 GetArchiveOutputFormat () const;
+
+
+	/**
+	 * Get a job's output in the format given by GetArchiveOutputFormat without
+	 * copying it onto the heap.
+	 *
+	 * @param job_output_filename_s The filename of the job's output.
+	 * @return A BlastResultBuffer mapping the job's output, which should be deleted
+	 * once it is no longer needed, or <code>NULL</code> if the output isn't available
+	 * in the archive format.
+	 */
+	virtual BlastResultBuffer *GetArchiveOutput (const char *job_output_filename_s);
 };
 
 
@@ -0,0 +1,181 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_hit_index.hpp
+ *
+ *  Created on: 28 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_HIT_INDEX_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_HIT_INDEX_HPP_
+
+#include "blast_service_api.h"
+#include "byte_buffer.h"
+#include "typedefs.h"
+
+
+/* forward declarations */
+class BlastResultBuffer;
+
+struct BlastHitIndexHeader;
+struct BlastHitIndexReport;
+struct BlastHitIndexHit;
+
+
+/**
+ * A BlastHitIndex holds the byte offsets of each query's report and of
+ * each of the hits within them in a job's single-file JSON output. This
+ * lets a page of the hits be cut out of the output by only reading the
+ * parts of it that are needed, rather than parsing the whole of what
+ * can be a very large result.
+ *
+ * The index is built by scanning the output once and is stored in its
+ * own file next to the job's other files. The output is read through
+ * ReadBlastFileRange so it can have been compressed since the index
+ * was built.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastHitIndex
+{
+public:
+
+	/**
+	 * Is a file a single-file JSON output that can be indexed?
+	 *
+	 * @param results_filename_s The filename of the uncompressed output.
+	 * @return <code>true</code> if the file can be indexed, <code>false</code>
+	 * otherwise.
+	 */
+	static bool IsIndexable (const char *results_filename_s);
+
+
+	/**
+	 * Scan a single-file JSON output and store its index.
+	 *
+	 * @param results_filename_s The filename of the uncompressed output.
+	 * @param index_filename_s The filename to store the index in. Any
+	 * existing index is replaced.
+	 * @return <code>true</code> if the index was stored successfully,
+	 * <code>false</code> otherwise.
+	 */
+	static bool WriteIndex (const char *results_filename_s, const char *index_filename_s);
+
+
+	/**
+	 * Open a stored index.
+	 *
+	 * @param results_filename_s The filename of the uncompressed output
+	 * that the index is for.
+	 * @param index_filename_s The filename that the index is stored in.
+	 * @return The BlastHitIndex or 0 if the index doesn't exist, no longer
+	 * matches the output or upon error.
+	 */
+	static BlastHitIndex *OpenIndex (const char *results_filename_s, const char *index_filename_s);
+
+
+	/**
+	 * Index a single-file JSON output that is held in memory, such
+	 * as the results of a remote job, without storing the index.
+	 *
+	 * @param results_p The output. If this method succeeds, the BlastHitIndex
+	 * takes ownership of this and will delete it, otherwise it is left to the
+	 * caller to delete.
+	 * @return The BlastHitIndex or 0 upon error.
+	 */
+	static BlastHitIndex *IndexBuffer (BlastResultBuffer *results_p);
+
+
+	/**
+	 * The BlastHitIndex destructor.
+	 */
+	~BlastHitIndex ();
+
+
+	/**
+	 * Get the number of query reports in the output.
+	 *
+	 * @return The number of reports.
+	 */
+	uint64 GetNumReports () const;
+
+
+	/**
+	 * Get the number of hits in the output.
+	 *
+	 * @param report_index The 1-based index of the report to get the
+	 * number of hits for or 0 for the number of hits in all of them.
+	 * @return The number of hits.
+	 */
+	uint64 GetNumHits (const uint64 report_index) const;
+
+
+	/**
+	 * Get a page of the hits as a single-file JSON output. Each report
+	 * in the page keeps all of its data apart from the hits that are not
+	 * on the page.
+	 *
+	 * @param report_index The 1-based index of the report to get the hits from.
+	 * If this is 0, the hits of all of the reports are numbered consecutively
+	 * and only the reports that have hits on the page are included.
+	 * @param hits_offset The number of hits to skip.
+	 * @param hits_limit The maximum number of hits to get or 0 for all of them.
+	 * @param num_hits_p If this is not <code>NULL</code>, the number of hits
+	 * on the page will be stored here.
+	 * @return A BlastResultBuffer with the page, which should be deleted once it
+	 * is no longer needed, or <code>NULL</code> upon error.
+	 */
+	BlastResultBuffer *GetPage (const uint64 report_index, const uint64 hits_offset, const uint64 hits_limit, uint64 *num_hits_p) const;
+
+
+private:
+	/** The index data, either mapped from its file or built in memory. */
+	BlastResultBuffer *bhi_index_p;
+
+	const struct BlastHitIndexHeader *bhi_header_p;
+
+	const struct BlastHitIndexReport *bhi_reports_p;
+
+	const struct BlastHitIndexHit *bhi_hits_p;
+
+	/** The filename of the indexed output if it is read from disk. */
+	char *bhi_results_filename_s;
+
+	/** The indexed output if it is held in memory. */
+	BlastResultBuffer *bhi_results_p;
+
+
+	BlastHitIndex (BlastResultBuffer *index_p, char *results_filename_s, BlastResultBuffer *results_p);
+
+	static BlastResultBuffer *ScanResults (const char *data_s, const size_t length);
+
+	static bool IsValidIndex (const BlastResultBuffer *index_p, const uint64 results_length);
+
+	static BlastHitIndex *Create (BlastResultBuffer *index_p, char *results_filename_s, BlastResultBuffer *results_p);
+
+	bool AppendReport (ByteBuffer *buffer_p, const struct BlastHitIndexReport *report_p, const uint64 first_hit, const uint64 end_hit) const;
+
+	bool AppendRange (ByteBuffer *buffer_p, const uint64 start, const uint64 end) const;
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_HIT_INDEX_HPP_ */
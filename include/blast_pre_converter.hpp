@@ -0,0 +1,184 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_pre_converter.hpp
+ *
+ *  Created on: 27 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PRE_CONVERTER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PRE_CONVERTER_HPP_
+
+#include <pthread.h>
+
+#include "blast_service_api.h"
+#include "blast_service.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+struct PreConversionJob;
+
+
+/**
+ * A BlastPreConverter converts the output of each job that has finished
+ * into a configured list of output formats in the background, so that
+ * when these formats are requested later, they are already on disk or
+ * in the ConvertedOutputCache rather than having to be converted while
+ * the request waits.
+ *
+ * The conversions are run by the converter's own threads at a lower
+ * scheduling priority than the rest of the server, so that they only
+ * use otherwise idle time. A conversion that is requested while the
+ * converter is running it is shared through the service's
+ * SingleFlightConverter rather than being run twice.
+ *
+ * Once all of the job's conversions have been made, the hits in its
+ * single-file JSON output are indexed and, if the job files are to be
+ * compressed, this is done too. As compressing at the higher levels can
+ * take a while, a BlastPreConverter with no formats to convert to is used
+ * just to compress the job files away from the threads running the jobs.
+ * Single files, such as the outputs that are converted when they are
+ * requested, can be queued for compression too.
+ *
+ * Jobs that can't be queued because the queue is full or the converter
+ * is stopping are written to BPC_OVERFLOW_FILENAME_S in the working
+ * directory, along with any that are still queued when the converter
+ * is freed. Whenever the queue is empty, these are read back in and
+ * converted, so that their files are still compressed eventually, even
+ * after the server has restarted.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastPreConverter
+{
+public:
+
+	/**
+	 * Create a BlastPreConverter and start its threads.
+	 *
+	 * @param data_p The BlastServiceData whose jobs will be converted.
+	 * @param formats_p The output format codes to convert each job into.
+	 * This is copied.
+	 * @param num_formats The number of output format codes. This can be 0
+	 * if the jobs' files are only to be indexed and compressed.
+	 * @param num_threads The number of threads to run the conversions with.
+	 * @return The new BlastPreConverter or 0 upon error.
+	 */
+	static BlastPreConverter *Create (const BlastServiceData *data_p, const uint32 *formats_p, const uint32 num_formats, const uint32 num_threads);
+
+
+	/**
+	 * The BlastPreConverter destructor. This stops the converter's
+	 * threads, waiting for any conversions that they are running to
+	 * finish, and drops any jobs that are still waiting to be converted.
+	 */
+	~BlastPreConverter ();
+
+
+	/**
+	 * Queue a finished job to be converted.
+	 *
+	 * @param job_id_s The job id.
+	 * @return <code>true</code> if the job was queued, is already queued
+	 * or has been saved to be converted once the queue has room for it,
+	 * <code>false</code> upon error. If this returns <code>false</code>,
+	 * then the caller is still responsible for any tidying up of the
+	 * job's files.
+	 */
+	bool AddJob (const char *job_id_s);
+
+
+	/**
+	 * Queue a single file to be compressed.
+	 *
+	 * @param filename_s The file to compress. This is copied.
+	 * @return <code>true</code> if the file was queued or is already queued,
+	 * <code>false</code> if the queue is full or upon error, in which case
+	 * the file is left uncompressed.
+	 */
+	bool AddFileToCompress (const char *filename_s);
+
+
+private:
+	/** The maximum number of jobs that can be waiting to be converted. */
+	static const uint32 BPC_MAX_QUEUED_JOBS;
+
+	/** The nice value that the threads run at. */
+	static const int BPC_NICENESS;
+
+	/** The file in the working directory listing the ids of the jobs that couldn't be queued. */
+	static const char * const BPC_OVERFLOW_FILENAME_S;
+
+	const BlastServiceData *bpc_data_p;
+
+	uint32 *bpc_formats_p;
+
+	uint32 bpc_num_formats;
+
+	/** The jobs that are waiting to be converted in the order that they finished. */
+	struct PreConversionJob *bpc_first_job_p;
+
+	struct PreConversionJob *bpc_last_job_p;
+
+	uint32 bpc_num_queued_jobs;
+
+	bool bpc_stop_flag;
+
+	char *bpc_overflow_filename_s;
+
+	/** Might there be any jobs in the overflow file? */
+	bool bpc_overflow_flag;
+
+	/** This protects the queue, the overflow file and the flags. */
+	pthread_mutex_t bpc_mutex;
+
+	pthread_cond_t bpc_cond;
+
+	pthread_t *bpc_threads_p;
+
+	uint32 bpc_num_threads;
+
+
+	BlastPreConverter (const BlastServiceData *data_p, const uint32 *formats_p, const uint32 num_formats, const uint32 num_threads);
+
+	static void *RunConverterThread (void *data_p);
+
+	void Run ();
+
+	bool AddToQueue (const char *job_id_s, const char *filename_s);
+
+	struct PreConversionJob *GetNextJob ();
+
+	bool WriteOverflowJobs (const struct PreConversionJob *first_job_p, const char *job_id_s);
+
+	void ReadOverflowJobs ();
+
+	bool IsStopping ();
+
+	void ConvertJob (const char *job_id_s);
+
+	void FreeFormats ();
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PRE_CONVERTER_HPP_ */
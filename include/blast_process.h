@@ -0,0 +1,234 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+
+/*
+ * blast_process.h
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_H_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_H_
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+
+
+/**
+ * The reasons why a process may be stopped before it has
+ * finished, either by a BlastProcessMonitor or by the limits
+ * of its BlastProcessEnvelope.
+ *
+ * @ingroup blast_service
+ */
+typedef enum BlastProcessStop
+{
+	/** The process was not stopped. */
+	BPS_NONE,
+
+	/** The process's job was cancelled. */
+	BPS_CANCELLED,
+
+	/** The process's job ran past its deadline. */
+	BPS_TIMED_OUT,
+
+	/** The process was killed for going over its memory limit. */
+	BPS_MEMORY_LIMIT
+} BlastProcessStop;
+
+
+/**
+ * The details of how an external process launched by
+ * the Blast service finished.
+ *
+ * @ingroup blast_service
+ */
+typedef struct BlastProcessResult
+{
+	/**
+	 * The exit code of the process if it exited normally,
+	 * or -1 if it was terminated by a signal.
+	 */
+	int bpr_exit_code;
+
+	/**
+	 * The signal that terminated the process or 0 if it
+	 * exited normally.
+	 */
+	int bpr_signal;
+
+	/**
+	 * The resources used by the process.
+	 */
+	struct rusage bpr_usage;
+
+	/**
+	 * Why the process was stopped by a BlastProcessMonitor
+	 * or its BlastProcessEnvelope, if it was.
+	 */
+	BlastProcessStop bpr_stop;
+
+} BlastProcessResult;
+
+
+/**
+ * A function to set up a process launched by SpawnPreparedBlastProcess
+ * before it runs its program, e.g. to apply resource limits to it.
+ *
+ * @param pid The process id.
+ * @param data_p The custom data passed to SpawnPreparedBlastProcess.
+ * @return <code>true</code> if the process was set up successfully and
+ * can run, <code>false</code> if it should be stopped instead.
+ * @ingroup blast_service
+ */
+typedef bool (*BlastProcessPrepareFn) (pid_t pid, void *data_p);
+
+
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+
+/**
+ * Launch an external process directly, without going via a shell.
+ *
+ * The process is started in its own process group with stdin
+ * attached to /dev/null and both stdout and stderr appended to
+ * the given log file.
+ *
+ * @param args_ss The <code>NULL</code>-terminated array of arguments.
+ * The first entry is the program to run and is searched for in the PATH.
+ * @param log_filename_s The file to append stdout and stderr to. If this is <code>NULL</code>
+ * then the output streams are inherited from the calling process.
+ * @return The process id of the launched process or -1 upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL pid_t SpawnBlastProcess (char * const *args_ss, const char *log_filename_s);
+
+
+/**
+ * Launch an external process in the same way as SpawnBlastProcess, but
+ * hold it before it runs its program until it has been set up.
+ *
+ * @param args_ss The <code>NULL</code>-terminated array of arguments.
+ * The first entry is the program to run and is searched for in the PATH.
+ * @param log_filename_s The file to append stdout and stderr to. If this is <code>NULL</code>
+ * then the output streams are inherited from the calling process.
+ * @param prepare_fn The function to set up the process. If this fails, the
+ * process is stopped without running its program.
+ * @param data_p The custom data to pass to prepare_fn.
+ * @return The process id of the launched process or -1 upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL pid_t SpawnPreparedBlastProcess (char * const *args_ss, const char *log_filename_s, BlastProcessPrepareFn prepare_fn, void *data_p);
+
+
+/**
+ * Wait for a process launched by SpawnBlastProcess to finish.
+ *
+ * @param pid The process id to wait for.
+ * @param result_p Where the exit status and resource usage of the process will be stored.
+ * @return <code>true</code> if the process was waited for successfully, <code>false</code>
+ * otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool WaitForBlastProcess (pid_t pid, BlastProcessResult *result_p);
+
+
+/**
+ * Check whether a process launched by SpawnBlastProcess has finished,
+ * collecting its exit status if it has, without blocking.
+ *
+ * @param pid The process id to check.
+ * @param result_p Where the exit status and resource usage of the process will be stored.
+ * @return 1 if the process has finished, 0 if it is still running or -1 upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL int TryWaitForBlastProcess (pid_t pid, BlastProcessResult *result_p);
+
+
+/**
+ * Wait until any one of several processes launched by SpawnBlastProcess
+ * has finished. The process is not reaped, so it must then be collected
+ * with WaitForBlastProcess or BlastProcessMonitor::Wait as usual.
+ *
+ * @param pids_p The process ids to wait for. Any that are not greater
+ * than 0 are ignored.
+ * @param num_pids The number of process ids.
+ * @return The index in pids_p of a process that has finished or -1
+ * upon error.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL int32 WaitForAnyBlastProcess (const pid_t *pids_p, const uint32 num_pids);
+
+
+/**
+ * Launch an external process and wait for it to finish.
+ *
+ * @param args_ss The <code>NULL</code>-terminated array of arguments.
+ * @param log_filename_s The file to append stdout and stderr to.
+ * @param result_p Where the exit status and resource usage of the process will be stored.
+ * @return <code>true</code> if the process was launched and ran to completion, <code>false</code>
+ * otherwise. Check the values in result_p to see whether the process itself was successful.
+ * @ingroup blast_service
+ * @see SpawnBlastProcess
+ * @see WaitForBlastProcess
+ */
+BLAST_SERVICE_LOCAL bool RunBlastProcess (char * const *args_ss, const char *log_filename_s, BlastProcessResult *result_p);
+
+
+/**
+ * Check whether a process completed successfully.
+ *
+ * @param result_p The BlastProcessResult to check.
+ * @return <code>true</code> if the process exited normally with a code of 0,
+ * <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool DidBlastProcessSucceed (const BlastProcessResult *result_p);
+
+
+/**
+ * Swap in different values for some of the arguments of a Blast process,
+ * e.g. to search part of a job. Only the pointers in args_ss are replaced,
+ * so the strings that they pointed to are left unchanged.
+ *
+ * @param args_ss The <code>NULL</code>-terminated array of arguments.
+ * @param replacements_ss A <code>NULL</code>-terminated array of pairs of
+ * the keys of the arguments to change followed by their new values.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL void ReplaceBlastProcessArgValues (char **args_ss, const char **replacements_ss);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_H_ */
@@ -0,0 +1,169 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_process_envelope.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_ENVELOPE_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_ENVELOPE_HPP_
+
+#include <sys/types.h>
+
+#include "blast_service_api.h"
+#include "blast_process.h"
+#include "jansson.h"
+#include "typedefs.h"
+
+
+/**
+ * A BlastProcessEnvelope limits the resources that each Blast process
+ * can use so that a single large search can't push the server into swap
+ * or starve the other searches of cpu time and disk bandwidth.
+ *
+ * If a delegated cgroup v2 directory is configured, each process is started
+ * in a cgroup of its own beneath it with the configured memory.max,
+ * cpu.max and io.weight. A process that is killed for going over its
+ * memory limit is then reported as such. Otherwise the memory limit is
+ * applied with setrlimit and the cpu and io limits are not available.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastProcessEnvelope
+{
+public:
+
+	/**
+	 * Create a BlastProcessEnvelope from its configuration.
+	 *
+	 * @param config_p The JSON object with the limits to use.
+	 * @return The new BlastProcessEnvelope or 0 if no limits
+	 * were configured or upon error.
+	 */
+	static BlastProcessEnvelope *Create (const json_t *config_p);
+
+
+	/**
+	 * Make a copy of a BlastProcessEnvelope for something that can
+	 * outlive it, such as a job queued on the shared BlastThreadPool.
+	 *
+	 * @param envelope_p The BlastProcessEnvelope to copy.
+	 * @return The new BlastProcessEnvelope or 0 upon error.
+	 */
+	static BlastProcessEnvelope *Clone (const BlastProcessEnvelope *envelope_p);
+
+
+	/**
+	 * Create a BlastProcessEnvelope from its configuration.
+	 *
+	 * @param config_p The JSON object with the limits to use.
+	 */
+	BlastProcessEnvelope (const json_t *config_p);
+
+
+	/**
+	 * The BlastProcessEnvelope destructor.
+	 */
+	~BlastProcessEnvelope ();
+
+
+	/**
+	 * Launch a process with the limits already applied, so that
+	 * it is in its cgroup and has its rlimits before it runs its program.
+	 *
+	 * @param args_ss The <code>NULL</code>-terminated array of arguments.
+	 * @param log_filename_s The file to append stdout and stderr to.
+	 * @param num_jobs The number of jobs whose searches the process is running.
+	 * The memory limit is for a single job, so it is multiplied by this for a
+	 * process that runs a batch of them.
+	 * @return The process id of the launched process or -1 upon error,
+	 * including if the limits couldn't be applied.
+	 * @see SpawnPreparedBlastProcess
+	 */
+	pid_t Spawn (char * const *args_ss, const char *log_filename_s, const uint32 num_jobs = 1);
+
+
+	/**
+	 * Tidy up after a process that has been reaped, recording in its
+	 * result whether it was killed for going over its memory limit.
+	 *
+	 * @param pid The process id.
+	 * @param result_p The result of the process to update.
+	 */
+	void Leave (pid_t pid, BlastProcessResult *result_p);
+
+
+	/**
+	 * Get the memory limit for each process.
+	 *
+	 * @return The limit in bytes or 0 if there is no limit.
+	 */
+	uint64 GetMemoryLimit () const;
+
+
+	/** The configuration key for the memory limit in megabytes. */
+	static const char * const BPE_MEMORY_MAX_MB_S;
+
+	/** The configuration key for the cpu limit as a percentage of a single core. */
+	static const char * const BPE_CPU_MAX_PERCENT_S;
+
+	/** The configuration key for the io weight between 1 and 10000. */
+	static const char * const BPE_IO_WEIGHT_S;
+
+	/** The configuration key for the delegated cgroup v2 directory. */
+	static const char * const BPE_CGROUP_ROOT_S;
+
+
+private:
+	/** The period, in microseconds, used for cpu.max. */
+	static const uint32 BPE_CPU_PERIOD;
+
+	uint64 bpe_memory_max;
+
+	uint32 bpe_cpu_max_percent;
+
+	uint32 bpe_io_weight;
+
+	/** The delegated cgroup directory or 0 if setrlimit is used instead. */
+	char *bpe_cgroup_root_s;
+
+
+	BlastProcessEnvelope (const BlastProcessEnvelope &envelope_r);
+
+	static bool PrepareProcess (pid_t pid, void *data_p);
+
+	bool Enter (pid_t pid, const uint32 num_jobs);
+
+	char *GetCgroupPath (pid_t pid) const;
+
+	bool EnterCgroup (pid_t pid, const uint64 memory_max);
+
+	bool EnterRlimits (pid_t pid, const uint64 memory_max);
+
+	bool WriteCgroupFile (const char *cgroup_s, const char *filename_s, const char *value_s, const bool required_flag) const;
+
+	bool WasOutOfMemory (const char *cgroup_s) const;
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_ENVELOPE_HPP_ */
@@ -0,0 +1,218 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_process_monitor.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_MONITOR_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_MONITOR_HPP_
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "blast_service_api.h"
+#include "blast_process.h"
+#include "typedefs.h"
+
+
+/**
+ * The function called by a BlastProcessMonitor when a process
+ * that it is watching finishes.
+ *
+ * @param data_p The data that was passed to BlastProcessMonitor::Watch.
+ * @param result_p The exit status and resource usage of the process.
+ */
+typedef void (*BlastProcessExitFn) (void *data_p, const BlastProcessResult *result_p);
+
+
+/* forward declaration */
+struct WatchedProcess;
+
+
+/**
+ * A BlastProcessMonitor uses a single thread to wait for any number of
+ * Blast processes to finish, so that asynchronous searches don't each
+ * need a thread of their own that does nothing but wait.
+ *
+ * Each process is watched through a pidfd with epoll. On kernels that
+ * don't support pidfds, the processes are checked at regular intervals
+ * instead. A single monitor is shared by all of the Blast services.
+ *
+ * The monitor also keeps track of the processes that are waited for by
+ * the threads that launched them. Any process that it knows about can be
+ * stopped, along with everything else in its process group, either by
+ * cancelling its job or when its job's deadline passes.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastProcessMonitor
+{
+public:
+
+	/**
+	 * Get the BlastProcessMonitor that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedBlastProcessMonitor.
+	 *
+	 * @return The shared BlastProcessMonitor or 0 upon error.
+	 */
+	static BlastProcessMonitor *GetSharedBlastProcessMonitor ();
+
+
+	/**
+	 * Release a reference to the shared BlastProcessMonitor. When the last
+	 * reference is released, its thread is stopped and the monitor is freed.
+	 */
+	static void ReleaseSharedBlastProcessMonitor ();
+
+
+	/**
+	 * Start watching a process launched by SpawnBlastProcess. Once it has
+	 * finished, the process is reaped and exit_fn is called from the
+	 * monitor's thread.
+	 *
+	 * @param pid The process id to watch.
+	 * @param exit_fn The function to call when the process finishes.
+	 * @param data_p The data to pass to exit_fn.
+	 * @param job_id_s The uuid of the job that the process is for.
+	 * @param deadline The time at which the process will be stopped
+	 * or 0 for no deadline.
+	 * @return <code>true</code> if the process is being watched,
+	 * <code>false</code> otherwise in which case the caller is still
+	 * responsible for waiting for the process.
+	 */
+	bool Watch (pid_t pid, BlastProcessExitFn exit_fn, void *data_p, const char *job_id_s, time_t deadline);
+
+
+	/**
+	 * Keep track of a process launched by SpawnBlastProcess that the caller
+	 * will wait for itself, so that it can be cancelled or stopped at its
+	 * deadline. The caller must use Wait rather than WaitForBlastProcess
+	 * so that the process is not reaped while the monitor may still signal it.
+	 *
+	 * @param pid The process id to track.
+	 * @param job_id_s The uuid of the job that the process is for.
+	 * @param deadline The time at which the process will be stopped
+	 * or 0 for no deadline.
+	 * @return <code>true</code> if the process is being tracked,
+	 * <code>false</code> otherwise.
+	 */
+	bool Track (pid_t pid, const char *job_id_s, time_t deadline);
+
+
+	/**
+	 * Wait for a process to finish, stop tracking it and then reap it.
+	 * This can also be used for processes that aren't being tracked.
+	 *
+	 * @param pid The process id to wait for.
+	 * @param result_p Where the exit status and resource usage of the process,
+	 * along with why it was stopped if it was, will be stored.
+	 * @return <code>true</code> if the process was waited for successfully, <code>false</code>
+	 * otherwise.
+	 */
+	bool Wait (pid_t pid, BlastProcessResult *result_p);
+
+
+	/**
+	 * Stop all of the processes for a job. Each process group is sent
+	 * SIGTERM and then SIGKILL if it is still running after a short while.
+	 *
+	 * @param job_id_s The uuid of the job to cancel.
+	 * @return <code>true</code> if any processes for the job were found,
+	 * <code>false</code> otherwise.
+	 */
+	bool Cancel (const char *job_id_s);
+
+
+	/**
+	 * Get the number of processes that are currently being watched.
+	 *
+	 * @return The number of processes.
+	 */
+	uint32 GetNumWatchedProcesses ();
+
+
+private:
+	static BlastProcessMonitor *bpm_shared_monitor_p;
+	static uint32 bpm_shared_monitor_count;
+	static pthread_mutex_t bpm_shared_monitor_mutex;
+
+	/** How often, in milliseconds, processes without a pidfd and deadlines are checked. */
+	static const int BPM_POLL_INTERVAL_MS;
+
+	/** How long, in seconds, a stopped process has to exit before it is killed. */
+	static const time_t BPM_KILL_GRACE_PERIOD;
+
+	int bpm_epoll_fd;
+
+	/** An eventfd used to wake the monitor's thread. */
+	int bpm_wakeup_fd;
+
+	/** The processes being watched. */
+	struct WatchedProcess *bpm_processes_p;
+
+	uint32 bpm_num_processes;
+
+	/** The number of watched processes that need checking at regular intervals. */
+	uint32 bpm_num_polled_processes;
+
+	/** The number of processes that have deadlines or are being stopped. */
+	uint32 bpm_num_timed_processes;
+
+	bool bpm_running_flag;
+
+	/** This protects the list of processes and bpm_running_flag. */
+	pthread_mutex_t bpm_mutex;
+
+	pthread_t bpm_thread;
+
+
+	BlastProcessMonitor ();
+
+	~BlastProcessMonitor ();
+
+	static void *RunMonitorThread (void *data_p);
+
+	void Run ();
+
+	void Wake ();
+
+	bool AddProcess (pid_t pid, bool reap_flag, BlastProcessExitFn exit_fn, void *data_p, const char *job_id_s, time_t deadline);
+
+	void CheckProcess (struct WatchedProcess *process_p);
+
+	void CheckPolledProcesses ();
+
+	void CheckDeadlines ();
+
+	void StopProcess (struct WatchedProcess *process_p, BlastProcessStop reason);
+
+	void RemoveProcess (struct WatchedProcess *process_p);
+
+	static void FinishProcess (struct WatchedProcess *process_p);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROCESS_MONITOR_HPP_ */
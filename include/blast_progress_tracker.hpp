@@ -0,0 +1,152 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_progress_tracker.hpp
+ *
+ *  Created on: 20 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROGRESS_TRACKER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROGRESS_TRACKER_HPP_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+
+
+/** The maximum length of the latest message from a job's log, including the terminating \0 */
+#define BPT_MESSAGE_SIZE	(256)
+
+
+/**
+ * How far through its queries a running Blast job is.
+ *
+ * @ingroup blast_service
+ */
+typedef struct BLAST_SERVICE_LOCAL BlastProgress
+{
+	/**
+	 * The number of queries whose results have been written
+	 * to the job's output so far.
+	 */
+	uint32 bp_queries_completed;
+
+	/**
+	 * Can the completed queries be counted from the job's output format?
+	 * If this is <code>false</code>, bp_queries_completed is always 0.
+	 */
+	bool bp_counted_flag;
+
+	/** The last line written to the job's log or an empty string if there is none. */
+	char bp_message_s [BPT_MESSAGE_SIZE];
+} BlastProgress;
+
+
+/* forward declaration */
+struct TrackedJob;
+
+
+/**
+ * A BlastProgressTracker follows the output and log files of running Blast
+ * jobs so that their progress can be reported while they are running.
+ *
+ * Each time that the progress of a job is asked for, only the parts of its
+ * files that have been written since the last time are read. The queries are
+ * counted from the markers that Blast writes at the start of each query's
+ * results, which depend upon the output format. Jobs are forgotten once
+ * their progress hasn't been asked for in a while. A single tracker is
+ * shared by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastProgressTracker
+{
+public:
+
+	/**
+	 * Get the BlastProgressTracker that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedBlastProgressTracker.
+	 *
+	 * @return The shared BlastProgressTracker or 0 upon error.
+	 */
+	static BlastProgressTracker *GetSharedBlastProgressTracker ();
+
+
+	/**
+	 * Release a reference to the shared BlastProgressTracker. When the last
+	 * reference is released, the tracker is freed.
+	 */
+	static void ReleaseSharedBlastProgressTracker ();
+
+
+	/**
+	 * Can the queries be counted for a given output format?
+	 *
+	 * @param output_format The Blast output format code.
+	 * @return <code>true</code> if the queries can be counted, <code>false</code>
+	 * otherwise.
+	 */
+	static bool CanCountQueries (const uint32 output_format);
+
+
+	/**
+	 * Read any new output and log messages for a job and get its progress.
+	 *
+	 * @param job_id_s The uuid of the job.
+	 * @param output_filename_s The file that Blast is writing the job's results to.
+	 * @param output_format The output format that Blast is writing the results in.
+	 * @param log_filename_s The job's log file or <code>NULL</code> if there isn't one.
+	 * @param progress_p Where the job's progress will be stored.
+	 * @return <code>true</code> if the progress was got successfully, <code>false</code>
+	 * otherwise.
+	 */
+	bool GetProgress (const char *job_id_s, const char *output_filename_s, const uint32 output_format, const char *log_filename_s, BlastProgress *progress_p);
+
+
+private:
+	static BlastProgressTracker *bpt_shared_tracker_p;
+	static uint32 bpt_shared_tracker_count;
+	static pthread_mutex_t bpt_shared_tracker_mutex;
+
+	/** How long, in seconds, a job is kept after its progress was last asked for. */
+	static const time_t BPT_EXPIRY_TIME;
+
+	struct TrackedJob *bpt_jobs_p;
+
+	/** This protects the list of jobs. */
+	pthread_mutex_t bpt_mutex;
+
+
+	BlastProgressTracker ();
+
+	~BlastProgressTracker ();
+
+	struct TrackedJob *GetJob (const char *job_id_s);
+
+	void RemoveExpiredJobs (const time_t now);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_PROGRESS_TRACKER_HPP_ */
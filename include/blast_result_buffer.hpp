@@ -0,0 +1,156 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_result_buffer.hpp
+ *
+ *  Created on: 25 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_RESULT_BUFFER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_RESULT_BUFFER_HPP_
+
+#include <stddef.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+#include "jansson.h"
+
+
+/**
+ * A BlastResultBuffer holds the results of a Blast job for as long as
+ * they are needed, without copying them onto the heap.
+ *
+ * Results that are in a file are memory-mapped, so reading them only
+ * costs the page cache rather than a heap copy, and the mapping is
+ * removed when the buffer is deleted. Results that have just been made
+ * in memory, e.g. by a BlastFormatter, are taken over by the buffer
+ * instead. The data is not guaranteed to be NUL-terminated, so it must
+ * be used along with its length.
+ *
+ * A mapped file must not be truncated while the buffer is alive, so only
+ * files that are finished with, such as the outputs of completed jobs and
+ * their converted outputs, should be mapped.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastResultBuffer
+{
+public:
+	/**
+	 * Create a BlastResultBuffer for the contents of a file.
+	 *
+	 * @param filename_s The file to map.
+	 * @return The new BlastResultBuffer or 0 upon error, e.g.
+	 * if the file does not exist.
+	 */
+	static BlastResultBuffer *MapFile (const char *filename_s);
+
+
+	/**
+	 * Create a BlastResultBuffer that takes over a string.
+	 *
+	 * @param data_s The string which must have been allocated by the
+	 * Grassroots string functions. If this call succeeds, the buffer
+	 * will free it with FreeCopiedString, otherwise it is left untouched.
+	 * @return The new BlastResultBuffer or 0 upon error.
+	 */
+	static BlastResultBuffer *AdoptString (char *data_s);
+
+
+	/**
+	 * Create a BlastResultBuffer that takes over a block of memory
+	 * whose length is already known.
+	 *
+	 * @param data_s The data which must have been allocated with AllocMemory
+	 * or by the Grassroots string functions. If this call succeeds, the buffer
+	 * will free it, otherwise it is left untouched.
+	 * @param length The number of bytes of data.
+	 * @return The new BlastResultBuffer or 0 upon error.
+	 */
+	static BlastResultBuffer *AdoptData (char *data_s, const size_t length);
+
+
+	/**
+	 * The BlastResultBuffer destructor. This frees or unmaps the data.
+	 */
+	~BlastResultBuffer ();
+
+
+	/**
+	 * Get the data.
+	 *
+	 * @return The data which is not necessarily NUL-terminated.
+	 */
+	const char *GetData () const;
+
+
+	/**
+	 * Get the length of the data.
+	 *
+	 * @return The number of bytes of data.
+	 */
+	size_t GetLength () const;
+
+
+	/**
+	 * Get the data as a JSON string. The data is only copied the
+	 * once into the JSON string.
+	 *
+	 * @return The JSON string or <code>NULL</code> upon error, e.g.
+	 * if the data isn't valid UTF-8.
+	 */
+	json_t *GetAsJSONString () const;
+
+
+	/**
+	 * Parse the data as JSON directly from the buffer.
+	 *
+	 * @param error_p If this is not <code>NULL</code>, it will be
+	 * filled in with the details of any parse error.
+	 * @return The parsed JSON or <code>NULL</code> upon error.
+	 */
+	json_t *ParseAsJSON (json_error_t *error_p) const;
+
+
+	/**
+	 * Get a copy of the data as a c-style string for the code that
+	 * still needs one.
+	 *
+	 * @return The copy which should be freed with FreeCopiedString
+	 * or <code>NULL</code> upon error.
+	 */
+	char *CopyToString () const;
+
+
+private:
+	const char *brb_data_s;
+
+	size_t brb_length;
+
+	/** Is brb_data_s a mapping rather than an adopted string? */
+	bool brb_mapped_flag;
+
+	BlastResultBuffer (const char *data_s, const size_t length, const bool mapped_flag);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_RESULT_BUFFER_HPP_ */
@@ -0,0 +1,146 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_result_streamer.hpp
+ *
+ *  Created on: 21 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_RESULT_STREAMER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_RESULT_STREAMER_HPP_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+#include "jansson.h"
+
+
+/* forward declarations */
+struct StreamedJob;
+struct BlastServiceData;
+
+
+/**
+ * A BlastResultStreamer follows the output files of running Blast jobs
+ * and collects the results of each query as soon as Blast has written
+ * them, so that the finished queries of a large search can be returned
+ * while the rest are still being searched.
+ *
+ * Each time that the results of a job are asked for, only the part of its
+ * output that has been written since the last time is read. For the
+ * single-file JSON format, each query's report is parsed as soon as it is
+ * complete and, if asked for, converted to the Grassroots markup once. The
+ * results are only rebuilt when more queries have been completed and are
+ * shared between the callers rather than copied. Jobs are forgotten once
+ * their results haven't been asked for in a while. A single streamer is
+ * shared by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastResultStreamer
+{
+public:
+
+	/**
+	 * Get the BlastResultStreamer that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedBlastResultStreamer.
+	 *
+	 * @return The shared BlastResultStreamer or 0 upon error.
+	 */
+	static BlastResultStreamer *GetSharedBlastResultStreamer ();
+
+
+	/**
+	 * Release a reference to the shared BlastResultStreamer. When the last
+	 * reference is released, the streamer is freed.
+	 */
+	static void ReleaseSharedBlastResultStreamer ();
+
+
+	/**
+	 * Can the results be collected query by query while Blast is writing them
+	 * for a given output format?
+	 *
+	 * @param output_format The Blast output format code.
+	 * @return <code>true</code> if the results can be streamed, <code>false</code>
+	 * otherwise.
+	 */
+	static bool CanStreamOutputFormat (const uint32 output_format);
+
+
+	/**
+	 * Read any new output for a running job and get the results of all of
+	 * its queries that have been completed so far.
+	 *
+	 * @param job_id_s The uuid of the job.
+	 * @param output_filename_s The file that Blast is writing the job's results to.
+	 * @param output_format The output format that Blast is writing the results in.
+	 * @param markup_flag If this is <code>true</code> and the output format is
+	 * single-file JSON, the results are returned as Grassroots markup.
+	 * @param data_p The configuration data for the Blast service used for the markup.
+	 * @param num_queries_p Where the number of completed queries will be stored.
+	 * @return The results as a new json reference, which is a string for the raw
+	 * output formats or an object for the markup, or <code>NULL</code> upon error.
+	 */
+	json_t *GetCompletedResults (const char *job_id_s, const char *output_filename_s, const uint32 output_format, const bool markup_flag, BlastServiceData *data_p, uint32 *num_queries_p);
+
+
+	/**
+	 * Stop following a job, e.g. once it has finished, and free the
+	 * results that have been collected for it.
+	 *
+	 * @param job_id_s The uuid of the job.
+	 */
+	void Forget (const char *job_id_s);
+
+
+private:
+	static BlastResultStreamer *brs_shared_streamer_p;
+	static uint32 brs_shared_streamer_count;
+	static pthread_mutex_t brs_shared_streamer_mutex;
+
+	/** How long, in seconds, a job is kept after its results were last asked for. */
+	static const time_t BRS_EXPIRY_TIME;
+
+	struct StreamedJob *brs_jobs_p;
+
+	/**
+	 * This protects the list of jobs. Each job has its own lock for
+	 * reading its output so this is only held while finding the job.
+	 */
+	pthread_mutex_t brs_mutex;
+
+
+	BlastResultStreamer ();
+
+	~BlastResultStreamer ();
+
+	struct StreamedJob *GetJob (const char *job_id_s, const uint32 output_format);
+
+	void RemoveExpiredJobs (const time_t now);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_RESULT_STREAMER_HPP_ */
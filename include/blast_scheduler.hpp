@@ -0,0 +1,264 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_scheduler.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_SCHEDULER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_SCHEDULER_HPP_
+
+#include <pthread.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+
+
+/**
+ * The callback used to launch a job that has been waiting for cores
+ * with BlastScheduler::AddWaitingJob.
+ *
+ * @param data_p The data that was passed to BlastScheduler::AddWaitingJob.
+ * @param num_cores The number of cores that the job has been given, which
+ * must be returned with BlastScheduler::ReleaseCores once it has finished.
+ * If this is 0, the BlastScheduler is being freed and the job will never
+ * get any cores, so it should fail its job instead.
+ */
+typedef void (*BlastSchedulerAdmitFn) (void *data_p, uint32 num_cores);
+
+
+/* forward declaration */
+struct BlastSchedulerWaitingJob;
+
+
+/**
+ * The admission control for the Blast processes that are run within
+ * the server. A single BlastScheduler is shared by all of the Blast
+ * services so that, between them, they never use more than a given
+ * number of cores.
+ *
+ * A job first reserves a place in the queue, which fails if the queue
+ * is full, and then waits for enough cores to become free. Jobs are
+ * admitted in the order that they started waiting so that a job
+ * needing many cores is not starved by a stream of smaller ones.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastScheduler
+{
+public:
+
+	/**
+	 * The error message given to a job that is rejected because the
+	 * queue of jobs waiting to run is full.
+	 */
+	static const char * const BS_QUEUE_FULL_S;
+
+
+	/**
+	 * The error message given to a job that was still waiting
+	 * for cores when the BlastScheduler was freed.
+	 */
+	static const char * const BS_SHUTTING_DOWN_S;
+
+
+	/**
+	 * Get the BlastScheduler that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedBlastScheduler.
+	 *
+	 * @param max_cores The maximum number of cores that running jobs can use
+	 * if the scheduler needs creating. If this is 0, then the number of online
+	 * processors will be used.
+	 * @param max_queued_jobs The maximum number of jobs that can be waiting to
+	 * run if the scheduler needs creating.
+	 * @return The shared BlastScheduler or 0 upon error.
+	 */
+	static BlastScheduler *GetSharedBlastScheduler (uint32 max_cores, uint32 max_queued_jobs);
+
+
+	/**
+	 * Release a reference to the shared BlastScheduler. When the last
+	 * reference is released, the scheduler is freed.
+	 */
+	static void ReleaseSharedBlastScheduler ();
+
+
+	/**
+	 * Reserve a place in the queue of jobs waiting to run.
+	 *
+	 * @return <code>true</code> if a place was reserved, <code>false</code>
+	 * if the queue is full and the job should be rejected.
+	 */
+	bool ReserveQueueSlot ();
+
+
+	/**
+	 * Give back a place in the queue that was reserved with ReserveQueueSlot
+	 * for a job that will no longer be run.
+	 */
+	void CancelQueueSlot ();
+
+
+	/**
+	 * Wait until a job that has reserved a place in the queue can run.
+	 * Upon return the job no longer has a place in the queue and the cores
+	 * that it has been given must be returned with ReleaseCores once it has finished.
+	 *
+	 * @param num_cores The number of cores that the job will use.
+	 * @return The number of cores that the job has been given. This is num_cores
+	 * limited to the maximum number of cores for this BlastScheduler.
+	 */
+	uint32 WaitForCores (uint32 num_cores);
+
+
+	/**
+	 * Add a job that has reserved a place in the queue to the line of jobs
+	 * waiting for cores without blocking the calling thread. The job keeps
+	 * its place in line alongside those that call WaitForCores and, once it
+	 * is admitted, admit_fn is called to launch it. This happens on whichever
+	 * thread frees up the cores, which may be the calling thread before this
+	 * method returns.
+	 *
+	 * @param num_cores The number of cores that the job will use.
+	 * @param admit_fn The function to call once the job can run.
+	 * @param data_p The data to pass to admit_fn.
+	 * @return <code>true</code> if the job was added, <code>false</code>
+	 * upon error in which case the job still has its place in the queue.
+	 */
+	bool AddWaitingJob (uint32 num_cores, BlastSchedulerAdmitFn admit_fn, void *data_p);
+
+
+	/**
+	 * Take a job that was added with AddWaitingJob out of the line
+	 * along with its place in the queue.
+	 *
+	 * @param data_p The data that was passed to AddWaitingJob.
+	 * @return <code>true</code> if the job was still waiting and its
+	 * admit_fn will now never be called, <code>false</code> if it wasn't
+	 * found as it has already been admitted.
+	 */
+	bool RemoveWaitingJob (void *data_p);
+
+
+	/**
+	 * Return the cores given to a job by WaitForCores or AddWaitingJob.
+	 * This may launch any jobs added with AddWaitingJob that can now run.
+	 *
+	 * @param num_cores The value returned by WaitForCores or passed to the job's BlastSchedulerAdmitFn.
+	 */
+	void ReleaseCores (uint32 num_cores);
+
+
+	/**
+	 * Work out how many threads a job should use based upon the size of its
+	 * search and how busy the server is. A large search on an idle server will
+	 * use all of the cores whereas, when many jobs are waiting, each one will
+	 * get its share of the free cores.
+	 *
+	 * This should be called after the job has reserved its place in the
+	 * queue and before calling WaitForCores.
+	 *
+	 * @param query_size The size of the query in bytes.
+	 * @param db_size The size of the database's sequence data in bytes. If this
+	 * is 0, the size is unknown and the number of threads depends only upon
+	 * how busy the server is.
+	 * @param max_threads The maximum number of threads that the job can use.
+	 * If this is 0, then only the number of cores limits it.
+	 * @return The number of threads, which is always at least 1.
+	 */
+	uint32 GetNumThreadsForJob (uint64 query_size, uint64 db_size, uint32 max_threads);
+
+
+	/**
+	 * Get the maximum number of cores that the running jobs can use.
+	 *
+	 * @return The number of cores.
+	 */
+	uint32 GetMaxCores () const;
+
+
+	/**
+	 * Get the number of cores that are currently being used by running jobs.
+	 *
+	 * @return The number of cores.
+	 */
+	uint32 GetNumUsedCores ();
+
+
+	/**
+	 * Share the cores that a job has been given out between the parts
+	 * of its search, such as the chunks of its queries. If there are
+	 * fewer cores than parts, then as many parts are run at a time as
+	 * there are cores.
+	 *
+	 * @param num_cores The number of cores that the job has been given.
+	 * @param num_parts The number of parts of the search.
+	 * @param max_running_parts_p Where the number of parts that can run
+	 * at the same time will be stored.
+	 * @return The number of threads for each part.
+	 */
+	static uint32 ShareCores (const uint32 num_cores, const uint32 num_parts, uint32 *max_running_parts_p);
+
+private:
+	static BlastScheduler *bs_shared_scheduler_p;
+	static uint32 bs_shared_scheduler_count;
+	static pthread_mutex_t bs_shared_scheduler_mutex;
+
+	uint32 bs_max_cores;
+
+	uint32 bs_num_used_cores;
+
+	uint32 bs_max_queued_jobs;
+
+	uint32 bs_num_queued_jobs;
+
+	/** The ticket given to the next job that calls WaitForCores. */
+	uint32 bs_next_ticket;
+
+	/** The ticket of the job that is next in line to be admitted. */
+	uint32 bs_current_ticket;
+
+	/** The jobs added with AddWaitingJob, in the order of their tickets. */
+	struct BlastSchedulerWaitingJob *bs_waiting_jobs_p;
+
+	struct BlastSchedulerWaitingJob *bs_last_waiting_job_p;
+
+	pthread_mutex_t bs_mutex;
+
+	pthread_cond_t bs_cond;
+
+
+	BlastScheduler (uint32 max_cores, uint32 max_queued_jobs);
+
+	~BlastScheduler ();
+
+	uint32 LimitNumCores (uint32 num_cores) const;
+
+	struct BlastSchedulerWaitingJob *AdmitWaitingJobs ();
+
+	static void LaunchAdmittedJobs (struct BlastSchedulerWaitingJob *jobs_p);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_SCHEDULER_HPP_ */
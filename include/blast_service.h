@@ -126,12 +126,38 @@ typedef struct BLAST_SERVICE_LOCAL DatabaseInfo
 	 */
 	const char *di_scaffold_regex_s;
 
+	/**
+	 * An array of the names of the volumes that this database can be split
+	 * into so that they can be searched in parallel by separate Blast processes.
+	 * This defaults to NULL which means that the database is always
+	 * searched as a whole.
+	 */
+	const json_t *di_shards_p;
+
+	/**
+	 * The order in which the database is loaded into the page cache
+	 * when the service starts, with lower values going first. This
+	 * defaults to 0.
+	 */
+	int32 di_warm_priority;
+
 } DatabaseInfo;
 
 
 
 /* forward class declarations */
 class BlastToolFactory;
+class BlastScheduler;
+class BlastBatcher;
+class BlastDatabaseWarmer;
+class BlastProcessMonitor;
+class BlastProcessEnvelope;
+class BlastProgressTracker;
+class BlastResultStreamer;
+class ConvertedOutputCache;
+class SingleFlightConverter;
+class BlastResultBuffer;
+class BlastPreConverter;
 struct BlastServiceJob;
 
 /**
@@ -171,9 +197,176 @@ typedef struct BLAST_SERVICE_LOCAL BlastServiceData
 	AsyncTasksManager *bsd_task_manager_p;
 
 
+	/**
+	 * The maximum number of databases that a synchronous request will
+	 * search against at the same time.
+	 */
+	uint32 bsd_max_parallel_databases;
+
+
+	/**
+	 * The maximum number of threads that a single search run
+	 * within the server can use. If this is 0, then a search can
+	 * use all of the cores available to the BlastScheduler.
+	 */
+	uint32 bsd_max_threads_per_search;
+
+
+	/**
+	 * The BlastScheduler, shared with the other Blast services, that limits
+	 * how many cores the Blast processes run within the server can use.
+	 */
+	BlastScheduler *bsd_scheduler_p;
+
+
+	/**
+	 * The BlastBatcher, shared with the other Blast services, that merges
+	 * concurrent searches which only differ in their queries into a single
+	 * Blast process. If this is <code>NULL</code>, then each search is run
+	 * on its own.
+	 */
+	BlastBatcher *bsd_batcher_p;
+
+
+	/**
+	 * If this is <code>true</code>, then a synchronous request against several
+	 * databases is run as a single Blast process against an alias database
+	 * covering all of them, with the hits then split back up by database.
+	 */
+	bool bsd_combine_databases_flag;
+
+
+	/**
+	 * The blastdbcmd executable used to find which database each hit of a
+	 * combined search came from when the databases have parsed sequence ids.
+	 */
+	const char *bsd_blastdbcmd_command_s;
+
+
+	/**
+	 * The maximum number of chunks that a query file with several sequences
+	 * will be split into so that they can be searched by separate Blast
+	 * processes at the same time. If this is 0, then query files are
+	 * not split.
+	 */
+	uint32 bsd_max_query_chunks;
+
+
+	/**
+	 * The BlastDatabaseWarmer that keeps this service's active databases
+	 * in the page cache. If this is <code>NULL</code>, then the databases
+	 * are left to be loaded by the searches.
+	 */
+	BlastDatabaseWarmer *bsd_warmer_p;
+
+
+	/**
+	 * The BlastProcessMonitor, shared with the other Blast services, that
+	 * keeps track of the Blast processes run within the server so that
+	 * they can be cancelled or stopped once their time limit has passed.
+	 */
+	BlastProcessMonitor *bsd_monitor_p;
+
+
+	/**
+	 * The maximum number of seconds that a Blast job can run for before
+	 * it is stopped. If this is 0, then jobs can run for as long as they need.
+	 */
+	uint32 bsd_job_time_limit;
+
+
+	/**
+	 * An optional JSON object of time limits, in seconds, for particular
+	 * Blast tasks, e.g. "megablast", that override bsd_job_time_limit.
+	 */
+	const json_t *bsd_task_time_limits_p;
+
+
+	/**
+	 * The memory, cpu and io limits for each of the Blast processes
+	 * run within the server. If this is <code>NULL</code>, then the
+	 * processes are not limited.
+	 */
+	BlastProcessEnvelope *bsd_envelope_p;
+
+
+	/**
+	 * The BlastProgressTracker, shared with the other Blast services, that
+	 * follows the output and log files of the running Blast jobs so that
+	 * their progress can be reported.
+	 */
+	BlastProgressTracker *bsd_progress_tracker_p;
+
+
+	/**
+	 * The BlastResultStreamer, shared with the other Blast services, that
+	 * collects the results of each query of a running job as soon as they
+	 * have been written. If this is <code>NULL</code>, then the results are
+	 * only available once the whole job has finished.
+	 */
+	BlastResultStreamer *bsd_streamer_p;
+
+
+	/**
+	 * The ConvertedOutputCache, shared with the other Blast services, that
+	 * keeps track of the job outputs that have been converted into other
+	 * formats. If this is <code>NULL</code>, then the converted files are
+	 * looked for on disk each time and are never deleted.
+	 */
+	ConvertedOutputCache *bsd_output_cache_p;
+
+
+	/**
+	 * The SingleFlightConverter, shared with the other Blast services, that
+	 * makes sure that only one conversion or markup of a given job's output
+	 * runs at a time. If this is <code>NULL</code>, then each request runs
+	 * its own conversion.
+	 */
+	SingleFlightConverter *bsd_flights_p;
+
+
+	/**
+	 * The zstd compression level used for the files of finished jobs and
+	 * their converted outputs. If this is 0, then the files are left
+	 * uncompressed.
+	 */
+	int32 bsd_compression_level;
+
+
+	/**
+	 * The BlastPreConverter that converts the output of each finished job
+	 * into the commonly requested formats in the background. It also
+	 * compresses the files of each finished job if bsd_compression_level
+	 * is set. If this is <code>NULL</code>, then outputs are only converted
+	 * when they are requested.
+	 */
+	BlastPreConverter *bsd_pre_converter_p;
+
 } BlastServiceData;
 
 
+/**
+ * The part of the hits of a previously run job's results that
+ * have been asked for.
+ *
+ * @ingroup blast_service
+ */
+typedef struct BLAST_SERVICE_LOCAL BlastResultsPage
+{
+	/**
+	 * The 1-based index of the query whose hits are wanted. If this is 0,
+	 * then the hits of all of the queries are numbered consecutively.
+	 */
+	uint32 brp_query_index;
+
+	/** The number of hits to skip. */
+	uint32 brp_hits_offset;
+
+	/** The maximum number of hits to get or 0 for all of them. */
+	uint32 brp_hits_limit;
+} BlastResultsPage;
+
+
 /**
  * A callback function used to amend a given ParameterSet.
  *
@@ -217,6 +410,12 @@ BLAST_SERVICE_PREFIX const char *BS_OUTPUT_SUFFIX_S BLAST_SERVICE_VAL (".output"
 /** The suffix to use for Blast Service log files. */
 BLAST_SERVICE_PREFIX const char *BS_LOG_SUFFIX_S BLAST_SERVICE_VAL (".log");
 
+/** The suffix appended to the name of a Blast Service file once it has been compressed. */
+BLAST_SERVICE_PREFIX const char *BS_COMPRESSED_SUFFIX_S BLAST_SERVICE_VAL (".zst");
+
+/** The suffix to use for the index of the hits in a Blast Service job's single-file JSON output. */
+BLAST_SERVICE_PREFIX const char *BS_HIT_INDEX_SUFFIX_S BLAST_SERVICE_VAL (".hit_index");
+
 /**
  * The default output format as a string to use.
  *
@@ -247,6 +446,202 @@ BLAST_SERVICE_PREFIX const char *BS_COMMAND_NAME_S BLAST_SERVICE_VAL ("blast_com
 BLAST_SERVICE_PREFIX const char *BS_APP_NAME_S BLAST_SERVICE_VAL ("blast_app_type");
 
 
+/**
+ * The configuration key used to declare the maximum number of databases that
+ * a synchronous request will search against concurrently.
+ */
+BLAST_SERVICE_PREFIX const char *BS_MAX_PARALLEL_DATABASES_S BLAST_SERVICE_VAL ("max_parallel_databases");
+
+
+/**
+ * The configuration key used to declare the maximum number of cores that the
+ * Blast processes run by all of the Blast services within the server can use
+ * between them.
+ */
+BLAST_SERVICE_PREFIX const char *BS_MAX_CORES_S BLAST_SERVICE_VAL ("max_cores");
+
+
+/**
+ * The configuration key used to declare the maximum number of Blast jobs
+ * that can be waiting for cores to become free before any further jobs
+ * are rejected.
+ */
+BLAST_SERVICE_PREFIX const char *BS_MAX_QUEUED_JOBS_S BLAST_SERVICE_VAL ("max_queued_jobs");
+
+
+/**
+ * The configuration key used to declare the maximum number of threads that
+ * a single Blast process run within the server can use.
+ */
+BLAST_SERVICE_PREFIX const char *BS_MAX_THREADS_PER_SEARCH_S BLAST_SERVICE_VAL ("max_threads_per_search");
+
+
+/** The default maximum number of Blast jobs that can be waiting to run. */
+#define BS_DEFAULT_MAX_QUEUED_JOBS	(256)
+
+
+/**
+ * The configuration key used to declare how long, in milliseconds, a search
+ * waits for other searches against the same databases to join it in a single
+ * Blast process. If this is 0, then searches are not batched.
+ */
+BLAST_SERVICE_PREFIX const char *BS_BATCH_WINDOW_MS_S BLAST_SERVICE_VAL ("batch_window_ms");
+
+
+/**
+ * The configuration key used to declare the number of queries that will
+ * cause a batch of searches to be run before its window has finished.
+ */
+BLAST_SERVICE_PREFIX const char *BS_BATCH_MAX_QUERIES_S BLAST_SERVICE_VAL ("batch_max_queries");
+
+
+/** The default number of queries that will cause a batch to be run. */
+#define BS_DEFAULT_BATCH_MAX_QUERIES	(64)
+
+
+/**
+ * The configuration key used to specify whether a synchronous request against
+ * several databases should be run as a single Blast process.
+ */
+BLAST_SERVICE_PREFIX const char *BS_COMBINE_DATABASES_S BLAST_SERVICE_VAL ("combine_databases");
+
+
+/**
+ * The configuration key used to specify the blastdbcmd executable used
+ * when splitting the results of a combined search up by database.
+ */
+BLAST_SERVICE_PREFIX const char *BS_BLASTDBCMD_COMMAND_S BLAST_SERVICE_VAL ("blastdbcmd_command");
+
+
+/**
+ * The configuration key used to declare the maximum number of chunks
+ * that a query file with several sequences will be split into.
+ */
+BLAST_SERVICE_PREFIX const char *BS_MAX_QUERY_CHUNKS_S BLAST_SERVICE_VAL ("max_query_chunks");
+
+
+/**
+ * The configuration key used to declare the number of megabytes of
+ * database files to keep in the page cache. If this is 0, then the
+ * databases are not warmed.
+ */
+BLAST_SERVICE_PREFIX const char *BS_WARM_DATABASES_BUDGET_MB_S BLAST_SERVICE_VAL ("warm_databases_budget_mb");
+
+
+/**
+ * The configuration key used to declare how often, in seconds, the
+ * warmed databases are checked and reloaded into the page cache.
+ */
+BLAST_SERVICE_PREFIX const char *BS_WARM_DATABASES_INTERVAL_S BLAST_SERVICE_VAL ("warm_databases_interval");
+
+
+/** The default number of seconds between checks of the warmed databases. */
+#define BS_DEFAULT_WARM_DATABASES_INTERVAL	(300)
+
+
+/**
+ * The configuration key used to declare the maximum number of seconds
+ * that a Blast job can run for. If this is 0, then there is no limit.
+ */
+BLAST_SERVICE_PREFIX const char *BS_JOB_TIME_LIMIT_S BLAST_SERVICE_VAL ("job_time_limit");
+
+
+/**
+ * The configuration key used to declare the time limits, in seconds,
+ * for particular Blast tasks which override the job_time_limit.
+ */
+BLAST_SERVICE_PREFIX const char *BS_TASK_TIME_LIMITS_S BLAST_SERVICE_VAL ("task_time_limits");
+
+
+/**
+ * The configuration key used to declare the object of memory, cpu
+ * and io limits for each Blast process.
+ *
+ * @see BlastProcessEnvelope
+ */
+BLAST_SERVICE_PREFIX const char *BS_PROCESS_LIMITS_S BLAST_SERVICE_VAL ("process_limits");
+
+
+/**
+ * The configuration key used to specify whether the results of the completed
+ * queries of a running job can be retrieved before the whole job has finished.
+ */
+BLAST_SERVICE_PREFIX const char *BS_STREAM_RESULTS_S BLAST_SERVICE_VAL ("stream_results");
+
+
+/**
+ * The key added to a result of a running job, when it is retrieved by its
+ * job id, to show that it only has the results of the queries that have
+ * been completed so far.
+ */
+BLAST_SERVICE_PREFIX const char *BS_MORE_RESULTS_PENDING_S BLAST_SERVICE_VAL ("more_results_pending");
+
+
+/**
+ * The key added to a result of a running job for the number of queries
+ * whose results it has.
+ */
+BLAST_SERVICE_PREFIX const char *BS_QUERIES_COMPLETED_S BLAST_SERVICE_VAL ("queries_completed");
+
+
+/**
+ * The key added to a page of a job's results for the number of hits
+ * that there are to page through.
+ */
+BLAST_SERVICE_PREFIX const char *BS_TOTAL_HITS_S BLAST_SERVICE_VAL ("total_hits");
+
+
+/**
+ * The key added to a page of a job's results for the number of hits
+ * that are on the page.
+ */
+BLAST_SERVICE_PREFIX const char *BS_HITS_RETURNED_S BLAST_SERVICE_VAL ("hits_returned");
+
+
+/**
+ * The key added to a page of a job's results for the number of queries
+ * that the job has results for.
+ */
+BLAST_SERVICE_PREFIX const char *BS_TOTAL_QUERIES_S BLAST_SERVICE_VAL ("total_queries");
+
+
+/**
+ * The configuration key used to declare the number of megabytes that the
+ * converted job outputs can take up on disk before the least recently used
+ * ones are deleted.
+ */
+BLAST_SERVICE_PREFIX const char *BS_CONVERTED_OUTPUT_DISK_BUDGET_MB_S BLAST_SERVICE_VAL ("converted_output_disk_budget_mb");
+
+
+/**
+ * The configuration key used to declare the number of megabytes of the
+ * most recently used converted job outputs to keep in memory.
+ */
+BLAST_SERVICE_PREFIX const char *BS_CONVERTED_OUTPUT_MEMORY_BUDGET_MB_S BLAST_SERVICE_VAL ("converted_output_memory_budget_mb");
+
+
+/**
+ * The configuration key used to declare the zstd compression level to use
+ * for the files of finished jobs and their converted outputs. If this is
+ * not set or is 0, then the files are not compressed.
+ */
+BLAST_SERVICE_PREFIX const char *BS_COMPRESSION_LEVEL_S BLAST_SERVICE_VAL ("compression_level");
+
+
+/**
+ * The configuration key used to declare the array of output format codes
+ * that the output of each finished job is converted into in the background.
+ */
+BLAST_SERVICE_PREFIX const char *BS_PRE_CONVERT_FORMATS_S BLAST_SERVICE_VAL ("pre_convert_formats");
+
+
+/**
+ * The configuration key used to declare the number of threads that
+ * convert the outputs of finished jobs in the background.
+ */
+BLAST_SERVICE_PREFIX const char *BS_PRE_CONVERT_THREADS_S BLAST_SERVICE_VAL ("pre_convert_threads");
+
+
 /** The prefix to use for Blast Service aliases. */
 #define BS_GROUP_ALIAS_PREFIX_S "blast"
 
@@ -399,6 +794,33 @@ BLAST_SERVICE_LOCAL bool DetermineBlastResult ( struct BlastServiceJob *job_p);
 BLAST_SERVICE_LOCAL OperationStatus GetBlastServiceStatus (Service *service_p, const uuid_t service_id);
 
 
+/**
+ * Cancel a running BlastServiceJob with the given job id. Any Blast
+ * processes that it has started are stopped and the job is marked
+ * as having failed.
+ *
+ * @param service_p The Blast Service of the type which ran the BlastServiceJob.
+ * @param job_id The UUID for the given BlastServiceJob.
+ * @return <code>true</code> if the job was found and is being cancelled,
+ * <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool CancelBlastServiceJob (Service *service_p, const uuid_t job_id);
+
+
+/**
+ * Get the time limit for a Blast job.
+ *
+ * @param data_p The configuration data for the Blast Service.
+ * @param task_s The Blast task that the job is running or <code>NULL</code>
+ * if it was not specified.
+ * @return The maximum number of seconds that the job can run for or
+ * 0 if there is no limit.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL uint32 GetBlastJobTimeLimit (const BlastServiceData *data_p, const char *task_s);
+
+
 /**
  * Get the TempFile detailing the query for a given BlastServiceJob UUID.
  *
@@ -440,6 +862,69 @@ BLAST_SERVICE_LOCAL char *GetBlastResultByUUID (const BlastServiceData *data_p,
 BLAST_SERVICE_LOCAL char *GetBlastResultByUUIDString (const BlastServiceData *data_p, const char *job_id_s, const uint32 output_format_code, const char *output_format_params_s);
 
 
+/**
+ * Get the result of a previously ran BlastServiceJob in a given output format
+ * without copying any of the files that it is read from onto the heap.
+ *
+ * @param data_p The BlastServiceData of the Blast Service that ran the job.
+ * @param job_id_s The ServiceJob identifier, as a string, to get the results for.
+ * @param output_format_code The required output format code.
+ * @param output_format_params_s The custom columns for the output format or <code>NULL</code>
+ * for the default ones.
+ * @return A BlastResultBuffer containing the results in the requested format, which
+ * should be deleted once it is no longer needed, or <code>NULL</code> upon error.
+ * @see GetBlastResultByUUIDString
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL BlastResultBuffer *GetBlastResultBufferByUUIDString (const BlastServiceData *data_p, const char *job_id_s, const uint32 output_format_code, const char *output_format_params_s);
+
+
+/**
+ * Use a BlastFormatter to convert the output of a previously ran BlastServiceJob
+ * into a given output format. If another request is already converting the same
+ * job's output into the same format, this waits for it and returns a copy of its
+ * result rather than running the formatter again. Any newly converted output is
+ * added to the Blast Service's ConvertedOutputCache.
+ *
+ * @param data_p The BlastServiceData of the Blast Service that ran the job.
+ * @param formatter_p The BlastFormatter to use.
+ * @param job_id_s The ServiceJob identifier, as a string, to convert the results for.
+ * @param job_output_filename_s The filename of the job's output.
+ * @param output_format_code The required output format code.
+ * @param output_format_params_s The custom columns for the output format or <code>NULL</code>
+ * for the default ones.
+ * @return A newly-allocated string containing the results in the requested format
+ * or <code>NULL</code> upon error.
+ * @see GetBlastResultByUUIDString
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL char *ConvertBlastResult (const BlastServiceData *data_p, BlastFormatter *formatter_p, const char *job_id_s, const char *job_output_filename_s, const uint32 output_format_code, const char *output_format_params_s);
+
+
+/**
+ * Compress the files of a finished BlastServiceJob using the Blast Service's
+ * compression level.
+ *
+ * @param data_p The BlastServiceData of the Blast Service that ran the job.
+ * @param job_id_s The ServiceJob identifier, as a string, whose files will be compressed.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL void CompressBlastJobFiles (const BlastServiceData *data_p, const char *job_id_s);
+
+
+/**
+ * Index the hits in the single-file JSON output of a finished BlastServiceJob
+ * so that pages of them can be got without reading the whole output. If the
+ * job doesn't have an output in this format, nothing is done.
+ *
+ * @param data_p The BlastServiceData of the Blast Service that ran the job.
+ * @param job_id_s The ServiceJob identifier, as a string, whose hits will be indexed.
+ * @return <code>true</code> if the hits were indexed, <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool IndexBlastJobHits (const BlastServiceData *data_p, const char *job_id_s);
+
+
 /**
  * Get the results of previously ran BlastServiceJobs in a given output format.
  *
@@ -447,19 +932,24 @@ BLAST_SERVICE_LOCAL char *GetBlastResultByUUIDString (const BlastServiceData *da
  * ServiceJobs.
  * @param blast_data_p The BlastServiceData of the Blast Service that ran the job.
  * @param output_format_code The required output format code.
+ * @param output_format_params_s The custom columns for the output format or <code>NULL</code>
+ * for the default ones.
+ * @param page_p If this is not <code>NULL</code>, only this page of the hits of each job
+ * is got. This is only available for the single-file JSON and Grassroots markup
+ * output formats.
  * @return A newly-allocated ServiceJobSet containing the results in the requested format
  * or <code>NULL</code> upon error.
  * @see GetBlastResultByUUIDString
  * @see CreateJobsForPreviousResults
  * @ingroup blast_service
  */
-BLAST_SERVICE_LOCAL ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, BlastServiceData *blast_data_p, const uint32 output_format_code, const char *output_format_params_s);
+BLAST_SERVICE_LOCAL ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, BlastServiceData *blast_data_p, const uint32 output_format_code, const char *output_format_params_s, const BlastResultsPage *page_p);
 
 
 /**
  * Get the results of previously ran BlastServiceJobs in a given output format.
  *
- * @param params_p The ParameterSet to get the output format from.
+ * @param params_p The ParameterSet to get the output format and the page of hits from.
  * @param ids_s A string containing UUIDs separated by whitespace.
  * @param blast_data_p The Blast Service configuration data.
  * @return The ServiceJobSet containing the results in the requested output format
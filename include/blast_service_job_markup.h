@@ -123,7 +123,9 @@ BLAST_SERVICE_LOCAL const json_t *GetScaffoldsForDatabaseHit (const json_t *hit_
 
 
 /**
- * Get the Grassroots marked-up data from a BlastServiceJob.
+ * Get the Grassroots marked-up data from a BlastServiceJob. If the same
+ * job's output is already being marked up, this waits for that to finish
+ * and returns a copy of its result.
  *
  * @param job_p The BlastServiceJob to get the marked-up result for.
  * @return The JSON fragment containing the marked-up data or <code>
@@ -137,6 +139,24 @@ BLAST_SERVICE_LOCAL json_t *MarkUpBlastResult (BlastServiceJob *job_p);
 BLAST_SERVICE_LOCAL json_t *ConvertBlastResultToGrassrootsMarkUp (const json_t *blast_job_output_p, BlastServiceData *data_p);
 
 
+/**
+ * Get the Grassroots marked-up data from the output of a previously ran
+ * BlastServiceJob in single-file JSON format. If the same job's output is
+ * already being marked up, this waits for that to finish and returns a copy
+ * of its result.
+ *
+ * @param job_id_s The ServiceJob identifier, as a string.
+ * @param blast_output_s The job's output in single-file JSON format. This does
+ * not need to be NUL-terminated.
+ * @param blast_output_length The length of blast_output_s.
+ * @param data_p The BlastServiceData of the Blast Service that ran the job.
+ * @return The JSON fragment containing the marked-up data or <code>
+ * NULL</code> upon error.
+ * @memberof BlastServiceJob
+ */
+BLAST_SERVICE_LOCAL json_t *ConvertBlastResultStringToGrassrootsMarkUp (const char *job_id_s, const char *blast_output_s, const size_t blast_output_length, BlastServiceData *data_p);
+
+
 
 BLAST_SERVICE_LOCAL json_t *GetMarkupReports (json_t *markup_p);
 
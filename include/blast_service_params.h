@@ -121,6 +121,40 @@ extern const char *BSP_OUTPUT_FORMATS_SS [BOF_NUM_TYPES];
  */
 BLAST_SERVICE_PREFIX NamedParameterType BS_JOB_ID BLAST_SERVICE_STRUCT_VAL ("job_id", PT_STRING);
 
+/**
+ * The Blast Service NamedParameterType for cancelling the jobs
+ * given by BS_JOB_ID rather than just getting their results.
+ *
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_PREFIX NamedParameterType BS_CANCEL_JOBS BLAST_SERVICE_STRUCT_VAL ("cancel_jobs", PT_BOOLEAN);
+
+/**
+ * The Blast Service NamedParameterType for specifying which query's hits
+ * to get from the results of previous jobs, starting from 1. If this is 0,
+ * then the hits of all of the queries are paged through together.
+ *
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_PREFIX NamedParameterType BS_QUERY_INDEX BLAST_SERVICE_STRUCT_VAL ("query_index", PT_UNSIGNED_INT);
+
+/**
+ * The Blast Service NamedParameterType for specifying the number of hits
+ * to skip in the results of previous jobs.
+ *
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_PREFIX NamedParameterType BS_HITS_OFFSET BLAST_SERVICE_STRUCT_VAL ("hits_offset", PT_UNSIGNED_INT);
+
+/**
+ * The Blast Service NamedParameterType for specifying the maximum number of
+ * hits to get from the results of previous jobs. If this is 0, then all
+ * of the hits after BS_HITS_OFFSET are got.
+ *
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_PREFIX NamedParameterType BS_HITS_LIMIT BLAST_SERVICE_STRUCT_VAL ("hits_limit", PT_UNSIGNED_INT);
+
 /*
  * These become the -query_loc parameter with the value "<subrange_from>-<subrange_to>"
  */
@@ -293,7 +327,8 @@ BLAST_SERVICE_LOCAL uint32 GetNumberOfDatabases (const BlastServiceData *data_p,
 
 
 /**
- * Create the Parameter for specifying the UUIDs for any previous Blast searches.
+ * Create the Parameter for specifying the UUIDs for any previous Blast searches
+ * along with the one for cancelling them.
  *
  * @param service_data_p The configuration data for the Blast Service.
  * @param param_set_p The ParameterSet that the UUID Parameter will be added to.
@@ -304,6 +339,19 @@ BLAST_SERVICE_LOCAL uint32 GetNumberOfDatabases (const BlastServiceData *data_p,
 BLAST_SERVICE_LOCAL Parameter *SetUpPreviousJobUUIDParameter (const BlastServiceData *service_data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
 
 
+/**
+ * Create the Parameters for specifying which page of the hits to get from
+ * the results of any previous Blast searches.
+ *
+ * @param service_data_p The configuration data for the Blast Service.
+ * @param param_set_p The ParameterSet that the Parameters will be added to.
+ * @param group_p The optional ParameterGroup to add the generated Parameters to. This can be <code>NULL</code>.
+ * @return <code>true</code> if the Parameters were added successfully, <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool SetUpPreviousJobResultsPageParameters (const BlastServiceData *service_data_p, ParameterSet *param_set_p, ParameterGroup *group_p);
+
+
 /**
  * Create the Parameter for specifying the output format from a Blast search.
  *
@@ -0,0 +1,150 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * blast_thread_pool.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_THREAD_POOL_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_THREAD_POOL_HPP_
+
+#include <pthread.h>
+
+#include "blast_service_api.h"
+#include "linked_list.h"
+#include "typedefs.h"
+
+
+/**
+ * The signature of the functions that a BlastThreadPool calls for
+ * each of its tasks.
+ *
+ * @param data_p The data that was passed to BlastThreadPool::AddTask.
+ */
+typedef void (*BlastThreadPoolTaskFn) (void *data_p);
+
+
+/* forward declarations */
+struct BlastThreadPoolWorker;
+struct BlastThreadPoolTaskNode;
+
+
+/**
+ * A fixed-size pool of threads for running tasks within the
+ * server process.
+ *
+ * Each thread has its own queue of tasks and any thread that
+ * runs out of work will steal tasks from the other queues. The tasks
+ * are whole searches rather than parts of one, so each thread takes
+ * the oldest task from its own queue as well as when stealing, so
+ * that the searches are run in about the order that they arrived.
+ * A single pool is shared by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL BlastThreadPool
+{
+public:
+
+	/**
+	 * Get the BlastThreadPool that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedBlastThreadPool.
+	 *
+	 * @param num_threads The number of threads to use if the pool needs creating.
+	 * If this is 0, then the number of online processors will be used.
+	 * @return The shared BlastThreadPool or 0 upon error.
+	 */
+	static BlastThreadPool *GetSharedBlastThreadPool (uint32 num_threads);
+
+
+	/**
+	 * Release a reference to the shared BlastThreadPool. When the last
+	 * reference is released, the pool is shut down and freed. It stops
+	 * accepting tasks, the tasks that are still queued are stopped without
+	 * being run and those that are running are stopped too. This then waits
+	 * for the threads to finish.
+	 */
+	static void ReleaseSharedBlastThreadPool ();
+
+
+	/**
+	 * Add a task to be run by this BlastThreadPool.
+	 *
+	 * @param task_fn The function to run.
+	 * @param stop_fn The function to call if the pool is shut down before
+	 * the task has finished. If the task is running, this must make task_fn
+	 * return as soon as possible, otherwise the task will never be run. It is
+	 * called with a lock held so it must not wait for task_fn.
+	 * @param free_fn The function to free data_p. This is called once task_fn
+	 * has returned or, if the task is never run, after stop_fn.
+	 * @param data_p The data to pass to task_fn, stop_fn and free_fn.
+	 * @return <code>true</code> if the task was queued successfully,
+	 * <code>false</code> otherwise in which case the caller still
+	 * owns data_p.
+	 */
+	bool AddTask (BlastThreadPoolTaskFn task_fn, BlastThreadPoolTaskFn stop_fn, BlastThreadPoolTaskFn free_fn, void *data_p);
+
+
+	/**
+	 * Get the number of threads in this BlastThreadPool.
+	 *
+	 * @return The number of threads.
+	 */
+	uint32 GetNumThreads () const;
+
+
+private:
+	static BlastThreadPool *btp_shared_pool_p;
+	static uint32 btp_shared_pool_count;
+	static pthread_mutex_t btp_shared_pool_mutex;
+
+	/** The workers each with their own thread and queue of tasks. */
+	struct BlastThreadPoolWorker *btp_workers_p;
+
+	uint32 btp_num_workers;
+
+	/** The worker whose queue will get the next task. */
+	uint32 btp_next_worker;
+
+	/** The number of tasks that are waiting to be picked up. */
+	int32 btp_num_queued_tasks;
+
+	bool btp_running_flag;
+
+	pthread_mutex_t btp_mutex;
+
+	pthread_cond_t btp_cond;
+
+
+	BlastThreadPool (uint32 num_threads);
+
+	~BlastThreadPool ();
+
+	struct BlastThreadPoolTaskNode *GetNextTask (uint32 worker_index);
+
+	static void *RunWorker (void *data_p);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_BLAST_THREAD_POOL_HPP_ */
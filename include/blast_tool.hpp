@@ -34,6 +34,8 @@
 /* forward declaration */
 struct BlastServiceData;
 struct BlastServiceJob;
+class CombinedDatabaseSearch;
+class BlastResultBuffer;
 
 /**
  * The base class for running Blast.
@@ -146,6 +148,27 @@ public:
 	virtual OperationStatus GetStatus (bool update_flag = true);
 
 
+	/**
+	 * Stop this BlastTool's running search along with any
+	 * processes that it has started.
+	 *
+	 * @return <code>true</code> if the search is being stopped,
+	 * <code>false</code> otherwise. The default implementation returns
+	 * <code>false</code>.
+	 */
+	virtual bool Cancel ();
+
+
+	/**
+	 * Get how far through its search this BlastTool's running job is.
+	 *
+	 * @return The progress as a json object or <code>0</code> if the
+	 * job isn't running or its progress can't be followed. The default
+	 * implementation returns <code>0</code>.
+	 */
+	virtual json_t *GetProgressAsJSON ();
+
+
 	/**
 	 * Get the results after the ExternalBlastTool has finished
 	 * running.
@@ -157,6 +180,21 @@ public:
 	 */
 	virtual char *GetResults (BlastFormatter *formatter_p) = 0;
 
+
+	/**
+	 * Get the results after the BlastTool has finished running
+	 * without copying them onto the heap if they can be read
+	 * straight from a file. The default implementation takes
+	 * over the value from GetResults.
+	 *
+	 * @param formatter_p The BlastFormatter to convert the results
+	 * into a different format. If this is 0, then the results will be
+	 * returned without any conversion.
+	 * @return A BlastResultBuffer with the results, which should be
+	 * deleted once it is no longer needed, or 0 upon error.
+	 */
+	virtual BlastResultBuffer *GetResultsBuffer (BlastFormatter *formatter_p);
+
 	/**
 	 * Get the log after the BlastTool has finished
 	 * running.
@@ -169,6 +207,42 @@ public:
 	virtual bool AddErrorDetails ();
 
 
+	/**
+	 * Add the database for this BlastTool to a CombinedDatabaseSearch
+	 * so that it can be searched by a single Blast process alongside the
+	 * other selected databases.
+	 *
+	 * @param search_p The CombinedDatabaseSearch to add the database to.
+	 * @return <code>true</code> if this BlastTool can take part in the
+	 * CombinedDatabaseSearch and its database was added successfully,
+	 * <code>false</code> otherwise. The default implementation returns
+	 * <code>false</code>.
+	 */
+	virtual bool AddToCombinedDatabaseSearch (CombinedDatabaseSearch *search_p);
+
+
+	/**
+	 * Run a CombinedDatabaseSearch using the arguments of this BlastTool
+	 * and wait for it to finish. This does not update the results of this
+	 * BlastTool's ServiceJob, that is done by CompleteRun once the results
+	 * have been split up between the databases.
+	 *
+	 * @param search_p The CombinedDatabaseSearch to run.
+	 * @return The OperationStatus of the Blast process. The default implementation
+	 * returns OS_FAILED_TO_START.
+	 */
+	virtual OperationStatus RunCombinedDatabaseSearch (CombinedDatabaseSearch *search_p);
+
+
+	/**
+	 * Update this BlastTool's ServiceJob after its Blast process has finished.
+	 *
+	 * @param status The OperationStatus of the Blast process.
+	 * @return The OperationStatus of the ServiceJob.
+	 */
+	virtual OperationStatus CompleteRun (OperationStatus status);
+
+
 	/**
 	 * Get the uuid for the ServiceJob that this BlastTool
 	 * is linked with.
@@ -239,6 +313,13 @@ protected:
 	char *bt_custom_output_columns_s;
 
 
+	/**
+	 * The time that this BlastTool's job was started
+	 * or 0 if it hasn't been started yet.
+	 */
+	time_t bt_start_time;
+
+
 	/**
 	 * @private
 	 *
@@ -272,6 +353,7 @@ private:
 	static const char * const BT_FACTORY_NAME_S;
 	static const char * const BT_OUTPUT_FORMAT_S;
 	static const char * const BT_CUSTOM_OUTPUT_COLUMNS_S;
+	static const char * const BT_START_TIME_S;
 
 };
 
@@ -325,6 +407,17 @@ BLAST_SERVICE_LOCAL OperationStatus RunBlast (BlastTool *tool_p);
 BLAST_SERVICE_LOCAL OperationStatus GetBlastStatus (BlastTool *tool_p);
 
 
+/**
+ * Cancel the running search of a BlastTool.
+ *
+ * @param tool_p The BlastTool to cancel.
+ * @return <code>true</code> if the search is being stopped, <code>false</code>
+ * otherwise.
+ * @memberof BlastTool
+ */
+BLAST_SERVICE_LOCAL bool CancelBlast (BlastTool *tool_p);
+
+
 /**
  * Is the BlastTool going to run asynchronously?
  *
@@ -106,6 +106,21 @@ public:
 	virtual Synchronicity GetToolsSynchronicity () const = 0;
 
 
+	/**
+	 * Run the BlastTools for the jobs of a single request, one for each
+	 * selected database, together rather than one at a time. This allows
+	 * a factory to submit them to a scheduler with a single request.
+	 *
+	 * @param tools_pp The BlastTools, which have all been prepared to run.
+	 * @param num_tools The number of BlastTools.
+	 * @param data_p The BlastServiceData for the Service that is running the BlastTools.
+	 * @return <code>true</code> if all of the BlastTools were run, <code>false</code>
+	 * if none of them were and they need running separately. The default implementation
+	 * returns <code>false</code>.
+	 */
+	virtual bool RunBlastToolsTogether (BlastTool **tools_pp, const uint32 num_tools, const BlastServiceData *data_p);
+
+
 protected:
 	/**
 	 * The JSON fragment containing the configuration data for this BlastToolFactory
@@ -153,6 +168,20 @@ BLAST_SERVICE_LOCAL void FreeBlastToolFactory (BlastToolFactory *factory_p);
 BLAST_SERVICE_LOCAL Synchronicity GetBlastToolFactorySynchronicity (BlastToolFactory *factory_p);
 
 
+/**
+ * Run the BlastTools for the jobs of a single request together.
+ *
+ * @param factory_p The BlastToolFactory that created the BlastTools.
+ * @param tools_pp The BlastTools to run.
+ * @param num_tools The number of BlastTools.
+ * @param data_p The BlastServiceData for the Service that is running the BlastTools.
+ * @return <code>true</code> if all of the BlastTools were run, <code>false</code>
+ * if they need running separately.
+ * @see BlastToolFactory::RunBlastToolsTogether
+ */
+BLAST_SERVICE_LOCAL bool RunBlastToolsTogetherFromFactory (BlastToolFactory *factory_p, BlastTool **tools_pp, const uint32 num_tools, const BlastServiceData *data_p);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -156,6 +156,58 @@ BLAST_SERVICE_LOCAL char *GetBlastJobFilename (const char * const prefix_s, cons
 BLAST_SERVICE_LOCAL char *GetBlastJobFilenameByUuid (const char * const prefix_s, const uuid_t id, const char * const suffix_s);
 
 
+/**
+ * Get the size of the sequence data for a Blast database. As Blast
+ * does, the database is looked for in the directories listed in the
+ * BLASTDB environment variable and alias databases are followed to
+ * the databases that they list.
+ *
+ * @param db_s The name of the database as passed to the "-db" argument.
+ * @return The total size in bytes of the database's sequence files, including
+ * all of its volumes, or 0 if they could not be found.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL uint64 GetBlastDatabaseSize (const char *db_s);
+
+
+/**
+ * Get the size of a file.
+ *
+ * @param filename_s The file to check.
+ * @return The size of the file in bytes or 0 if it does not exist.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL uint64 GetBlastFileSize (const char *filename_s);
+
+
+/**
+ * Count the number of sequences in a FASTA query file.
+ *
+ * @param query_filename_s The query file.
+ * @return The number of sequences. A raw sequence without a
+ * FASTA header counts as a single sequence.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL uint32 CountBlastQueries (const char *query_filename_s);
+
+
+/**
+ * Get the number of sequences and residues in a Blast database by
+ * reading the headers of its index files. The database is found in
+ * the same way as for GetBlastDatabaseSize.
+ *
+ * @param db_s The name of the database as passed to the "-db" argument.
+ * @param num_sequences_p Where the total number of sequences, including
+ * all of the database's volumes, will be stored.
+ * @param total_length_p Where the total number of residues, including
+ * all of the database's volumes, will be stored.
+ * @return <code>true</code> if the index files were read successfully,
+ * <code>false</code> otherwise.
+ * @ingroup blast_service
+ */
+BLAST_SERVICE_LOCAL bool GetBlastDatabaseStatistics (const char *db_s, uint32 *num_sequences_p, uint64 *total_length_p);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,165 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * chunked_query_search.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_CHUNKED_QUERY_SEARCH_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_CHUNKED_QUERY_SEARCH_HPP_
+
+#include <stdio.h>
+
+#include "blast_service_api.h"
+#include "jansson.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+struct QueryChunk;
+
+
+/**
+ * A ChunkedQuerySearch splits a query file containing several sequences
+ * into chunks of roughly equal size so that each of them can be searched
+ * by a separate Blast process at the same time.
+ *
+ * As each chunk finishes, its reports are appended, in the same order as
+ * the queries in the original file, to the job's single-file JSON output
+ * after those of the chunks before it. The output is written in the same
+ * way as Blast writes it, so the results of the first chunks can be read
+ * while the later ones are still running.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL ChunkedQuerySearch
+{
+public:
+
+	/**
+	 * Create a ChunkedQuerySearch.
+	 *
+	 * @param query_filename_s The query file to split up.
+	 * @param output_filename_s The file where the merged results will be written. This
+	 * is also used to name the query and output files for each of the chunks.
+	 * @param max_num_chunks The maximum number of chunks to split the queries into.
+	 * @return The new ChunkedQuerySearch or 0 if the queries could not be split
+	 * into at least 2 chunks.
+	 */
+	static ChunkedQuerySearch *Create (const char *query_filename_s, const char *output_filename_s, uint32 max_num_chunks);
+
+
+	/**
+	 * Create a ChunkedQuerySearch.
+	 *
+	 * @param output_filename_s The file where the merged results will be written.
+	 * This is copied so the ChunkedQuerySearch can outlive the string.
+	 */
+	ChunkedQuerySearch (const char *output_filename_s);
+
+
+	/**
+	 * The ChunkedQuerySearch destructor. This deletes the query and
+	 * output files of each of the chunks. If the results of some of the
+	 * chunks were never merged, the incomplete merged output is deleted too.
+	 */
+	~ChunkedQuerySearch ();
+
+
+	/**
+	 * Get the number of chunks that the queries were split into.
+	 *
+	 * @return The number of chunks.
+	 */
+	uint32 GetNumChunks () const;
+
+
+	/**
+	 * Get the query file for a chunk to pass to the "-query" argument.
+	 *
+	 * @param index The index of the chunk.
+	 * @return The query filename.
+	 */
+	const char *GetChunkQueryFilename (uint32 index) const;
+
+
+	/**
+	 * Get the file that the search of a chunk must write its
+	 * single-file JSON output to.
+	 *
+	 * @param index The index of the chunk.
+	 * @return The output filename.
+	 */
+	const char *GetChunkOutputFilename (uint32 index) const;
+
+
+	/**
+	 * Mark the search of a chunk as having succeeded and append the
+	 * results of all of the chunks up to the first unfinished one to
+	 * the output. When this is the last chunk to be merged, the output
+	 * is finished off.
+	 *
+	 * @param index The index of the chunk.
+	 * @return <code>true</code> if the results were written successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool SetChunkSucceeded (uint32 index);
+
+
+	/**
+	 * Check whether the results of every chunk have been merged.
+	 *
+	 * @return <code>true</code> if all of the results have been written,
+	 * <code>false</code> otherwise.
+	 */
+	bool IsComplete () const;
+
+
+private:
+	char *cqs_output_filename_s;
+
+	/** The merged output, which is open from when the first chunk is merged until the last one is. */
+	FILE *cqs_output_f;
+
+	struct QueryChunk *cqs_chunks_p;
+
+	uint32 cqs_num_chunks;
+
+	/** The number of chunks whose reports have been written to the output. */
+	uint32 cqs_num_merged_chunks;
+
+	/** The number of reports that have been written to the output. */
+	uint32 cqs_num_merged_reports;
+
+
+	bool SplitQueries (const char *query_filename_s, uint32 max_num_chunks);
+
+	bool AddChunk (const char *data_s, const size_t length);
+
+	bool MergeChunkReports (struct QueryChunk *chunk_p);
+
+	bool FinishOutput ();
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_CHUNKED_QUERY_SEARCH_HPP_ */
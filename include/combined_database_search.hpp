@@ -0,0 +1,241 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * combined_database_search.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_COMBINED_DATABASE_SEARCH_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_COMBINED_DATABASE_SEARCH_HPP_
+
+#include "blast_service_api.h"
+#include "blast_service.h"
+#include "jansson.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+struct CombinedDatabase;
+
+
+/**
+ * A CombinedDatabaseSearch runs a query against several databases with
+ * a single Blast process by writing a temporary alias database that
+ * covers all of them.
+ *
+ * Once the search has finished, the hits are split back up into a
+ * separate single-file JSON output for each of the databases with their
+ * expect values scaled to the size of that database. Since the combined
+ * search is run with its expect threshold raised so that it finds every
+ * hit that any of the databases would, the hits that are then above the
+ * original threshold are dropped. The results aren't identical to
+ * searching each database on its own, as the effective search space
+ * that Blast uses also depends on the lengths of the sequences, but the
+ * differences are small.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL CombinedDatabaseSearch
+{
+public:
+
+	/**
+	 * Create a CombinedDatabaseSearch.
+	 *
+	 * @param data_p The BlastServiceData for the Service that is running the search.
+	 * @param job_id_s The id used to name the temporary files for the search.
+	 * @param max_num_databases The maximum number of databases that will be added.
+	 * @return The new CombinedDatabaseSearch or 0 upon error.
+	 */
+	static CombinedDatabaseSearch *Create (const BlastServiceData *data_p, const char *job_id_s, uint32 max_num_databases);
+
+
+	/**
+	 * Create a CombinedDatabaseSearch.
+	 *
+	 * @param data_p The BlastServiceData for the Service that is running the search.
+	 * @param job_id_s The id used to name the temporary files for the search.
+	 * @param max_num_databases The maximum number of databases that will be added.
+	 */
+	CombinedDatabaseSearch (const BlastServiceData *data_p, const char *job_id_s, uint32 max_num_databases);
+
+
+	/**
+	 * The CombinedDatabaseSearch destructor. This deletes any
+	 * temporary files that the search created.
+	 */
+	~CombinedDatabaseSearch ();
+
+
+	/**
+	 * Add a database to the search.
+	 *
+	 * @param db_filename_s The name of the database as passed to the "-db" argument.
+	 * @param output_filename_s The file where this database's share of the
+	 * results will be written in single-file JSON format.
+	 * @return <code>true</code> if the database was added successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool AddDatabase (const char *db_filename_s, const char *output_filename_s);
+
+
+	/**
+	 * Get the number of databases that have been added.
+	 *
+	 * @return The number of databases.
+	 */
+	uint32 GetNumDatabases () const;
+
+
+	/**
+	 * Get the total size of the sequence files of all of the databases
+	 * that have been added.
+	 *
+	 * @return The size in bytes.
+	 * @see GetBlastDatabaseSize
+	 */
+	uint64 GetDatabasesSize () const;
+
+
+	/**
+	 * Write the alias database covering all of the databases
+	 * that have been added.
+	 *
+	 * @return <code>true</code> if the alias was written successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool WriteAlias ();
+
+
+	/**
+	 * Get the name of the alias database to pass to the "-db" argument.
+	 *
+	 * @return The alias name.
+	 */
+	const char *GetAliasName () const;
+
+
+	/**
+	 * Get the file that the combined search must write its
+	 * single-file JSON output to.
+	 *
+	 * @return The output filename.
+	 */
+	const char *GetOutputFilename () const;
+
+
+	/**
+	 * Set the maximum number of hits that each database
+	 * should have in its results.
+	 *
+	 * @param max_target_seqs The number of hits or 0 for no limit.
+	 */
+	void SetMaxTargetSequences (uint32 max_target_seqs);
+
+
+	/**
+	 * Set the expect threshold that the hits of each database
+	 * must be within.
+	 *
+	 * @param evalue The expect threshold as passed to the "-evalue" argument.
+	 */
+	void SetExpectThreshold (double evalue);
+
+
+	/**
+	 * Get the expect threshold for the combined search. Since the expect
+	 * values of each database's hits are scaled down by the proportion of
+	 * the combined database that it makes up, the threshold is raised by
+	 * the ratio of the combined size to that of the smallest database so
+	 * that no hits are missed.
+	 *
+	 * @return The expect threshold to pass to the "-evalue" argument of the combined search.
+	 */
+	double GetCombinedExpectThreshold () const;
+
+
+	/**
+	 * Split the output of the combined search into the output files of
+	 * each of the databases.
+	 *
+	 * @return <code>true</code> if every hit was attributed to its database and
+	 * the outputs were written successfully, <code>false</code> otherwise.
+	 */
+	bool Demultiplex ();
+
+
+private:
+	/** The prefix that Blast gives to the ids of sequences in databases built without parsed sequence ids. */
+	static const char * const CDS_ORDINAL_ID_PREFIX_S;
+
+	const BlastServiceData *cds_service_data_p;
+
+	/** The databases in the order that they appear in the alias. */
+	struct CombinedDatabase *cds_databases_p;
+
+	uint32 cds_num_databases;
+
+	uint32 cds_max_num_databases;
+
+	/** The number of residues in all of the databases. */
+	uint64 cds_total_length;
+
+	/** The size in bytes of the sequence files of all of the databases. */
+	uint64 cds_databases_size;
+
+	uint32 cds_max_target_seqs;
+
+	/** The expect threshold that the search was asked for. */
+	double cds_max_evalue;
+
+	char *cds_alias_name_s;
+
+	char *cds_alias_filename_s;
+
+	char *cds_output_filename_s;
+
+	/** The temporary files used when looking up which database each hit came from. */
+	char *cds_ids_filename_s;
+
+	char *cds_found_filename_s;
+
+	char *cds_log_filename_s;
+
+
+	int32 GetHitDatabaseIndex (const json_t *hit_p, const json_t *accessions_p) const;
+
+	bool FindAccessionDatabases (const json_t *reports_p, json_t *accessions_p);
+
+	bool WriteAccessions (const json_t *accessions_p);
+
+	bool ReadFoundAccessions (json_t *accessions_p, const uint32 db_index);
+
+	bool SplitReport (json_t *entry_p, const json_t *accessions_p);
+
+	void UpdateStatistics (json_t *search_p, const struct CombinedDatabase *db_p) const;
+
+	static bool ScaleExpectValues (json_t *hit_p, const double factor, const double max_evalue);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_COMBINED_DATABASE_SEARCH_HPP_ */
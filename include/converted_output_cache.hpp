@@ -0,0 +1,177 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * converted_output_cache.hpp
+ *
+ *  Created on: 23 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_CONVERTED_OUTPUT_CACHE_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_CONVERTED_OUTPUT_CACHE_HPP_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+
+
+/* forward declarations */
+struct ConvertedOutput;
+class BlastResultBuffer;
+
+
+/**
+ * A ConvertedOutputCache keeps an index of the outputs of Blast jobs that
+ * have been converted into other formats, along with their sizes and when
+ * they were last used.
+ *
+ * The most recently used outputs are kept in memory, up to a given number
+ * of bytes, so that repeated requests for them don't need to read the disk.
+ * The converted files are deleted, least recently used first, once they
+ * take up more than a given amount of disk space. A single cache is shared
+ * by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL ConvertedOutputCache
+{
+public:
+
+	/**
+	 * Get the ConvertedOutputCache that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedConvertedOutputCache.
+	 *
+	 * @param disk_budget The number of bytes that the converted files can take up
+	 * on disk. If this is 0, the files are never deleted. This is only used when the
+	 * cache is created.
+	 * @param memory_budget The number of bytes of converted outputs to keep in memory.
+	 * This is only used when the cache is created.
+	 * @return The shared ConvertedOutputCache or 0 upon error.
+	 */
+	static ConvertedOutputCache *GetSharedConvertedOutputCache (const uint64 disk_budget, const uint64 memory_budget);
+
+
+	/**
+	 * Release a reference to the shared ConvertedOutputCache. When the last
+	 * reference is released, the cache is freed. The converted files are
+	 * left on disk.
+	 */
+	static void ReleaseSharedConvertedOutputCache ();
+
+
+	/**
+	 * Add the converted files that already exist in a directory to the
+	 * index and delete the least recently modified of them if they are
+	 * over the disk budget.
+	 *
+	 * @param directory_s The directory to look in.
+	 */
+	void IndexDirectory (const char *directory_s);
+
+
+	/**
+	 * Get a job's output in a given format if it has already been converted.
+	 *
+	 * @param output_filename_s The filename of the job's output.
+	 * @param output_format_code The required output format code.
+	 * @param custom_format_s The custom columns for the output format or <code>NULL</code>
+	 * for the default ones.
+	 * @return A copy of the converted output which should be freed with FreeCopiedString
+	 * or <code>NULL</code> if it isn't available.
+	 */
+	char *GetConvertedOutput (const char *output_filename_s, const uint32 output_format_code, const char *custom_format_s);
+
+
+	/**
+	 * Get a job's output in a given format if it has already been converted
+	 * without making a heap copy of any converted file on disk.
+	 *
+	 * @param output_filename_s The filename of the job's output.
+	 * @param output_format_code The required output format code.
+	 * @param custom_format_s The custom columns for the output format or <code>NULL</code>
+	 * for the default ones.
+	 * @return A BlastResultBuffer with the converted output, which should be deleted
+	 * once it is no longer needed, or <code>NULL</code> if it isn't available.
+	 */
+	BlastResultBuffer *GetConvertedOutputBuffer (const char *output_filename_s, const uint32 output_format_code, const char *custom_format_s);
+
+
+	/**
+	 * Add a job's output that has just been converted to the cache.
+	 *
+	 * @param output_filename_s The filename of the job's output.
+	 * @param output_format_code The output format code of the converted output.
+	 * @param custom_format_s The custom columns for the output format or <code>NULL</code>
+	 * for the default ones.
+	 * @param converted_output_s The converted output.
+	 * @return <code>true</code> if the output was added successfully, <code>false</code>
+	 * otherwise.
+	 */
+	bool AddConvertedOutput (const char *output_filename_s, const uint32 output_format_code, const char *custom_format_s, const char *converted_output_s);
+
+
+private:
+	static ConvertedOutputCache *coc_shared_cache_p;
+	static uint32 coc_shared_cache_count;
+	static pthread_mutex_t coc_shared_cache_mutex;
+
+	/** The converted outputs, from the most to the least recently used */
+	struct ConvertedOutput *coc_first_output_p;
+
+	struct ConvertedOutput *coc_last_output_p;
+
+	uint64 coc_disk_budget;
+
+	uint64 coc_memory_budget;
+
+	/** The number of bytes of converted files on disk */
+	uint64 coc_disk_size;
+
+	/** The number of bytes of converted outputs held in memory */
+	uint64 coc_memory_size;
+
+	/** This protects the index. */
+	pthread_mutex_t coc_mutex;
+
+
+	ConvertedOutputCache (const uint64 disk_budget, const uint64 memory_budget);
+
+	~ConvertedOutputCache ();
+
+	struct ConvertedOutput *FindOutput (const char *filename_s);
+
+	struct ConvertedOutput *AddOutput (const char *filename_s, const uint64 disk_size, const time_t last_access);
+
+	void MoveToFront (struct ConvertedOutput *output_p);
+
+	void RemoveOutput (struct ConvertedOutput *output_p);
+
+	void KeepInMemory (struct ConvertedOutput *output_p, const char *data_s, const size_t length);
+
+	void Trim ();
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_CONVERTED_OUTPUT_CACHE_HPP_ */
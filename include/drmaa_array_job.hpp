@@ -0,0 +1,199 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * drmaa_array_job.hpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_ARRAY_JOB_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_ARRAY_JOB_HPP_
+
+#include "blast_service_api.h"
+#include "blast_service.h"
+#include "typedefs.h"
+
+
+/**
+ * A DrmaaArrayJob submits the searches against several databases
+ * for the same request as a single DRMAA array job, so that the
+ * scheduler only has one submission to process rather than one
+ * for each database.
+ *
+ * Each task of the array runs a small shell script that is written
+ * to the working directory by AddTask. The script for each task is
+ * passed to it as its standard input using the DRMAA index placeholder,
+ * which is supported by every DRMAA implementation, so that task
+ * number <i>n</i> runs the <i>n</i>th search.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL DrmaaArrayJob
+{
+public:
+
+	/**
+	 * Create a DrmaaArrayJob.
+	 *
+	 * @param data_p The BlastServiceData for the Service that is running the searches.
+	 * @param array_id_s The id used to name the task files for the array.
+	 * @param max_num_tasks The maximum number of tasks that will be added.
+	 * @return The new DrmaaArrayJob or 0 upon error.
+	 */
+	static DrmaaArrayJob *Create (const BlastServiceData *data_p, const char *array_id_s, uint32 max_num_tasks);
+
+
+	/**
+	 * Create a DrmaaArrayJob.
+	 *
+	 * @param data_p The BlastServiceData for the Service that is running the searches.
+	 * @param array_id_s The id used to name the task files for the array.
+	 * @param max_num_tasks The maximum number of tasks that will be added.
+	 */
+	DrmaaArrayJob (const BlastServiceData *data_p, const char *array_id_s, uint32 max_num_tasks);
+
+
+	/**
+	 * The DrmaaArrayJob destructor. If the array was not submitted,
+	 * this deletes any task files that were written.
+	 */
+	~DrmaaArrayJob ();
+
+
+	/**
+	 * Add a search to the array.
+	 *
+	 * @param program_s The Blast executable to run.
+	 * @param args_ss The NULL-terminated arguments to run it with.
+	 * @param log_filename_s The file that the output and any errors
+	 * from the search will be appended to.
+	 * @return The index of the task within the array, starting at 1,
+	 * or 0 upon error.
+	 */
+	uint32 AddTask (const char *program_s, char **args_ss, const char *log_filename_s);
+
+
+	/**
+	 * Get the number of tasks that have been added.
+	 *
+	 * @return The number of tasks.
+	 */
+	uint32 GetNumTasks () const;
+
+
+	/**
+	 * Set the queue that the array will be submitted to.
+	 *
+	 * @param queue_s The queue name or <code>NULL</code> for the default queue.
+	 */
+	void SetQueueName (const char *queue_s);
+
+
+	/**
+	 * Set the number of cores that each task asks for.
+	 *
+	 * @param cores The number of cores.
+	 */
+	void SetCoresPerTask (uint32 cores);
+
+
+	/**
+	 * Set the native specification to submit the array with, instead
+	 * of one built from the queue and number of cores.
+	 *
+	 * @param spec_s The native specification.
+	 */
+	void SetNativeSpecification (const char *spec_s);
+
+
+	/**
+	 * Set an email address to send notifications to for each task.
+	 *
+	 * @param email_s The email address or <code>NULL</code> for none.
+	 */
+	void SetEmailNotifications (const char *email_s);
+
+
+	/**
+	 * Submit all of the tasks that have been added as a single array job.
+	 *
+	 * @return <code>true</code> if the array was submitted successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool Submit ();
+
+
+	/**
+	 * Get the DRMAA job id of one of the tasks once the array
+	 * has been submitted.
+	 *
+	 * @param index The index of the task as returned by AddTask.
+	 * @return The job id or <code>NULL</code> if the array hasn't
+	 * been submitted.
+	 */
+	const char *GetTaskId (uint32 index) const;
+
+
+	/**
+	 * Get the script file for one of the tasks.
+	 *
+	 * @param index The index of the task as returned by AddTask.
+	 * @return The filename or <code>NULL</code> if the index is invalid.
+	 */
+	const char *GetTaskFilename (uint32 index) const;
+
+
+private:
+	const BlastServiceData *daj_service_data_p;
+
+	/** The task filenames, which are daj_task_stem_s followed by the task index */
+	char **daj_task_filenames_ss;
+
+	char *daj_task_stem_s;
+
+	/** The DRMAA job ids of the tasks once the array has been submitted */
+	char **daj_task_ids_ss;
+
+	char *daj_input_path_s;
+
+	char *daj_job_name_s;
+
+	uint32 daj_num_tasks;
+
+	uint32 daj_max_num_tasks;
+
+	const char *daj_queue_s;
+
+	const char *daj_native_spec_s;
+
+	const char *daj_email_s;
+
+	uint32 daj_cores;
+
+	bool daj_submitted_flag;
+
+
+	char *GetNativeSpecification () const;
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_ARRAY_JOB_HPP_ */
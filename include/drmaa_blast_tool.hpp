@@ -28,11 +28,17 @@
 #ifndef DRMAA_BLAST_TOOL_HPP_
 #define DRMAA_BLAST_TOOL_HPP_
 
+#include <time.h>
+
 #include "drmaa_tool_args_processor.hpp"
 #include "external_blast_tool.hpp"
 #include "drmaa_tool.h"
 
 
+class DrmaaArrayJob;
+class DrmaaStatusPoller;
+
+
 /**
  * A class that will run Blast as a drmaa process.
  *
@@ -124,6 +130,16 @@ public:
 	virtual OperationStatus GetStatus (bool update_flag = true);
 
 
+	/**
+	 * Terminate the DRMAA job for this DrmaaBlastTool.
+	 *
+	 * @return <code>true</code> if the job was terminated successfully,
+	 * <code>false</code> otherwise.
+	 * @see BlastTool::Cancel
+	 */
+	virtual bool Cancel ();
+
+
 	/**
 	 * Set the number of cores that this DrmaaBlastTool that will try to use
 	 * when it runs.
@@ -152,6 +168,41 @@ public:
 	virtual bool SetUpOutputFile ();
 
 
+	/**
+	 * Add the search for this DrmaaBlastTool to a DrmaaArrayJob
+	 * rather than submitting it as a job of its own.
+	 *
+	 * @param array_p The DrmaaArrayJob to add the search to.
+	 * @return The index of the search's task within the array
+	 * or 0 upon error.
+	 * @see DrmaaArrayJob::AddTask
+	 */
+	uint32 AddToDrmaaArrayJob (DrmaaArrayJob *array_p);
+
+
+	/**
+	 * Track this DrmaaBlastTool's search using its task
+	 * within a DrmaaArrayJob that has been submitted.
+	 *
+	 * @param array_p The submitted DrmaaArrayJob.
+	 * @param index The index of the task as returned by AddToDrmaaArrayJob.
+	 * @return <code>true</code> if the task's details were stored
+	 * successfully, <code>false</code> otherwise.
+	 */
+	bool SetDrmaaArrayTask (const DrmaaArrayJob *array_p, uint32 index);
+
+
+	/**
+	 * Set the DrmaaStatusPoller that this DrmaaBlastTool will get the
+	 * state of its DRMAA job from rather than querying the scheduler
+	 * each time that its status is updated.
+	 *
+	 * @param poller_p The DrmaaStatusPoller or 0 to always query the
+	 * scheduler directly.
+	 */
+	void SetStatusPoller (DrmaaStatusPoller *poller_p);
+
+
 protected:
 
 	/**
@@ -207,6 +258,12 @@ private:
 
 	static const char * const DBT_DRMAA_S;
 
+	static const char * const DBT_DEADLINE_S;
+
+	static const char * const DBT_ARRAY_TASK_ID_S;
+
+	static const char * const DBT_ARRAY_TASK_FILE_S;
+
 	/**
 	 * @private
 	 *
@@ -221,8 +278,49 @@ private:
 	 */
 	bool dbt_async_flag;
 
+	/**
+	 * @private
+	 *
+	 * When the DRMAA job will be terminated or 0 if it has no time limit.
+	 * This is checked whenever the status of the job is updated.
+	 */
+	time_t dbt_deadline;
+
+	/**
+	 * @private
+	 *
+	 * If the search was submitted as part of a DrmaaArrayJob,
+	 * this is the DRMAA job id of its task, otherwise it is 0
+	 * and the DrmaaTool's job id is used.
+	 */
+	char *dbt_task_id_s;
+
+	/**
+	 * @private
+	 *
+	 * The script run by the task of a DrmaaArrayJob, which
+	 * is deleted once the task has finished.
+	 */
+	char *dbt_task_filename_s;
+
+	/**
+	 * @private
+	 *
+	 * The DrmaaStatusPoller that caches the state of the DRMAA
+	 * job or 0 if the scheduler is queried directly.
+	 */
+	DrmaaStatusPoller *dbt_poller_p;
+
 
 	DrmaaBlastTool (ServiceJob *job_p, DrmaaTool *drmaa_p, bool async_flag);
+
+	bool Terminate (const char *reason_s);
+
+	void SetDeadline ();
+
+	const char *GetDrmaaJobId () const;
+
+	OperationStatus GetDrmaaJobStatus ();
 };
 
 
@@ -31,6 +31,9 @@
 
 #include "external_blast_tool_factory.hpp"
 
+
+class DrmaaStatusPoller;
+
 /**
  * The base class for generating DrmaaBlastTools.
  *
@@ -96,6 +99,23 @@ public:
 	 */
 	virtual Synchronicity GetToolsSynchronicity () const;
 
+
+	/**
+	 * Submit the DrmaaBlastTools for the jobs of a single request as
+	 * one DRMAA array job, with a task for each database, rather than
+	 * submitting a separate job for each of them. This is only done
+	 * when the DrmaaBlastTools run asynchronously and can be turned off
+	 * by setting "array_jobs" to false in the "drmaa_blast_tool_config".
+	 *
+	 * @param tools_pp The DrmaaBlastTools, which have all been prepared to run.
+	 * @param num_tools The number of DrmaaBlastTools.
+	 * @param data_p The BlastServiceData for the Service that is running the DrmaaBlastTools.
+	 * @return <code>true</code> if the array job was submitted, <code>false</code>
+	 * if the DrmaaBlastTools need submitting separately.
+	 * @see DrmaaArrayJob
+	 */
+	virtual bool RunBlastToolsTogether (BlastTool **tools_pp, const uint32 num_tools, const BlastServiceData *data_p);
+
 protected:
 
 	/**
@@ -105,6 +125,14 @@ protected:
 	 * server configuration.
 	 */
 	DrmaaBlastToolFactory (const json_t *service_config_p);
+
+private:
+
+	/**
+	 * The DrmaaStatusPoller given to each DrmaaBlastTool or 0
+	 * if they query the scheduler directly.
+	 */
+	DrmaaStatusPoller *dbtf_poller_p;
 };
 
 
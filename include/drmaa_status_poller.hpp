@@ -0,0 +1,155 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * drmaa_status_poller.hpp
+ *
+ *  Created on: 19 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_STATUS_POLLER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_STATUS_POLLER_HPP_
+
+#include <pthread.h>
+#include <time.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+struct PolledJob;
+
+
+/**
+ * A DrmaaStatusPoller keeps a cache of the scheduler states of the
+ * DRMAA jobs that are being asked about, so that clients checking
+ * the statuses of their searches don't each cause a query to the
+ * scheduler.
+ *
+ * A single thread refreshes the states of all of the outstanding
+ * jobs in one sweep at a regular interval. Jobs that have finished
+ * are no longer queried and any job whose status hasn't been asked
+ * for in a while is dropped from the cache. A single poller is shared
+ * by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL DrmaaStatusPoller
+{
+public:
+
+	/**
+	 * Get the DrmaaStatusPoller that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedDrmaaStatusPoller.
+	 *
+	 * @param interval The number of seconds between each refresh of the job states.
+	 * This is only used when the poller is created.
+	 * @return The shared DrmaaStatusPoller or 0 upon error.
+	 */
+	static DrmaaStatusPoller *GetSharedDrmaaStatusPoller (uint32 interval);
+
+
+	/**
+	 * Release a reference to the shared DrmaaStatusPoller. When the last
+	 * reference is released, its thread is stopped and the poller is freed.
+	 */
+	static void ReleaseSharedDrmaaStatusPoller ();
+
+
+	/**
+	 * Get the cached state of a DRMAA job. If the job isn't in the
+	 * cache, it is added so that it will be included in the next refresh.
+	 *
+	 * @param job_id_s The DRMAA job id.
+	 * @param drmaa_status_p Where the state from drmaa_job_ps will be stored.
+	 * @param res_p Where the DRMAA error code from drmaa_job_ps will be stored.
+	 * @return <code>true</code> if the state of the job was cached, <code>false</code>
+	 * if the caller needs to query the scheduler itself.
+	 */
+	bool GetJobStatus (const char *job_id_s, int *drmaa_status_p, int *res_p);
+
+
+	/**
+	 * Store the state of a DRMAA job that the caller has queried
+	 * the scheduler for itself.
+	 *
+	 * @param job_id_s The DRMAA job id.
+	 * @param drmaa_status The state from drmaa_job_ps.
+	 * @param res The DRMAA error code from drmaa_job_ps.
+	 */
+	void SetJobStatus (const char *job_id_s, int drmaa_status, int res);
+
+
+	/**
+	 * Remove a DRMAA job from the cache, e.g. after it has been terminated,
+	 * so that the next request for its state goes to the scheduler.
+	 *
+	 * @param job_id_s The DRMAA job id.
+	 */
+	void Forget (const char *job_id_s);
+
+
+private:
+	static DrmaaStatusPoller *dsp_shared_poller_p;
+	static uint32 dsp_shared_poller_count;
+	static pthread_mutex_t dsp_shared_poller_mutex;
+
+	/** How long, in seconds, a job is kept after its state was last asked for. */
+	static const time_t DSP_EXPIRY_TIME;
+
+	struct PolledJob *dsp_jobs_p;
+
+	uint32 dsp_num_jobs;
+
+	uint32 dsp_interval;
+
+	bool dsp_running_flag;
+
+	/** This protects the list of jobs and dsp_running_flag. */
+	pthread_mutex_t dsp_mutex;
+
+	/** This is signalled to stop the poller's thread. */
+	pthread_cond_t dsp_cond;
+
+	pthread_t dsp_thread;
+
+
+	DrmaaStatusPoller (uint32 interval);
+
+	~DrmaaStatusPoller ();
+
+	static void *RunPollerThread (void *data_p);
+
+	void Run ();
+
+	void Refresh ();
+
+	struct PolledJob *FindJob (const char *job_id_s) const;
+
+	struct PolledJob *AddJob (const char *job_id_s);
+
+	void RemoveJob (struct PolledJob *job_p);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_STATUS_POLLER_HPP_ */
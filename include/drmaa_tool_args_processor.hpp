@@ -29,11 +29,14 @@
 #define SERVER_SRC_SERVICES_BLAST_INCLUDE_DRMAA_TOOL_ARGS_PROCESSOR_HPP_
 
 #include "args_processor.hpp"
+#include "strings_args_processor.hpp"
 #include "drmaa_tool.h"
 
 
 /**
  * An ArgsProcessor that adds all of its values to a given DrmaaTool.
+ * A copy of the arguments is also kept so that the command line can
+ * be written out when the job is submitted as part of a DrmaaArrayJob.
  *
  * @ingroup blast_service
  */
@@ -66,8 +69,20 @@ public:
 	 */
 	virtual bool AddArg (const char *arg_s, const bool hyphen_flag);
 
+
+	/**
+	 * Get all of the arguments that have been added as an array of strings.
+	 * The final element in the array will be <code>NULL</code>
+	 *
+	 * @return The arguments which will need to be freed with FreeMemory.
+	 * @see StringsArgsProcessor::GetArgsAsStrings
+	 */
+	char **GetArgsAsStrings ();
+
 private:
 	DrmaaTool *dtap_drmaa_p;
+
+	StringsArgsProcessor *dtap_args_p;
 };
 
 
@@ -137,6 +137,16 @@ public:
 	virtual char *GetResults (BlastFormatter *formatter_p);
 
 
+	/**
+	 * Get the results after the ExternalBlastTool has finished
+	 * running. If they don't need converting, the output file is
+	 * mapped rather than read onto the heap.
+	 *
+	 * @see BlastTool::GetResultsBuffer
+	 */
+	virtual BlastResultBuffer *GetResultsBuffer (BlastFormatter *formatter_p);
+
+
 	/**
 	 * Get a copy of the log data from the run of this ExternalBlastTool's
 	 * run.
@@ -149,6 +159,17 @@ public:
 	virtual char *GetLog ();
 
 
+	/**
+	 * Get how far through its queries this ExternalBlastTool's running
+	 * job is by following its output and log files.
+	 *
+	 * @return The progress as a json object or <code>0</code> if the
+	 * job isn't running or its progress can't be followed.
+	 * @see BlastProgressTracker
+	 */
+	virtual json_t *GetProgressAsJSON ();
+
+
 protected:
 
 	/**
@@ -182,6 +203,21 @@ protected:
 	bool ebt_async_flag;
 
 
+	/**
+	 * The size in bytes of the query file that was set with
+	 * SetInputFilename. This is used to decide how many threads
+	 * the search should use.
+	 */
+	uint64 ebt_query_size;
+
+
+	/**
+	 * The number of queries in the query file that was set with
+	 * SetInputFilename. This is used to report the progress of the search.
+	 */
+	uint32 ebt_num_queries;
+
+
 	/**
 	 * Get the ArgsProcessor that this BlastTool will use
 	 * to parse the input ParameterSet prior to running its
@@ -234,6 +270,17 @@ protected:
 	char *GetJobFilename (const char * const prefix_s, const char * const suffix_s);
 
 
+	/**
+	 * Get the name of the file that the log of this ExternalBlastTool's
+	 * job is written to.
+	 *
+	 * @return The filename or 0 upon error. If a valid value is
+	 * returned, this will need to be freed by <code>FreeCopiedString</code>
+	 * to avoid a memory leak.
+	 */
+	char *GetLogFilename () const;
+
+
 	/**
 	 * This method is used to serialise this ExternalBlastTool so that
 	 * it can be recreated from another calling process when required.
@@ -252,6 +299,14 @@ private:
 	static const char * const EBT_COMMAND_LINE_EXECUTABLE_S;
 	static const char * const EBT_WORKING_DIR_S;
 	static const char * const EBT_RESULTS_FILE_S;
+	static const char * const EBT_NUM_QUERIES_S;
+
+	static const char * const EBT_PROGRESS_QUERIES_COMPLETED_S;
+	static const char * const EBT_PROGRESS_QUERIES_TOTAL_S;
+	static const char * const EBT_PROGRESS_ELAPSED_S;
+	static const char * const EBT_PROGRESS_ETA_S;
+	static const char * const EBT_PROGRESS_POLL_INTERVAL_S;
+	static const char * const EBT_PROGRESS_MESSAGE_S;
 };
 #endif /* EXTERNAL_BLAST_TOOL_HPP_ */
 
@@ -0,0 +1,134 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+
+/*
+ * native_blast_formatter.h
+ *
+ *  Created on: 22 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef NATIVE_BLAST_FORMATTER_H_
+#define NATIVE_BLAST_FORMATTER_H_
+
+#include "blast_formatter.h"
+
+
+/**
+ * This class converts the output of a blast job between the different
+ * formats within the Blast service itself rather than by running an
+ * external blast_formatter process for each conversion.
+ *
+ * The Blast tools write their results in single-file JSON format when
+ * this is the service's formatter and these are converted to the
+ * pairwise, tabular, tabular with comments and CSV formats, including
+ * any custom columns. Any other formats, or any jobs whose results are
+ * still in "BLAST archive format (ASN.1)", are passed on to an optional
+ * SystemBlastFormatter.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL NativeBlastFormatter : public BlastFormatter
+{
+public:
+	/**
+	 * Create a NativeBlastFormatter.
+	 *
+	 * @param system_config_p The JSON fragment that is the value of "system_formatter_config"
+	 * from within the Blast service section of the global Server configuration file. If this
+	 * is not <code>NULL</code>, it is used to create the SystemBlastFormatter for the formats
+	 * that can't be converted natively.
+	 * @return A new NativeBlastFormatter or 0 upon error.
+	 */
+	static NativeBlastFormatter *Create (const json_t *system_config_p);
+
+
+	/**
+	 * Can a given output format be converted natively from the single-file JSON format?
+	 *
+	 * @param output_format_code The required output format code.
+	 * @param custom_format_s The space-separated list of custom columns or <code>NULL</code>
+	 * for the default ones.
+	 * @return <code>true</code> if the conversion can be done natively, <code>false</code>
+	 * otherwise.
+	 */
+	static bool CanConvertOutputFormat (const uint32 output_format_code, const char *custom_format_s);
+
+
+	/**
+	 * Convert the results of a blast job in single-file JSON format.
+	 *
+	 * @param blast_output_p The results in single-file JSON format.
+	 * @param output_format_code The required output format code.
+	 * @param custom_format_s The space-separated list of custom columns or <code>NULL</code>
+	 * for the default ones.
+	 * @return The converted output which should be freed with FreeCopiedString or
+	 * <code>NULL</code> upon error.
+	 */
+	static char *ConvertJSONOutput (const json_t *blast_output_p, const uint32 output_format_code, const char *custom_format_s);
+
+
+	/**
+	 * The NativeBlastFormatter destructor.
+	 */
+	virtual ~NativeBlastFormatter ();
+
+
+	/**
+	 * Get the converted output as a c-style string. If the job's results are in
+	 * single-file JSON format and the required format can be converted natively, this
+	 * is done directly. Otherwise this is done by the SystemBlastFormatter, if there is one.
+	 *
+	 * @see BlastFormatter::GetConvertedOutput
+	 * @see BlastOutputFormat
+	 */
+	virtual char *GetConvertedOutput (const char *job_id_s, const uint32 output_format_code, const char *custom_format_s, const BlastServiceData *data_p);
+
+
+	/**
+	 * Get the output format that the Blast tools write their results in.
+	 *
+	 * @return The single-file JSON format code.
+	 * @see BlastFormatter::GetArchiveOutputFormat
+	 */
+	virtual uint32 GetArchiveOutputFormat () const;
+
+
+	/**
+	 * Get a job's output in single-file JSON format without copying it
+	 * onto the heap.
+	 *
+	 * @return The mapped output or <code>NULL</code> if the job's output
+	 * is still an ASN.1 archive.
+	 * @see BlastFormatter::GetArchiveOutput
+	 */
+	virtual BlastResultBuffer *GetArchiveOutput (const char *job_output_filename_s);
+
+
+private:
+	/** The formatter used for the formats that can't be converted natively. This can be 0. */
+	SystemBlastFormatter *nbf_fallback_formatter_p;
+
+	NativeBlastFormatter (SystemBlastFormatter *fallback_formatter_p);
+};
+
+
+#endif /* NATIVE_BLAST_FORMATTER_H_ */
@@ -0,0 +1,181 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * sharded_database_search.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_SHARDED_DATABASE_SEARCH_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_SHARDED_DATABASE_SEARCH_HPP_
+
+#include "blast_service_api.h"
+#include "blast_service.h"
+#include "jansson.h"
+#include "typedefs.h"
+
+
+/* forward declaration */
+struct DatabaseShard;
+
+
+/**
+ * A ShardedDatabaseSearch runs a query against a large database by
+ * searching each of its volumes with a separate Blast process at the
+ * same time.
+ *
+ * Each of the processes is given the size of the whole database with
+ * the "-dbsize" argument so that their expect values are the same as
+ * for a search of the whole database. Once they have all finished, their
+ * hits are merged in order of expect value and bit score into a single
+ * set of results in single-file JSON format.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL ShardedDatabaseSearch
+{
+public:
+
+	/**
+	 * Create a ShardedDatabaseSearch.
+	 *
+	 * @param db_p The DatabaseInfo for the database to search. Its di_shards_p
+	 * must be set.
+	 * @param output_filename_s The file where the merged results will be written. This
+	 * is also used to name the output files for each of the shards.
+	 * @return The new ShardedDatabaseSearch or 0 upon error.
+	 */
+	static ShardedDatabaseSearch *Create (const DatabaseInfo *db_p, const char *output_filename_s);
+
+
+	/**
+	 * Create a ShardedDatabaseSearch.
+	 *
+	 * @param db_p The DatabaseInfo for the database to search. Its di_shards_p
+	 * must be set.
+	 * @param output_filename_s The file where the merged results will be written.
+	 */
+	ShardedDatabaseSearch (const DatabaseInfo *db_p, const char *output_filename_s);
+
+
+	/**
+	 * The ShardedDatabaseSearch destructor. This deletes the output
+	 * files of each of the shards.
+	 */
+	~ShardedDatabaseSearch ();
+
+
+	/**
+	 * Get the number of shards that the database is split into.
+	 *
+	 * @return The number of shards.
+	 */
+	uint32 GetNumShards () const;
+
+
+	/**
+	 * Get the name of a shard to pass to the "-db" argument.
+	 *
+	 * @param index The index of the shard.
+	 * @return The volume name.
+	 */
+	const char *GetShardName (uint32 index) const;
+
+
+	/**
+	 * Get the file that the search of a shard must write its
+	 * single-file JSON output to.
+	 *
+	 * @param index The index of the shard.
+	 * @return The output filename.
+	 */
+	const char *GetShardOutputFilename (uint32 index) const;
+
+
+	/**
+	 * Get the total size of the sequence files of all of the shards.
+	 *
+	 * @return The size in bytes.
+	 * @see GetBlastDatabaseSize
+	 */
+	uint64 GetDatabaseSize () const;
+
+
+	/**
+	 * Get the number of residues in the whole database. This is the
+	 * value to use for the "-dbsize" argument of each shard's search.
+	 *
+	 * @return The number of residues.
+	 */
+	uint64 GetTotalLength () const;
+
+
+	/**
+	 * Merge the outputs of each of the shards into a single set of results.
+	 *
+	 * @param max_target_seqs The maximum number of hits to keep for each query
+	 * or 0 for no limit.
+	 * @return <code>true</code> if the results were merged and written
+	 * successfully, <code>false</code> otherwise.
+	 */
+	bool Merge (uint32 max_target_seqs);
+
+
+private:
+	/** The prefix that Blast gives to the ids of sequences in databases built without parsed sequence ids. */
+	static const char * const SDS_ORDINAL_ID_PREFIX_S;
+
+	/** The name of the whole database. */
+	const char *sds_db_filename_s;
+
+	const char *sds_output_filename_s;
+
+	/** The shards in the order that they appear in the database. */
+	struct DatabaseShard *sds_shards_p;
+
+	uint32 sds_num_shards;
+
+	/** The number of sequences in all of the shards. */
+	uint32 sds_num_sequences;
+
+	/** The number of residues in all of the shards. */
+	uint64 sds_total_length;
+
+	/** The size in bytes of the sequence files of all of the shards. */
+	uint64 sds_database_size;
+
+
+	bool ReadStatistics ();
+
+	bool LoadShardOutputs ();
+
+	bool MergeReport (json_t *entry_p, const size_t index, const uint32 max_target_seqs);
+
+	static json_t *GetShardHits (const json_t *reports_p, const size_t index);
+
+	static bool IsBetterHit (const json_t *hit_p, const json_t *other_hit_p);
+
+	static bool OffsetOrdinalIds (json_t *hit_p, const uint32 offset);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_SHARDED_DATABASE_SEARCH_HPP_ */
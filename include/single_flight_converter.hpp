@@ -0,0 +1,162 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * single_flight_converter.hpp
+ *
+ *  Created on: 24 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVER_SRC_SERVICES_BLAST_INCLUDE_SINGLE_FLIGHT_CONVERTER_HPP_
+#define SERVER_SRC_SERVICES_BLAST_INCLUDE_SINGLE_FLIGHT_CONVERTER_HPP_
+
+#include <pthread.h>
+
+#include "blast_service_api.h"
+#include "typedefs.h"
+#include "jansson.h"
+
+
+/* forward declaration */
+struct ConversionFlight;
+
+
+/**
+ * A callback function that converts a job's output into another format.
+ *
+ * @param data_p The data passed to SingleFlightConverter::ConvertOutput.
+ * @return The converted output which should be freed with FreeCopiedString
+ * or <code>NULL</code> upon error.
+ */
+typedef char *(*ConvertOutputCallback) (void *data_p);
+
+
+/**
+ * A callback function that marks up a job's output.
+ *
+ * @param data_p The data passed to SingleFlightConverter::MarkUpOutput.
+ * @return The marked-up output or <code>NULL</code> upon error.
+ */
+typedef json_t *(*MarkUpOutputCallback) (void *data_p);
+
+
+/**
+ * A SingleFlightConverter makes sure that, for each job, output format
+ * and set of custom columns, only one conversion or markup of a job's
+ * output runs at any one time.
+ *
+ * The first request for a given key runs the conversion and any requests
+ * for the same key that arrive while it is running wait for it to finish
+ * and are then given a copy of its result, rather than each of them
+ * running their own formatter and writing to the same output file. A
+ * single converter is shared by all of the Blast services.
+ *
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL SingleFlightConverter
+{
+public:
+
+	/**
+	 * Get the SingleFlightConverter that is shared across all of the Blast services
+	 * creating it if necessary. Each successful call must be matched by a call to
+	 * ReleaseSharedSingleFlightConverter.
+	 *
+	 * @return The shared SingleFlightConverter or 0 upon error.
+	 */
+	static SingleFlightConverter *GetSharedSingleFlightConverter ();
+
+
+	/**
+	 * Release a reference to the shared SingleFlightConverter. When the last
+	 * reference is released, the converter is freed.
+	 */
+	static void ReleaseSharedSingleFlightConverter ();
+
+
+	/**
+	 * Make the key that identifies the conversion of a job's output.
+	 *
+	 * @param job_id_s The job's uuid as a string.
+	 * @param output_format_code The required output format code.
+	 * @param custom_format_s The custom columns for the output format or <code>NULL</code>
+	 * for the default ones.
+	 * @return The key which should be freed with FreeCopiedString or <code>NULL</code>
+	 * upon error.
+	 */
+	static char *MakeFlightKey (const char *job_id_s, const uint32 output_format_code, const char *custom_format_s);
+
+
+	/**
+	 * Convert a job's output, sharing the result with any other calls for the
+	 * same key that are made while the conversion is running.
+	 *
+	 * @param key_s The key for the conversion as made by MakeFlightKey.
+	 * @param convert_fn The callback function to run the conversion if no other
+	 * call for the same key is already running it.
+	 * @param callback_data_p The data to pass to convert_fn.
+	 * @return The converted output which should be freed with FreeCopiedString
+	 * or <code>NULL</code> upon error.
+	 */
+	char *ConvertOutput (const char *key_s, ConvertOutputCallback convert_fn, void *callback_data_p);
+
+
+	/**
+	 * Mark up a job's output, sharing the result with any other calls for the
+	 * same key that are made while the markup is running.
+	 *
+	 * @param key_s The key for the markup as made by MakeFlightKey.
+	 * @param markup_fn The callback function to run the markup if no other
+	 * call for the same key is already running it.
+	 * @param callback_data_p The data to pass to markup_fn.
+	 * @return The marked-up output or <code>NULL</code> upon error.
+	 */
+	json_t *MarkUpOutput (const char *key_s, MarkUpOutputCallback markup_fn, void *callback_data_p);
+
+
+private:
+	static SingleFlightConverter *sfc_shared_converter_p;
+	static uint32 sfc_shared_converter_count;
+	static pthread_mutex_t sfc_shared_converter_mutex;
+
+	/** The conversions that are currently running */
+	struct ConversionFlight *sfc_flights_p;
+
+	/** This protects the flights. */
+	pthread_mutex_t sfc_mutex;
+
+	/** This is signalled whenever a flight finishes. */
+	pthread_cond_t sfc_landed_cond;
+
+
+	SingleFlightConverter ();
+
+	~SingleFlightConverter ();
+
+	struct ConversionFlight *JoinFlight (const char *key_s, bool *leader_flag_p);
+
+	void LandFlight (struct ConversionFlight *flight_p, const char *result_s, const json_t *result_p);
+
+	void WaitForFlight (struct ConversionFlight *flight_p, char **result_ss, json_t **result_pp);
+};
+
+
+#endif /* SERVER_SRC_SERVICES_BLAST_INCLUDE_SINGLE_FLIGHT_CONVERTER_HPP_ */
@@ -50,7 +50,7 @@ public:
 
 
 	/**
-	 * Add an argument to the underlying ByteBuffer
+	 * Add an argument to the underlying list of arguments.
 	 *
 	 * @param arg_s The value to add.
 	 * @param hyphen_flag If this is <code>true</code> then the value
@@ -65,10 +65,45 @@ public:
 	 * Get the complete set of arguments as an array of strings.
 	 * The final element in the array will be <code>NULL</code>
 	 *
-	 * @return The arguments as a string
+	 * The strings are owned by this StringsArgsProcessor, so only the array
+	 * itself needs to be freed with FreeMemory.
+	 *
+	 * @return The arguments as an array of strings suitable for passing as
+	 * argv to a process.
 	 */
 	char **GetArgsAsStrings ();
 
+
+	/**
+	 * Get the complete set of arguments as a single command line with any
+	 * arguments containing whitespace quoted.
+	 *
+	 * @return The newly-allocated command line which will need to be freed
+	 * with FreeCopiedString to avoid a memory leak or <code>NULL</code> upon error.
+	 */
+	char *GetArgsAsString ();
+
+
+	/**
+	 * Replace the value that follows a given argument.
+	 *
+	 * @param arg_s The argument, including any leading hyphen, to search for.
+	 * @param value_s The new value for the argument. This will be copied.
+	 * @return <code>true</code> if the argument was found and its value was
+	 * replaced successfully, <code>false</code> otherwise.
+	 */
+	bool ReplaceArgValue (const char *arg_s, const char *value_s);
+
+
+	/**
+	 * Get the value that follows a given argument.
+	 *
+	 * @param arg_s The argument, including any leading hyphen, to search for.
+	 * @return The value which is owned by this StringsArgsProcessor or
+	 * <code>NULL</code> if the argument could not be found.
+	 */
+	const char *GetArgValue (const char *arg_s) const;
+
 private:
 	LinkedList *sap_args_p;
 };
@@ -28,11 +28,21 @@
 #ifndef SYSTEM_BLAST_TOOL_HPP_
 #define SYSTEM_BLAST_TOOL_HPP_
 
-#include "byte_buffer_args_processor.hpp"
+#include <time.h>
+
+#include "strings_args_processor.hpp"
 #include "external_blast_tool.hpp"
+#include "blast_process.h"
+
+
+/* forward declaration */
+class ShardedDatabaseSearch;
+class ChunkedQuerySearch;
 
 /**
- * A class that will run Blast as a system process.
+ * A class that will run Blast as a system process. The process is
+ * launched directly rather than via a shell with its stdout and stderr
+ * going to the job's log file.
  *
  * @ingroup blast_service
  */
@@ -68,21 +78,6 @@ public:
 	 */
 	virtual ~SystemBlastTool ();
 
-	/**
-	 * Parse a ParameterSet to configure a BlastTool prior
-	 * to it being ran.
-	 *
-	 * @param params_p The ParameterSet to parse.
-	 * @param app_params_p The BlastAppParameters to use process the
-	 * values from the given ParameterSet.
-	 * @return <code>true</code> if the BlastTool was configured
-	 * successfully and is ready to be ran, <code>false</code>
-	 * otherwise.
-	 * @see BlastTool::ParseParameters
-	 */
-	virtual bool ParseParameters (ParameterSet *params_p, BlastAppParameters *app_params_p);
-
-
 	/**
 	 * Run this BlastTool
 	 *
@@ -102,9 +97,129 @@ public:
 	 */
 	virtual OperationStatus GetStatus (bool update_flag = true);
 
+
+	/**
+	 * Stop any Blast processes that this SystemBlastTool is running,
+	 * along with anything that they have started. If the job is part
+	 * of a batch, it is just detached from it instead.
+	 *
+	 * @return <code>true</code> if any processes are being stopped,
+	 * <code>false</code> otherwise.
+	 */
+	virtual bool Cancel ();
+
+
+	/**
+	 * Cancel a job run by a SystemBlastTool, or one of its subclasses,
+	 * without needing its BlastTool.
+	 *
+	 * @param data_p The BlastServiceData for the Service that is running the job.
+	 * @param job_id_s The id of the job to cancel.
+	 * @return <code>true</code> if the job is being stopped,
+	 * <code>false</code> otherwise.
+	 * @see Cancel
+	 */
+	static bool CancelJob (const BlastServiceData *data_p, const char *job_id_s);
+
+
+	/**
+	 * Add the database for this SystemBlastTool to a CombinedDatabaseSearch.
+	 * This is only possible if the output is in single-file JSON format.
+	 *
+	 * @param search_p The CombinedDatabaseSearch to add the database to.
+	 * @return <code>true</code> if the database was added successfully,
+	 * <code>false</code> otherwise.
+	 */
+	virtual bool AddToCombinedDatabaseSearch (CombinedDatabaseSearch *search_p);
+
+
+	/**
+	 * Run a CombinedDatabaseSearch using the arguments of this SystemBlastTool.
+	 *
+	 * @param search_p The CombinedDatabaseSearch to run.
+	 * @return The OperationStatus of the Blast process.
+	 */
+	virtual OperationStatus RunCombinedDatabaseSearch (CombinedDatabaseSearch *search_p);
+
+
+	/**
+	 * Get the results of the Blast process for this SystemBlastTool's
+	 * ServiceJob, or any errors if it failed.
+	 *
+	 * @param status The OperationStatus of the Blast process.
+	 * @return The OperationStatus of the ServiceJob.
+	 */
+	virtual OperationStatus CompleteRun (OperationStatus status);
+
 protected:
 
-	ByteBufferArgsProcessor *sbt_args_processor_p;
+	/** The arguments used to launch the Blast process. */
+	StringsArgsProcessor *sbt_args_processor_p;
+
+	/**
+	 * When this job's Blast processes will be stopped. This is set when the
+	 * first process is launched and is 0 if the job has no time limit.
+	 */
+	time_t sbt_deadline;
+
+	/** Why this job's Blast processes were stopped, if they were. */
+	BlastProcessStop sbt_stop;
+
+	/**
+	 * The number of jobs whose queries are in this job's Blast process. This is
+	 * more than 1 if it runs a batch, in which case its time and memory limits are
+	 * scaled up to cover all of them.
+	 */
+	uint32 sbt_num_batched_jobs;
+
+
+	/**
+	 * Get the maximum number of seconds that this job can run for.
+	 *
+	 * @return The time limit or 0 if there is no limit.
+	 */
+	uint32 GetTimeLimit () const;
+
+
+	/**
+	 * Get when this job's Blast processes will be stopped, starting
+	 * the clock if this is the first time that it has been called.
+	 *
+	 * @return The deadline or 0 if there is no time limit.
+	 */
+	time_t GetDeadline ();
+
+
+	/**
+	 * Launch a Blast process for this job and let the service's
+	 * BlastProcessMonitor keep track of it so that it can be cancelled
+	 * or stopped once the job's time limit has passed. If the service
+	 * has a BlastProcessEnvelope, the process is started within its limits.
+	 *
+	 * @param args_ss The <code>NULL</code>-terminated array of arguments.
+	 * @param logfile_s The file to send the process's stdout and stderr to.
+	 * @return The process id or -1 upon error, including if the limits
+	 * couldn't be applied.
+	 */
+	pid_t SpawnTrackedBlastProcess (char **args_ss, const char *logfile_s);
+
+
+	/**
+	 * Wait for a process launched by SpawnTrackedBlastProcess to finish.
+	 *
+	 * @param pid The process id to wait for.
+	 * @param result_p Where the exit status and resource usage of the process will be stored.
+	 * @return <code>true</code> if the process was waited for successfully, <code>false</code>
+	 * otherwise.
+	 */
+	bool WaitForTrackedBlastProcess (pid_t pid, BlastProcessResult *result_p);
+
+
+	/**
+	 * Add an error to this job's ServiceJob saying why its Blast
+	 * processes were stopped.
+	 */
+	void AddStopErrorDetails ();
 
 	/**
 	 * Get the ArgsProcessor that this BlastTool will use
@@ -127,6 +242,131 @@ protected:
 
 	bool SaveCommandLine (const char *command_line_s);
 
+
+	/**
+	 * Add the "-num_threads" argument to the command line.
+	 *
+	 * @param num_threads The number of threads that the Blast process will use.
+	 * @return <code>true</code> if the argument was added successfully,
+	 * <code>false</code> otherwise.
+	 */
+	bool AddNumThreadsArg (uint32 num_threads);
+
+
+	/**
+	 * Wait for the BlastScheduler to let this job run and then launch
+	 * the Blast process and wait for it to finish.
+	 *
+	 * @param replacements_ss If this is not <code>NULL</code>, it is a
+	 * <code>NULL</code>-terminated array of argument and value pairs whose
+	 * values will replace the existing values of those arguments for this run only.
+	 * @param db_size The size of the database being searched which is used to
+	 * choose the number of threads.
+	 * @return The OperationStatus of the Blast process.
+	 */
+	OperationStatus RunBlastCommand (const char **replacements_ss, uint64 db_size);
+
+
+	/**
+	 * Launch the Blast process with the current arguments and wait
+	 * for it to finish.
+	 *
+	 * @param replacements_ss If this is not <code>NULL</code>, it is a
+	 * <code>NULL</code>-terminated array of argument and value pairs whose
+	 * values will replace the existing values of those arguments for this run only.
+	 * @return The OperationStatus of the Blast process.
+	 */
+	OperationStatus LaunchBlastProcess (const char **replacements_ss);
+
+
+	/**
+	 * Get the key used to batch this job together with others that only
+	 * differ in their queries.
+	 *
+	 * @param query_filename_ss Where the query filename will be stored.
+	 * @param output_filename_ss Where the output filename will be stored.
+	 * @return The newly-allocated key which should be freed with FreeCopiedString
+	 * or <code>NULL</code> if this job cannot be batched.
+	 */
+	char *GetBatchKey (const char **query_filename_ss, const char **output_filename_ss);
+
+
+	/**
+	 * The BlastBatchRunFn used to run a batch of jobs.
+	 *
+	 * @param data_p The SystemBlastTool that is running the batch.
+	 * @param query_filename_s The file containing all of the queries in the batch.
+	 * @param output_filename_s The file to write the combined results to.
+	 * @param num_jobs The number of jobs in the batch.
+	 * @return The OperationStatus of the Blast process.
+	 */
+	static OperationStatus RunBatchedBlastCommand (void *data_p, const char *query_filename_s, const char *output_filename_s, uint32 num_jobs);
+
+
+	/**
+	 * Check whether this job writes its output in single-file JSON format
+	 * which is needed to split up or merge its results.
+	 *
+	 * @return <code>true</code> if the output is in single-file JSON format,
+	 * <code>false</code> otherwise.
+	 */
+	bool HasSingleFileJSONOutput () const;
+
+
+	/**
+	 * Wait for the BlastScheduler to let this job run and then search
+	 * each of the shards of the database at the same time, sharing the
+	 * cores between them, before merging their results.
+	 *
+	 * @param search_p The ShardedDatabaseSearch to run.
+	 * @return The OperationStatus of the search.
+	 */
+	OperationStatus RunShardedSearch (ShardedDatabaseSearch *search_p);
+
+
+	/**
+	 * Launch a Blast process for each of the shards of a database and
+	 * wait for them all to finish.
+	 *
+	 * @param search_p The ShardedDatabaseSearch to run.
+	 * @param max_running_shards The maximum number of processes to run at the same time.
+	 * @return The OperationStatus of the Blast processes.
+	 */
+	OperationStatus LaunchShardProcesses (ShardedDatabaseSearch *search_p, uint32 max_running_shards);
+
+
+	/**
+	 * Split this job's queries into chunks if it has several of them
+	 * and the service is configured to do so.
+	 *
+	 * @return The ChunkedQuerySearch or <code>NULL</code> if the queries
+	 * should be searched by a single Blast process.
+	 */
+	ChunkedQuerySearch *GetChunkedQuerySearch ();
+
+
+	/**
+	 * Wait for the BlastScheduler to let this job run and then search
+	 * the chunks of the queries at the same time, sharing the cores
+	 * between them.
+	 *
+	 * @param search_p The ChunkedQuerySearch to run.
+	 * @return The OperationStatus of the search.
+	 */
+	OperationStatus RunChunkedSearch (ChunkedQuerySearch *search_p);
+
+
+	/**
+	 * Launch a Blast process for each of the chunks of the queries,
+	 * keeping up to max_running_chunks of them running at a time,
+	 * and wait for them all to finish.
+	 *
+	 * @param search_p The ChunkedQuerySearch to run.
+	 * @param max_running_chunks The maximum number of processes to run at the same time.
+	 * @return The OperationStatus of the Blast processes.
+	 */
+	OperationStatus LaunchChunkProcesses (ChunkedQuerySearch *search_p, uint32 max_running_chunks);
+
 };
 
 
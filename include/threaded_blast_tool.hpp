@@ -30,11 +30,15 @@
 #define THREADED_BLAST_TOOL_HPP_
 
 
-#include "pthread.h"
 #include "system_blast_tool.hpp"
+#include "blast_thread_pool.hpp"
 
 /**
- * A class that will run Blast within a pthread.
+ * A class that will run Blast as a process launched from one of the
+ * threads of a shared BlastThreadPool. This allows the jobs to run
+ * asynchronously within the server process whilst limiting the number
+ * of Blast processes that are running at any one time to the number
+ * of threads in the pool.
  *
  * @ingroup blast_service
  */
@@ -51,8 +55,21 @@ public:
 	 * @param data_p The BlastServiceData for the Service that will run this ExternalBlastTool.
 	 * @param blast_program_name_s The name of blast command line executable that this ExternalBlastTool
 	 * will call to run its blast job.
+	 * @param pool_p The BlastThreadPool that will run the blast job.
 	 */
-	ThreadedBlastTool (BlastServiceJob *service_job_p, const char *name_s, const char *factory_s, const BlastServiceData *data_p, const char *blast_program_name_s);
+	ThreadedBlastTool (BlastServiceJob *service_job_p, const char *name_s, const char *factory_s, const BlastServiceData *data_p, const char *blast_program_name_s, BlastThreadPool *pool_p);
+
+
+	/**
+	 * Create a ThreadedBlastTool for a given ServiceJob using the configuration details from
+	 * a serialised JSON fragment.
+	 *
+	 * @param job_p The ServiceJob to associate with this ThreadedBlastTool.
+	 * @param data_p The BlastServiceData for the Service that will run this ThreadedBlastTool.
+	 * @param json_p The JSON fragment to fill in the serialised values such as job name, etc.
+	 * @param pool_p The BlastThreadPool that will run the blast job.
+	 */
+	ThreadedBlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p, const json_t *json_p, BlastThreadPool *pool_p);
 
 	/**
 	 * The ThreadedBlastTool destructor.
@@ -60,24 +77,15 @@ public:
 	virtual ~ThreadedBlastTool ();
 
 	/**
-	 * Run this ThreadedBlastTool
+	 * Run this ThreadedBlastTool. The blast job is added to the
+	 * BlastThreadPool and this method returns without waiting for
+	 * it to finish.
 	 *
 	 * @return The OperationStatus of this ThreadedBlastTool after
-	 * it has started running.
+	 * it has been queued.
 	 */
 	virtual OperationStatus Run ();
 
-	/**
-	 * Get the results after the ThreadedBlastTool has finished
-	 * running.
-	 *
-	 * @param formatter_p The BlastFormatter to convert the results
-	 * into a different format. If this is 0, then the results will be
-	 * returned without any conversion.
-	 * @return The results as a c-style string or 0 upon error.
-	 */
-	virtual char *GetResults (BlastFormatter *formatter_p);
-
 	/**
 	 * Get the status of a ThreadedBlastTool
 	 *
@@ -88,15 +96,34 @@ public:
 	 */
 	virtual OperationStatus GetStatus (bool update_flag = true);
 
-protected:
-	/** The pthread to run this BlastTool in. */
-	pthread_t *tbt_thread_p;
 
-	/** The mutex to use to moderate access to the pthread. */
-	pthread_mutex_t *tbt_mutex_p;
+	/**
+	 * Cancel this ThreadedBlastTool. If its job is still waiting in the
+	 * BlastThreadPool or for free cores, it will fail without running,
+	 * otherwise its Blast process is stopped.
+	 *
+	 * @return <code>true</code> if the job is being stopped,
+	 * <code>false</code> otherwise.
+	 */
+	virtual bool Cancel ();
 
-	/** The id of the pthread to run this BlastTool in. */
-	int tbt_thread_id;
+
+	/**
+	 * Cancel a job run by a ThreadedBlastTool without needing its BlastTool.
+	 * This can also be used for jobs that weren't run by a ThreadedBlastTool,
+	 * in which case it is the same as SystemBlastTool :: CancelJob.
+	 *
+	 * @param data_p The BlastServiceData for the Service that is running the job.
+	 * @param job_id_s The id of the job to cancel.
+	 * @return <code>true</code> if the job is being stopped,
+	 * <code>false</code> otherwise.
+	 * @see Cancel
+	 */
+	static bool CancelJob (const BlastServiceData *data_p, const char *job_id_s);
+
+protected:
+	/** The BlastThreadPool to run the blast job in. */
+	BlastThreadPool *tbt_pool_p;
 };
 
 
@@ -0,0 +1,117 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/**
+ * @file
+ * @brief
+ */
+/*
+ * threaded_blast_tool_factory.hpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#ifndef SERVICES_BLAST_INCLUDE_THREADED_BLAST_TOOL_FACTORY_HPP_
+#define SERVICES_BLAST_INCLUDE_THREADED_BLAST_TOOL_FACTORY_HPP_
+
+
+#include "external_blast_tool_factory.hpp"
+#include "blast_thread_pool.hpp"
+
+
+/**
+ * The class for generating ThreadedBlastTools.
+ *
+ * @see ThreadedBlastTool
+ * @ingroup blast_service
+ */
+class BLAST_SERVICE_LOCAL ThreadedBlastToolFactory : public ExternalBlastToolFactory
+{
+public:
+	/**
+	 * A thin wrapper around the constructor for ThreadedBlastToolFactory to catch any
+	 * exceptions and return 0 instead.
+	 *
+	 * @param service_config_p The Blast Service configuration from the global
+	 * server configuration.
+	 * @return The new ThreadedBlastToolFactory or 0 upon error.
+	 * @see  ThreadedBlastToolFactory::ThreadedBlastToolFactory
+	 */
+	static ThreadedBlastToolFactory *CreateThreadedBlastToolFactory (const json_t *service_config_p);
+
+
+	/**
+	 * The ThreadedBlastToolFactory destructor.
+	 */
+	virtual ~ThreadedBlastToolFactory ();
+
+
+	/**
+	 * Get an identifying name for this BlastToolFactory.
+	 *
+	 * @return The name for this type of BlastToolFactory.
+	 */
+	virtual const char *GetName ();
+
+
+	/**
+	 * Create a BlastTool.
+	 *
+	 * @param job_p The ServiceJob to associate with the newly generated BlastTool.
+	 * @param name_s The name to give to the new BlastTool.
+	 * @param data_p The BlastServiceData for the Service that will use this BlastTool.
+	 * @return The new BlastTool or 0 upon error.
+	 */
+	virtual BlastTool *CreateBlastTool (BlastServiceJob *job_p, const char *name_s, const BlastServiceData *data_p);
+
+
+	/**
+	 * Create a BlastTool from serialised JSON.
+	 *
+	 * @param json_p The ServiceJob to associate with the newly generated BlastTool.
+	 * @param blast_job_p The BlastServiceJob to be associated with the generated BlastTool.
+	 * @param service_data_p The BlastServiceData for the Service that will use this BlastTool.
+	 * @return The new BlastTool or 0 upon error.
+	 */
+	virtual BlastTool *CreateBlastTool (const json_t *json_p, BlastServiceJob *blast_job_p, BlastServiceData *service_data_p);
+
+
+	/**
+	 * Are the BlastTools that this BlastToolFactory
+	 * create able to run asynchronously?
+	 *
+	 * @return <code>true</code> if the BlastTools are able
+	 * to run asynchronously, <code>false</code> otherwise.
+	 */
+	virtual Synchronicity GetToolsSynchronicity () const;
+
+protected:
+
+	/** The BlastThreadPool that the ThreadedBlastTools will run their jobs in. */
+	BlastThreadPool *tbtf_pool_p;
+
+	/**
+	 * The constructor for ThreadedBlastToolFactory.
+	 *
+	 * @param service_config_p The Blast Service configuration from the global
+	 * server configuration.
+	 */
+	ThreadedBlastToolFactory (const json_t *service_config_p);
+};
+
+
+#endif /* SERVICES_BLAST_INCLUDE_THREADED_BLAST_TOOL_FACTORY_HPP_ */
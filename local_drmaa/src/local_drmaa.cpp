@@ -0,0 +1,2639 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * local_drmaa.cpp
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: billy
+ *
+ * A stand-in DRMAA library that runs jobs as child processes on the
+ * local machine rather than submitting them to a cluster. It lets the
+ * drmaa blast tool be run, load-tested and profiled on a single machine.
+ *
+ * Jobs wait in a first-in first-out queue until they have been queued
+ * for at least the emulated scheduling delay and there are enough free
+ * slots to run them. Each job uses one slot unless its native
+ * specification asks for more cores, using "-n <cores>", "-c <cores>"
+ * or "--cpus-per-task=<cores>".
+ *
+ * It is configured with the following environment variables:
+ *
+ *  LOCAL_DRMAA_SLOTS: The number of slots, defaulting to the number of processors.
+ *  LOCAL_DRMAA_QUEUE_WAIT_MS: The minimum time that each job is queued for, defaulting to 0.
+ *  LOCAL_DRMAA_QUEUE_WAIT_JITTER_MS: A random extra queuing time of up to this many milliseconds.
+ *  LOCAL_DRMAA_STATS_FILE: If set, the counts and timings of the DRMAA calls
+ *  made during the session are written to this file as JSON by drmaa_exit.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "drmaa.h"
+
+
+extern char **environ;
+
+
+/* How often, in milliseconds, running jobs are checked to see if they have finished */
+#define LD_POLL_INTERVAL_MS	(20)
+
+/* How long, in seconds, a terminated job has to exit before it is killed */
+#define LD_KILL_GRACE_PERIOD	(5)
+
+/* How long, in seconds, the details of a finished job are kept if nothing waits for it */
+#define LD_FINISHED_JOB_LIFETIME	(3600)
+
+#define LD_JOB_ID_BUFFER	(64)
+
+/* This bit in a job's stat marks that it was aborted before it ran */
+#define LD_STAT_ABORTED	(0x10000)
+
+
+/*
+ * A list of strings along with the position of the next
+ * one to return from the drmaa_get_next_ functions.
+ */
+typedef struct StringList
+{
+	char **sl_values_ss;
+
+	size_t sl_num_values;
+
+	size_t sl_next;
+} StringList;
+
+
+struct drmaa_attr_names_s
+{
+	StringList an_list;
+};
+
+
+struct drmaa_attr_values_s
+{
+	StringList av_list;
+};
+
+
+struct drmaa_job_ids_s
+{
+	StringList ji_list;
+};
+
+
+/*
+ * A job template attribute, which has either a single
+ * value or a NULL-terminated array of values.
+ */
+typedef struct TemplateAttribute
+{
+	char *ta_name_s;
+
+	char *ta_value_s;
+
+	char **ta_values_ss;
+
+	struct TemplateAttribute *ta_next_p;
+} TemplateAttribute;
+
+
+struct drmaa_job_template_s
+{
+	TemplateAttribute *jt_attributes_p;
+};
+
+
+typedef struct LocalJob
+{
+	char lj_id_s [LD_JOB_ID_BUFFER];
+
+	/* The command followed by its arguments, all with their placeholders filled in */
+	char **lj_args_ss;
+
+	/* The job's environment or NULL to use the server's one */
+	char **lj_env_ss;
+
+	char *lj_wd_s;
+
+	char *lj_input_s;
+
+	char *lj_output_s;
+
+	char *lj_error_s;
+
+	bool lj_join_flag;
+
+	unsigned int lj_slots;
+
+	int lj_state;
+
+	/* Was the job submitted on hold? */
+	bool lj_hold_flag;
+
+	pid_t lj_pid;
+
+	int lj_stat;
+
+	struct rusage lj_usage;
+
+	/* When the job was submitted, could first be started, started and finished */
+	struct timespec lj_submit_time;
+
+	struct timespec lj_eligible_time;
+
+	struct timespec lj_start_time;
+
+	struct timespec lj_end_time;
+
+	/* When the job was sent SIGTERM or 0 if it hasn't been terminated */
+	time_t lj_term_time;
+
+	struct LocalJob *lj_next_p;
+} LocalJob;
+
+
+/*
+ * The counts and timings of the DRMAA calls, so that the overhead of
+ * the DRMAA integration can be measured.
+ */
+typedef struct LocalDrmaaStats
+{
+	unsigned long lds_num_run_job_calls;
+
+	unsigned long lds_num_run_bulk_jobs_calls;
+
+	unsigned long lds_num_jobs_submitted;
+
+	unsigned long lds_num_job_ps_calls;
+
+	unsigned long lds_num_control_calls;
+
+	unsigned long lds_num_wait_calls;
+
+	unsigned long lds_num_jobs_started;
+
+	unsigned long lds_num_jobs_finished;
+
+	unsigned long lds_max_queued_jobs;
+
+	unsigned long lds_max_running_jobs;
+
+	/* All of these are in nanoseconds */
+	unsigned long long lds_submit_ns;
+
+	unsigned long long lds_job_ps_ns;
+
+	unsigned long long lds_total_queue_wait_ns;
+
+	unsigned long long lds_max_queue_wait_ns;
+
+	unsigned long long lds_total_run_ns;
+} LocalDrmaaStats;
+
+
+typedef struct LocalDrmaaSession
+{
+	bool lds_active_flag;
+
+	unsigned int lds_num_slots;
+
+	unsigned int lds_used_slots;
+
+	unsigned int lds_queue_wait_ms;
+
+	unsigned int lds_queue_wait_jitter_ms;
+
+	unsigned int lds_random_seed;
+
+	unsigned long lds_next_job_number;
+
+	unsigned long lds_num_queued_jobs;
+
+	unsigned long lds_num_running_jobs;
+
+	/* The jobs in the order that they were submitted */
+	LocalJob *lds_jobs_p;
+
+	LocalJob *lds_last_job_p;
+
+	pthread_t lds_dispatcher;
+
+	/* This is signalled to wake the dispatcher */
+	pthread_cond_t lds_dispatch_cond;
+
+	/* This is broadcast whenever a job finishes */
+	pthread_cond_t lds_finished_cond;
+
+	struct timespec lds_start_time;
+
+	LocalDrmaaStats lds_stats;
+} LocalDrmaaSession;
+
+
+static LocalDrmaaSession s_session;
+
+static pthread_mutex_t s_session_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static const char * const S_SCALAR_ATTRIBUTES_SS [] =
+{
+	DRMAA_BLOCK_EMAIL,
+	DRMAA_ERROR_PATH,
+	DRMAA_INPUT_PATH,
+	DRMAA_JOB_CATEGORY,
+	DRMAA_JOB_NAME,
+	DRMAA_JOIN_FILES,
+	DRMAA_JS_STATE,
+	DRMAA_NATIVE_SPECIFICATION,
+	DRMAA_OUTPUT_PATH,
+	DRMAA_REMOTE_COMMAND,
+	DRMAA_WD,
+	NULL
+};
+
+
+static const char * const S_VECTOR_ATTRIBUTES_SS [] =
+{
+	DRMAA_V_ARGV,
+	DRMAA_V_EMAIL,
+	DRMAA_V_ENV,
+	NULL
+};
+
+
+static const char * const S_ERRORS_SS [] =
+{
+	"Success",
+	"Internal error",
+	"DRM communication failure",
+	"Authorization failure",
+	"Invalid argument",
+	"No active session",
+	"Out of memory",
+	"Invalid contact string",
+	"Default contact string error",
+	"No default contact string selected",
+	"DRMS initialisation failed",
+	"Session already active",
+	"DRMS exit error",
+	"Invalid attribute format",
+	"Invalid attribute value",
+	"Conflicting attribute values",
+	"Try later",
+	"Denied by DRM",
+	"Invalid job",
+	"Resume inconsistent state",
+	"Suspend inconsistent state",
+	"Hold inconsistent state",
+	"Release inconsistent state",
+	"Exit timeout",
+	"No rusage",
+	"No more elements"
+};
+
+
+
+static int SetError (const int error, char *error_diagnosis, size_t error_diag_len, const char *format_s, ...);
+
+static bool IsKnownAttribute (const char *name_s, const char * const *names_ss);
+
+static TemplateAttribute *FindAttribute (const drmaa_job_template_t *jt, const char *name_s);
+
+static const char *GetAttributeValue (const drmaa_job_template_t *jt, const char *name_s);
+
+static char **CopyStringArray (const char * const *values_ss);
+
+static void FreeStringArray (char **values_ss);
+
+static bool AddToStringList (StringList *list_p, const char *value_s);
+
+static int GetNextFromStringList (StringList *list_p, char *value, size_t value_len);
+
+static void FreeStringList (StringList *list_p);
+
+static char *ReplacePlaceholders (const char *value_s, const char *wd_s, const int index);
+
+static char *GetJobPath (const char *path_s, const char *wd_s, const char *job_name_s, const char *job_id_s, const char *suffix_s, const int index);
+
+static unsigned int GetSlotsFromNativeSpecification (const char *spec_s);
+
+static LocalJob *CreateLocalJob (const drmaa_job_template_t *jt, const char *job_id_s, const int index, char *error_diagnosis, size_t error_diag_len, int *res_p);
+
+static void FreeLocalJobDetails (LocalJob *job_p);
+
+static void AddLocalJob (LocalJob *job_p);
+
+static LocalJob *FindLocalJob (const char *job_id_s);
+
+static void RemoveLocalJob (LocalJob *job_p);
+
+static bool IsLocalJobFinished (const LocalJob *job_p);
+
+static void FinishLocalJob (LocalJob *job_p, const int state, const int stat);
+
+static bool StartLocalJob (LocalJob *job_p);
+
+static int ControlLocalJob (LocalJob *job_p, const int action);
+
+static void *RunDispatcher (void *data_p);
+
+static void CheckRunningJobs (const struct timespec *now_p);
+
+static void StartQueuedJobs (const struct timespec *now_p);
+
+static void PruneFinishedJobs (const struct timespec *now_p);
+
+static void GetDispatchTimeout (const struct timespec *now_p, struct timespec *timeout_p);
+
+static unsigned int GetEnvironmentValue (const char *name_s, const unsigned int default_value);
+
+static unsigned long long GetNanosecondsBetween (const struct timespec *start_p, const struct timespec *end_p);
+
+static void AddMilliseconds (struct timespec *time_p, const unsigned long ms);
+
+static bool IsBefore (const struct timespec *a_p, const struct timespec *b_p);
+
+static bool WaitForFinishedJob (const char *job_id_s, signed long timeout, LocalJob **job_pp);
+
+static void WriteStats (const char *filename_s);
+
+static void ClearStats (LocalDrmaaStats *stats_p);
+
+
+
+/*
+ * String list iterators
+ */
+
+int drmaa_get_next_attr_name (drmaa_attr_names_t *values, char *value, size_t value_len)
+{
+	return values ? GetNextFromStringList (& (values -> an_list), value, value_len) : DRMAA_ERRNO_INVALID_ARGUMENT;
+}
+
+
+int drmaa_get_next_attr_value (drmaa_attr_values_t *values, char *value, size_t value_len)
+{
+	return values ? GetNextFromStringList (& (values -> av_list), value, value_len) : DRMAA_ERRNO_INVALID_ARGUMENT;
+}
+
+
+int drmaa_get_next_job_id (drmaa_job_ids_t *values, char *value, size_t value_len)
+{
+	return values ? GetNextFromStringList (& (values -> ji_list), value, value_len) : DRMAA_ERRNO_INVALID_ARGUMENT;
+}
+
+
+int drmaa_get_num_attr_names (drmaa_attr_names_t *values, size_t *size)
+{
+	if (!values)
+		{
+			return DRMAA_ERRNO_INVALID_ARGUMENT;
+		}
+
+	*size = values -> an_list.sl_num_values;
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_num_attr_values (drmaa_attr_values_t *values, size_t *size)
+{
+	if (!values)
+		{
+			return DRMAA_ERRNO_INVALID_ARGUMENT;
+		}
+
+	*size = values -> av_list.sl_num_values;
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_num_job_ids (drmaa_job_ids_t *values, size_t *size)
+{
+	if (!values)
+		{
+			return DRMAA_ERRNO_INVALID_ARGUMENT;
+		}
+
+	*size = values -> ji_list.sl_num_values;
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+void drmaa_release_attr_names (drmaa_attr_names_t *values)
+{
+	if (values)
+		{
+			FreeStringList (& (values -> an_list));
+			free (values);
+		}
+}
+
+
+void drmaa_release_attr_values (drmaa_attr_values_t *values)
+{
+	if (values)
+		{
+			FreeStringList (& (values -> av_list));
+			free (values);
+		}
+}
+
+
+void drmaa_release_job_ids (drmaa_job_ids_t *values)
+{
+	if (values)
+		{
+			FreeStringList (& (values -> ji_list));
+			free (values);
+		}
+}
+
+
+
+/*
+ * Session management
+ */
+
+int drmaa_init (const char *contact, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+
+	if (contact && (*contact != '\0') && (strcmp (contact, "local") != 0))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_CONTACT_STRING, error_diagnosis, error_diag_len, "The only contact string available is \"local\", not \"%s\"", contact);
+		}
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (!s_session.lds_active_flag)
+		{
+			long num_processors = sysconf (_SC_NPROCESSORS_ONLN);
+
+			s_session.lds_num_slots = GetEnvironmentValue ("LOCAL_DRMAA_SLOTS", (num_processors > 0) ? (unsigned int) num_processors : 1);
+			s_session.lds_queue_wait_ms = GetEnvironmentValue ("LOCAL_DRMAA_QUEUE_WAIT_MS", 0);
+			s_session.lds_queue_wait_jitter_ms = GetEnvironmentValue ("LOCAL_DRMAA_QUEUE_WAIT_JITTER_MS", 0);
+			s_session.lds_random_seed = (unsigned int) getpid ();
+			s_session.lds_used_slots = 0;
+			s_session.lds_next_job_number = 1;
+			s_session.lds_num_queued_jobs = 0;
+			s_session.lds_num_running_jobs = 0;
+			s_session.lds_jobs_p = NULL;
+			s_session.lds_last_job_p = NULL;
+			clock_gettime (CLOCK_MONOTONIC, & (s_session.lds_start_time));
+			ClearStats (& (s_session.lds_stats));
+
+			if (s_session.lds_num_slots == 0)
+				{
+					s_session.lds_num_slots = 1;
+				}
+
+			if (pthread_cond_init (& (s_session.lds_dispatch_cond), NULL) == 0)
+				{
+					if (pthread_cond_init (& (s_session.lds_finished_cond), NULL) == 0)
+						{
+							s_session.lds_active_flag = true;
+
+							if (pthread_create (& (s_session.lds_dispatcher), NULL, RunDispatcher, NULL) != 0)
+								{
+									s_session.lds_active_flag = false;
+									pthread_cond_destroy (& (s_session.lds_finished_cond));
+									pthread_cond_destroy (& (s_session.lds_dispatch_cond));
+									res = SetError (DRMAA_ERRNO_DRMS_INIT_FAILED, error_diagnosis, error_diag_len, "Failed to start the dispatcher thread");
+								}
+						}
+					else
+						{
+							pthread_cond_destroy (& (s_session.lds_dispatch_cond));
+							res = SetError (DRMAA_ERRNO_DRMS_INIT_FAILED, error_diagnosis, error_diag_len, "Failed to initialise condition variable");
+						}
+				}
+			else
+				{
+					res = SetError (DRMAA_ERRNO_DRMS_INIT_FAILED, error_diagnosis, error_diag_len, "Failed to initialise condition variable");
+				}
+		}
+	else
+		{
+			res = SetError (DRMAA_ERRNO_ALREADY_ACTIVE_SESSION, error_diagnosis, error_diag_len, "A session is already active");
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	return res;
+}
+
+
+int drmaa_exit (char *error_diagnosis, size_t error_diag_len)
+{
+	LocalJob *job_p;
+	pthread_t dispatcher;
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (!s_session.lds_active_flag)
+		{
+			pthread_mutex_unlock (&s_session_mutex);
+			return SetError (DRMAA_ERRNO_NO_ACTIVE_SESSION, error_diagnosis, error_diag_len, "There is no active session");
+		}
+
+	s_session.lds_active_flag = false;
+	dispatcher = s_session.lds_dispatcher;
+	pthread_cond_signal (& (s_session.lds_dispatch_cond));
+	pthread_cond_broadcast (& (s_session.lds_finished_cond));
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	pthread_join (dispatcher, NULL);
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	WriteStats (getenv ("LOCAL_DRMAA_STATS_FILE"));
+
+	/* As with a real DRM, any running jobs carry on, they just aren't waited for any more */
+	job_p = s_session.lds_jobs_p;
+
+	while (job_p)
+		{
+			LocalJob *next_p = job_p -> lj_next_p;
+
+			FreeLocalJobDetails (job_p);
+			free (job_p);
+			job_p = next_p;
+		}
+
+	s_session.lds_jobs_p = NULL;
+	s_session.lds_last_job_p = NULL;
+
+	pthread_cond_destroy (& (s_session.lds_finished_cond));
+	pthread_cond_destroy (& (s_session.lds_dispatch_cond));
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+
+/*
+ * Job templates
+ */
+
+int drmaa_allocate_job_template (drmaa_job_template_t **jt, char *error_diagnosis, size_t error_diag_len)
+{
+	drmaa_job_template_t *template_p;
+
+	if (!jt)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job template given");
+		}
+
+	template_p = (drmaa_job_template_t *) malloc (sizeof (drmaa_job_template_t));
+
+	if (!template_p)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate job template");
+		}
+
+	template_p -> jt_attributes_p = NULL;
+	*jt = template_p;
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_delete_job_template (drmaa_job_template_t *jt, char *error_diagnosis, size_t error_diag_len)
+{
+	TemplateAttribute *attr_p;
+
+	if (!jt)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job template given");
+		}
+
+	attr_p = jt -> jt_attributes_p;
+
+	while (attr_p)
+		{
+			TemplateAttribute *next_p = attr_p -> ta_next_p;
+
+			free (attr_p -> ta_name_s);
+			free (attr_p -> ta_value_s);
+			FreeStringArray (attr_p -> ta_values_ss);
+			free (attr_p);
+
+			attr_p = next_p;
+		}
+
+	free (jt);
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_set_attribute (drmaa_job_template_t *jt, const char *name, const char *value, char *error_diagnosis, size_t error_diag_len)
+{
+	TemplateAttribute *attr_p;
+	char *value_s;
+
+	if ((!jt) || (!name) || (!value))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job template, attribute name or value given");
+		}
+
+	if (!IsKnownAttribute (name, S_SCALAR_ATTRIBUTES_SS))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "\"%s\" is not a supported scalar attribute", name);
+		}
+
+	if ((strcmp (name, DRMAA_JS_STATE) == 0) && (strcmp (value, DRMAA_SUBMISSION_STATE_ACTIVE) != 0) && (strcmp (value, DRMAA_SUBMISSION_STATE_HOLD) != 0))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ATTRIBUTE_VALUE, error_diagnosis, error_diag_len, "\"%s\" is not a valid value for \"%s\"", value, name);
+		}
+
+	value_s = strdup (value);
+
+	if (!value_s)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to copy value for \"%s\"", name);
+		}
+
+	attr_p = FindAttribute (jt, name);
+
+	if (attr_p)
+		{
+			free (attr_p -> ta_value_s);
+		}
+	else
+		{
+			attr_p = (TemplateAttribute *) calloc (1, sizeof (TemplateAttribute));
+
+			if (attr_p)
+				{
+					attr_p -> ta_name_s = strdup (name);
+				}
+
+			if ((!attr_p) || (!attr_p -> ta_name_s))
+				{
+					free (attr_p);
+					free (value_s);
+					return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate attribute \"%s\"", name);
+				}
+
+			attr_p -> ta_next_p = jt -> jt_attributes_p;
+			jt -> jt_attributes_p = attr_p;
+		}
+
+	attr_p -> ta_value_s = value_s;
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_attribute (drmaa_job_template_t *jt, const char *name, char *value, size_t value_len, char *error_diagnosis, size_t error_diag_len)
+{
+	const char *value_s;
+
+	if ((!jt) || (!name) || (!value))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job template, attribute name or buffer given");
+		}
+
+	value_s = GetAttributeValue (jt, name);
+
+	if (!value_s)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "\"%s\" has not been set", name);
+		}
+
+	snprintf (value, value_len, "%s", value_s);
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_set_vector_attribute (drmaa_job_template_t *jt, const char *name, const char *value [], char *error_diagnosis, size_t error_diag_len)
+{
+	TemplateAttribute *attr_p;
+	char **values_ss;
+
+	if ((!jt) || (!name) || (!value))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job template, attribute name or values given");
+		}
+
+	if (!IsKnownAttribute (name, S_VECTOR_ATTRIBUTES_SS))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "\"%s\" is not a supported vector attribute", name);
+		}
+
+	values_ss = CopyStringArray (value);
+
+	if (!values_ss)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to copy values for \"%s\"", name);
+		}
+
+	attr_p = FindAttribute (jt, name);
+
+	if (attr_p)
+		{
+			FreeStringArray (attr_p -> ta_values_ss);
+		}
+	else
+		{
+			attr_p = (TemplateAttribute *) calloc (1, sizeof (TemplateAttribute));
+
+			if (attr_p)
+				{
+					attr_p -> ta_name_s = strdup (name);
+				}
+
+			if ((!attr_p) || (!attr_p -> ta_name_s))
+				{
+					free (attr_p);
+					FreeStringArray (values_ss);
+					return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate attribute \"%s\"", name);
+				}
+
+			attr_p -> ta_next_p = jt -> jt_attributes_p;
+			jt -> jt_attributes_p = attr_p;
+		}
+
+	attr_p -> ta_values_ss = values_ss;
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_vector_attribute (drmaa_job_template_t *jt, const char *name, drmaa_attr_values_t **values, char *error_diagnosis, size_t error_diag_len)
+{
+	const TemplateAttribute *attr_p;
+	drmaa_attr_values_t *values_p;
+	char **value_ss;
+
+	if ((!jt) || (!name) || (!values))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job template, attribute name or values given");
+		}
+
+	attr_p = FindAttribute (jt, name);
+
+	if ((!attr_p) || (!attr_p -> ta_values_ss))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "\"%s\" has not been set", name);
+		}
+
+	values_p = (drmaa_attr_values_t *) calloc (1, sizeof (drmaa_attr_values_t));
+
+	if (!values_p)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate values");
+		}
+
+	for (value_ss = attr_p -> ta_values_ss; *value_ss; ++ value_ss)
+		{
+			if (!AddToStringList (& (values_p -> av_list), *value_ss))
+				{
+					drmaa_release_attr_values (values_p);
+					return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to copy values");
+				}
+		}
+
+	*values = values_p;
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_attribute_names (drmaa_attr_names_t **values, char *error_diagnosis, size_t error_diag_len)
+{
+	drmaa_attr_names_t *names_p;
+	const char * const *name_ss;
+
+	if (!values)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No names given");
+		}
+
+	names_p = (drmaa_attr_names_t *) calloc (1, sizeof (drmaa_attr_names_t));
+
+	if (!names_p)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate names");
+		}
+
+	for (name_ss = S_SCALAR_ATTRIBUTES_SS; *name_ss; ++ name_ss)
+		{
+			if (!AddToStringList (& (names_p -> an_list), *name_ss))
+				{
+					drmaa_release_attr_names (names_p);
+					return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to copy names");
+				}
+		}
+
+	*values = names_p;
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_vector_attribute_names (drmaa_attr_names_t **values, char *error_diagnosis, size_t error_diag_len)
+{
+	drmaa_attr_names_t *names_p;
+	const char * const *name_ss;
+
+	if (!values)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No names given");
+		}
+
+	names_p = (drmaa_attr_names_t *) calloc (1, sizeof (drmaa_attr_names_t));
+
+	if (!names_p)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate names");
+		}
+
+	for (name_ss = S_VECTOR_ATTRIBUTES_SS; *name_ss; ++ name_ss)
+		{
+			if (!AddToStringList (& (names_p -> an_list), *name_ss))
+				{
+					drmaa_release_attr_names (names_p);
+					return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to copy names");
+				}
+		}
+
+	*values = names_p;
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+
+/*
+ * Job submission and control
+ */
+
+int drmaa_run_job (char *job_id, size_t job_id_len, const drmaa_job_template_t *jt, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+	struct timespec start_time;
+	struct timespec end_time;
+
+	if ((!job_id) || (!jt))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job id buffer or job template given");
+		}
+
+	clock_gettime (CLOCK_MONOTONIC, &start_time);
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (s_session.lds_active_flag)
+		{
+			char id_s [LD_JOB_ID_BUFFER];
+			LocalJob *job_p;
+
+			snprintf (id_s, LD_JOB_ID_BUFFER, "local.%lu", s_session.lds_next_job_number);
+
+			job_p = CreateLocalJob (jt, id_s, 1, error_diagnosis, error_diag_len, &res);
+
+			if (job_p)
+				{
+					++ (s_session.lds_next_job_number);
+					AddLocalJob (job_p);
+					snprintf (job_id, job_id_len, "%s", id_s);
+				}
+
+			clock_gettime (CLOCK_MONOTONIC, &end_time);
+
+			++ (s_session.lds_stats.lds_num_run_job_calls);
+			s_session.lds_stats.lds_submit_ns += GetNanosecondsBetween (&start_time, &end_time);
+		}
+	else
+		{
+			res = SetError (DRMAA_ERRNO_NO_ACTIVE_SESSION, error_diagnosis, error_diag_len, "There is no active session");
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	return res;
+}
+
+
+int drmaa_run_bulk_jobs (drmaa_job_ids_t **jobids, const drmaa_job_template_t *jt, int start, int end, int incr, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+	struct timespec start_time;
+	struct timespec end_time;
+	drmaa_job_ids_t *ids_p;
+
+	if ((!jobids) || (!jt) || (start < 1) || (end < start) || (incr < 1))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "Invalid bulk job range %d-%d:%d", start, end, incr);
+		}
+
+	ids_p = (drmaa_job_ids_t *) calloc (1, sizeof (drmaa_job_ids_t));
+
+	if (!ids_p)
+		{
+			return SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate job ids");
+		}
+
+	clock_gettime (CLOCK_MONOTONIC, &start_time);
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (s_session.lds_active_flag)
+		{
+			LocalJob *first_job_p = NULL;
+			LocalJob *last_job_p = NULL;
+			int i;
+
+			/* Create all of the tasks before adding any, so that the array is submitted as a whole or not at all */
+			for (i = start; (i <= end) && (res == DRMAA_ERRNO_SUCCESS); i += incr)
+				{
+					char id_s [LD_JOB_ID_BUFFER];
+					LocalJob *job_p;
+
+					snprintf (id_s, LD_JOB_ID_BUFFER, "local.%lu.%d", s_session.lds_next_job_number, i);
+
+					job_p = CreateLocalJob (jt, id_s, i, error_diagnosis, error_diag_len, &res);
+
+					if (job_p)
+						{
+							if (AddToStringList (& (ids_p -> ji_list), id_s))
+								{
+									if (last_job_p)
+										{
+											last_job_p -> lj_next_p = job_p;
+										}
+									else
+										{
+											first_job_p = job_p;
+										}
+
+									last_job_p = job_p;
+								}
+							else
+								{
+									FreeLocalJobDetails (job_p);
+									free (job_p);
+									res = SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to copy job id");
+								}
+						}
+
+					/* Stop before i overflows */
+					if (i > INT_MAX - incr)
+						{
+							break;
+						}
+				}
+
+			if (res == DRMAA_ERRNO_SUCCESS)
+				{
+					while (first_job_p)
+						{
+							LocalJob *next_p = first_job_p -> lj_next_p;
+
+							AddLocalJob (first_job_p);
+							first_job_p = next_p;
+						}
+
+					++ (s_session.lds_next_job_number);
+					*jobids = ids_p;
+					ids_p = NULL;
+				}
+			else
+				{
+					while (first_job_p)
+						{
+							LocalJob *next_p = first_job_p -> lj_next_p;
+
+							FreeLocalJobDetails (first_job_p);
+							free (first_job_p);
+							first_job_p = next_p;
+						}
+				}
+
+			clock_gettime (CLOCK_MONOTONIC, &end_time);
+
+			++ (s_session.lds_stats.lds_num_run_bulk_jobs_calls);
+			s_session.lds_stats.lds_submit_ns += GetNanosecondsBetween (&start_time, &end_time);
+		}
+	else
+		{
+			res = SetError (DRMAA_ERRNO_NO_ACTIVE_SESSION, error_diagnosis, error_diag_len, "There is no active session");
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	if (ids_p)
+		{
+			drmaa_release_job_ids (ids_p);
+		}
+
+	return res;
+}
+
+
+int drmaa_control (const char *jobid, int action, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+
+	if (!jobid)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job id given");
+		}
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (s_session.lds_active_flag)
+		{
+			++ (s_session.lds_stats.lds_num_control_calls);
+
+			if (strcmp (jobid, DRMAA_JOB_IDS_SESSION_ALL) == 0)
+				{
+					LocalJob *job_p;
+
+					for (job_p = s_session.lds_jobs_p; job_p; job_p = job_p -> lj_next_p)
+						{
+							if (!IsLocalJobFinished (job_p))
+								{
+									/* Like the other DRMs, this only reports the last failure */
+									int job_res = ControlLocalJob (job_p, action);
+
+									if (job_res != DRMAA_ERRNO_SUCCESS)
+										{
+											res = job_res;
+										}
+								}
+						}
+				}
+			else
+				{
+					LocalJob *job_p = FindLocalJob (jobid);
+
+					if (job_p)
+						{
+							res = ControlLocalJob (job_p, action);
+						}
+					else
+						{
+							res = DRMAA_ERRNO_INVALID_JOB;
+						}
+				}
+
+			if (res != DRMAA_ERRNO_SUCCESS)
+				{
+					SetError (res, error_diagnosis, error_diag_len, "Failed to apply action %d to job \"%s\": %s", action, jobid, drmaa_strerror (res));
+				}
+
+			pthread_cond_signal (& (s_session.lds_dispatch_cond));
+		}
+	else
+		{
+			res = SetError (DRMAA_ERRNO_NO_ACTIVE_SESSION, error_diagnosis, error_diag_len, "There is no active session");
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	return res;
+}
+
+
+int drmaa_synchronize (const char *job_ids [], signed long timeout, int dispose, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+	const char **id_ss;
+	bool all_flag = false;
+
+	if (!job_ids)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job ids given");
+		}
+
+	for (id_ss = job_ids; *id_ss; ++ id_ss)
+		{
+			if (strcmp (*id_ss, DRMAA_JOB_IDS_SESSION_ALL) == 0)
+				{
+					all_flag = true;
+				}
+		}
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (all_flag)
+		{
+			LocalJob *job_p = s_session.lds_jobs_p;
+
+			/* Wait for each job in turn, starting again from the first job after each wait as the list may have changed */
+			while (job_p && (res == DRMAA_ERRNO_SUCCESS))
+				{
+					if (IsLocalJobFinished (job_p))
+						{
+							LocalJob *next_p = job_p -> lj_next_p;
+
+							if (dispose)
+								{
+									RemoveLocalJob (job_p);
+								}
+
+							job_p = next_p;
+						}
+					else if (WaitForFinishedJob (job_p -> lj_id_s, timeout, &job_p))
+						{
+							job_p = s_session.lds_jobs_p;
+						}
+					else
+						{
+							res = s_session.lds_active_flag ? DRMAA_ERRNO_EXIT_TIMEOUT : DRMAA_ERRNO_NO_ACTIVE_SESSION;
+						}
+				}
+		}
+	else
+		{
+			for (id_ss = job_ids; *id_ss && (res == DRMAA_ERRNO_SUCCESS); ++ id_ss)
+				{
+					LocalJob *job_p = NULL;
+
+					if (FindLocalJob (*id_ss))
+						{
+							if (WaitForFinishedJob (*id_ss, timeout, &job_p))
+								{
+									if (dispose)
+										{
+											RemoveLocalJob (job_p);
+										}
+								}
+							else
+								{
+									res = s_session.lds_active_flag ? DRMAA_ERRNO_EXIT_TIMEOUT : DRMAA_ERRNO_NO_ACTIVE_SESSION;
+								}
+						}
+					else
+						{
+							res = DRMAA_ERRNO_INVALID_JOB;
+						}
+				}
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	if (res != DRMAA_ERRNO_SUCCESS)
+		{
+			SetError (res, error_diagnosis, error_diag_len, "Failed to synchronize jobs: %s", drmaa_strerror (res));
+		}
+
+	return res;
+}
+
+
+int drmaa_wait (const char *job_id, char *job_id_out, size_t job_id_out_len, int *stat, signed long timeout, drmaa_attr_values_t **rusage, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+	LocalJob *job_p = NULL;
+
+	if (!job_id)
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job id given");
+		}
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	++ (s_session.lds_stats.lds_num_wait_calls);
+
+	if ((strcmp (job_id, DRMAA_JOB_IDS_SESSION_ANY) == 0) ? (s_session.lds_jobs_p != NULL) : (FindLocalJob (job_id) != NULL))
+		{
+			if (WaitForFinishedJob (job_id, timeout, &job_p))
+				{
+					if (job_id_out)
+						{
+							snprintf (job_id_out, job_id_out_len, "%s", job_p -> lj_id_s);
+						}
+
+					if (stat)
+						{
+							*stat = job_p -> lj_stat;
+						}
+
+					if (rusage)
+						{
+							drmaa_attr_values_t *values_p = (drmaa_attr_values_t *) calloc (1, sizeof (drmaa_attr_values_t));
+
+							*rusage = NULL;
+
+							if (values_p)
+								{
+									char value_s [64];
+
+									snprintf (value_s, sizeof (value_s), "ru_utime=%ld.%06ld", (long) job_p -> lj_usage.ru_utime.tv_sec, (long) job_p -> lj_usage.ru_utime.tv_usec);
+									AddToStringList (& (values_p -> av_list), value_s);
+
+									snprintf (value_s, sizeof (value_s), "ru_stime=%ld.%06ld", (long) job_p -> lj_usage.ru_stime.tv_sec, (long) job_p -> lj_usage.ru_stime.tv_usec);
+									AddToStringList (& (values_p -> av_list), value_s);
+
+									snprintf (value_s, sizeof (value_s), "ru_maxrss=%ld", job_p -> lj_usage.ru_maxrss);
+									AddToStringList (& (values_p -> av_list), value_s);
+
+									snprintf (value_s, sizeof (value_s), "ru_wallclock=%.3f", GetNanosecondsBetween (& (job_p -> lj_start_time), & (job_p -> lj_end_time)) / 1.0e9);
+									AddToStringList (& (values_p -> av_list), value_s);
+
+									*rusage = values_p;
+								}
+						}
+
+					/* The job is disposed of once it has been waited for */
+					RemoveLocalJob (job_p);
+				}
+			else
+				{
+					res = s_session.lds_active_flag ? DRMAA_ERRNO_EXIT_TIMEOUT : DRMAA_ERRNO_NO_ACTIVE_SESSION;
+				}
+		}
+	else
+		{
+			res = DRMAA_ERRNO_INVALID_JOB;
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	if (res != DRMAA_ERRNO_SUCCESS)
+		{
+			SetError (res, error_diagnosis, error_diag_len, "Failed to wait for \"%s\": %s", job_id, drmaa_strerror (res));
+		}
+
+	return res;
+}
+
+
+int drmaa_job_ps (const char *job_id, int *remote_ps, char *error_diagnosis, size_t error_diag_len)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+	struct timespec start_time;
+	struct timespec end_time;
+
+	if ((!job_id) || (!remote_ps))
+		{
+			return SetError (DRMAA_ERRNO_INVALID_ARGUMENT, error_diagnosis, error_diag_len, "No job id or state given");
+		}
+
+	clock_gettime (CLOCK_MONOTONIC, &start_time);
+
+	pthread_mutex_lock (&s_session_mutex);
+
+	if (s_session.lds_active_flag)
+		{
+			const LocalJob *job_p = FindLocalJob (job_id);
+
+			if (job_p)
+				{
+					*remote_ps = job_p -> lj_state;
+				}
+			else
+				{
+					res = SetError (DRMAA_ERRNO_INVALID_JOB, error_diagnosis, error_diag_len, "Unknown job \"%s\"", job_id);
+				}
+
+			clock_gettime (CLOCK_MONOTONIC, &end_time);
+
+			++ (s_session.lds_stats.lds_num_job_ps_calls);
+			s_session.lds_stats.lds_job_ps_ns += GetNanosecondsBetween (&start_time, &end_time);
+		}
+	else
+		{
+			res = SetError (DRMAA_ERRNO_NO_ACTIVE_SESSION, error_diagnosis, error_diag_len, "There is no active session");
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	return res;
+}
+
+
+
+/*
+ * Exit status inspection
+ */
+
+int drmaa_wifexited (int *exited, int stat, char *error_diagnosis, size_t error_diag_len)
+{
+	*exited = ((stat & LD_STAT_ABORTED) == 0) && WIFEXITED (stat);
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_wexitstatus (int *exit_status, int stat, char *error_diagnosis, size_t error_diag_len)
+{
+	*exit_status = WEXITSTATUS (stat);
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_wifsignaled (int *signaled, int stat, char *error_diagnosis, size_t error_diag_len)
+{
+	*signaled = ((stat & LD_STAT_ABORTED) == 0) && WIFSIGNALED (stat);
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_wtermsig (char *signal, size_t signal_len, int stat, char *error_diagnosis, size_t error_diag_len)
+{
+	const int sig = WTERMSIG (stat);
+	const char *abbreviation_s = sigabbrev_np (sig);
+
+	if (abbreviation_s)
+		{
+			snprintf (signal, signal_len, "SIG%s", abbreviation_s);
+		}
+	else
+		{
+			snprintf (signal, signal_len, "%d", sig);
+		}
+
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_wcoredump (int *core_dumped, int stat, char *error_diagnosis, size_t error_diag_len)
+{
+	*core_dumped = ((stat & LD_STAT_ABORTED) == 0) && WIFSIGNALED (stat) && WCOREDUMP (stat);
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_wifaborted (int *aborted, int stat, char *error_diagnosis, size_t error_diag_len)
+{
+	*aborted = ((stat & LD_STAT_ABORTED) != 0);
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+
+/*
+ * Auxiliary functions
+ */
+
+const char *drmaa_strerror (int drmaa_errno)
+{
+	if ((drmaa_errno >= DRMAA_ERRNO_SUCCESS) && (drmaa_errno < DRMAA_NO_ERRNO))
+		{
+			return * (S_ERRORS_SS + drmaa_errno);
+		}
+
+	return "Unknown error";
+}
+
+
+int drmaa_get_contact (char *contact, size_t contact_len, char *error_diagnosis, size_t error_diag_len)
+{
+	snprintf (contact, contact_len, "local");
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_version (unsigned int *major, unsigned int *minor, char *error_diagnosis, size_t error_diag_len)
+{
+	*major = 1;
+	*minor = 0;
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_DRM_system (char *drm_system, size_t drm_system_len, char *error_diagnosis, size_t error_diag_len)
+{
+	snprintf (drm_system, drm_system_len, "Grassroots local DRMAA stand-in");
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+int drmaa_get_DRMAA_implementation (char *drmaa_impl, size_t drmaa_impl_len, char *error_diagnosis, size_t error_diag_len)
+{
+	snprintf (drmaa_impl, drmaa_impl_len, "Grassroots local DRMAA stand-in 1.0");
+	return DRMAA_ERRNO_SUCCESS;
+}
+
+
+
+
+static int SetError (const int error, char *error_diagnosis, size_t error_diag_len, const char *format_s, ...)
+{
+	if (error_diagnosis && (error_diag_len > 0))
+		{
+			va_list args;
+
+			va_start (args, format_s);
+			vsnprintf (error_diagnosis, error_diag_len, format_s, args);
+			va_end (args);
+		}
+
+	return error;
+}
+
+
+static bool IsKnownAttribute (const char *name_s, const char * const *names_ss)
+{
+	while (*names_ss)
+		{
+			if (strcmp (*names_ss, name_s) == 0)
+				{
+					return true;
+				}
+
+			++ names_ss;
+		}
+
+	return false;
+}
+
+
+static TemplateAttribute *FindAttribute (const drmaa_job_template_t *jt, const char *name_s)
+{
+	TemplateAttribute *attr_p;
+
+	for (attr_p = jt -> jt_attributes_p; attr_p; attr_p = attr_p -> ta_next_p)
+		{
+			if (strcmp (attr_p -> ta_name_s, name_s) == 0)
+				{
+					return attr_p;
+				}
+		}
+
+	return NULL;
+}
+
+
+static const char *GetAttributeValue (const drmaa_job_template_t *jt, const char *name_s)
+{
+	const TemplateAttribute *attr_p = FindAttribute (jt, name_s);
+
+	return attr_p ? attr_p -> ta_value_s : NULL;
+}
+
+
+static char **CopyStringArray (const char * const *values_ss)
+{
+	size_t num_values = 0;
+	char **copies_ss;
+
+	while (* (values_ss + num_values))
+		{
+			++ num_values;
+		}
+
+	copies_ss = (char **) calloc (num_values + 1, sizeof (char *));
+
+	if (copies_ss)
+		{
+			size_t i;
+
+			for (i = 0; i < num_values; ++ i)
+				{
+					* (copies_ss + i) = strdup (* (values_ss + i));
+
+					if (! (* (copies_ss + i)))
+						{
+							FreeStringArray (copies_ss);
+							return NULL;
+						}
+				}
+		}
+
+	return copies_ss;
+}
+
+
+static void FreeStringArray (char **values_ss)
+{
+	if (values_ss)
+		{
+			char **value_ss;
+
+			for (value_ss = values_ss; *value_ss; ++ value_ss)
+				{
+					free (*value_ss);
+				}
+
+			free (values_ss);
+		}
+}
+
+
+static bool AddToStringList (StringList *list_p, const char *value_s)
+{
+	char **values_ss = (char **) realloc (list_p -> sl_values_ss, (list_p -> sl_num_values + 1) * sizeof (char *));
+
+	if (values_ss)
+		{
+			list_p -> sl_values_ss = values_ss;
+
+			* (values_ss + list_p -> sl_num_values) = strdup (value_s);
+
+			if (* (values_ss + list_p -> sl_num_values))
+				{
+					++ (list_p -> sl_num_values);
+					return true;
+				}
+		}
+
+	return false;
+}
+
+
+static int GetNextFromStringList (StringList *list_p, char *value, size_t value_len)
+{
+	if (list_p -> sl_next < list_p -> sl_num_values)
+		{
+			snprintf (value, value_len, "%s", * (list_p -> sl_values_ss + list_p -> sl_next));
+			++ (list_p -> sl_next);
+
+			return DRMAA_ERRNO_SUCCESS;
+		}
+
+	return DRMAA_ERRNO_NO_MORE_ELEMENTS;
+}
+
+
+static void FreeStringList (StringList *list_p)
+{
+	size_t i;
+
+	for (i = 0; i < list_p -> sl_num_values; ++ i)
+		{
+			free (* (list_p -> sl_values_ss + i));
+		}
+
+	free (list_p -> sl_values_ss);
+}
+
+
+/*
+ * Fill in any of the DRMAA placeholders in a value. The caller
+ * must free the returned string.
+ */
+static char *ReplacePlaceholders (const char *value_s, const char *wd_s, const int index)
+{
+	size_t length = 0;
+	char *result_s;
+	const char *home_s = getenv ("HOME");
+	char index_s [16];
+	int pass;
+
+	snprintf (index_s, sizeof (index_s), "%d", index);
+
+	if (!home_s)
+		{
+			home_s = "";
+		}
+
+	/* The first pass gets the length and the second fills in the result */
+	result_s = NULL;
+
+	for (pass = 0; pass < 2; ++ pass)
+		{
+			const char *src_s = value_s;
+			char *dest_s = result_s;
+
+			length = 0;
+
+			while (*src_s)
+				{
+					const char *replacement_s = NULL;
+					size_t placeholder_length = 0;
+
+					if (*src_s == '$')
+						{
+							if (strncmp (src_s, DRMAA_PLACEHOLDER_INCR, strlen (DRMAA_PLACEHOLDER_INCR)) == 0)
+								{
+									replacement_s = index_s;
+									placeholder_length = strlen (DRMAA_PLACEHOLDER_INCR);
+								}
+							else if (strncmp (src_s, DRMAA_PLACEHOLDER_HD, strlen (DRMAA_PLACEHOLDER_HD)) == 0)
+								{
+									replacement_s = home_s;
+									placeholder_length = strlen (DRMAA_PLACEHOLDER_HD);
+								}
+							else if (strncmp (src_s, DRMAA_PLACEHOLDER_WD, strlen (DRMAA_PLACEHOLDER_WD)) == 0)
+								{
+									replacement_s = wd_s;
+									placeholder_length = strlen (DRMAA_PLACEHOLDER_WD);
+								}
+						}
+
+					if (replacement_s)
+						{
+							const size_t l = strlen (replacement_s);
+
+							if (dest_s)
+								{
+									memcpy (dest_s, replacement_s, l);
+									dest_s += l;
+								}
+
+							length += l;
+							src_s += placeholder_length;
+						}
+					else
+						{
+							if (dest_s)
+								{
+									*dest_s = *src_s;
+									++ dest_s;
+								}
+
+							++ length;
+							++ src_s;
+						}
+				}
+
+			if (dest_s)
+				{
+					*dest_s = '\0';
+				}
+			else
+				{
+					result_s = (char *) malloc (length + 1);
+
+					if (!result_s)
+						{
+							return NULL;
+						}
+				}
+		}
+
+	return result_s;
+}
+
+
+/*
+ * Get the file to use for one of a job's output streams. DRMAA
+ * paths are "[hostname]:path" and if the path is a directory, the
+ * file is created within it.
+ */
+static char *GetJobPath (const char *path_s, const char *wd_s, const char *job_name_s, const char *job_id_s, const char *suffix_s, const int index)
+{
+	char *result_s = NULL;
+	const char *colon_s = strchr (path_s, ':');
+	char *filename_s;
+
+	if (colon_s)
+		{
+			path_s = colon_s + 1;
+		}
+
+	filename_s = ReplacePlaceholders (path_s, wd_s, index);
+
+	if (filename_s)
+		{
+			struct stat st;
+
+			if ((stat (filename_s, &st) == 0) && (S_ISDIR (st.st_mode)))
+				{
+					const size_t l = strlen (filename_s) + strlen (job_name_s) + strlen (suffix_s) + strlen (job_id_s) + 2;
+
+					result_s = (char *) malloc (l + 1);
+
+					if (result_s)
+						{
+							snprintf (result_s, l + 1, "%s/%s%s%s", filename_s, job_name_s, suffix_s, job_id_s);
+						}
+
+					free (filename_s);
+				}
+			else
+				{
+					result_s = filename_s;
+				}
+		}
+
+	return result_s;
+}
+
+
+/*
+ * Get the number of cores asked for using the
+ * LSF, Slurm or Grid Engine style options.
+ */
+static unsigned int GetSlotsFromNativeSpecification (const char *spec_s)
+{
+	unsigned int slots = 1;
+
+	if (spec_s)
+		{
+			const char *value_s = NULL;
+
+			if ((value_s = strstr (spec_s, "--cpus-per-task=")) != NULL)
+				{
+					value_s += strlen ("--cpus-per-task=");
+				}
+			else if (((value_s = strstr (spec_s, "-n ")) != NULL) || ((value_s = strstr (spec_s, "-c ")) != NULL))
+				{
+					value_s += 3;
+				}
+
+			if (value_s)
+				{
+					long l = strtol (value_s, NULL, 10);
+
+					if (l > 0)
+						{
+							slots = (unsigned int) l;
+						}
+				}
+		}
+
+	return slots;
+}
+
+
+/*
+ * Create a job from a template. This must be called with the session mutex held.
+ */
+static LocalJob *CreateLocalJob (const drmaa_job_template_t *jt, const char *job_id_s, const int index, char *error_diagnosis, size_t error_diag_len, int *res_p)
+{
+	const char *command_s = GetAttributeValue (jt, DRMAA_REMOTE_COMMAND);
+	const TemplateAttribute *argv_p = FindAttribute (jt, DRMAA_V_ARGV);
+	const TemplateAttribute *env_p = FindAttribute (jt, DRMAA_V_ENV);
+	const char *wd_s = GetAttributeValue (jt, DRMAA_WD);
+	const char *input_s = GetAttributeValue (jt, DRMAA_INPUT_PATH);
+	const char *output_s = GetAttributeValue (jt, DRMAA_OUTPUT_PATH);
+	const char *error_s = GetAttributeValue (jt, DRMAA_ERROR_PATH);
+	const char *join_s = GetAttributeValue (jt, DRMAA_JOIN_FILES);
+	const char *state_s = GetAttributeValue (jt, DRMAA_JS_STATE);
+	const char *job_name_s = GetAttributeValue (jt, DRMAA_JOB_NAME);
+	char cwd_s [PATH_MAX];
+	LocalJob *job_p;
+	size_t num_args = 1;
+	size_t i;
+	bool success_flag = true;
+
+	if (!command_s)
+		{
+			*res_p = SetError (DRMAA_ERRNO_CONFLICTING_ATTRIBUTE_VALUES, error_diagnosis, error_diag_len, "\"%s\" has not been set", DRMAA_REMOTE_COMMAND);
+			return NULL;
+		}
+
+	if (!wd_s)
+		{
+			wd_s = getcwd (cwd_s, PATH_MAX) ? cwd_s : "/";
+		}
+
+	if (!job_name_s)
+		{
+			job_name_s = "drmaa";
+		}
+
+	job_p = (LocalJob *) calloc (1, sizeof (LocalJob));
+
+	if (!job_p)
+		{
+			*res_p = SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to allocate job");
+			return NULL;
+		}
+
+	snprintf (job_p -> lj_id_s, LD_JOB_ID_BUFFER, "%s", job_id_s);
+	job_p -> lj_pid = -1;
+	job_p -> lj_state = DRMAA_PS_QUEUED_ACTIVE;
+	job_p -> lj_slots = GetSlotsFromNativeSpecification (GetAttributeValue (jt, DRMAA_NATIVE_SPECIFICATION));
+	job_p -> lj_join_flag = join_s && ((*join_s == 'y') || (*join_s == 'Y'));
+
+	/* A job that asks for more slots than there are would never run */
+	if (job_p -> lj_slots > s_session.lds_num_slots)
+		{
+			job_p -> lj_slots = s_session.lds_num_slots;
+		}
+
+	if (state_s && (strcmp (state_s, DRMAA_SUBMISSION_STATE_HOLD) == 0))
+		{
+			job_p -> lj_state = DRMAA_PS_USER_ON_HOLD;
+			job_p -> lj_hold_flag = true;
+		}
+
+	if (argv_p && argv_p -> ta_values_ss)
+		{
+			char **arg_ss;
+
+			for (arg_ss = argv_p -> ta_values_ss; *arg_ss; ++ arg_ss)
+				{
+					++ num_args;
+				}
+		}
+
+	job_p -> lj_args_ss = (char **) calloc (num_args + 1, sizeof (char *));
+
+	if (job_p -> lj_args_ss)
+		{
+			job_p -> lj_wd_s = ReplacePlaceholders (wd_s, wd_s, index);
+			success_flag = (job_p -> lj_wd_s != NULL);
+
+			if (success_flag)
+				{
+					* (job_p -> lj_args_ss) = ReplacePlaceholders (command_s, job_p -> lj_wd_s, index);
+					success_flag = (* (job_p -> lj_args_ss) != NULL);
+				}
+
+			for (i = 1; success_flag && (i < num_args); ++ i)
+				{
+					* (job_p -> lj_args_ss + i) = ReplacePlaceholders (* (argv_p -> ta_values_ss + i - 1), job_p -> lj_wd_s, index);
+					success_flag = (* (job_p -> lj_args_ss + i) != NULL);
+				}
+		}
+	else
+		{
+			success_flag = false;
+		}
+
+	if (success_flag && env_p && env_p -> ta_values_ss)
+		{
+			size_t num_parent_vars = 0;
+			size_t num_job_vars = 0;
+
+			while (* (environ + num_parent_vars))
+				{
+					++ num_parent_vars;
+				}
+
+			while (* (env_p -> ta_values_ss + num_job_vars))
+				{
+					++ num_job_vars;
+				}
+
+			/* The job's variables go first so that they take precedence */
+			job_p -> lj_env_ss = (char **) calloc (num_parent_vars + num_job_vars + 1, sizeof (char *));
+
+			if (job_p -> lj_env_ss)
+				{
+					for (i = 0; success_flag && (i < num_job_vars); ++ i)
+						{
+							* (job_p -> lj_env_ss + i) = strdup (* (env_p -> ta_values_ss + i));
+							success_flag = (* (job_p -> lj_env_ss + i) != NULL);
+						}
+
+					for (i = 0; success_flag && (i < num_parent_vars); ++ i)
+						{
+							* (job_p -> lj_env_ss + num_job_vars + i) = strdup (* (environ + i));
+							success_flag = (* (job_p -> lj_env_ss + num_job_vars + i) != NULL);
+						}
+				}
+			else
+				{
+					success_flag = false;
+				}
+		}
+
+	if (success_flag && input_s)
+		{
+			job_p -> lj_input_s = GetJobPath (input_s, job_p -> lj_wd_s, job_name_s, job_id_s, ".i", index);
+			success_flag = (job_p -> lj_input_s != NULL);
+		}
+
+	if (success_flag && output_s)
+		{
+			job_p -> lj_output_s = GetJobPath (output_s, job_p -> lj_wd_s, job_name_s, job_id_s, ".o", index);
+			success_flag = (job_p -> lj_output_s != NULL);
+		}
+
+	if (success_flag && error_s && (!job_p -> lj_join_flag))
+		{
+			job_p -> lj_error_s = GetJobPath (error_s, job_p -> lj_wd_s, job_name_s, job_id_s, ".e", index);
+			success_flag = (job_p -> lj_error_s != NULL);
+		}
+
+	if (!success_flag)
+		{
+			FreeLocalJobDetails (job_p);
+			free (job_p);
+
+			*res_p = SetError (DRMAA_ERRNO_NO_MEMORY, error_diagnosis, error_diag_len, "Failed to set up job \"%s\"", job_id_s);
+			return NULL;
+		}
+
+	clock_gettime (CLOCK_MONOTONIC, & (job_p -> lj_submit_time));
+	job_p -> lj_eligible_time = job_p -> lj_submit_time;
+
+	if ((s_session.lds_queue_wait_ms > 0) || (s_session.lds_queue_wait_jitter_ms > 0))
+		{
+			unsigned long wait_ms = s_session.lds_queue_wait_ms;
+
+			if (s_session.lds_queue_wait_jitter_ms > 0)
+				{
+					wait_ms += ((unsigned long) rand_r (& (s_session.lds_random_seed))) % (s_session.lds_queue_wait_jitter_ms + 1);
+				}
+
+			AddMilliseconds (& (job_p -> lj_eligible_time), wait_ms);
+		}
+
+	*res_p = DRMAA_ERRNO_SUCCESS;
+
+	return job_p;
+}
+
+
+/*
+ * Free everything that a job only needs until it has finished.
+ */
+static void FreeLocalJobDetails (LocalJob *job_p)
+{
+	FreeStringArray (job_p -> lj_args_ss);
+	job_p -> lj_args_ss = NULL;
+
+	FreeStringArray (job_p -> lj_env_ss);
+	job_p -> lj_env_ss = NULL;
+
+	free (job_p -> lj_wd_s);
+	job_p -> lj_wd_s = NULL;
+
+	free (job_p -> lj_input_s);
+	job_p -> lj_input_s = NULL;
+
+	free (job_p -> lj_output_s);
+	job_p -> lj_output_s = NULL;
+
+	free (job_p -> lj_error_s);
+	job_p -> lj_error_s = NULL;
+}
+
+
+/*
+ * Add a job to the end of the queue. This must be called with the session mutex held.
+ */
+static void AddLocalJob (LocalJob *job_p)
+{
+	job_p -> lj_next_p = NULL;
+
+	if (s_session.lds_last_job_p)
+		{
+			s_session.lds_last_job_p -> lj_next_p = job_p;
+		}
+	else
+		{
+			s_session.lds_jobs_p = job_p;
+		}
+
+	s_session.lds_last_job_p = job_p;
+
+	++ (s_session.lds_num_queued_jobs);
+	++ (s_session.lds_stats.lds_num_jobs_submitted);
+
+	if (s_session.lds_num_queued_jobs > s_session.lds_stats.lds_max_queued_jobs)
+		{
+			s_session.lds_stats.lds_max_queued_jobs = s_session.lds_num_queued_jobs;
+		}
+
+	pthread_cond_signal (& (s_session.lds_dispatch_cond));
+}
+
+
+static LocalJob *FindLocalJob (const char *job_id_s)
+{
+	LocalJob *job_p;
+
+	for (job_p = s_session.lds_jobs_p; job_p; job_p = job_p -> lj_next_p)
+		{
+			if (strcmp (job_p -> lj_id_s, job_id_s) == 0)
+				{
+					return job_p;
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * Remove a finished job from the session and free it. This
+ * must be called with the session mutex held.
+ */
+static void RemoveLocalJob (LocalJob *job_p)
+{
+	LocalJob *prev_p = NULL;
+	LocalJob *current_p;
+
+	for (current_p = s_session.lds_jobs_p; current_p && (current_p != job_p); current_p = current_p -> lj_next_p)
+		{
+			prev_p = current_p;
+		}
+
+	if (current_p)
+		{
+			if (prev_p)
+				{
+					prev_p -> lj_next_p = job_p -> lj_next_p;
+				}
+			else
+				{
+					s_session.lds_jobs_p = job_p -> lj_next_p;
+				}
+
+			if (s_session.lds_last_job_p == job_p)
+				{
+					s_session.lds_last_job_p = prev_p;
+				}
+
+			FreeLocalJobDetails (job_p);
+			free (job_p);
+		}
+}
+
+
+static bool IsLocalJobFinished (const LocalJob *job_p)
+{
+	return ((job_p -> lj_state == DRMAA_PS_DONE) || (job_p -> lj_state == DRMAA_PS_FAILED));
+}
+
+
+/*
+ * This must be called with the session mutex held.
+ */
+static void FinishLocalJob (LocalJob *job_p, const int state, const int stat)
+{
+	const bool running_flag = (job_p -> lj_pid != -1);
+
+	clock_gettime (CLOCK_MONOTONIC, & (job_p -> lj_end_time));
+
+	if (running_flag)
+		{
+			s_session.lds_used_slots -= job_p -> lj_slots;
+			-- (s_session.lds_num_running_jobs);
+
+			s_session.lds_stats.lds_total_run_ns += GetNanosecondsBetween (& (job_p -> lj_start_time), & (job_p -> lj_end_time));
+		}
+	else
+		{
+			-- (s_session.lds_num_queued_jobs);
+			job_p -> lj_start_time = job_p -> lj_end_time;
+		}
+
+	job_p -> lj_state = state;
+	job_p -> lj_stat = stat;
+	job_p -> lj_pid = -1;
+
+	++ (s_session.lds_stats.lds_num_jobs_finished);
+
+	FreeLocalJobDetails (job_p);
+
+	pthread_cond_broadcast (& (s_session.lds_finished_cond));
+}
+
+
+/*
+ * Launch the process for a job. This must be called with the session mutex held.
+ */
+static bool StartLocalJob (LocalJob *job_p)
+{
+	bool success_flag = false;
+	pid_t pid = fork ();
+
+	if (pid == 0)
+		{
+			/*
+			 * Only async-signal-safe calls can be used in the child of a
+			 * multi-threaded process, so everything is set up beforehand.
+			 */
+			int fd;
+			sigset_t signals;
+
+			sigemptyset (&signals);
+			sigprocmask (SIG_SETMASK, &signals, NULL);
+
+			/* Run the job in its own process group, as a DRM would, so that it can be signalled as a whole */
+			setpgid (0, 0);
+
+			if (chdir (job_p -> lj_wd_s) != 0)
+				{
+					_exit (127);
+				}
+
+			fd = open (job_p -> lj_input_s ? job_p -> lj_input_s : "/dev/null", O_RDONLY);
+
+			if ((fd == -1) || (dup2 (fd, STDIN_FILENO) == -1))
+				{
+					_exit (127);
+				}
+
+			if (job_p -> lj_output_s)
+				{
+					fd = open (job_p -> lj_output_s, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+					if ((fd == -1) || (dup2 (fd, STDOUT_FILENO) == -1))
+						{
+							_exit (127);
+						}
+				}
+
+			if (job_p -> lj_join_flag)
+				{
+					if (dup2 (STDOUT_FILENO, STDERR_FILENO) == -1)
+						{
+							_exit (127);
+						}
+				}
+			else if (job_p -> lj_error_s)
+				{
+					fd = open (job_p -> lj_error_s, O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+					if ((fd == -1) || (dup2 (fd, STDERR_FILENO) == -1))
+						{
+							_exit (127);
+						}
+				}
+
+			if (job_p -> lj_env_ss)
+				{
+					execvpe (*job_p -> lj_args_ss, job_p -> lj_args_ss, job_p -> lj_env_ss);
+				}
+			else
+				{
+					execvp (*job_p -> lj_args_ss, job_p -> lj_args_ss);
+				}
+
+			_exit (127);
+		}
+	else if (pid > 0)
+		{
+			unsigned long long queue_wait_ns;
+
+			/* Set it from this side too so that it is in place before any signals are sent */
+			setpgid (pid, pid);
+
+			job_p -> lj_pid = pid;
+			job_p -> lj_state = DRMAA_PS_RUNNING;
+			clock_gettime (CLOCK_MONOTONIC, & (job_p -> lj_start_time));
+
+			s_session.lds_used_slots += job_p -> lj_slots;
+			-- (s_session.lds_num_queued_jobs);
+			++ (s_session.lds_num_running_jobs);
+
+			queue_wait_ns = GetNanosecondsBetween (& (job_p -> lj_submit_time), & (job_p -> lj_start_time));
+
+			++ (s_session.lds_stats.lds_num_jobs_started);
+			s_session.lds_stats.lds_total_queue_wait_ns += queue_wait_ns;
+
+			if (queue_wait_ns > s_session.lds_stats.lds_max_queue_wait_ns)
+				{
+					s_session.lds_stats.lds_max_queue_wait_ns = queue_wait_ns;
+				}
+
+			if (s_session.lds_num_running_jobs > s_session.lds_stats.lds_max_running_jobs)
+				{
+					s_session.lds_stats.lds_max_running_jobs = s_session.lds_num_running_jobs;
+				}
+
+			success_flag = true;
+		}
+	else
+		{
+			fprintf (stderr, "local_drmaa: failed to fork for job \"%s\": %s\n", job_p -> lj_id_s, strerror (errno));
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * This must be called with the session mutex held.
+ */
+static int ControlLocalJob (LocalJob *job_p, const int action)
+{
+	int res = DRMAA_ERRNO_SUCCESS;
+
+	switch (action)
+		{
+			case DRMAA_CONTROL_SUSPEND:
+				if ((job_p -> lj_state == DRMAA_PS_RUNNING) && (kill (- (job_p -> lj_pid), SIGSTOP) == 0))
+					{
+						job_p -> lj_state = DRMAA_PS_USER_SUSPENDED;
+					}
+				else
+					{
+						res = DRMAA_ERRNO_SUSPEND_INCONSISTENT_STATE;
+					}
+				break;
+
+			case DRMAA_CONTROL_RESUME:
+				if ((job_p -> lj_state == DRMAA_PS_USER_SUSPENDED) && (kill (- (job_p -> lj_pid), SIGCONT) == 0))
+					{
+						job_p -> lj_state = DRMAA_PS_RUNNING;
+					}
+				else
+					{
+						res = DRMAA_ERRNO_RESUME_INCONSISTENT_STATE;
+					}
+				break;
+
+			case DRMAA_CONTROL_HOLD:
+				if (job_p -> lj_state == DRMAA_PS_QUEUED_ACTIVE)
+					{
+						job_p -> lj_state = DRMAA_PS_USER_ON_HOLD;
+					}
+				else
+					{
+						res = DRMAA_ERRNO_HOLD_INCONSISTENT_STATE;
+					}
+				break;
+
+			case DRMAA_CONTROL_RELEASE:
+				if (job_p -> lj_state == DRMAA_PS_USER_ON_HOLD)
+					{
+						job_p -> lj_state = DRMAA_PS_QUEUED_ACTIVE;
+					}
+				else
+					{
+						res = DRMAA_ERRNO_RELEASE_INCONSISTENT_STATE;
+					}
+				break;
+
+			case DRMAA_CONTROL_TERMINATE:
+				if ((job_p -> lj_state == DRMAA_PS_QUEUED_ACTIVE) || (job_p -> lj_state == DRMAA_PS_USER_ON_HOLD))
+					{
+						FinishLocalJob (job_p, DRMAA_PS_FAILED, LD_STAT_ABORTED);
+					}
+				else if (job_p -> lj_pid != -1)
+					{
+						if (job_p -> lj_term_time == 0)
+							{
+								/* A suspended job needs to be woken to act on the signal */
+								kill (- (job_p -> lj_pid), SIGTERM);
+								kill (- (job_p -> lj_pid), SIGCONT);
+								job_p -> lj_term_time = time (NULL);
+							}
+					}
+				else
+					{
+						res = DRMAA_ERRNO_INVALID_JOB;
+					}
+				break;
+
+			default:
+				res = DRMAA_ERRNO_INVALID_ARGUMENT;
+				break;
+		}
+
+	return res;
+}
+
+
+static void *RunDispatcher (void *data_p)
+{
+	pthread_mutex_lock (&s_session_mutex);
+
+	while (s_session.lds_active_flag)
+		{
+			struct timespec now;
+			struct timespec timeout;
+			struct timespec wake_time;
+			unsigned long long wait_ns;
+
+			clock_gettime (CLOCK_MONOTONIC, &now);
+
+			CheckRunningJobs (&now);
+			StartQueuedJobs (&now);
+			PruneFinishedJobs (&now);
+
+			GetDispatchTimeout (&now, &timeout);
+			wait_ns = GetNanosecondsBetween (&now, &timeout);
+
+			/* The condition variable uses the realtime clock, so convert the monotonic timeout into a relative wait */
+			clock_gettime (CLOCK_REALTIME, &wake_time);
+			AddMilliseconds (&wake_time, (unsigned long) ((wait_ns + 999999ULL) / 1000000ULL));
+
+			pthread_cond_timedwait (& (s_session.lds_dispatch_cond), &s_session_mutex, &wake_time);
+		}
+
+	pthread_mutex_unlock (&s_session_mutex);
+
+	return NULL;
+}
+
+
+/*
+ * Collect any running jobs that have finished, and kill any that
+ * haven't exited in time after being terminated. This must be called
+ * with the session mutex held.
+ */
+static void CheckRunningJobs (const struct timespec *now_p)
+{
+	LocalJob *job_p;
+
+	for (job_p = s_session.lds_jobs_p; job_p; job_p = job_p -> lj_next_p)
+		{
+			if (job_p -> lj_pid != -1)
+				{
+					int status;
+					pid_t res;
+
+					/* Only the job's own pid is waited for so that the server's other children are left alone */
+					do
+						{
+							res = wait4 (job_p -> lj_pid, &status, WNOHANG | WUNTRACED | WCONTINUED, & (job_p -> lj_usage));
+						}
+					while ((res == -1) && (errno == EINTR));
+
+					if (res == job_p -> lj_pid)
+						{
+							if (WIFEXITED (status))
+								{
+									FinishLocalJob (job_p, (WEXITSTATUS (status) == 0) ? DRMAA_PS_DONE : DRMAA_PS_FAILED, status);
+								}
+							else if (WIFSIGNALED (status))
+								{
+									FinishLocalJob (job_p, DRMAA_PS_FAILED, status);
+								}
+						}
+					else if (res == -1)
+						{
+							/* Something else reaped it, so its exit status is lost */
+							FinishLocalJob (job_p, DRMAA_PS_FAILED, LD_STAT_ABORTED);
+						}
+					else if ((job_p -> lj_term_time != 0) && (time (NULL) >= job_p -> lj_term_time + LD_KILL_GRACE_PERIOD))
+						{
+							kill (- (job_p -> lj_pid), SIGKILL);
+						}
+				}
+		}
+}
+
+
+/*
+ * Start the queued jobs in the order that they were submitted for
+ * as long as there are free slots. This must be called with the
+ * session mutex held.
+ */
+static void StartQueuedJobs (const struct timespec *now_p)
+{
+	LocalJob *job_p;
+
+	for (job_p = s_session.lds_jobs_p; job_p; job_p = job_p -> lj_next_p)
+		{
+			if ((job_p -> lj_state == DRMAA_PS_QUEUED_ACTIVE) && (!IsBefore (now_p, & (job_p -> lj_eligible_time))))
+				{
+					if (s_session.lds_used_slots + job_p -> lj_slots > s_session.lds_num_slots)
+						{
+							/* There's no backfilling, so later jobs have to wait too */
+							break;
+						}
+
+					if (!StartLocalJob (job_p))
+						{
+							FinishLocalJob (job_p, DRMAA_PS_FAILED, LD_STAT_ABORTED);
+						}
+				}
+		}
+}
+
+
+/*
+ * Drop the details of any finished jobs that nothing has waited for,
+ * as a DRM would, so that they don't build up in a long-running server.
+ * This must be called with the session mutex held.
+ */
+static void PruneFinishedJobs (const struct timespec *now_p)
+{
+	LocalJob *job_p = s_session.lds_jobs_p;
+
+	while (job_p)
+		{
+			LocalJob *next_p = job_p -> lj_next_p;
+
+			if (IsLocalJobFinished (job_p) && (now_p -> tv_sec >= job_p -> lj_end_time.tv_sec + LD_FINISHED_JOB_LIFETIME))
+				{
+					RemoveLocalJob (job_p);
+				}
+
+			job_p = next_p;
+		}
+}
+
+
+/*
+ * Work out when the dispatcher next needs to run. This must
+ * be called with the session mutex held.
+ */
+static void GetDispatchTimeout (const struct timespec *now_p, struct timespec *timeout_p)
+{
+	const LocalJob *job_p;
+
+	/* Check the finished jobs at least once a minute so that they get pruned */
+	*timeout_p = *now_p;
+
+	if (s_session.lds_num_running_jobs > 0)
+		{
+			AddMilliseconds (timeout_p, LD_POLL_INTERVAL_MS);
+		}
+	else
+		{
+			timeout_p -> tv_sec += 60;
+		}
+
+	for (job_p = s_session.lds_jobs_p; job_p; job_p = job_p -> lj_next_p)
+		{
+			if ((job_p -> lj_state == DRMAA_PS_QUEUED_ACTIVE) && (IsBefore (now_p, & (job_p -> lj_eligible_time))) && (IsBefore (& (job_p -> lj_eligible_time), timeout_p)))
+				{
+					*timeout_p = job_p -> lj_eligible_time;
+				}
+		}
+}
+
+
+static unsigned int GetEnvironmentValue (const char *name_s, const unsigned int default_value)
+{
+	unsigned int value = default_value;
+	const char *value_s = getenv (name_s);
+
+	if (value_s)
+		{
+			char *end_s;
+			long l = strtol (value_s, &end_s, 10);
+
+			if ((end_s != value_s) && (l >= 0))
+				{
+					value = (unsigned int) l;
+				}
+			else
+				{
+					fprintf (stderr, "local_drmaa: invalid value \"%s\" for %s, using %u\n", value_s, name_s, default_value);
+				}
+		}
+
+	return value;
+}
+
+
+static unsigned long long GetNanosecondsBetween (const struct timespec *start_p, const struct timespec *end_p)
+{
+	const long long ns = ((long long) (end_p -> tv_sec - start_p -> tv_sec)) * 1000000000LL + (end_p -> tv_nsec - start_p -> tv_nsec);
+
+	return (ns > 0) ? (unsigned long long) ns : 0;
+}
+
+
+static void AddMilliseconds (struct timespec *time_p, const unsigned long ms)
+{
+	time_p -> tv_sec += (time_t) (ms / 1000);
+	time_p -> tv_nsec += (long) ((ms % 1000) * 1000000);
+
+	if (time_p -> tv_nsec >= 1000000000L)
+		{
+			time_p -> tv_nsec -= 1000000000L;
+			++ (time_p -> tv_sec);
+		}
+}
+
+
+static bool IsBefore (const struct timespec *a_p, const struct timespec *b_p)
+{
+	return ((a_p -> tv_sec < b_p -> tv_sec) || ((a_p -> tv_sec == b_p -> tv_sec) && (a_p -> tv_nsec < b_p -> tv_nsec)));
+}
+
+
+/*
+ * Wait for a job, or any job if job_id_s is DRMAA_JOB_IDS_SESSION_ANY,
+ * to finish. This must be called with the session mutex held.
+ *
+ * @return true if a finished job was found and stored in job_pp, false
+ * if the timeout passed or the session ended first.
+ */
+static bool WaitForFinishedJob (const char *job_id_s, signed long timeout, LocalJob **job_pp)
+{
+	const bool any_flag = (strcmp (job_id_s, DRMAA_JOB_IDS_SESSION_ANY) == 0);
+	struct timespec wake_time;
+
+	if (timeout > 0)
+		{
+			clock_gettime (CLOCK_REALTIME, &wake_time);
+			wake_time.tv_sec += timeout;
+		}
+
+	while (s_session.lds_active_flag)
+		{
+			LocalJob *job_p;
+
+			if (any_flag)
+				{
+					for (job_p = s_session.lds_jobs_p; job_p && (!IsLocalJobFinished (job_p)); job_p = job_p -> lj_next_p)
+						{
+						}
+				}
+			else
+				{
+					job_p = FindLocalJob (job_id_s);
+
+					/* It may have been disposed of by another thread */
+					if (!job_p)
+						{
+							return false;
+						}
+
+					if (!IsLocalJobFinished (job_p))
+						{
+							job_p = NULL;
+						}
+				}
+
+			if (job_p)
+				{
+					*job_pp = job_p;
+					return true;
+				}
+
+			if (timeout == DRMAA_TIMEOUT_NO_WAIT)
+				{
+					return false;
+				}
+			else if (timeout > 0)
+				{
+					if (pthread_cond_timedwait (& (s_session.lds_finished_cond), &s_session_mutex, &wake_time) == ETIMEDOUT)
+						{
+							timeout = DRMAA_TIMEOUT_NO_WAIT;
+						}
+				}
+			else
+				{
+					pthread_cond_wait (& (s_session.lds_finished_cond), &s_session_mutex);
+				}
+		}
+
+	return false;
+}
+
+
+static void WriteStats (const char *filename_s)
+{
+	if (filename_s)
+		{
+			FILE *out_f = fopen (filename_s, "w");
+
+			if (out_f)
+				{
+					const LocalDrmaaStats *stats_p = & (s_session.lds_stats);
+					struct timespec now;
+					double elapsed_s;
+					const unsigned long num_submit_calls = stats_p -> lds_num_run_job_calls + stats_p -> lds_num_run_bulk_jobs_calls;
+
+					clock_gettime (CLOCK_MONOTONIC, &now);
+					elapsed_s = GetNanosecondsBetween (& (s_session.lds_start_time), &now) / 1.0e9;
+
+					fprintf (out_f, "{\n");
+					fprintf (out_f, "\t\"slots\": %u,\n", s_session.lds_num_slots);
+					fprintf (out_f, "\t\"queue_wait_ms\": %u,\n", s_session.lds_queue_wait_ms);
+					fprintf (out_f, "\t\"queue_wait_jitter_ms\": %u,\n", s_session.lds_queue_wait_jitter_ms);
+					fprintf (out_f, "\t\"session_seconds\": %.3f,\n", elapsed_s);
+					fprintf (out_f, "\t\"run_job_calls\": %lu,\n", stats_p -> lds_num_run_job_calls);
+					fprintf (out_f, "\t\"run_bulk_jobs_calls\": %lu,\n", stats_p -> lds_num_run_bulk_jobs_calls);
+					fprintf (out_f, "\t\"jobs_submitted\": %lu,\n", stats_p -> lds_num_jobs_submitted);
+					fprintf (out_f, "\t\"submissions_per_second\": %.3f,\n", (elapsed_s > 0.0) ? num_submit_calls / elapsed_s : 0.0);
+					fprintf (out_f, "\t\"mean_submit_us\": %.3f,\n", (num_submit_calls > 0) ? stats_p -> lds_submit_ns / (1000.0 * num_submit_calls) : 0.0);
+					fprintf (out_f, "\t\"job_ps_calls\": %lu,\n", stats_p -> lds_num_job_ps_calls);
+					fprintf (out_f, "\t\"job_ps_calls_per_job\": %.3f,\n", (stats_p -> lds_num_jobs_submitted > 0) ? ((double) stats_p -> lds_num_job_ps_calls) / stats_p -> lds_num_jobs_submitted : 0.0);
+					fprintf (out_f, "\t\"mean_job_ps_us\": %.3f,\n", (stats_p -> lds_num_job_ps_calls > 0) ? stats_p -> lds_job_ps_ns / (1000.0 * stats_p -> lds_num_job_ps_calls) : 0.0);
+					fprintf (out_f, "\t\"control_calls\": %lu,\n", stats_p -> lds_num_control_calls);
+					fprintf (out_f, "\t\"wait_calls\": %lu,\n", stats_p -> lds_num_wait_calls);
+					fprintf (out_f, "\t\"jobs_started\": %lu,\n", stats_p -> lds_num_jobs_started);
+					fprintf (out_f, "\t\"jobs_finished\": %lu,\n", stats_p -> lds_num_jobs_finished);
+					fprintf (out_f, "\t\"max_queued_jobs\": %lu,\n", stats_p -> lds_max_queued_jobs);
+					fprintf (out_f, "\t\"max_running_jobs\": %lu,\n", stats_p -> lds_max_running_jobs);
+					fprintf (out_f, "\t\"mean_queue_wait_ms\": %.3f,\n", (stats_p -> lds_num_jobs_started > 0) ? stats_p -> lds_total_queue_wait_ns / (1.0e6 * stats_p -> lds_num_jobs_started) : 0.0);
+					fprintf (out_f, "\t\"max_queue_wait_ms\": %.3f,\n", stats_p -> lds_max_queue_wait_ns / 1.0e6);
+					fprintf (out_f, "\t\"total_run_seconds\": %.3f\n", stats_p -> lds_total_run_ns / 1.0e9);
+					fprintf (out_f, "}\n");
+
+					fclose (out_f);
+				}
+			else
+				{
+					fprintf (stderr, "local_drmaa: failed to open \"%s\" to write stats: %s\n", filename_s, strerror (errno));
+				}
+		}
+}
+
+
+static void ClearStats (LocalDrmaaStats *stats_p)
+{
+	memset (stats_p, 0, sizeof (LocalDrmaaStats));
+}
@@ -24,13 +24,19 @@
  */
 
 
+#include <signal.h>
+
 #include "async_system_blast_tool.hpp"
 
 #include "blast_service_job.h"
+#include "blast_process.h"
+#include "blast_process_envelope.hpp"
+#include "blast_scheduler.hpp"
+#include "blast_util.h"
+#include "chunked_query_search.hpp"
 #include "string_utils.h"
 #include "jobs_manager.h"
-
-#include "system_async_task.h"
+#include "memory_allocations.h"
 
 #include "uuid_util.h"
 
@@ -45,25 +51,36 @@ const char * const AsyncSystemBlastTool :: ASBT_ASYNC_S = "async";
 
 const char * const AsyncSystemBlastTool :: ASBT_LOGFILE_S = "logfile";
 
+/*
+ * The data passed to the BlastProcessMonitor for the process
+ * searching one of the chunks of a job's queries.
+ */
+typedef struct AsyncQueryChunk
+{
+	AsyncSystemBlastTool *aqc_tool_p;
+
+	uint32 aqc_index;
+
+	pid_t aqc_pid;
+} AsyncQueryChunk;
+
+
 static bool UpdateAsyncBlastServiceJob (struct ServiceJob *job_p);
 
 
 
 AsyncSystemBlastTool :: AsyncSystemBlastTool (BlastServiceJob *job_p, const char *name_s, const char *factory_s, const BlastServiceData *data_p, const char *blast_program_name_s)
 : SystemBlastTool (job_p, name_s, factory_s, data_p, blast_program_name_s),
-	asbt_async_logfile_s (0)
+	asbt_async_logfile_s (0),
+	asbt_pid (-1),
+	asbt_num_cores (0)
 {
-	SetServiceJobUpdateFunction (& (job_p -> bsj_job), UpdateAsyncBlastServiceJob);
-
-	asbt_task_p = AllocateSystemAsyncTask (& (job_p -> bsj_job), name_s, data_p -> bsd_task_manager_p, true, blast_program_name_s, BlastServiceJobCompleted);
+	InitChunks ();
 
-	if (!asbt_task_p)
-		{
-			throw std :: bad_alloc ();
-		}
+	SetServiceJobUpdateFunction (& (job_p -> bsj_job), UpdateAsyncBlastServiceJob);
 
 	#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINEST
-	PrintLog (STM_LEVEL_FINEST, __FILE__, __LINE__, "Created AsyncSystemBlastTool at " %.16X " with task " %.16X " for job " %.16X " for service " %.16X " with name ", this, asbt_task_p, job_p, job_p -> bsj_job.sj_service_p, name_s);
+	PrintLog (STM_LEVEL_FINEST, __FILE__, __LINE__, "Created AsyncSystemBlastTool at %.16X for job %.16X for service %.16X with name \"%s\"", this, job_p, job_p -> bsj_job.sj_service_p, name_s);
 	#endif
 }
 
@@ -75,59 +92,86 @@ AsyncSystemBlastTool :: ~AsyncSystemBlastTool ()
 			FreeCopiedString (asbt_async_logfile_s);
 		}
 
-	FreeSystemAsyncTask (asbt_task_p);
+	if (asbt_chunked_search_p)
+		{
+			delete asbt_chunked_search_p;
+		}
+
+	if (asbt_chunks_p)
+		{
+			FreeMemory (asbt_chunks_p);
+		}
+
+	if (asbt_chunk_args_ss)
+		{
+			FreeMemory (asbt_chunk_args_ss);
+		}
+
+	if (asbt_chunk_logfile_s)
+		{
+			FreeCopiedString (asbt_chunk_logfile_s);
+		}
+
+	pthread_mutex_destroy (&asbt_chunks_mutex);
 
 	#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINEST
-	PrintLog (STM_LEVEL_FINEST, __FILE__, __LINE__, "Freed AsyncSystemBlastTool at " %.16X " with task " %.16X " for job " %.16X " for service " %.16X, this, asbt_task_p, job_p, job_p -> bsj_job.sj_service_p);
+	PrintLog (STM_LEVEL_FINEST, __FILE__, __LINE__, "Freed AsyncSystemBlastTool at %.16X for job %.16X", this, bt_job_p);
 	#endif
 }
 
 
 AsyncSystemBlastTool :: AsyncSystemBlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p, const json_t *root_p)
 : SystemBlastTool (job_p, data_p, root_p),
-	asbt_async_logfile_s (0)
+	asbt_async_logfile_s (0),
+	asbt_pid (-1),
+	asbt_num_cores (0)
 {
 	bool alloc_flag = false;
 	bool async_flag;
 
+	InitChunks ();
+
 	if (GetJSONBoolean (root_p, AsyncSystemBlastTool :: ASBT_ASYNC_S, &async_flag))
 		{
-			char *name_s = NULL;
-			char *blast_program_name_s = NULL;
-			bool continue_flag = true;
 			const char *value_s = GetJSONString (root_p, AsyncSystemBlastTool :: ASBT_LOGFILE_S);
 
 			if (value_s)
 				{
 					asbt_async_logfile_s = CopyToNewString (value_s, 0, false);
 
-					if (!asbt_async_logfile_s)
+					if (asbt_async_logfile_s)
 						{
-							continue_flag = false;
+							alloc_flag = true;
 						}
 				}
 			else
 				{
 					asbt_async_logfile_s = NULL;
-				}
-
-			if (continue_flag)
-				{
-					asbt_task_p = AllocateSystemAsyncTask (& (job_p -> bsj_job), name_s, data_p -> bsd_task_manager_p, true, blast_program_name_s, BlastServiceJobCompleted);
-
-					if (asbt_task_p)
-						{
-							alloc_flag = true;
-						}
-				}
-
-			if (!alloc_flag)
-				{
-					FreeCopiedString (asbt_async_logfile_s);
+					alloc_flag = true;
 				}
 		}
 
 	if (!alloc_flag)
+		{
+			pthread_mutex_destroy (&asbt_chunks_mutex);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+void AsyncSystemBlastTool :: InitChunks ()
+{
+	asbt_chunked_search_p = 0;
+	asbt_chunks_p = 0;
+	asbt_chunk_args_ss = 0;
+	asbt_chunk_logfile_s = 0;
+	asbt_next_chunk = 0;
+	asbt_num_running_chunks = 0;
+	asbt_max_running_chunks = 0;
+	asbt_chunks_status = OS_IDLE;
+	asbt_chunks_cancelled_flag = false;
+
+	if (pthread_mutex_init (&asbt_chunks_mutex, NULL) != 0)
 		{
 			throw std :: bad_alloc ();
 		}
@@ -143,6 +187,11 @@ bool AsyncSystemBlastTool :: PreRun ()
 		{
 			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_STARTED);
 		}
+	else
+		{
+			/* Run won't be called, so count this job as finished */
+			IncrementAsyncTaskManagerCount (bt_service_data_p -> bsd_task_manager_p);
+		}
 
 	return b;
 }
@@ -151,60 +200,297 @@ bool AsyncSystemBlastTool :: PreRun ()
 OperationStatus AsyncSystemBlastTool :: Run ()
 {
 	OperationStatus status = OS_FAILED_TO_START;
-	const char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+	BlastScheduler *scheduler_p = bt_service_data_p -> bsd_scheduler_p;
+	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (bt_job_p -> bsj_job.sj_service_p);
+	JobsManager *manager_p = GetJobsManager (grassroots_p);
 	char uuid_s [UUID_STRING_BUFFER_SIZE];
 
 	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
 
 	SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
 
-	if (command_line_s)
+	if (AddServiceJobToJobsManager (manager_p, bt_job_p -> bsj_job.sj_id, (ServiceJob *) bt_job_p))
 		{
-			if (SetSystemAsyncTaskCommand	(asbt_task_p, command_line_s))
-				{
-					GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (bt_job_p -> bsj_job.sj_service_p);
-					JobsManager *manager_p = GetJobsManager (grassroots_p);
+			asbt_chunked_search_p = GetChunkedQuerySearch ();
 
-					#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
-					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "About to run SystemBlastTool with \"%s\"", command_line_s);
-					#endif
+			if (asbt_chunked_search_p)
+				{
+					asbt_chunks_p = (AsyncQueryChunk *) AllocMemoryArray (asbt_chunked_search_p -> GetNumChunks (), sizeof (AsyncQueryChunk));
 
-					if (!SaveCommandLine (command_line_s))
+					/* Fall back to searching all of the queries with a single process */
+					if (!asbt_chunks_p)
 						{
-							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate query chunks for uuid %s", uuid_s);
+
+							delete asbt_chunked_search_p;
+							asbt_chunked_search_p = 0;
 						}
+				}
 
-					if (AddServiceJobToJobsManager (manager_p, bt_job_p -> bsj_job.sj_id, (ServiceJob *) bt_job_p))
+			if (scheduler_p -> ReserveQueueSlot ())
+				{
+					uint32 num_threads = scheduler_p -> GetNumThreadsForJob (ebt_query_size, GetBlastDatabaseSize (bt_name_s), bt_service_data_p -> bsd_max_threads_per_search);
+
+					/*
+					 * Set the status before adding the job to the line, as it
+					 * may be launched, and even finish, before AddWaitingJob returns.
+					 */
+					SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_PENDING);
+
+					if (scheduler_p -> AddWaitingJob (num_threads, AsyncSystemBlastTool :: CoresAvailable, this))
 						{
+							/*
+							 * The ServiceJob should now only be writeable by CoresAvailable
+							 * and the BlastProcessMonitor that will be watching it.
+							 */
 							status = OS_PENDING;
-							SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
 
-							if (RunSystemAsyncTask (asbt_task_p))
-								{
-									/*
-									 * The ServiceJob should now only be writeable by the SystemAsyncTask that it is running under.
-									 */
-									status = OS_STARTED;
-								}
-							else
-								{
-									status = OS_FAILED_TO_START;
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run async task for uuid %s", uuid_s);
-								}
+							#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Added uuid %s to the jobs waiting for " UINT32_FMT " cores", uuid_s, num_threads);
+							#endif
 						}
 					else
 						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add Blast Service Job \"%s\" to jobs manager", uuid_s);
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add uuid %s to the jobs waiting for cores", uuid_s);
+							scheduler_p -> CancelQueueSlot ();
+						}
+
+				}		/* if (scheduler_p -> ReserveQueueSlot ()) */
+			else
+				{
+					if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), BlastScheduler :: BS_QUEUE_FULL_S))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", BlastScheduler :: BS_QUEUE_FULL_S);
+						}
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add Blast Service Job \"%s\" to jobs manager", uuid_s);
+		}
+
+	if (status == OS_FAILED_TO_START)
+		{
+			FailToStart ();
+		}
+
+	return status;
+}
+
+
+/*
+ * This is called by the BlastScheduler once this job has been given its
+ * cores, on whichever thread released them.
+ */
+void AsyncSystemBlastTool :: CoresAvailable (void *data_p, uint32 num_cores)
+{
+	AsyncSystemBlastTool *tool_p = static_cast <AsyncSystemBlastTool *> (data_p);
+
+	if (num_cores > 0)
+		{
+			bool launched_flag;
+
+			tool_p -> asbt_num_cores = num_cores;
+
+			if (tool_p -> asbt_chunked_search_p)
+				{
+					launched_flag = tool_p -> LaunchWatchedChunks ();
+				}
+			else
+				{
+					launched_flag = tool_p -> LaunchWatchedBlastProcess ();
+				}
+
+			if (!launched_flag)
+				{
+					/* Give the cores back first, as the service may be freed by FailToStart */
+					tool_p -> asbt_num_cores = 0;
+					tool_p -> bt_service_data_p -> bsd_scheduler_p -> ReleaseCores (num_cores);
+
+					tool_p -> FailToStart ();
+				}
+		}
+	else
+		{
+			/* The BlastScheduler is being freed so this job will never run */
+			tool_p -> FailWithoutCores ();
+		}
+}
+
+
+/*
+ * Launch the Blast process using the cores that this job has been given and
+ * hand it over to the BlastProcessMonitor. If this succeeds, the process may
+ * already have finished and this AsyncSystemBlastTool been freed by the
+ * time that this returns.
+ */
+bool AsyncSystemBlastTool :: LaunchWatchedBlastProcess ()
+{
+	bool success_flag = false;
+	char **args_ss = NULL;
+	char *command_line_s = NULL;
+	char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+	if (AddNumThreadsArg (asbt_num_cores))
+		{
+			args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+			command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set the number of threads to " UINT32_FMT " for uuid %s", asbt_num_cores, uuid_s);
+		}
+
+	if (args_ss && command_line_s && logfile_s)
+		{
+			pid_t pid;
+
+			#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "About to run AsyncSystemBlastTool with \"%s\"", command_line_s);
+			#endif
+
+			if (!SaveCommandLine (command_line_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+				}
+
+			/*
+			 * Set the status before launching the process, as the
+			 * BlastProcessMonitor may complete the job before it has
+			 * been added to the monitor.
+			 */
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_STARTED);
+
+			if (bt_service_data_p -> bsd_envelope_p)
+				{
+					pid = bt_service_data_p -> bsd_envelope_p -> Spawn (args_ss, logfile_s);
+				}
+			else
+				{
+					pid = SpawnBlastProcess (args_ss, logfile_s);
+				}
+
+			if (pid != -1)
+				{
+					/* This is needed by BlastProcessFinished so set it before the process is watched */
+					asbt_pid = pid;
+
+					if (bt_service_data_p -> bsd_monitor_p -> Watch (pid, AsyncSystemBlastTool :: BlastProcessFinished, this, uuid_s, GetDeadline ()))
+						{
+							success_flag = true;
 						}
+					else
+						{
+							BlastProcessResult result;
+
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to watch process %d for uuid %s", pid, uuid_s);
+
+							/* Nothing would collect the process's results, so stop it */
+							kill (-pid, SIGTERM);
+							WaitForBlastProcess (pid, &result);
 
-					#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
-					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created async task for uuid %s", uuid_s);
-					#endif
+							if (bt_service_data_p -> bsd_envelope_p)
+								{
+									bt_service_data_p -> bsd_envelope_p -> Leave (pid, &result);
+								}
+						}
 				}
 			else
 				{
-					SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set command \"%s\" for uuid \"%s\"", command_line_s, uuid_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to launch process for uuid %s", uuid_s);
+				}
+
+			#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Launched process %d for uuid %s", pid, uuid_s);
+			#endif
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" failed to start", command_line_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get command to run for uuid \"%s\"", uuid_s);
+		}
+
+	if (logfile_s)
+		{
+			FreeCopiedString (logfile_s);
+		}
+
+	if (command_line_s)
+		{
+			FreeCopiedString (command_line_s);
+		}
+
+	if (args_ss)
+		{
+			FreeMemory (args_ss);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Launch the processes for as many of the chunks of the queries as can run
+ * at the same time using the cores that this job has been given. The rest
+ * are launched by ChunkFinished. If this succeeds, all of the chunks may
+ * already have finished and this AsyncSystemBlastTool been freed by the
+ * time that this returns.
+ */
+bool AsyncSystemBlastTool :: LaunchWatchedChunks ()
+{
+	bool success_flag = false;
+	char *command_line_s = NULL;
+	const uint32 threads_per_chunk = BlastScheduler :: ShareCores (asbt_num_cores, asbt_chunked_search_p -> GetNumChunks (), &asbt_max_running_chunks);
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+	asbt_chunk_logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+
+	if (AddNumThreadsArg (threads_per_chunk))
+		{
+			asbt_chunk_args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+			command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set the number of threads to " UINT32_FMT " for uuid %s", threads_per_chunk, uuid_s);
+		}
+
+	if (asbt_chunk_args_ss && command_line_s && asbt_chunk_logfile_s)
+		{
+			#if ASYNC_SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Searching " UINT32_FMT " query chunks for uuid %s, " UINT32_FMT " at a time with " UINT32_FMT " threads each", asbt_chunked_search_p -> GetNumChunks (), uuid_s, asbt_max_running_chunks, threads_per_chunk);
+			#endif
+
+			if (!SaveCommandLine (command_line_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+				}
+
+			/* As in LaunchWatchedBlastProcess, set the status before any of the processes can finish */
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_STARTED);
+
+			pthread_mutex_lock (&asbt_chunks_mutex);
+
+			asbt_chunks_status = OS_STARTED;
+			LaunchChunks ();
+
+			/* If none of the chunks are running, nothing will complete the job so let CoresAvailable fail it */
+			success_flag = (asbt_num_running_chunks > 0);
+
+			pthread_mutex_unlock (&asbt_chunks_mutex);
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" failed to start", command_line_s);
 				}
 		}
 	else
@@ -212,26 +498,245 @@ OperationStatus AsyncSystemBlastTool :: Run ()
 			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get command to run for uuid \"%s\"", uuid_s);
 		}
 
-	if ((status == OS_ERROR) || (status == OS_FAILED_TO_START) || (status == OS_FAILED))
+	if (command_line_s)
 		{
-			char *log_s = GetLog ();
+			FreeCopiedString (command_line_s);
+		}
+
+	return success_flag;
+}
 
-			SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
 
-			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" returned %d", command_line_s, status);
+/*
+ * Launch chunks until as many are running as the cores allow. This must
+ * be called with asbt_chunks_mutex locked.
+ */
+void AsyncSystemBlastTool :: LaunchChunks ()
+{
+	if ((asbt_chunks_status == OS_STARTED) && asbt_chunks_cancelled_flag)
+		{
+			asbt_chunks_status = OS_FAILED;
+			sbt_stop = BPS_CANCELLED;
+		}
+
+	while ((asbt_chunks_status == OS_STARTED) && (asbt_next_chunk < asbt_chunked_search_p -> GetNumChunks ()) && (asbt_num_running_chunks < asbt_max_running_chunks))
+		{
+			LaunchNextChunk ();
+		}
+}
+
 
-			if (log_s)
+/* This must be called with asbt_chunks_mutex locked */
+void AsyncSystemBlastTool :: LaunchNextChunk ()
+{
+	AsyncQueryChunk *chunk_p = asbt_chunks_p + asbt_next_chunk;
+	const char *replacements_ss [] = { "-query", asbt_chunked_search_p -> GetChunkQueryFilename (asbt_next_chunk), "-out", asbt_chunked_search_p -> GetChunkOutputFilename (asbt_next_chunk), NULL };
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+	chunk_p -> aqc_tool_p = this;
+	chunk_p -> aqc_index = asbt_next_chunk;
+
+	++ asbt_next_chunk;
+
+	ReplaceBlastProcessArgValues (asbt_chunk_args_ss, replacements_ss);
+
+	if (bt_service_data_p -> bsd_envelope_p)
+		{
+			chunk_p -> aqc_pid = bt_service_data_p -> bsd_envelope_p -> Spawn (asbt_chunk_args_ss, asbt_chunk_logfile_s);
+		}
+	else
+		{
+			chunk_p -> aqc_pid = SpawnBlastProcess (asbt_chunk_args_ss, asbt_chunk_logfile_s);
+		}
+
+	if (chunk_p -> aqc_pid != -1)
+		{
+			/* ChunkFinished can't run until asbt_chunks_mutex is unlocked so count it first */
+			++ asbt_num_running_chunks;
+
+			if (!bt_service_data_p -> bsd_monitor_p -> Watch (chunk_p -> aqc_pid, AsyncSystemBlastTool :: ChunkFinished, chunk_p, uuid_s, GetDeadline ()))
 				{
-					if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), log_s))
+					BlastProcessResult result;
+
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to watch process %d for chunk " UINT32_FMT " of uuid %s", chunk_p -> aqc_pid, chunk_p -> aqc_index, uuid_s);
+
+					-- asbt_num_running_chunks;
+					asbt_chunks_status = OS_FAILED;
+
+					/* Nothing would collect the process's results, so stop it */
+					kill (- (chunk_p -> aqc_pid), SIGTERM);
+					WaitForBlastProcess (chunk_p -> aqc_pid, &result);
+
+					if (bt_service_data_p -> bsd_envelope_p)
 						{
-							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job");
+							bt_service_data_p -> bsd_envelope_p -> Leave (chunk_p -> aqc_pid, &result);
 						}
+				}
+		}
+	else
+		{
+			asbt_chunks_status = OS_FAILED;
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to launch process for chunk " UINT32_FMT " of uuid %s", chunk_p -> aqc_index, uuid_s);
+		}
+}
+
 
-					FreeCopiedString (log_s);
-				}		/* if (log_s) */
+/*
+ * This is called from the BlastProcessMonitor's thread once the process
+ * for one of the chunks has finished. Its results are merged, so that
+ * they can be streamed, and the next chunk is launched in its place.
+ */
+void AsyncSystemBlastTool :: ChunkFinished (void *data_p, const BlastProcessResult *result_p)
+{
+	AsyncQueryChunk *chunk_p = static_cast <AsyncQueryChunk *> (data_p);
+	AsyncSystemBlastTool *tool_p = chunk_p -> aqc_tool_p;
+	BlastProcessEnvelope *envelope_p = tool_p -> bt_service_data_p -> bsd_envelope_p;
+	BlastProcessResult result = *result_p;
+	bool finished_flag;
+
+	if (envelope_p)
+		{
+			envelope_p -> Leave (chunk_p -> aqc_pid, &result);
 		}
 
-	return status;
+	pthread_mutex_lock (& (tool_p -> asbt_chunks_mutex));
+
+	-- (tool_p -> asbt_num_running_chunks);
+
+	if (result.bpr_stop != BPS_NONE)
+		{
+			tool_p -> sbt_stop = result.bpr_stop;
+		}
+
+	if (!DidBlastProcessSucceed (&result))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Query chunk \"%s\" returned %d with signal %d", tool_p -> asbt_chunked_search_p -> GetChunkQueryFilename (chunk_p -> aqc_index), result.bpr_exit_code, result.bpr_signal);
+			tool_p -> asbt_chunks_status = OS_FAILED;
+		}
+	else if ((tool_p -> asbt_chunks_status == OS_STARTED) && (!tool_p -> asbt_chunked_search_p -> SetChunkSucceeded (chunk_p -> aqc_index)))
+		{
+			tool_p -> asbt_chunks_status = OS_FAILED;
+		}
+
+	tool_p -> LaunchChunks ();
+
+	finished_flag = (tool_p -> asbt_num_running_chunks == 0);
+
+	pthread_mutex_unlock (& (tool_p -> asbt_chunks_mutex));
+
+	if (finished_flag)
+		{
+			tool_p -> FinishChunks ();
+		}
+}
+
+
+/*
+ * Complete the job once all of its chunks have finished. As in
+ * BlastProcessFinished, this AsyncSystemBlastTool may be freed by this.
+ */
+void AsyncSystemBlastTool :: FinishChunks ()
+{
+	AsyncTasksManager *manager_p = bt_service_data_p -> bsd_task_manager_p;
+	const OperationStatus status = ((asbt_chunks_status == OS_STARTED) && (asbt_chunked_search_p -> IsComplete ())) ? OS_SUCCEEDED : OS_FAILED;
+
+	if (asbt_num_cores > 0)
+		{
+			bt_service_data_p -> bsd_scheduler_p -> ReleaseCores (asbt_num_cores);
+			asbt_num_cores = 0;
+		}
+
+	CompleteRun (status);
+
+	BlastServiceJobCompleted (& (bt_job_p -> bsj_job));
+
+	IncrementAsyncTaskManagerCount (manager_p);
+}
+
+
+/*
+ * Mark the job as having failed to start and, as there is no process for
+ * the BlastProcessMonitor to complete, count it as finished now. This must
+ * be done last as this AsyncSystemBlastTool may be freed by it.
+ */
+void AsyncSystemBlastTool :: FailToStart ()
+{
+	AsyncTasksManager *manager_p = bt_service_data_p -> bsd_task_manager_p;
+	char *log_s = GetLog ();
+
+	SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_FAILED_TO_START);
+
+	if (log_s)
+		{
+			if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), log_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", log_s);
+				}
+
+			FreeCopiedString (log_s);
+		}		/* if (log_s) */
+
+	IncrementAsyncTaskManagerCount (manager_p);
+}
+
+
+/*
+ * Fail and complete a job that was still waiting for its cores when
+ * the BlastScheduler was freed. As in FailToStart, this must be done
+ * last as this AsyncSystemBlastTool may be freed by it.
+ */
+void AsyncSystemBlastTool :: FailWithoutCores ()
+{
+	AsyncTasksManager *manager_p = bt_service_data_p -> bsd_task_manager_p;
+
+	if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), BlastScheduler :: BS_SHUTTING_DOWN_S))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", BlastScheduler :: BS_SHUTTING_DOWN_S);
+		}
+
+	CompleteRun (OS_FAILED);
+
+	BlastServiceJobCompleted (& (bt_job_p -> bsj_job));
+
+	IncrementAsyncTaskManagerCount (manager_p);
+}
+
+
+bool AsyncSystemBlastTool :: Cancel ()
+{
+	bool success_flag = false;
+
+	if (bt_service_data_p -> bsd_scheduler_p -> RemoveWaitingJob (this))
+		{
+			AsyncTasksManager *manager_p = bt_service_data_p -> bsd_task_manager_p;
+
+			/* The job never got its cores so there is no process to stop, just complete it now */
+			sbt_stop = BPS_CANCELLED;
+			CompleteRun (OS_FAILED);
+
+			BlastServiceJobCompleted (& (bt_job_p -> bsj_job));
+			success_flag = true;
+
+			/* As in BlastProcessFinished, this must be done last */
+			IncrementAsyncTaskManagerCount (manager_p);
+		}
+	else
+		{
+			/* Stop any more of the chunks from being launched */
+			if (asbt_chunked_search_p)
+				{
+					pthread_mutex_lock (&asbt_chunks_mutex);
+					asbt_chunks_cancelled_flag = true;
+					pthread_mutex_unlock (&asbt_chunks_mutex);
+				}
+
+			/* The BlastProcessMonitor will call BlastProcessFinished, or ChunkFinished, which gives back the cores */
+			success_flag = SystemBlastTool :: Cancel ();
+		}
+
+	return success_flag;
 }
 
 
@@ -332,6 +837,55 @@ char *AsyncSystemBlastTool :: GetResults (BlastFormatter *formatter_p)
 
 
 
+/*
+ * This is called from the BlastProcessMonitor's thread once the blast
+ * process has finished.
+ */
+void AsyncSystemBlastTool :: BlastProcessFinished (void *data_p, const BlastProcessResult *result_p)
+{
+	AsyncSystemBlastTool *tool_p = static_cast <AsyncSystemBlastTool *> (data_p);
+	AsyncTasksManager *manager_p = tool_p -> bt_service_data_p -> bsd_task_manager_p;
+	BlastProcessEnvelope *envelope_p = tool_p -> bt_service_data_p -> bsd_envelope_p;
+	OperationStatus status = OS_SUCCEEDED;
+	BlastProcessResult result = *result_p;
+
+	if (envelope_p)
+		{
+			envelope_p -> Leave (tool_p -> asbt_pid, &result);
+		}
+
+	tool_p -> sbt_stop = result.bpr_stop;
+
+	/* Let any waiting jobs have the cores while the results are being gathered */
+	if (tool_p -> asbt_num_cores > 0)
+		{
+			tool_p -> bt_service_data_p -> bsd_scheduler_p -> ReleaseCores (tool_p -> asbt_num_cores);
+			tool_p -> asbt_num_cores = 0;
+		}
+
+	if (!DidBlastProcessSucceed (&result))
+		{
+			char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+			ConvertUUIDToString (tool_p -> bt_job_p -> bsj_job.sj_id, uuid_s);
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Blast process for uuid %s returned %d with signal %d", uuid_s, result.bpr_exit_code, result.bpr_signal);
+
+			status = OS_FAILED;
+		}
+
+	tool_p -> CompleteRun (status);
+
+	BlastServiceJobCompleted (& (tool_p -> bt_job_p -> bsj_job));
+
+	/*
+	 * This must be done last as, if this was the Service's final job,
+	 * the Service along with this AsyncSystemBlastTool may now be freed.
+	 */
+	IncrementAsyncTaskManagerCount (manager_p);
+}
+
+
+
 static bool UpdateAsyncBlastServiceJob (struct ServiceJob *job_p)
 {
 	BlastServiceJob *blast_job_p = reinterpret_cast <BlastServiceJob *> (job_p);
@@ -0,0 +1,864 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_batcher.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blast_batcher.hpp"
+#include "blast_util.h"
+#include "json_util.h"
+
+#include "jansson.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_BATCHER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_BATCHER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A search that is part of a batch. These are owned by the batch rather
+ * than the thread that is waiting for the search to finish, as a cancelled
+ * search stops waiting while the batch is still using its details.
+ */
+typedef struct BlastBatchMember
+{
+	ListItem bbm_node;
+
+	char *bbm_query_filename_s;
+
+	char *bbm_output_filename_s;
+
+	char *bbm_log_filename_s;
+
+	char bbm_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	uint32 bbm_num_queries;
+
+	OperationStatus bbm_status;
+
+	/* Has this search been cancelled and detached from the batch? */
+	bool bbm_cancelled_flag;
+} BlastBatchMember;
+
+
+/*
+ * A set of searches that will be run as a single Blast process.
+ */
+typedef struct BlastBatch
+{
+	ListItem bb_node;
+
+	char *bb_key_s;
+
+	/* The BlastBatchMembers in the order that they joined */
+	LinkedList *bb_members_p;
+
+	uint32 bb_num_queries;
+
+	/* The id of the job that runs the batch, which its Blast process is tracked under */
+	char bb_leader_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	uint32 bb_num_cancelled;
+
+	bool bb_open_flag;
+
+	bool bb_done_flag;
+
+	/* The number of members that have yet to collect their status */
+	uint32 bb_num_references;
+} BlastBatch;
+
+
+/*
+ * The header given to any raw sequences in a batch's query file. This is
+ * removed from the batch's output so that it doesn't show up as the title
+ * of the query.
+ */
+static const char * const S_RAW_QUERY_HEADER_S = "grassroots_batch_raw_query";
+
+
+static BlastBatch *AllocateBlastBatch (const char *key_s, const char *leader_job_id_s);
+
+static void FreeBlastBatch (BlastBatch *batch_p);
+
+static BlastBatchMember *AllocateBlastBatchMember (const char *job_id_s, const char *query_filename_s, const char *output_filename_s, const char *log_filename_s);
+
+static void FreeBlastBatchMember (ListItem * const node_p);
+
+
+static bool WriteBatchQueries (const BlastBatch *batch_p, const char *filename_s);
+
+static bool SplitBatchOutput (const BlastBatch *batch_p, const char *filename_s);
+
+static bool RenumberBatchQuery (json_t *report_p, const uint32 query_number);
+
+static bool CopyBatchLog (const char *from_filename_s, const char *to_filename_s);
+
+
+
+BlastBatcher *BlastBatcher :: bb_shared_batcher_p = 0;
+
+uint32 BlastBatcher :: bb_shared_batcher_count = 0;
+
+pthread_mutex_t BlastBatcher :: bb_shared_batcher_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+BlastBatcher *BlastBatcher :: GetSharedBlastBatcher (uint32 window_ms, uint32 max_queries)
+{
+	BlastBatcher *batcher_p = 0;
+
+	pthread_mutex_lock (&bb_shared_batcher_mutex);
+
+	if (!bb_shared_batcher_p)
+		{
+			try
+				{
+					bb_shared_batcher_p = new BlastBatcher (window_ms, max_queries);
+
+					#if BLAST_BATCHER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared BlastBatcher with a " UINT32_FMT " ms window and up to " UINT32_FMT " queries", window_ms, max_queries);
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastBatcher");
+				}
+		}
+	else if ((window_ms != bb_shared_batcher_p -> bb_window_ms) || (max_queries != bb_shared_batcher_p -> bb_max_queries))
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Shared BlastBatcher already has a " UINT32_FMT " ms window and up to " UINT32_FMT " queries, ignoring request for " UINT32_FMT " ms and " UINT32_FMT,
+									 bb_shared_batcher_p -> bb_window_ms, bb_shared_batcher_p -> bb_max_queries, window_ms, max_queries);
+		}
+
+	if (bb_shared_batcher_p)
+		{
+			++ bb_shared_batcher_count;
+			batcher_p = bb_shared_batcher_p;
+		}
+
+	pthread_mutex_unlock (&bb_shared_batcher_mutex);
+
+	return batcher_p;
+}
+
+
+void BlastBatcher :: ReleaseSharedBlastBatcher ()
+{
+	BlastBatcher *batcher_to_free_p = 0;
+
+	pthread_mutex_lock (&bb_shared_batcher_mutex);
+
+	if (bb_shared_batcher_count > 0)
+		{
+			-- bb_shared_batcher_count;
+
+			if (bb_shared_batcher_count == 0)
+				{
+					batcher_to_free_p = bb_shared_batcher_p;
+					bb_shared_batcher_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&bb_shared_batcher_mutex);
+
+	if (batcher_to_free_p)
+		{
+			delete batcher_to_free_p;
+		}
+}
+
+
+BlastBatcher :: BlastBatcher (uint32 window_ms, uint32 max_queries)
+	: bb_window_ms (window_ms),
+		bb_max_queries (max_queries)
+{
+	/* The batches are freed by their last member so the list doesn't own them */
+	bb_batches_p = AllocateLinkedList (NULL);
+
+	if (!bb_batches_p)
+		{
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_mutex_init (&bb_mutex, NULL) != 0)
+		{
+			FreeLinkedList (bb_batches_p);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&bb_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&bb_mutex);
+			FreeLinkedList (bb_batches_p);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastBatcher :: ~BlastBatcher ()
+{
+	pthread_cond_destroy (&bb_cond);
+	pthread_mutex_destroy (&bb_mutex);
+	FreeLinkedList (bb_batches_p);
+}
+
+
+OperationStatus BlastBatcher :: RunBatched (const char *key_s, const char *job_id_s, const char *query_filename_s, const char *output_filename_s, const char *log_filename_s, BlastBatchRunFn run_fn, void *run_data_p, bool *cancelled_flag_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	BlastBatchMember *member_p = AllocateBlastBatchMember (job_id_s, query_filename_s, output_filename_s, log_filename_s);
+	BlastBatch *batch_p = NULL;
+	bool leader_flag = false;
+
+	*cancelled_flag_p = false;
+
+	if (member_p)
+		{
+			pthread_mutex_lock (&bb_mutex);
+
+			batch_p = GetOpenBatch (key_s);
+
+			if (!batch_p)
+				{
+					batch_p = AllocateBlastBatch (key_s, job_id_s);
+
+					if (batch_p)
+						{
+							LinkedListAddTail (bb_batches_p, & (batch_p -> bb_node));
+							leader_flag = true;
+						}
+				}
+
+			if (batch_p)
+				{
+					LinkedListAddTail (batch_p -> bb_members_p, & (member_p -> bbm_node));
+					batch_p -> bb_num_queries += member_p -> bbm_num_queries;
+					++ (batch_p -> bb_num_references);
+
+					if (batch_p -> bb_num_queries >= bb_max_queries)
+						{
+							CloseBatch (batch_p);
+							pthread_cond_broadcast (&bb_cond);
+						}
+
+					if (leader_flag)
+						{
+							struct timespec deadline;
+							int res = 0;
+
+							clock_gettime (CLOCK_REALTIME, &deadline);
+							deadline.tv_sec += bb_window_ms / 1000;
+							deadline.tv_nsec += (long) (bb_window_ms % 1000) * 1000000L;
+
+							if (deadline.tv_nsec >= 1000000000L)
+								{
+									++ deadline.tv_sec;
+									deadline.tv_nsec -= 1000000000L;
+								}
+
+							while ((batch_p -> bb_open_flag) && (res != ETIMEDOUT))
+								{
+									res = pthread_cond_timedwait (&bb_cond, &bb_mutex, &deadline);
+								}
+
+							CloseBatch (batch_p);
+
+							/* If all of the searches have been cancelled already, there's nothing left to run */
+							if (batch_p -> bb_num_cancelled < batch_p -> bb_members_p -> ll_size)
+								{
+									/* No more members can join now so we can run it without holding the lock */
+									pthread_mutex_unlock (&bb_mutex);
+
+									RunBatch (batch_p, run_fn, run_data_p);
+
+									pthread_mutex_lock (&bb_mutex);
+								}
+
+							LinkedListRemove (bb_batches_p, & (batch_p -> bb_node));
+							batch_p -> bb_done_flag = true;
+							pthread_cond_broadcast (&bb_cond);
+						}
+					else
+						{
+							while ((! (batch_p -> bb_done_flag)) && (! (member_p -> bbm_cancelled_flag)))
+								{
+									pthread_cond_wait (&bb_cond, &bb_mutex);
+								}
+						}
+
+					/* A cancelled search ignores how the batch went */
+					*cancelled_flag_p = member_p -> bbm_cancelled_flag;
+					status = (*cancelled_flag_p) ? OS_FAILED : member_p -> bbm_status;
+
+					-- (batch_p -> bb_num_references);
+
+					if (batch_p -> bb_num_references == 0)
+						{
+							FreeBlastBatch (batch_p);
+						}
+
+					pthread_mutex_unlock (&bb_mutex);
+				}		/* if (batch_p) */
+			else
+				{
+					pthread_mutex_unlock (&bb_mutex);
+					FreeBlastBatchMember (& (member_p -> bbm_node));
+				}
+
+		}		/* if (member_p) */
+
+	if (!batch_p)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate batch for \"%s\", running it on its own", query_filename_s);
+			status = run_fn (run_data_p, query_filename_s, output_filename_s, 1);
+		}
+
+	return status;
+}
+
+
+bool BlastBatcher :: CancelBatched (const char *job_id_s, char *batch_job_id_s)
+{
+	bool found_flag = false;
+	BlastBatch *batch_p;
+
+	*batch_job_id_s = '\0';
+
+	pthread_mutex_lock (&bb_mutex);
+
+	batch_p = (BlastBatch *) (bb_batches_p -> ll_head_p);
+
+	while (batch_p && !found_flag)
+		{
+			BlastBatchMember *member_p = (BlastBatchMember *) (batch_p -> bb_members_p -> ll_head_p);
+
+			while (member_p && !found_flag)
+				{
+					if ((!member_p -> bbm_cancelled_flag) && (strcmp (member_p -> bbm_job_id_s, job_id_s) == 0))
+						{
+							member_p -> bbm_cancelled_flag = true;
+							++ (batch_p -> bb_num_cancelled);
+							found_flag = true;
+
+							/* Once none of the searches want the results, the batch's process can be stopped */
+							if ((!batch_p -> bb_open_flag) && (batch_p -> bb_num_cancelled == batch_p -> bb_members_p -> ll_size))
+								{
+									strcpy (batch_job_id_s, batch_p -> bb_leader_job_id_s);
+								}
+						}
+					else
+						{
+							member_p = (BlastBatchMember *) (member_p -> bbm_node.ln_next_p);
+						}
+				}
+
+			batch_p = (BlastBatch *) (batch_p -> bb_node.ln_next_p);
+		}
+
+	/* Let the cancelled search stop waiting */
+	if (found_flag)
+		{
+			pthread_cond_broadcast (&bb_cond);
+		}
+
+	pthread_mutex_unlock (&bb_mutex);
+
+	#if BLAST_BATCHER_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Cancelling batched job \"%s\" %s", job_id_s, found_flag ? "succeeded" : "found no batch");
+	#endif
+
+	return found_flag;
+}
+
+
+/* This must be called with bb_mutex held */
+BlastBatch *BlastBatcher :: GetOpenBatch (const char *key_s)
+{
+	BlastBatch *batch_p = (BlastBatch *) (bb_batches_p -> ll_head_p);
+
+	while (batch_p)
+		{
+			if ((batch_p -> bb_open_flag) && (strcmp (batch_p -> bb_key_s, key_s) == 0))
+				{
+					return batch_p;
+				}
+
+			batch_p = (BlastBatch *) (batch_p -> bb_node.ln_next_p);
+		}
+
+	return NULL;
+}
+
+
+/*
+ * This must be called with bb_mutex held. The batch stays in bb_batches_p
+ * until it has finished so that its searches can still be cancelled.
+ */
+void BlastBatcher :: CloseBatch (BlastBatch *batch_p)
+{
+	batch_p -> bb_open_flag = false;
+}
+
+
+/*
+ * The batch is closed when this is called so its members won't change
+ * and it can be accessed without holding bb_mutex. It's only the statuses
+ * of the members that are written to here and they are only read once
+ * bb_done_flag has been set. Any members that are cancelled while this
+ * runs still get their output, it's just that nobody will read it.
+ */
+OperationStatus BlastBatcher :: RunBatch (BlastBatch *batch_p, BlastBatchRunFn run_fn, void *run_data_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	BlastBatchMember *member_p = (BlastBatchMember *) (batch_p -> bb_members_p -> ll_head_p);
+
+	if (batch_p -> bb_members_p -> ll_size == 1)
+		{
+			/* Nothing joined so there's no need to merge anything */
+			status = run_fn (run_data_p, member_p -> bbm_query_filename_s, member_p -> bbm_output_filename_s, 1);
+			member_p -> bbm_status = status;
+		}
+	else
+		{
+			/* The leader is the first member so use its output file to name the batch files */
+			char *query_filename_s = ConcatenateVarargsStrings (member_p -> bbm_output_filename_s, ".batch.query", NULL);
+
+			#if BLAST_BATCHER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Running batch of " SIZET_FMT " searches with " UINT32_FMT " queries", batch_p -> bb_members_p -> ll_size, batch_p -> bb_num_queries);
+			#endif
+
+			if (query_filename_s)
+				{
+					char *output_filename_s = ConcatenateVarargsStrings (member_p -> bbm_output_filename_s, ".batch.out", NULL);
+
+					if (output_filename_s)
+						{
+							if (WriteBatchQueries (batch_p, query_filename_s))
+								{
+									const BlastBatchMember *follower_p = (const BlastBatchMember *) (member_p -> bbm_node.ln_next_p);
+
+									status = run_fn (run_data_p, query_filename_s, output_filename_s, (uint32) (batch_p -> bb_members_p -> ll_size));
+
+									/* The process writes to the leader's log, so give each of the others a copy of it */
+									while (follower_p)
+										{
+											if (!CopyBatchLog (member_p -> bbm_log_filename_s, follower_p -> bbm_log_filename_s))
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to copy batch log \"%s\" to \"%s\"", member_p -> bbm_log_filename_s, follower_p -> bbm_log_filename_s);
+												}
+
+											follower_p = (const BlastBatchMember *) (follower_p -> bbm_node.ln_next_p);
+										}
+
+									if (status == OS_SUCCEEDED)
+										{
+											if (!SplitBatchOutput (batch_p, output_filename_s))
+												{
+													status = OS_FAILED;
+												}
+										}
+
+									unlink (output_filename_s);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write batch queries to \"%s\"", query_filename_s);
+								}
+
+							unlink (query_filename_s);
+							FreeCopiedString (output_filename_s);
+						}		/* if (output_filename_s) */
+
+					FreeCopiedString (query_filename_s);
+				}		/* if (query_filename_s) */
+
+			while (member_p)
+				{
+					member_p -> bbm_status = status;
+					member_p = (BlastBatchMember *) (member_p -> bbm_node.ln_next_p);
+				}
+		}
+
+	return status;
+}
+
+
+
+static BlastBatch *AllocateBlastBatch (const char *key_s, const char *leader_job_id_s)
+{
+	BlastBatch *batch_p = (BlastBatch *) AllocMemory (sizeof (BlastBatch));
+
+	if (batch_p)
+		{
+			batch_p -> bb_key_s = EasyCopyToNewString (key_s);
+
+			if (batch_p -> bb_key_s)
+				{
+					batch_p -> bb_members_p = AllocateLinkedList (FreeBlastBatchMember);
+
+					if (batch_p -> bb_members_p)
+						{
+							memset (& (batch_p -> bb_node), 0, sizeof (ListItem));
+							strncpy (batch_p -> bb_leader_job_id_s, leader_job_id_s, UUID_STRING_BUFFER_SIZE - 1);
+							* (batch_p -> bb_leader_job_id_s + UUID_STRING_BUFFER_SIZE - 1) = '\0';
+							batch_p -> bb_num_queries = 0;
+							batch_p -> bb_num_cancelled = 0;
+							batch_p -> bb_open_flag = true;
+							batch_p -> bb_done_flag = false;
+							batch_p -> bb_num_references = 0;
+
+							return batch_p;
+						}
+
+					FreeCopiedString (batch_p -> bb_key_s);
+				}
+
+			FreeMemory (batch_p);
+		}
+
+	return NULL;
+}
+
+
+static void FreeBlastBatch (BlastBatch *batch_p)
+{
+	FreeLinkedList (batch_p -> bb_members_p);
+	FreeCopiedString (batch_p -> bb_key_s);
+	FreeMemory (batch_p);
+}
+
+
+static BlastBatchMember *AllocateBlastBatchMember (const char *job_id_s, const char *query_filename_s, const char *output_filename_s, const char *log_filename_s)
+{
+	BlastBatchMember *member_p = (BlastBatchMember *) AllocMemory (sizeof (BlastBatchMember));
+
+	if (member_p)
+		{
+			memset (member_p, 0, sizeof (BlastBatchMember));
+
+			member_p -> bbm_query_filename_s = EasyCopyToNewString (query_filename_s);
+
+			if (member_p -> bbm_query_filename_s)
+				{
+					member_p -> bbm_output_filename_s = EasyCopyToNewString (output_filename_s);
+
+					if (member_p -> bbm_output_filename_s)
+						{
+							member_p -> bbm_log_filename_s = EasyCopyToNewString (log_filename_s);
+
+							if (member_p -> bbm_log_filename_s)
+								{
+									strncpy (member_p -> bbm_job_id_s, job_id_s, UUID_STRING_BUFFER_SIZE - 1);
+									member_p -> bbm_num_queries = CountBlastQueries (query_filename_s);
+									member_p -> bbm_status = OS_FAILED_TO_START;
+									member_p -> bbm_cancelled_flag = false;
+
+									return member_p;
+								}
+
+							FreeCopiedString (member_p -> bbm_output_filename_s);
+						}
+
+					FreeCopiedString (member_p -> bbm_query_filename_s);
+				}
+
+			FreeMemory (member_p);
+		}
+
+	return NULL;
+}
+
+
+static void FreeBlastBatchMember (ListItem * const node_p)
+{
+	BlastBatchMember *member_p = (BlastBatchMember *) node_p;
+
+	FreeCopiedString (member_p -> bbm_query_filename_s);
+	FreeCopiedString (member_p -> bbm_output_filename_s);
+	FreeCopiedString (member_p -> bbm_log_filename_s);
+	FreeMemory (member_p);
+}
+
+
+static bool WriteBatchQueries (const BlastBatch *batch_p, const char *filename_s)
+{
+	bool success_flag = false;
+	FILE *out_f = fopen (filename_s, "w");
+
+	if (out_f)
+		{
+			const BlastBatchMember *member_p = (const BlastBatchMember *) (batch_p -> bb_members_p -> ll_head_p);
+
+			success_flag = true;
+
+			while (member_p && success_flag)
+				{
+					char *query_s = GetFileContentsAsStringByFilename (member_p -> bbm_query_filename_s);
+
+					if (query_s)
+						{
+							const char *start_s = query_s;
+							size_t l;
+
+							while (isspace (*start_s))
+								{
+									++ start_s;
+								}
+
+							/* Give any raw sequences a header so that they stay as separate queries */
+							if (*start_s != '>')
+								{
+									success_flag = (fprintf (out_f, ">%s\n", S_RAW_QUERY_HEADER_S) > 0);
+								}
+
+							l = strlen (start_s);
+
+							if (success_flag && (l > 0))
+								{
+									success_flag = (fwrite (start_s, 1, l, out_f) == l);
+
+									if (success_flag && (* (start_s + l - 1) != '\n'))
+										{
+											success_flag = (fputc ('\n', out_f) != EOF);
+										}
+								}
+
+							FreeCopiedString (query_s);
+						}
+					else
+						{
+							success_flag = false;
+						}
+
+					member_p = (const BlastBatchMember *) (member_p -> bbm_node.ln_next_p);
+				}
+
+			if (fclose (out_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The single-file JSON output has an entry in its BlastOutput2 array
+ * for each query in the order that they appeared in the query file, so
+ * each member gets the next bbm_num_queries of them. Their query ids
+ * are renumbered to start from 1 for each member.
+ */
+static bool SplitBatchOutput (const BlastBatch *batch_p, const char *filename_s)
+{
+	bool success_flag = false;
+	json_error_t err;
+	json_t *output_p = json_load_file (filename_s, 0, &err);
+
+	if (output_p)
+		{
+			json_t *reports_p = json_object_get (output_p, "BlastOutput2");
+
+			if (reports_p && json_is_array (reports_p) && (json_array_size (reports_p) == batch_p -> bb_num_queries))
+				{
+					const BlastBatchMember *member_p = (const BlastBatchMember *) (batch_p -> bb_members_p -> ll_head_p);
+					size_t index = 0;
+
+					success_flag = true;
+
+					while (member_p && success_flag)
+						{
+							json_t *member_output_p = json_object ();
+
+							success_flag = false;
+
+							if (member_output_p)
+								{
+									json_t *member_reports_p = json_array ();
+
+									if (member_reports_p)
+										{
+											if (json_object_set_new (member_output_p, "BlastOutput2", member_reports_p) == 0)
+												{
+													uint32 i;
+
+													success_flag = true;
+
+													for (i = 0; (i < member_p -> bbm_num_queries) && success_flag; ++ i, ++ index)
+														{
+															json_t *report_p = json_array_get (reports_p, index);
+
+															if ((!RenumberBatchQuery (report_p, i + 1)) || (json_array_append (member_reports_p, report_p) != 0))
+																{
+																	success_flag = false;
+																}
+														}
+
+													if (success_flag)
+														{
+															if (json_dump_file (member_output_p, member_p -> bbm_output_filename_s, JSON_INDENT (2)) != 0)
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write batch results to \"%s\"", member_p -> bbm_output_filename_s);
+																	success_flag = false;
+																}
+														}
+												}
+											else
+												{
+													json_decref (member_reports_p);
+												}
+										}
+
+									json_decref (member_output_p);
+								}
+
+							member_p = (const BlastBatchMember *) (member_p -> bbm_node.ln_next_p);
+						}
+
+				}		/* if (reports_p && json_is_array (reports_p) ... */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Batch output \"%s\" doesn't have " UINT32_FMT " results", filename_s, batch_p -> bb_num_queries);
+				}
+
+			json_decref (output_p);
+		}		/* if (output_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load batch output \"%s\", error at line %d: %s", filename_s, err.line, err.text);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Unless the ids of the queries have been parsed, Blast numbers them
+ * across the whole batch as "Query_1", "Query_2", etc. so give the
+ * query the id that it would have had if its job had been run on its own.
+ * Any header that was added to a raw sequence is removed too, as a raw
+ * sequence has no title when its job is run on its own.
+ */
+static bool RenumberBatchQuery (json_t *report_p, const uint32 query_number)
+{
+	bool success_flag = true;
+	json_t *search_p = json_object_get (json_object_get (json_object_get (report_p, "report"), "results"), "search");
+
+	if (search_p)
+		{
+			const char *id_s = GetJSONString (search_p, "query_id");
+			const char *title_s = GetJSONString (search_p, "query_title");
+			bool raw_query_flag = false;
+
+			if (title_s && (strcmp (title_s, S_RAW_QUERY_HEADER_S) == 0))
+				{
+					raw_query_flag = true;
+
+					if (json_object_del (search_p, "query_title") != 0)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove title of raw batch query " UINT32_FMT, query_number);
+							success_flag = false;
+						}
+				}
+
+			if (id_s)
+				{
+					const size_t id_length = strlen (id_s);
+					const size_t header_length = strlen (S_RAW_QUERY_HEADER_S);
+
+					/* With -parse_deflines, the added header becomes the id, possibly with a "lcl|" prefix */
+					if ((id_length >= header_length) && (strcmp (id_s + id_length - header_length, S_RAW_QUERY_HEADER_S) == 0))
+						{
+							raw_query_flag = true;
+						}
+				}
+
+			if (raw_query_flag || (id_s && (strncmp (id_s, "Query_", 6) == 0)))
+				{
+					char query_id_s [32];
+
+					sprintf (query_id_s, "Query_" UINT32_FMT, query_number);
+
+					if (!SetJSONString (search_p, "query_id", query_id_s))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to renumber batch query " UINT32_FMT " to \"%s\"", query_number, query_id_s);
+							success_flag = false;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool CopyBatchLog (const char *from_filename_s, const char *to_filename_s)
+{
+	bool success_flag = false;
+	FILE *in_f = fopen (from_filename_s, "r");
+
+	if (in_f)
+		{
+			FILE *out_f = fopen (to_filename_s, "w");
+
+			if (out_f)
+				{
+					char buffer [4096];
+					size_t l;
+
+					success_flag = true;
+
+					while (success_flag && ((l = fread (buffer, 1, sizeof (buffer), in_f)) > 0))
+						{
+							success_flag = (fwrite (buffer, 1, l, out_f) == l);
+						}
+
+					if (ferror (in_f))
+						{
+							success_flag = false;
+						}
+
+					if (fclose (out_f) != 0)
+						{
+							success_flag = false;
+						}
+				}
+
+			fclose (in_f);
+		}
+
+	return success_flag;
+}
@@ -0,0 +1,642 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_database_warmer.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blast_database_warmer.hpp"
+
+#include "blast_util.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_DATABASE_WARMER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_DATABASE_WARMER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A database is either a single volume or up to 100 numbered
+ * volumes for each of its sequence and index files.
+ */
+#define BDW_MAX_DATABASE_FILES	(202)
+
+
+/*
+ * One of the databases that a BlastDatabaseWarmer checks. The names
+ * belong to the service's DatabaseInfo, which outlives the warmer.
+ */
+typedef struct WarmedDatabase
+{
+	const char *wd_name_s;
+
+	const char *wd_filename_s;
+
+	int32 wd_priority;
+
+	/* The size of the database's files when they were last checked */
+	uint64 wd_size;
+
+	/* How much of the database's files were in the page cache when they were last checked */
+	uint64 wd_resident_size;
+
+	bool wd_checked_flag;
+
+	/* Was the database within the memory budget when it was last checked? */
+	bool wd_warmed_flag;
+} WarmedDatabase;
+
+
+static uint32 GetDatabaseFilenames (const char *db_s, const DatabaseType db_type, char **filenames_ss);
+
+static bool AddDatabaseFilename (char *filename_s, char **filenames_ss, uint32 *num_filenames_p);
+
+
+
+const char * const BlastDatabaseWarmer :: BDW_REPORT_FILENAME_S = "database_residency.json";
+
+/* 64k pages is 256 Mb with 4 Kb pages */
+const size_t BlastDatabaseWarmer :: BDW_PAGES_PER_WINDOW = 65536;
+
+
+BlastDatabaseWarmer *BlastDatabaseWarmer :: Create (const BlastServiceData *data_p, uint64 budget, uint32 interval_s)
+{
+	BlastDatabaseWarmer *warmer_p = 0;
+
+	try
+		{
+			warmer_p = new BlastDatabaseWarmer (data_p, budget, interval_s);
+
+			#if BLAST_DATABASE_WARMER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Started warming " UINT32_FMT " databases with a budget of " UINT64_FMT " bytes", warmer_p -> bdw_num_databases, budget);
+			#endif
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastDatabaseWarmer");
+		}
+
+	return warmer_p;
+}
+
+
+BlastDatabaseWarmer :: BlastDatabaseWarmer (const BlastServiceData *data_p, uint64 budget, uint32 interval_s)
+	: bdw_databases_p (0),
+		bdw_num_databases (0),
+		bdw_type (data_p -> bsd_type),
+		bdw_budget (budget),
+		bdw_interval_s (interval_s),
+		bdw_stop_flag (false)
+{
+	const DatabaseInfo *db_p = data_p -> bsd_databases_p;
+	uint32 num_active_databases = 0;
+
+	if (db_p)
+		{
+			while (db_p -> di_filename_s)
+				{
+					if (db_p -> di_active_flag)
+						{
+							++ num_active_databases;
+						}
+
+					++ db_p;
+				}
+		}
+
+	if (num_active_databases > 0)
+		{
+			bdw_databases_p = (WarmedDatabase *) AllocMemoryArray (num_active_databases, sizeof (WarmedDatabase));
+
+			if (!bdw_databases_p)
+				{
+					throw std :: bad_alloc ();
+				}
+
+			/* Insert the databases in order of priority, keeping the configured order for equal priorities */
+			for (db_p = data_p -> bsd_databases_p; db_p -> di_filename_s; ++ db_p)
+				{
+					if (db_p -> di_active_flag)
+						{
+							WarmedDatabase *warmed_db_p = bdw_databases_p + bdw_num_databases;
+
+							while ((warmed_db_p > bdw_databases_p) && ((warmed_db_p - 1) -> wd_priority > db_p -> di_warm_priority))
+								{
+									*warmed_db_p = * (warmed_db_p - 1);
+									-- warmed_db_p;
+								}
+
+							warmed_db_p -> wd_name_s = db_p -> di_name_s;
+							warmed_db_p -> wd_filename_s = db_p -> di_filename_s;
+							warmed_db_p -> wd_priority = db_p -> di_warm_priority;
+							warmed_db_p -> wd_size = 0;
+							warmed_db_p -> wd_resident_size = 0;
+							warmed_db_p -> wd_checked_flag = false;
+							warmed_db_p -> wd_warmed_flag = false;
+
+							++ bdw_num_databases;
+						}
+				}
+		}
+
+	bdw_report_filename_s = ConcatenateStrings (data_p -> bsd_working_dir_s, BDW_REPORT_FILENAME_S);
+
+	if (!bdw_report_filename_s)
+		{
+			FreeMemory (bdw_databases_p);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_mutex_init (&bdw_mutex, NULL) != 0)
+		{
+			FreeCopiedString (bdw_report_filename_s);
+			FreeMemory (bdw_databases_p);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&bdw_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&bdw_mutex);
+			FreeCopiedString (bdw_report_filename_s);
+			FreeMemory (bdw_databases_p);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_create (&bdw_thread, NULL, RunWarmerThread, this) != 0)
+		{
+			pthread_cond_destroy (&bdw_cond);
+			pthread_mutex_destroy (&bdw_mutex);
+			FreeCopiedString (bdw_report_filename_s);
+			FreeMemory (bdw_databases_p);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastDatabaseWarmer :: ~BlastDatabaseWarmer ()
+{
+	pthread_mutex_lock (&bdw_mutex);
+	bdw_stop_flag = true;
+	pthread_cond_broadcast (&bdw_cond);
+	pthread_mutex_unlock (&bdw_mutex);
+
+	pthread_join (bdw_thread, NULL);
+
+	pthread_cond_destroy (&bdw_cond);
+	pthread_mutex_destroy (&bdw_mutex);
+	FreeCopiedString (bdw_report_filename_s);
+
+	if (bdw_databases_p)
+		{
+			FreeMemory (bdw_databases_p);
+		}
+}
+
+
+double BlastDatabaseWarmer :: GetResidency (const char *db_filename_s)
+{
+	double residency = -1.0;
+	uint32 i;
+	const WarmedDatabase *db_p = bdw_databases_p;
+
+	pthread_mutex_lock (&bdw_mutex);
+
+	for (i = 0; i < bdw_num_databases; ++ i, ++ db_p)
+		{
+			if (strcmp (db_p -> wd_filename_s, db_filename_s) == 0)
+				{
+					if ((db_p -> wd_checked_flag) && (db_p -> wd_size > 0))
+						{
+							residency = ((double) (db_p -> wd_resident_size)) / ((double) (db_p -> wd_size));
+						}
+
+					i = bdw_num_databases;
+				}
+		}
+
+	pthread_mutex_unlock (&bdw_mutex);
+
+	return residency;
+}
+
+
+json_t *BlastDatabaseWarmer :: GetResidencyAsJSON ()
+{
+	json_t *databases_p = json_array ();
+
+	if (databases_p)
+		{
+			uint32 i;
+			const WarmedDatabase *db_p = bdw_databases_p;
+			bool success_flag = true;
+
+			pthread_mutex_lock (&bdw_mutex);
+
+			for (i = 0; (i < bdw_num_databases) && success_flag; ++ i, ++ db_p)
+				{
+					if (db_p -> wd_checked_flag)
+						{
+							json_t *db_json_p = json_pack ("{s:s, s:s, s:I, s:I, s:b}",
+																						 "name", db_p -> wd_name_s,
+																						 "filename", db_p -> wd_filename_s,
+																						 "size", (json_int_t) (db_p -> wd_size),
+																						 "resident_size", (json_int_t) (db_p -> wd_resident_size),
+																						 "warmed", db_p -> wd_warmed_flag);
+
+							if (db_json_p)
+								{
+									if (json_array_append_new (databases_p, db_json_p) != 0)
+										{
+											json_decref (db_json_p);
+											success_flag = false;
+										}
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+				}
+
+			pthread_mutex_unlock (&bdw_mutex);
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get the residency of the databases as JSON");
+					json_decref (databases_p);
+					databases_p = NULL;
+				}
+		}
+
+	return databases_p;
+}
+
+
+void *BlastDatabaseWarmer :: RunWarmerThread (void *data_p)
+{
+	BlastDatabaseWarmer *warmer_p = static_cast <BlastDatabaseWarmer *> (data_p);
+
+	warmer_p -> Run ();
+
+	return NULL;
+}
+
+
+void BlastDatabaseWarmer :: Run ()
+{
+	do
+		{
+			uint64 remaining_budget = bdw_budget;
+			uint32 i;
+
+			for (i = 0; (i < bdw_num_databases) && (!IsStopping ()); ++ i)
+				{
+					CheckDatabase (bdw_databases_p + i, &remaining_budget);
+				}
+
+			if (!IsStopping ())
+				{
+					if (!WriteReport ())
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write database residency report to \"%s\"", bdw_report_filename_s);
+						}
+				}
+		}
+	while (WaitForNextCheck ());
+}
+
+
+bool BlastDatabaseWarmer :: WaitForNextCheck ()
+{
+	bool continue_flag = false;
+
+	if (bdw_interval_s > 0)
+		{
+			struct timespec deadline;
+			int res = 0;
+
+			clock_gettime (CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += bdw_interval_s;
+
+			pthread_mutex_lock (&bdw_mutex);
+
+			while ((!bdw_stop_flag) && (res != ETIMEDOUT))
+				{
+					res = pthread_cond_timedwait (&bdw_cond, &bdw_mutex, &deadline);
+				}
+
+			continue_flag = !bdw_stop_flag;
+
+			pthread_mutex_unlock (&bdw_mutex);
+		}
+
+	return continue_flag;
+}
+
+
+bool BlastDatabaseWarmer :: IsStopping ()
+{
+	bool stop_flag;
+
+	pthread_mutex_lock (&bdw_mutex);
+	stop_flag = bdw_stop_flag;
+	pthread_mutex_unlock (&bdw_mutex);
+
+	return stop_flag;
+}
+
+
+/*
+ * A database is only warmed if all of it fits in what is left of the budget,
+ * since Blast reads the whole of each volume during a search. Databases that
+ * don't fit are still checked so that their residency can be reported.
+ */
+void BlastDatabaseWarmer :: CheckDatabase (WarmedDatabase *db_p, uint64 *remaining_budget_p)
+{
+	char *filenames_ss [BDW_MAX_DATABASE_FILES];
+	const uint32 num_filenames = GetDatabaseFilenames (db_p -> wd_filename_s, bdw_type, filenames_ss);
+	uint64 size = 0;
+	uint64 resident_size = 0;
+	bool warm_flag;
+	uint32 i;
+
+	for (i = 0; i < num_filenames; ++ i)
+		{
+			size += GetBlastFileSize (* (filenames_ss + i));
+		}
+
+	warm_flag = ((size > 0) && (size <= *remaining_budget_p));
+
+	if (warm_flag)
+		{
+			*remaining_budget_p -= size;
+		}
+	else
+		{
+			#if BLAST_DATABASE_WARMER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Not warming \"%s\" of " UINT64_FMT " bytes with " UINT64_FMT " bytes left of the budget", db_p -> wd_filename_s, size, *remaining_budget_p);
+			#endif
+		}
+
+	/* Recount the size from the files that were actually checked */
+	size = 0;
+
+	for (i = 0; i < num_filenames; ++ i)
+		{
+			uint64 file_size = 0;
+			uint64 file_resident_size = 0;
+
+			if (!IsStopping ())
+				{
+					if (CheckFile (* (filenames_ss + i), warm_flag, &file_size, &file_resident_size))
+						{
+							size += file_size;
+							resident_size += file_resident_size;
+						}
+				}
+
+			FreeCopiedString (* (filenames_ss + i));
+		}
+
+	pthread_mutex_lock (&bdw_mutex);
+
+	db_p -> wd_size = size;
+	db_p -> wd_resident_size = resident_size;
+	db_p -> wd_warmed_flag = warm_flag;
+	db_p -> wd_checked_flag = true;
+
+	pthread_mutex_unlock (&bdw_mutex);
+
+	#if BLAST_DATABASE_WARMER_DEBUG >= STM_LEVEL_FINER
+	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "\"%s\" has " UINT64_FMT " of " UINT64_FMT " bytes in the page cache", db_p -> wd_filename_s, resident_size, size);
+	#endif
+}
+
+
+/*
+ * Map the file and use mincore to see which of its pages are in the page
+ * cache. If the file is being warmed, any pages that aren't are read in.
+ * This is done a window at a time so that the warmer can be stopped
+ * quickly and to limit the size of the residency vector.
+ */
+bool BlastDatabaseWarmer :: CheckFile (const char *filename_s, const bool warm_flag, uint64 *size_p, uint64 *resident_size_p)
+{
+	bool success_flag = false;
+	int fd = open (filename_s, O_RDONLY);
+
+	*size_p = 0;
+	*resident_size_p = 0;
+
+	if (fd >= 0)
+		{
+			struct stat st;
+
+			if ((fstat (fd, &st) == 0) && (st.st_size > 0))
+				{
+					const size_t length = (size_t) st.st_size;
+					void *map_p = mmap (NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+
+					if (map_p != MAP_FAILED)
+						{
+							unsigned char *residency_p = (unsigned char *) AllocMemory (BDW_PAGES_PER_WINDOW);
+
+							if (residency_p)
+								{
+									const size_t page_size = (size_t) sysconf (_SC_PAGESIZE);
+									const size_t num_pages = (length + page_size - 1) / page_size;
+									size_t first_page = 0;
+									uint64 num_resident_pages = 0;
+
+									success_flag = true;
+
+									while ((first_page < num_pages) && success_flag && (!IsStopping ()))
+										{
+											const size_t window_pages = (num_pages - first_page < BDW_PAGES_PER_WINDOW) ? (num_pages - first_page) : BDW_PAGES_PER_WINDOW;
+											const size_t window_offset = first_page * page_size;
+											const size_t window_length = (length - window_offset < window_pages * page_size) ? (length - window_offset) : (window_pages * page_size);
+											const char *window_p = ((const char *) map_p) + window_offset;
+
+											if (mincore ((void *) window_p, window_length, residency_p) == 0)
+												{
+													bool advised_flag = false;
+													size_t i;
+
+													for (i = 0; i < window_pages; ++ i)
+														{
+															if (* (residency_p + i) & 1)
+																{
+																	++ num_resident_pages;
+																}
+															else if (warm_flag)
+																{
+																	/* Start the read ahead for the whole window before touching the first missing page */
+																	if (!advised_flag)
+																		{
+																			madvise ((void *) window_p, window_length, MADV_WILLNEED);
+																			advised_flag = true;
+																		}
+
+																	/* Reading a byte of the page is enough to fault it in */
+																	(void) * ((volatile const char *) (window_p + (i * page_size)));
+
+																	++ num_resident_pages;
+																}
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "mincore failed for \"%s\", %s", filename_s, strerror (errno));
+													success_flag = false;
+												}
+
+											first_page += window_pages;
+										}		/* while ((first_page < num_pages) && success_flag && (!IsStopping ())) */
+
+									if (success_flag)
+										{
+											*size_p = length;
+											*resident_size_p = num_resident_pages * page_size;
+
+											/* The last page is only partly used */
+											if (*resident_size_p > length)
+												{
+													*resident_size_p = length;
+												}
+										}
+
+									FreeMemory (residency_p);
+								}		/* if (residency_p) */
+
+							munmap (map_p, length);
+						}		/* if (map_p != MAP_FAILED) */
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to map \"%s\", %s", filename_s, strerror (errno));
+						}
+				}
+
+			close (fd);
+		}		/* if (fd >= 0) */
+
+	return success_flag;
+}
+
+
+bool BlastDatabaseWarmer :: WriteReport ()
+{
+	bool success_flag = false;
+	json_t *databases_p = GetResidencyAsJSON ();
+
+	if (databases_p)
+		{
+			json_t *report_p = json_object ();
+
+			if (report_p)
+				{
+					if (json_object_set_new (report_p, "databases", databases_p) == 0)
+						{
+							success_flag = (json_dump_file (report_p, bdw_report_filename_s, JSON_INDENT (2)) == 0);
+						}
+
+					json_decref (report_p);
+				}
+			else
+				{
+					json_decref (databases_p);
+				}
+		}
+
+	return success_flag;
+}
+
+
+
+/*
+ * Get the sequence and index files of the database, using the same
+ * volume naming as GetBlastDatabaseSize.
+ */
+static uint32 GetDatabaseFilenames (const char *db_s, const DatabaseType db_type, char **filenames_ss)
+{
+	const char *nucleotide_suffixes_ss [] = { "nsq", "nin", NULL };
+	const char *protein_suffixes_ss [] = { "psq", "pin", NULL };
+	const char **suffix_ss = (db_type == DT_PROTEIN) ? protein_suffixes_ss : nucleotide_suffixes_ss;
+	uint32 num_filenames = 0;
+
+	while (*suffix_ss)
+		{
+			char *filename_s = ConcatenateVarargsStrings (db_s, ".", *suffix_ss, NULL);
+
+			if (!AddDatabaseFilename (filename_s, filenames_ss, &num_filenames))
+				{
+					uint32 i;
+					bool loop_flag = true;
+
+					for (i = 0; (i < 100) && loop_flag; ++ i)
+						{
+							char volume_s [8];
+
+							sprintf (volume_s, "%02u", (unsigned int) i);
+
+							filename_s = ConcatenateVarargsStrings (db_s, ".", volume_s, ".", *suffix_ss, NULL);
+							loop_flag = AddDatabaseFilename (filename_s, filenames_ss, &num_filenames);
+						}
+				}
+
+			++ suffix_ss;
+		}
+
+	return num_filenames;
+}
+
+
+static bool AddDatabaseFilename (char *filename_s, char **filenames_ss, uint32 *num_filenames_p)
+{
+	bool added_flag = false;
+
+	if (filename_s)
+		{
+			if ((*num_filenames_p < BDW_MAX_DATABASE_FILES) && (GetBlastFileSize (filename_s) > 0))
+				{
+					* (filenames_ss + *num_filenames_p) = filename_s;
+					++ (*num_filenames_p);
+					added_flag = true;
+				}
+			else
+				{
+					FreeCopiedString (filename_s);
+				}
+		}
+
+	return added_flag;
+}
@@ -0,0 +1,858 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_file_compression.cpp
+ *
+ *  Created on: 26 Oct 2026
+ *      Author: billy
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef ZSTD_ENABLED
+#include <zstd.h>
+#endif
+
+#include "blast_file_compression.hpp"
+#include "blast_result_buffer.hpp"
+#include "blast_service.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_FILE_COMPRESSION_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_FILE_COMPRESSION_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+#ifdef ZSTD_ENABLED
+
+/*
+ * The uncompressed size of each frame. Smaller frames make reading
+ * ranges cheaper at the cost of a slightly worse compression ratio.
+ */
+static const size_t S_FRAME_SIZE = 1 << 20;
+
+/* The magic number of the skippable frame that holds the seek table */
+static const uint32 S_SKIPPABLE_MAGIC = 0x184D2A5E;
+
+/* The magic number at the very end of a seekable file */
+static const uint32 S_SEEKABLE_MAGIC = 0x8F92EAB1;
+
+/* The number of frames, the descriptor and the seekable magic number */
+static const size_t S_SEEK_TABLE_FOOTER_SIZE = 9;
+
+/* The size of the skippable frame header */
+static const size_t S_SKIPPABLE_HEADER_SIZE = 8;
+
+/* Set in the descriptor if each seek table entry has a checksum */
+static const unsigned char S_CHECKSUM_FLAG = 0x80;
+
+
+/*
+ * The frames of a seekable file, with the
+ * offsets of each one within the file and
+ * within the uncompressed data.
+ */
+typedef struct SeekTable
+{
+	uint32 st_num_frames;
+
+	uint64 *st_compressed_offsets_p;
+
+	uint64 *st_decompressed_offsets_p;
+} SeekTable;
+
+
+static bool WriteSeekableFile (const char *data_s, const size_t length, FILE *out_f, const int level);
+
+static bool ReadSeekTable (const unsigned char *data_p, const size_t length, SeekTable *table_p);
+
+static void ClearSeekTable (SeekTable *table_p);
+
+static bool DecompressFrames (const unsigned char *data_p, const SeekTable *table_p, const uint32 first_frame, const uint32 last_frame, char *output_s);
+
+static char *DecompressStream (const unsigned char *data_p, const size_t length, size_t *decompressed_length_p);
+
+static void PutLittleEndian32 (unsigned char *buffer_p, const uint32 value);
+
+static uint32 GetLittleEndian32 (const unsigned char *buffer_p);
+
+#endif		/* #ifdef ZSTD_ENABLED */
+
+
+static BlastResultBuffer *ReadCompressedBlastFile (const char *compressed_filename_s, const uint64 offset, const size_t length, uint64 *total_length_p);
+
+
+
+bool IsBlastFileCompressionAvailable (void)
+{
+	#ifdef ZSTD_ENABLED
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+
+char *GetCompressedBlastFilename (const char *filename_s)
+{
+	return ConcatenateStrings (filename_s, BS_COMPRESSED_SUFFIX_S);
+}
+
+
+bool DoesBlastFileExist (const char *filename_s)
+{
+	uint64 size;
+
+	return GetStoredBlastFileSize (filename_s, &size);
+}
+
+
+bool GetStoredBlastFileSize (const char *filename_s, uint64 *size_p)
+{
+	bool exists_flag = false;
+	struct stat st;
+
+	if (stat (filename_s, &st) == 0)
+		{
+			*size_p = (uint64) st.st_size;
+			exists_flag = true;
+		}
+	else
+		{
+			char *compressed_filename_s = GetCompressedBlastFilename (filename_s);
+
+			if (compressed_filename_s)
+				{
+					if (stat (compressed_filename_s, &st) == 0)
+						{
+							*size_p = (uint64) st.st_size;
+							exists_flag = true;
+						}
+
+					FreeCopiedString (compressed_filename_s);
+				}
+		}
+
+	return exists_flag;
+}
+
+
+bool RemoveBlastFile (const char *filename_s)
+{
+	bool success_flag = ((unlink (filename_s) == 0) || (errno == ENOENT));
+	char *compressed_filename_s = GetCompressedBlastFilename (filename_s);
+
+	if (compressed_filename_s)
+		{
+			if ((unlink (compressed_filename_s) != 0) && (errno != ENOENT))
+				{
+					success_flag = false;
+				}
+
+			FreeCopiedString (compressed_filename_s);
+		}
+	else
+		{
+			success_flag = false;
+		}
+
+	return success_flag;
+}
+
+
+BlastResultBuffer *ReadBlastFile (const char *filename_s)
+{
+	BlastResultBuffer *buffer_p = NULL;
+
+	if (access (filename_s, F_OK) == 0)
+		{
+			buffer_p = BlastResultBuffer :: MapFile (filename_s);
+		}
+	else
+		{
+			char *compressed_filename_s = GetCompressedBlastFilename (filename_s);
+
+			if (compressed_filename_s)
+				{
+					if (access (compressed_filename_s, F_OK) == 0)
+						{
+							buffer_p = ReadCompressedBlastFile (compressed_filename_s, 0, 0, NULL);
+						}
+
+					FreeCopiedString (compressed_filename_s);
+				}
+		}
+
+	return buffer_p;
+}
+
+
+BlastResultBuffer *ReadBlastFileRange (const char *filename_s, const uint64 offset, const size_t length, uint64 *total_length_p)
+{
+	BlastResultBuffer *buffer_p = NULL;
+
+	if (access (filename_s, F_OK) == 0)
+		{
+			FILE *in_f = fopen (filename_s, "rb");
+
+			if (in_f)
+				{
+					struct stat st;
+
+					if (fstat (fileno (in_f), &st) == 0)
+						{
+							const uint64 total_length = (uint64) st.st_size;
+							const size_t range_length = (offset < total_length) ? (((total_length - offset) < length) ? (size_t) (total_length - offset) : length) : 0;
+							char *range_s = (char *) AllocMemory (range_length + 1);
+
+							if (range_s)
+								{
+									if ((range_length == 0) || ((fseeko (in_f, (off_t) offset, SEEK_SET) == 0) && (fread (range_s, 1, range_length, in_f) == range_length)))
+										{
+											* (range_s + range_length) = '\0';
+											buffer_p = BlastResultBuffer :: AdoptData (range_s, range_length);
+
+											if (buffer_p && total_length_p)
+												{
+													*total_length_p = total_length;
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read " SIZET_FMT " bytes from \"%s\" at " UINT64_FMT, range_length, filename_s, offset);
+										}
+
+									if (!buffer_p)
+										{
+											FreeMemory (range_s);
+										}
+								}
+						}
+
+					fclose (in_f);
+				}		/* if (in_f) */
+		}
+	else
+		{
+			char *compressed_filename_s = GetCompressedBlastFilename (filename_s);
+
+			if (compressed_filename_s)
+				{
+					if (access (compressed_filename_s, F_OK) == 0)
+						{
+							/* A length of 0 means the whole file to ReadCompressedBlastFile */
+							if (length > 0)
+								{
+									buffer_p = ReadCompressedBlastFile (compressed_filename_s, offset, length, total_length_p);
+								}
+							else
+								{
+									char *empty_s = EasyCopyToNewString ("");
+
+									if (empty_s)
+										{
+											buffer_p = BlastResultBuffer :: AdoptData (empty_s, 0);
+
+											if (!buffer_p)
+												{
+													FreeCopiedString (empty_s);
+												}
+										}
+								}
+						}
+
+					FreeCopiedString (compressed_filename_s);
+				}
+		}
+
+	return buffer_p;
+}
+
+
+bool GetUncompressedBlastFile (const char *filename_s, char **temp_filename_ss)
+{
+	bool success_flag = false;
+
+	*temp_filename_ss = NULL;
+
+	if (access (filename_s, F_OK) == 0)
+		{
+			success_flag = true;
+		}
+	else
+		{
+			BlastResultBuffer *buffer_p = ReadBlastFile (filename_s);
+
+			if (buffer_p)
+				{
+					char *temp_filename_s = ConcatenateStrings (filename_s, ".XXXXXX");
+
+					if (temp_filename_s)
+						{
+							int fd = mkstemp (temp_filename_s);
+
+							if (fd >= 0)
+								{
+									FILE *out_f = fdopen (fd, "wb");
+
+									if (out_f)
+										{
+											if (fwrite (buffer_p -> GetData (), 1, buffer_p -> GetLength (), out_f) == buffer_p -> GetLength ())
+												{
+													success_flag = true;
+												}
+
+											if (fclose (out_f) != 0)
+												{
+													success_flag = false;
+												}
+										}
+									else
+										{
+											close (fd);
+										}
+
+									if (success_flag)
+										{
+											*temp_filename_ss = temp_filename_s;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write uncompressed copy of \"%s\" to \"%s\"", filename_s, temp_filename_s);
+											unlink (temp_filename_s);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create temporary file \"%s\", %s", temp_filename_s, strerror (errno));
+								}
+
+							if (!success_flag)
+								{
+									FreeCopiedString (temp_filename_s);
+								}
+						}
+
+					delete buffer_p;
+				}
+		}
+
+	return success_flag;
+}
+
+
+#ifdef ZSTD_ENABLED
+
+bool CompressBlastFile (const char *filename_s, const int level)
+{
+	bool success_flag = false;
+
+	/* There's nothing to do if the file has gone or has already been compressed */
+	if (access (filename_s, F_OK) == 0)
+		{
+			char *compressed_filename_s = GetCompressedBlastFilename (filename_s);
+
+			if (compressed_filename_s)
+				{
+					char *temp_filename_s = ConcatenateStrings (compressed_filename_s, ".XXXXXX");
+
+					if (temp_filename_s)
+						{
+							BlastResultBuffer *buffer_p = BlastResultBuffer :: MapFile (filename_s);
+
+							if (buffer_p)
+								{
+									/* Write to a temporary file so that readers never see a partial file */
+									int fd = mkstemp (temp_filename_s);
+
+									if (fd >= 0)
+										{
+											FILE *out_f = fdopen (fd, "wb");
+
+											if (out_f)
+												{
+													success_flag = WriteSeekableFile (buffer_p -> GetData (), buffer_p -> GetLength (), out_f, level);
+
+													if (fclose (out_f) != 0)
+														{
+															success_flag = false;
+														}
+												}
+											else
+												{
+													close (fd);
+												}
+
+											if (success_flag)
+												{
+													if (rename (temp_filename_s, compressed_filename_s) == 0)
+														{
+															#if BLAST_FILE_COMPRESSION_DEBUG >= STM_LEVEL_FINE
+															uint64 compressed_size = 0;
+
+															GetStoredBlastFileSize (compressed_filename_s, &compressed_size);
+															PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Compressed \"%s\" from " SIZET_FMT " to " UINT64_FMT " bytes", filename_s, buffer_p -> GetLength (), compressed_size);
+															#endif
+
+															/* Anything that still has the original open or mapped can carry on using it */
+															if (unlink (filename_s) != 0)
+																{
+																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove \"%s\" after compressing it, %s", filename_s, strerror (errno));
+																}
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to rename \"%s\" to \"%s\", %s", temp_filename_s, compressed_filename_s, strerror (errno));
+															success_flag = false;
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to compress \"%s\"", filename_s);
+												}
+
+											if (!success_flag)
+												{
+													unlink (temp_filename_s);
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create temporary file \"%s\", %s", temp_filename_s, strerror (errno));
+										}
+
+									delete buffer_p;
+								}		/* if (buffer_p) */
+
+							FreeCopiedString (temp_filename_s);
+						}		/* if (temp_filename_s) */
+
+					FreeCopiedString (compressed_filename_s);
+				}		/* if (compressed_filename_s) */
+
+		}		/* if (access (filename_s, F_OK) == 0) */
+
+	return success_flag;
+}
+
+
+/*
+ * Read the whole of a compressed file if length is 0, otherwise
+ * just the frames that cover the given range.
+ */
+static BlastResultBuffer *ReadCompressedBlastFile (const char *compressed_filename_s, const uint64 offset, const size_t length, uint64 *total_length_p)
+{
+	BlastResultBuffer *result_p = NULL;
+	BlastResultBuffer *compressed_p = BlastResultBuffer :: MapFile (compressed_filename_s);
+
+	if (compressed_p)
+		{
+			const unsigned char *data_p = (const unsigned char *) (compressed_p -> GetData ());
+			SeekTable table;
+
+			if (ReadSeekTable (data_p, compressed_p -> GetLength (), &table))
+				{
+					const uint64 total_length = * (table.st_decompressed_offsets_p + table.st_num_frames);
+					const uint64 start = (offset < total_length) ? offset : total_length;
+					const uint64 end = ((length == 0) || (total_length - start < length)) ? total_length : (start + length);
+					uint32 first_frame = 0;
+					uint32 last_frame;
+					char *output_s;
+
+					/* Find the frames that hold the range */
+					while ((first_frame < table.st_num_frames) && (* (table.st_decompressed_offsets_p + first_frame + 1) <= start))
+						{
+							++ first_frame;
+						}
+
+					last_frame = first_frame;
+
+					while ((last_frame < table.st_num_frames) && (* (table.st_decompressed_offsets_p + last_frame) < end))
+						{
+							++ last_frame;
+						}
+
+					output_s = (char *) AllocMemory ((size_t) (* (table.st_decompressed_offsets_p + last_frame) - * (table.st_decompressed_offsets_p + first_frame)) + 1);
+
+					if (output_s)
+						{
+							if (DecompressFrames (data_p, &table, first_frame, last_frame, output_s))
+								{
+									const size_t skip = (size_t) (start - * (table.st_decompressed_offsets_p + first_frame));
+									const size_t range_length = (size_t) (end - start);
+
+									if (skip > 0)
+										{
+											memmove (output_s, output_s + skip, range_length);
+										}
+
+									* (output_s + range_length) = '\0';
+
+									result_p = BlastResultBuffer :: AdoptData (output_s, range_length);
+
+									if (result_p && total_length_p)
+										{
+											*total_length_p = total_length;
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to decompress \"%s\"", compressed_filename_s);
+								}
+
+							if (!result_p)
+								{
+									FreeMemory (output_s);
+								}
+						}
+
+					ClearSeekTable (&table);
+				}		/* if (ReadSeekTable (data_p, compressed_p -> GetLength (), &table)) */
+			else
+				{
+					/* It was compressed by something else so it has to be read from the start */
+					size_t total_length = 0;
+					char *output_s = DecompressStream (data_p, compressed_p -> GetLength (), &total_length);
+
+					if (output_s)
+						{
+							const size_t start = (offset < total_length) ? (size_t) offset : total_length;
+							const size_t range_length = ((length == 0) || (total_length - start < length)) ? (total_length - start) : length;
+
+							if (start > 0)
+								{
+									memmove (output_s, output_s + start, range_length);
+								}
+
+							* (output_s + range_length) = '\0';
+
+							result_p = BlastResultBuffer :: AdoptData (output_s, range_length);
+
+							if (result_p)
+								{
+									if (total_length_p)
+										{
+											*total_length_p = (uint64) total_length;
+										}
+								}
+							else
+								{
+									FreeMemory (output_s);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to decompress \"%s\"", compressed_filename_s);
+						}
+				}
+
+			delete compressed_p;
+		}		/* if (compressed_p) */
+
+	return result_p;
+}
+
+
+static bool WriteSeekableFile (const char *data_s, const size_t length, FILE *out_f, const int level)
+{
+	bool success_flag = false;
+	const uint32 num_frames = (uint32) ((length + S_FRAME_SIZE - 1) / S_FRAME_SIZE);
+	const size_t table_size = S_SKIPPABLE_HEADER_SIZE + (num_frames * 8) + S_SEEK_TABLE_FOOTER_SIZE;
+	unsigned char *table_p = (unsigned char *) AllocMemory (table_size);
+
+	if (table_p)
+		{
+			const size_t bound = ZSTD_compressBound (S_FRAME_SIZE);
+			void *frame_p = AllocMemory (bound);
+
+			if (frame_p)
+				{
+					ZSTD_CCtx *context_p = ZSTD_createCCtx ();
+
+					if (context_p)
+						{
+							unsigned char *entry_p = table_p + S_SKIPPABLE_HEADER_SIZE;
+							uint32 i;
+
+							success_flag = true;
+
+							for (i = 0; (i < num_frames) && success_flag; ++ i)
+								{
+									const size_t frame_start = i * S_FRAME_SIZE;
+									const size_t frame_length = (length - frame_start < S_FRAME_SIZE) ? (length - frame_start) : S_FRAME_SIZE;
+									const size_t compressed_length = ZSTD_compressCCtx (context_p, frame_p, bound, data_s + frame_start, frame_length, level);
+
+									if (!ZSTD_isError (compressed_length))
+										{
+											if (fwrite (frame_p, 1, compressed_length, out_f) == compressed_length)
+												{
+													PutLittleEndian32 (entry_p, (uint32) compressed_length);
+													PutLittleEndian32 (entry_p + 4, (uint32) frame_length);
+													entry_p += 8;
+												}
+											else
+												{
+													success_flag = false;
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "ZSTD_compressCCtx failed: %s", ZSTD_getErrorName (compressed_length));
+											success_flag = false;
+										}
+								}
+
+							if (success_flag)
+								{
+									PutLittleEndian32 (table_p, S_SKIPPABLE_MAGIC);
+									PutLittleEndian32 (table_p + 4, (uint32) (table_size - S_SKIPPABLE_HEADER_SIZE));
+
+									PutLittleEndian32 (entry_p, num_frames);
+									* (entry_p + 4) = 0;
+									PutLittleEndian32 (entry_p + 5, S_SEEKABLE_MAGIC);
+
+									success_flag = (fwrite (table_p, 1, table_size, out_f) == table_size);
+								}
+
+							ZSTD_freeCCtx (context_p);
+						}		/* if (context_p) */
+
+					FreeMemory (frame_p);
+				}		/* if (frame_p) */
+
+			FreeMemory (table_p);
+		}		/* if (table_p) */
+
+	return success_flag;
+}
+
+
+static bool ReadSeekTable (const unsigned char *data_p, const size_t length, SeekTable *table_p)
+{
+	if (length >= S_SKIPPABLE_HEADER_SIZE + S_SEEK_TABLE_FOOTER_SIZE)
+		{
+			const unsigned char *footer_p = data_p + length - S_SEEK_TABLE_FOOTER_SIZE;
+
+			if (GetLittleEndian32 (footer_p + 5) == S_SEEKABLE_MAGIC)
+				{
+					const uint32 num_frames = GetLittleEndian32 (footer_p);
+					const size_t entry_size = (* (footer_p + 4) & S_CHECKSUM_FLAG) ? 12 : 8;
+					const uint64 table_size = S_SKIPPABLE_HEADER_SIZE + ((uint64) num_frames * entry_size) + S_SEEK_TABLE_FOOTER_SIZE;
+
+					if (table_size <= length)
+						{
+							const unsigned char *entry_p = data_p + length - table_size + S_SKIPPABLE_HEADER_SIZE;
+
+							table_p -> st_num_frames = num_frames;
+							table_p -> st_compressed_offsets_p = (uint64 *) AllocMemory ((num_frames + 1) * sizeof (uint64));
+							table_p -> st_decompressed_offsets_p = (uint64 *) AllocMemory ((num_frames + 1) * sizeof (uint64));
+
+							if ((table_p -> st_compressed_offsets_p) && (table_p -> st_decompressed_offsets_p))
+								{
+									uint32 i;
+
+									* (table_p -> st_compressed_offsets_p) = 0;
+									* (table_p -> st_decompressed_offsets_p) = 0;
+
+									for (i = 0; i < num_frames; ++ i, entry_p += entry_size)
+										{
+											* (table_p -> st_compressed_offsets_p + i + 1) = * (table_p -> st_compressed_offsets_p + i) + GetLittleEndian32 (entry_p);
+											* (table_p -> st_decompressed_offsets_p + i + 1) = * (table_p -> st_decompressed_offsets_p + i) + GetLittleEndian32 (entry_p + 4);
+										}
+
+									/* The frames must fit in front of the seek table */
+									if (* (table_p -> st_compressed_offsets_p + num_frames) == length - table_size)
+										{
+											return true;
+										}
+
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Seek table doesn't match the file's size");
+								}
+
+							ClearSeekTable (table_p);
+						}
+				}
+		}
+
+	return false;
+}
+
+
+static void ClearSeekTable (SeekTable *table_p)
+{
+	if (table_p -> st_compressed_offsets_p)
+		{
+			FreeMemory (table_p -> st_compressed_offsets_p);
+			table_p -> st_compressed_offsets_p = NULL;
+		}
+
+	if (table_p -> st_decompressed_offsets_p)
+		{
+			FreeMemory (table_p -> st_decompressed_offsets_p);
+			table_p -> st_decompressed_offsets_p = NULL;
+		}
+
+	table_p -> st_num_frames = 0;
+}
+
+
+static bool DecompressFrames (const unsigned char *data_p, const SeekTable *table_p, const uint32 first_frame, const uint32 last_frame, char *output_s)
+{
+	bool success_flag = true;
+	ZSTD_DCtx *context_p = ZSTD_createDCtx ();
+
+	if (context_p)
+		{
+			uint32 i;
+
+			for (i = first_frame; (i < last_frame) && success_flag; ++ i)
+				{
+					const uint64 compressed_start = * (table_p -> st_compressed_offsets_p + i);
+					const size_t compressed_length = (size_t) (* (table_p -> st_compressed_offsets_p + i + 1) - compressed_start);
+					const size_t frame_length = (size_t) (* (table_p -> st_decompressed_offsets_p + i + 1) - * (table_p -> st_decompressed_offsets_p + i));
+					const size_t res = ZSTD_decompressDCtx (context_p, output_s, frame_length, data_p + compressed_start, compressed_length);
+
+					if ((!ZSTD_isError (res)) && (res == frame_length))
+						{
+							output_s += frame_length;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to decompress frame " UINT32_FMT ": %s", i, ZSTD_isError (res) ? ZSTD_getErrorName (res) : "wrong size");
+							success_flag = false;
+						}
+				}
+
+			ZSTD_freeDCtx (context_p);
+		}
+	else
+		{
+			success_flag = false;
+		}
+
+	return success_flag;
+}
+
+
+static char *DecompressStream (const unsigned char *data_p, const size_t length, size_t *decompressed_length_p)
+{
+	char *output_s = NULL;
+	ZSTD_DStream *stream_p = ZSTD_createDStream ();
+
+	if (stream_p)
+		{
+			size_t capacity = (length * 4) + ZSTD_DStreamOutSize ();
+
+			output_s = (char *) AllocMemory (capacity + 1);
+
+			if (output_s)
+				{
+					ZSTD_inBuffer in = { data_p, length, 0 };
+					ZSTD_outBuffer out = { output_s, capacity, 0 };
+					bool success_flag = true;
+
+					ZSTD_initDStream (stream_p);
+
+					while (success_flag && (in.pos < in.size))
+						{
+							const size_t res = ZSTD_decompressStream (stream_p, &out, &in);
+
+							if (ZSTD_isError (res))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "ZSTD_decompressStream failed: %s", ZSTD_getErrorName (res));
+									success_flag = false;
+								}
+							else if (out.pos == out.size)
+								{
+									/* Make room for more */
+									char *larger_s = (char *) ReallocMemory (output_s, (capacity * 2) + 1, capacity + 1);
+
+									if (larger_s)
+										{
+											output_s = larger_s;
+											capacity *= 2;
+											out.dst = output_s;
+											out.size = capacity;
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+						}
+
+					if (success_flag)
+						{
+							*decompressed_length_p = out.pos;
+						}
+					else
+						{
+							FreeMemory (output_s);
+							output_s = NULL;
+						}
+				}
+
+			ZSTD_freeDStream (stream_p);
+		}
+
+	return output_s;
+}
+
+
+static void PutLittleEndian32 (unsigned char *buffer_p, const uint32 value)
+{
+	*buffer_p = (unsigned char) (value & 0xFF);
+	* (buffer_p + 1) = (unsigned char) ((value >> 8) & 0xFF);
+	* (buffer_p + 2) = (unsigned char) ((value >> 16) & 0xFF);
+	* (buffer_p + 3) = (unsigned char) ((value >> 24) & 0xFF);
+}
+
+
+static uint32 GetLittleEndian32 (const unsigned char *buffer_p)
+{
+	return ((uint32) *buffer_p) | (((uint32) * (buffer_p + 1)) << 8) | (((uint32) * (buffer_p + 2)) << 16) | (((uint32) * (buffer_p + 3)) << 24);
+}
+
+
+#else		/* #ifdef ZSTD_ENABLED */
+
+
+bool CompressBlastFile (const char *filename_s, const int UNUSED_PARAM (level))
+{
+	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Can't compress \"%s\" as the Blast service was built without zstd", filename_s);
+	return false;
+}
+
+
+static BlastResultBuffer *ReadCompressedBlastFile (const char *compressed_filename_s, const uint64 UNUSED_PARAM (offset), const size_t UNUSED_PARAM (length), uint64 * UNUSED_PARAM (total_length_p))
+{
+	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Can't read \"%s\" as the Blast service was built without zstd", compressed_filename_s);
+	return NULL;
+}
+
+
+#endif		/* #ifdef ZSTD_ENABLED */
@@ -25,13 +25,21 @@
 
 #include <new>
 
+#include <stdio.h>
+#include <unistd.h>
+
 #include "byte_buffer.h"
 #include "string_utils.h"
 #include "streams.h"
 #include "math_utils.h"
 #include "blast_service_params.h"
 #include "blast_util.h"
+#include "blast_process.h"
+#include "strings_args_processor.hpp"
+#include "memory_allocations.h"
 #include "blast_service.h"
+#include "blast_result_buffer.hpp"
+#include "blast_file_compression.hpp"
 
 
 
@@ -47,14 +55,39 @@ BlastFormatter :: ~BlastFormatter ()
 
 
 
-char *BlastFormatter :: GetConvertedOutputFilename (const char * const filename_s, const uint32 output_format_code)
+char *BlastFormatter :: GetConvertedOutputFilename (const char * const filename_s, const uint32 output_format_code, const char *custom_format_s)
 {
 	char *output_filename_s = NULL;
 	char *output_format_code_s = ConvertUnsignedIntegerToString (output_format_code);
 
 	if (output_format_code_s)
 		{
-			output_filename_s = ConcatenateVarargsStrings (filename_s, ".", output_format_code_s, NULL);
+			if (custom_format_s && (*custom_format_s != '\0') && (IsCustomisableOutputFormat (output_format_code)))
+				{
+					/*
+					 * Add a hash of the columns, so that outputs with different
+					 * columns don't overwrite each other.
+					 */
+					uint32 hash = 2166136261U;
+					const char *c_p = custom_format_s;
+					char hash_s [9];
+
+					while (*c_p)
+						{
+							hash ^= (uint32) ((unsigned char) *c_p);
+							hash *= 16777619U;
+							++ c_p;
+						}
+
+					snprintf (hash_s, sizeof (hash_s), "%08x", hash);
+
+					output_filename_s = ConcatenateVarargsStrings (filename_s, ".", output_format_code_s, ".", hash_s, NULL);
+				}
+			else
+				{
+					output_filename_s = ConcatenateVarargsStrings (filename_s, ".", output_format_code_s, NULL);
+				}
+
 			FreeCopiedString (output_format_code_s);
 		}
 
@@ -68,6 +101,17 @@ bool BlastFormatter :: IsCustomisableOutputFormat (const uint32 output_format_co
 }
 
 
+uint32 BlastFormatter :: GetArchiveOutputFormat () const
+{
+	return BS_DEFAULT_OUTPUT_FORMAT;
+}
+
+
+BlastResultBuffer *BlastFormatter :: GetArchiveOutput (const char *job_output_filename_s)
+{
+	return ReadBlastFile (job_output_filename_s);
+}
+
 
 SystemBlastFormatter *SystemBlastFormatter :: Create (const json_t *config_p)
 {
@@ -152,15 +196,24 @@ char *SystemBlastFormatter :: GetConvertedOutput (const char *job_id_s, const ui
 
 	if (sbf_blast_formatter_command_s)
 		{
-			ByteBuffer *buffer_p = AllocateByteBuffer (1024);
+			StringsArgsProcessor *args_processor_p = 0;
+
+			try
+				{
+					args_processor_p = new StringsArgsProcessor ();
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate StringsArgsProcessor");
+				}
 
-			if (buffer_p)
+			if (args_processor_p)
 				{
 					char *input_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, BS_OUTPUT_SUFFIX_S);
 
 					if (input_filename_s)
 						{
-							char *output_filename_s = BlastFormatter :: GetConvertedOutputFilename (input_filename_s, output_format_code);
+							char *output_filename_s = BlastFormatter :: GetConvertedOutputFilename (input_filename_s, output_format_code, custom_format_s);
 
 							if (output_filename_s)
 								{
@@ -172,53 +225,84 @@ char *SystemBlastFormatter :: GetConvertedOutput (const char *job_id_s, const ui
 
 											if (logfile_s)
 												{
-													if (AppendStringsToByteBuffer (buffer_p, sbf_blast_formatter_command_s, " -archive ", input_filename_s, " -outfmt \"", output_format_params_s, "\" -out ", output_filename_s, " >> ", logfile_s, " 2>&1", NULL))
+													char *uncompressed_filename_s = NULL;
+
+													/* blast_formatter can't read a compressed archive so it is given a temporary uncompressed copy */
+													if ((GetUncompressedBlastFile (input_filename_s, &uncompressed_filename_s)) &&
+															(args_processor_p -> AddArg (sbf_blast_formatter_command_s, false)) &&
+															(AddArgsPair ("archive", uncompressed_filename_s ? uncompressed_filename_s : input_filename_s, args_processor_p)) &&
+															(AddArgsPair ("outfmt", output_format_params_s, args_processor_p)) &&
+															(AddArgsPair ("out", output_filename_s, args_processor_p)))
 														{
-															const char *command_line_s = GetByteBufferData (buffer_p);
-															int res;
+															char **args_ss = args_processor_p -> GetArgsAsStrings ();
+															char *command_line_s = args_processor_p -> GetArgsAsString ();
 
-															if (!SaveCommandLine (input_filename_s, command_line_s))
+															if (args_ss && command_line_s)
 																{
-																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "SaveCommandLine failed for \"%s\" to file \"%s\"", command_line_s, input_filename_s);
-
-																}
+																	BlastProcessResult process_result;
 
-															res = system (command_line_s);
+																	if (!SaveCommandLine (input_filename_s, command_line_s))
+																		{
+																			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "SaveCommandLine failed for \"%s\" to file \"%s\"", command_line_s, input_filename_s);
 
-															if (res == 0)
-																{
-																	FILE *converted_output_f = fopen (output_filename_s, "r");
+																		}
 
-																	if (converted_output_f)
+																	if ((RunBlastProcess (args_ss, logfile_s, &process_result)) && (DidBlastProcessSucceed (&process_result)))
 																		{
-																			result_s = GetFileContentsAsString (converted_output_f);
+																			FILE *converted_output_f = fopen (output_filename_s, "r");
 
-																			if (!result_s)
+																			if (converted_output_f)
 																				{
-																					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get contents of \"%s\"", output_filename_s);
-																				}		/* if (!result_s) */
+																					result_s = GetFileContentsAsString (converted_output_f);
 
-																			if (fclose (converted_output_f) != 0)
+																					if (!result_s)
+																						{
+																							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get contents of \"%s\"", output_filename_s);
+																						}		/* if (!result_s) */
+
+																					if (fclose (converted_output_f) != 0)
+																						{
+																							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to close \"%s\"", output_filename_s);
+																						}
+
+																				}		/* if (converted_output_f) */
+																			else
 																				{
-																					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to close \"%s\"", output_filename_s);
+																					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\"", output_filename_s);
 																				}
 
-																		}		/* if (converted_output_f) */
+																		}		/* if ((RunBlastProcess (args_ss, logfile_s, &process_result)) && (DidBlastProcessSucceed (&process_result))) */
 																	else
 																		{
-																			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\"", output_filename_s);
+																			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run \"%s\"", command_line_s);
 																		}
 
-																}		/* if (res == 0) */
+																}		/* if (args_ss && command_line_s) */
 															else
 																{
-																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run \"%s\" with code %d", command_line_s, res);
+																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get command line for \"%s\"", input_filename_s);
+																}
+
+															if (command_line_s)
+																{
+																	FreeCopiedString (command_line_s);
+																}
+
+															if (args_ss)
+																{
+																	FreeMemory (args_ss);
 																}
 
-														}		/* if (AppendStringToByteBuffer (buffer_p, sbf_blast_formatter_command_s, " -archive ", input_filename_s, " -outfmt ", output_format_code_s, " -out ", output_filename_s, NULL)) */
+														}		/* if ((GetUncompressedBlastFile (input_filename_s, &uncompressed_filename_s)) && ... */
 													else
 														{
-															PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to build command line buffer for \"%s\"", input_filename_s);
+															PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to build command line arguments for \"%s\"", input_filename_s);
+														}
+
+													if (uncompressed_filename_s)
+														{
+															unlink (uncompressed_filename_s);
+															FreeCopiedString (uncompressed_filename_s);
 														}
 
 
@@ -251,14 +335,8 @@ char *SystemBlastFormatter :: GetConvertedOutput (const char *job_id_s, const ui
 							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get create input filename for job \"%s\"", job_id_s);
 						}
 
-
-
-					FreeByteBuffer (buffer_p);
-				}		/* if (buffer_p) */
-			else
-				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate ByteBuffer");
-				}
+					delete args_processor_p;
+				}		/* if (args_processor_p) */
 
 		}		/* if (sbf_blast_formatter_command_s) */
 	else
@@ -268,5 +346,3 @@ char *SystemBlastFormatter :: GetConvertedOutput (const char *job_id_s, const ui
 
 	return result_s;
 }
-
-
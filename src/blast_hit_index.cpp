@@ -0,0 +1,727 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_hit_index.cpp
+ *
+ *  Created on: 28 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "blast_hit_index.hpp"
+#include "blast_file_compression.hpp"
+#include "blast_result_buffer.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_HIT_INDEX_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_HIT_INDEX_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * In the single-file JSON format, each query's report is an
+ * object within the BlastOutput2 array of the top-level object.
+ */
+#define BHI_REPORT_DEPTH	(3)
+
+
+/* The key of the array of hits within each report */
+static const char S_HITS_KEY_S [] = "hits";
+
+/* The key of the array of reports in the top-level object */
+static const char S_REPORTS_KEY_S [] = "\"BlastOutput2\"";
+
+/* How far into an output to look for S_REPORTS_KEY_S */
+static const size_t S_REPORTS_KEY_SEARCH_LENGTH = 64;
+
+/* Changed whenever the layout of the index changes */
+static const char S_INDEX_MAGIC_S [8] = { 'B', 'S', 'H', 'I', 'T', 'S', '0', '1' };
+
+
+/*
+ * The index starts with this, followed by an array of
+ * BlastHitIndexReports and then an array of BlastHitIndexHits.
+ * All of the offsets are into the uncompressed output.
+ */
+typedef struct BlastHitIndexHeader
+{
+	char bhih_magic [8];
+
+	/* The length of the output that was indexed */
+	uint64 bhih_results_length;
+
+	uint64 bhih_num_reports;
+
+	uint64 bhih_num_hits;
+} BlastHitIndexHeader;
+
+
+typedef struct BlastHitIndexReport
+{
+	/* The opening brace of the report */
+	uint64 bhir_start;
+
+	/* Just after the closing brace of the report */
+	uint64 bhir_end;
+
+	/*
+	 * Just after the opening bracket and at the closing bracket
+	 * of the report's hits array. These are both 0 if the report
+	 * doesn't have one.
+	 */
+	uint64 bhir_hits_start;
+
+	uint64 bhir_hits_end;
+
+	/* The index of the report's first hit in the array of hits */
+	uint64 bhir_first_hit;
+
+	uint64 bhir_num_hits;
+} BlastHitIndexReport;
+
+
+typedef struct BlastHitIndexHit
+{
+	/* The opening brace of the hit */
+	uint64 bhit_start;
+
+	/* Just after the closing brace of the hit */
+	uint64 bhit_end;
+} BlastHitIndexHit;
+
+
+
+bool BlastHitIndex :: IsIndexable (const char *results_filename_s)
+{
+	bool indexable_flag = false;
+	BlastResultBuffer *start_p = ReadBlastFileRange (results_filename_s, 0, S_REPORTS_KEY_SEARCH_LENGTH, NULL);
+
+	if (start_p)
+		{
+			/* This distinguishes it from the other json formats such as Seqalign */
+			indexable_flag = (strstr (start_p -> GetData (), S_REPORTS_KEY_S) != NULL);
+			delete start_p;
+		}
+
+	return indexable_flag;
+}
+
+
+bool BlastHitIndex :: WriteIndex (const char *results_filename_s, const char *index_filename_s)
+{
+	bool success_flag = false;
+	BlastResultBuffer *results_p = ReadBlastFile (results_filename_s);
+
+	if (results_p)
+		{
+			BlastResultBuffer *index_p = ScanResults (results_p -> GetData (), results_p -> GetLength ());
+
+			if (index_p)
+				{
+					char *temp_filename_s = ConcatenateStrings (index_filename_s, ".XXXXXX");
+
+					if (temp_filename_s)
+						{
+							/* Write to a temporary file so that readers never see a partial index */
+							int fd = mkstemp (temp_filename_s);
+
+							if (fd >= 0)
+								{
+									FILE *out_f = fdopen (fd, "wb");
+
+									if (out_f)
+										{
+											success_flag = (fwrite (index_p -> GetData (), 1, index_p -> GetLength (), out_f) == index_p -> GetLength ());
+
+											if (fclose (out_f) != 0)
+												{
+													success_flag = false;
+												}
+										}
+									else
+										{
+											close (fd);
+										}
+
+									if (success_flag)
+										{
+											if (rename (temp_filename_s, index_filename_s) == 0)
+												{
+													#if BLAST_HIT_INDEX_DEBUG >= STM_LEVEL_FINE
+													const BlastHitIndexHeader *header_p = (const BlastHitIndexHeader *) (index_p -> GetData ());
+													PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Indexed " UINT64_FMT " hits in " UINT64_FMT " reports of \"%s\"", header_p -> bhih_num_hits, header_p -> bhih_num_reports, results_filename_s);
+													#endif
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to rename \"%s\" to \"%s\", %s", temp_filename_s, index_filename_s, strerror (errno));
+													success_flag = false;
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write hit index \"%s\"", temp_filename_s);
+										}
+
+									if (!success_flag)
+										{
+											unlink (temp_filename_s);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create temporary file \"%s\", %s", temp_filename_s, strerror (errno));
+								}
+
+							FreeCopiedString (temp_filename_s);
+						}		/* if (temp_filename_s) */
+
+					delete index_p;
+				}		/* if (index_p) */
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to index hits of \"%s\"", results_filename_s);
+				}
+
+			delete results_p;
+		}		/* if (results_p) */
+
+	return success_flag;
+}
+
+
+BlastHitIndex *BlastHitIndex :: OpenIndex (const char *results_filename_s, const char *index_filename_s)
+{
+	BlastHitIndex *hit_index_p = 0;
+
+	if (access (index_filename_s, F_OK) == 0)
+		{
+			BlastResultBuffer *index_p = BlastResultBuffer :: MapFile (index_filename_s);
+
+			if (index_p)
+				{
+					uint64 results_length = 0;
+
+					/* Reading the start of the output gets its current length */
+					BlastResultBuffer *start_p = ReadBlastFileRange (results_filename_s, 0, 1, &results_length);
+
+					if (start_p)
+						{
+							if ((start_p -> GetLength () == 1) && (* (start_p -> GetData ()) == '{') && IsValidIndex (index_p, results_length))
+								{
+									char *copied_filename_s = EasyCopyToNewString (results_filename_s);
+
+									if (copied_filename_s)
+										{
+											hit_index_p = Create (index_p, copied_filename_s, 0);
+
+											if (!hit_index_p)
+												{
+													FreeCopiedString (copied_filename_s);
+												}
+										}
+								}
+							else
+								{
+									#if BLAST_HIT_INDEX_DEBUG >= STM_LEVEL_FINE
+									PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Hit index \"%s\" doesn't match \"%s\"", index_filename_s, results_filename_s);
+									#endif
+								}
+
+							delete start_p;
+						}		/* if (start_p) */
+
+					if (!hit_index_p)
+						{
+							delete index_p;
+						}
+
+				}		/* if (index_p) */
+
+		}		/* if (access (index_filename_s, F_OK) == 0) */
+
+	return hit_index_p;
+}
+
+
+BlastHitIndex *BlastHitIndex :: IndexBuffer (BlastResultBuffer *results_p)
+{
+	BlastHitIndex *hit_index_p = 0;
+	BlastResultBuffer *index_p = ScanResults (results_p -> GetData (), results_p -> GetLength ());
+
+	if (index_p)
+		{
+			hit_index_p = Create (index_p, 0, results_p);
+
+			if (!hit_index_p)
+				{
+					delete index_p;
+				}
+		}
+
+	return hit_index_p;
+}
+
+
+BlastHitIndex *BlastHitIndex :: Create (BlastResultBuffer *index_p, char *results_filename_s, BlastResultBuffer *results_p)
+{
+	BlastHitIndex *hit_index_p = 0;
+
+	try
+		{
+			hit_index_p = new BlastHitIndex (index_p, results_filename_s, results_p);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate BlastHitIndex");
+		}
+
+	return hit_index_p;
+}
+
+
+BlastHitIndex :: BlastHitIndex (BlastResultBuffer *index_p, char *results_filename_s, BlastResultBuffer *results_p)
+	: bhi_index_p (index_p),
+		bhi_header_p (0),
+		bhi_reports_p (0),
+		bhi_hits_p (0),
+		bhi_results_filename_s (results_filename_s),
+		bhi_results_p (results_p)
+{
+	bhi_header_p = (const BlastHitIndexHeader *) (index_p -> GetData ());
+	bhi_reports_p = (const BlastHitIndexReport *) (bhi_header_p + 1);
+	bhi_hits_p = (const BlastHitIndexHit *) (bhi_reports_p + bhi_header_p -> bhih_num_reports);
+}
+
+
+BlastHitIndex :: ~BlastHitIndex ()
+{
+	delete bhi_index_p;
+
+	if (bhi_results_filename_s)
+		{
+			FreeCopiedString (bhi_results_filename_s);
+		}
+
+	if (bhi_results_p)
+		{
+			delete bhi_results_p;
+		}
+}
+
+
+uint64 BlastHitIndex :: GetNumReports () const
+{
+	return bhi_header_p -> bhih_num_reports;
+}
+
+
+uint64 BlastHitIndex :: GetNumHits (const uint64 report_index) const
+{
+	uint64 num_hits = 0;
+
+	if (report_index == 0)
+		{
+			num_hits = bhi_header_p -> bhih_num_hits;
+		}
+	else if (report_index <= bhi_header_p -> bhih_num_reports)
+		{
+			num_hits = (bhi_reports_p + (report_index - 1)) -> bhir_num_hits;
+		}
+
+	return num_hits;
+}
+
+
+BlastResultBuffer *BlastHitIndex :: GetPage (const uint64 report_index, const uint64 hits_offset, const uint64 hits_limit, uint64 *num_hits_p) const
+{
+	BlastResultBuffer *page_p = NULL;
+	ByteBuffer *buffer_p = AllocateByteBuffer (4096);
+
+	if (buffer_p)
+		{
+			bool success_flag = AppendStringsToByteBuffer (buffer_p, "{", S_REPORTS_KEY_S, ": [", NULL);
+			uint64 num_hits = 0;
+
+			if (report_index == 0)
+				{
+					/* The hits of all of the reports are numbered in the order that they are in the output */
+					const uint64 total_hits = bhi_header_p -> bhih_num_hits;
+					const uint64 page_start = (hits_offset < total_hits) ? hits_offset : total_hits;
+					const uint64 page_end = ((hits_limit == 0) || ((total_hits - page_start) < hits_limit)) ? total_hits : page_start + hits_limit;
+					const BlastHitIndexReport *report_p = bhi_reports_p;
+					const BlastHitIndexReport *end_report_p = bhi_reports_p + bhi_header_p -> bhih_num_reports;
+					bool first_flag = true;
+
+					while (success_flag && (report_p < end_report_p))
+						{
+							const uint64 first_hit = report_p -> bhir_first_hit;
+							const uint64 end_hit = first_hit + report_p -> bhir_num_hits;
+
+							if ((first_hit < page_end) && (end_hit > page_start))
+								{
+									if (first_flag)
+										{
+											first_flag = false;
+										}
+									else
+										{
+											success_flag = AppendStringToByteBuffer (buffer_p, ", ");
+										}
+
+									if (success_flag)
+										{
+											success_flag = AppendReport (buffer_p, report_p, (first_hit > page_start) ? first_hit : page_start, (end_hit < page_end) ? end_hit : page_end);
+										}
+								}
+
+							++ report_p;
+						}
+
+					num_hits = page_end - page_start;
+				}		/* if (report_index == 0) */
+			else if (report_index <= bhi_header_p -> bhih_num_reports)
+				{
+					/* The report is always included so that its query details are available even if the page is empty */
+					const BlastHitIndexReport *report_p = bhi_reports_p + (report_index - 1);
+					const uint64 total_hits = report_p -> bhir_num_hits;
+					const uint64 page_start = (hits_offset < total_hits) ? hits_offset : total_hits;
+					const uint64 page_end = ((hits_limit == 0) || ((total_hits - page_start) < hits_limit)) ? total_hits : page_start + hits_limit;
+
+					success_flag = AppendReport (buffer_p, report_p, report_p -> bhir_first_hit + page_start, report_p -> bhir_first_hit + page_end);
+					num_hits = page_end - page_start;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Report " UINT64_FMT " is out of range, there are only " UINT64_FMT, report_index, bhi_header_p -> bhih_num_reports);
+					success_flag = false;
+				}
+
+			if (success_flag)
+				{
+					if (AppendStringToByteBuffer (buffer_p, "]}"))
+						{
+							const size_t length = buffer_p -> bb_current_index;
+							char *page_s = DetachByteBufferData (buffer_p);
+
+							buffer_p = NULL;
+
+							if (page_s)
+								{
+									page_p = BlastResultBuffer :: AdoptData (page_s, length);
+
+									if (page_p)
+										{
+											if (num_hits_p)
+												{
+													*num_hits_p = num_hits;
+												}
+										}
+									else
+										{
+											FreeCopiedString (page_s);
+										}
+								}
+						}
+				}
+
+			if (buffer_p)
+				{
+					FreeByteBuffer (buffer_p);
+				}
+		}		/* if (buffer_p) */
+
+	return page_p;
+}
+
+
+/*
+ * Add a report with only the hits from first_hit up to, but not
+ * including, end_hit.
+ */
+bool BlastHitIndex :: AppendReport (ByteBuffer *buffer_p, const BlastHitIndexReport *report_p, const uint64 first_hit, const uint64 end_hit) const
+{
+	bool success_flag = false;
+
+	if (report_p -> bhir_hits_start > 0)
+		{
+			if (AppendRange (buffer_p, report_p -> bhir_start, report_p -> bhir_hits_start))
+				{
+					/* The hits are next to each other so the commas between them come along too */
+					if ((first_hit == end_hit) || AppendRange (buffer_p, (bhi_hits_p + first_hit) -> bhit_start, (bhi_hits_p + (end_hit - 1)) -> bhit_end))
+						{
+							success_flag = AppendRange (buffer_p, report_p -> bhir_hits_end, report_p -> bhir_end);
+						}
+				}
+		}
+	else
+		{
+			success_flag = AppendRange (buffer_p, report_p -> bhir_start, report_p -> bhir_end);
+		}
+
+	return success_flag;
+}
+
+
+bool BlastHitIndex :: AppendRange (ByteBuffer *buffer_p, const uint64 start, const uint64 end) const
+{
+	bool success_flag = false;
+
+	if ((start <= end) && (end <= bhi_header_p -> bhih_results_length))
+		{
+			if (bhi_results_p)
+				{
+					success_flag = AppendToByteBuffer (buffer_p, bhi_results_p -> GetData () + start, (size_t) (end - start));
+				}
+			else
+				{
+					BlastResultBuffer *range_p = ReadBlastFileRange (bhi_results_filename_s, start, (size_t) (end - start), NULL);
+
+					if (range_p)
+						{
+							if (range_p -> GetLength () == (size_t) (end - start))
+								{
+									success_flag = AppendToByteBuffer (buffer_p, range_p -> GetData (), range_p -> GetLength ());
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Only read " SIZET_FMT " of " UINT64_FMT " bytes from \"%s\" at " UINT64_FMT, range_p -> GetLength (), end - start, bhi_results_filename_s, start);
+								}
+
+							delete range_p;
+						}
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid range " UINT64_FMT " to " UINT64_FMT " in hit index", start, end);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Scan through the json output keeping track of how deeply nested
+ * it is, in the same way as the BlastResultStreamer does, noting
+ * where each report and each entry in its hits array starts and ends.
+ */
+BlastResultBuffer *BlastHitIndex :: ScanResults (const char *data_s, const size_t length)
+{
+	BlastResultBuffer *index_p = NULL;
+	ByteBuffer *reports_buffer_p = AllocateByteBuffer (1024);
+
+	if (reports_buffer_p)
+		{
+			ByteBuffer *hits_buffer_p = AllocateByteBuffer (16384);
+
+			if (hits_buffer_p)
+				{
+					bool success_flag = true;
+					BlastHitIndexHeader header;
+					BlastHitIndexReport report;
+					BlastHitIndexHit hit;
+					bool in_report_flag = false;
+					bool in_string_flag = false;
+					bool escape_flag = false;
+					uint32 depth = 0;
+
+					/* The depth of the current report's hits array or 0 if we're not in it */
+					uint32 hits_depth = 0;
+
+					/* The last string that was closed, which is the key when a value is opened */
+					const char *string_s = NULL;
+					const char *last_string_s = NULL;
+					size_t last_string_length = 0;
+					size_t i;
+
+					memset (&header, 0, sizeof (header));
+					memset (&report, 0, sizeof (report));
+					memset (&hit, 0, sizeof (hit));
+
+					for (i = 0; (i < length) && success_flag; ++ i)
+						{
+							const char c = * (data_s + i);
+
+							if (in_string_flag)
+								{
+									if (escape_flag)
+										{
+											escape_flag = false;
+										}
+									else if (c == '\\')
+										{
+											escape_flag = true;
+										}
+									else if (c == '"')
+										{
+											in_string_flag = false;
+											last_string_s = string_s + 1;
+											last_string_length = (data_s + i) - last_string_s;
+										}
+								}
+							else if (c == '"')
+								{
+									in_string_flag = true;
+									string_s = data_s + i;
+								}
+							else if ((c == '{') || (c == '['))
+								{
+									++ depth;
+
+									if (depth == BHI_REPORT_DEPTH)
+										{
+											memset (&report, 0, sizeof (report));
+											report.bhir_start = i;
+											report.bhir_first_hit = header.bhih_num_hits;
+											in_report_flag = true;
+										}
+									else if (in_report_flag && (c == '[') && (hits_depth == 0) && (report.bhir_hits_start == 0) &&
+										(last_string_length == sizeof (S_HITS_KEY_S) - 1) && (strncmp (last_string_s, S_HITS_KEY_S, last_string_length) == 0))
+										{
+											/* The programs that the service runs only have one hits array per report */
+											hits_depth = depth;
+											report.bhir_hits_start = i + 1;
+										}
+									else if ((hits_depth > 0) && (depth == hits_depth + 1) && (c == '{'))
+										{
+											hit.bhit_start = i;
+										}
+								}
+							else if ((c == '}') || (c == ']'))
+								{
+									if (hits_depth > 0)
+										{
+											if ((depth == hits_depth + 1) && (c == '}'))
+												{
+													hit.bhit_end = i + 1;
+
+													success_flag = AppendToByteBuffer (hits_buffer_p, &hit, sizeof (hit));
+													++ (header.bhih_num_hits);
+													++ (report.bhir_num_hits);
+												}
+											else if (depth == hits_depth)
+												{
+													report.bhir_hits_end = i;
+													hits_depth = 0;
+												}
+										}
+
+									if (in_report_flag && (depth == BHI_REPORT_DEPTH))
+										{
+											report.bhir_end = i + 1;
+
+											success_flag = AppendToByteBuffer (reports_buffer_p, &report, sizeof (report));
+											++ (header.bhih_num_reports);
+											in_report_flag = false;
+										}
+
+									if (depth > 0)
+										{
+											-- depth;
+										}
+								}
+						}		/* for (i = 0; (i < length) && success_flag; ++ i) */
+
+					if (success_flag)
+						{
+							if ((depth == 0) && (!in_report_flag) && (!in_string_flag))
+								{
+									const size_t index_length = sizeof (header) + reports_buffer_p -> bb_current_index + hits_buffer_p -> bb_current_index;
+									char *index_data_p = (char *) AllocMemory (index_length);
+
+									if (index_data_p)
+										{
+											memcpy (header.bhih_magic, S_INDEX_MAGIC_S, sizeof (header.bhih_magic));
+											header.bhih_results_length = length;
+
+											memcpy (index_data_p, &header, sizeof (header));
+											memcpy (index_data_p + sizeof (header), GetByteBufferData (reports_buffer_p), reports_buffer_p -> bb_current_index);
+											memcpy (index_data_p + sizeof (header) + reports_buffer_p -> bb_current_index, GetByteBufferData (hits_buffer_p), hits_buffer_p -> bb_current_index);
+
+											index_p = BlastResultBuffer :: AdoptData (index_data_p, index_length);
+
+											if (!index_p)
+												{
+													FreeMemory (index_data_p);
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " bytes for hit index", index_length);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Blast output of " SIZET_FMT " bytes is incomplete", length);
+								}
+						}
+
+					FreeByteBuffer (hits_buffer_p);
+				}		/* if (hits_buffer_p) */
+
+			FreeByteBuffer (reports_buffer_p);
+		}		/* if (reports_buffer_p) */
+
+	return index_p;
+}
+
+
+bool BlastHitIndex :: IsValidIndex (const BlastResultBuffer *index_p, const uint64 results_length)
+{
+	bool valid_flag = false;
+	const size_t index_length = index_p -> GetLength ();
+
+	if (index_length >= sizeof (BlastHitIndexHeader))
+		{
+			const BlastHitIndexHeader *header_p = (const BlastHitIndexHeader *) (index_p -> GetData ());
+
+			if ((memcmp (header_p -> bhih_magic, S_INDEX_MAGIC_S, sizeof (header_p -> bhih_magic)) == 0) && (header_p -> bhih_results_length == results_length))
+				{
+					const uint64 entries_length = index_length - sizeof (BlastHitIndexHeader);
+
+					/* Check the counts before multiplying them so that a corrupt index can't overflow */
+					if ((header_p -> bhih_num_reports <= entries_length / sizeof (BlastHitIndexReport)) && (header_p -> bhih_num_hits <= entries_length / sizeof (BlastHitIndexHit)) &&
+						(header_p -> bhih_num_reports * sizeof (BlastHitIndexReport) + header_p -> bhih_num_hits * sizeof (BlastHitIndexHit) == entries_length))
+						{
+							const BlastHitIndexReport *report_p = (const BlastHitIndexReport *) (header_p + 1);
+							uint64 i;
+
+							valid_flag = true;
+
+							for (i = header_p -> bhih_num_reports; (i > 0) && valid_flag; -- i, ++ report_p)
+								{
+									valid_flag = (report_p -> bhir_first_hit <= header_p -> bhih_num_hits) && (report_p -> bhir_num_hits <= header_p -> bhih_num_hits - report_p -> bhir_first_hit);
+								}
+						}
+				}
+		}
+
+	return valid_flag;
+}
@@ -0,0 +1,650 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_pre_converter.cpp
+ *
+ *  Created on: 27 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "blast_pre_converter.hpp"
+#include "blast_formatter.h"
+#include "blast_file_compression.hpp"
+#include "blast_service_job.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_PRE_CONVERTER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_PRE_CONVERTER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A finished job that is waiting to be converted or, if pcj_filename_s
+ * is set, a single file that is waiting to be compressed.
+ */
+typedef struct PreConversionJob
+{
+	char *pcj_job_id_s;
+
+	char *pcj_filename_s;
+
+	struct PreConversionJob *pcj_next_p;
+} PreConversionJob;
+
+
+static void FreePreConversionJob (PreConversionJob *job_p);
+
+
+
+const uint32 BlastPreConverter :: BPC_MAX_QUEUED_JOBS = 1024;
+
+const int BlastPreConverter :: BPC_NICENESS = 10;
+
+const char * const BlastPreConverter :: BPC_OVERFLOW_FILENAME_S = "pre_conversion_overflow.txt";
+
+
+
+BlastPreConverter *BlastPreConverter :: Create (const BlastServiceData *data_p, const uint32 *formats_p, const uint32 num_formats, const uint32 num_threads)
+{
+	BlastPreConverter *converter_p = 0;
+
+	try
+		{
+			converter_p = new BlastPreConverter (data_p, formats_p, num_formats, num_threads);
+
+			#if BLAST_PRE_CONVERTER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Started converting finished jobs into " UINT32_FMT " formats with " UINT32_FMT " threads", num_formats, num_threads);
+			#endif
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastPreConverter");
+		}
+
+	return converter_p;
+}
+
+
+BlastPreConverter :: BlastPreConverter (const BlastServiceData *data_p, const uint32 *formats_p, const uint32 num_formats, const uint32 num_threads)
+	: bpc_data_p (data_p),
+		bpc_formats_p (0),
+		bpc_num_formats (num_formats),
+		bpc_first_job_p (0),
+		bpc_last_job_p (0),
+		bpc_num_queued_jobs (0),
+		bpc_stop_flag (false),
+		bpc_overflow_filename_s (0),
+		bpc_overflow_flag (true),
+		bpc_threads_p (0),
+		bpc_num_threads (0)
+{
+	/* Any jobs left over from before the server restarted are picked up when the queue is first empty */
+	bpc_overflow_filename_s = MakeFilename (data_p -> bsd_working_dir_s, BPC_OVERFLOW_FILENAME_S);
+
+	if (!bpc_overflow_filename_s)
+		{
+			throw std :: bad_alloc ();
+		}
+
+	/* With no formats, the converter just indexes and compresses the jobs' files */
+	if (num_formats > 0)
+		{
+			bpc_formats_p = (uint32 *) AllocMemoryArray (num_formats, sizeof (uint32));
+
+			if (!bpc_formats_p)
+				{
+					FreeCopiedString (bpc_overflow_filename_s);
+					throw std :: bad_alloc ();
+				}
+
+			memcpy (bpc_formats_p, formats_p, num_formats * sizeof (uint32));
+		}
+
+	bpc_threads_p = (pthread_t *) AllocMemoryArray (num_threads, sizeof (pthread_t));
+
+	if (!bpc_threads_p)
+		{
+			FreeFormats ();
+			FreeCopiedString (bpc_overflow_filename_s);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_mutex_init (&bpc_mutex, NULL) != 0)
+		{
+			FreeMemory (bpc_threads_p);
+			FreeFormats ();
+			FreeCopiedString (bpc_overflow_filename_s);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&bpc_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&bpc_mutex);
+			FreeMemory (bpc_threads_p);
+			FreeFormats ();
+			FreeCopiedString (bpc_overflow_filename_s);
+			throw std :: bad_alloc ();
+		}
+
+	while (bpc_num_threads < num_threads)
+		{
+			if (pthread_create (bpc_threads_p + bpc_num_threads, NULL, RunConverterThread, this) == 0)
+				{
+					++ bpc_num_threads;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start BlastPreConverter thread " UINT32_FMT, bpc_num_threads);
+					break;
+				}
+		}
+
+	/* Fewer threads than asked for just means that the conversions take longer */
+	if (bpc_num_threads == 0)
+		{
+			pthread_cond_destroy (&bpc_cond);
+			pthread_mutex_destroy (&bpc_mutex);
+			FreeMemory (bpc_threads_p);
+			FreeFormats ();
+			FreeCopiedString (bpc_overflow_filename_s);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastPreConverter :: ~BlastPreConverter ()
+{
+	uint32 i;
+
+	pthread_mutex_lock (&bpc_mutex);
+	bpc_stop_flag = true;
+	pthread_cond_broadcast (&bpc_cond);
+	pthread_mutex_unlock (&bpc_mutex);
+
+	for (i = 0; i < bpc_num_threads; ++ i)
+		{
+			pthread_join (* (bpc_threads_p + i), NULL);
+		}
+
+	/*
+	 * Save any jobs that didn't get converted so that they are converted
+	 * after the server restarts. Any single files that were waiting are
+	 * just left uncompressed.
+	 */
+	if (bpc_first_job_p)
+		{
+			WriteOverflowJobs (bpc_first_job_p, NULL);
+		}
+
+	while (bpc_first_job_p)
+		{
+			PreConversionJob *next_p = bpc_first_job_p -> pcj_next_p;
+
+			FreePreConversionJob (bpc_first_job_p);
+			bpc_first_job_p = next_p;
+		}
+
+	pthread_cond_destroy (&bpc_cond);
+	pthread_mutex_destroy (&bpc_mutex);
+
+	FreeMemory (bpc_threads_p);
+	FreeFormats ();
+	FreeCopiedString (bpc_overflow_filename_s);
+}
+
+
+void BlastPreConverter :: FreeFormats ()
+{
+	if (bpc_formats_p)
+		{
+			FreeMemory (bpc_formats_p);
+			bpc_formats_p = 0;
+		}
+}
+
+
+bool BlastPreConverter :: AddJob (const char *job_id_s)
+{
+	bool success_flag = false;
+	PreConversionJob *job_p;
+
+	pthread_mutex_lock (&bpc_mutex);
+
+	/* A job's results can be determined more than once */
+	job_p = bpc_first_job_p;
+
+	while (job_p && ! ((job_p -> pcj_job_id_s) && (strcmp (job_p -> pcj_job_id_s, job_id_s) == 0)))
+		{
+			job_p = job_p -> pcj_next_p;
+		}
+
+	if (job_p)
+		{
+			success_flag = true;
+		}
+	else
+		{
+			if ((!bpc_stop_flag) && (bpc_num_queued_jobs < BPC_MAX_QUEUED_JOBS))
+				{
+					success_flag = AddToQueue (job_id_s, NULL);
+				}
+
+			/* Rather than leaving the job's files uncompressed, save it for later */
+			if (!success_flag)
+				{
+					success_flag = WriteOverflowJobs (NULL, job_id_s);
+
+					if (success_flag)
+						{
+							bpc_overflow_flag = true;
+
+							#if BLAST_PRE_CONVERTER_DEBUG >= STM_LEVEL_FINE
+							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Conversion queue has " UINT32_FMT " jobs, saved \"%s\" to convert later", bpc_num_queued_jobs, job_id_s);
+							#endif
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to queue \"%s\" for conversion", job_id_s);
+						}
+				}
+		}
+
+	pthread_mutex_unlock (&bpc_mutex);
+
+	return success_flag;
+}
+
+
+bool BlastPreConverter :: AddFileToCompress (const char *filename_s)
+{
+	bool success_flag = false;
+	PreConversionJob *job_p;
+
+	pthread_mutex_lock (&bpc_mutex);
+
+	job_p = bpc_first_job_p;
+
+	while (job_p && ! ((job_p -> pcj_filename_s) && (strcmp (job_p -> pcj_filename_s, filename_s) == 0)))
+		{
+			job_p = job_p -> pcj_next_p;
+		}
+
+	if (job_p)
+		{
+			success_flag = true;
+		}
+	else if (bpc_stop_flag)
+		{
+			#if BLAST_PRE_CONVERTER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "BlastPreConverter is stopping, not compressing \"%s\"", filename_s);
+			#endif
+		}
+	else if (bpc_num_queued_jobs < BPC_MAX_QUEUED_JOBS)
+		{
+			success_flag = AddToQueue (NULL, filename_s);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Conversion queue is full with " UINT32_FMT " jobs, not compressing \"%s\"", bpc_num_queued_jobs, filename_s);
+		}
+
+	pthread_mutex_unlock (&bpc_mutex);
+
+	return success_flag;
+}
+
+
+/* This must be called with bpc_mutex locked */
+bool BlastPreConverter :: AddToQueue (const char *job_id_s, const char *filename_s)
+{
+	bool success_flag = false;
+	PreConversionJob *job_p = (PreConversionJob *) AllocMemory (sizeof (PreConversionJob));
+
+	if (job_p)
+		{
+			job_p -> pcj_job_id_s = job_id_s ? EasyCopyToNewString (job_id_s) : NULL;
+			job_p -> pcj_filename_s = filename_s ? EasyCopyToNewString (filename_s) : NULL;
+
+			if ((job_p -> pcj_job_id_s) || (job_p -> pcj_filename_s))
+				{
+					job_p -> pcj_next_p = NULL;
+
+					if (bpc_last_job_p)
+						{
+							bpc_last_job_p -> pcj_next_p = job_p;
+						}
+					else
+						{
+							bpc_first_job_p = job_p;
+						}
+
+					bpc_last_job_p = job_p;
+					++ bpc_num_queued_jobs;
+
+					pthread_cond_signal (&bpc_cond);
+					success_flag = true;
+				}
+			else
+				{
+					FreeMemory (job_p);
+				}
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to queue \"%s\"", job_id_s ? job_id_s : filename_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Append the ids of the jobs in the given list, followed by job_id_s if
+ * it is set, to the overflow file. This must be called with bpc_mutex
+ * locked or once the threads have stopped.
+ */
+bool BlastPreConverter :: WriteOverflowJobs (const PreConversionJob *first_job_p, const char *job_id_s)
+{
+	bool success_flag = false;
+	FILE *overflow_f = fopen (bpc_overflow_filename_s, "a");
+
+	if (overflow_f)
+		{
+			const PreConversionJob *job_p = first_job_p;
+
+			success_flag = true;
+
+			while (job_p && success_flag)
+				{
+					if (job_p -> pcj_job_id_s)
+						{
+							success_flag = (fprintf (overflow_f, "%s\n", job_p -> pcj_job_id_s) > 0);
+						}
+
+					job_p = job_p -> pcj_next_p;
+				}
+
+			if (job_id_s && success_flag)
+				{
+					success_flag = (fprintf (overflow_f, "%s\n", job_id_s) > 0);
+				}
+
+			if (fclose (overflow_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to write to \"%s\", %s", bpc_overflow_filename_s, strerror (errno));
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Queue the jobs from the overflow file, writing back any that
+ * still don't fit. This must be called with bpc_mutex locked.
+ */
+void BlastPreConverter :: ReadOverflowJobs ()
+{
+	char *job_ids_s = GetFileContentsAsStringByFilename (bpc_overflow_filename_s);
+
+	bpc_overflow_flag = false;
+
+	if (job_ids_s)
+		{
+			if (unlink (bpc_overflow_filename_s) == 0)
+				{
+					char *job_id_s = job_ids_s;
+
+					while (*job_id_s)
+						{
+							char *end_s = strchr (job_id_s, '\n');
+
+							if (end_s)
+								{
+									*end_s = '\0';
+								}
+
+							if (*job_id_s)
+								{
+									if (! ((bpc_num_queued_jobs < BPC_MAX_QUEUED_JOBS) && (AddToQueue (job_id_s, NULL))))
+										{
+											if (WriteOverflowJobs (NULL, job_id_s))
+												{
+													bpc_overflow_flag = true;
+												}
+										}
+								}
+
+							job_id_s = end_s ? end_s + 1 : job_id_s + strlen (job_id_s);
+						}		/* while (*job_id_s) */
+
+					#if BLAST_PRE_CONVERTER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Queued " UINT32_FMT " jobs from \"%s\"", bpc_num_queued_jobs, bpc_overflow_filename_s);
+					#endif
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove \"%s\", %s", bpc_overflow_filename_s, strerror (errno));
+				}
+
+			FreeCopiedString (job_ids_s);
+		}		/* if (job_ids_s) */
+}
+
+
+void *BlastPreConverter :: RunConverterThread (void *data_p)
+{
+	BlastPreConverter *converter_p = static_cast <BlastPreConverter *> (data_p);
+
+	#ifdef __linux__
+	/*
+	 * On Linux, the nice value is per thread rather than per process,
+	 * and any blast_formatter processes that are spawned inherit it.
+	 */
+	if (setpriority (PRIO_PROCESS, (id_t) syscall (SYS_gettid), BPC_NICENESS) != 0)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to lower priority of BlastPreConverter thread, %s", strerror (errno));
+		}
+	#endif
+
+	converter_p -> Run ();
+
+	return NULL;
+}
+
+
+void BlastPreConverter :: Run ()
+{
+	PreConversionJob *job_p;
+
+	while ((job_p = GetNextJob ()) != NULL)
+		{
+			if (job_p -> pcj_filename_s)
+				{
+					CompressBlastFile (job_p -> pcj_filename_s, bpc_data_p -> bsd_compression_level);
+				}
+			else
+				{
+					ConvertJob (job_p -> pcj_job_id_s);
+				}
+
+			FreePreConversionJob (job_p);
+		}
+}
+
+
+PreConversionJob *BlastPreConverter :: GetNextJob ()
+{
+	PreConversionJob *job_p = NULL;
+
+	pthread_mutex_lock (&bpc_mutex);
+
+	while ((!bpc_stop_flag) && (!bpc_first_job_p))
+		{
+			/* Now that the queue is empty, take on any jobs that didn't fit before */
+			if (bpc_overflow_flag)
+				{
+					ReadOverflowJobs ();
+				}
+
+			if (!bpc_first_job_p)
+				{
+					pthread_cond_wait (&bpc_cond, &bpc_mutex);
+				}
+		}
+
+	if (!bpc_stop_flag)
+		{
+			job_p = bpc_first_job_p;
+			bpc_first_job_p = job_p -> pcj_next_p;
+
+			if (!bpc_first_job_p)
+				{
+					bpc_last_job_p = NULL;
+				}
+
+			-- bpc_num_queued_jobs;
+		}
+
+	pthread_mutex_unlock (&bpc_mutex);
+
+	return job_p;
+}
+
+
+bool BlastPreConverter :: IsStopping ()
+{
+	bool stop_flag;
+
+	pthread_mutex_lock (&bpc_mutex);
+	stop_flag = bpc_stop_flag;
+	pthread_mutex_unlock (&bpc_mutex);
+
+	return stop_flag;
+}
+
+
+void BlastPreConverter :: ConvertJob (const char *job_id_s)
+{
+	char *job_output_filename_s = GetPreviousJobFilename (bpc_data_p, job_id_s, BS_OUTPUT_SUFFIX_S);
+
+	if (job_output_filename_s)
+		{
+			BlastFormatter *formatter_p = bpc_data_p -> bsd_formatter_p;
+
+			if (formatter_p && DoesBlastFileExist (job_output_filename_s))
+				{
+					const uint32 archive_format = formatter_p -> GetArchiveOutputFormat ();
+					uint32 i;
+
+					for (i = 0; (i < bpc_num_formats) && (!IsStopping ()); ++ i)
+						{
+							const uint32 output_format_code = * (bpc_formats_p + i);
+
+							/* The job's own output is already in its archive format */
+							if (output_format_code != archive_format)
+								{
+									char *converted_filename_s = BlastFormatter :: GetConvertedOutputFilename (job_output_filename_s, output_format_code, NULL);
+
+									if (converted_filename_s)
+										{
+											if (!DoesBlastFileExist (converted_filename_s))
+												{
+													char *result_s = ConvertBlastResult (bpc_data_p, formatter_p, job_id_s, job_output_filename_s, output_format_code, NULL);
+
+													if (result_s)
+														{
+															#if BLAST_PRE_CONVERTER_DEBUG >= STM_LEVEL_FINER
+															PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Converted \"%s\" to " UINT32_FMT, job_id_s, output_format_code);
+															#endif
+
+															FreeCopiedString (result_s);
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to convert \"%s\" to " UINT32_FMT, job_id_s, output_format_code);
+														}
+												}
+											else if (bpc_data_p -> bsd_compression_level > 0)
+												{
+													/* It may have been converted for a request whose compression couldn't be queued */
+													CompressBlastFile (converted_filename_s, bpc_data_p -> bsd_compression_level);
+												}
+
+											FreeCopiedString (converted_filename_s);
+										}		/* if (converted_filename_s) */
+
+								}		/* if (output_format_code != archive_format) */
+
+						}		/* for (i = 0; (i < bpc_num_formats) && (!IsStopping ()); ++ i) */
+
+				}		/* if (formatter_p && DoesBlastFileExist (job_output_filename_s)) */
+
+			FreeCopiedString (job_output_filename_s);
+		}		/* if (job_output_filename_s) */
+
+	/* The single-file JSON output might only exist now that it has been converted */
+	if (!IsStopping ())
+		{
+			IndexBlastJobHits (bpc_data_p, job_id_s);
+		}
+
+	/* Compressing the output first would mean decompressing it for each conversion */
+	if (bpc_data_p -> bsd_compression_level > 0)
+		{
+			CompressBlastJobFiles (bpc_data_p, job_id_s);
+		}
+}
+
+
+static void FreePreConversionJob (PreConversionJob *job_p)
+{
+	if (job_p -> pcj_job_id_s)
+		{
+			FreeCopiedString (job_p -> pcj_job_id_s);
+		}
+
+	if (job_p -> pcj_filename_s)
+		{
+			FreeCopiedString (job_p -> pcj_filename_s);
+		}
+
+	FreeMemory (job_p);
+}
@@ -0,0 +1,547 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_process.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include "blast_process.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "memory_allocations.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_PROCESS_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_PROCESS_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+extern char **environ;
+
+
+static void ClearBlastProcessResult (BlastProcessResult *result_p);
+
+static void SetBlastProcessResult (pid_t pid, const int status, BlastProcessResult *result_p);
+
+static void RunPreparedBlastProcess (char * const *args_ss, const char *log_filename_s, const int go_fd, const int error_fd);
+
+static bool RedirectBlastProcessStream (const char *filename_s, const int flags, const int stream_fd);
+
+
+pid_t SpawnBlastProcess (char * const *args_ss, const char *log_filename_s)
+{
+	pid_t pid = -1;
+	posix_spawn_file_actions_t actions;
+	int res = posix_spawn_file_actions_init (&actions);
+
+	if (res == 0)
+		{
+			posix_spawnattr_t attrs;
+
+			res = posix_spawnattr_init (&attrs);
+
+			if (res == 0)
+				{
+					sigset_t signals;
+
+					/*
+					 * Run the child in its own process group, so that it and anything it
+					 * starts can be signalled together, and make sure that it doesn't
+					 * inherit any blocked signals from the server's threads.
+					 */
+					sigemptyset (&signals);
+
+					if (((res = posix_spawnattr_setflags (&attrs, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK)) == 0) &&
+							((res = posix_spawnattr_setpgroup (&attrs, 0)) == 0) &&
+							((res = posix_spawnattr_setsigmask (&attrs, &signals)) == 0) &&
+							((res = posix_spawn_file_actions_addopen (&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0)) == 0))
+						{
+							if (log_filename_s)
+								{
+									if ((res = posix_spawn_file_actions_addopen (&actions, STDOUT_FILENO, log_filename_s, O_WRONLY | O_CREAT | O_APPEND, 0644)) == 0)
+										{
+											res = posix_spawn_file_actions_adddup2 (&actions, STDOUT_FILENO, STDERR_FILENO);
+										}
+								}
+
+							if (res == 0)
+								{
+									res = posix_spawnp (&pid, *args_ss, &actions, &attrs, args_ss, environ);
+
+									if (res == 0)
+										{
+											#if BLAST_PROCESS_DEBUG >= STM_LEVEL_FINE
+											PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Launched \"%s\" as process %d", *args_ss, pid);
+											#endif
+										}
+									else
+										{
+											pid = -1;
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to launch \"%s\": %s", *args_ss, strerror (res));
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to redirect output of \"%s\" to \"%s\": %s", *args_ss, log_filename_s, strerror (res));
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set up process attributes for \"%s\": %s", *args_ss, strerror (res));
+						}
+
+					posix_spawnattr_destroy (&attrs);
+				}		/* if (res == 0) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "posix_spawnattr_init failed: %s", strerror (res));
+				}
+
+			posix_spawn_file_actions_destroy (&actions);
+		}		/* if (res == 0) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "posix_spawn_file_actions_init failed: %s", strerror (res));
+		}
+
+	return pid;
+}
+
+
+/*
+ * posix_spawn has no way to do anything in between fork and exec, so the
+ * child is forked and then waits on a pipe until the parent has set it up.
+ * A second pipe, which is closed when the child's exec succeeds, passes
+ * back the error if it fails.
+ */
+pid_t SpawnPreparedBlastProcess (char * const *args_ss, const char *log_filename_s, BlastProcessPrepareFn prepare_fn, void *data_p)
+{
+	pid_t pid = -1;
+	int go_fds [2];
+
+	if (pipe2 (go_fds, O_CLOEXEC) == 0)
+		{
+			int error_fds [2];
+
+			if (pipe2 (error_fds, O_CLOEXEC) == 0)
+				{
+					pid = fork ();
+
+					if (pid == 0)
+						{
+							RunPreparedBlastProcess (args_ss, log_filename_s, go_fds [0], error_fds [1]);
+						}
+					else if (pid > 0)
+						{
+							bool success_flag = false;
+
+							close (go_fds [0]);
+							close (error_fds [1]);
+
+							/* The child does this too, but make sure that it is in place whichever of us gets there first */
+							setpgid (pid, pid);
+
+							if (prepare_fn (pid, data_p))
+								{
+									const char go = 1;
+
+									if (write (go_fds [1], &go, 1) == 1)
+										{
+											int error = 0;
+											ssize_t res;
+
+											do
+												{
+													res = read (error_fds [0], &error, sizeof (error));
+												}
+											while ((res == -1) && (errno == EINTR));
+
+											if (res == 0)
+												{
+													success_flag = true;
+
+													#if BLAST_PROCESS_DEBUG >= STM_LEVEL_FINE
+													PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Launched \"%s\" as prepared process %d", *args_ss, pid);
+													#endif
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to launch \"%s\": %s", *args_ss, strerror ((res == sizeof (error)) ? error : errno));
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to start prepared process %d for \"%s\": %s", pid, *args_ss, strerror (errno));
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to prepare process %d for \"%s\", stopping it", pid, *args_ss);
+								}
+
+							close (go_fds [1]);
+							close (error_fds [0]);
+
+							if (!success_flag)
+								{
+									int status;
+									pid_t res;
+
+									/* The child hasn't run its program so there is nothing of its own to stop */
+									kill (pid, SIGKILL);
+
+									do
+										{
+											res = waitpid (pid, &status, 0);
+										}
+									while ((res == -1) && (errno == EINTR));
+
+									pid = -1;
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to fork for \"%s\": %s", *args_ss, strerror (errno));
+
+							close (go_fds [0]);
+							close (go_fds [1]);
+							close (error_fds [0]);
+							close (error_fds [1]);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create error pipe for \"%s\": %s", *args_ss, strerror (errno));
+
+					close (go_fds [0]);
+					close (go_fds [1]);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create pipe for \"%s\": %s", *args_ss, strerror (errno));
+		}
+
+	return pid;
+}
+
+
+bool WaitForBlastProcess (pid_t pid, BlastProcessResult *result_p)
+{
+	bool success_flag = false;
+	int status;
+	pid_t res;
+
+	ClearBlastProcessResult (result_p);
+
+	do
+		{
+			res = wait4 (pid, &status, 0, & (result_p -> bpr_usage));
+		}
+	while ((res == -1) && (errno == EINTR));
+
+	if (res == pid)
+		{
+			SetBlastProcessResult (pid, status, result_p);
+			success_flag = true;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to wait for process %d: %s", pid, strerror (errno));
+		}
+
+	return success_flag;
+}
+
+
+int TryWaitForBlastProcess (pid_t pid, BlastProcessResult *result_p)
+{
+	int ret = -1;
+	int status;
+	pid_t res;
+
+	ClearBlastProcessResult (result_p);
+
+	do
+		{
+			res = wait4 (pid, &status, WNOHANG, & (result_p -> bpr_usage));
+		}
+	while ((res == -1) && (errno == EINTR));
+
+	if (res == pid)
+		{
+			SetBlastProcessResult (pid, status, result_p);
+			ret = 1;
+		}
+	else if (res == 0)
+		{
+			ret = 0;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to check process %d: %s", pid, strerror (errno));
+		}
+
+	return ret;
+}
+
+
+/*
+ * Where pidfds are available, poll them for the processes exiting.
+ * Otherwise, the processes are checked at regular intervals.
+ */
+int32 WaitForAnyBlastProcess (const pid_t *pids_p, const uint32 num_pids)
+{
+	int32 index = -1;
+	struct pollfd *fds_p = (struct pollfd *) AllocMemoryArray (num_pids, sizeof (struct pollfd));
+
+	if (fds_p)
+		{
+			const int poll_interval_ms = 1000;
+			uint32 num_valid_pids = 0;
+			bool polled_flag = false;
+			bool error_flag = false;
+			uint32 i;
+
+			for (i = 0; i < num_pids; ++ i)
+				{
+					struct pollfd *fd_p = fds_p + i;
+
+					fd_p -> fd = -1;
+					fd_p -> events = POLLIN;
+					fd_p -> revents = 0;
+
+					if (* (pids_p + i) > 0)
+						{
+							#ifdef SYS_pidfd_open
+							fd_p -> fd = (int) syscall (SYS_pidfd_open, * (pids_p + i), 0);
+							#endif
+
+							if (fd_p -> fd == -1)
+								{
+									polled_flag = true;
+								}
+
+							++ num_valid_pids;
+						}
+				}
+
+			error_flag = (num_valid_pids == 0);
+
+			while ((index == -1) && (!error_flag))
+				{
+					for (i = 0; (i < num_pids) && (index == -1) && (!error_flag); ++ i)
+						{
+							const pid_t pid = * (pids_p + i);
+
+							if (pid > 0)
+								{
+									siginfo_t info;
+
+									/* si_pid is only set if the process has finished */
+									memset (&info, 0, sizeof (info));
+
+									if (waitid (P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0)
+										{
+											if (info.si_pid == pid)
+												{
+													index = (int32) i;
+												}
+										}
+									else if (errno != EINTR)
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to check process %d: %s", pid, strerror (errno));
+											error_flag = true;
+										}
+								}
+						}
+
+					if ((index == -1) && (!error_flag))
+						{
+							if ((poll (fds_p, num_pids, polled_flag ? poll_interval_ms : -1) == -1) && (errno != EINTR))
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to wait for " UINT32_FMT " processes: %s", num_valid_pids, strerror (errno));
+									error_flag = true;
+								}
+						}
+				}		/* while ((index == -1) && (!error_flag)) */
+
+			for (i = 0; i < num_pids; ++ i)
+				{
+					if ((fds_p + i) -> fd != -1)
+						{
+							close ((fds_p + i) -> fd);
+						}
+				}
+
+			FreeMemory (fds_p);
+		}		/* if (fds_p) */
+
+	return index;
+}
+
+
+bool RunBlastProcess (char * const *args_ss, const char *log_filename_s, BlastProcessResult *result_p)
+{
+	bool success_flag = false;
+	pid_t pid = SpawnBlastProcess (args_ss, log_filename_s);
+
+	if (pid != -1)
+		{
+			success_flag = WaitForBlastProcess (pid, result_p);
+		}
+
+	return success_flag;
+}
+
+
+bool DidBlastProcessSucceed (const BlastProcessResult *result_p)
+{
+	return ((result_p -> bpr_signal == 0) && (result_p -> bpr_exit_code == 0));
+}
+
+
+void ReplaceBlastProcessArgValues (char **args_ss, const char **replacements_ss)
+{
+	const char **replacement_ss = replacements_ss;
+
+	while (*replacement_ss)
+		{
+			char **arg_ss = args_ss;
+
+			while (*arg_ss && * (arg_ss + 1))
+				{
+					if (strcmp (*arg_ss, *replacement_ss) == 0)
+						{
+							* (arg_ss + 1) = (char *) * (replacement_ss + 1);
+						}
+
+					++ arg_ss;
+				}
+
+			replacement_ss += 2;
+		}
+}
+
+
+
+static void ClearBlastProcessResult (BlastProcessResult *result_p)
+{
+	memset (& (result_p -> bpr_usage), 0, sizeof (result_p -> bpr_usage));
+	result_p -> bpr_exit_code = -1;
+	result_p -> bpr_signal = 0;
+	result_p -> bpr_stop = BPS_NONE;
+}
+
+
+static void SetBlastProcessResult (pid_t pid, const int status, BlastProcessResult *result_p)
+{
+	if (WIFEXITED (status))
+		{
+			result_p -> bpr_exit_code = WEXITSTATUS (status);
+		}
+	else if (WIFSIGNALED (status))
+		{
+			result_p -> bpr_signal = WTERMSIG (status);
+		}
+
+	#if BLAST_PROCESS_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Process %d finished with code %d signal %d, user %ld.%06lds sys %ld.%06lds max rss %ld KB", pid,
+						result_p -> bpr_exit_code, result_p -> bpr_signal,
+						(long) result_p -> bpr_usage.ru_utime.tv_sec, (long) result_p -> bpr_usage.ru_utime.tv_usec,
+						(long) result_p -> bpr_usage.ru_stime.tv_sec, (long) result_p -> bpr_usage.ru_stime.tv_usec,
+						result_p -> bpr_usage.ru_maxrss);
+	#endif
+}
+
+
+/*
+ * This runs in the forked child so only uses async-signal-safe calls
+ * and never returns.
+ */
+static void RunPreparedBlastProcess (char * const *args_ss, const char *log_filename_s, const int go_fd, const int error_fd)
+{
+	sigset_t signals;
+	int error;
+
+	/* As with SpawnBlastProcess, don't inherit any blocked signals from the server's thread */
+	sigemptyset (&signals);
+
+	if ((sigprocmask (SIG_SETMASK, &signals, NULL) == 0) && (setpgid (0, 0) == 0) &&
+			(RedirectBlastProcessStream ("/dev/null", O_RDONLY, STDIN_FILENO)) &&
+			((!log_filename_s) || ((RedirectBlastProcessStream (log_filename_s, O_WRONLY | O_CREAT | O_APPEND, STDOUT_FILENO)) && (dup2 (STDOUT_FILENO, STDERR_FILENO) != -1))))
+		{
+			char go;
+			ssize_t res;
+
+			/* Wait until the parent has set us up, it closes the pipe instead if that fails */
+			do
+				{
+					res = read (go_fd, &go, 1);
+				}
+			while ((res == -1) && (errno == EINTR));
+
+			if (res == 1)
+				{
+					execvp (*args_ss, args_ss);
+				}
+		}
+
+	error = errno;
+
+	if (write (error_fd, &error, sizeof (error)) != sizeof (error))
+		{
+			/* There's nothing else that we can do about it here */
+		}
+
+	_exit (127);
+}
+
+
+static bool RedirectBlastProcessStream (const char *filename_s, const int flags, const int stream_fd)
+{
+	bool success_flag = false;
+	int fd = open (filename_s, flags, 0644);
+
+	if (fd != -1)
+		{
+			if (fd == stream_fd)
+				{
+					success_flag = true;
+				}
+			else if (dup2 (fd, stream_fd) != -1)
+				{
+					close (fd);
+					success_flag = true;
+				}
+		}
+
+	return success_flag;
+}
@@ -0,0 +1,529 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_process_envelope.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blast_process_envelope.hpp"
+
+#include "json_util.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_PROCESS_ENVELOPE_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_PROCESS_ENVELOPE_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * The details that BlastProcessEnvelope::PrepareProcess
+ * needs to apply the limits to a process.
+ */
+typedef struct EnvelopeSpawn
+{
+	BlastProcessEnvelope *es_envelope_p;
+
+	uint32 es_num_jobs;
+
+	/* The process that the limits were applied to or -1 if they weren't */
+	pid_t es_pid;
+} EnvelopeSpawn;
+
+
+static bool ReadCgroupValue (const char *cgroup_s, const char *filename_s, const char *key_s, uint64 *value_p);
+
+
+
+const char * const BlastProcessEnvelope :: BPE_MEMORY_MAX_MB_S = "memory_max_mb";
+
+const char * const BlastProcessEnvelope :: BPE_CPU_MAX_PERCENT_S = "cpu_max_percent";
+
+const char * const BlastProcessEnvelope :: BPE_IO_WEIGHT_S = "io_weight";
+
+const char * const BlastProcessEnvelope :: BPE_CGROUP_ROOT_S = "cgroup_root";
+
+const uint32 BlastProcessEnvelope :: BPE_CPU_PERIOD = 100000;
+
+
+
+BlastProcessEnvelope *BlastProcessEnvelope :: Create (const json_t *config_p)
+{
+	BlastProcessEnvelope *envelope_p = 0;
+
+	try
+		{
+			envelope_p = new BlastProcessEnvelope (config_p);
+
+			if ((envelope_p -> bpe_memory_max == 0) && (envelope_p -> bpe_cpu_max_percent == 0) && (envelope_p -> bpe_io_weight == 0))
+				{
+					delete envelope_p;
+					envelope_p = 0;
+				}
+			else
+				{
+					#if BLAST_PROCESS_ENVELOPE_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Limiting blast processes to " UINT64_FMT " bytes, " UINT32_FMT "%% cpu and io weight " UINT32_FMT " using %s",
+										envelope_p -> bpe_memory_max, envelope_p -> bpe_cpu_max_percent, envelope_p -> bpe_io_weight,
+										envelope_p -> bpe_cgroup_root_s ? envelope_p -> bpe_cgroup_root_s : "setrlimit");
+					#endif
+				}
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastProcessEnvelope");
+		}
+
+	return envelope_p;
+}
+
+
+BlastProcessEnvelope *BlastProcessEnvelope :: Clone (const BlastProcessEnvelope *envelope_p)
+{
+	BlastProcessEnvelope *copy_p = 0;
+
+	try
+		{
+			copy_p = new BlastProcessEnvelope (*envelope_p);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy BlastProcessEnvelope");
+		}
+
+	return copy_p;
+}
+
+
+BlastProcessEnvelope :: BlastProcessEnvelope (const BlastProcessEnvelope &envelope_r)
+	: bpe_memory_max (envelope_r.bpe_memory_max),
+		bpe_cpu_max_percent (envelope_r.bpe_cpu_max_percent),
+		bpe_io_weight (envelope_r.bpe_io_weight),
+		bpe_cgroup_root_s (0)
+{
+	if (envelope_r.bpe_cgroup_root_s)
+		{
+			bpe_cgroup_root_s = EasyCopyToNewString (envelope_r.bpe_cgroup_root_s);
+
+			if (!bpe_cgroup_root_s)
+				{
+					throw std :: bad_alloc ();
+				}
+		}
+}
+
+
+BlastProcessEnvelope :: BlastProcessEnvelope (const json_t *config_p)
+	: bpe_memory_max (0),
+		bpe_cpu_max_percent (0),
+		bpe_io_weight (0),
+		bpe_cgroup_root_s (0)
+{
+	json_int_t i;
+	const char *root_s;
+
+	if (GetJSONInteger (config_p, BPE_MEMORY_MAX_MB_S, &i))
+		{
+			if (i >= 0)
+				{
+					bpe_memory_max = ((uint64) i) << 20;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not limiting memory", BPE_MEMORY_MAX_MB_S, i);
+				}
+		}
+
+	if (GetJSONInteger (config_p, BPE_CPU_MAX_PERCENT_S, &i))
+		{
+			if (i >= 0)
+				{
+					bpe_cpu_max_percent = (uint32) i;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not limiting cpu", BPE_CPU_MAX_PERCENT_S, i);
+				}
+		}
+
+	if (GetJSONInteger (config_p, BPE_IO_WEIGHT_S, &i))
+		{
+			if ((i == 0) || ((i >= 1) && (i <= 10000)))
+				{
+					bpe_io_weight = (uint32) i;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", it must be between 1 and 10000", BPE_IO_WEIGHT_S, i);
+				}
+		}
+
+	root_s = GetJSONString (config_p, BPE_CGROUP_ROOT_S);
+
+	if (root_s)
+		{
+			char *procs_s = ConcatenateVarargsStrings (root_s, "/cgroup.procs", NULL);
+
+			if (!procs_s)
+				{
+					throw std :: bad_alloc ();
+				}
+
+			/* We need to be able to create child cgroups and move processes between them */
+			if ((access (root_s, W_OK) == 0) && (access (procs_s, W_OK) == 0))
+				{
+					bpe_cgroup_root_s = EasyCopyToNewString (root_s);
+
+					if (!bpe_cgroup_root_s)
+						{
+							FreeCopiedString (procs_s);
+							throw std :: bad_alloc ();
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Cannot write to cgroup \"%s\": %s, limiting memory with setrlimit instead", root_s, strerror (errno));
+				}
+
+			FreeCopiedString (procs_s);
+		}
+
+	if ((!bpe_cgroup_root_s) && ((bpe_cpu_max_percent > 0) || (bpe_io_weight > 0)))
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" and \"%s\" need \"%s\" to be set, ignoring them", BPE_CPU_MAX_PERCENT_S, BPE_IO_WEIGHT_S, BPE_CGROUP_ROOT_S);
+		}
+}
+
+
+BlastProcessEnvelope :: ~BlastProcessEnvelope ()
+{
+	if (bpe_cgroup_root_s)
+		{
+			FreeCopiedString (bpe_cgroup_root_s);
+		}
+}
+
+
+uint64 BlastProcessEnvelope :: GetMemoryLimit () const
+{
+	return bpe_memory_max;
+}
+
+
+pid_t BlastProcessEnvelope :: Spawn (char * const *args_ss, const char *log_filename_s, const uint32 num_jobs)
+{
+	EnvelopeSpawn spawn;
+	pid_t pid;
+
+	spawn.es_envelope_p = this;
+	spawn.es_num_jobs = num_jobs;
+	spawn.es_pid = -1;
+
+	pid = SpawnPreparedBlastProcess (args_ss, log_filename_s, BlastProcessEnvelope :: PrepareProcess, &spawn);
+
+	/* If the program itself failed to start, remove the cgroup that it was put in */
+	if ((pid == -1) && (spawn.es_pid != -1))
+		{
+			BlastProcessResult result;
+
+			memset (&result, 0, sizeof (result));
+			result.bpr_exit_code = -1;
+			result.bpr_stop = BPS_NONE;
+
+			Leave (spawn.es_pid, &result);
+		}
+
+	return pid;
+}
+
+
+bool BlastProcessEnvelope :: PrepareProcess (pid_t pid, void *data_p)
+{
+	EnvelopeSpawn *spawn_p = (EnvelopeSpawn *) data_p;
+	bool success_flag = spawn_p -> es_envelope_p -> Enter (pid, spawn_p -> es_num_jobs);
+
+	if (success_flag)
+		{
+			spawn_p -> es_pid = pid;
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * This is called while the process is waiting to run its program,
+ * so it can't get away from its limits or use anything before they
+ * are in place.
+ */
+bool BlastProcessEnvelope :: Enter (pid_t pid, const uint32 num_jobs)
+{
+	const uint64 memory_max = bpe_memory_max * num_jobs;
+	bool success_flag;
+
+	if (bpe_cgroup_root_s)
+		{
+			success_flag = EnterCgroup (pid, memory_max);
+		}
+	else
+		{
+			success_flag = EnterRlimits (pid, memory_max);
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to apply resource limits to process %d, so it won't be run", pid);
+		}
+
+	return success_flag;
+}
+
+
+void BlastProcessEnvelope :: Leave (pid_t pid, BlastProcessResult *result_p)
+{
+	if (bpe_cgroup_root_s)
+		{
+			char *cgroup_s = GetCgroupPath (pid);
+
+			if (cgroup_s)
+				{
+					/* Being stopped by the monitor takes precedence as that is what the user asked for */
+					if ((result_p -> bpr_stop == BPS_NONE) && (!DidBlastProcessSucceed (result_p)) && (WasOutOfMemory (cgroup_s)))
+						{
+							result_p -> bpr_stop = BPS_MEMORY_LIMIT;
+						}
+
+					/*
+					 * Anything that the process started and left behind would stop the
+					 * cgroup from being removed, so kill it. cgroup.kill is only on
+					 * kernels 5.14 and later, so this isn't required.
+					 */
+					if (rmdir (cgroup_s) != 0)
+						{
+							if ((errno == EBUSY) && (WriteCgroupFile (cgroup_s, "cgroup.kill", "1", false)))
+								{
+									usleep (100000);
+								}
+
+							if ((rmdir (cgroup_s) != 0) && (errno != ENOENT))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to remove cgroup \"%s\": %s", cgroup_s, strerror (errno));
+								}
+						}
+
+					FreeCopiedString (cgroup_s);
+				}
+		}
+}
+
+
+char *BlastProcessEnvelope :: GetCgroupPath (pid_t pid) const
+{
+	char name_s [64];
+
+	/* Include the server's pid so that several servers can share the same root */
+	snprintf (name_s, sizeof (name_s), "blast-%d-%d", (int) getpid (), (int) pid);
+
+	return ConcatenateVarargsStrings (bpe_cgroup_root_s, "/", name_s, NULL);
+}
+
+
+bool BlastProcessEnvelope :: EnterCgroup (pid_t pid, const uint64 memory_max)
+{
+	bool success_flag = false;
+	char *cgroup_s = GetCgroupPath (pid);
+
+	if (cgroup_s)
+		{
+			if (mkdir (cgroup_s, 0755) == 0)
+				{
+					char value_s [64];
+
+					success_flag = true;
+
+					if (memory_max > 0)
+						{
+							snprintf (value_s, sizeof (value_s), UINT64_FMT, memory_max);
+
+							/* Don't let the job swap instead of hitting its limit, and kill all of its processes together */
+							success_flag = WriteCgroupFile (cgroup_s, "memory.max", value_s, true) &&
+								WriteCgroupFile (cgroup_s, "memory.swap.max", "0", false) &&
+								WriteCgroupFile (cgroup_s, "memory.oom.group", "1", false);
+						}
+
+					if (success_flag && (bpe_cpu_max_percent > 0))
+						{
+							const uint64 quota = ((uint64) bpe_cpu_max_percent) * BPE_CPU_PERIOD / 100;
+
+							snprintf (value_s, sizeof (value_s), UINT64_FMT " " UINT32_FMT, quota, BPE_CPU_PERIOD);
+							success_flag = WriteCgroupFile (cgroup_s, "cpu.max", value_s, true);
+						}
+
+					/* io.weight only has an effect with some io schedulers, so it's optional */
+					if (success_flag && (bpe_io_weight > 0))
+						{
+							snprintf (value_s, sizeof (value_s), "default " UINT32_FMT, bpe_io_weight);
+							WriteCgroupFile (cgroup_s, "io.weight", value_s, false);
+						}
+
+					if (success_flag)
+						{
+							snprintf (value_s, sizeof (value_s), "%d", (int) pid);
+							success_flag = WriteCgroupFile (cgroup_s, "cgroup.procs", value_s, true);
+						}
+
+					if (!success_flag)
+						{
+							rmdir (cgroup_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create cgroup \"%s\": %s", cgroup_s, strerror (errno));
+				}
+
+			FreeCopiedString (cgroup_s);
+		}
+
+	return success_flag;
+}
+
+
+bool BlastProcessEnvelope :: EnterRlimits (pid_t pid, const uint64 memory_max)
+{
+	bool success_flag = true;
+
+	/*
+	 * RLIMIT_AS would also count the memory-mapped database files, which
+	 * can be far larger than the memory that blast actually uses, so
+	 * limit the heap instead.
+	 */
+	if (memory_max > 0)
+		{
+			struct rlimit limit;
+
+			limit.rlim_cur = (rlim_t) memory_max;
+			limit.rlim_max = (rlim_t) memory_max;
+
+			if (prlimit (pid, RLIMIT_DATA, &limit, NULL) != 0)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to set memory limit for process %d: %s", pid, strerror (errno));
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool BlastProcessEnvelope :: WriteCgroupFile (const char *cgroup_s, const char *filename_s, const char *value_s, const bool required_flag) const
+{
+	bool success_flag = false;
+	char *path_s = ConcatenateVarargsStrings (cgroup_s, "/", filename_s, NULL);
+
+	if (path_s)
+		{
+			int fd = open (path_s, O_WRONLY | O_CLOEXEC);
+
+			if (fd != -1)
+				{
+					const size_t l = strlen (value_s);
+
+					if (write (fd, value_s, l) == (ssize_t) l)
+						{
+							success_flag = true;
+						}
+
+					close (fd);
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (required_flag ? STM_LEVEL_WARNING : STM_LEVEL_FINE, __FILE__, __LINE__, "Failed to write \"%s\" to \"%s\": %s", value_s, path_s, strerror (errno));
+				}
+
+			FreeCopiedString (path_s);
+		}
+
+	return success_flag;
+}
+
+
+bool BlastProcessEnvelope :: WasOutOfMemory (const char *cgroup_s) const
+{
+	uint64 count = 0;
+
+	return (ReadCgroupValue (cgroup_s, "memory.events", "oom_kill", &count) && (count > 0));
+}
+
+
+
+/*
+ * Get the value for a key from a flat-keyed cgroup file
+ * such as memory.events, where each line is "<key> <value>".
+ */
+static bool ReadCgroupValue (const char *cgroup_s, const char *filename_s, const char *key_s, uint64 *value_p)
+{
+	bool success_flag = false;
+	char *path_s = ConcatenateVarargsStrings (cgroup_s, "/", filename_s, NULL);
+
+	if (path_s)
+		{
+			FILE *in_f = fopen (path_s, "r");
+
+			if (in_f)
+				{
+					char line_s [256];
+					const size_t key_length = strlen (key_s);
+
+					while ((!success_flag) && (fgets (line_s, sizeof (line_s), in_f)))
+						{
+							if ((strncmp (line_s, key_s, key_length) == 0) && (line_s [key_length] == ' '))
+								{
+									unsigned long long value;
+
+									if (sscanf (line_s + key_length + 1, "%llu", &value) == 1)
+										{
+											*value_p = (uint64) value;
+											success_flag = true;
+										}
+								}
+						}
+
+					fclose (in_f);
+				}
+
+			FreeCopiedString (path_s);
+		}
+
+	return success_flag;
+}
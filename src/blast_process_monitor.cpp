@@ -0,0 +1,752 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_process_monitor.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "blast_process_monitor.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_PROCESS_MONITOR_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_PROCESS_MONITOR_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * The maximum number of events to get from each call to epoll_wait.
+ * Any others are picked up by the next call.
+ */
+#define BPM_MAX_EVENTS	(64)
+
+
+/*
+ * A process that a BlastProcessMonitor is waiting for or
+ * keeping track of.
+ */
+typedef struct WatchedProcess
+{
+	pid_t wp_pid;
+
+	/*
+	 * Is the process reaped by the monitor? If not, it is
+	 * waited for by the thread that launched it.
+	 */
+	bool wp_reap_flag;
+
+	/* The pidfd for the process or -1 if it is checked at regular intervals instead */
+	int wp_pidfd;
+
+	BlastProcessExitFn wp_exit_fn;
+
+	void *wp_data_p;
+
+	BlastProcessResult wp_result;
+
+	char wp_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	/* When the process will be stopped or 0 for no deadline */
+	time_t wp_deadline;
+
+	/* When the process was sent SIGTERM or 0 if it hasn't been stopped */
+	time_t wp_stop_time;
+
+	BlastProcessStop wp_stop;
+
+	bool wp_killed_flag;
+
+	/* Is this counted in bpm_num_timed_processes? */
+	bool wp_timed_flag;
+
+	struct WatchedProcess *wp_prev_p;
+
+	struct WatchedProcess *wp_next_p;
+} WatchedProcess;
+
+
+static int OpenPidfd (pid_t pid);
+
+
+
+BlastProcessMonitor *BlastProcessMonitor :: bpm_shared_monitor_p = 0;
+
+uint32 BlastProcessMonitor :: bpm_shared_monitor_count = 0;
+
+pthread_mutex_t BlastProcessMonitor :: bpm_shared_monitor_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const int BlastProcessMonitor :: BPM_POLL_INTERVAL_MS = 1000;
+
+const time_t BlastProcessMonitor :: BPM_KILL_GRACE_PERIOD = 10;
+
+
+
+BlastProcessMonitor *BlastProcessMonitor :: GetSharedBlastProcessMonitor ()
+{
+	BlastProcessMonitor *monitor_p = 0;
+
+	pthread_mutex_lock (&bpm_shared_monitor_mutex);
+
+	if (!bpm_shared_monitor_p)
+		{
+			try
+				{
+					bpm_shared_monitor_p = new BlastProcessMonitor ();
+
+					#if BLAST_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared BlastProcessMonitor");
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastProcessMonitor");
+				}
+		}
+
+	if (bpm_shared_monitor_p)
+		{
+			++ bpm_shared_monitor_count;
+			monitor_p = bpm_shared_monitor_p;
+		}
+
+	pthread_mutex_unlock (&bpm_shared_monitor_mutex);
+
+	return monitor_p;
+}
+
+
+void BlastProcessMonitor :: ReleaseSharedBlastProcessMonitor ()
+{
+	BlastProcessMonitor *monitor_to_free_p = 0;
+
+	pthread_mutex_lock (&bpm_shared_monitor_mutex);
+
+	if (bpm_shared_monitor_count > 0)
+		{
+			-- bpm_shared_monitor_count;
+
+			if (bpm_shared_monitor_count == 0)
+				{
+					monitor_to_free_p = bpm_shared_monitor_p;
+					bpm_shared_monitor_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&bpm_shared_monitor_mutex);
+
+	/* Wait for the thread outside of the lock */
+	if (monitor_to_free_p)
+		{
+			delete monitor_to_free_p;
+		}
+}
+
+
+BlastProcessMonitor :: BlastProcessMonitor ()
+	: bpm_processes_p (0),
+		bpm_num_processes (0),
+		bpm_num_polled_processes (0),
+		bpm_num_timed_processes (0),
+		bpm_running_flag (true)
+{
+	struct epoll_event event;
+
+	bpm_epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+
+	if (bpm_epoll_fd == -1)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "epoll_create1 failed: %s", strerror (errno));
+			throw std :: bad_alloc ();
+		}
+
+	bpm_wakeup_fd = eventfd (0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (bpm_wakeup_fd == -1)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "eventfd failed: %s", strerror (errno));
+			close (bpm_epoll_fd);
+			throw std :: bad_alloc ();
+		}
+
+	/* A NULL pointer marks the wake up event */
+	memset (&event, 0, sizeof (event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+
+	if (epoll_ctl (bpm_epoll_fd, EPOLL_CTL_ADD, bpm_wakeup_fd, &event) != 0)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add eventfd to epoll: %s", strerror (errno));
+			close (bpm_wakeup_fd);
+			close (bpm_epoll_fd);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_mutex_init (&bpm_mutex, NULL) != 0)
+		{
+			close (bpm_wakeup_fd);
+			close (bpm_epoll_fd);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_create (&bpm_thread, NULL, RunMonitorThread, this) != 0)
+		{
+			pthread_mutex_destroy (&bpm_mutex);
+			close (bpm_wakeup_fd);
+			close (bpm_epoll_fd);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastProcessMonitor :: ~BlastProcessMonitor ()
+{
+	WatchedProcess *process_p;
+
+	pthread_mutex_lock (&bpm_mutex);
+	bpm_running_flag = false;
+	pthread_mutex_unlock (&bpm_mutex);
+
+	Wake ();
+	pthread_join (bpm_thread, NULL);
+
+	if (bpm_num_processes > 0)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Stopped watching " UINT32_FMT " running processes", bpm_num_processes);
+		}
+
+	process_p = bpm_processes_p;
+
+	while (process_p)
+		{
+			WatchedProcess *next_p = process_p -> wp_next_p;
+
+			if (process_p -> wp_pidfd != -1)
+				{
+					close (process_p -> wp_pidfd);
+				}
+
+			FreeMemory (process_p);
+			process_p = next_p;
+		}
+
+	pthread_mutex_destroy (&bpm_mutex);
+	close (bpm_wakeup_fd);
+	close (bpm_epoll_fd);
+}
+
+
+bool BlastProcessMonitor :: Watch (pid_t pid, BlastProcessExitFn exit_fn, void *data_p, const char *job_id_s, time_t deadline)
+{
+	return AddProcess (pid, true, exit_fn, data_p, job_id_s, deadline);
+}
+
+
+bool BlastProcessMonitor :: Track (pid_t pid, const char *job_id_s, time_t deadline)
+{
+	return AddProcess (pid, false, NULL, NULL, job_id_s, deadline);
+}
+
+
+bool BlastProcessMonitor :: Wait (pid_t pid, BlastProcessResult *result_p)
+{
+	bool success_flag;
+	BlastProcessStop stop = BPS_NONE;
+	WatchedProcess *process_p;
+	siginfo_t info;
+	int res;
+
+	/*
+	 * Wait for the process without reaping it so that its process
+	 * group can't be reused while the monitor may still signal it.
+	 */
+	do
+		{
+			res = waitid (P_PID, pid, &info, WEXITED | WNOWAIT);
+		}
+	while ((res == -1) && (errno == EINTR));
+
+	if (res == -1)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to wait for process %d to exit: %s", pid, strerror (errno));
+		}
+
+	pthread_mutex_lock (&bpm_mutex);
+
+	for (process_p = bpm_processes_p; process_p; process_p = process_p -> wp_next_p)
+		{
+			if ((process_p -> wp_pid == pid) && (!process_p -> wp_reap_flag))
+				{
+					stop = process_p -> wp_stop;
+					RemoveProcess (process_p);
+					break;
+				}
+		}
+
+	pthread_mutex_unlock (&bpm_mutex);
+
+	if (process_p)
+		{
+			FreeMemory (process_p);
+		}
+
+	success_flag = WaitForBlastProcess (pid, result_p);
+	result_p -> bpr_stop = stop;
+
+	return success_flag;
+}
+
+
+bool BlastProcessMonitor :: Cancel (const char *job_id_s)
+{
+	bool found_flag = false;
+	WatchedProcess *process_p;
+
+	pthread_mutex_lock (&bpm_mutex);
+
+	for (process_p = bpm_processes_p; process_p; process_p = process_p -> wp_next_p)
+		{
+			if (strcmp (process_p -> wp_job_id_s, job_id_s) == 0)
+				{
+					StopProcess (process_p, BPS_CANCELLED);
+					found_flag = true;
+				}
+		}
+
+	pthread_mutex_unlock (&bpm_mutex);
+
+	/* Let the thread know that it needs to check whether the processes need killing */
+	if (found_flag)
+		{
+			Wake ();
+		}
+
+	#if BLAST_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Cancelling job \"%s\" %s", job_id_s, found_flag ? "succeeded" : "found no processes");
+	#endif
+
+	return found_flag;
+}
+
+
+bool BlastProcessMonitor :: AddProcess (pid_t pid, bool reap_flag, BlastProcessExitFn exit_fn, void *data_p, const char *job_id_s, time_t deadline)
+{
+	bool success_flag = false;
+	WatchedProcess *process_p = (WatchedProcess *) AllocMemory (sizeof (WatchedProcess));
+
+	if (process_p)
+		{
+			bool wake_flag = false;
+
+			process_p -> wp_pid = pid;
+			process_p -> wp_reap_flag = reap_flag;
+			process_p -> wp_pidfd = reap_flag ? OpenPidfd (pid) : -1;
+			process_p -> wp_exit_fn = exit_fn;
+			process_p -> wp_data_p = data_p;
+			process_p -> wp_deadline = deadline;
+			process_p -> wp_stop_time = 0;
+			process_p -> wp_stop = BPS_NONE;
+			process_p -> wp_killed_flag = false;
+			process_p -> wp_timed_flag = (deadline != 0);
+			process_p -> wp_prev_p = NULL;
+
+			strncpy (process_p -> wp_job_id_s, job_id_s ? job_id_s : "", UUID_STRING_BUFFER_SIZE - 1);
+			* (process_p -> wp_job_id_s + UUID_STRING_BUFFER_SIZE - 1) = '\0';
+
+			pthread_mutex_lock (&bpm_mutex);
+
+			process_p -> wp_next_p = bpm_processes_p;
+
+			if (bpm_processes_p)
+				{
+					bpm_processes_p -> wp_prev_p = process_p;
+				}
+
+			bpm_processes_p = process_p;
+			++ bpm_num_processes;
+
+			/*
+			 * The process is added to the list before its pidfd is added
+			 * to epoll, as it may already have finished.
+			 */
+			if (process_p -> wp_pidfd != -1)
+				{
+					struct epoll_event event;
+
+					memset (&event, 0, sizeof (event));
+					event.events = EPOLLIN;
+					event.data.ptr = process_p;
+
+					if (epoll_ctl (bpm_epoll_fd, EPOLL_CTL_ADD, process_p -> wp_pidfd, &event) != 0)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add pidfd for process %d to epoll, %s", pid, strerror (errno));
+
+							close (process_p -> wp_pidfd);
+							process_p -> wp_pidfd = -1;
+						}
+				}
+
+			if (reap_flag && (process_p -> wp_pidfd == -1))
+				{
+					++ bpm_num_polled_processes;
+					wake_flag = true;
+				}
+
+			if (process_p -> wp_timed_flag)
+				{
+					++ bpm_num_timed_processes;
+					wake_flag = true;
+				}
+
+			pthread_mutex_unlock (&bpm_mutex);
+
+			/* Let the thread know that it needs to start checking at regular intervals */
+			if (wake_flag)
+				{
+					Wake ();
+				}
+
+			#if BLAST_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "%s process %d for job \"%s\" %s", reap_flag ? "Watching" : "Tracking", pid, process_p -> wp_job_id_s, (process_p -> wp_pidfd == -1) ? "without a pidfd" : "with a pidfd");
+			#endif
+
+			success_flag = true;
+		}		/* if (process_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate memory to watch process %d", pid);
+		}
+
+	return success_flag;
+}
+
+
+uint32 BlastProcessMonitor :: GetNumWatchedProcesses ()
+{
+	uint32 num_processes;
+
+	pthread_mutex_lock (&bpm_mutex);
+	num_processes = bpm_num_processes;
+	pthread_mutex_unlock (&bpm_mutex);
+
+	return num_processes;
+}
+
+
+void *BlastProcessMonitor :: RunMonitorThread (void *data_p)
+{
+	BlastProcessMonitor *monitor_p = static_cast <BlastProcessMonitor *> (data_p);
+
+	monitor_p -> Run ();
+
+	return NULL;
+}
+
+
+void BlastProcessMonitor :: Run ()
+{
+	struct epoll_event events [BPM_MAX_EVENTS];
+	bool running_flag = true;
+
+	while (running_flag)
+		{
+			int timeout;
+			int num_events;
+
+			/* Only wake up at regular intervals if there are processes without pidfds or with deadlines */
+			pthread_mutex_lock (&bpm_mutex);
+			timeout = ((bpm_num_polled_processes > 0) || (bpm_num_timed_processes > 0)) ? BPM_POLL_INTERVAL_MS : -1;
+			pthread_mutex_unlock (&bpm_mutex);
+
+			num_events = epoll_wait (bpm_epoll_fd, events, BPM_MAX_EVENTS, timeout);
+
+			if (num_events > 0)
+				{
+					int i;
+
+					for (i = 0; i < num_events; ++ i)
+						{
+							WatchedProcess *process_p = static_cast <WatchedProcess *> (events [i].data.ptr);
+
+							if (process_p)
+								{
+									CheckProcess (process_p);
+								}
+							else
+								{
+									uint64 value;
+
+									/* Reset the eventfd's counter */
+									if (read (bpm_wakeup_fd, &value, sizeof (value)) == -1)
+										{
+											#if BLAST_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINEST
+											PrintLog (STM_LEVEL_FINEST, __FILE__, __LINE__, "Failed to read eventfd: %s", strerror (errno));
+											#endif
+										}
+								}
+						}
+				}
+			else if ((num_events == -1) && (errno != EINTR))
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "epoll_wait failed: %s", strerror (errno));
+				}
+
+			CheckPolledProcesses ();
+			CheckDeadlines ();
+
+			pthread_mutex_lock (&bpm_mutex);
+			running_flag = bpm_running_flag;
+			pthread_mutex_unlock (&bpm_mutex);
+		}		/* while (running_flag) */
+}
+
+
+void BlastProcessMonitor :: Wake ()
+{
+	const uint64 value = 1;
+
+	if (write (bpm_wakeup_fd, &value, sizeof (value)) == -1)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to wake BlastProcessMonitor: %s", strerror (errno));
+		}
+}
+
+
+/*
+ * This is only called from the monitor's thread, which is the only
+ * thread that reaps or removes the watched processes. The process is
+ * reaped with the lock held so that its process group can't be reused
+ * while it could still be signalled by Cancel.
+ */
+void BlastProcessMonitor :: CheckProcess (WatchedProcess *process_p)
+{
+	bool finished_flag = false;
+
+	pthread_mutex_lock (&bpm_mutex);
+
+	/* If the process can't be checked, stop watching it and report it as failed */
+	if (TryWaitForBlastProcess (process_p -> wp_pid, & (process_p -> wp_result)) != 0)
+		{
+			RemoveProcess (process_p);
+			finished_flag = true;
+		}
+
+	pthread_mutex_unlock (&bpm_mutex);
+
+	if (finished_flag)
+		{
+			FinishProcess (process_p);
+		}
+}
+
+
+void BlastProcessMonitor :: CheckPolledProcesses ()
+{
+	WatchedProcess *finished_processes_p = NULL;
+
+	pthread_mutex_lock (&bpm_mutex);
+
+	if (bpm_num_polled_processes > 0)
+		{
+			WatchedProcess *process_p = bpm_processes_p;
+
+			while (process_p)
+				{
+					WatchedProcess *next_p = process_p -> wp_next_p;
+
+					if ((process_p -> wp_reap_flag) && (process_p -> wp_pidfd == -1))
+						{
+							if (TryWaitForBlastProcess (process_p -> wp_pid, & (process_p -> wp_result)) != 0)
+								{
+									RemoveProcess (process_p);
+
+									process_p -> wp_next_p = finished_processes_p;
+									finished_processes_p = process_p;
+								}
+						}
+
+					process_p = next_p;
+				}
+		}
+
+	pthread_mutex_unlock (&bpm_mutex);
+
+	/* Call the exit functions outside of the lock as they may watch further processes */
+	while (finished_processes_p)
+		{
+			WatchedProcess *next_p = finished_processes_p -> wp_next_p;
+
+			FinishProcess (finished_processes_p);
+			finished_processes_p = next_p;
+		}
+}
+
+
+void BlastProcessMonitor :: CheckDeadlines ()
+{
+	pthread_mutex_lock (&bpm_mutex);
+
+	if (bpm_num_timed_processes > 0)
+		{
+			const time_t now = time (NULL);
+			WatchedProcess *process_p;
+
+			for (process_p = bpm_processes_p; process_p; process_p = process_p -> wp_next_p)
+				{
+					if (process_p -> wp_stop_time == 0)
+						{
+							if ((process_p -> wp_deadline != 0) && (now >= process_p -> wp_deadline))
+								{
+									PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Process %d for job \"%s\" has passed its deadline", process_p -> wp_pid, process_p -> wp_job_id_s);
+									StopProcess (process_p, BPS_TIMED_OUT);
+								}
+						}
+					else if ((!process_p -> wp_killed_flag) && (now >= process_p -> wp_stop_time + BPM_KILL_GRACE_PERIOD))
+						{
+							PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Killing process %d for job \"%s\"", process_p -> wp_pid, process_p -> wp_job_id_s);
+
+							killpg (process_p -> wp_pid, SIGKILL);
+							process_p -> wp_killed_flag = true;
+						}
+				}
+		}
+
+	pthread_mutex_unlock (&bpm_mutex);
+}
+
+
+/*
+ * Ask the process group to stop, leaving CheckDeadlines to kill it if
+ * it is still running after the grace period. Since each process is
+ * started in its own process group, this stops anything that Blast has
+ * started too. This must be called with bpm_mutex locked.
+ */
+void BlastProcessMonitor :: StopProcess (WatchedProcess *process_p, BlastProcessStop reason)
+{
+	if (process_p -> wp_stop_time == 0)
+		{
+			if (killpg (process_p -> wp_pid, SIGTERM) != 0)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to stop process %d: %s", process_p -> wp_pid, strerror (errno));
+				}
+
+			process_p -> wp_stop = reason;
+			process_p -> wp_stop_time = time (NULL);
+
+			if (!process_p -> wp_timed_flag)
+				{
+					process_p -> wp_timed_flag = true;
+					++ bpm_num_timed_processes;
+				}
+		}
+}
+
+
+/*
+ * This must be called with bpm_mutex locked.
+ */
+void BlastProcessMonitor :: RemoveProcess (WatchedProcess *process_p)
+{
+	if (process_p -> wp_prev_p)
+		{
+			process_p -> wp_prev_p -> wp_next_p = process_p -> wp_next_p;
+		}
+	else
+		{
+			bpm_processes_p = process_p -> wp_next_p;
+		}
+
+	if (process_p -> wp_next_p)
+		{
+			process_p -> wp_next_p -> wp_prev_p = process_p -> wp_prev_p;
+		}
+
+	process_p -> wp_prev_p = NULL;
+	process_p -> wp_next_p = NULL;
+
+	if (process_p -> wp_pidfd != -1)
+		{
+			epoll_ctl (bpm_epoll_fd, EPOLL_CTL_DEL, process_p -> wp_pidfd, NULL);
+			close (process_p -> wp_pidfd);
+			process_p -> wp_pidfd = -1;
+		}
+	else if (process_p -> wp_reap_flag)
+		{
+			-- bpm_num_polled_processes;
+		}
+
+	if (process_p -> wp_timed_flag)
+		{
+			-- bpm_num_timed_processes;
+		}
+
+	-- bpm_num_processes;
+}
+
+
+void BlastProcessMonitor :: FinishProcess (WatchedProcess *process_p)
+{
+	process_p -> wp_result.bpr_stop = process_p -> wp_stop;
+
+	#if BLAST_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Process %d finished with code %d signal %d", process_p -> wp_pid, process_p -> wp_result.bpr_exit_code, process_p -> wp_result.bpr_signal);
+	#endif
+
+	process_p -> wp_exit_fn (process_p -> wp_data_p, & (process_p -> wp_result));
+
+	FreeMemory (process_p);
+}
+
+
+
+/*
+ * pidfds need Linux 5.3 or later, so return -1 if they aren't
+ * available and let the process be checked at regular intervals.
+ */
+static int OpenPidfd (pid_t pid)
+{
+	int fd = -1;
+
+	#ifdef SYS_pidfd_open
+	fd = (int) syscall (SYS_pidfd_open, pid, 0);
+
+	if (fd == -1)
+		{
+			#if BLAST_PROCESS_MONITOR_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "pidfd_open failed for process %d: %s", pid, strerror (errno));
+			#endif
+		}
+	#endif
+
+	return fd;
+}
@@ -0,0 +1,551 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_progress_tracker.cpp
+ *
+ *  Created on: 20 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blast_progress_tracker.hpp"
+#include "blast_service_params.h"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_PROGRESS_TRACKER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_PROGRESS_TRACKER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * The number of bytes at the start of each line of output
+ * that are kept to look for the query markers.
+ */
+#define BPT_LINE_PREFIX_SIZE	(64)
+
+
+/* The size of the buffer used to read the new parts of each file */
+#define BPT_READ_BUFFER_SIZE	(16384)
+
+
+/*
+ * A job whose progress is being followed by
+ * a BlastProgressTracker.
+ */
+typedef struct TrackedJob
+{
+	char tj_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	/* How much of the output file has been read */
+	off_t tj_output_offset;
+
+	/* How much of the log file has been read */
+	off_t tj_log_offset;
+
+	uint32 tj_queries_completed;
+
+	/* The start of the current line of output, without any leading whitespace */
+	char tj_line_s [BPT_LINE_PREFIX_SIZE];
+
+	uint32 tj_line_length;
+
+	/* The first column of the last line of tabular output */
+	char tj_last_query_s [BPT_LINE_PREFIX_SIZE];
+
+	/* The current line of the log */
+	char tj_log_line_s [BPT_MESSAGE_SIZE];
+
+	uint32 tj_log_line_length;
+
+	/* The last complete, non-empty line of the log */
+	char tj_message_s [BPT_MESSAGE_SIZE];
+
+	/* When the job's progress was last asked for */
+	time_t tj_last_read;
+
+	struct TrackedJob *tj_next_p;
+} TrackedJob;
+
+
+typedef void (*ProcessDataFn) (TrackedJob *job_p, const char *data_s, const size_t length, const uint32 output_format);
+
+typedef void (*ResetDataFn) (TrackedJob *job_p);
+
+
+static bool ReadNewData (TrackedJob *job_p, const char *filename_s, off_t *offset_p, ProcessDataFn process_fn, ResetDataFn reset_fn, const uint32 output_format);
+
+static void ProcessOutputData (TrackedJob *job_p, const char *data_s, const size_t length, const uint32 output_format);
+
+static void ProcessLogData (TrackedJob *job_p, const char *data_s, const size_t length, const uint32 output_format);
+
+static void ProcessOutputLine (TrackedJob *job_p, const uint32 output_format);
+
+static void ResetOutput (TrackedJob *job_p);
+
+static void ResetLog (TrackedJob *job_p);
+
+
+
+BlastProgressTracker *BlastProgressTracker :: bpt_shared_tracker_p = 0;
+
+uint32 BlastProgressTracker :: bpt_shared_tracker_count = 0;
+
+pthread_mutex_t BlastProgressTracker :: bpt_shared_tracker_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const time_t BlastProgressTracker :: BPT_EXPIRY_TIME = 600;
+
+
+
+BlastProgressTracker *BlastProgressTracker :: GetSharedBlastProgressTracker ()
+{
+	BlastProgressTracker *tracker_p = 0;
+
+	pthread_mutex_lock (&bpt_shared_tracker_mutex);
+
+	if (!bpt_shared_tracker_p)
+		{
+			try
+				{
+					bpt_shared_tracker_p = new BlastProgressTracker ();
+
+					#if BLAST_PROGRESS_TRACKER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared BlastProgressTracker");
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastProgressTracker");
+				}
+		}
+
+	if (bpt_shared_tracker_p)
+		{
+			++ bpt_shared_tracker_count;
+			tracker_p = bpt_shared_tracker_p;
+		}
+
+	pthread_mutex_unlock (&bpt_shared_tracker_mutex);
+
+	return tracker_p;
+}
+
+
+void BlastProgressTracker :: ReleaseSharedBlastProgressTracker ()
+{
+	BlastProgressTracker *tracker_to_free_p = 0;
+
+	pthread_mutex_lock (&bpt_shared_tracker_mutex);
+
+	if (bpt_shared_tracker_count > 0)
+		{
+			-- bpt_shared_tracker_count;
+
+			if (bpt_shared_tracker_count == 0)
+				{
+					tracker_to_free_p = bpt_shared_tracker_p;
+					bpt_shared_tracker_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&bpt_shared_tracker_mutex);
+
+	if (tracker_to_free_p)
+		{
+			delete tracker_to_free_p;
+		}
+}
+
+
+bool BlastProgressTracker :: CanCountQueries (const uint32 output_format)
+{
+	bool count_flag = false;
+
+	switch (output_format)
+		{
+			case BOF_PAIRWISE:
+			case BOF_QUERY_ANCHORED_WITH_IDENTITIES:
+			case BOF_QUERY_ANCHORED_NO_IDENTITIES:
+			case BOF_FLAT_QUERY_ANCHORED_WITH_IDENTITIES:
+			case BOF_FLAT_QUERY_ANCHORED_NO_IDENTITIES:
+			case BOF_XML_BLAST:
+			case BOF_TABULAR:
+			case BOF_TABULAR_WITH_COMMENTS:
+			case BOF_CSV:
+			case BOF_SINGLE_FILE_JSON_BLAST:
+			case BOF_SINGLE_FILE_XML2_BLAST:
+				count_flag = true;
+				break;
+
+			/* The ASN.1 formats are only written once all of the queries have been searched */
+			default:
+				break;
+		}
+
+	return count_flag;
+}
+
+
+BlastProgressTracker :: BlastProgressTracker ()
+	: bpt_jobs_p (0)
+{
+	if (pthread_mutex_init (&bpt_mutex, NULL) != 0)
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastProgressTracker :: ~BlastProgressTracker ()
+{
+	TrackedJob *job_p = bpt_jobs_p;
+
+	while (job_p)
+		{
+			TrackedJob *next_p = job_p -> tj_next_p;
+
+			FreeMemory (job_p);
+			job_p = next_p;
+		}
+
+	pthread_mutex_destroy (&bpt_mutex);
+}
+
+
+bool BlastProgressTracker :: GetProgress (const char *job_id_s, const char *output_filename_s, const uint32 output_format, const char *log_filename_s, BlastProgress *progress_p)
+{
+	bool success_flag = false;
+	TrackedJob *job_p;
+	time_t now = time (NULL);
+
+	/*
+	 * Only the new parts of the files are read, so it's cheap
+	 * enough to hold the lock while doing so.
+	 */
+	pthread_mutex_lock (&bpt_mutex);
+
+	RemoveExpiredJobs (now);
+
+	job_p = GetJob (job_id_s);
+
+	if (job_p)
+		{
+			const bool count_flag = CanCountQueries (output_format);
+
+			job_p -> tj_last_read = now;
+
+			if (count_flag && output_filename_s)
+				{
+					ReadNewData (job_p, output_filename_s, & (job_p -> tj_output_offset), ProcessOutputData, ResetOutput, output_format);
+				}
+
+			if (log_filename_s)
+				{
+					ReadNewData (job_p, log_filename_s, & (job_p -> tj_log_offset), ProcessLogData, ResetLog, output_format);
+				}
+
+			progress_p -> bp_queries_completed = job_p -> tj_queries_completed;
+			progress_p -> bp_counted_flag = count_flag;
+			strcpy (progress_p -> bp_message_s, job_p -> tj_message_s);
+
+			success_flag = true;
+		}
+
+	pthread_mutex_unlock (&bpt_mutex);
+
+	return success_flag;
+}
+
+
+TrackedJob *BlastProgressTracker :: GetJob (const char *job_id_s)
+{
+	TrackedJob *job_p;
+
+	for (job_p = bpt_jobs_p; job_p; job_p = job_p -> tj_next_p)
+		{
+			if (strcmp (job_p -> tj_job_id_s, job_id_s) == 0)
+				{
+					return job_p;
+				}
+		}
+
+	job_p = (TrackedJob *) AllocMemory (sizeof (TrackedJob));
+
+	if (job_p)
+		{
+			memset (job_p, 0, sizeof (TrackedJob));
+
+			strncpy (job_p -> tj_job_id_s, job_id_s, UUID_STRING_BUFFER_SIZE - 1);
+
+			job_p -> tj_next_p = bpt_jobs_p;
+			bpt_jobs_p = job_p;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate progress for \"%s\"", job_id_s);
+		}
+
+	return job_p;
+}
+
+
+void BlastProgressTracker :: RemoveExpiredJobs (const time_t now)
+{
+	TrackedJob *prev_p = NULL;
+	TrackedJob *job_p = bpt_jobs_p;
+
+	while (job_p)
+		{
+			TrackedJob *next_p = job_p -> tj_next_p;
+
+			if (now - job_p -> tj_last_read > BPT_EXPIRY_TIME)
+				{
+					if (prev_p)
+						{
+							prev_p -> tj_next_p = next_p;
+						}
+					else
+						{
+							bpt_jobs_p = next_p;
+						}
+
+					#if BLAST_PROGRESS_TRACKER_DEBUG >= STM_LEVEL_FINER
+					PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Stopped tracking progress of \"%s\"", job_p -> tj_job_id_s);
+					#endif
+
+					FreeMemory (job_p);
+				}
+			else
+				{
+					prev_p = job_p;
+				}
+
+			job_p = next_p;
+		}
+}
+
+
+/*
+ * Read the part of a file that has been written since it was last
+ * read. If the file has got smaller, it has been rewritten so it is
+ * read again from the start.
+ */
+static bool ReadNewData (TrackedJob *job_p, const char *filename_s, off_t *offset_p, ProcessDataFn process_fn, ResetDataFn reset_fn, const uint32 output_format)
+{
+	bool success_flag = false;
+	int fd = open (filename_s, O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if (fstat (fd, &st) == 0)
+				{
+					if (st.st_size < *offset_p)
+						{
+							reset_fn (job_p);
+							*offset_p = 0;
+						}
+
+					if (st.st_size > *offset_p)
+						{
+							if (lseek (fd, *offset_p, SEEK_SET) == *offset_p)
+								{
+									char buffer_s [BPT_READ_BUFFER_SIZE];
+									ssize_t num_read;
+
+									while ((num_read = read (fd, buffer_s, BPT_READ_BUFFER_SIZE)) > 0)
+										{
+											process_fn (job_p, buffer_s, (size_t) num_read, output_format);
+											*offset_p += num_read;
+										}
+
+									success_flag = (num_read == 0);
+								}
+						}
+					else
+						{
+							success_flag = true;
+						}
+				}
+
+			close (fd);
+		}
+	else if (errno == ENOENT)
+		{
+			/* Nothing has been written yet */
+			success_flag = true;
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read progress of \"%s\" from \"%s\": %s", job_p -> tj_job_id_s, filename_s, strerror (errno));
+		}
+
+	return success_flag;
+}
+
+
+static void ProcessOutputData (TrackedJob *job_p, const char *data_s, const size_t length, const uint32 output_format)
+{
+	const char *end_s = data_s + length;
+
+	while (data_s < end_s)
+		{
+			const char c = *data_s;
+
+			if (c == '\n')
+				{
+					ProcessOutputLine (job_p, output_format);
+					job_p -> tj_line_length = 0;
+				}
+			else if (job_p -> tj_line_length < BPT_LINE_PREFIX_SIZE - 1)
+				{
+					/* The markers in the XML and JSON formats are indented */
+					if ((job_p -> tj_line_length > 0) || (!isspace (c)))
+						{
+							job_p -> tj_line_s [job_p -> tj_line_length] = c;
+							++ (job_p -> tj_line_length);
+						}
+				}
+
+			++ data_s;
+		}
+}
+
+
+static void ProcessOutputLine (TrackedJob *job_p, const uint32 output_format)
+{
+	const char *line_s = job_p -> tj_line_s;
+	const char *marker_s = NULL;
+
+	job_p -> tj_line_s [job_p -> tj_line_length] = '\0';
+
+	switch (output_format)
+		{
+			case BOF_PAIRWISE:
+			case BOF_QUERY_ANCHORED_WITH_IDENTITIES:
+			case BOF_QUERY_ANCHORED_NO_IDENTITIES:
+			case BOF_FLAT_QUERY_ANCHORED_WITH_IDENTITIES:
+			case BOF_FLAT_QUERY_ANCHORED_NO_IDENTITIES:
+				marker_s = "Query=";
+				break;
+
+			case BOF_XML_BLAST:
+				marker_s = "<Iteration>";
+				break;
+
+			case BOF_TABULAR_WITH_COMMENTS:
+				marker_s = "# Query:";
+				break;
+
+			case BOF_SINGLE_FILE_JSON_BLAST:
+				marker_s = "\"report\":";
+				break;
+
+			case BOF_SINGLE_FILE_XML2_BLAST:
+				marker_s = "<report>";
+				break;
+
+			case BOF_TABULAR:
+			case BOF_CSV:
+				{
+					/*
+					 * There are no markers, so count the changes in the query id in
+					 * the first column. Queries without any hits don't appear at all.
+					 */
+					const char sep = (output_format == BOF_CSV) ? ',' : '\t';
+					const char *sep_p = strchr (line_s, sep);
+
+					if (sep_p && (sep_p > line_s) && (*line_s != '#'))
+						{
+							const size_t id_length = sep_p - line_s;
+
+							if ((strncmp (job_p -> tj_last_query_s, line_s, id_length) != 0) || (job_p -> tj_last_query_s [id_length] != '\0'))
+								{
+									memcpy (job_p -> tj_last_query_s, line_s, id_length);
+									job_p -> tj_last_query_s [id_length] = '\0';
+									++ (job_p -> tj_queries_completed);
+								}
+						}
+				}
+				break;
+
+			default:
+				break;
+		}
+
+	if (marker_s && (strncmp (line_s, marker_s, strlen (marker_s)) == 0))
+		{
+			++ (job_p -> tj_queries_completed);
+		}
+}
+
+
+static void ProcessLogData (TrackedJob *job_p, const char *data_s, const size_t length, const uint32 UNUSED_PARAM (output_format))
+{
+	const char *end_s = data_s + length;
+
+	while (data_s < end_s)
+		{
+			const char c = *data_s;
+
+			if ((c == '\n') || (c == '\r'))
+				{
+					if (job_p -> tj_log_line_length > 0)
+						{
+							memcpy (job_p -> tj_message_s, job_p -> tj_log_line_s, job_p -> tj_log_line_length);
+							job_p -> tj_message_s [job_p -> tj_log_line_length] = '\0';
+							job_p -> tj_log_line_length = 0;
+						}
+				}
+			else if (job_p -> tj_log_line_length < BPT_MESSAGE_SIZE - 1)
+				{
+					job_p -> tj_log_line_s [job_p -> tj_log_line_length] = c;
+					++ (job_p -> tj_log_line_length);
+				}
+
+			++ data_s;
+		}
+}
+
+
+static void ResetOutput (TrackedJob *job_p)
+{
+	job_p -> tj_queries_completed = 0;
+	job_p -> tj_line_length = 0;
+	* (job_p -> tj_last_query_s) = '\0';
+}
+
+
+static void ResetLog (TrackedJob *job_p)
+{
+	job_p -> tj_log_line_length = 0;
+	* (job_p -> tj_message_s) = '\0';
+}
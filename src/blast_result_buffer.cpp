@@ -0,0 +1,192 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_result_buffer.cpp
+ *
+ *  Created on: 25 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blast_result_buffer.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_RESULT_BUFFER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_RESULT_BUFFER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/* mmap can't map an empty file so this stands in for one */
+static const char S_EMPTY_S [] = "";
+
+
+BlastResultBuffer *BlastResultBuffer :: MapFile (const char *filename_s)
+{
+	BlastResultBuffer *buffer_p = 0;
+	int fd = open (filename_s, O_RDONLY);
+
+	if (fd >= 0)
+		{
+			struct stat st;
+
+			if (fstat (fd, &st) == 0)
+				{
+					const size_t length = (size_t) st.st_size;
+					const char *data_s = S_EMPTY_S;
+					bool mapped_flag = false;
+
+					if (length > 0)
+						{
+							void *map_p = mmap (NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+							if (map_p != MAP_FAILED)
+								{
+									/* The results are read from start to end */
+									madvise (map_p, length, MADV_SEQUENTIAL);
+
+									data_s = (const char *) map_p;
+									mapped_flag = true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to map \"%s\", %s", filename_s, strerror (errno));
+									data_s = NULL;
+								}
+						}
+
+					if (data_s)
+						{
+							try
+								{
+									buffer_p = new BlastResultBuffer (data_s, length, mapped_flag);
+
+									#if BLAST_RESULT_BUFFER_DEBUG >= STM_LEVEL_FINER
+									PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Mapped " SIZET_FMT " bytes of \"%s\"", length, filename_s);
+									#endif
+								}
+							catch (std :: bad_alloc &alloc_r)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate BlastResultBuffer for \"%s\"", filename_s);
+
+									if (mapped_flag)
+										{
+											munmap ((void *) data_s, length);
+										}
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to stat \"%s\", %s", filename_s, strerror (errno));
+				}
+
+			/* The mapping stays valid after the file is closed */
+			close (fd);
+		}		/* if (fd >= 0) */
+
+	return buffer_p;
+}
+
+
+BlastResultBuffer *BlastResultBuffer :: AdoptString (char *data_s)
+{
+	return AdoptData (data_s, strlen (data_s));
+}
+
+
+BlastResultBuffer *BlastResultBuffer :: AdoptData (char *data_s, const size_t length)
+{
+	BlastResultBuffer *buffer_p = 0;
+
+	try
+		{
+			buffer_p = new BlastResultBuffer (data_s, length, false);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate BlastResultBuffer");
+		}
+
+	return buffer_p;
+}
+
+
+BlastResultBuffer :: BlastResultBuffer (const char *data_s, const size_t length, const bool mapped_flag)
+	: brb_data_s (data_s),
+		brb_length (length),
+		brb_mapped_flag (mapped_flag)
+{
+}
+
+
+BlastResultBuffer :: ~BlastResultBuffer ()
+{
+	if (brb_mapped_flag)
+		{
+			if (munmap ((void *) brb_data_s, brb_length) != 0)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to unmap " SIZET_FMT " bytes, %s", brb_length, strerror (errno));
+				}
+		}
+	else if (brb_data_s != S_EMPTY_S)
+		{
+			FreeCopiedString ((char *) brb_data_s);
+		}
+}
+
+
+const char *BlastResultBuffer :: GetData () const
+{
+	return brb_data_s;
+}
+
+
+size_t BlastResultBuffer :: GetLength () const
+{
+	return brb_length;
+}
+
+
+json_t *BlastResultBuffer :: GetAsJSONString () const
+{
+	return json_stringn (brb_data_s, brb_length);
+}
+
+
+json_t *BlastResultBuffer :: ParseAsJSON (json_error_t *error_p) const
+{
+	return json_loadb (brb_data_s, brb_length, 0, error_p);
+}
+
+
+char *BlastResultBuffer :: CopyToString () const
+{
+	return CopyToNewString (brb_data_s, brb_length, false);
+}
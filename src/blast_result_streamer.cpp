@@ -0,0 +1,1008 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_result_streamer.cpp
+ *
+ *  Created on: 21 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blast_result_streamer.hpp"
+#include "blast_service.h"
+#include "blast_service_params.h"
+#include "blast_service_job_markup.h"
+
+#include "byte_buffer.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_RESULT_STREAMER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_RESULT_STREAMER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/* The size of the buffer used to read the new parts of each output file */
+#define BRS_READ_BUFFER_SIZE	(16384)
+
+
+/*
+ * In the single-file JSON format, each query's report is an
+ * object within the BlastOutput2 array of the top-level object.
+ */
+#define BRS_REPORT_DEPTH	(3)
+
+
+/*
+ * A running job whose results are being collected by
+ * a BlastResultStreamer.
+ */
+typedef struct StreamedJob
+{
+	char stj_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	uint32 stj_output_format;
+
+	/* How much of the output file has been read */
+	off_t stj_offset;
+
+	uint32 stj_queries_completed;
+
+	/*
+	 * The output of the query that is currently being read. This is
+	 * the text of its report for the json format and its lines for the
+	 * tabular formats.
+	 */
+	ByteBuffer *stj_pending_buffer_p;
+
+	/* The current line of tabular output */
+	ByteBuffer *stj_line_buffer_p;
+
+	/* The tabular output of the completed queries */
+	ByteBuffer *stj_completed_buffer_p;
+
+	/* The json reports of the completed queries */
+	json_t *stj_reports_p;
+
+	/* The Grassroots markup of each of the completed reports, created when it is first asked for */
+	json_t *stj_marked_up_p;
+
+	/* The number of reports that have been added to stj_marked_up_p */
+	size_t stj_num_marked_up;
+
+	/*
+	 * The results that were last returned. These are never changed once
+	 * they have been built, so they can be shared with every caller.
+	 */
+	json_t *stj_results_p;
+
+	/* The number of completed queries in stj_results_p */
+	uint32 stj_results_num_queries;
+
+	/* Is stj_results_p the Grassroots markup? */
+	bool stj_results_markup_flag;
+
+	/* How deeply nested the json output that has been read so far is */
+	uint32 stj_depth;
+
+	bool stj_in_string_flag;
+
+	bool stj_escape_flag;
+
+	/* Has the output been unreadable? */
+	bool stj_failed_flag;
+
+	/* When the job's results were last asked for */
+	time_t stj_last_read;
+
+	/*
+	 * The number of references to this job, one of which is held by the
+	 * streamer's list of jobs. This is protected by the streamer's lock.
+	 */
+	uint32 stj_num_references;
+
+	/* This protects the rest of the job while its output is being read */
+	pthread_mutex_t stj_mutex;
+
+	struct StreamedJob *stj_next_p;
+} StreamedJob;
+
+
+static StreamedJob *AllocateStreamedJob (const char *job_id_s, const uint32 output_format);
+
+static void FreeStreamedJob (StreamedJob *job_p);
+
+static void ReleaseStreamedJob (StreamedJob *job_p);
+
+static void ResetStreamedJob (StreamedJob *job_p);
+
+static bool ReadNewOutput (StreamedJob *job_p, const char *filename_s);
+
+static bool ProcessJSONData (StreamedJob *job_p, const char *data_s, const size_t length);
+
+static bool AddCompletedReport (StreamedJob *job_p);
+
+static bool ProcessTabularData (StreamedJob *job_p, const char *data_s, const size_t length);
+
+static bool ProcessTabularLine (StreamedJob *job_p);
+
+static bool IsStartOfNextQuery (const StreamedJob *job_p, const char *line_s);
+
+static json_t *GetReportsAsString (const StreamedJob *job_p);
+
+static bool MarkUpCompletedReports (StreamedJob *job_p, BlastServiceData *data_p);
+
+static json_t *GetMarkupOfCompletedReports (const StreamedJob *job_p);
+
+static json_t *GetCompletedResultsForJob (StreamedJob *job_p, const bool markup_flag, BlastServiceData *data_p);
+
+
+
+BlastResultStreamer *BlastResultStreamer :: brs_shared_streamer_p = 0;
+
+uint32 BlastResultStreamer :: brs_shared_streamer_count = 0;
+
+pthread_mutex_t BlastResultStreamer :: brs_shared_streamer_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const time_t BlastResultStreamer :: BRS_EXPIRY_TIME = 600;
+
+
+
+BlastResultStreamer *BlastResultStreamer :: GetSharedBlastResultStreamer ()
+{
+	BlastResultStreamer *streamer_p = 0;
+
+	pthread_mutex_lock (&brs_shared_streamer_mutex);
+
+	if (!brs_shared_streamer_p)
+		{
+			try
+				{
+					brs_shared_streamer_p = new BlastResultStreamer ();
+
+					#if BLAST_RESULT_STREAMER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared BlastResultStreamer");
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastResultStreamer");
+				}
+		}
+
+	if (brs_shared_streamer_p)
+		{
+			++ brs_shared_streamer_count;
+			streamer_p = brs_shared_streamer_p;
+		}
+
+	pthread_mutex_unlock (&brs_shared_streamer_mutex);
+
+	return streamer_p;
+}
+
+
+void BlastResultStreamer :: ReleaseSharedBlastResultStreamer ()
+{
+	BlastResultStreamer *streamer_to_free_p = 0;
+
+	pthread_mutex_lock (&brs_shared_streamer_mutex);
+
+	if (brs_shared_streamer_count > 0)
+		{
+			-- brs_shared_streamer_count;
+
+			if (brs_shared_streamer_count == 0)
+				{
+					streamer_to_free_p = brs_shared_streamer_p;
+					brs_shared_streamer_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&brs_shared_streamer_mutex);
+
+	if (streamer_to_free_p)
+		{
+			delete streamer_to_free_p;
+		}
+}
+
+
+bool BlastResultStreamer :: CanStreamOutputFormat (const uint32 output_format)
+{
+	bool stream_flag = false;
+
+	switch (output_format)
+		{
+			case BOF_TABULAR:
+			case BOF_TABULAR_WITH_COMMENTS:
+			case BOF_CSV:
+			case BOF_SINGLE_FILE_JSON_BLAST:
+				stream_flag = true;
+				break;
+
+			/*
+			 * The other formats either have headers and footers that
+			 * would need rebuilding or are only written at the end.
+			 */
+			default:
+				break;
+		}
+
+	return stream_flag;
+}
+
+
+BlastResultStreamer :: BlastResultStreamer ()
+	: brs_jobs_p (0)
+{
+	if (pthread_mutex_init (&brs_mutex, NULL) != 0)
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastResultStreamer :: ~BlastResultStreamer ()
+{
+	StreamedJob *job_p = brs_jobs_p;
+
+	while (job_p)
+		{
+			StreamedJob *next_p = job_p -> stj_next_p;
+
+			FreeStreamedJob (job_p);
+			job_p = next_p;
+		}
+
+	pthread_mutex_destroy (&brs_mutex);
+}
+
+
+json_t *BlastResultStreamer :: GetCompletedResults (const char *job_id_s, const char *output_filename_s, const uint32 output_format, const bool markup_flag, BlastServiceData *data_p, uint32 *num_queries_p)
+{
+	json_t *results_p = NULL;
+	StreamedJob *job_p;
+	time_t now = time (NULL);
+
+	if (!CanStreamOutputFormat (output_format))
+		{
+			return NULL;
+		}
+
+	/* The streamer's lock is only held while finding the job */
+	pthread_mutex_lock (&brs_mutex);
+
+	RemoveExpiredJobs (now);
+
+	job_p = GetJob (job_id_s, output_format);
+
+	if (job_p)
+		{
+			job_p -> stj_last_read = now;
+			++ (job_p -> stj_num_references);
+		}
+
+	pthread_mutex_unlock (&brs_mutex);
+
+	if (job_p)
+		{
+			/*
+			 * Reading, parsing and marking up the new output only needs the
+			 * job's own lock, so polling a large job doesn't hold up the others.
+			 */
+			pthread_mutex_lock (& (job_p -> stj_mutex));
+
+			if (job_p -> stj_output_format != output_format)
+				{
+					ResetStreamedJob (job_p);
+					job_p -> stj_output_format = output_format;
+				}
+
+			if (!job_p -> stj_failed_flag)
+				{
+					if (ReadNewOutput (job_p, output_filename_s))
+						{
+							results_p = GetCompletedResultsForJob (job_p, markup_flag, data_p);
+
+							if (results_p)
+								{
+									*num_queries_p = job_p -> stj_results_num_queries;
+								}
+						}
+					else
+						{
+							job_p -> stj_failed_flag = true;
+						}
+				}
+
+			pthread_mutex_unlock (& (job_p -> stj_mutex));
+
+			pthread_mutex_lock (&brs_mutex);
+			ReleaseStreamedJob (job_p);
+			pthread_mutex_unlock (&brs_mutex);
+		}		/* if (job_p) */
+
+	return results_p;
+}
+
+
+void BlastResultStreamer :: Forget (const char *job_id_s)
+{
+	StreamedJob *prev_p = NULL;
+	StreamedJob *job_p;
+
+	pthread_mutex_lock (&brs_mutex);
+
+	for (job_p = brs_jobs_p; job_p; prev_p = job_p, job_p = job_p -> stj_next_p)
+		{
+			if (strcmp (job_p -> stj_job_id_s, job_id_s) == 0)
+				{
+					if (prev_p)
+						{
+							prev_p -> stj_next_p = job_p -> stj_next_p;
+						}
+					else
+						{
+							brs_jobs_p = job_p -> stj_next_p;
+						}
+
+					ReleaseStreamedJob (job_p);
+					break;
+				}
+		}
+
+	pthread_mutex_unlock (&brs_mutex);
+}
+
+
+/*
+ * This must be called with brs_mutex held. If the job is already being
+ * followed, any change of its output format is dealt with once its own
+ * lock is held.
+ */
+StreamedJob *BlastResultStreamer :: GetJob (const char *job_id_s, const uint32 output_format)
+{
+	StreamedJob *job_p;
+
+	for (job_p = brs_jobs_p; job_p; job_p = job_p -> stj_next_p)
+		{
+			if (strcmp (job_p -> stj_job_id_s, job_id_s) == 0)
+				{
+					return job_p;
+				}
+		}
+
+	job_p = AllocateStreamedJob (job_id_s, output_format);
+
+	if (job_p)
+		{
+			job_p -> stj_next_p = brs_jobs_p;
+			brs_jobs_p = job_p;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate streamed results for \"%s\"", job_id_s);
+		}
+
+	return job_p;
+}
+
+
+void BlastResultStreamer :: RemoveExpiredJobs (const time_t now)
+{
+	StreamedJob *prev_p = NULL;
+	StreamedJob *job_p = brs_jobs_p;
+
+	while (job_p)
+		{
+			StreamedJob *next_p = job_p -> stj_next_p;
+
+			if (now - job_p -> stj_last_read > BRS_EXPIRY_TIME)
+				{
+					if (prev_p)
+						{
+							prev_p -> stj_next_p = next_p;
+						}
+					else
+						{
+							brs_jobs_p = next_p;
+						}
+
+					#if BLAST_RESULT_STREAMER_DEBUG >= STM_LEVEL_FINER
+					PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Stopped streaming results of \"%s\"", job_p -> stj_job_id_s);
+					#endif
+
+					ReleaseStreamedJob (job_p);
+				}
+			else
+				{
+					prev_p = job_p;
+				}
+
+			job_p = next_p;
+		}
+}
+
+
+static StreamedJob *AllocateStreamedJob (const char *job_id_s, const uint32 output_format)
+{
+	StreamedJob *job_p = (StreamedJob *) AllocMemory (sizeof (StreamedJob));
+
+	if (job_p)
+		{
+			memset (job_p, 0, sizeof (StreamedJob));
+
+			job_p -> stj_pending_buffer_p = AllocateByteBuffer (1024);
+
+			if (job_p -> stj_pending_buffer_p)
+				{
+					job_p -> stj_line_buffer_p = AllocateByteBuffer (1024);
+
+					if (job_p -> stj_line_buffer_p)
+						{
+							job_p -> stj_completed_buffer_p = AllocateByteBuffer (1024);
+
+							if (job_p -> stj_completed_buffer_p)
+								{
+									job_p -> stj_reports_p = json_array ();
+
+									if (job_p -> stj_reports_p)
+										{
+											if (pthread_mutex_init (& (job_p -> stj_mutex), NULL) == 0)
+												{
+													strncpy (job_p -> stj_job_id_s, job_id_s, UUID_STRING_BUFFER_SIZE - 1);
+													job_p -> stj_output_format = output_format;
+													job_p -> stj_num_references = 1;
+
+													return job_p;
+												}
+
+											json_decref (job_p -> stj_reports_p);
+										}
+
+									FreeByteBuffer (job_p -> stj_completed_buffer_p);
+								}
+
+							FreeByteBuffer (job_p -> stj_line_buffer_p);
+						}
+
+					FreeByteBuffer (job_p -> stj_pending_buffer_p);
+				}
+
+			FreeMemory (job_p);
+		}
+
+	return NULL;
+}
+
+
+static void FreeStreamedJob (StreamedJob *job_p)
+{
+	FreeByteBuffer (job_p -> stj_pending_buffer_p);
+	FreeByteBuffer (job_p -> stj_line_buffer_p);
+	FreeByteBuffer (job_p -> stj_completed_buffer_p);
+
+	json_decref (job_p -> stj_reports_p);
+
+	if (job_p -> stj_marked_up_p)
+		{
+			json_decref (job_p -> stj_marked_up_p);
+		}
+
+	if (job_p -> stj_results_p)
+		{
+			json_decref (job_p -> stj_results_p);
+		}
+
+	pthread_mutex_destroy (& (job_p -> stj_mutex));
+
+	FreeMemory (job_p);
+}
+
+
+/*
+ * This must be called with the streamer's lock held. The job is only
+ * freed once it has been removed from the streamer's list and nobody
+ * is still reading its output.
+ */
+static void ReleaseStreamedJob (StreamedJob *job_p)
+{
+	-- (job_p -> stj_num_references);
+
+	if (job_p -> stj_num_references == 0)
+		{
+			FreeStreamedJob (job_p);
+		}
+}
+
+
+static void ResetStreamedJob (StreamedJob *job_p)
+{
+	ResetByteBuffer (job_p -> stj_pending_buffer_p);
+	ResetByteBuffer (job_p -> stj_line_buffer_p);
+	ResetByteBuffer (job_p -> stj_completed_buffer_p);
+
+	json_array_clear (job_p -> stj_reports_p);
+
+	if (job_p -> stj_marked_up_p)
+		{
+			json_decref (job_p -> stj_marked_up_p);
+			job_p -> stj_marked_up_p = NULL;
+		}
+
+	if (job_p -> stj_results_p)
+		{
+			json_decref (job_p -> stj_results_p);
+			job_p -> stj_results_p = NULL;
+		}
+
+	job_p -> stj_num_marked_up = 0;
+	job_p -> stj_results_num_queries = 0;
+	job_p -> stj_results_markup_flag = false;
+	job_p -> stj_offset = 0;
+	job_p -> stj_queries_completed = 0;
+	job_p -> stj_depth = 0;
+	job_p -> stj_in_string_flag = false;
+	job_p -> stj_escape_flag = false;
+	job_p -> stj_failed_flag = false;
+}
+
+
+/*
+ * Read the part of the output that has been written since it was last
+ * read. If the file has got smaller, it has been rewritten so it is
+ * read again from the start.
+ */
+static bool ReadNewOutput (StreamedJob *job_p, const char *filename_s)
+{
+	bool success_flag = false;
+	int fd = open (filename_s, O_RDONLY | O_CLOEXEC);
+
+	if (fd != -1)
+		{
+			struct stat st;
+
+			if (fstat (fd, &st) == 0)
+				{
+					if (st.st_size < job_p -> stj_offset)
+						{
+							ResetStreamedJob (job_p);
+						}
+
+					if (st.st_size > job_p -> stj_offset)
+						{
+							if (lseek (fd, job_p -> stj_offset, SEEK_SET) == job_p -> stj_offset)
+								{
+									const bool json_flag = (job_p -> stj_output_format == BOF_SINGLE_FILE_JSON_BLAST);
+									char buffer_s [BRS_READ_BUFFER_SIZE];
+									ssize_t num_read;
+
+									success_flag = true;
+
+									while (success_flag && ((num_read = read (fd, buffer_s, BRS_READ_BUFFER_SIZE)) > 0))
+										{
+											if (json_flag)
+												{
+													success_flag = ProcessJSONData (job_p, buffer_s, (size_t) num_read);
+												}
+											else
+												{
+													success_flag = ProcessTabularData (job_p, buffer_s, (size_t) num_read);
+												}
+
+											job_p -> stj_offset += num_read;
+										}
+
+									if (success_flag && (num_read != 0))
+										{
+											success_flag = false;
+										}
+								}
+						}
+					else
+						{
+							success_flag = true;
+						}
+				}
+
+			close (fd);
+		}
+	else if (errno == ENOENT)
+		{
+			/* Nothing has been written yet */
+			success_flag = true;
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read results of \"%s\" from \"%s\"", job_p -> stj_job_id_s, filename_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Scan through the json output keeping track of how deeply nested
+ * it is, so that each query's report can be picked out as soon as
+ * its closing brace has been written.
+ */
+static bool ProcessJSONData (StreamedJob *job_p, const char *data_s, const size_t length)
+{
+	bool success_flag = true;
+	const char *end_s = data_s + length;
+	const char *c_p;
+
+	/* The start of the part of this data that belongs to the current report */
+	const char *report_s = (job_p -> stj_depth >= BRS_REPORT_DEPTH) ? data_s : NULL;
+
+	for (c_p = data_s; (c_p < end_s) && success_flag; ++ c_p)
+		{
+			const char c = *c_p;
+
+			if (job_p -> stj_in_string_flag)
+				{
+					if (job_p -> stj_escape_flag)
+						{
+							job_p -> stj_escape_flag = false;
+						}
+					else if (c == '\\')
+						{
+							job_p -> stj_escape_flag = true;
+						}
+					else if (c == '"')
+						{
+							job_p -> stj_in_string_flag = false;
+						}
+				}
+			else if (c == '"')
+				{
+					job_p -> stj_in_string_flag = true;
+				}
+			else if ((c == '{') || (c == '['))
+				{
+					++ (job_p -> stj_depth);
+
+					if (job_p -> stj_depth == BRS_REPORT_DEPTH)
+						{
+							report_s = c_p;
+						}
+				}
+			else if ((c == '}') || (c == ']'))
+				{
+					if (job_p -> stj_depth == BRS_REPORT_DEPTH)
+						{
+							success_flag = AppendToByteBuffer (job_p -> stj_pending_buffer_p, report_s, c_p + 1 - report_s) && AddCompletedReport (job_p);
+							report_s = NULL;
+						}
+
+					if (job_p -> stj_depth > 0)
+						{
+							-- (job_p -> stj_depth);
+						}
+				}
+		}
+
+	if (success_flag && report_s)
+		{
+			success_flag = AppendToByteBuffer (job_p -> stj_pending_buffer_p, report_s, end_s - report_s);
+		}
+
+	return success_flag;
+}
+
+
+static bool AddCompletedReport (StreamedJob *job_p)
+{
+	bool success_flag = false;
+	json_error_t err;
+	json_t *report_p = json_loads (GetByteBufferData (job_p -> stj_pending_buffer_p), 0, &err);
+
+	if (report_p)
+		{
+			if (json_array_append_new (job_p -> stj_reports_p, report_p) == 0)
+				{
+					++ (job_p -> stj_queries_completed);
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add report " UINT32_FMT " for \"%s\"", job_p -> stj_queries_completed, job_p -> stj_job_id_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to parse report " UINT32_FMT " for \"%s\": %s", job_p -> stj_queries_completed, job_p -> stj_job_id_s, err.text);
+		}
+
+	ResetByteBuffer (job_p -> stj_pending_buffer_p);
+
+	return success_flag;
+}
+
+
+static bool ProcessTabularData (StreamedJob *job_p, const char *data_s, const size_t length)
+{
+	bool success_flag = true;
+	const char *end_s = data_s + length;
+
+	while ((data_s < end_s) && success_flag)
+		{
+			const char *newline_s = (const char *) memchr (data_s, '\n', end_s - data_s);
+			const char *line_end_s = newline_s ? newline_s + 1 : end_s;
+
+			success_flag = AppendToByteBuffer (job_p -> stj_line_buffer_p, data_s, line_end_s - data_s);
+
+			if (success_flag && newline_s)
+				{
+					success_flag = ProcessTabularLine (job_p);
+				}
+
+			data_s = line_end_s;
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Add a complete line of tabular output to the current query. If it
+ * is the first line of the next query, the lines of the current query
+ * are moved to the completed output.
+ */
+static bool ProcessTabularLine (StreamedJob *job_p)
+{
+	bool success_flag = true;
+	const char *line_s = GetByteBufferData (job_p -> stj_line_buffer_p);
+
+	if ((job_p -> stj_pending_buffer_p -> bb_current_index > 0) && IsStartOfNextQuery (job_p, line_s))
+		{
+			success_flag = AppendToByteBuffer (job_p -> stj_completed_buffer_p, GetByteBufferData (job_p -> stj_pending_buffer_p), job_p -> stj_pending_buffer_p -> bb_current_index);
+			ResetByteBuffer (job_p -> stj_pending_buffer_p);
+
+			++ (job_p -> stj_queries_completed);
+		}
+
+	if (success_flag)
+		{
+			success_flag = AppendToByteBuffer (job_p -> stj_pending_buffer_p, line_s, job_p -> stj_line_buffer_p -> bb_current_index);
+		}
+
+	ResetByteBuffer (job_p -> stj_line_buffer_p);
+
+	return success_flag;
+}
+
+
+static bool IsStartOfNextQuery (const StreamedJob *job_p, const char *line_s)
+{
+	bool next_flag = false;
+
+	if (job_p -> stj_output_format == BOF_TABULAR_WITH_COMMENTS)
+		{
+			/* Each query starts with a comment block that begins with the program name and version */
+			next_flag = (strncmp (line_s, "# BLAST", 7) == 0);
+		}
+	else
+		{
+			/*
+			 * There are no markers, so look for a change in the query id in
+			 * the first column. Queries without any hits don't appear at all.
+			 */
+			const char sep = (job_p -> stj_output_format == BOF_CSV) ? ',' : '\t';
+			const char *current_s = GetByteBufferData (job_p -> stj_pending_buffer_p);
+			const char *sep_p = strchr (line_s, sep);
+
+			if (sep_p)
+				{
+					const size_t id_length = sep_p - line_s;
+
+					next_flag = ((strncmp (current_s, line_s, id_length) != 0) || (current_s [id_length] != sep));
+				}
+		}
+
+	return next_flag;
+}
+
+
+static json_t *GetReportsAsString (const StreamedJob *job_p)
+{
+	json_t *results_p = NULL;
+	json_t *output_p = json_object ();
+
+	if (output_p)
+		{
+			if (json_object_set (output_p, "BlastOutput2", job_p -> stj_reports_p) == 0)
+				{
+					char *output_s = json_dumps (output_p, JSON_INDENT (2));
+
+					if (output_s)
+						{
+							results_p = json_string (output_s);
+							free (output_s);
+						}
+				}
+
+			json_decref (output_p);
+		}
+
+	if (!results_p)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get the completed reports for \"%s\"", job_p -> stj_job_id_s);
+		}
+
+	return results_p;
+}
+
+
+/*
+ * Only build the results again if more queries have been completed
+ * since they were last asked for. Once they have been built, they
+ * are never changed so each caller gets a reference to them rather
+ * than a copy.
+ */
+static json_t *GetCompletedResultsForJob (StreamedJob *job_p, const bool markup_flag, BlastServiceData *data_p)
+{
+	const bool json_flag = (job_p -> stj_output_format == BOF_SINGLE_FILE_JSON_BLAST);
+	const bool use_markup_flag = json_flag && markup_flag;
+
+	if ((!job_p -> stj_results_p) || (job_p -> stj_results_num_queries != job_p -> stj_queries_completed) || (job_p -> stj_results_markup_flag != use_markup_flag))
+		{
+			json_t *results_p = NULL;
+
+			if (use_markup_flag)
+				{
+					if (MarkUpCompletedReports (job_p, data_p))
+						{
+							results_p = GetMarkupOfCompletedReports (job_p);
+						}
+				}
+			else if (json_flag)
+				{
+					results_p = GetReportsAsString (job_p);
+				}
+			else
+				{
+					results_p = json_string (GetByteBufferData (job_p -> stj_completed_buffer_p));
+				}
+
+			if (!results_p)
+				{
+					return NULL;
+				}
+
+			if (job_p -> stj_results_p)
+				{
+					json_decref (job_p -> stj_results_p);
+				}
+
+			job_p -> stj_results_p = results_p;
+			job_p -> stj_results_num_queries = job_p -> stj_queries_completed;
+			job_p -> stj_results_markup_flag = use_markup_flag;
+		}
+
+	return json_incref (job_p -> stj_results_p);
+}
+
+
+/*
+ * Mark up any of the reports that have been completed since the
+ * last time and add them to the job's marked up reports.
+ */
+static bool MarkUpCompletedReports (StreamedJob *job_p, BlastServiceData *data_p)
+{
+	bool success_flag = true;
+	const size_t num_reports = json_array_size (job_p -> stj_reports_p);
+
+	if (!job_p -> stj_marked_up_p)
+		{
+			job_p -> stj_marked_up_p = json_array ();
+
+			if (!job_p -> stj_marked_up_p)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create markup for \"%s\"", job_p -> stj_job_id_s);
+					return false;
+				}
+		}
+
+	while ((job_p -> stj_num_marked_up < num_reports) && success_flag)
+		{
+			json_t *blast_output_p = json_object ();
+
+			success_flag = false;
+
+			if (blast_output_p)
+				{
+					json_t *reports_p = json_array ();
+
+					if (reports_p)
+						{
+							if (json_object_set_new (blast_output_p, "BlastOutput2", reports_p) == 0)
+								{
+									if (json_array_append (reports_p, json_array_get (job_p -> stj_reports_p, job_p -> stj_num_marked_up)) == 0)
+										{
+											json_t *markup_p = ConvertBlastResultToGrassrootsMarkUp (blast_output_p, data_p);
+
+											/* A query without any hits has nothing to mark up */
+											if (markup_p)
+												{
+													success_flag = (json_array_extend (job_p -> stj_marked_up_p, GetMarkupReports (markup_p)) == 0);
+													json_decref (markup_p);
+												}
+											else
+												{
+													success_flag = true;
+												}
+										}
+								}
+							else
+								{
+									json_decref (reports_p);
+								}
+						}
+
+					json_decref (blast_output_p);
+				}		/* if (blast_output_p) */
+
+			if (success_flag)
+				{
+					++ (job_p -> stj_num_marked_up);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to mark up report " SIZET_FMT " for \"%s\"", job_p -> stj_num_marked_up, job_p -> stj_job_id_s);
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The marked up reports are shared with any earlier results rather
+ * than copied, which is safe as they are not changed once added.
+ */
+static json_t *GetMarkupOfCompletedReports (const StreamedJob *job_p)
+{
+	json_t *markup_p = GetInitialisedProcessedRequest ();
+
+	if (markup_p)
+		{
+			if (json_array_extend (GetMarkupReports (markup_p), job_p -> stj_marked_up_p) == 0)
+				{
+					return markup_p;
+				}
+
+			json_decref (markup_p);
+		}
+
+	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create markup for \"%s\"", job_p -> stj_job_id_s);
+
+	return NULL;
+}
@@ -0,0 +1,595 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_scheduler.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <stdint.h>
+
+#include <unistd.h>
+
+#include "blast_scheduler.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_SCHEDULER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_SCHEDULER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/**
+ * The amount of work, measured as the query size multiplied by the database
+ * size, that is worth giving an extra thread to. This is roughly a 1 kb query
+ * against a 100 Mb database. Anything smaller runs quicker with a single thread
+ * than it takes blast to start the others.
+ */
+#define BS_WORK_PER_THREAD	(100000000000ULL)
+
+
+/*
+ * A job that is waiting for cores without a thread
+ * blocked in WaitForCores.
+ */
+struct BlastSchedulerWaitingJob
+{
+	struct BlastSchedulerWaitingJob *bswj_next_p;
+
+	/* This is NULL if the job has been removed before its turn came */
+	BlastSchedulerAdmitFn bswj_admit_fn;
+
+	void *bswj_data_p;
+
+	uint32 bswj_num_cores;
+
+	uint32 bswj_ticket;
+};
+
+
+const char * const BlastScheduler :: BS_QUEUE_FULL_S = "The server is too busy to run this search at the moment, please try again later";
+
+const char * const BlastScheduler :: BS_SHUTTING_DOWN_S = "The server shut down before this search could be run, please try again later";
+
+
+BlastScheduler *BlastScheduler :: bs_shared_scheduler_p = 0;
+
+uint32 BlastScheduler :: bs_shared_scheduler_count = 0;
+
+pthread_mutex_t BlastScheduler :: bs_shared_scheduler_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+BlastScheduler *BlastScheduler :: GetSharedBlastScheduler (uint32 max_cores, uint32 max_queued_jobs)
+{
+	BlastScheduler *scheduler_p = 0;
+
+	pthread_mutex_lock (&bs_shared_scheduler_mutex);
+
+	if (!bs_shared_scheduler_p)
+		{
+			if (max_cores == 0)
+				{
+					long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+					max_cores = (num_cpus > 0) ? (uint32) num_cpus : 1;
+				}
+
+			try
+				{
+					bs_shared_scheduler_p = new BlastScheduler (max_cores, max_queued_jobs);
+
+					#if BLAST_SCHEDULER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared BlastScheduler with " UINT32_FMT " cores and " UINT32_FMT " queued jobs", max_cores, max_queued_jobs);
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastScheduler with " UINT32_FMT " cores", max_cores);
+				}
+		}
+	else if ((max_cores != 0) && (max_cores != bs_shared_scheduler_p -> bs_max_cores))
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Shared BlastScheduler already has " UINT32_FMT " cores, ignoring request for " UINT32_FMT, bs_shared_scheduler_p -> bs_max_cores, max_cores);
+		}
+
+	if (bs_shared_scheduler_p)
+		{
+			++ bs_shared_scheduler_count;
+			scheduler_p = bs_shared_scheduler_p;
+		}
+
+	pthread_mutex_unlock (&bs_shared_scheduler_mutex);
+
+	return scheduler_p;
+}
+
+
+void BlastScheduler :: ReleaseSharedBlastScheduler ()
+{
+	BlastScheduler *scheduler_to_free_p = 0;
+
+	pthread_mutex_lock (&bs_shared_scheduler_mutex);
+
+	if (bs_shared_scheduler_count > 0)
+		{
+			-- bs_shared_scheduler_count;
+
+			if (bs_shared_scheduler_count == 0)
+				{
+					scheduler_to_free_p = bs_shared_scheduler_p;
+					bs_shared_scheduler_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&bs_shared_scheduler_mutex);
+
+	if (scheduler_to_free_p)
+		{
+			delete scheduler_to_free_p;
+		}
+}
+
+
+BlastScheduler :: BlastScheduler (uint32 max_cores, uint32 max_queued_jobs)
+	: bs_max_cores (max_cores),
+		bs_num_used_cores (0),
+		bs_max_queued_jobs (max_queued_jobs),
+		bs_num_queued_jobs (0),
+		bs_next_ticket (0),
+		bs_current_ticket (0),
+		bs_waiting_jobs_p (0),
+		bs_last_waiting_job_p (0)
+{
+	if (pthread_mutex_init (&bs_mutex, NULL) != 0)
+		{
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&bs_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&bs_mutex);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastScheduler :: ~BlastScheduler ()
+{
+	/*
+	 * Any jobs that are still waiting will never get their cores,
+	 * so admit them with none to let them fail and complete.
+	 */
+	while (bs_waiting_jobs_p)
+		{
+			BlastSchedulerWaitingJob *next_p = bs_waiting_jobs_p -> bswj_next_p;
+
+			if (bs_waiting_jobs_p -> bswj_admit_fn)
+				{
+					bs_waiting_jobs_p -> bswj_admit_fn (bs_waiting_jobs_p -> bswj_data_p, 0);
+				}
+
+			FreeMemory (bs_waiting_jobs_p);
+			bs_waiting_jobs_p = next_p;
+		}
+
+	pthread_cond_destroy (&bs_cond);
+	pthread_mutex_destroy (&bs_mutex);
+}
+
+
+bool BlastScheduler :: ReserveQueueSlot ()
+{
+	bool success_flag = false;
+
+	pthread_mutex_lock (&bs_mutex);
+
+	if (bs_num_queued_jobs < bs_max_queued_jobs)
+		{
+			++ bs_num_queued_jobs;
+			success_flag = true;
+		}
+
+	pthread_mutex_unlock (&bs_mutex);
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Blast job queue is full with " UINT32_FMT " jobs", bs_max_queued_jobs);
+		}
+
+	return success_flag;
+}
+
+
+void BlastScheduler :: CancelQueueSlot ()
+{
+	pthread_mutex_lock (&bs_mutex);
+
+	if (bs_num_queued_jobs > 0)
+		{
+			-- bs_num_queued_jobs;
+		}
+
+	pthread_mutex_unlock (&bs_mutex);
+}
+
+
+uint32 BlastScheduler :: WaitForCores (uint32 num_cores)
+{
+	BlastSchedulerWaitingJob *admitted_jobs_p;
+	uint32 ticket;
+
+	num_cores = LimitNumCores (num_cores);
+
+	pthread_mutex_lock (&bs_mutex);
+
+	ticket = bs_next_ticket;
+	++ bs_next_ticket;
+
+	while ((ticket != bs_current_ticket) || (bs_num_used_cores + num_cores > bs_max_cores))
+		{
+			pthread_cond_wait (&bs_cond, &bs_mutex);
+		}
+
+	++ bs_current_ticket;
+	bs_num_used_cores += num_cores;
+
+	if (bs_num_queued_jobs > 0)
+		{
+			-- bs_num_queued_jobs;
+		}
+
+	/* Let the next job in line see if it can run too */
+	pthread_cond_broadcast (&bs_cond);
+
+	#if BLAST_SCHEDULER_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Admitted job using " UINT32_FMT " cores, " UINT32_FMT " of " UINT32_FMT " cores now in use", num_cores, bs_num_used_cores, bs_max_cores);
+	#endif
+
+	admitted_jobs_p = AdmitWaitingJobs ();
+
+	pthread_mutex_unlock (&bs_mutex);
+
+	LaunchAdmittedJobs (admitted_jobs_p);
+
+	return num_cores;
+}
+
+
+bool BlastScheduler :: AddWaitingJob (uint32 num_cores, BlastSchedulerAdmitFn admit_fn, void *data_p)
+{
+	BlastSchedulerWaitingJob *job_p = (BlastSchedulerWaitingJob *) AllocMemory (sizeof (BlastSchedulerWaitingJob));
+
+	if (job_p)
+		{
+			BlastSchedulerWaitingJob *admitted_jobs_p;
+
+			job_p -> bswj_next_p = 0;
+			job_p -> bswj_admit_fn = admit_fn;
+			job_p -> bswj_data_p = data_p;
+			job_p -> bswj_num_cores = LimitNumCores (num_cores);
+
+			pthread_mutex_lock (&bs_mutex);
+
+			job_p -> bswj_ticket = bs_next_ticket;
+			++ bs_next_ticket;
+
+			if (bs_last_waiting_job_p)
+				{
+					bs_last_waiting_job_p -> bswj_next_p = job_p;
+				}
+			else
+				{
+					bs_waiting_jobs_p = job_p;
+				}
+
+			bs_last_waiting_job_p = job_p;
+
+			admitted_jobs_p = AdmitWaitingJobs ();
+
+			pthread_mutex_unlock (&bs_mutex);
+
+			LaunchAdmittedJobs (admitted_jobs_p);
+
+			return true;
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate waiting job for " UINT32_FMT " cores", num_cores);
+		}
+
+	return false;
+}
+
+
+bool BlastScheduler :: RemoveWaitingJob (void *data_p)
+{
+	BlastSchedulerWaitingJob *admitted_jobs_p = 0;
+	BlastSchedulerWaitingJob *job_p;
+	bool removed_flag = false;
+
+	pthread_mutex_lock (&bs_mutex);
+
+	for (job_p = bs_waiting_jobs_p; job_p; job_p = job_p -> bswj_next_p)
+		{
+			if ((job_p -> bswj_data_p == data_p) && (job_p -> bswj_admit_fn))
+				{
+					/*
+					 * The job keeps its ticket so that the jobs behind it don't lose
+					 * their places, it is just skipped over once its turn comes.
+					 */
+					job_p -> bswj_admit_fn = 0;
+
+					if (bs_num_queued_jobs > 0)
+						{
+							-- bs_num_queued_jobs;
+						}
+
+					removed_flag = true;
+					break;
+				}
+		}
+
+	if (removed_flag)
+		{
+			admitted_jobs_p = AdmitWaitingJobs ();
+		}
+
+	pthread_mutex_unlock (&bs_mutex);
+
+	LaunchAdmittedJobs (admitted_jobs_p);
+
+	return removed_flag;
+}
+
+
+void BlastScheduler :: ReleaseCores (uint32 num_cores)
+{
+	BlastSchedulerWaitingJob *admitted_jobs_p;
+
+	pthread_mutex_lock (&bs_mutex);
+
+	if (bs_num_used_cores >= num_cores)
+		{
+			bs_num_used_cores -= num_cores;
+		}
+	else
+		{
+			bs_num_used_cores = 0;
+		}
+
+	pthread_cond_broadcast (&bs_cond);
+
+	admitted_jobs_p = AdmitWaitingJobs ();
+
+	pthread_mutex_unlock (&bs_mutex);
+
+	LaunchAdmittedJobs (admitted_jobs_p);
+}
+
+
+uint32 BlastScheduler :: GetNumThreadsForJob (uint64 query_size, uint64 db_size, uint32 max_threads)
+{
+	uint32 num_threads = bs_max_cores;
+	uint32 num_free_cores;
+	uint32 num_queued_jobs;
+	uint64 threads_for_work = 0;
+
+	/*
+	 * If the size of the database couldn't be found, just use the job's
+	 * share of the free cores. Otherwise the work for a large query against
+	 * a large database could overflow, in which case it is capped as it
+	 * would use all of the cores anyway.
+	 */
+	if (db_size > 0)
+		{
+			const uint64 work = (query_size <= (UINT64_MAX / db_size)) ? query_size * db_size : UINT64_MAX;
+
+			threads_for_work = work / BS_WORK_PER_THREAD + 1;
+		}
+	else
+		{
+			#if BLAST_SCHEDULER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Database size is unknown, so the number of threads depends only upon the free cores");
+			#endif
+		}
+
+	pthread_mutex_lock (&bs_mutex);
+	num_free_cores = (bs_num_used_cores < bs_max_cores) ? bs_max_cores - bs_num_used_cores : 0;
+	num_queued_jobs = bs_num_queued_jobs;
+	pthread_mutex_unlock (&bs_mutex);
+
+	/* Share the free cores between all of the waiting jobs, which includes this one */
+	if (num_queued_jobs > 1)
+		{
+			num_free_cores /= num_queued_jobs;
+		}
+
+	if (num_threads > num_free_cores)
+		{
+			num_threads = num_free_cores;
+		}
+
+	if ((threads_for_work > 0) && (num_threads > threads_for_work))
+		{
+			num_threads = (uint32) threads_for_work;
+		}
+
+	if ((max_threads > 0) && (num_threads > max_threads))
+		{
+			num_threads = max_threads;
+		}
+
+	if (num_threads == 0)
+		{
+			num_threads = 1;
+		}
+
+	#if BLAST_SCHEDULER_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Using " UINT32_FMT " threads for job with query size " UINT64_FMT " and database size " UINT64_FMT, num_threads, query_size, db_size);
+	#endif
+
+	return num_threads;
+}
+
+
+uint32 BlastScheduler :: GetMaxCores () const
+{
+	return bs_max_cores;
+}
+
+
+uint32 BlastScheduler :: GetNumUsedCores ()
+{
+	uint32 num_cores;
+
+	pthread_mutex_lock (&bs_mutex);
+	num_cores = bs_num_used_cores;
+	pthread_mutex_unlock (&bs_mutex);
+
+	return num_cores;
+}
+
+
+uint32 BlastScheduler :: ShareCores (const uint32 num_cores, const uint32 num_parts, uint32 *max_running_parts_p)
+{
+	uint32 threads_per_part = 1;
+
+	if (num_cores >= num_parts)
+		{
+			threads_per_part = num_cores / num_parts;
+			*max_running_parts_p = num_parts;
+		}
+	else
+		{
+			*max_running_parts_p = (num_cores > 0) ? num_cores : 1;
+		}
+
+	return threads_per_part;
+}
+
+
+uint32 BlastScheduler :: LimitNumCores (uint32 num_cores) const
+{
+	/* A job can never use more than all of the cores */
+	if (num_cores > bs_max_cores)
+		{
+			num_cores = bs_max_cores;
+		}
+	else if (num_cores == 0)
+		{
+			num_cores = 1;
+		}
+
+	return num_cores;
+}
+
+
+/*
+ * Take the jobs from the front of bs_waiting_jobs_p whose turn it is and
+ * that there are enough free cores for. This must be called with bs_mutex
+ * held and the returned jobs launched with LaunchAdmittedJobs once it has
+ * been released.
+ */
+BlastSchedulerWaitingJob *BlastScheduler :: AdmitWaitingJobs ()
+{
+	BlastSchedulerWaitingJob *admitted_jobs_p = 0;
+	BlastSchedulerWaitingJob *last_admitted_job_p = 0;
+	bool admitted_flag = false;
+
+	while (bs_waiting_jobs_p && (bs_waiting_jobs_p -> bswj_ticket == bs_current_ticket))
+		{
+			BlastSchedulerWaitingJob *job_p = bs_waiting_jobs_p;
+
+			if (job_p -> bswj_admit_fn)
+				{
+					if (bs_num_used_cores + (job_p -> bswj_num_cores) > bs_max_cores)
+						{
+							break;
+						}
+
+					bs_num_used_cores += job_p -> bswj_num_cores;
+
+					if (bs_num_queued_jobs > 0)
+						{
+							-- bs_num_queued_jobs;
+						}
+
+					#if BLAST_SCHEDULER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Admitted waiting job using " UINT32_FMT " cores, " UINT32_FMT " of " UINT32_FMT " cores now in use", job_p -> bswj_num_cores, bs_num_used_cores, bs_max_cores);
+					#endif
+				}
+
+			bs_waiting_jobs_p = job_p -> bswj_next_p;
+
+			if (!bs_waiting_jobs_p)
+				{
+					bs_last_waiting_job_p = 0;
+				}
+
+			++ bs_current_ticket;
+			admitted_flag = true;
+
+			if (job_p -> bswj_admit_fn)
+				{
+					job_p -> bswj_next_p = 0;
+
+					if (last_admitted_job_p)
+						{
+							last_admitted_job_p -> bswj_next_p = job_p;
+						}
+					else
+						{
+							admitted_jobs_p = job_p;
+						}
+
+					last_admitted_job_p = job_p;
+				}
+			else
+				{
+					FreeMemory (job_p);
+				}
+		}
+
+	/* Let any jobs blocked in WaitForCores see if it is now their turn */
+	if (admitted_flag)
+		{
+			pthread_cond_broadcast (&bs_cond);
+		}
+
+	return admitted_jobs_p;
+}
+
+
+void BlastScheduler :: LaunchAdmittedJobs (BlastSchedulerWaitingJob *jobs_p)
+{
+	while (jobs_p)
+		{
+			BlastSchedulerWaitingJob *next_p = jobs_p -> bswj_next_p;
+
+			jobs_p -> bswj_admit_fn (jobs_p -> bswj_data_p, jobs_p -> bswj_num_cores);
+			FreeMemory (jobs_p);
+
+			jobs_p = next_p;
+		}
+}
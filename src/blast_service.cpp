@@ -14,6 +14,7 @@
  ** limitations under the License.
  */
 #include <string.h>
+#include <pthread.h>
 
 #define ALLOCATE_BLAST_SERVICE_CONSTANTS (1)
 #include "blast_service.h"
@@ -31,10 +32,27 @@
 #include "temp_file.hpp"
 #include "json_tools.h"
 #include "blast_formatter.h"
+#include "native_blast_formatter.h"
 #include "blast_service_job.h"
 #include "paired_blast_service.h"
 #include "blast_service_params.h"
 #include "blast_tool_factory.hpp"
+#include "blast_scheduler.hpp"
+#include "blast_batcher.hpp"
+#include "blast_database_warmer.hpp"
+#include "blast_process_monitor.hpp"
+#include "blast_process_envelope.hpp"
+#include "blast_progress_tracker.hpp"
+#include "blast_result_streamer.hpp"
+#include "converted_output_cache.hpp"
+#include "single_flight_converter.hpp"
+#include "blast_result_buffer.hpp"
+#include "blast_file_compression.hpp"
+#include "blast_pre_converter.hpp"
+#include "blast_hit_index.hpp"
+#include "combined_database_search.hpp"
+#include "system_blast_tool.hpp"
+#include "threaded_blast_tool.hpp"
 #include "jobs_manager.h"
 #include "blast_service_job.h"
 #include "blast_service_params.h"
@@ -61,18 +79,101 @@
 
 /***************************************/
 
+/*
+ * The details for each of the ServiceJobs that RunJobs
+ * will process.
+ */
+typedef struct JobRunDetails
+{
+	/* The ServiceJob to run */
+	ServiceJob *jrd_job_p;
+
+	/* Has the BlastTool for this job been set up and is ready to run? */
+	bool jrd_ready_flag;
+
+	/* Has the job been ran? */
+	bool jrd_ran_flag;
+
+	/* Is the job's database part of a CombinedDatabaseSearch? */
+	bool jrd_combined_flag;
+} JobRunDetails;
+
+
+/*
+ * The shared state between the threads running the BlastTools
+ * for a set of JobRunDetails.
+ */
+typedef struct JobsRunner
+{
+	JobRunDetails *jr_details_p;
+
+	size_t jr_num_jobs;
+
+	/* The index of the next entry in jr_details_p to run */
+	size_t jr_next_index;
+
+	pthread_mutex_t jr_mutex;
+} JobsRunner;
+
+
+/*
+ * The details that a SingleFlightConverter needs
+ * to convert a job's output.
+ */
+typedef struct BlastResultConversion
+{
+	const BlastServiceData *brc_data_p;
+
+	BlastFormatter *brc_formatter_p;
+
+	const char *brc_job_id_s;
+
+	const char *brc_job_output_filename_s;
+
+	uint32 brc_output_format_code;
+
+	const char *brc_output_format_params_s;
+} BlastResultConversion;
+
+
 static void InitBlastService (Service *blast_service_p);
 
 static void RunJobs (Service *service_p, ParameterSet *param_set_p, const char *input_filename_s, BlastAppParameters *app_params_p, ServiceJobSetIterator *iterator_p);
 
 static bool PreRunJobs (BlastServiceData *blast_data_p);
 
+static bool PrepareBlastJobToRun (BlastServiceJob *job_p, ParameterSet *param_set_p, const char *input_filename_s, BlastAppParameters *app_params_p);
+
+static void RunPreparedJobs (JobRunDetails *details_p, const size_t num_jobs, const uint32 max_num_threads);
+
+static void RunCombinedDatabaseJobs (JobRunDetails *details_p, const size_t num_jobs, const BlastServiceData *blast_data_p);
+
+static void RunGroupedJobs (JobRunDetails *details_p, const size_t num_jobs, const BlastServiceData *blast_data_p);
+
+static void *RunPreparedJobsThread (void *data_p);
+
+static void UpdateRanJob (Service *service_p, ServiceJob *base_job_p);
+
+static BlastServiceJob *FindBlastServiceJob (Service *service_p, const uuid_t job_id);
+
+static bool AddStreamedBlastResultToServiceJob (ServiceJob *job_p, BlastServiceData *blast_data_p, const uuid_t job_id, const char *job_id_s, const uint32 output_format_code);
+
+static bool AddBlastResultsPageToServiceJob (ServiceJob *job_p, BlastServiceData *blast_data_p, const char *job_id_s, const uint32 output_format_code, const BlastResultsPage *page_p, char **error_ss);
+
+static BlastHitIndex *GetBlastJobHitIndex (const BlastServiceData *data_p, const char *job_id_s);
+
+static char *GetBlastJobJSONFilename (const BlastServiceData *data_p, const char *job_id_s);
+
 static bool CleanupAsyncBlastService (void *data_p);
 
+static char *RunBlastResultConversion (void *data_p);
+
 static bool AddDatabaseForIndexing (const DatabaseInfo *db_p, json_t *json_p);
 
 static char *ConfigureWorkingDirectoryPath (const json_t *blast_config_p);
 
+static bool AreDatabaseShardsValid (const json_t *shards_p);
+
 static json_t *GetBlastIndexingDataPayload (GrassrootsServer *server_p, const char *service_s, const DatabaseInfo *db_p);
 
 static json_t *GetIndexingDataForDatabase (const Service *service_p, const DatabaseInfo *db_p);
@@ -317,9 +418,42 @@ ServiceJobSet *CreateJobsForPreviousResults (ParameterSet *params_p, const char
 			const uint32 *fmt_code_p = NULL;
 			uint32 output_format_code = BS_DEFAULT_OUTPUT_FORMAT;
 			const char *output_format_param_s = NULL;
+			const uint32 *query_index_p = NULL;
+			const uint32 *hits_offset_p = NULL;
+			const uint32 *hits_limit_p = NULL;
+			const bool *cancel_flag_p = NULL;
+			BlastResultsPage page;
 
 			GetCurrentStringParameterValueFromParameterSet (params_p, BS_CUSTOM_OUTPUT_FORMAT.npt_name_s, &output_format_param_s);
 
+			/* These aren't available from older clients so it doesn't matter if they are missing */
+			GetCurrentUnsignedIntParameterValueFromParameterSet (params_p, BS_QUERY_INDEX.npt_name_s, &query_index_p);
+			GetCurrentUnsignedIntParameterValueFromParameterSet (params_p, BS_HITS_OFFSET.npt_name_s, &hits_offset_p);
+			GetCurrentUnsignedIntParameterValueFromParameterSet (params_p, BS_HITS_LIMIT.npt_name_s, &hits_limit_p);
+
+			/* Stop any of the jobs that are still running before getting their statuses */
+			if (GetCurrentBooleanParameterValueFromParameterSet (params_p, BS_CANCEL_JOBS.npt_name_s, &cancel_flag_p) && cancel_flag_p && (*cancel_flag_p))
+				{
+					Service *service_p = blast_data_p -> bsd_base_data.sd_service_p;
+					StringListNode *node_p = (StringListNode *) (ids_p -> ll_head_p);
+
+					while (node_p)
+						{
+							uuid_t job_id;
+
+							if (uuid_parse (node_p -> sln_string_s, job_id) == 0)
+								{
+									CancelBlastServiceJob (service_p, job_id);
+								}
+
+							node_p = (StringListNode *) (node_p -> sln_node.ln_next_p);
+						}
+				}
+
+			page.brp_query_index = query_index_p ? *query_index_p : 0;
+			page.brp_hits_offset = hits_offset_p ? *hits_offset_p : 0;
+			page.brp_hits_limit = hits_limit_p ? *hits_limit_p : 0;
+
 			if (GetCurrentUnsignedIntParameterValueFromParameterSet (params_p, BS_OUTPUT_FORMAT.npt_name_s, &fmt_code_p))
 				{
 					if (fmt_code_p)
@@ -333,7 +467,8 @@ ServiceJobSet *CreateJobsForPreviousResults (ParameterSet *params_p, const char
 				}
 
 
-			jobs_p = GetPreviousJobResults (ids_p, blast_data_p, output_format_code, output_format_param_s);
+			/* If none of the paging parameters are set, then the whole of each result is got as before */
+			jobs_p = GetPreviousJobResults (ids_p, blast_data_p, output_format_code, output_format_param_s, ((page.brp_query_index > 0) || (page.brp_hits_offset > 0) || (page.brp_hits_limit > 0)) ? &page : NULL);
 
 			if (jobs_p)
 				{
@@ -522,7 +657,7 @@ TempFile *GetInputTempFile (const ParameterSet *params_p, const char *working_di
 }
 
 
-ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, BlastServiceData *blast_data_p, const uint32 output_format_code, const char *output_format_params_s)
+ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, BlastServiceData *blast_data_p, const uint32 output_format_code, const char *output_format_params_s, const BlastResultsPage *page_p)
 {
 	char *error_s = NULL;
 	Service *service_p = blast_data_p -> bsd_base_data.sd_service_p;
@@ -549,72 +684,79 @@ ServiceJobSet *GetPreviousJobResults (LinkedList *ids_p, BlastServiceData *blast
 
 									if (uuid_parse (job_id_s, job_id) == 0)
 										{
-											char *result_s = GetBlastResultByUUIDString (blast_data_p, job_id_s, (output_format_code != BOF_GRASSROOTS) ? output_format_code : (uint32) BOF_SINGLE_FILE_JSON_BLAST, output_format_params_s);
-											SetServiceJobStatus (job_p, OS_FAILED);
-
-											if (result_s)
+											/* If the job is still running, get the results of the queries that it has finished */
+											if (AddStreamedBlastResultToServiceJob (job_p, blast_data_p, job_id, job_id_s, output_format_code))
 												{
-													json_t *result_json_p = NULL;
-
-													if (output_format_code == BOF_GRASSROOTS)
+													++ num_successful_jobs;
+												}
+											else if (page_p)
+												{
+													if (AddBlastResultsPageToServiceJob (job_p, blast_data_p, job_id_s, output_format_code, page_p, &error_s))
 														{
-															json_error_t err;
-															json_t *temp_p  = json_loads (result_s, 0, &err);
-
-															/*
-															 * Convert the blast json to our markup and then
-															 * get the result
-															 */
-															if (temp_p)
-																{
-																	result_json_p = ConvertBlastResultToGrassrootsMarkUp (temp_p, blast_data_p);
-
-																	json_decref (temp_p);
-																}
+															++ num_successful_jobs;
 														}
-													else
+												}
+											else
+												{
+													BlastResultBuffer *result_p = GetBlastResultBufferByUUIDString (blast_data_p, job_id_s, (output_format_code != BOF_GRASSROOTS) ? output_format_code : (uint32) BOF_SINGLE_FILE_JSON_BLAST, output_format_params_s);
+													SetServiceJobStatus (job_p, OS_FAILED);
+
+													if (result_p)
 														{
-															result_json_p = json_string (result_s);
-														}
+															json_t *result_json_p = NULL;
 
+															if (output_format_code == BOF_GRASSROOTS)
+																{
+																	/*
+																	 * Convert the blast json to our markup and then
+																	 * get the result
+																	 */
+																	result_json_p = ConvertBlastResultStringToGrassrootsMarkUp (job_id_s, result_p -> GetData (), result_p -> GetLength (), blast_data_p);
+																}
+															else
+																{
+																	result_json_p = result_p -> GetAsJSONString ();
+																}
 
-													if (result_json_p)
-														{
-															json_t *blast_result_json_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, job_id_s, result_json_p);
 
-															if (blast_result_json_p)
+															if (result_json_p)
 																{
-																	if (AddResultToServiceJob (job_p, blast_result_json_p))
+																	json_t *blast_result_json_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, job_id_s, result_json_p);
+
+																	if (blast_result_json_p)
 																		{
-																			++ num_successful_jobs;
+																			if (AddResultToServiceJob (job_p, blast_result_json_p))
+																				{
+																					++ num_successful_jobs;
+																				}
+																			else
+																				{
+																					error_s = ConcatenateVarargsStrings ("Failed to add blast result \"", job_id_s, "\" to json results array", NULL);
+																					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add blast result \"%s\" to json results array", job_id_s);
+																				}
 																		}
 																	else
 																		{
-																			error_s = ConcatenateVarargsStrings ("Failed to add blast result \"", job_id_s, "\" to json results array", NULL);
-																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add blast result \"%s\" to json results array", job_id_s);
+																			error_s = ConcatenateVarargsStrings ("Failed to get full blast result as json \"", job_id_s, "\"", NULL);
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get full blast result as json \"%s\"", job_id_s);
 																		}
+
+																	json_decref (result_json_p);
 																}
 															else
 																{
-																	error_s = ConcatenateVarargsStrings ("Failed to get full blast result as json \"", job_id_s, "\"", NULL);
-																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get full blast result as json \"%s\"", job_id_s);
+																	error_s = ConcatenateVarargsStrings ("Failed to get blast result as json \"", job_id_s, "\"", NULL);
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast result as json \"%s\"", job_id_s);
 																}
 
-															json_decref (result_json_p);
-														}
+															delete result_p;
+														}		/* if (result_p) */
 													else
 														{
-															error_s = ConcatenateVarargsStrings ("Failed to get blast result as json \"", job_id_s, "\"", NULL);
-															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast result as json \"%s\"", job_id_s);
+															error_s = ConcatenateVarargsStrings ("Failed to get blast result for \"", job_id_s, "\"", NULL);
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast result for \"%s\"", job_id_s);
 														}
-
-													FreeCopiedString (result_s);
-												}		/* if (result_s) */
-											else
-												{
-													error_s = ConcatenateVarargsStrings ("Failed to get blast result for \"", job_id_s, "\"", NULL);
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast result for \"%s\"", job_id_s);
-												}
+												}		/* if (AddStreamedBlastResultToServiceJob (job_p, blast_data_p, job_id, job_id_s, output_format_code)) else */
 										}		/* if (uuid_parse (param_value.st_string_value_s, job_id) == 0) */
 									else
 										{
@@ -840,48 +982,77 @@ ParameterSet *IsResourceForBlastService (Service *service_p, DataResource *resou
 OperationStatus GetBlastServiceStatus (Service *service_p, const uuid_t job_id)
 {
 	OperationStatus status = OS_ERROR;
+	BlastServiceJob *job_p = FindBlastServiceJob (service_p, job_id);
+
+	if (job_p)
+		{
+			status = GetCachedServiceJobStatus (& (job_p -> bsj_job));
+		}		/* if (job_p) */
+
+	return status;
+}
+
+
+bool CancelBlastServiceJob (Service *service_p, const uuid_t job_id)
+{
+	bool success_flag = false;
 	BlastServiceJob *job_p = NULL;
 	char uuid_s [UUID_STRING_BUFFER_SIZE];
 
 	ConvertUUIDToString (job_id, uuid_s);
 
-	if (service_p -> se_jobs_p)
-		{
-			job_p = (BlastServiceJob *) GetServiceJobFromServiceJobSetById (service_p -> se_jobs_p, job_id);
-		}
+	job_p = FindBlastServiceJob (service_p, job_id);
 
-	if (!job_p)
+	if (job_p)
 		{
-			GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (service_p);
-			JobsManager *jobs_manager_p = GetJobsManager (grassroots_p);
-
-			if (jobs_manager_p)
+			if (job_p -> bsj_tool_p)
 				{
-					ServiceJob *previous_job_p = GetServiceJobFromJobsManager (jobs_manager_p, job_id);
-
-					if (previous_job_p)
-						{
-							job_p = (BlastServiceJob *) previous_job_p;
-						}
-				}		/* if (jobs_manager_p) */
+					success_flag = job_p -> bsj_tool_p -> Cancel ();
+				}
 			else
 				{
+					/* The job may be running in another thread without its tool attached */
+					BlastServiceData *data_p = (BlastServiceData *) (service_p -> se_data_p);
 
+					success_flag = ThreadedBlastTool :: CancelJob (data_p, uuid_s);
 				}
 
-		}		/* if (!job_p) */
-
-
-	if (job_p)
-		{
-			status = GetCachedServiceJobStatus (& (job_p -> bsj_job));
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to cancel job \"%s\"", uuid_s);
+				}
 		}		/* if (job_p) */
 	else
 		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to find job \"%s\" to cancel", uuid_s);
+		}
+
+	return success_flag;
+}
+
+
+uint32 GetBlastJobTimeLimit (const BlastServiceData *data_p, const char *task_s)
+{
+	uint32 time_limit = data_p -> bsd_job_time_limit;
+
+	if ((task_s) && (data_p -> bsd_task_time_limits_p))
+		{
+			json_int_t i;
 
+			if (GetJSONInteger (data_p -> bsd_task_time_limits_p, task_s, &i))
+				{
+					if (i >= 0)
+						{
+							time_limit = (uint32) i;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid time limit for task \"%s\": %" JSON_INTEGER_FORMAT, task_s, i);
+						}
+				}
 		}
 
-	return status;
+	return time_limit;
 }
 
 
@@ -910,12 +1081,12 @@ bool DetermineBlastResult (BlastServiceJob *job_p)
 				}		/* if (out_fmt == BOF_GRASSROOTS) */
 			else
 				{
-					char *result_s = tool_p -> GetResults (blast_data_p -> bsd_formatter_p);
+					BlastResultBuffer *result_p = tool_p -> GetResultsBuffer (blast_data_p -> bsd_formatter_p);
 
-					if (result_s)
+					if (result_p)
 						{
-							result_json_p = json_string (result_s);
-							FreeCopiedString (result_s);
+							result_json_p = result_p -> GetAsJSONString ();
+							delete result_p;
 						}
 				}
 
@@ -944,6 +1115,27 @@ bool DetermineBlastResult (BlastServiceJob *job_p)
 					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast result for \"%s\"", uuid_s);
 				}
 
+			if (success_flag)
+				{
+					/*
+					 * The pre-converter indexes and compresses the job's files once it has
+					 * converted them. If its queue is full, it saves the job for later.
+					 */
+					if (! ((blast_data_p -> bsd_pre_converter_p) && (blast_data_p -> bsd_pre_converter_p -> AddJob (uuid_s))))
+						{
+							IndexBlastJobHits (blast_data_p, uuid_s);
+
+							/*
+							 * Compressing can take a while so don't hold up this thread doing it.
+							 * The files can be read just as well uncompressed.
+							 */
+							if (blast_data_p -> bsd_compression_level > 0)
+								{
+									PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Not compressing the files of \"%s\" as it couldn't be queued for compression", uuid_s);
+								}
+						}
+				}
+
 		}		/* if (status == OS_SUCCEEDED) */
 	else
 		{
@@ -954,6 +1146,55 @@ bool DetermineBlastResult (BlastServiceJob *job_p)
 }
 
 
+void CompressBlastJobFiles (const BlastServiceData *data_p, const char *job_id_s)
+{
+	/*
+	 * The job has finished so nothing will write to these again. The query's
+	 * BS_INPUT_SUFFIX_S file is left alone as it is named after the first job
+	 * of the request and is shared by the request's other jobs, which may
+	 * still be waiting to read it.
+	 */
+	const char *suffixes_ss [] = { BS_OUTPUT_SUFFIX_S, BS_LOG_SUFFIX_S, ".command", NULL };
+	const char **suffix_ss = suffixes_ss;
+
+	while (*suffix_ss)
+		{
+			char *filename_s = GetPreviousJobFilename (data_p, job_id_s, *suffix_ss);
+
+			if (filename_s)
+				{
+					CompressBlastFile (filename_s, data_p -> bsd_compression_level);
+					FreeCopiedString (filename_s);
+				}
+
+			++ suffix_ss;
+		}
+}
+
+
+bool IndexBlastJobHits (const BlastServiceData *data_p, const char *job_id_s)
+{
+	bool success_flag = false;
+	char *json_filename_s = GetBlastJobJSONFilename (data_p, job_id_s);
+
+	/* If there isn't a single-file JSON output yet, the hits are indexed when a page of them is first asked for */
+	if (json_filename_s)
+		{
+			char *index_filename_s = GetPreviousJobFilename (data_p, job_id_s, BS_HIT_INDEX_SUFFIX_S);
+
+			if (index_filename_s)
+				{
+					success_flag = BlastHitIndex :: WriteIndex (json_filename_s, index_filename_s);
+					FreeCopiedString (index_filename_s);
+				}
+
+			FreeCopiedString (json_filename_s);
+		}
+
+	return success_flag;
+}
+
+
 char *GetBlastResultByUUID (const BlastServiceData *data_p, const uuid_t job_id, const uint32 output_format_code, const char *output_format_params_s)
 {
 	char job_id_s [UUID_STRING_BUFFER_SIZE];
@@ -970,68 +1211,190 @@ char *GetBlastResultByUUID (const BlastServiceData *data_p, const uuid_t job_id,
 
 char *GetBlastResultByUUIDString (const BlastServiceData *data_p, const char *job_id_s, const uint32 output_format_code, const char *output_format_params_s)
 {
+	char *result_s = NULL;
+	BlastResultBuffer *buffer_p = GetBlastResultBufferByUUIDString (data_p, job_id_s, output_format_code, output_format_params_s);
+
+	if (buffer_p)
+		{
+			result_s = buffer_p -> CopyToString ();
+			delete buffer_p;
+		}
+
+	return result_s;
+}
+
+
+BlastResultBuffer *GetBlastResultBufferByUUIDString (const BlastServiceData *data_p, const char *job_id_s, const uint32 output_format_code, const char *output_format_params_s)
+{
+	BlastResultBuffer *buffer_p = NULL;
 	char *result_s = NULL;
 	char *job_output_filename_s = GetPreviousJobFilename (data_p, job_id_s, BS_OUTPUT_SUFFIX_S);
 
 	if (job_output_filename_s)
 		{
-			/* Does the file already exist? */
-			char *converted_filename_s = BlastFormatter :: GetConvertedOutputFilename (job_output_filename_s, output_format_code);
+			ConvertedOutputCache *cache_p = data_p -> bsd_output_cache_p;
 
-			if (converted_filename_s)
+			if ((data_p -> bsd_formatter_p) && (output_format_code == data_p -> bsd_formatter_p -> GetArchiveOutputFormat ()))
 				{
-					FILE *job_f = fopen (converted_filename_s, "r");
+					/* The job's own output is already in the required format */
+					buffer_p = data_p -> bsd_formatter_p -> GetArchiveOutput (job_output_filename_s);
+				}
 
-					if (job_f)
+			if (!buffer_p)
+				{
+					if (cache_p)
+						{
+							/* Is it in memory or on disk? */
+							buffer_p = cache_p -> GetConvertedOutputBuffer (job_output_filename_s, output_format_code, output_format_params_s);
+						}
+					else
 						{
-							result_s = GetFileContentsAsString (job_f);
+							/* Does the file already exist? */
+							char *converted_filename_s = BlastFormatter :: GetConvertedOutputFilename (job_output_filename_s, output_format_code, output_format_params_s);
 
-							if (!result_s)
+							if (converted_filename_s)
 								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Couldn't get content of job file \"%s\"", job_output_filename_s);
-								}
+									if (DoesBlastFileExist (converted_filename_s))
+										{
+											buffer_p = ReadBlastFile (converted_filename_s);
 
-							if (fclose (job_f) != 0)
-								{
-									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Couldn't close job file \"%s\"", job_output_filename_s);
-								}
-						}		/* if (job_f) */
+											if (!buffer_p)
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Couldn't get content of job file \"%s\"", converted_filename_s);
+												}
+										}
 
-					FreeCopiedString (converted_filename_s);
-				}		/* if (converted_filename_s) */
+									FreeCopiedString (converted_filename_s);
+								}		/* if (converted_filename_s) */
+						}
+				}
 
-			if (!result_s)
+			if (!buffer_p)
 				{
 					/*
 					 * We haven't got the output in the desired output format so we need to run the formatter.
 					 */
 
 					/* Is it a local job? */
-					if (IsPathValid (job_output_filename_s))
+					if (DoesBlastFileExist (job_output_filename_s))
 						{
 							if (data_p -> bsd_formatter_p)
 								{
-									result_s = data_p -> bsd_formatter_p -> GetConvertedOutput (job_id_s, output_format_code, output_format_params_s, data_p);
+									result_s = ConvertBlastResult (data_p, data_p -> bsd_formatter_p, job_id_s, job_output_filename_s, output_format_code, output_format_params_s);
 								}		/* if (data_p -> bsd_formatter_p) */
 							else
 								{
 									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No formatter specified");
 								}
 
-						}		/* if (IsPathValid (job_output_filename_s)) */
+						}		/* if (DoesBlastFileExist (job_output_filename_s)) */
 
-				}		/* if (!result_s) */
+				}		/* if (!buffer_p) */
 
 			FreeCopiedString (job_output_filename_s);
 		}		/* if (job_output_filename_s) */
 
 
-	if (!result_s)
+	if ((!buffer_p) && (!result_s))
 		{
 			/* Is it a remote job? */
 			result_s = GetPreviousRemoteBlastServiceJob (job_id_s, output_format_code, data_p);
 		}
 
+	if (result_s)
+		{
+			buffer_p = BlastResultBuffer :: AdoptString (result_s);
+
+			if (!buffer_p)
+				{
+					FreeCopiedString (result_s);
+				}
+		}
+
+	return buffer_p;
+}
+
+
+char *ConvertBlastResult (const BlastServiceData *data_p, BlastFormatter *formatter_p, const char *job_id_s, const char *job_output_filename_s, const uint32 output_format_code, const char *output_format_params_s)
+{
+	char *result_s = NULL;
+	BlastResultConversion conversion;
+
+	conversion.brc_data_p = data_p;
+	conversion.brc_formatter_p = formatter_p;
+	conversion.brc_job_id_s = job_id_s;
+	conversion.brc_job_output_filename_s = job_output_filename_s;
+	conversion.brc_output_format_code = output_format_code;
+	conversion.brc_output_format_params_s = output_format_params_s;
+
+	if (data_p -> bsd_flights_p)
+		{
+			char *key_s = SingleFlightConverter :: MakeFlightKey (job_id_s, output_format_code, output_format_params_s);
+
+			if (key_s)
+				{
+					result_s = data_p -> bsd_flights_p -> ConvertOutput (key_s, RunBlastResultConversion, &conversion);
+					FreeCopiedString (key_s);
+				}
+			else
+				{
+					result_s = RunBlastResultConversion (&conversion);
+				}
+		}
+	else
+		{
+			result_s = RunBlastResultConversion (&conversion);
+		}
+
+	return result_s;
+}
+
+
+static char *RunBlastResultConversion (void *data_p)
+{
+	BlastResultConversion *conversion_p = (BlastResultConversion *) data_p;
+	ConvertedOutputCache *cache_p = conversion_p -> brc_data_p -> bsd_output_cache_p;
+	char *result_s = NULL;
+
+	if (cache_p)
+		{
+			/* A conversion that finished since the caller last looked may have already done this */
+			result_s = cache_p -> GetConvertedOutput (conversion_p -> brc_job_output_filename_s, conversion_p -> brc_output_format_code, conversion_p -> brc_output_format_params_s);
+		}
+
+	if (!result_s)
+		{
+			result_s = conversion_p -> brc_formatter_p -> GetConvertedOutput (conversion_p -> brc_job_id_s, conversion_p -> brc_output_format_code, conversion_p -> brc_output_format_params_s, conversion_p -> brc_data_p);
+
+			if (result_s && (conversion_p -> brc_data_p -> bsd_compression_level > 0))
+				{
+					/* We already have the result in memory so the file is only needed for later requests */
+					char *converted_filename_s = BlastFormatter :: GetConvertedOutputFilename (conversion_p -> brc_job_output_filename_s, conversion_p -> brc_output_format_code, conversion_p -> brc_output_format_params_s);
+
+					if (converted_filename_s)
+						{
+							/*
+							 * Compressing can take a while, so leave it to the pre-converter rather
+							 * than holding up the request. If it can't be queued, it is left uncompressed.
+							 */
+							if (conversion_p -> brc_data_p -> bsd_pre_converter_p)
+								{
+									conversion_p -> brc_data_p -> bsd_pre_converter_p -> AddFileToCompress (converted_filename_s);
+								}
+
+							FreeCopiedString (converted_filename_s);
+						}
+				}
+
+			if (result_s && cache_p)
+				{
+					if (!cache_p -> AddConvertedOutput (conversion_p -> brc_job_output_filename_s, conversion_p -> brc_output_format_code, conversion_p -> brc_output_format_params_s, result_s))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add converted output for \"%s\" to cache", conversion_p -> brc_job_id_s);
+						}
+				}
+		}
+
 	return result_s;
 }
 
@@ -1075,6 +1438,24 @@ BlastServiceData *AllocateBlastServiceData (Service * UNUSED_PARAM (blast_servic
 			data_p -> bsd_tool_factory_p = NULL;
 			data_p -> bsd_type = database_type;
 			data_p -> bsd_task_manager_p = NULL;
+			data_p -> bsd_max_parallel_databases = 1;
+			data_p -> bsd_max_threads_per_search = 0;
+			data_p -> bsd_scheduler_p = NULL;
+			data_p -> bsd_batcher_p = NULL;
+			data_p -> bsd_combine_databases_flag = false;
+			data_p -> bsd_blastdbcmd_command_s = NULL;
+			data_p -> bsd_max_query_chunks = 0;
+			data_p -> bsd_warmer_p = NULL;
+			data_p -> bsd_monitor_p = NULL;
+			data_p -> bsd_job_time_limit = 0;
+			data_p -> bsd_task_time_limits_p = NULL;
+			data_p -> bsd_envelope_p = NULL;
+			data_p -> bsd_progress_tracker_p = NULL;
+			data_p -> bsd_streamer_p = NULL;
+			data_p -> bsd_output_cache_p = NULL;
+			data_p -> bsd_flights_p = NULL;
+			data_p -> bsd_compression_level = 0;
+			data_p -> bsd_pre_converter_p = NULL;
 		}
 
 
@@ -1208,6 +1589,8 @@ bool GetBlastServiceConfig (BlastServiceData *data_p)
 																		const char *scaffold_regex_s = GetJSONString (db_json_p, "scaffold_regex");
 																		const char *scaffold_key_s = GetJSONString (db_json_p, "scaffold_key");
 																		const char *search_description_s = GetJSONString (db_json_p, "search_description");
+																		const json_t *shards_p = json_object_get (db_json_p, "shards");
+																		json_int_t warm_priority;
 
 																		db_p -> di_name_s = name_s;
 																		db_p -> di_filename_s = filename_s;
@@ -1219,17 +1602,36 @@ bool GetBlastServiceConfig (BlastServiceData *data_p)
 																		db_p -> di_type = DT_NUCLEOTIDE;
 																		db_p -> di_scaffold_key_s = scaffold_key_s ? scaffold_key_s : "id";
 																		db_p -> di_scaffold_regex_s = scaffold_regex_s;
+																		db_p -> di_shards_p = NULL;
+																		db_p -> di_warm_priority = 0;
 
 																		GetJSONBoolean (db_json_p, "active", & (db_p -> di_active_flag));
 
-																		if (type_s)
+																		if (GetJSONInteger (db_json_p, "warm_priority", &warm_priority))
 																			{
-																				if (strcmp (type_s, "protein") == 0)
+																				db_p -> di_warm_priority = (int32) warm_priority;
+																			}
+
+																		if (type_s)
+																			{
+																				if (strcmp (type_s, "protein") == 0)
 																					{
 																						db_p -> di_type = DT_PROTEIN;
 																					}
 																			}
 
+																		if (shards_p)
+																			{
+																				if (AreDatabaseShardsValid (shards_p))
+																					{
+																						db_p -> di_shards_p = shards_p;
+																					}
+																				else
+																					{
+																						PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, db_json_p, "Ignoring shards for database, they must be an array of at least 2 volume names");
+																					}
+																			}
+
 																		success_flag = true;
 																		++ db_p;
 																	}		/* if (description_s) */
@@ -1305,164 +1707,648 @@ bool GetBlastServiceConfig (BlastServiceData *data_p)
 
 			if (success_flag)
 				{
-					const char *value_s = GetJSONString (blast_config_p, "blast_formatter");
+					json_int_t max_parallel_databases;
 
-					if (value_s)
+					if (GetJSONInteger (blast_config_p, BS_MAX_PARALLEL_DATABASES_S, &max_parallel_databases))
 						{
-							if (strcmp (value_s, "system") == 0)
+							if (max_parallel_databases > 0)
 								{
-									const json_t *formatter_config_p = json_object_get (blast_config_p, "system_formatter_config");
-
-									data_p -> bsd_formatter_p = SystemBlastFormatter :: Create (formatter_config_p);
+									data_p -> bsd_max_parallel_databases = (uint32) max_parallel_databases;
 								}
 							else
 								{
-									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Unknown BlastFormatter type \"%s\"", value_s);
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", using 1", BS_MAX_PARALLEL_DATABASES_S, max_parallel_databases);
 								}
 						}
 				}
 
-		}		/* if (blast_config_p) */
+			if (success_flag)
+				{
+					json_int_t i;
+					uint32 max_cores = 0;
+					uint32 max_queued_jobs = BS_DEFAULT_MAX_QUEUED_JOBS;
 
-	return success_flag;
-}
+					if (GetJSONInteger (blast_config_p, BS_MAX_CORES_S, &i))
+						{
+							if (i > 0)
+								{
+									max_cores = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", using the number of processors", BS_MAX_CORES_S, i);
+								}
+						}
 
+					if (GetJSONInteger (blast_config_p, BS_MAX_QUEUED_JOBS_S, &i))
+						{
+							if (i >= 0)
+								{
+									max_queued_jobs = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", using " UINT32_FMT, BS_MAX_QUEUED_JOBS_S, i, max_queued_jobs);
+								}
+						}
 
+					if (GetJSONInteger (blast_config_p, BS_MAX_THREADS_PER_SEARCH_S, &i))
+						{
+							if (i >= 0)
+								{
+									data_p -> bsd_max_threads_per_search = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not limiting the threads per search", BS_MAX_THREADS_PER_SEARCH_S, i);
+								}
+						}
 
-void FreeBlastServiceData (BlastServiceData *data_p)
-{
-#if BLAST_SERVICE_DEBUG >= STM_LEVEL_FINEST
-	PrintErrors (STM_LEVEL_FINEST, __FILE__, __LINE__,  "Freeing the blast service data at %.16X", data_p);
-#endif
+					data_p -> bsd_scheduler_p = BlastScheduler :: GetSharedBlastScheduler (max_cores, max_queued_jobs);
 
-	if (data_p -> bsd_databases_p)
-		{
-			FreeMemory (data_p -> bsd_databases_p);
-		}
+					if (!data_p -> bsd_scheduler_p)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get BlastScheduler");
+							success_flag = false;
+						}
+				}
 
-	if (data_p -> bsd_formatter_p)
-		{
-			delete (data_p -> bsd_formatter_p);
-		}
+			if (success_flag)
+				{
+					json_int_t i;
 
-	if (data_p -> bsd_tool_factory_p)
-		{
-			delete (data_p -> bsd_tool_factory_p);
-		}
+					data_p -> bsd_monitor_p = BlastProcessMonitor :: GetSharedBlastProcessMonitor ();
 
-	if (data_p -> bsd_working_dir_s)
-		{
-			FreeCopiedString (data_p -> bsd_working_dir_s);
-		}
+					if (!data_p -> bsd_monitor_p)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get BlastProcessMonitor");
+							success_flag = false;
+						}
 
+					/* Without this, concurrent requests for the same conversion just each run their own */
+					data_p -> bsd_flights_p = SingleFlightConverter :: GetSharedSingleFlightConverter ();
 
-	if (data_p -> bsd_task_manager_p)
-		{
-			if (!IsAsyncTaskManagerRunning (data_p -> bsd_task_manager_p))
-				{
-					FreeAsyncTasksManager (data_p -> bsd_task_manager_p);
-				}
-		}
+					if (!data_p -> bsd_flights_p)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get SingleFlightConverter");
+						}
 
-	FreeMemory (data_p);
-}
+					/* Not being able to report progress doesn't stop the searches from running */
+					data_p -> bsd_progress_tracker_p = BlastProgressTracker :: GetSharedBlastProgressTracker ();
 
+					if (!data_p -> bsd_progress_tracker_p)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get BlastProgressTracker");
+						}
 
-ServiceMetadata *GetGeneralBlastServiceMetadata (Service *service_p)
-{
-	const char *term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "operation_0491";
-	SchemaTerm *category_p = AllocateSchemaTerm (term_url_s, "Pairwise sequence alignment", "Methods might perform one-to-one, one-to-many or many-to-many comparisons. Align exactly two molecular sequences.");
+					if (GetJSONInteger (blast_config_p, BS_JOB_TIME_LIMIT_S, &i))
+						{
+							if (i >= 0)
+								{
+									data_p -> bsd_job_time_limit = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not limiting the job times", BS_JOB_TIME_LIMIT_S, i);
+								}
+						}
 
-	if (category_p)
-		{
-			ServiceMetadata *metadata_p = AllocateServiceMetadata (category_p, NULL);
+					data_p -> bsd_task_time_limits_p = json_object_get (blast_config_p, BS_TASK_TIME_LIMITS_S);
 
-			if (metadata_p)
+					if ((data_p -> bsd_task_time_limits_p) && (!json_is_object (data_p -> bsd_task_time_limits_p)))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" is not an object, ignoring it", BS_TASK_TIME_LIMITS_S);
+							data_p -> bsd_task_time_limits_p = NULL;
+						}
+				}
+
+			if (success_flag)
 				{
-					SchemaTerm *output_p;
+					const json_t *limits_p = json_object_get (blast_config_p, BS_PROCESS_LIMITS_S);
 
-					term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "format_1333";
-					output_p = AllocateSchemaTerm (term_url_s, "BLAST results", "Format of results of a sequence database search using some variant of BLAST. This includes score data, alignment data and summary table.");
+					if (limits_p)
+						{
+							if (json_is_object (limits_p))
+								{
+									/* This is 0 if none of the limits are set */
+									data_p -> bsd_envelope_p = BlastProcessEnvelope :: Create (limits_p);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" is not an object, ignoring it", BS_PROCESS_LIMITS_S);
+								}
+						}
+				}
 
-					if (output_p)
+			if (success_flag)
+				{
+					json_int_t i;
+					uint32 window_ms = 0;
+					uint32 max_queries = BS_DEFAULT_BATCH_MAX_QUERIES;
+
+					if (GetJSONInteger (blast_config_p, BS_BATCH_WINDOW_MS_S, &i))
 						{
-							if (AddSchemaTermToServiceMetadataOutput (metadata_p, output_p))
+							if (i >= 0)
 								{
-									return metadata_p;
+									window_ms = (uint32) i;
 								}
 							else
 								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add output term %s to service metadata", term_url_s);
-									FreeSchemaTerm (output_p);
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not batching searches", BS_BATCH_WINDOW_MS_S, i);
 								}
+						}
 
-						}		/* if (output_p) */
-					else
+					if (GetJSONInteger (blast_config_p, BS_BATCH_MAX_QUERIES_S, &i))
 						{
-							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate output term %s for service metadata", term_url_s);
+							if (i > 0)
+								{
+									max_queries = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", using " UINT32_FMT, BS_BATCH_MAX_QUERIES_S, i, max_queries);
+								}
 						}
 
-				}		/* if (metadata_p) */
+					if (window_ms > 0)
+						{
+							data_p -> bsd_batcher_p = BlastBatcher :: GetSharedBlastBatcher (window_ms, max_queries);
 
-		}		/* if (category_p) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate category term %s for service metadata", term_url_s);
-		}
+							if (!data_p -> bsd_batcher_p)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get BlastBatcher");
+									success_flag = false;
+								}
+						}
+				}
 
-	return NULL;
-}
+			if (success_flag)
+				{
+					GetJSONBoolean (blast_config_p, BS_COMBINE_DATABASES_S, & (data_p -> bsd_combine_databases_flag));
+					data_p -> bsd_blastdbcmd_command_s = GetJSONString (blast_config_p, BS_BLASTDBCMD_COMMAND_S);
+				}
 
+			if (success_flag)
+				{
+					bool stream_flag = false;
 
+					if (GetJSONBoolean (blast_config_p, BS_STREAM_RESULTS_S, &stream_flag) && stream_flag)
+						{
+							data_p -> bsd_streamer_p = BlastResultStreamer :: GetSharedBlastResultStreamer ();
 
-void ReleaseBlastService (Service *service_p)
-{
-	BlastServiceData *data_p = (BlastServiceData *) service_p -> se_data_p;
+							if (!data_p -> bsd_streamer_p)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get BlastResultStreamer");
+									success_flag = false;
+								}
+						}
+				}
 
-	if (data_p -> bsd_task_manager_p)
-		{
-			IncrementAsyncTaskManagerCount (data_p -> bsd_task_manager_p);
-		}		/* if (data_p -> bsd_task_manager_p) */
-}
+			if (success_flag)
+				{
+					json_int_t i;
+
+					if (GetJSONInteger (blast_config_p, BS_MAX_QUERY_CHUNKS_S, &i))
+						{
+							if (i >= 0)
+								{
+									data_p -> bsd_max_query_chunks = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not splitting queries", BS_MAX_QUERY_CHUNKS_S, i);
+								}
+						}
+				}
 
+			if (success_flag)
+				{
+					json_int_t i;
+					uint64 budget = 0;
+					uint32 interval = BS_DEFAULT_WARM_DATABASES_INTERVAL;
 
+					if (GetJSONInteger (blast_config_p, BS_WARM_DATABASES_BUDGET_MB_S, &i))
+						{
+							if (i >= 0)
+								{
+									budget = ((uint64) i) << 20;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not warming databases", BS_WARM_DATABASES_BUDGET_MB_S, i);
+								}
+						}
 
-/*
- * STATIC FUNCTIONS
- */
+					if (GetJSONInteger (blast_config_p, BS_WARM_DATABASES_INTERVAL_S, &i))
+						{
+							if (i >= 0)
+								{
+									interval = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", using " UINT32_FMT, BS_WARM_DATABASES_INTERVAL_S, i, interval);
+								}
+						}
 
+					/* The warmer only needs the databases so it failing to start isn't fatal */
+					if ((budget > 0) && (data_p -> bsd_databases_p))
+						{
+							data_p -> bsd_warmer_p = BlastDatabaseWarmer :: Create (data_p, budget, interval);
 
-static void InitBlastService (Service *blast_service_p)
-{
-	blast_service_p -> se_synchronous = GetBlastToolFactorySynchronicity ( ( (BlastServiceData *) (blast_service_p -> se_data_p)) -> bsd_tool_factory_p);
+							if (!data_p -> bsd_warmer_p)
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start BlastDatabaseWarmer");
+								}
+						}
+				}
 
-	blast_service_p -> se_deserialise_job_json_fn = BuildBlastServiceJob;
-	blast_service_p -> se_serialise_job_json_fn = BuildBlastServiceJobJSON;
+			if (success_flag)
+				{
+					const char *value_s = GetJSONString (blast_config_p, "blast_formatter");
 
-	blast_service_p -> se_process_linked_services_fn = ProcessLinkedServiceForBlastServiceJobOutput;
-}
+					if (value_s)
+						{
+							if (strcmp (value_s, "system") == 0)
+								{
+									const json_t *formatter_config_p = json_object_get (blast_config_p, "system_formatter_config");
 
+									data_p -> bsd_formatter_p = SystemBlastFormatter :: Create (formatter_config_p);
+								}
+							else if (strcmp (value_s, "native") == 0)
+								{
+									/* Any system formatter is used for the formats that can't be converted natively */
+									const json_t *formatter_config_p = json_object_get (blast_config_p, "system_formatter_config");
 
-const char *GetMatchingDatabaseFilename (const BlastServiceData *data_p, const char *name_s)
-{
-	const DatabaseInfo *db_p = data_p -> bsd_databases_p;
+									data_p -> bsd_formatter_p = NativeBlastFormatter :: Create (formatter_config_p);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Unknown BlastFormatter type \"%s\"", value_s);
+								}
+						}
+				}
 
-	if (db_p)
-		{
-			while (db_p -> di_name_s)
+			if (success_flag)
 				{
-					if (strcmp (name_s, db_p -> di_name_s) == 0)
+					json_int_t i;
+					uint64 disk_budget = 0;
+					uint64 memory_budget = 0;
+
+					if (GetJSONInteger (blast_config_p, BS_CONVERTED_OUTPUT_DISK_BUDGET_MB_S, &i))
 						{
-							return db_p -> di_filename_s;
+							if (i >= 0)
+								{
+									disk_budget = ((uint64) i) << 20;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not limiting converted outputs", BS_CONVERTED_OUTPUT_DISK_BUDGET_MB_S, i);
+								}
 						}
 
-					++ db_p;
-
-				}		/* while (db_p -> di_name_s) */
+					if (GetJSONInteger (blast_config_p, BS_CONVERTED_OUTPUT_MEMORY_BUDGET_MB_S, &i))
+						{
+							if (i >= 0)
+								{
+									memory_budget = ((uint64) i) << 20;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not keeping converted outputs in memory", BS_CONVERTED_OUTPUT_MEMORY_BUDGET_MB_S, i);
+								}
+						}
 
-		}		/* if (db_p) */
+					/* Without the cache, the converted files are just looked for on disk so it failing to start isn't fatal */
+					if ((disk_budget > 0) || (memory_budget > 0))
+						{
+							data_p -> bsd_output_cache_p = ConvertedOutputCache :: GetSharedConvertedOutputCache (disk_budget, memory_budget);
 
-	return NULL;
+							if (data_p -> bsd_output_cache_p)
+								{
+									if (data_p -> bsd_working_dir_s)
+										{
+											data_p -> bsd_output_cache_p -> IndexDirectory (data_p -> bsd_working_dir_s);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get ConvertedOutputCache");
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					json_int_t i;
+
+					if (GetJSONInteger (blast_config_p, BS_COMPRESSION_LEVEL_S, &i))
+						{
+							if ((i >= 0) && (i <= 22))
+								{
+									if ((i == 0) || IsBlastFileCompressionAvailable ())
+										{
+											data_p -> bsd_compression_level = (int32) i;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" is set but the Blast service was built without zstd, not compressing job files", BS_COMPRESSION_LEVEL_S);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", not compressing job files", BS_COMPRESSION_LEVEL_S, i);
+								}
+						}
+				}
+
+			if (success_flag)
+				{
+					const json_t *formats_json_p = json_object_get (blast_config_p, BS_PRE_CONVERT_FORMATS_S);
+					uint32 *formats_p = NULL;
+					uint32 num_formats = 0;
+					uint32 num_threads = 1;
+					json_int_t i;
+
+					/* The pre-converter only saves later requests some time so it failing to start isn't fatal */
+					if (formats_json_p)
+						{
+							if (json_is_array (formats_json_p) && (json_array_size (formats_json_p) > 0))
+								{
+									formats_p = (uint32 *) AllocMemoryArray (json_array_size (formats_json_p), sizeof (uint32));
+
+									if (formats_p)
+										{
+											size_t j;
+											json_t *format_p;
+
+											json_array_foreach (formats_json_p, j, format_p)
+											{
+												if (json_is_integer (format_p) && ((i = json_integer_value (format_p)) >= 0) && (i < BOF_NUM_TYPES))
+													{
+														/* The Grassroots markup is made from the single-file JSON for each request so that is what gets converted */
+														const uint32 output_format_code = (i == BOF_GRASSROOTS) ? (uint32) BOF_SINGLE_FILE_JSON_BLAST : (uint32) i;
+														uint32 k = 0;
+
+														while ((k < num_formats) && (* (formats_p + k) != output_format_code))
+															{
+																++ k;
+															}
+
+														if (k == num_formats)
+															{
+																* (formats_p + num_formats) = output_format_code;
+																++ num_formats;
+															}
+													}
+												else
+													{
+														PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, format_p, "Invalid output format code in \"%s\", ignoring it", BS_PRE_CONVERT_FORMATS_S);
+													}
+											}
+
+										}		/* if (formats_p) */
+
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" must be an array of output format codes, not converting finished jobs", BS_PRE_CONVERT_FORMATS_S);
+								}
+						}		/* if (formats_json_p) */
+
+					if (GetJSONInteger (blast_config_p, BS_PRE_CONVERT_THREADS_S, &i))
+						{
+							if (i > 0)
+								{
+									num_threads = (uint32) i;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid value for \"%s\": %" JSON_INTEGER_FORMAT ", using " UINT32_FMT, BS_PRE_CONVERT_THREADS_S, i, num_threads);
+								}
+						}
+
+					/* Without a formatter, there is nothing to convert the jobs with */
+					if (!data_p -> bsd_formatter_p)
+						{
+							num_formats = 0;
+						}
+
+					/*
+					 * Compressing a job's files can take a while at the higher levels, so
+					 * rather than doing it on the thread that finished the job, it is left
+					 * to the pre-converter even when there are no formats to convert to.
+					 */
+					if ((num_formats > 0) || (data_p -> bsd_compression_level > 0))
+						{
+							data_p -> bsd_pre_converter_p = BlastPreConverter :: Create (data_p, formats_p, num_formats, num_threads);
+
+							if (!data_p -> bsd_pre_converter_p)
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start BlastPreConverter");
+								}
+						}
+
+					if (formats_p)
+						{
+							FreeMemory (formats_p);
+						}
+				}
+
+		}		/* if (blast_config_p) */
+
+	return success_flag;
+}
+
+
+
+void FreeBlastServiceData (BlastServiceData *data_p)
+{
+#if BLAST_SERVICE_DEBUG >= STM_LEVEL_FINEST
+	PrintErrors (STM_LEVEL_FINEST, __FILE__, __LINE__,  "Freeing the blast service data at %.16X", data_p);
+#endif
+
+	/* Stop the pre-converter first as it uses the formatter and the output cache */
+	if (data_p -> bsd_pre_converter_p)
+		{
+			delete (data_p -> bsd_pre_converter_p);
+		}
+
+	/* Stop the warmer first as it uses the databases */
+	if (data_p -> bsd_warmer_p)
+		{
+			delete (data_p -> bsd_warmer_p);
+		}
+
+	if (data_p -> bsd_databases_p)
+		{
+			FreeMemory (data_p -> bsd_databases_p);
+		}
+
+	if (data_p -> bsd_formatter_p)
+		{
+			delete (data_p -> bsd_formatter_p);
+		}
+
+	if (data_p -> bsd_tool_factory_p)
+		{
+			delete (data_p -> bsd_tool_factory_p);
+		}
+
+	/* Release these after the tool factory as any of its queued jobs may still need them */
+	if (data_p -> bsd_batcher_p)
+		{
+			BlastBatcher :: ReleaseSharedBlastBatcher ();
+		}
+
+	if (data_p -> bsd_scheduler_p)
+		{
+			BlastScheduler :: ReleaseSharedBlastScheduler ();
+		}
+
+	if (data_p -> bsd_monitor_p)
+		{
+			BlastProcessMonitor :: ReleaseSharedBlastProcessMonitor ();
+		}
+
+	if (data_p -> bsd_progress_tracker_p)
+		{
+			BlastProgressTracker :: ReleaseSharedBlastProgressTracker ();
+		}
+
+	if (data_p -> bsd_streamer_p)
+		{
+			BlastResultStreamer :: ReleaseSharedBlastResultStreamer ();
+		}
+
+	if (data_p -> bsd_output_cache_p)
+		{
+			ConvertedOutputCache :: ReleaseSharedConvertedOutputCache ();
+		}
+
+	if (data_p -> bsd_flights_p)
+		{
+			SingleFlightConverter :: ReleaseSharedSingleFlightConverter ();
+		}
+
+	if (data_p -> bsd_envelope_p)
+		{
+			delete (data_p -> bsd_envelope_p);
+		}
+
+	if (data_p -> bsd_working_dir_s)
+		{
+			FreeCopiedString (data_p -> bsd_working_dir_s);
+		}
+
+
+	if (data_p -> bsd_task_manager_p)
+		{
+			if (!IsAsyncTaskManagerRunning (data_p -> bsd_task_manager_p))
+				{
+					FreeAsyncTasksManager (data_p -> bsd_task_manager_p);
+				}
+		}
+
+	FreeMemory (data_p);
+}
+
+
+ServiceMetadata *GetGeneralBlastServiceMetadata (Service *service_p)
+{
+	const char *term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "operation_0491";
+	SchemaTerm *category_p = AllocateSchemaTerm (term_url_s, "Pairwise sequence alignment", "Methods might perform one-to-one, one-to-many or many-to-many comparisons. Align exactly two molecular sequences.");
+
+	if (category_p)
+		{
+			ServiceMetadata *metadata_p = AllocateServiceMetadata (category_p, NULL);
+
+			if (metadata_p)
+				{
+					SchemaTerm *output_p;
+
+					term_url_s = CONTEXT_PREFIX_EDAM_ONTOLOGY_S "format_1333";
+					output_p = AllocateSchemaTerm (term_url_s, "BLAST results", "Format of results of a sequence database search using some variant of BLAST. This includes score data, alignment data and summary table.");
+
+					if (output_p)
+						{
+							if (AddSchemaTermToServiceMetadataOutput (metadata_p, output_p))
+								{
+									return metadata_p;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add output term %s to service metadata", term_url_s);
+									FreeSchemaTerm (output_p);
+								}
+
+						}		/* if (output_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate output term %s for service metadata", term_url_s);
+						}
+
+				}		/* if (metadata_p) */
+
+		}		/* if (category_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate category term %s for service metadata", term_url_s);
+		}
+
+	return NULL;
+}
+
+
+
+void ReleaseBlastService (Service *service_p)
+{
+	BlastServiceData *data_p = (BlastServiceData *) service_p -> se_data_p;
+
+	if (data_p -> bsd_task_manager_p)
+		{
+			IncrementAsyncTaskManagerCount (data_p -> bsd_task_manager_p);
+		}		/* if (data_p -> bsd_task_manager_p) */
+}
+
+
+
+/*
+ * STATIC FUNCTIONS
+ */
+
+
+static void InitBlastService (Service *blast_service_p)
+{
+	blast_service_p -> se_synchronous = GetBlastToolFactorySynchronicity ( ( (BlastServiceData *) (blast_service_p -> se_data_p)) -> bsd_tool_factory_p);
+
+	blast_service_p -> se_deserialise_job_json_fn = BuildBlastServiceJob;
+	blast_service_p -> se_serialise_job_json_fn = BuildBlastServiceJobJSON;
+
+	blast_service_p -> se_process_linked_services_fn = ProcessLinkedServiceForBlastServiceJobOutput;
+}
+
+
+const char *GetMatchingDatabaseFilename (const BlastServiceData *data_p, const char *name_s)
+{
+	const DatabaseInfo *db_p = data_p -> bsd_databases_p;
+
+	if (db_p)
+		{
+			while (db_p -> di_name_s)
+				{
+					if (strcmp (name_s, db_p -> di_name_s) == 0)
+						{
+							return db_p -> di_filename_s;
+						}
+
+					++ db_p;
+
+				}		/* while (db_p -> di_name_s) */
+
+		}		/* if (db_p) */
+
+	return NULL;
 }
 
 
@@ -1681,265 +2567,980 @@ static json_t *GetIndexingDataForDatabase (const Service *service_p, const Datab
 																						{
 																							const char *description_s = db_p -> di_search_description_s ? db_p -> di_search_description_s : db_p -> di_description_s;
 
-																							if (description_s)
-																								{
-																									if (SetJSONString (index_data_p, INDEXING_DESCRIPTION_S, description_s))
-																										{
-																											json_t *payload_p = GetBlastIndexingDataPayload (grassroots_p, name_s, db_p);
+																							if (description_s)
+																								{
+																									if (SetJSONString (index_data_p, INDEXING_DESCRIPTION_S, description_s))
+																										{
+																											json_t *payload_p = GetBlastIndexingDataPayload (grassroots_p, name_s, db_p);
+
+																											if (payload_p)
+																												{
+																													if (json_object_set_new (index_data_p, INDEXING_PAYLOAD_DATA_S, payload_p) == 0)
+																														{
+																															return index_data_p;
+																														}		/* if (json_object_set_new (index_data_p, "payload", payload_p) == 0) */
+																													else
+																														{
+																															json_decref (payload_p);
+																															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to append data to array for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
+																														}
+																												}		/* if (payload_p) */
+																											else
+																												{
+																													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetIndexingDataPayload failed for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
+																												}
+
+																										}		/* if (SetJSONString (index_data_p, INDEXING_DESCRIPTION_S, description_s)) */
+																									else
+																										{
+																											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_DESCRIPTION_S, description_s, db_p -> di_name_s, name_s);
+																										}
+
+																								}		/* if (description_s) */
+																							else
+																								{
+																									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No description for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
+																								}
+
+																						}
+																					else
+																						{
+
+																							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_TYPE_DESCRIPTION_S, INDEXING_TYPE_DESCRIPTION_SERVICE_GRASSROOTS_S, db_p -> di_name_s, name_s);
+																						}
+
+
+																				}		/* if (SetJSONString (index_data_p, INDEXING_TYPE_S, INDEXING_TYPE_SERVICE_GRASSROOTS_S)) */
+																			else
+																				{
+																					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_TYPE_S, INDEXING_TYPE_SERVICE_GRASSROOTS_S, db_p -> di_name_s, name_s);
+																				}
+
+																		}		/* if (SetJSONString (index_data_p, "id", id_s)) */
+																	else
+																		{
+																			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"id\": \"%s\" for \"%s\" in \"%s\"", id_s, db_p -> di_name_s, name_s);
+																		}
+
+																}		/* if (id_s) */
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get id from \"%s\", \"%s\", \"%s\"", url_s, path_s, alias_s);
+																}
+
+														}		/* if (SetJSONString (index_data_p, "internal_url", url_s)) */
+													else
+														{
+															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"internal_url\": \"%s\" for \"%s\" in \"%s\"", url_s, db_p -> di_name_s, name_s);
+														}
+
+												}		/* if (json_is_string (hostname_p)) */
+											else
+												{
+													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, hostname_p, "Hostname is not a string");
+												}
+
+										}		/* if (hostname_p) */
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get hostname from global config");
+										}
+
+								}		/* if (SetJSONString (index_data_p, INDEXING_NAME_S, database_p -> di_name_s)) */
+							else
+								{
+									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_NAME_S, db_p -> di_name_s, db_p -> di_name_s, name_s);
+								}
+
+						}		/* if (SetJSONString (index_data_p, INDEXING_SERVICE_ALIAS_S, name_s)) */
+					else
+						{
+							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_SERVICE_ALIAS_S, name_s, db_p -> di_name_s, name_s);
+						}
+
+
+				}		/* if (SetJSONString (index_data_p, SERVICE_NAME_S, name_s)) */
+			else
+				{
+					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", SERVICE_NAME_S, name_s, db_p -> di_name_s, name_s);
+				}
+
+			json_decref (index_data_p);
+		}		/* if (index_data_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate index data for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
+		}
+
+	return NULL;
+}
+
+
+static void RunJobs (Service *service_p, ParameterSet *param_set_p, const char *input_filename_s, BlastAppParameters *app_params_p, ServiceJobSetIterator *iterator_p)
+{
+	/*
+	 * Get the absolute path and filename stem e.g.
+	 *
+	 *  file_stem_s = /usr/foo/bar/job_id
+	 *
+	 *  which will be used to build the input, output and other associated filenames e.g.
+	 *
+	 *  input file = file_stem_s + ".input"
+	 *  output_file = file_stem_s + ".output"
+	 *
+	 *  As each job will have the same input file name it using the first job's id
+	 *
+	 */
+	const size_t num_jobs = GetServiceJobSetSize (service_p -> se_jobs_p);
+	JobRunDetails *details_p = (JobRunDetails *) AllocMemoryArray (num_jobs, sizeof (JobRunDetails));
+
+	if (details_p)
+		{
+			BlastServiceData *blast_data_p = (BlastServiceData *) (service_p -> se_data_p);
+			ServiceJob *base_job_p = GetNextServiceJobFromServiceJobSetIterator (iterator_p);
+			JobRunDetails *detail_p = details_p;
+			size_t num_details = 0;
+			size_t i;
+
+			/*
+			 * Set up all of the jobs first. This is done one at a time
+			 * since it uses the shared ParameterSet.
+			 */
+			while (base_job_p && (num_details < num_jobs))
+				{
+					detail_p -> jrd_job_p = base_job_p;
+					detail_p -> jrd_ready_flag = false;
+					detail_p -> jrd_ran_flag = false;
+					detail_p -> jrd_combined_flag = false;
+
+					/*
+					 * Check that it is a BlastServiceJob as we may also have
+					 * RemoteServiceJobs on this list
+					 */
+					if (strcmp (base_job_p -> sj_type_s, BSJ_TYPE_S) == 0)
+						{
+							/*
+							 * Assume the job has failed unless proved otherwise
+							 */
+							SetServiceJobStatus (base_job_p, OS_FAILED_TO_START);
+
+							LogServiceJob (base_job_p);
+
+							detail_p -> jrd_ready_flag = PrepareBlastJobToRun ((BlastServiceJob *) base_job_p, param_set_p, input_filename_s, app_params_p);
+						}		/* if (strcmp (base_job_p -> sj_type_s, BSJ_TYPE_S) == 0) */
+					else if (strcmp (base_job_p -> sj_type_s, RSJ_TYPE_S) == 0)
+						{
+							detail_p -> jrd_ran_flag = true;
+						}		/* else if (strcmp (base_job_p -> sj_type_s, RSJ_TYPE_S) == 0) */
+
+					++ detail_p;
+					++ num_details;
+
+					base_job_p = GetNextServiceJobFromServiceJobSetIterator (iterator_p);
+				}		/* while (base_job_p && (num_details < num_jobs)) */
+
+
+			/*
+			 * Try searching all of the selected databases with a single Blast process.
+			 * Any jobs that this doesn't run are left ready for RunPreparedJobs.
+			 */
+			if ((service_p -> se_synchronous == SY_SYNCHRONOUS) && (blast_data_p -> bsd_combine_databases_flag))
+				{
+					RunCombinedDatabaseJobs (details_p, num_details, blast_data_p);
+				}
+
+			/*
+			 * Give the BlastToolFactory the chance to submit the remaining
+			 * jobs together, e.g. as a single array job on a cluster.
+			 */
+			RunGroupedJobs (details_p, num_details, blast_data_p);
+
+			/*
+			 * Asynchronous BlastTools return straight away, so there is only any
+			 * benefit in running the jobs concurrently for the synchronous ones.
+			 */
+			RunPreparedJobs (details_p, num_details, (service_p -> se_synchronous == SY_SYNCHRONOUS) ? blast_data_p -> bsd_max_parallel_databases : 1);
+
+
+			/*
+			 * Now update the statuses and the JobsManager for the jobs that were run
+			 */
+			for (i = 0, detail_p = details_p; i < num_details; ++ i, ++ detail_p)
+				{
+					if (detail_p -> jrd_ran_flag)
+						{
+							UpdateRanJob (service_p, detail_p -> jrd_job_p);
+						}
+					else if ((!detail_p -> jrd_ready_flag) && (blast_data_p -> bsd_task_manager_p) && (strcmp (detail_p -> jrd_job_p -> sj_type_s, BSJ_TYPE_S) == 0))
+						{
+							/* This job was never run, so it won't be completed asynchronously */
+							IncrementAsyncTaskManagerCount (blast_data_p -> bsd_task_manager_p);
+						}
+				}
+
+			FreeMemory (details_p);
+		}		/* if (details_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate details for running " SIZET_FMT " jobs", num_jobs);
+		}
+
+}
+
+
+static bool PrepareBlastJobToRun (BlastServiceJob *job_p, ParameterSet *param_set_p, const char *input_filename_s, BlastAppParameters *app_params_p)
+{
+	bool success_flag = false;
+	BlastTool *tool_p = job_p -> bsj_tool_p;
+
+	if (tool_p)
+		{
+			if (tool_p -> SetInputFilename (input_filename_s))
+				{
+					if (tool_p -> SetUpOutputFile())
+						{
+							if (tool_p -> ParseParameters (param_set_p, app_params_p))
+								{
+									success_flag = true;
+								}		/* if (tool_p -> ParseParameters (param_set_p, input_filename_s)) */
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse parameters for blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+								}
+
+						}		/* if (tool_p -> SetOutputFilename ()) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set output filename for blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+						}
+
+				}		/* if (tool_p -> SetInputFilename (input_filename_s)) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set input filename for blast tool \"%s\" to \"%s\"", job_p -> bsj_job.sj_name_s, input_filename_s);
+				}
+
+		}		/* if (tool_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast tool for \"%s\"", job_p -> bsj_job.sj_name_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Run the BlastTools for all of the prepared jobs using up to max_num_threads
+ * threads. The calling thread is one of these and this function will not return
+ * until all of the jobs have been run.
+ */
+static void RunPreparedJobs (JobRunDetails *details_p, const size_t num_jobs, const uint32 max_num_threads)
+{
+	JobsRunner runner;
+	size_t num_ready_jobs = 0;
+	size_t num_threads;
+	size_t i;
+	bool ran_flag = false;
+
+	for (i = 0; i < num_jobs; ++ i)
+		{
+			if ((details_p + i) -> jrd_ready_flag)
+				{
+					++ num_ready_jobs;
+				}
+		}
+
+	num_threads = (num_ready_jobs < max_num_threads) ? num_ready_jobs : max_num_threads;
+
+	runner.jr_details_p = details_p;
+	runner.jr_num_jobs = num_jobs;
+	runner.jr_next_index = 0;
+
+	if (num_threads > 1)
+		{
+			pthread_t *threads_p = (pthread_t *) AllocMemoryArray (num_threads - 1, sizeof (pthread_t));
+
+			if (threads_p)
+				{
+					if (pthread_mutex_init (& (runner.jr_mutex), NULL) == 0)
+						{
+							size_t num_started_threads = 0;
+
+							for (i = 0; i < num_threads - 1; ++ i)
+								{
+									if (pthread_create (threads_p + num_started_threads, NULL, RunPreparedJobsThread, &runner) == 0)
+										{
+											++ num_started_threads;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to start blast job thread " SIZET_FMT, i);
+										}
+								}
+
+							/* Do our share of the work and then wait for the other threads */
+							RunPreparedJobsThread (&runner);
+
+							for (i = 0; i < num_started_threads; ++ i)
+								{
+									pthread_join (* (threads_p + i), NULL);
+								}
+
+							pthread_mutex_destroy (& (runner.jr_mutex));
+
+							ran_flag = true;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to initialise mutex for running blast jobs");
+						}
+
+					FreeMemory (threads_p);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " blast job threads", num_threads - 1);
+				}
+
+		}		/* if (num_threads > 1) */
+
+
+	/* If we couldn't use any extra threads, run the jobs one after another */
+	if (!ran_flag)
+		{
+			for (i = 0; i < num_jobs; ++ i)
+				{
+					JobRunDetails *detail_p = details_p + i;
+
+					if (detail_p -> jrd_ready_flag)
+						{
+							BlastServiceJob *job_p = (BlastServiceJob *) (detail_p -> jrd_job_p);
+
+							if (RunBlast (job_p -> bsj_tool_p))
+								{
+									detail_p -> jrd_ran_flag = true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+								}
+						}
+				}
+		}
+}
+
+
+/*
+ * Run all of the ready jobs whose BlastTools support it as a single
+ * CombinedDatabaseSearch. If the combined search fails or its hits can't be
+ * split up between the databases, the jobs are left ready to be run separately.
+ */
+static void RunCombinedDatabaseJobs (JobRunDetails *details_p, const size_t num_jobs, const BlastServiceData *blast_data_p)
+{
+	BlastTool *lead_tool_p = NULL;
+	CombinedDatabaseSearch *search_p = NULL;
+	size_t num_ready_jobs = 0;
+	size_t i;
+	JobRunDetails *detail_p;
+
+	for (i = 0, detail_p = details_p; i < num_jobs; ++ i, ++ detail_p)
+		{
+			if (detail_p -> jrd_ready_flag)
+				{
+					if (!lead_tool_p)
+						{
+							lead_tool_p = ((BlastServiceJob *) (detail_p -> jrd_job_p)) -> bsj_tool_p;
+						}
+
+					++ num_ready_jobs;
+				}
+		}
+
+	if (num_ready_jobs > 1)
+		{
+			char job_id_s [UUID_STRING_BUFFER_SIZE];
+
+			ConvertUUIDToString (lead_tool_p -> GetUUID (), job_id_s);
+
+			search_p = CombinedDatabaseSearch :: Create (blast_data_p, job_id_s, (uint32) num_ready_jobs);
+		}
+
+	if (search_p)
+		{
+			lead_tool_p = NULL;
+
+			for (i = 0, detail_p = details_p; i < num_jobs; ++ i, ++ detail_p)
+				{
+					if (detail_p -> jrd_ready_flag)
+						{
+							BlastTool *tool_p = ((BlastServiceJob *) (detail_p -> jrd_job_p)) -> bsj_tool_p;
+
+							if (tool_p -> AddToCombinedDatabaseSearch (search_p))
+								{
+									detail_p -> jrd_combined_flag = true;
+
+									if (!lead_tool_p)
+										{
+											lead_tool_p = tool_p;
+										}
+								}
+						}
+				}
+
+			if ((search_p -> GetNumDatabases () > 1) && (search_p -> WriteAlias ()))
+				{
+					OperationStatus status;
+
+					for (i = 0, detail_p = details_p; i < num_jobs; ++ i, ++ detail_p)
+						{
+							if (detail_p -> jrd_combined_flag)
+								{
+									((BlastServiceJob *) (detail_p -> jrd_job_p)) -> bsj_tool_p -> PreRun ();
+								}
+						}
+
+					status = lead_tool_p -> RunCombinedDatabaseSearch (search_p);
+
+					if ((status == OS_SUCCEEDED) && (search_p -> Demultiplex ()))
+						{
+							for (i = 0, detail_p = details_p; i < num_jobs; ++ i, ++ detail_p)
+								{
+									if (detail_p -> jrd_combined_flag)
+										{
+											BlastTool *tool_p = ((BlastServiceJob *) (detail_p -> jrd_job_p)) -> bsj_tool_p;
+
+											tool_p -> CompleteRun (status);
+											tool_p -> PostRun ();
+
+											detail_p -> jrd_ready_flag = false;
+											detail_p -> jrd_ran_flag = true;
+										}
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Combined search against " UINT32_FMT " databases failed, searching them separately", search_p -> GetNumDatabases ());
+						}
+
+				}		/* if ((search_p -> GetNumDatabases () > 1) && (search_p -> WriteAlias ())) */
+
+			delete search_p;
+		}		/* if (search_p) */
+}
+
+
+/*
+ * Pass all of the ready jobs to the BlastToolFactory to run together.
+ * If it can't, they are left ready to be run separately.
+ */
+static void RunGroupedJobs (JobRunDetails *details_p, const size_t num_jobs, const BlastServiceData *blast_data_p)
+{
+	BlastTool **tools_pp = (BlastTool **) AllocMemoryArray (num_jobs, sizeof (BlastTool *));
+
+	if (tools_pp)
+		{
+			uint32 num_tools = 0;
+			size_t i;
+			JobRunDetails *detail_p;
+
+			for (i = 0, detail_p = details_p; i < num_jobs; ++ i, ++ detail_p)
+				{
+					if (detail_p -> jrd_ready_flag)
+						{
+							* (tools_pp + num_tools) = ((BlastServiceJob *) (detail_p -> jrd_job_p)) -> bsj_tool_p;
+							++ num_tools;
+						}
+				}
+
+			if (num_tools > 1)
+				{
+					if (RunBlastToolsTogetherFromFactory (blast_data_p -> bsd_tool_factory_p, tools_pp, num_tools, blast_data_p))
+						{
+							for (i = 0, detail_p = details_p; i < num_jobs; ++ i, ++ detail_p)
+								{
+									if (detail_p -> jrd_ready_flag)
+										{
+											detail_p -> jrd_ready_flag = false;
+											detail_p -> jrd_ran_flag = true;
+										}
+								}
+						}
+				}
+
+			FreeMemory (tools_pp);
+		}		/* if (tools_pp) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate " SIZET_FMT " BlastTools to run together", num_jobs);
+		}
+}
+
+
+static void *RunPreparedJobsThread (void *data_p)
+{
+	JobsRunner *runner_p = (JobsRunner *) data_p;
+	bool loop_flag = true;
+
+	while (loop_flag)
+		{
+			size_t index;
+
+			pthread_mutex_lock (& (runner_p -> jr_mutex));
+			index = runner_p -> jr_next_index;
+
+			if (index < runner_p -> jr_num_jobs)
+				{
+					++ (runner_p -> jr_next_index);
+				}
+
+			pthread_mutex_unlock (& (runner_p -> jr_mutex));
+
+			if (index < runner_p -> jr_num_jobs)
+				{
+					JobRunDetails *detail_p = runner_p -> jr_details_p + index;
+
+					/*
+					 * Each job only ever touches its own BlastServiceJob so once
+					 * we have claimed it, we don't need to hold the lock.
+					 */
+					if (detail_p -> jrd_ready_flag)
+						{
+							BlastServiceJob *job_p = (BlastServiceJob *) (detail_p -> jrd_job_p);
+
+							if (RunBlast (job_p -> bsj_tool_p))
+								{
+									detail_p -> jrd_ran_flag = true;
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+								}
+						}
+				}
+			else
+				{
+					loop_flag = false;
+				}
+		}
+
+	return NULL;
+}
+
+
+static void UpdateRanJob (Service *service_p, ServiceJob *base_job_p)
+{
+	if (strcmp (base_job_p -> sj_type_s, BSJ_TYPE_S) == 0)
+		{
+			BlastServiceJob *job_p = (BlastServiceJob *) base_job_p;
+
+			/* If the status needs updating, refresh it */
+			if ( (job_p -> bsj_job.sj_status == OS_PENDING) || (job_p -> bsj_job.sj_status == OS_STARTED))
+				{
+					SetServiceJobStatus (base_job_p, job_p -> bsj_tool_p -> GetStatus());
+				}
+
+			LogServiceJob (base_job_p);
+		}
+
+	switch (base_job_p -> sj_status)
+		{
+			case OS_SUCCEEDED:
+			case OS_PARTIALLY_SUCCEEDED:
+				if (base_job_p -> sj_result_p)
+					{
+						char job_id_s [UUID_STRING_BUFFER_SIZE];
+
+						ConvertUUIDToString (base_job_p -> sj_id, job_id_s);
+						PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get results for %s", job_id_s);
+					}
+
+				break;
+
+			case OS_PENDING:
+			case OS_STARTED:
+			{
+				GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (service_p);
+				JobsManager *jobs_manager_p = GetJobsManager (grassroots_p);
+
+				if (jobs_manager_p)
+					{
+						if (!AddServiceJobToJobsManager (jobs_manager_p, base_job_p -> sj_id, base_job_p))
+							{
+								char job_id_s [UUID_STRING_BUFFER_SIZE];
+
+								ConvertUUIDToString (base_job_p -> sj_id, job_id_s);
+								PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add job \"%s\" to JobsManager", job_id_s);
+							}
+					}
+			}
+			break;
+
+			default:
+				break;
+		}		/* switch (job_p -> bsj_job.sj_status) */
+}
+
+
+/*
+ * Find a job that is either one of this service's current jobs
+ * or has been stored in the JobsManager.
+ */
+static BlastServiceJob *FindBlastServiceJob (Service *service_p, const uuid_t job_id)
+{
+	BlastServiceJob *job_p = NULL;
+
+	if (service_p -> se_jobs_p)
+		{
+			job_p = (BlastServiceJob *) GetServiceJobFromServiceJobSetById (service_p -> se_jobs_p, job_id);
+		}
+
+	if (!job_p)
+		{
+			GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (service_p);
+			JobsManager *jobs_manager_p = GetJobsManager (grassroots_p);
+
+			if (jobs_manager_p)
+				{
+					job_p = (BlastServiceJob *) GetServiceJobFromJobsManager (jobs_manager_p, job_id);
+				}
+		}
+
+	return job_p;
+}
 
-																											if (payload_p)
-																												{
-																													if (json_object_set_new (index_data_p, INDEXING_PAYLOAD_DATA_S, payload_p) == 0)
-																														{
-																															return index_data_p;
-																														}		/* if (json_object_set_new (index_data_p, "payload", payload_p) == 0) */
-																													else
-																														{
-																															json_decref (payload_p);
-																															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to append data to array for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
-																														}
-																												}		/* if (payload_p) */
-																											else
-																												{
-																													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "GetIndexingDataPayload failed for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
-																												}
 
-																										}		/* if (SetJSONString (index_data_p, INDEXING_DESCRIPTION_S, description_s)) */
-																									else
-																										{
-																											PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_DESCRIPTION_S, description_s, db_p -> di_name_s, name_s);
-																										}
+/*
+ * If a job is still running and its output can be streamed, add the
+ * results of the queries that it has finished so far to job_p along
+ * with a marker saying that there are more to come.
+ */
+static bool AddStreamedBlastResultToServiceJob (ServiceJob *job_p, BlastServiceData *blast_data_p, const uuid_t job_id, const char *job_id_s, const uint32 output_format_code)
+{
+	bool success_flag = false;
+	BlastResultStreamer *streamer_p = blast_data_p -> bsd_streamer_p;
 
-																								}		/* if (description_s) */
-																							else
-																								{
-																									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No description for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
-																								}
+	if (streamer_p)
+		{
+			BlastServiceJob *running_job_p = FindBlastServiceJob (blast_data_p -> bsd_base_data.sd_service_p, job_id);
 
-																						}
-																					else
-																						{
+			if (running_job_p && (running_job_p -> bsj_tool_p))
+				{
+					if (GetCachedServiceJobStatus (& (running_job_p -> bsj_job)) == OS_STARTED)
+						{
+							/*
+							 * With a BlastFormatter, the output is written in its archive format
+							 * rather than the requested one. The ASN.1 archive can't be read until
+							 * it is complete but the single-file JSON one can.
+							 */
+							const uint32 output_format = (blast_data_p -> bsd_formatter_p) ? blast_data_p -> bsd_formatter_p -> GetArchiveOutputFormat () : running_job_p -> bsj_tool_p -> GetOutputFormat ();
 
-																							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_TYPE_DESCRIPTION_S, INDEXING_TYPE_DESCRIPTION_SERVICE_GRASSROOTS_S, db_p -> di_name_s, name_s);
-																						}
+							/* The Grassroots markup is made from the single-file JSON format */
+							const bool markup_flag = (output_format_code == BOF_GRASSROOTS) && (output_format == BOF_SINGLE_FILE_JSON_BLAST);
 
+							if (markup_flag || (output_format_code == output_format))
+								{
+									char *output_filename_s = GetPreviousJobFilename (blast_data_p, job_id_s, BS_OUTPUT_SUFFIX_S);
 
-																				}		/* if (SetJSONString (index_data_p, INDEXING_TYPE_S, INDEXING_TYPE_SERVICE_GRASSROOTS_S)) */
-																			else
-																				{
-																					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_TYPE_S, INDEXING_TYPE_SERVICE_GRASSROOTS_S, db_p -> di_name_s, name_s);
-																				}
+									if (output_filename_s)
+										{
+											uint32 num_queries = 0;
+											json_t *result_json_p = streamer_p -> GetCompletedResults (job_id_s, output_filename_s, output_format, markup_flag, blast_data_p, &num_queries);
 
-																		}		/* if (SetJSONString (index_data_p, "id", id_s)) */
+											if (result_json_p)
+												{
+													json_t *blast_result_json_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, job_id_s, result_json_p);
+
+													if (blast_result_json_p)
+														{
+															if ((SetJSONBoolean (blast_result_json_p, BS_MORE_RESULTS_PENDING_S, true)) &&
+																	(SetJSONInteger (blast_result_json_p, BS_QUERIES_COMPLETED_S, num_queries)))
+																{
+																	if (AddResultToServiceJob (job_p, blast_result_json_p))
+																		{
+																			success_flag = true;
+																		}
 																	else
 																		{
-																			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"id\": \"%s\" for \"%s\" in \"%s\"", id_s, db_p -> di_name_s, name_s);
+																			json_decref (blast_result_json_p);
+																			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add streamed blast result \"%s\" to json results array", job_id_s);
 																		}
-
-																}		/* if (id_s) */
+																}
 															else
 																{
-																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get id from \"%s\", \"%s\", \"%s\"", url_s, path_s, alias_s);
+																	json_decref (blast_result_json_p);
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to mark streamed blast result \"%s\" as incomplete", job_id_s);
 																}
-
-														}		/* if (SetJSONString (index_data_p, "internal_url", url_s)) */
+														}
 													else
 														{
-															PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"internal_url\": \"%s\" for \"%s\" in \"%s\"", url_s, db_p -> di_name_s, name_s);
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get streamed blast result as json \"%s\"", job_id_s);
 														}
 
-												}		/* if (json_is_string (hostname_p)) */
-											else
-												{
-													PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, hostname_p, "Hostname is not a string");
-												}
+													json_decref (result_json_p);
+												}		/* if (result_json_p) */
 
-										}		/* if (hostname_p) */
-									else
-										{
-											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get hostname from global config");
-										}
+											FreeCopiedString (output_filename_s);
+										}		/* if (output_filename_s) */
 
-								}		/* if (SetJSONString (index_data_p, INDEXING_NAME_S, database_p -> di_name_s)) */
-							else
-								{
-									PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_NAME_S, db_p -> di_name_s, db_p -> di_name_s, name_s);
-								}
+								}		/* if (markup_flag || (output_format_code == output_format)) */
 
-						}		/* if (SetJSONString (index_data_p, INDEXING_SERVICE_ALIAS_S, name_s)) */
+						}		/* if (GetCachedServiceJobStatus (& (running_job_p -> bsj_job)) == OS_STARTED) */
 					else
 						{
-							PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", INDEXING_SERVICE_ALIAS_S, name_s, db_p -> di_name_s, name_s);
+							/* The job has finished so its results are now read in full */
+							streamer_p -> Forget (job_id_s);
 						}
 
+				}		/* if (running_job_p && (running_job_p -> bsj_tool_p)) */
 
-				}		/* if (SetJSONString (index_data_p, SERVICE_NAME_S, name_s)) */
-			else
-				{
-					PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, index_data_p, "Failed to add \"%s\": \"%s\" for \"%s\" in \"%s\"", SERVICE_NAME_S, name_s, db_p -> di_name_s, name_s);
-				}
-
-			json_decref (index_data_p);
-		}		/* if (index_data_p) */
-	else
-		{
-			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate index data for \"%s\" in \"%s\"", db_p -> di_name_s, name_s);
-		}
+		}		/* if (streamer_p) */
 
-	return NULL;
+	return success_flag;
 }
 
 
-static void RunJobs (Service *service_p, ParameterSet *param_set_p, const char *input_filename_s, BlastAppParameters *app_params_p, ServiceJobSetIterator *iterator_p)
+/*
+ * Add a page of the hits of a finished job to job_p along with the
+ * numbers that are needed to page through the rest of them.
+ */
+static bool AddBlastResultsPageToServiceJob (ServiceJob *job_p, BlastServiceData *blast_data_p, const char *job_id_s, const uint32 output_format_code, const BlastResultsPage *page_p, char **error_ss)
 {
-	/*
-	 * Get the absolute path and filename stem e.g.
-	 *
-	 *  file_stem_s = /usr/foo/bar/job_id
-	 *
-	 *  which will be used to build the input, output and other associated filenames e.g.
-	 *
-	 *  input file = file_stem_s + ".input"
-	 *  output_file = file_stem_s + ".output"
-	 *
-	 *  As each job will have the same input file name it using the first job's id
-	 *
-	 */
-	ServiceJob *base_job_p = GetNextServiceJobFromServiceJobSetIterator (iterator_p);
+	bool success_flag = false;
 
-	if (base_job_p)
+	/* The hits can only be picked out of the single-file JSON format, which the Grassroots markup is made from */
+	if ((output_format_code == BOF_SINGLE_FILE_JSON_BLAST) || (output_format_code == BOF_GRASSROOTS))
 		{
-			bool loop_flag = true;
-			bool job_ran_flag;
+			BlastHitIndex *hit_index_p = GetBlastJobHitIndex (blast_data_p, job_id_s);
 
-			/*
-			 * Iterate over all the jobs and run them if need be
-			 */
-			while (loop_flag)
+			if (hit_index_p)
 				{
-					job_ran_flag = false;
+					const uint64 num_queries = hit_index_p -> GetNumReports ();
 
-					/*
-					 * Check that it is a BlastServiceJob as we may also have
-					 * RemoteServiceJobs on this list
-					 */
-					if (strcmp (base_job_p -> sj_type_s, BSJ_TYPE_S) == 0)
+					if (page_p -> brp_query_index <= num_queries)
 						{
-							BlastServiceJob *job_p = (BlastServiceJob *) base_job_p;
-							BlastTool *tool_p = job_p -> bsj_tool_p;
+							uint64 num_hits = 0;
+							BlastResultBuffer *page_buffer_p = hit_index_p -> GetPage (page_p -> brp_query_index, page_p -> brp_hits_offset, page_p -> brp_hits_limit, &num_hits);
 
-							/*
-							 * Assume the job has failed unless proved otherwise
-							 */
-							SetServiceJobStatus (base_job_p, OS_FAILED_TO_START);
+							if (page_buffer_p)
+								{
+									json_t *result_json_p = NULL;
 
-							LogServiceJob (base_job_p);
+									if (output_format_code == BOF_GRASSROOTS)
+										{
+											/*
+											 * Each page is marked up on its own rather than through
+											 * the SingleFlightConverter, which shares the markup of
+											 * the whole of a job's output.
+											 */
+											json_error_t err;
+											json_t *blast_output_p = page_buffer_p -> ParseAsJSON (&err);
+
+											if (blast_output_p)
+												{
+													result_json_p = ConvertBlastResultToGrassrootsMarkUp (blast_output_p, blast_data_p);
+													json_decref (blast_output_p);
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse page of blast result \"%s\", error at line %d: \"%s\"", job_id_s, err.line, err.text);
+												}
+										}
+									else
+										{
+											result_json_p = page_buffer_p -> GetAsJSONString ();
+										}
 
-							if (tool_p)
-								{
-									if (tool_p -> SetInputFilename (input_filename_s))
+									if (result_json_p)
 										{
-											if (tool_p -> SetUpOutputFile())
+											json_t *blast_result_json_p = GetDataResourceAsJSONByParts (PROTOCOL_INLINE_S, NULL, job_id_s, result_json_p);
+
+											if (blast_result_json_p)
 												{
-													if (tool_p -> ParseParameters (param_set_p, app_params_p))
+													if ((SetJSONInteger (blast_result_json_p, BS_TOTAL_QUERIES_S, num_queries)) &&
+															(SetJSONInteger (blast_result_json_p, BS_TOTAL_HITS_S, hit_index_p -> GetNumHits (page_p -> brp_query_index))) &&
+															(SetJSONInteger (blast_result_json_p, BS_HITS_RETURNED_S, num_hits)))
 														{
-															if (RunBlast (tool_p))
+															if (AddResultToServiceJob (job_p, blast_result_json_p))
 																{
-																	/* If the status needs updating, refresh it */
-																	if ( (job_p -> bsj_job.sj_status == OS_PENDING) || (job_p -> bsj_job.sj_status == OS_STARTED))
-																		{
-																			SetServiceJobStatus (base_job_p, tool_p -> GetStatus());
-																		}
-
-																	LogServiceJob (base_job_p);
-																	job_ran_flag = true;
-
+																	success_flag = true;
 																}
 															else
 																{
-																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to run blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+																	json_decref (blast_result_json_p);
+																	*error_ss = ConcatenateVarargsStrings ("Failed to add page of blast result \"", job_id_s, "\" to json results array", NULL);
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add page of blast result \"%s\" to json results array", job_id_s);
 																}
-
-														}		/* if (tool_p -> ParseParameters (param_set_p, input_filename_s)) */
+														}
 													else
 														{
-															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse parameters for blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+															json_decref (blast_result_json_p);
+															*error_ss = ConcatenateVarargsStrings ("Failed to add paging details to blast result \"", job_id_s, "\"", NULL);
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add paging details to blast result \"%s\"", job_id_s);
 														}
-
-												}		/* if (tool_p -> SetOutputFilename ()) */
+												}
 											else
 												{
-													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set output filename for blast tool \"%s\"", job_p -> bsj_job.sj_name_s);
+													*error_ss = ConcatenateVarargsStrings ("Failed to get page of blast result as json \"", job_id_s, "\"", NULL);
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get page of blast result as json \"%s\"", job_id_s);
 												}
 
-										}		/* if (tool_p -> SetInputFilename (input_filename_s)) */
+											json_decref (result_json_p);
+										}		/* if (result_json_p) */
 									else
 										{
-											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set input filename for blast tool \"%s\" to \"%s\"", job_p -> bsj_job.sj_name_s, input_filename_s);
+											*error_ss = ConcatenateVarargsStrings ("Failed to convert page of blast result \"", job_id_s, "\"", NULL);
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to convert page of blast result \"%s\"", job_id_s);
 										}
 
-								}		/* if (tool_p) */
+									delete page_buffer_p;
+								}		/* if (page_buffer_p) */
 							else
 								{
-									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast tool for \"%s\"", job_p -> bsj_job.sj_name_s);
+									*error_ss = ConcatenateVarargsStrings ("Failed to get page of blast result \"", job_id_s, "\"", NULL);
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get page of blast result \"%s\"", job_id_s);
 								}
 
-						}		/* if (strcmp (base_job_p -> sj_type_s, BSJ_TYPE_S) == 0) */
-					else if (strcmp (base_job_p -> sj_type_s, RSJ_TYPE_S) == 0)
+						}		/* if (page_p -> brp_query_index <= num_queries) */
+					else
 						{
-							job_ran_flag = true;
-						}		/* else if (strcmp (base_job_p -> sj_type_s, RSJ_TYPE_S) == 0) */
+							char *num_queries_s = ConvertLongToString ((int64) num_queries);
+
+							if (num_queries_s)
+								{
+									*error_ss = ConcatenateVarargsStrings ("Query index is out of range for \"", job_id_s, "\" which has results for ", num_queries_s, " queries", NULL);
+									FreeCopiedString (num_queries_s);
+								}
 
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Query index " UINT32_FMT " is out of range for \"%s\" which has results for " UINT64_FMT " queries", page_p -> brp_query_index, job_id_s, num_queries);
+						}
+
+					delete hit_index_p;
+				}		/* if (hit_index_p) */
+			else
+				{
+					*error_ss = ConcatenateVarargsStrings ("Failed to index the hits of blast result \"", job_id_s, "\"", NULL);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to index the hits of blast result \"%s\"", job_id_s);
+				}
+
+		}		/* if ((output_format_code == BOF_SINGLE_FILE_JSON_BLAST) || (output_format_code == BOF_GRASSROOTS)) */
+	else
+		{
+			*error_ss = EasyCopyToNewString ("Results can only be paged through in the single-file JSON and Grassroots markup output formats");
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Can't page through \"%s\" in output format " UINT32_FMT, job_id_s, output_format_code);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Get the index of the hits in a job's single-file JSON output, building
+ * it if this hasn't been done yet or if the output has changed since.
+ */
+static BlastHitIndex *GetBlastJobHitIndex (const BlastServiceData *data_p, const char *job_id_s)
+{
+	BlastHitIndex *hit_index_p = NULL;
+	char *index_filename_s = GetPreviousJobFilename (data_p, job_id_s, BS_HIT_INDEX_SUFFIX_S);
+
+	if (index_filename_s)
+		{
+			char *json_filename_s = GetBlastJobJSONFilename (data_p, job_id_s);
+			BlastResultBuffer *results_p = NULL;
+
+			if (!json_filename_s)
+				{
+					/*
+					 * Converting the output writes the single-file JSON version to disk
+					 * unless it is a remote job or was already in the ConvertedOutputCache's
+					 * memory, in which case we index what we've been given.
+					 */
+					results_p = GetBlastResultBufferByUUIDString (data_p, job_id_s, BOF_SINGLE_FILE_JSON_BLAST, NULL);
 
-					if (job_ran_flag)
+					if (results_p)
 						{
-							switch (base_job_p -> sj_status)
-								{
-									case OS_SUCCEEDED:
-									case OS_PARTIALLY_SUCCEEDED:
-										if (base_job_p -> sj_result_p)
-											{
-												char job_id_s [UUID_STRING_BUFFER_SIZE];
+							json_filename_s = GetBlastJobJSONFilename (data_p, job_id_s);
+						}
+				}
 
-												ConvertUUIDToString (base_job_p -> sj_id, job_id_s);
-												PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get results for %s", job_id_s);
-											}
+			if (json_filename_s)
+				{
+					hit_index_p = BlastHitIndex :: OpenIndex (json_filename_s, index_filename_s);
 
-										break;
+					if (!hit_index_p)
+						{
+							if (BlastHitIndex :: WriteIndex (json_filename_s, index_filename_s))
+								{
+									hit_index_p = BlastHitIndex :: OpenIndex (json_filename_s, index_filename_s);
+								}
+						}
 
-									case OS_PENDING:
-									case OS_STARTED:
-									{
-										GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (service_p);
-										JobsManager *jobs_manager_p = GetJobsManager (grassroots_p);
+					FreeCopiedString (json_filename_s);
+				}
+			else if (results_p)
+				{
+					hit_index_p = BlastHitIndex :: IndexBuffer (results_p);
 
-										if (jobs_manager_p)
-											{
-												if (!AddServiceJobToJobsManager (jobs_manager_p, base_job_p -> sj_id, base_job_p))
-													{
-														char job_id_s [UUID_STRING_BUFFER_SIZE];
+					/* The index now owns the results */
+					if (hit_index_p)
+						{
+							results_p = NULL;
+						}
+				}
 
-														ConvertUUIDToString (base_job_p -> sj_id, job_id_s);
-														PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add job \"%s\" to JobsManager", job_id_s);
-													}
-											}
-									}
-									break;
+			if (results_p)
+				{
+					delete results_p;
+				}
 
-									default:
-										break;
-								}		/* switch (job_p -> bsj_job.sj_status) */
+			FreeCopiedString (index_filename_s);
+		}		/* if (index_filename_s) */
+
+	return hit_index_p;
+}
 
-						}		/* if (job_ran_flag) */
 
-					base_job_p = GetNextServiceJobFromServiceJobSetIterator (iterator_p);
-					loop_flag = (base_job_p != NULL);
+/*
+ * Get the filename of a job's output in the single-file JSON format,
+ * which is either the job's own output or a version that has been
+ * converted from it, if it exists.
+ */
+static char *GetBlastJobJSONFilename (const BlastServiceData *data_p, const char *job_id_s)
+{
+	char *json_filename_s = NULL;
+	char *job_output_filename_s = GetPreviousJobFilename (data_p, job_id_s, BS_OUTPUT_SUFFIX_S);
 
-				}		/* while (loop_flag) */
+	if (job_output_filename_s)
+		{
+			if (DoesBlastFileExist (job_output_filename_s) && BlastHitIndex :: IsIndexable (job_output_filename_s))
+				{
+					json_filename_s = job_output_filename_s;
+					job_output_filename_s = NULL;
+				}
+			else
+				{
+					char *converted_filename_s = BlastFormatter :: GetConvertedOutputFilename (job_output_filename_s, BOF_SINGLE_FILE_JSON_BLAST, NULL);
 
+					if (converted_filename_s)
+						{
+							if (DoesBlastFileExist (converted_filename_s) && BlastHitIndex :: IsIndexable (converted_filename_s))
+								{
+									json_filename_s = converted_filename_s;
+								}
+							else
+								{
+									FreeCopiedString (converted_filename_s);
+								}
+						}
+				}
 
-		}		/* if (job_p) */
+			if (job_output_filename_s)
+				{
+					FreeCopiedString (job_output_filename_s);
+				}
+		}		/* if (job_output_filename_s) */
 
+	return json_filename_s;
 }
 
 
@@ -1950,15 +3551,33 @@ static bool PreRunJobs (BlastServiceData *blast_data_p)
 	if (blast_data_p -> bsd_task_manager_p)
 		{
 			Service *blast_service_p = blast_data_p -> bsd_base_data.sd_service_p;
+			ServiceJobSetIterator iterator;
+			ServiceJob *job_p;
+			int32 num_blast_jobs = 0;
+
+			/*
+			 * Each BlastServiceJob counts itself as finished once its Blast process
+			 * has been completed by the BlastProcessMonitor, or straight away if it
+			 * couldn't be started.
+			 */
+			InitServiceJobSetIterator (&iterator, blast_service_p -> se_jobs_p);
+
+			while ((job_p = GetNextServiceJobFromServiceJobSetIterator (&iterator)) != NULL)
+				{
+					if (strcmp (job_p -> sj_type_s, BSJ_TYPE_S) == 0)
+						{
+							++ num_blast_jobs;
+						}
+				}
 
 			/*
-			 * Set the initial counter value to 1 which will take the system's call
+			 * Add 1 to the counter value which will take the system's call
 			 * to ReleaseService () into account once it has finished with this
 			 * Service. This is to make sure that the Service doesn't delete itself
 			 * after it has finished running all of its jobs asynchronously before
 			 * the system has finished with it and then accessing freed memory.
 			 */
-			PrepareAsyncTasksManager (blast_data_p -> bsd_task_manager_p, 1);
+			PrepareAsyncTasksManager (blast_data_p -> bsd_task_manager_p, 1 + num_blast_jobs);
 
 			/* If we have asynchronous jobs running then set the "is running" flag for this service */
 			SetServiceRunning (blast_service_p, true);
@@ -2038,3 +3657,31 @@ static char *ConfigureWorkingDirectoryPath (const json_t *blast_config_p)
 
 	return dir_s;
 }
+
+
+/*
+ * There is no point in splitting a database into a single shard and
+ * each of the shards must be the name of a database volume.
+ */
+static bool AreDatabaseShardsValid (const json_t *shards_p)
+{
+	bool valid_flag = false;
+
+	if (json_is_array (shards_p) && (json_array_size (shards_p) > 1))
+		{
+			size_t i;
+			json_t *shard_p;
+
+			valid_flag = true;
+
+			json_array_foreach (shards_p, i, shard_p)
+			{
+				if (!json_is_string (shard_p))
+					{
+						valid_flag = false;
+					}
+			}
+		}
+
+	return valid_flag;
+}
@@ -49,6 +49,7 @@
 static const char * const BSJ_TOOL_S = "tool";
 static const char * const BSJ_FACTORY_S = "factory";
 static const char * const BSJ_JOB_S = "job";
+static const char * const BSJ_PROGRESS_S = "progress";
 
 
 static bool ProcessResultForLinkedService (json_t *data_p, ServiceJob *job_p, LinkedService *linked_service_p, ParameterSet *output_params_p);
@@ -323,6 +324,17 @@ json_t *ConvertBlastServiceJobToJSON (BlastServiceJob *job_p, bool omit_results_
 														{
 															if (json_object_set_new (blast_job_json_p, BSJ_TOOL_S, tool_json_p) == 0)
 																{
+																	/* This is only available while the job is running */
+																	json_t *progress_json_p = job_p -> bsj_tool_p -> GetProgressAsJSON ();
+
+																	if (progress_json_p)
+																		{
+																			if (json_object_set_new (blast_job_json_p, BSJ_PROGRESS_S, progress_json_p) != 0)
+																				{
+																					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add progress json");
+																				}
+																		}
+
 																	return blast_job_json_p;
 																}
 															else
@@ -31,12 +31,28 @@
 #include "blast_service_params.h"
 #include "string_utils.h"
 #include "regular_expressions.h"
+#include "single_flight_converter.hpp"
+#include "blast_result_buffer.hpp"
 
 #include "uuid_util.h"
 
 
 
 
+/*
+ * The blast output that a SingleFlightConverter
+ * needs to mark up.
+ */
+typedef struct BlastResultStringMarkUp
+{
+	const char *brsm_blast_output_s;
+
+	size_t brsm_blast_output_length;
+
+	BlastServiceData *brsm_data_p;
+} BlastResultStringMarkUp;
+
+
 /*
  * STATIC FUNCTION PROTOTYPES
  */
@@ -63,6 +79,12 @@ static bool AddMarkedUpHit (json_t *marked_up_results_p, const json_t *blast_hit
 
 static json_t *GetBlastResult (BlastServiceJob *job_p, BlastServiceData *data_p);
 
+static json_t *RunBlastResultMarkUp (void *data_p);
+
+static json_t *RunBlastResultStringMarkUp (void *data_p);
+
+static json_t *MarkUpBlastResultOnce (BlastServiceData *data_p, const char *job_id_s, MarkUpOutputCallback markup_fn, void *callback_data_p);
+
 static const DatabaseInfo *GetDatabaseFromBlastResult (const json_t *blast_report_p, const BlastServiceData *data_p);
 
 
@@ -708,13 +730,65 @@ json_t *ConvertBlastResultToGrassrootsMarkUp (const json_t *blast_job_output_p,
 
 json_t *MarkUpBlastResult (BlastServiceJob *job_p)
 {
-	json_t *markup_p = NULL;
 	BlastServiceData *data_p = (BlastServiceData *) (job_p -> bsj_job.sj_service_p -> se_data_p);
-	json_t *blast_job_output_p = GetBlastResult (job_p, data_p);
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (job_p -> bsj_job.sj_id, uuid_s);
+
+	return MarkUpBlastResultOnce (data_p, uuid_s, RunBlastResultMarkUp, job_p);
+}
+
+
+json_t *ConvertBlastResultStringToGrassrootsMarkUp (const char *job_id_s, const char *blast_output_s, const size_t blast_output_length, BlastServiceData *data_p)
+{
+	BlastResultStringMarkUp markup;
+
+	markup.brsm_blast_output_s = blast_output_s;
+	markup.brsm_blast_output_length = blast_output_length;
+	markup.brsm_data_p = data_p;
+
+	return MarkUpBlastResultOnce (data_p, job_id_s, RunBlastResultStringMarkUp, &markup);
+}
+
+
+/*
+ * If a job's output is already being marked up for another request,
+ * wait for that and share its result rather than doing it again.
+ */
+static json_t *MarkUpBlastResultOnce (BlastServiceData *data_p, const char *job_id_s, MarkUpOutputCallback markup_fn, void *callback_data_p)
+{
+	json_t *markup_p = NULL;
+	char *key_s = NULL;
+
+	if (data_p -> bsd_flights_p)
+		{
+			key_s = SingleFlightConverter :: MakeFlightKey (job_id_s, BOF_GRASSROOTS, NULL);
+		}
+
+	if (key_s)
+		{
+			markup_p = data_p -> bsd_flights_p -> MarkUpOutput (key_s, markup_fn, callback_data_p);
+			FreeCopiedString (key_s);
+		}
+	else
+		{
+			markup_p = markup_fn (callback_data_p);
+		}
+
+	return markup_p;
+}
+
+
+static json_t *RunBlastResultMarkUp (void *data_p)
+{
+	json_t *markup_p = NULL;
+	BlastServiceJob *job_p = (BlastServiceJob *) data_p;
+	BlastServiceData *blast_data_p = (BlastServiceData *) (job_p -> bsj_job.sj_service_p -> se_data_p);
+	json_t *blast_job_output_p = GetBlastResult (job_p, blast_data_p);
 
 	if (blast_job_output_p)
 		{
-			markup_p = ConvertBlastResultToGrassrootsMarkUp (blast_job_output_p, data_p);
+			markup_p = ConvertBlastResultToGrassrootsMarkUp (blast_job_output_p, blast_data_p);
 			json_decref (blast_job_output_p);
 		}		/* if (blast_job_output_p) */
 
@@ -723,6 +797,27 @@ json_t *MarkUpBlastResult (BlastServiceJob *job_p)
 }
 
 
+static json_t *RunBlastResultStringMarkUp (void *data_p)
+{
+	json_t *markup_p = NULL;
+	BlastResultStringMarkUp *markup_data_p = (BlastResultStringMarkUp *) data_p;
+	json_error_t err;
+	json_t *blast_job_output_p = json_loadb (markup_data_p -> brsm_blast_output_s, markup_data_p -> brsm_blast_output_length, 0, &err);
+
+	if (blast_job_output_p)
+		{
+			markup_p = ConvertBlastResultToGrassrootsMarkUp (blast_job_output_p, markup_data_p -> brsm_data_p);
+			json_decref (blast_job_output_p);
+		}		/* if (blast_job_output_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse blast output, error at line %d: \"%s\"", err.line, err.text);
+		}
+
+	return markup_p;
+}
+
+
 
 json_t *GetInitialisedProcessedRequest (void)
 {
@@ -1720,27 +1815,27 @@ static json_t *GetBlastResult (BlastServiceJob *job_p, BlastServiceData *data_p)
 	 * Get the result. Ideally we'd like to get this in a format that we can parse, so to begin with we'll use the single json format
 	 * available in blast 2.3+
 	 */
-	char *raw_result_s = GetBlastResultByUUID (data_p, job_p -> bsj_job.sj_id, BOF_SINGLE_FILE_JSON_BLAST, NULL);
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+	BlastResultBuffer *raw_result_p;
 
-	if (raw_result_s)
+	ConvertUUIDToString (job_p -> bsj_job.sj_id, uuid_s);
+	raw_result_p = GetBlastResultBufferByUUIDString (data_p, uuid_s, BOF_SINGLE_FILE_JSON_BLAST, NULL);
+
+	if (raw_result_p)
 		{
 			json_error_t err;
-			blast_output_p = json_loads (raw_result_s, 0, &err);
+			blast_output_p = raw_result_p -> ParseAsJSON (&err);
 
 			if (!blast_output_p)
 				{
-					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "error decoding blast result: \"%s\"\n\"%s\"\n%d %d %d\n%s\n", err.text, err.source, err.line, err.column, err.position, raw_result_s);
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "error decoding blast result: \"%s\"\n\"%s\"\n%d %d %d\n%.*s\n", err.text, err.source, err.line, err.column, err.position, (int) (raw_result_p -> GetLength ()), raw_result_p -> GetData ());
 				}
 
-			FreeCopiedString (raw_result_s);
+			delete raw_result_p;
 		}
 	else
 		{
-			char uuid_s [UUID_STRING_BUFFER_SIZE];
-
-			ConvertUUIDToString (job_p -> bsj_job.sj_id, uuid_s);
 			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get blast result for \"%s\"", uuid_s);
-
 		}
 
 	return blast_output_p;
@@ -244,10 +244,39 @@ Parameter *SetUpPreviousJobUUIDParameter (const BlastServiceData *service_data_p
 {
 	Parameter *param_p = EasyCreateAndAddStringParameterToParameterSet (& (service_data_p -> bsd_base_data), param_set_p, group_p, BS_JOB_ID.npt_type, BS_JOB_ID.npt_name_s, "Job IDs", "The UUIDs for Blast jobs that have previously been run", NULL, PL_ADVANCED);
 
+	if (param_p)
+		{
+			bool def = false;
+
+			if (!EasyCreateAndAddBooleanParameterToParameterSet (& (service_data_p -> bsd_base_data), param_set_p, group_p, BS_CANCEL_JOBS.npt_name_s, "Cancel jobs", "Stop the Blast jobs given by the Job IDs if they are still running", &def, PL_ADVANCED))
+				{
+					param_p = NULL;
+				}
+		}
+
 	return param_p;
 }
 
 
+bool SetUpPreviousJobResultsPageParameters (const BlastServiceData *service_data_p, ParameterSet *param_set_p, ParameterGroup *group_p)
+{
+	bool success_flag = false;
+
+	if (EasyCreateAndAddUnsignedIntParameterToParameterSet (& (service_data_p -> bsd_base_data), param_set_p, group_p, BS_QUERY_INDEX.npt_name_s, "Query index", "When getting the results of previous jobs, only get the hits for this query, counting from 1. Leave as 0 to page through the hits of all of the queries", NULL, PL_ADVANCED))
+		{
+			if (EasyCreateAndAddUnsignedIntParameterToParameterSet (& (service_data_p -> bsd_base_data), param_set_p, group_p, BS_HITS_OFFSET.npt_name_s, "Hits offset", "When getting the results of previous jobs, the number of hits to skip", NULL, PL_ADVANCED))
+				{
+					if (EasyCreateAndAddUnsignedIntParameterToParameterSet (& (service_data_p -> bsd_base_data), param_set_p, group_p, BS_HITS_LIMIT.npt_name_s, "Hits limit", "When getting the results of previous jobs, the maximum number of hits to get. Leave as 0 to get all of them", NULL, PL_ADVANCED))
+						{
+							success_flag = true;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
 int8 GetOutputFormatCodeForString (const char *output_format_s)
 {
 	int8 code = -1;
@@ -334,7 +363,7 @@ bool AddQuerySequenceParams (BlastServiceData *data_p, ParameterSet *param_set_p
 	ParameterGroup *group_p = CreateAndAddParameterGroupToParameterSet ("Query Sequence Parameters", false, & (data_p -> bsd_base_data), param_set_p);
 
 
-	if ((param_p = SetUpPreviousJobUUIDParameter (data_p, param_set_p, group_p)) != NULL)
+	if (((param_p = SetUpPreviousJobUUIDParameter (data_p, param_set_p, group_p)) != NULL) && (SetUpPreviousJobResultsPageParameters (data_p, param_set_p, group_p)))
 		{
 			if ((param_p = EasyCreateAndAddStringParameterToParameterSet (& (data_p -> bsd_base_data), param_set_p, group_p, BS_INPUT_QUERY.npt_type, BS_INPUT_QUERY.npt_name_s, "Query Sequence(s)", "Query sequence(s) to be used for a BLAST search should be pasted in the 'Search' text area. "
 																													"It accepts a number of different types of input and automatically determines the format or the input."
@@ -371,6 +400,22 @@ bool GetQuerySequenceParameterTypeForNamedParameter (const char *param_name_s, P
 		{
 			*pt_p = BS_JOB_ID.npt_type;
 		}
+	else if (strcmp (param_name_s, BS_CANCEL_JOBS.npt_name_s) == 0)
+		{
+			*pt_p = BS_CANCEL_JOBS.npt_type;
+		}
+	else if (strcmp (param_name_s, BS_QUERY_INDEX.npt_name_s) == 0)
+		{
+			*pt_p = BS_QUERY_INDEX.npt_type;
+		}
+	else if (strcmp (param_name_s, BS_HITS_OFFSET.npt_name_s) == 0)
+		{
+			*pt_p = BS_HITS_OFFSET.npt_type;
+		}
+	else if (strcmp (param_name_s, BS_HITS_LIMIT.npt_name_s) == 0)
+		{
+			*pt_p = BS_HITS_LIMIT.npt_type;
+		}
 	else if (strcmp (param_name_s, BS_INPUT_QUERY.npt_name_s) == 0)
 		{
 			*pt_p = BS_INPUT_QUERY.npt_type;
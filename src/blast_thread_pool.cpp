@@ -0,0 +1,551 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * blast_thread_pool.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <unistd.h>
+
+#include "blast_thread_pool.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+
+
+#ifdef _DEBUG
+	#define BLAST_THREAD_POOL_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define BLAST_THREAD_POOL_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A thread in the pool along with its queue of tasks.
+ */
+typedef struct BlastThreadPoolWorker
+{
+	pthread_t btpw_thread;
+
+	/* Guards btpw_tasks_p and btpw_running_task_p */
+	pthread_mutex_t btpw_mutex;
+
+	LinkedList *btpw_tasks_p;
+
+	/* The task that this worker is running, if any */
+	struct BlastThreadPoolTaskNode *btpw_running_task_p;
+
+	uint32 btpw_index;
+
+	BlastThreadPool *btpw_pool_p;
+} BlastThreadPoolWorker;
+
+
+/*
+ * A queued task.
+ */
+typedef struct BlastThreadPoolTaskNode
+{
+	ListItem btptn_node;
+
+	BlastThreadPoolTaskFn btptn_fn;
+
+	BlastThreadPoolTaskFn btptn_stop_fn;
+
+	BlastThreadPoolTaskFn btptn_free_fn;
+
+	void *btptn_data_p;
+} BlastThreadPoolTaskNode;
+
+
+static void FreeBlastThreadPoolTaskNode (ListItem * const node_p);
+
+static void StopBlastThreadPoolTask (BlastThreadPoolTaskNode *node_p);
+
+
+BlastThreadPool *BlastThreadPool :: btp_shared_pool_p = 0;
+
+uint32 BlastThreadPool :: btp_shared_pool_count = 0;
+
+pthread_mutex_t BlastThreadPool :: btp_shared_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+BlastThreadPool *BlastThreadPool :: GetSharedBlastThreadPool (uint32 num_threads)
+{
+	BlastThreadPool *pool_p = 0;
+
+	pthread_mutex_lock (&btp_shared_pool_mutex);
+
+	if (!btp_shared_pool_p)
+		{
+			if (num_threads == 0)
+				{
+					long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+					num_threads = (num_cpus > 0) ? (uint32) num_cpus : 1;
+				}
+
+			try
+				{
+					btp_shared_pool_p = new BlastThreadPool (num_threads);
+
+					#if BLAST_THREAD_POOL_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared BlastThreadPool with " UINT32_FMT " threads", num_threads);
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create BlastThreadPool with " UINT32_FMT " threads", num_threads);
+				}
+		}
+	else if ((num_threads != 0) && (num_threads != btp_shared_pool_p -> btp_num_workers))
+		{
+			PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Shared BlastThreadPool already has " UINT32_FMT " threads, ignoring request for " UINT32_FMT, btp_shared_pool_p -> btp_num_workers, num_threads);
+		}
+
+	if (btp_shared_pool_p)
+		{
+			++ btp_shared_pool_count;
+			pool_p = btp_shared_pool_p;
+		}
+
+	pthread_mutex_unlock (&btp_shared_pool_mutex);
+
+	return pool_p;
+}
+
+
+void BlastThreadPool :: ReleaseSharedBlastThreadPool ()
+{
+	BlastThreadPool *pool_p = 0;
+
+	pthread_mutex_lock (&btp_shared_pool_mutex);
+
+	if (btp_shared_pool_count > 0)
+		{
+			-- btp_shared_pool_count;
+
+			if (btp_shared_pool_count == 0)
+				{
+					pool_p = btp_shared_pool_p;
+					btp_shared_pool_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&btp_shared_pool_mutex);
+
+	/*
+	 * Free the pool without holding the mutex as it has to wait
+	 * for the running tasks to stop.
+	 */
+	if (pool_p)
+		{
+			#if BLAST_THREAD_POOL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Last reference to shared BlastThreadPool released, shutting it down");
+			#endif
+
+			delete pool_p;
+		}
+}
+
+
+BlastThreadPool :: BlastThreadPool (uint32 num_threads)
+{
+	uint32 i;
+	uint32 num_initialised_workers = 0;
+	uint32 num_started_workers = 0;
+
+	if (num_threads == 0)
+		{
+			num_threads = 1;
+		}
+
+	btp_num_workers = num_threads;
+	btp_next_worker = 0;
+	btp_num_queued_tasks = 0;
+	btp_running_flag = true;
+
+	btp_workers_p = (BlastThreadPoolWorker *) AllocMemoryArray (num_threads, sizeof (BlastThreadPoolWorker));
+
+	if (!btp_workers_p)
+		{
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_mutex_init (&btp_mutex, NULL) != 0)
+		{
+			FreeMemory (btp_workers_p);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&btp_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&btp_mutex);
+			FreeMemory (btp_workers_p);
+			throw std :: bad_alloc ();
+		}
+
+	for (i = 0; i < num_threads; ++ i)
+		{
+			BlastThreadPoolWorker *worker_p = btp_workers_p + i;
+
+			worker_p -> btpw_index = i;
+			worker_p -> btpw_pool_p = this;
+			worker_p -> btpw_running_task_p = 0;
+			worker_p -> btpw_tasks_p = AllocateLinkedList (FreeBlastThreadPoolTaskNode);
+
+			if (worker_p -> btpw_tasks_p)
+				{
+					if (pthread_mutex_init (& (worker_p -> btpw_mutex), NULL) == 0)
+						{
+							++ num_initialised_workers;
+						}
+					else
+						{
+							FreeLinkedList (worker_p -> btpw_tasks_p);
+							i = num_threads;		/* force exit from loop */
+						}
+				}
+			else
+				{
+					i = num_threads;		/* force exit from loop */
+				}
+		}
+
+	if (num_initialised_workers == num_threads)
+		{
+			for (i = 0; i < num_threads; ++ i)
+				{
+					BlastThreadPoolWorker *worker_p = btp_workers_p + i;
+
+					if (pthread_create (& (worker_p -> btpw_thread), NULL, BlastThreadPool :: RunWorker, worker_p) == 0)
+						{
+							++ num_started_workers;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to start thread " UINT32_FMT " for BlastThreadPool", i);
+							i = num_threads;		/* force exit from loop */
+						}
+				}
+		}
+
+	if (num_started_workers != num_threads)
+		{
+			/* Stop any threads that we did start */
+			pthread_mutex_lock (&btp_mutex);
+			btp_running_flag = false;
+			pthread_cond_broadcast (&btp_cond);
+			pthread_mutex_unlock (&btp_mutex);
+
+			for (i = 0; i < num_started_workers; ++ i)
+				{
+					pthread_join ((btp_workers_p + i) -> btpw_thread, NULL);
+				}
+
+			for (i = 0; i < num_initialised_workers; ++ i)
+				{
+					BlastThreadPoolWorker *worker_p = btp_workers_p + i;
+
+					pthread_mutex_destroy (& (worker_p -> btpw_mutex));
+					FreeLinkedList (worker_p -> btpw_tasks_p);
+				}
+
+			pthread_cond_destroy (&btp_cond);
+			pthread_mutex_destroy (&btp_mutex);
+			FreeMemory (btp_workers_p);
+
+			throw std :: bad_alloc ();
+		}
+}
+
+
+BlastThreadPool :: ~BlastThreadPool ()
+{
+	LinkedList stopped_tasks;
+	BlastThreadPoolTaskNode *node_p;
+	uint32 i;
+
+	InitLinkedList (&stopped_tasks);
+
+	/* Stop accepting tasks and wake up any idle workers so that they exit */
+	pthread_mutex_lock (&btp_mutex);
+	btp_running_flag = false;
+	pthread_cond_broadcast (&btp_cond);
+	pthread_mutex_unlock (&btp_mutex);
+
+	/*
+	 * Stop the running tasks and take the queued ones so that they won't
+	 * be run. Any task that a worker takes from a queue after this point
+	 * is stopped by the worker itself as the pool is no longer running.
+	 */
+	for (i = 0; i < btp_num_workers; ++ i)
+		{
+			BlastThreadPoolWorker *worker_p = btp_workers_p + i;
+
+			pthread_mutex_lock (& (worker_p -> btpw_mutex));
+
+			if (worker_p -> btpw_running_task_p)
+				{
+					worker_p -> btpw_running_task_p -> btptn_stop_fn (worker_p -> btpw_running_task_p -> btptn_data_p);
+				}
+
+			while ((node_p = (BlastThreadPoolTaskNode *) LinkedListRemHead (worker_p -> btpw_tasks_p)) != NULL)
+				{
+					LinkedListAddTail (&stopped_tasks, & (node_p -> btptn_node));
+				}
+
+			pthread_mutex_unlock (& (worker_p -> btpw_mutex));
+		}
+
+	pthread_mutex_lock (&btp_mutex);
+	btp_num_queued_tasks -= (int32) (stopped_tasks.ll_size);
+	pthread_mutex_unlock (&btp_mutex);
+
+	for (i = 0; i < btp_num_workers; ++ i)
+		{
+			pthread_join ((btp_workers_p + i) -> btpw_thread, NULL);
+		}
+
+	#if BLAST_THREAD_POOL_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "BlastThreadPool threads have finished, stopping " UINT32_FMT " queued tasks", stopped_tasks.ll_size);
+	#endif
+
+	while ((node_p = (BlastThreadPoolTaskNode *) LinkedListRemHead (&stopped_tasks)) != NULL)
+		{
+			StopBlastThreadPoolTask (node_p);
+		}
+
+	for (i = 0; i < btp_num_workers; ++ i)
+		{
+			BlastThreadPoolWorker *worker_p = btp_workers_p + i;
+
+			pthread_mutex_destroy (& (worker_p -> btpw_mutex));
+			FreeLinkedList (worker_p -> btpw_tasks_p);
+		}
+
+	pthread_cond_destroy (&btp_cond);
+	pthread_mutex_destroy (&btp_mutex);
+	FreeMemory (btp_workers_p);
+}
+
+
+uint32 BlastThreadPool :: GetNumThreads () const
+{
+	return btp_num_workers;
+}
+
+
+bool BlastThreadPool :: AddTask (BlastThreadPoolTaskFn task_fn, BlastThreadPoolTaskFn stop_fn, BlastThreadPoolTaskFn free_fn, void *data_p)
+{
+	bool success_flag = false;
+	BlastThreadPoolTaskNode *node_p = (BlastThreadPoolTaskNode *) AllocMemory (sizeof (BlastThreadPoolTaskNode));
+
+	if (node_p)
+		{
+			BlastThreadPoolWorker *worker_p = 0;
+
+			node_p -> btptn_node.ln_prev_p = NULL;
+			node_p -> btptn_node.ln_next_p = NULL;
+			node_p -> btptn_fn = task_fn;
+			node_p -> btptn_stop_fn = stop_fn;
+			node_p -> btptn_free_fn = free_fn;
+			node_p -> btptn_data_p = data_p;
+
+			pthread_mutex_lock (&btp_mutex);
+
+			if (btp_running_flag)
+				{
+					worker_p = btp_workers_p + btp_next_worker;
+
+					++ btp_next_worker;
+
+					if (btp_next_worker == btp_num_workers)
+						{
+							btp_next_worker = 0;
+						}
+				}
+
+			pthread_mutex_unlock (&btp_mutex);
+
+			if (worker_p)
+				{
+					pthread_mutex_lock (& (worker_p -> btpw_mutex));
+					pthread_mutex_lock (&btp_mutex);
+
+					/*
+					 * Check again with the worker's queue locked, so that the
+					 * task can't be added after the pool has emptied the queue
+					 * whilst shutting down.
+					 */
+					if (btp_running_flag)
+						{
+							LinkedListAddTail (worker_p -> btpw_tasks_p, & (node_p -> btptn_node));
+
+							++ btp_num_queued_tasks;
+							pthread_cond_signal (&btp_cond);
+
+							success_flag = true;
+						}
+
+					pthread_mutex_unlock (&btp_mutex);
+					pthread_mutex_unlock (& (worker_p -> btpw_mutex));
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "BlastThreadPool is shutting down, cannot add task");
+					FreeMemory (node_p);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate BlastThreadPool task");
+		}
+
+	return success_flag;
+}
+
+
+BlastThreadPoolTaskNode *BlastThreadPool :: GetNextTask (uint32 worker_index)
+{
+	BlastThreadPoolWorker *worker_p = btp_workers_p + worker_index;
+	BlastThreadPoolTaskNode *node_p = 0;
+
+	/* Take the oldest task from our own queue... */
+	pthread_mutex_lock (& (worker_p -> btpw_mutex));
+	node_p = (BlastThreadPoolTaskNode *) LinkedListRemHead (worker_p -> btpw_tasks_p);
+	pthread_mutex_unlock (& (worker_p -> btpw_mutex));
+
+	/* ... or steal the oldest one from another worker */
+	if (!node_p)
+		{
+			uint32 i;
+
+			for (i = 1; (i < btp_num_workers) && (!node_p); ++ i)
+				{
+					BlastThreadPoolWorker *victim_p = btp_workers_p + ((worker_index + i) % btp_num_workers);
+
+					pthread_mutex_lock (& (victim_p -> btpw_mutex));
+					node_p = (BlastThreadPoolTaskNode *) LinkedListRemHead (victim_p -> btpw_tasks_p);
+					pthread_mutex_unlock (& (victim_p -> btpw_mutex));
+				}
+		}
+
+	if (node_p)
+		{
+			pthread_mutex_lock (&btp_mutex);
+			-- btp_num_queued_tasks;
+			pthread_mutex_unlock (&btp_mutex);
+		}
+
+	return node_p;
+}
+
+
+void *BlastThreadPool :: RunWorker (void *data_p)
+{
+	BlastThreadPoolWorker *worker_p = (BlastThreadPoolWorker *) data_p;
+	BlastThreadPool *pool_p = worker_p -> btpw_pool_p;
+	bool loop_flag = true;
+
+	while (loop_flag)
+		{
+			BlastThreadPoolTaskNode *node_p = pool_p -> GetNextTask (worker_p -> btpw_index);
+
+			if (node_p)
+				{
+					bool run_flag;
+
+					/*
+					 * Only mark the task as running if the pool hasn't started
+					 * shutting down, so that the pool either stops it whilst it
+					 * is running or it is stopped here without being run.
+					 */
+					pthread_mutex_lock (& (worker_p -> btpw_mutex));
+					pthread_mutex_lock (& (pool_p -> btp_mutex));
+
+					run_flag = pool_p -> btp_running_flag;
+
+					pthread_mutex_unlock (& (pool_p -> btp_mutex));
+
+					if (run_flag)
+						{
+							worker_p -> btpw_running_task_p = node_p;
+						}
+
+					pthread_mutex_unlock (& (worker_p -> btpw_mutex));
+
+					if (run_flag)
+						{
+							node_p -> btptn_fn (node_p -> btptn_data_p);
+
+							pthread_mutex_lock (& (worker_p -> btpw_mutex));
+							worker_p -> btpw_running_task_p = 0;
+							pthread_mutex_unlock (& (worker_p -> btpw_mutex));
+
+							node_p -> btptn_free_fn (node_p -> btptn_data_p);
+							FreeMemory (node_p);
+						}
+					else
+						{
+							StopBlastThreadPoolTask (node_p);
+						}
+				}
+			else
+				{
+					pthread_mutex_lock (& (pool_p -> btp_mutex));
+
+					while ((pool_p -> btp_num_queued_tasks <= 0) && (pool_p -> btp_running_flag))
+						{
+							pthread_cond_wait (& (pool_p -> btp_cond), & (pool_p -> btp_mutex));
+						}
+
+					/* Any tasks that are still queued once the pool is shutting down are stopped by the pool */
+					if (!pool_p -> btp_running_flag)
+						{
+							loop_flag = false;
+						}
+
+					pthread_mutex_unlock (& (pool_p -> btp_mutex));
+				}
+		}
+
+	return NULL;
+}
+
+
+/*
+ * Stop a task that will never be run and free it.
+ */
+static void StopBlastThreadPoolTask (BlastThreadPoolTaskNode *node_p)
+{
+	node_p -> btptn_stop_fn (node_p -> btptn_data_p);
+	node_p -> btptn_free_fn (node_p -> btptn_data_p);
+
+	FreeMemory (node_p);
+}
+
+
+static void FreeBlastThreadPoolTaskNode (ListItem * const node_p)
+{
+	FreeMemory (node_p);
+}
@@ -18,11 +18,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
+#include <ctime>
 
 #include <syslog.h>
 
 #include "blast_service.h"
 #include "blast_service_job.h"
+#include "blast_result_buffer.hpp"
 #include "io_utils.h"
 
 #include "byte_buffer.h"
@@ -41,6 +43,8 @@ const char * const BlastTool :: BT_OUTPUT_FORMAT_S = "output_format";
 
 const char * const BlastTool :: BT_CUSTOM_OUTPUT_COLUMNS_S = "custom_output_format_columns";
 
+const char * const BlastTool :: BT_START_TIME_S = "start_time";
+
 
 
 #ifdef _DEBUG
@@ -83,6 +87,12 @@ OperationStatus GetBlastStatus (BlastTool *tool_p)
 }
 
 
+bool CancelBlast (BlastTool *tool_p)
+{
+	return (tool_p -> Cancel ());
+}
+
+
 /******************************/
 
 
@@ -93,6 +103,7 @@ BlastTool :: BlastTool (BlastServiceJob *service_job_p, const char *name_s, cons
 
 	bt_service_data_p = data_p;
 	bt_output_format = output_format;
+	bt_start_time = 0;
 
 	bt_factory_name_s = EasyCopyToNewString (factory_s);
 	if (!bt_factory_name_s)
@@ -137,6 +148,7 @@ BlastTool :: BlastTool (BlastServiceJob *service_job_p, const char *name_s, cons
 BlastTool :: BlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p, const json_t *root_p)
 {
 	json_int_t output_format = BS_DEFAULT_OUTPUT_FORMAT;
+	json_int_t start_time = 0;
 
 	bt_factory_name_s = GetCopiedJSONString (root_p, BT_FACTORY_NAME_S);
 	if (!bt_factory_name_s)
@@ -168,6 +180,9 @@ BlastTool :: BlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p,
 	GetJSONInteger (root_p, BT_OUTPUT_FORMAT_S, &output_format);
 	bt_output_format = (uint32) output_format;
 
+	GetJSONInteger (root_p, BT_START_TIME_S, &start_time);
+	bt_start_time = (time_t) start_time;
+
 
 	bt_job_p = job_p;
 	bt_service_data_p = data_p;
@@ -199,6 +214,37 @@ OperationStatus BlastTool :: GetStatus (bool update_flag)
 	return status;
 }
 
+bool BlastTool :: Cancel ()
+{
+	return false;
+}
+
+
+json_t *BlastTool :: GetProgressAsJSON ()
+{
+	return NULL;
+}
+
+
+BlastResultBuffer *BlastTool :: GetResultsBuffer (BlastFormatter *formatter_p)
+{
+	BlastResultBuffer *buffer_p = 0;
+	char *results_s = GetResults (formatter_p);
+
+	if (results_s)
+		{
+			buffer_p = BlastResultBuffer :: AdoptString (results_s);
+
+			if (!buffer_p)
+				{
+					FreeCopiedString (results_s);
+				}
+		}
+
+	return buffer_p;
+}
+
+
 const uuid_t &BlastTool :: GetUUID () const
 {
 	return bt_job_p -> bsj_job.sj_id;
@@ -243,6 +289,7 @@ BlastTool :: ~BlastTool ()
 bool BlastTool :: PreRun ()
 {
 	SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_STARTED);
+	bt_start_time = time (NULL);
 
 	return true;
 }
@@ -253,6 +300,26 @@ void BlastTool :: PostRun ()
 }
 
 
+bool BlastTool :: AddToCombinedDatabaseSearch (CombinedDatabaseSearch * UNUSED_PARAM (search_p))
+{
+	return false;
+}
+
+
+OperationStatus BlastTool :: RunCombinedDatabaseSearch (CombinedDatabaseSearch * UNUSED_PARAM (search_p))
+{
+	return OS_FAILED_TO_START;
+}
+
+
+OperationStatus BlastTool :: CompleteRun (OperationStatus status)
+{
+	SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
+
+	return status;
+}
+
+
 uint32 BlastTool :: GetOutputFormat () const
 {
 	return bt_output_format;
@@ -298,7 +365,15 @@ bool BlastTool :: AddToJSON (json_t *root_p)
 									success_flag = SetJSONNull (root_p, BT_CUSTOM_OUTPUT_COLUMNS_S);
 								}
 
-							if (!success_flag)
+							if (success_flag)
+								{
+									if (!SetJSONInteger (root_p, BT_START_TIME_S, (json_int_t) bt_start_time))
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s:" SIZET_FMT " to BlastTool json", BT_START_TIME_S, (size_t) bt_start_time);
+											success_flag = false;
+										}
+								}
+							else
 								{
 									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s:%s to BlastTool json", BT_CUSTOM_OUTPUT_COLUMNS_S, bt_custom_output_columns_s ? bt_custom_output_columns_s : "null");
 								}
@@ -27,6 +27,7 @@
 #include "blast_service.h"
 #include "drmaa_blast_tool_factory.hpp"
 #include "system_blast_tool_factory.hpp"
+#include "threaded_blast_tool_factory.hpp"
 #include "streams.h"
 
 
@@ -61,6 +62,21 @@ BlastToolFactory *BlastToolFactory :: GetBlastToolFactory (const json_t *service
 					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Grassroots has been compiled without DRMAA support so cannot use DrmaaBlastToolFactory");
 					#endif
 				}		/* if (strcmp (value_s, "drmaa") == 0) */
+			else if (strcmp (value_s, "threaded") == 0)
+				{
+					factory_p = ThreadedBlastToolFactory :: CreateThreadedBlastToolFactory (service_config_p);
+
+					if (factory_p)
+						{
+							#if BLAST_TOOL_FACTORY_DEBUG >= STM_LEVEL_FINER
+							PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Using ThreadedBlastToolFactory");
+							#endif
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create ThreadedBlastToolFactory");
+						}
+				}		/* else if (strcmp (value_s, "threaded") == 0) */
 
 		}		/* if (value_s) */
 
@@ -99,6 +115,12 @@ BlastToolFactory :: ~BlastToolFactory ()
 }
 
 
+bool BlastToolFactory :: RunBlastToolsTogether (BlastTool ** UNUSED_PARAM (tools_pp), const uint32 UNUSED_PARAM (num_tools), const BlastServiceData * UNUSED_PARAM (data_p))
+{
+	return false;
+}
+
+
 BlastTool *CreateBlastToolFromFactory (BlastToolFactory *factory_p, BlastServiceJob *job_p, const char *name_s, const BlastServiceData *data_p)
 {
 	return (factory_p -> CreateBlastTool (job_p, name_s, data_p));
@@ -116,3 +138,9 @@ Synchronicity GetBlastToolFactorySynchronicity (BlastToolFactory *factory_p)
 	return factory_p -> GetToolsSynchronicity ();
 }
 
+
+bool RunBlastToolsTogetherFromFactory (BlastToolFactory *factory_p, BlastTool **tools_pp, const uint32 num_tools, const BlastServiceData *data_p)
+{
+	return factory_p -> RunBlastToolsTogether (tools_pp, num_tools, data_p);
+}
+
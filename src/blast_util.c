@@ -22,7 +22,11 @@
 
 #include "blast_util.h"
 
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include "math_utils.h"
 #include "string_utils.h"
@@ -36,6 +40,45 @@
 #include "uuid_util.h"
 
 
+/* How deeply alias databases can refer to other alias databases */
+#define BU_MAX_ALIAS_DEPTH (8)
+
+
+/*
+ * The running totals for GetBlastDatabaseStatistics.
+ */
+typedef struct BlastDatabaseStatistics
+{
+	uint32 bds_num_sequences;
+
+	uint64 bds_total_length;
+} BlastDatabaseStatistics;
+
+
+/*
+ * A function that is called for each of the files of a database's
+ * volumes, returning false if the file couldn't be used.
+ */
+typedef bool (*BlastDatabaseVolumeFn) (const char *filename_s, void *data_p);
+
+
+static bool VisitBlastDatabaseVolumes (const char *db_s, const char *suffix_s, const char *alias_suffix_s, BlastDatabaseVolumeFn volume_fn, void *data_p, const uint32 depth);
+
+static bool VisitBlastAliasVolumes (const char *alias_filename_s, const char *suffix_s, const char *alias_suffix_s, BlastDatabaseVolumeFn volume_fn, void *data_p, const uint32 depth);
+
+static char *FindBlastDatabaseFile (const char *db_s, const char *suffix_s);
+
+static bool AddBlastVolumeSize (const char *filename_s, void *data_p);
+
+static bool AddBlastVolumeStatistics (const char *filename_s, void *data_p);
+
+static bool ReadBlastIndexHeader (const char *filename_s, uint32 *num_sequences_p, uint64 *total_length_p);
+
+static bool ReadBigEndianUInt32 (FILE *in_f, uint32 *value_p);
+
+static bool SkipBlastIndexString (FILE *in_f);
+
+
 
 bool AddArgsPair (const char *key_s, const char *value_s, ArgsProcessor *ap_p)
 {
@@ -271,3 +314,476 @@ char *GetBlastJobFilename (const char * const prefix_s, const char *job_id_s, co
 	return job_filename_s;
 }
 
+
+
+uint64 GetBlastDatabaseSize (const char *db_s)
+{
+	uint64 size = 0;
+
+	if (!VisitBlastDatabaseVolumes (db_s, "nsq", "nal", AddBlastVolumeSize, &size, 0))
+		{
+			size = 0;
+
+			if (!VisitBlastDatabaseVolumes (db_s, "psq", "pal", AddBlastVolumeSize, &size, 0))
+				{
+					size = 0;
+					PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Failed to find the sequence files for database \"%s\" so its size is unknown", db_s);
+				}
+		}
+
+	return size;
+}
+
+
+uint64 GetBlastFileSize (const char *filename_s)
+{
+	uint64 size = 0;
+	struct stat st;
+
+	if (stat (filename_s, &st) == 0)
+		{
+			size = (uint64) st.st_size;
+		}
+
+	return size;
+}
+
+
+uint32 CountBlastQueries (const char *query_filename_s)
+{
+	uint32 num_queries = 0;
+	FILE *in_f = fopen (query_filename_s, "r");
+
+	if (in_f)
+		{
+			int c;
+			int prev_c = '\n';
+			bool data_flag = false;
+
+			while ((c = fgetc (in_f)) != EOF)
+				{
+					if ((c == '>') && (prev_c == '\n'))
+						{
+							++ num_queries;
+						}
+					else if (!isspace (c))
+						{
+							data_flag = true;
+						}
+
+					prev_c = c;
+				}
+
+			/* A raw sequence without a FASTA header is a single query */
+			if ((num_queries == 0) && data_flag)
+				{
+					num_queries = 1;
+				}
+
+			fclose (in_f);
+		}
+
+	return num_queries;
+}
+
+
+bool GetBlastDatabaseStatistics (const char *db_s, uint32 *num_sequences_p, uint64 *total_length_p)
+{
+	BlastDatabaseStatistics stats;
+	bool success_flag;
+
+	stats.bds_num_sequences = 0;
+	stats.bds_total_length = 0;
+
+	success_flag = VisitBlastDatabaseVolumes (db_s, "nin", "nal", AddBlastVolumeStatistics, &stats, 0);
+
+	if (!success_flag)
+		{
+			stats.bds_num_sequences = 0;
+			stats.bds_total_length = 0;
+
+			success_flag = VisitBlastDatabaseVolumes (db_s, "pin", "pal", AddBlastVolumeStatistics, &stats, 0);
+		}
+
+	if (success_flag)
+		{
+			*num_sequences_p = stats.bds_num_sequences;
+			*total_length_p = stats.bds_total_length;
+		}
+	else
+		{
+			*num_sequences_p = 0;
+			*total_length_p = 0;
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Call volume_fn for the file with the given suffix of each of the volumes
+ * of a database. As with Blast itself, a database can be a single volume,
+ * an alias file listing other databases or, for larger databases, volumes
+ * called <db>.00.<suffix>, <db>.01.<suffix>, etc.
+ */
+static bool VisitBlastDatabaseVolumes (const char *db_s, const char *suffix_s, const char *alias_suffix_s, BlastDatabaseVolumeFn volume_fn, void *data_p, const uint32 depth)
+{
+	bool success_flag = false;
+	char *filename_s = FindBlastDatabaseFile (db_s, suffix_s);
+
+	if (filename_s)
+		{
+			success_flag = volume_fn (filename_s, data_p);
+			FreeCopiedString (filename_s);
+		}
+	else if ((filename_s = FindBlastDatabaseFile (db_s, alias_suffix_s)) != NULL)
+		{
+			if (depth < BU_MAX_ALIAS_DEPTH)
+				{
+					success_flag = VisitBlastAliasVolumes (filename_s, suffix_s, alias_suffix_s, volume_fn, data_p, depth + 1);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Alias database \"%s\" is nested more than %d deep", filename_s, BU_MAX_ALIAS_DEPTH);
+				}
+
+			FreeCopiedString (filename_s);
+		}
+	else
+		{
+			uint32 i;
+			bool loop_flag = true;
+
+			for (i = 0; (i < 100) && loop_flag; ++ i)
+				{
+					char volume_suffix_s [16];
+
+					sprintf (volume_suffix_s, "%02u.%s", (unsigned int) i, suffix_s);
+
+					filename_s = FindBlastDatabaseFile (db_s, volume_suffix_s);
+
+					if (filename_s)
+						{
+							loop_flag = volume_fn (filename_s, data_p);
+							success_flag = loop_flag;
+
+							FreeCopiedString (filename_s);
+						}
+					else
+						{
+							loop_flag = false;
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Visit each of the databases in the DBLIST of an alias file, which are
+ * relative to the alias's own directory. An alias that only covers some
+ * of its databases' sequences, using a GILIST, OIDLIST, etc., is treated
+ * as a failure since its sizes can't be worked out from the volumes.
+ */
+static bool VisitBlastAliasVolumes (const char *alias_filename_s, const char *suffix_s, const char *alias_suffix_s, BlastDatabaseVolumeFn volume_fn, void *data_p, const uint32 depth)
+{
+	bool success_flag = false;
+	char *alias_s = GetFileContentsAsStringByFilename (alias_filename_s);
+
+	if (alias_s)
+		{
+			const char *separator_s = strrchr (alias_filename_s, '/');
+			char *directory_s = separator_s ? CopyToNewString (alias_filename_s, separator_s - alias_filename_s, false) : NULL;
+			char *line_s = alias_s;
+			bool loop_flag = (separator_s == NULL) || (directory_s != NULL);
+
+			while (loop_flag && *line_s)
+				{
+					char *next_line_s = strchr (line_s, '\n');
+
+					if (next_line_s)
+						{
+							*next_line_s = '\0';
+							++ next_line_s;
+						}
+					else
+						{
+							next_line_s = line_s + strlen (line_s);
+						}
+
+					if ((strncmp (line_s, "GILIST", 6) == 0) || (strncmp (line_s, "OIDLIST", 7) == 0) || (strncmp (line_s, "SEQIDLIST", 9) == 0) || (strncmp (line_s, "TAXIDLIST", 9) == 0))
+						{
+							PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "Alias database \"%s\" only covers part of its databases", alias_filename_s);
+							success_flag = false;
+							loop_flag = false;
+						}
+					else if ((strncmp (line_s, "DBLIST", 6) == 0) && isspace (* (line_s + 6)))
+						{
+							char *db_s = line_s + 6;
+
+							while (loop_flag && *db_s)
+								{
+									char *end_s;
+
+									while (isspace (*db_s))
+										{
+											++ db_s;
+										}
+
+									/* Names with spaces in are quoted */
+									if (*db_s == '"')
+										{
+											++ db_s;
+											end_s = strchr (db_s, '"');
+										}
+									else
+										{
+											end_s = db_s;
+
+											while (*end_s && !isspace (*end_s))
+												{
+													++ end_s;
+												}
+										}
+
+									if (end_s && (end_s > db_s))
+										{
+											const bool last_flag = (*end_s == '\0');
+											char *path_s;
+
+											*end_s = '\0';
+
+											if ((*db_s == '/') || (!directory_s))
+												{
+													path_s = EasyCopyToNewString (db_s);
+												}
+											else
+												{
+													path_s = ConcatenateVarargsStrings (directory_s, "/", db_s, NULL);
+												}
+
+											if (path_s)
+												{
+													loop_flag = VisitBlastDatabaseVolumes (path_s, suffix_s, alias_suffix_s, volume_fn, data_p, depth);
+													success_flag = loop_flag;
+
+													FreeCopiedString (path_s);
+												}
+											else
+												{
+													success_flag = false;
+													loop_flag = false;
+												}
+
+											db_s = last_flag ? end_s : end_s + 1;
+										}
+									else
+										{
+											/* The end of the list or an unmatched quote */
+											loop_flag = (end_s != NULL);
+											db_s += strlen (db_s);
+										}
+								}		/* while (loop_flag && *db_s) */
+
+						}		/* else if ((strncmp (line_s, "DBLIST", 6) == 0) && isspace (* (line_s + 6))) */
+
+					line_s = next_line_s;
+				}		/* while (loop_flag && *line_s) */
+
+			if (directory_s)
+				{
+					FreeCopiedString (directory_s);
+				}
+
+			FreeCopiedString (alias_s);
+		}		/* if (alias_s) */
+
+	return success_flag;
+}
+
+
+/*
+ * Find <db>.<suffix>, looking in the directories in the BLASTDB
+ * environment variable, as Blast does, if it isn't in the current
+ * directory and the database name doesn't give a path.
+ */
+static char *FindBlastDatabaseFile (const char *db_s, const char *suffix_s)
+{
+	char *filename_s = ConcatenateVarargsStrings (db_s, ".", suffix_s, NULL);
+
+	if (filename_s)
+		{
+			if (GetBlastFileSize (filename_s) == 0)
+				{
+					const char *blastdb_s = getenv ("BLASTDB");
+
+					FreeCopiedString (filename_s);
+					filename_s = NULL;
+
+					if (blastdb_s && (!strchr (db_s, '/')))
+						{
+							while (*blastdb_s && !filename_s)
+								{
+									const char *end_s = strchr (blastdb_s, ':');
+									const size_t length = end_s ? (size_t) (end_s - blastdb_s) : strlen (blastdb_s);
+
+									if (length > 0)
+										{
+											char *directory_s = CopyToNewString (blastdb_s, length, false);
+
+											if (directory_s)
+												{
+													filename_s = ConcatenateVarargsStrings (directory_s, "/", db_s, ".", suffix_s, NULL);
+
+													if (filename_s && (GetBlastFileSize (filename_s) == 0))
+														{
+															FreeCopiedString (filename_s);
+															filename_s = NULL;
+														}
+
+													FreeCopiedString (directory_s);
+												}
+										}
+
+									blastdb_s += length;
+
+									if (*blastdb_s == ':')
+										{
+											++ blastdb_s;
+										}
+								}		/* while (*blastdb_s && !filename_s) */
+						}
+				}
+		}
+
+	return filename_s;
+}
+
+
+static bool AddBlastVolumeSize (const char *filename_s, void *data_p)
+{
+	uint64 *size_p = (uint64 *) data_p;
+	const uint64 size = GetBlastFileSize (filename_s);
+
+	*size_p += size;
+
+	return (size > 0);
+}
+
+
+static bool AddBlastVolumeStatistics (const char *filename_s, void *data_p)
+{
+	BlastDatabaseStatistics *stats_p = (BlastDatabaseStatistics *) data_p;
+	uint32 num_sequences;
+	uint64 length;
+	bool success_flag = ReadBlastIndexHeader (filename_s, &num_sequences, &length);
+
+	if (success_flag)
+		{
+			stats_p -> bds_num_sequences += num_sequences;
+			stats_p -> bds_total_length += length;
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * The index file header is made up of big-endian 32-bit integers and
+ * length-prefixed strings apart from the total length which is a
+ * little-endian 64-bit integer. Version 5 databases add a volume number
+ * and the name of their LMDB file.
+ */
+static bool ReadBlastIndexHeader (const char *filename_s, uint32 *num_sequences_p, uint64 *total_length_p)
+{
+	bool success_flag = false;
+	FILE *in_f = fopen (filename_s, "rb");
+
+	if (in_f)
+		{
+			uint32 version;
+			uint32 value;
+
+			if (ReadBigEndianUInt32 (in_f, &version) && ((version == 4) || (version == 5)))
+				{
+					/* The sequence type */
+					if (ReadBigEndianUInt32 (in_f, &value))
+						{
+							bool read_flag = true;
+
+							/* The volume number */
+							if (version == 5)
+								{
+									read_flag = ReadBigEndianUInt32 (in_f, &value);
+								}
+
+							/* The title */
+							if (read_flag)
+								{
+									read_flag = SkipBlastIndexString (in_f);
+								}
+
+							/* The LMDB filename */
+							if (read_flag && (version == 5))
+								{
+									read_flag = SkipBlastIndexString (in_f);
+								}
+
+							/* The date */
+							if (read_flag)
+								{
+									read_flag = SkipBlastIndexString (in_f);
+								}
+
+							if (read_flag)
+								{
+									unsigned char buffer [8];
+
+									if (ReadBigEndianUInt32 (in_f, num_sequences_p) && (fread (buffer, 1, 8, in_f) == 8))
+										{
+											int i;
+
+											*total_length_p = 0;
+
+											for (i = 7; i >= 0; -- i)
+												{
+													*total_length_p = (*total_length_p << 8) | buffer [i];
+												}
+
+											success_flag = true;
+										}
+								}
+
+						}		/* if (ReadBigEndianUInt32 (in_f, &value)) */
+
+				}		/* if (ReadBigEndianUInt32 (in_f, &version) && ((version == 4) || (version == 5))) */
+
+			fclose (in_f);
+		}		/* if (in_f) */
+
+	return success_flag;
+}
+
+
+static bool ReadBigEndianUInt32 (FILE *in_f, uint32 *value_p)
+{
+	bool success_flag = false;
+	unsigned char buffer [4];
+
+	if (fread (buffer, 1, 4, in_f) == 4)
+		{
+			*value_p = (((uint32) buffer [0]) << 24) | (((uint32) buffer [1]) << 16) | (((uint32) buffer [2]) << 8) | ((uint32) buffer [3]);
+			success_flag = true;
+		}
+
+	return success_flag;
+}
+
+
+static bool SkipBlastIndexString (FILE *in_f)
+{
+	uint32 length;
+
+	return ((ReadBigEndianUInt32 (in_f, &length)) && (fseek (in_f, (long) length, SEEK_CUR) == 0));
+}
@@ -0,0 +1,461 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * chunked_query_search.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chunked_query_search.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define CHUNKED_QUERY_SEARCH_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define CHUNKED_QUERY_SEARCH_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * One of the chunks of a ChunkedQuerySearch.
+ */
+typedef struct QueryChunk
+{
+	char *qc_query_filename_s;
+
+	char *qc_output_filename_s;
+
+	/* Has the search of this chunk finished successfully? */
+	bool qc_done_flag;
+} QueryChunk;
+
+
+static void FreeAndRemoveFile (char *filename_s);
+
+
+
+ChunkedQuerySearch *ChunkedQuerySearch :: Create (const char *query_filename_s, const char *output_filename_s, uint32 max_num_chunks)
+{
+	ChunkedQuerySearch *search_p = 0;
+
+	try
+		{
+			search_p = new ChunkedQuerySearch (output_filename_s);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create ChunkedQuerySearch for \"%s\"", query_filename_s);
+		}
+
+	if (search_p)
+		{
+			if (!search_p -> SplitQueries (query_filename_s, max_num_chunks))
+				{
+					delete search_p;
+					search_p = 0;
+				}
+		}
+
+	return search_p;
+}
+
+
+ChunkedQuerySearch :: ChunkedQuerySearch (const char *output_filename_s)
+	: cqs_output_f (0),
+		cqs_chunks_p (0),
+		cqs_num_chunks (0),
+		cqs_num_merged_chunks (0),
+		cqs_num_merged_reports (0)
+{
+	cqs_output_filename_s = EasyCopyToNewString (output_filename_s);
+
+	if (!cqs_output_filename_s)
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+ChunkedQuerySearch :: ~ChunkedQuerySearch ()
+{
+	if (cqs_chunks_p)
+		{
+			uint32 i;
+			QueryChunk *chunk_p = cqs_chunks_p;
+
+			for (i = 0; i < cqs_num_chunks; ++ i, ++ chunk_p)
+				{
+					FreeAndRemoveFile (chunk_p -> qc_query_filename_s);
+					FreeAndRemoveFile (chunk_p -> qc_output_filename_s);
+				}
+
+			FreeMemory (cqs_chunks_p);
+		}
+
+	/* The search didn't finish so don't leave an unterminated output behind */
+	if (cqs_output_f)
+		{
+			fclose (cqs_output_f);
+			unlink (cqs_output_filename_s);
+		}
+
+	FreeCopiedString (cqs_output_filename_s);
+}
+
+
+uint32 ChunkedQuerySearch :: GetNumChunks () const
+{
+	return cqs_num_chunks;
+}
+
+
+const char *ChunkedQuerySearch :: GetChunkQueryFilename (uint32 index) const
+{
+	return (cqs_chunks_p + index) -> qc_query_filename_s;
+}
+
+
+const char *ChunkedQuerySearch :: GetChunkOutputFilename (uint32 index) const
+{
+	return (cqs_chunks_p + index) -> qc_output_filename_s;
+}
+
+
+bool ChunkedQuerySearch :: IsComplete () const
+{
+	return (cqs_num_merged_chunks == cqs_num_chunks);
+}
+
+
+/*
+ * The chunks can finish in any order but their results have to appear
+ * in the same order as the queries, so only merge the chunks up to the
+ * first one that is still running. Each merged chunk is appended to the
+ * output straight away so that its results can be streamed.
+ */
+bool ChunkedQuerySearch :: SetChunkSucceeded (uint32 index)
+{
+	bool success_flag = true;
+
+	(cqs_chunks_p + index) -> qc_done_flag = true;
+
+	while (success_flag && (cqs_num_merged_chunks < cqs_num_chunks) && ((cqs_chunks_p + cqs_num_merged_chunks) -> qc_done_flag))
+		{
+			success_flag = MergeChunkReports (cqs_chunks_p + cqs_num_merged_chunks);
+
+			if (success_flag)
+				{
+					++ cqs_num_merged_chunks;
+
+					#if CHUNKED_QUERY_SEARCH_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Merged results for " UINT32_FMT " of " UINT32_FMT " chunks for \"%s\"", cqs_num_merged_chunks, cqs_num_chunks, cqs_output_filename_s);
+					#endif
+
+					if (IsComplete ())
+						{
+							success_flag = FinishOutput ();
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Split the queries at the sequence boundaries closest to equal shares
+ * of the file, keeping them in order so that the results of the chunks
+ * only need to be concatenated.
+ */
+bool ChunkedQuerySearch :: SplitQueries (const char *query_filename_s, uint32 max_num_chunks)
+{
+	bool success_flag = false;
+	char *queries_s = GetFileContentsAsStringByFilename (query_filename_s);
+
+	if (queries_s)
+		{
+			const char *start_s = queries_s;
+
+			while (isspace ((unsigned char) *start_s))
+				{
+					++ start_s;
+				}
+
+			/* A raw sequence without a FASTA header is a single query */
+			if (*start_s == '>')
+				{
+					uint32 num_records = 0;
+					uint32 num_chunks;
+					const char *c_p;
+
+					for (c_p = start_s; *c_p != '\0'; ++ c_p)
+						{
+							if ((*c_p == '>') && ((c_p == start_s) || (* (c_p - 1) == '\n')))
+								{
+									++ num_records;
+								}
+						}
+
+					num_chunks = (num_records < max_num_chunks) ? num_records : max_num_chunks;
+
+					if (num_chunks > 1)
+						{
+							const char **records_ss = (const char **) AllocMemoryArray (num_records + 1, sizeof (const char *));
+
+							if (records_ss)
+								{
+									cqs_chunks_p = (QueryChunk *) AllocMemoryArray (num_chunks, sizeof (QueryChunk));
+
+									if (cqs_chunks_p)
+										{
+											const char **record_ss = records_ss;
+											size_t total_length;
+											uint32 first = 0;
+											uint32 i;
+
+											for (c_p = start_s; *c_p != '\0'; ++ c_p)
+												{
+													if ((*c_p == '>') && ((c_p == start_s) || (* (c_p - 1) == '\n')))
+														{
+															*record_ss = c_p;
+															++ record_ss;
+														}
+												}
+
+											/* The end of the last record */
+											*record_ss = c_p;
+											total_length = c_p - start_s;
+
+											success_flag = true;
+
+											for (i = 0; (i < num_chunks) && success_flag; ++ i)
+												{
+													uint32 last = num_records;
+
+													if (i < num_chunks - 1)
+														{
+															const size_t target = (total_length * (i + 1)) / num_chunks;
+
+															/* Leave at least one record for each of the remaining chunks */
+															const uint32 max_last = num_records - (num_chunks - 1 - i);
+
+															last = first + 1;
+
+															while ((last < max_last) && (((size_t) (* (records_ss + last) - start_s)) < target))
+																{
+																	++ last;
+																}
+														}
+
+													success_flag = AddChunk (* (records_ss + first), * (records_ss + last) - * (records_ss + first));
+													first = last;
+												}
+
+											#if CHUNKED_QUERY_SEARCH_DEBUG >= STM_LEVEL_FINE
+											PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Split " UINT32_FMT " queries from \"%s\" into " UINT32_FMT " chunks", num_records, query_filename_s, num_chunks);
+											#endif
+										}		/* if (cqs_chunks_p) */
+
+									FreeMemory (records_ss);
+								}		/* if (records_ss) */
+
+						}		/* if (num_chunks > 1) */
+
+				}		/* if (*start_s == '>') */
+
+			FreeCopiedString (queries_s);
+		}		/* if (queries_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read queries from \"%s\"", query_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+bool ChunkedQuerySearch :: AddChunk (const char *data_s, const size_t length)
+{
+	bool success_flag = false;
+	QueryChunk *chunk_p = cqs_chunks_p + cqs_num_chunks;
+	char index_s [16];
+
+	sprintf (index_s, UINT32_FMT, cqs_num_chunks);
+
+	chunk_p -> qc_query_filename_s = ConcatenateVarargsStrings (cqs_output_filename_s, ".chunk.", index_s, ".query", NULL);
+	chunk_p -> qc_output_filename_s = ConcatenateVarargsStrings (cqs_output_filename_s, ".chunk.", index_s, NULL);
+	chunk_p -> qc_done_flag = false;
+
+	if ((chunk_p -> qc_query_filename_s) && (chunk_p -> qc_output_filename_s))
+		{
+			FILE *query_f = fopen (chunk_p -> qc_query_filename_s, "w");
+
+			/* Count it straight away so that its files are removed whatever happens */
+			++ cqs_num_chunks;
+
+			if (query_f)
+				{
+					success_flag = (fwrite (data_s, 1, length, query_f) == length);
+
+					if (success_flag && (length > 0) && (* (data_s + length - 1) != '\n'))
+						{
+							success_flag = (fputc ('\n', query_f) != EOF);
+						}
+
+					if (fclose (query_f) != 0)
+						{
+							success_flag = false;
+						}
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write query chunk \"%s\"", chunk_p -> qc_query_filename_s);
+				}
+		}
+	else
+		{
+			FreeAndRemoveFile (chunk_p -> qc_query_filename_s);
+			FreeAndRemoveFile (chunk_p -> qc_output_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Append a chunk's reports to the BlastOutput2 array of the output,
+ * starting the output if this is the first chunk. Only whole reports
+ * are written and each write is flushed, so anything reading the output
+ * as it grows sees the same as it would for the output of a single Blast
+ * process.
+ */
+bool ChunkedQuerySearch :: MergeChunkReports (QueryChunk *chunk_p)
+{
+	bool success_flag = false;
+	json_error_t err;
+	json_t *output_p = json_load_file (chunk_p -> qc_output_filename_s, 0, &err);
+
+	if (output_p)
+		{
+			json_t *reports_p = json_object_get (output_p, "BlastOutput2");
+
+			if (reports_p && json_is_array (reports_p))
+				{
+					if (!cqs_output_f)
+						{
+							cqs_output_f = fopen (cqs_output_filename_s, "w");
+
+							if (cqs_output_f)
+								{
+									success_flag = (fputs ("{\n\"BlastOutput2\": [\n", cqs_output_f) != EOF);
+								}
+						}
+					else
+						{
+							success_flag = true;
+						}
+
+					if (success_flag)
+						{
+							size_t i;
+							json_t *report_p;
+
+							json_array_foreach (reports_p, i, report_p)
+								{
+									if (success_flag)
+										{
+											if (cqs_num_merged_reports > 0)
+												{
+													success_flag = (fputs (",\n", cqs_output_f) != EOF);
+												}
+
+											if (success_flag)
+												{
+													success_flag = (json_dumpf (report_p, cqs_output_f, JSON_INDENT (2)) == 0);
+													++ cqs_num_merged_reports;
+												}
+										}
+								}
+
+							if (success_flag)
+								{
+									success_flag = (fflush (cqs_output_f) == 0);
+								}
+						}
+
+					if (!success_flag)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write the results of \"%s\" to \"%s\"", chunk_p -> qc_output_filename_s, cqs_output_filename_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Chunk output \"%s\" has no BlastOutput2 array", chunk_p -> qc_output_filename_s);
+				}
+
+			json_decref (output_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load chunk output \"%s\", error at line %d: %s", chunk_p -> qc_output_filename_s, err.line, err.text);
+		}
+
+	return success_flag;
+}
+
+
+bool ChunkedQuerySearch :: FinishOutput ()
+{
+	bool success_flag = (fputs ("\n]\n}\n", cqs_output_f) != EOF);
+
+	if (fclose (cqs_output_f) != 0)
+		{
+			success_flag = false;
+		}
+
+	cqs_output_f = 0;
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to finish writing merged results to \"%s\"", cqs_output_filename_s);
+			unlink (cqs_output_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+static void FreeAndRemoveFile (char *filename_s)
+{
+	if (filename_s)
+		{
+			unlink (filename_s);
+			FreeCopiedString (filename_s);
+		}
+}
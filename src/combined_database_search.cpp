@@ -0,0 +1,909 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * combined_database_search.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "combined_database_search.hpp"
+
+#include "blast_process.h"
+#include "blast_util.h"
+#include "json_util.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define COMBINED_DATABASE_SEARCH_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define COMBINED_DATABASE_SEARCH_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * One of the databases within a CombinedDatabaseSearch. The filenames
+ * belong to the BlastTool that added the database, which outlives
+ * the search.
+ */
+typedef struct CombinedDatabase
+{
+	const char *cd_filename_s;
+
+	const char *cd_output_filename_s;
+
+	/* The ordinal id within the alias of this database's first sequence */
+	uint32 cd_first_oid;
+
+	uint32 cd_num_sequences;
+
+	uint64 cd_length;
+
+	/* The BlastOutput2 array being built for this database */
+	json_t *cd_reports_p;
+
+	/* The hits array of the report currently being split */
+	json_t *cd_hits_p;
+} CombinedDatabase;
+
+
+static char *GetAccessionKey (const char *accession_s);
+
+static void FreeAndRemoveFile (char *filename_s);
+
+
+
+const char * const CombinedDatabaseSearch :: CDS_ORDINAL_ID_PREFIX_S = "gnl|BL_ORD_ID|";
+
+
+CombinedDatabaseSearch *CombinedDatabaseSearch :: Create (const BlastServiceData *data_p, const char *job_id_s, uint32 max_num_databases)
+{
+	CombinedDatabaseSearch *search_p = 0;
+
+	try
+		{
+			search_p = new CombinedDatabaseSearch (data_p, job_id_s, max_num_databases);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create CombinedDatabaseSearch for \"%s\"", job_id_s);
+		}
+
+	return search_p;
+}
+
+
+CombinedDatabaseSearch :: CombinedDatabaseSearch (const BlastServiceData *data_p, const char *job_id_s, uint32 max_num_databases)
+	: cds_service_data_p (data_p),
+		cds_num_databases (0),
+		cds_max_num_databases (max_num_databases),
+		cds_total_length (0),
+		cds_databases_size (0),
+		cds_max_target_seqs (0),
+		cds_max_evalue (0.0)
+{
+	const char *alias_suffix_s = (data_p -> bsd_type == DT_PROTEIN) ? ".combined.pal" : ".combined.nal";
+
+	cds_databases_p = (CombinedDatabase *) AllocMemoryArray (max_num_databases, sizeof (CombinedDatabase));
+	cds_alias_name_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, ".combined");
+	cds_alias_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, alias_suffix_s);
+	cds_output_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, ".combined.output");
+	cds_ids_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, ".combined.ids");
+	cds_found_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, ".combined.found");
+	cds_log_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, ".combined.log");
+
+	if (! (cds_databases_p && cds_alias_name_s && cds_alias_filename_s && cds_output_filename_s && cds_ids_filename_s && cds_found_filename_s && cds_log_filename_s))
+		{
+			if (cds_databases_p)
+				{
+					FreeMemory (cds_databases_p);
+				}
+
+			FreeAndRemoveFile (cds_alias_name_s);
+			FreeAndRemoveFile (cds_alias_filename_s);
+			FreeAndRemoveFile (cds_output_filename_s);
+			FreeAndRemoveFile (cds_ids_filename_s);
+			FreeAndRemoveFile (cds_found_filename_s);
+			FreeAndRemoveFile (cds_log_filename_s);
+
+			throw std :: bad_alloc ();
+		}
+}
+
+
+CombinedDatabaseSearch :: ~CombinedDatabaseSearch ()
+{
+	uint32 i;
+	CombinedDatabase *db_p = cds_databases_p;
+
+	for (i = 0; i < cds_num_databases; ++ i, ++ db_p)
+		{
+			if (db_p -> cd_reports_p)
+				{
+					json_decref (db_p -> cd_reports_p);
+				}
+		}
+
+	FreeMemory (cds_databases_p);
+
+	/* The alias name has no file of its own */
+	FreeCopiedString (cds_alias_name_s);
+
+	FreeAndRemoveFile (cds_alias_filename_s);
+	FreeAndRemoveFile (cds_output_filename_s);
+	FreeAndRemoveFile (cds_ids_filename_s);
+	FreeAndRemoveFile (cds_found_filename_s);
+	FreeAndRemoveFile (cds_log_filename_s);
+}
+
+
+bool CombinedDatabaseSearch :: AddDatabase (const char *db_filename_s, const char *output_filename_s)
+{
+	bool success_flag = false;
+
+	if (cds_num_databases < cds_max_num_databases)
+		{
+			CombinedDatabase *db_p = cds_databases_p + cds_num_databases;
+
+			/*
+			 * We need the number of sequences in each database to know which
+			 * range of ordinal ids within the alias belongs to it.
+			 */
+			if (GetBlastDatabaseStatistics (db_filename_s, & (db_p -> cd_num_sequences), & (db_p -> cd_length)))
+				{
+					db_p -> cd_filename_s = db_filename_s;
+					db_p -> cd_output_filename_s = output_filename_s;
+					db_p -> cd_first_oid = 0;
+					db_p -> cd_reports_p = NULL;
+					db_p -> cd_hits_p = NULL;
+
+					if (cds_num_databases > 0)
+						{
+							const CombinedDatabase *previous_db_p = db_p - 1;
+
+							db_p -> cd_first_oid = previous_db_p -> cd_first_oid + previous_db_p -> cd_num_sequences;
+						}
+
+					cds_total_length += db_p -> cd_length;
+					cds_databases_size += GetBlastDatabaseSize (db_filename_s);
+					++ cds_num_databases;
+
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read the index of database \"%s\" so it can't be searched as part of a combined search", db_filename_s);
+				}
+
+		}		/* if (cds_num_databases < cds_max_num_databases) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Combined search already has " UINT32_FMT " databases, can't add \"%s\"", cds_num_databases, db_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+uint32 CombinedDatabaseSearch :: GetNumDatabases () const
+{
+	return cds_num_databases;
+}
+
+
+uint64 CombinedDatabaseSearch :: GetDatabasesSize () const
+{
+	return cds_databases_size;
+}
+
+
+const char *CombinedDatabaseSearch :: GetAliasName () const
+{
+	return cds_alias_name_s;
+}
+
+
+const char *CombinedDatabaseSearch :: GetOutputFilename () const
+{
+	return cds_output_filename_s;
+}
+
+
+void CombinedDatabaseSearch :: SetMaxTargetSequences (uint32 max_target_seqs)
+{
+	cds_max_target_seqs = max_target_seqs;
+}
+
+
+void CombinedDatabaseSearch :: SetExpectThreshold (double evalue)
+{
+	cds_max_evalue = evalue;
+}
+
+
+double CombinedDatabaseSearch :: GetCombinedExpectThreshold () const
+{
+	double evalue = cds_max_evalue;
+	uint64 min_length = 0;
+	uint32 i;
+	const CombinedDatabase *db_p = cds_databases_p;
+
+	for (i = 0; i < cds_num_databases; ++ i, ++ db_p)
+		{
+			if ((i == 0) || (db_p -> cd_length < min_length))
+				{
+					min_length = db_p -> cd_length;
+				}
+		}
+
+	if (min_length > 0)
+		{
+			evalue *= ((double) cds_total_length) / ((double) min_length);
+		}
+
+	return evalue;
+}
+
+
+bool CombinedDatabaseSearch :: WriteAlias ()
+{
+	bool success_flag = false;
+	FILE *alias_f = fopen (cds_alias_filename_s, "w");
+
+	if (alias_f)
+		{
+			uint32 i;
+			const CombinedDatabase *db_p = cds_databases_p;
+
+			success_flag = (fprintf (alias_f, "#\n# Alias file created by the Grassroots BLAST service\n#\nTITLE Combined search of " UINT32_FMT " databases\nDBLIST", cds_num_databases) > 0);
+
+			for (i = 0; (i < cds_num_databases) && success_flag; ++ i, ++ db_p)
+				{
+					success_flag = (fprintf (alias_f, " \"%s\"", db_p -> cd_filename_s) > 0);
+				}
+
+			if (success_flag)
+				{
+					success_flag = (fprintf (alias_f, "\n") > 0);
+				}
+
+			if (fclose (alias_f) != 0)
+				{
+					success_flag = false;
+				}
+
+			if (!success_flag)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write alias database \"%s\"", cds_alias_filename_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open alias database \"%s\" for writing", cds_alias_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+bool CombinedDatabaseSearch :: Demultiplex ()
+{
+	bool success_flag = false;
+	json_error_t err;
+	json_t *output_p = json_load_file (cds_output_filename_s, 0, &err);
+
+	if (output_p)
+		{
+			json_t *reports_p = json_object_get (output_p, "BlastOutput2");
+
+			if (reports_p && json_is_array (reports_p))
+				{
+					/* The database index for each of the accessions that need looking up */
+					json_t *accessions_p = json_object ();
+
+					if (accessions_p)
+						{
+							if (FindAccessionDatabases (reports_p, accessions_p))
+								{
+									uint32 i;
+									CombinedDatabase *db_p = cds_databases_p;
+
+									success_flag = true;
+
+									for (i = 0; (i < cds_num_databases) && success_flag; ++ i, ++ db_p)
+										{
+											db_p -> cd_reports_p = json_array ();
+
+											if (!db_p -> cd_reports_p)
+												{
+													success_flag = false;
+												}
+										}
+
+									if (success_flag)
+										{
+											size_t j;
+											json_t *entry_p;
+
+											json_array_foreach (reports_p, j, entry_p)
+												{
+													if (success_flag)
+														{
+															success_flag = SplitReport (entry_p, accessions_p);
+														}
+												}
+										}
+
+									for (i = 0, db_p = cds_databases_p; (i < cds_num_databases) && success_flag; ++ i, ++ db_p)
+										{
+											json_t *db_output_p = json_object ();
+
+											success_flag = false;
+
+											if (db_output_p)
+												{
+													if (json_object_set (db_output_p, "BlastOutput2", db_p -> cd_reports_p) == 0)
+														{
+															if (json_dump_file (db_output_p, db_p -> cd_output_filename_s, JSON_INDENT (2)) == 0)
+																{
+																	success_flag = true;
+																}
+															else
+																{
+																	PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write results for \"%s\" to \"%s\"", db_p -> cd_filename_s, db_p -> cd_output_filename_s);
+																}
+														}
+
+													json_decref (db_output_p);
+												}
+										}
+
+								}		/* if (FindAccessionDatabases (reports_p, accessions_p)) */
+
+							json_decref (accessions_p);
+						}		/* if (accessions_p) */
+
+				}		/* if (reports_p && json_is_array (reports_p)) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Combined output \"%s\" has no BlastOutput2 array", cds_output_filename_s);
+				}
+
+			json_decref (output_p);
+		}		/* if (output_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load combined output \"%s\", error at line %d: %s", cds_output_filename_s, err.line, err.text);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Databases built without parsed sequence ids report their hits using
+ * ordinal ids which, within an alias, are numbered consecutively across
+ * all of its databases. Any other ids have been looked up beforehand by
+ * FindAccessionDatabases.
+ */
+int32 CombinedDatabaseSearch :: GetHitDatabaseIndex (const json_t *hit_p, const json_t *accessions_p) const
+{
+	int32 index = -1;
+	const json_t *description_p = json_array_get (json_object_get (hit_p, "description"), 0);
+
+	if (description_p)
+		{
+			const char *id_s = GetJSONString (description_p, "id");
+			const size_t prefix_length = strlen (CDS_ORDINAL_ID_PREFIX_S);
+
+			if (id_s && (strncmp (id_s, CDS_ORDINAL_ID_PREFIX_S, prefix_length) == 0))
+				{
+					const uint32 oid = (uint32) strtoul (id_s + prefix_length, NULL, 10);
+					uint32 i;
+					const CombinedDatabase *db_p = cds_databases_p;
+
+					for (i = 0; (i < cds_num_databases) && (index < 0); ++ i, ++ db_p)
+						{
+							if ((oid >= db_p -> cd_first_oid) && (oid < db_p -> cd_first_oid + db_p -> cd_num_sequences))
+								{
+									index = (int32) i;
+								}
+						}
+				}
+			else
+				{
+					const char *accession_s = GetJSONString (description_p, "accession");
+
+					if (accession_s)
+						{
+							char *key_s = GetAccessionKey (accession_s);
+
+							if (key_s)
+								{
+									const json_t *value_p = json_object_get (accessions_p, key_s);
+
+									if (value_p && json_is_integer (value_p))
+										{
+											index = (int32) json_integer_value (value_p);
+										}
+
+									FreeCopiedString (key_s);
+								}
+						}
+				}
+
+		}		/* if (description_p) */
+
+	return index;
+}
+
+
+bool CombinedDatabaseSearch :: FindAccessionDatabases (const json_t *reports_p, json_t *accessions_p)
+{
+	bool success_flag = true;
+	size_t i;
+	const json_t *entry_p;
+
+	/* Collect the accessions of any hits that don't have ordinal ids */
+	json_array_foreach (reports_p, i, entry_p)
+		{
+			const json_t *hits_p = GetCompoundJSONObject (entry_p, "report.results.search.hits");
+
+			if (hits_p && success_flag)
+				{
+					size_t j;
+					const json_t *hit_p;
+
+					json_array_foreach (hits_p, j, hit_p)
+						{
+							const json_t *description_p = json_array_get (json_object_get (hit_p, "description"), 0);
+							const char *id_s = description_p ? GetJSONString (description_p, "id") : NULL;
+
+							if (id_s && (strncmp (id_s, CDS_ORDINAL_ID_PREFIX_S, strlen (CDS_ORDINAL_ID_PREFIX_S)) != 0))
+								{
+									const char *accession_s = GetJSONString (description_p, "accession");
+									char *key_s = GetAccessionKey (accession_s ? accession_s : id_s);
+
+									if (key_s)
+										{
+											if (!json_object_get (accessions_p, key_s))
+												{
+													if (json_object_set_new (accessions_p, key_s, json_integer (-1)) != 0)
+														{
+															success_flag = false;
+														}
+												}
+
+											FreeCopiedString (key_s);
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+						}
+				}
+		}
+
+
+	if (success_flag && (json_object_size (accessions_p) > 0))
+		{
+			const char *blastdbcmd_s = cds_service_data_p -> bsd_blastdbcmd_command_s;
+
+			success_flag = false;
+
+			if (blastdbcmd_s)
+				{
+					if (WriteAccessions (accessions_p))
+						{
+							uint32 j;
+							const CombinedDatabase *db_p = cds_databases_p;
+
+							success_flag = true;
+
+							for (j = 0; (j < cds_num_databases) && success_flag; ++ j, ++ db_p)
+								{
+									const char *args_ss [] = { blastdbcmd_s, "-db", db_p -> cd_filename_s, "-entry_batch", cds_ids_filename_s, "-outfmt", "%a", "-out", cds_found_filename_s, NULL };
+									BlastProcessResult result;
+
+									/*
+									 * blastdbcmd exits with an error for any entries that it can't find which
+									 * is expected here, so we only check that it wasn't killed.
+									 */
+									if (RunBlastProcess ((char * const *) args_ss, cds_log_filename_s, &result) && (result.bpr_signal == 0))
+										{
+											success_flag = ReadFoundAccessions (accessions_p, j);
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run \"%s\" to look up hits in \"%s\"", blastdbcmd_s, db_p -> cd_filename_s);
+											success_flag = false;
+										}
+								}
+
+							if (success_flag)
+								{
+									const char *key_s;
+									json_t *value_p;
+
+									json_object_foreach (accessions_p, key_s, value_p)
+										{
+											if (json_integer_value (value_p) < 0)
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to find which database \"%s\" came from", key_s);
+													success_flag = false;
+												}
+										}
+								}
+						}		/* if (WriteAccessions (accessions_p)) */
+
+				}		/* if (blastdbcmd_s) */
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" is not set so the hits from databases with parsed sequence ids can't be split up", BS_BLASTDBCMD_COMMAND_S);
+				}
+		}
+
+	return success_flag;
+}
+
+
+bool CombinedDatabaseSearch :: WriteAccessions (const json_t *accessions_p)
+{
+	bool success_flag = false;
+	FILE *ids_f = fopen (cds_ids_filename_s, "w");
+
+	if (ids_f)
+		{
+			const char *key_s;
+			const json_t *value_p;
+
+			success_flag = true;
+
+			json_object_foreach ((json_t *) accessions_p, key_s, value_p)
+				{
+					if (success_flag)
+						{
+							success_flag = (fprintf (ids_f, "%s\n", key_s) > 0);
+						}
+				}
+
+			if (fclose (ids_f) != 0)
+				{
+					success_flag = false;
+				}
+		}
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write accessions to \"%s\"", cds_ids_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+bool CombinedDatabaseSearch :: ReadFoundAccessions (json_t *accessions_p, const uint32 db_index)
+{
+	bool success_flag = true;
+
+	/* If none of the accessions were found, there might not be an output file at all */
+	if (IsPathValid (cds_found_filename_s))
+		{
+			char *contents_s = GetFileContentsAsStringByFilename (cds_found_filename_s);
+
+			if (contents_s)
+				{
+					char *save_s = NULL;
+					char *line_s = strtok_r (contents_s, "\r\n", &save_s);
+
+					while (line_s && success_flag)
+						{
+							char *key_s = GetAccessionKey (line_s);
+
+							if (key_s)
+								{
+									json_t *value_p = json_object_get (accessions_p, key_s);
+
+									if (value_p)
+										{
+											const json_int_t current_index = json_integer_value (value_p);
+
+											if (current_index < 0)
+												{
+													json_integer_set (value_p, db_index);
+												}
+											else if (current_index != db_index)
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" is in both \"%s\" and \"%s\"", key_s, (cds_databases_p + current_index) -> cd_filename_s, (cds_databases_p + db_index) -> cd_filename_s);
+													success_flag = false;
+												}
+										}
+
+									FreeCopiedString (key_s);
+								}
+							else
+								{
+									success_flag = false;
+								}
+
+							line_s = strtok_r (NULL, "\r\n", &save_s);
+						}
+
+					FreeCopiedString (contents_s);
+				}
+
+			unlink (cds_found_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Give each database its own copy of the report with only its own hits,
+ * renumbered and with their expect values scaled to the size of that
+ * database. Any hits that are no longer within the expect threshold
+ * once they have been scaled are dropped.
+ */
+bool CombinedDatabaseSearch :: SplitReport (json_t *entry_p, const json_t *accessions_p)
+{
+	bool success_flag = false;
+	json_t *search_p = GetCompoundJSONObject (entry_p, "report.results.search");
+
+	if (search_p)
+		{
+			json_t *hits_p = json_object_get (search_p, "hits");
+			uint32 i;
+			CombinedDatabase *db_p = cds_databases_p;
+
+			/* Take the hits out so that they aren't copied for every database */
+			if (hits_p)
+				{
+					json_incref (hits_p);
+					json_object_del (search_p, "hits");
+				}
+
+			success_flag = true;
+
+			for (i = 0; (i < cds_num_databases) && success_flag; ++ i, ++ db_p)
+				{
+					json_t *copy_p = json_deep_copy (entry_p);
+
+					success_flag = false;
+
+					if (copy_p)
+						{
+							json_t *target_p = GetCompoundJSONObject (copy_p, "report.search_target");
+							json_t *copied_search_p = GetCompoundJSONObject (copy_p, "report.results.search");
+
+							if (target_p && copied_search_p)
+								{
+									if (json_object_set_new (target_p, "db", json_string (db_p -> cd_filename_s)) == 0)
+										{
+											db_p -> cd_hits_p = json_array ();
+
+											if (db_p -> cd_hits_p)
+												{
+													if (json_object_set_new (copied_search_p, "hits", db_p -> cd_hits_p) == 0)
+														{
+															UpdateStatistics (copied_search_p, db_p);
+
+															if (json_array_append (db_p -> cd_reports_p, copy_p) == 0)
+																{
+																	success_flag = true;
+																}
+														}
+													else
+														{
+															json_decref (db_p -> cd_hits_p);
+															db_p -> cd_hits_p = NULL;
+														}
+												}
+										}
+								}
+
+							json_decref (copy_p);
+						}		/* if (copy_p) */
+
+				}		/* for (i = 0; (i < cds_num_databases) && success_flag; ++ i, ++ db_p) */
+
+			if (hits_p)
+				{
+					if (success_flag)
+						{
+							size_t j;
+							json_t *hit_p;
+
+							json_array_foreach (hits_p, j, hit_p)
+								{
+									if (success_flag)
+										{
+											const int32 index = GetHitDatabaseIndex (hit_p, accessions_p);
+
+											if (index >= 0)
+												{
+													db_p = cds_databases_p + index;
+
+													if ((cds_max_target_seqs == 0) || (json_array_size (db_p -> cd_hits_p) < cds_max_target_seqs))
+														{
+															const double factor = (cds_total_length > 0) ? ((double) (db_p -> cd_length)) / ((double) cds_total_length) : 1.0;
+
+															if (ScaleExpectValues (hit_p, factor, cds_max_evalue))
+																{
+																	if (json_object_set_new (hit_p, "num", json_integer (json_array_size (db_p -> cd_hits_p) + 1)) == 0)
+																		{
+																			success_flag = (json_array_append (db_p -> cd_hits_p, hit_p) == 0);
+																		}
+																	else
+																		{
+																			success_flag = false;
+																		}
+																}
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get the database for hit " SIZET_FMT " in \"%s\"", j, cds_output_filename_s);
+													success_flag = false;
+												}
+										}
+								}		/* json_array_foreach (hits_p, j, hit_p) */
+						}
+
+					json_decref (hits_p);
+				}		/* if (hits_p) */
+
+		}		/* if (search_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Combined output \"%s\" has a report without any search results", cds_output_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+void CombinedDatabaseSearch :: UpdateStatistics (json_t *search_p, const CombinedDatabase *db_p) const
+{
+	json_t *stat_p = json_object_get (search_p, "stat");
+
+	if (stat_p)
+		{
+			const json_t *eff_space_p = json_object_get (stat_p, "eff_space");
+
+			if (eff_space_p && json_is_number (eff_space_p) && (cds_total_length > 0))
+				{
+					const double eff_space = json_number_value (eff_space_p) * ((double) (db_p -> cd_length)) / ((double) cds_total_length);
+
+					json_object_set_new (stat_p, "eff_space", json_integer ((json_int_t) eff_space));
+				}
+
+			json_object_set_new (stat_p, "db_num", json_integer (db_p -> cd_num_sequences));
+			json_object_set_new (stat_p, "db_len", json_integer ((json_int_t) (db_p -> cd_length)));
+		}
+}
+
+
+/*
+ * The expect value grows with the size of the database, so scale
+ * it back down to match a search against just one of the databases.
+ * The combined search was run with a raised threshold, so remove any
+ * HSPs that are still above the original one and renumber the rest.
+ * This returns false if the hit has no HSPs left.
+ */
+bool CombinedDatabaseSearch :: ScaleExpectValues (json_t *hit_p, const double factor, const double max_evalue)
+{
+	bool kept_flag = false;
+	json_t *hsps_p = json_object_get (hit_p, "hsps");
+
+	if (hsps_p && json_is_array (hsps_p))
+		{
+			size_t i = 0;
+
+			while (i < json_array_size (hsps_p))
+				{
+					json_t *hsp_p = json_array_get (hsps_p, i);
+					const json_t *evalue_p = json_object_get (hsp_p, "evalue");
+					bool keep_flag = true;
+
+					if (evalue_p && json_is_number (evalue_p))
+						{
+							const double evalue = json_number_value (evalue_p) * factor;
+
+							if (evalue <= max_evalue)
+								{
+									json_object_set_new (hsp_p, "evalue", json_real (evalue));
+								}
+							else
+								{
+									keep_flag = false;
+								}
+						}
+
+					if (keep_flag)
+						{
+							if (json_object_get (hsp_p, "num"))
+								{
+									json_object_set_new (hsp_p, "num", json_integer (i + 1));
+								}
+
+							++ i;
+						}
+					else
+						{
+							json_array_remove (hsps_p, i);
+						}
+				}
+
+			kept_flag = (json_array_size (hsps_p) > 0);
+		}
+
+	return kept_flag;
+}
+
+
+/*
+ * blastdbcmd reports accessions with their version numbers whereas
+ * Blast's JSON output might not, so compare them without any version.
+ */
+static char *GetAccessionKey (const char *accession_s)
+{
+	char *key_s = EasyCopyToNewString (accession_s);
+
+	if (key_s)
+		{
+			char *dot_s = strrchr (key_s, '.');
+
+			if (dot_s && (* (dot_s + 1) != '\0'))
+				{
+					const char *c_p = dot_s + 1;
+
+					while (isdigit ((unsigned char) *c_p))
+						{
+							++ c_p;
+						}
+
+					if (*c_p == '\0')
+						{
+							*dot_s = '\0';
+						}
+				}
+		}
+
+	return key_s;
+}
+
+
+static void FreeAndRemoveFile (char *filename_s)
+{
+	if (filename_s)
+		{
+			unlink (filename_s);
+			FreeCopiedString (filename_s);
+		}
+}
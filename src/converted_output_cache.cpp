@@ -0,0 +1,668 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * converted_output_cache.cpp
+ *
+ *  Created on: 23 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "converted_output_cache.hpp"
+#include "blast_result_buffer.hpp"
+#include "blast_file_compression.hpp"
+#include "blast_formatter.h"
+#include "blast_service.h"
+
+#include "filesystem_utils.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define CONVERTED_OUTPUT_CACHE_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define CONVERTED_OUTPUT_CACHE_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A job's output that has been converted
+ * into another format.
+ */
+typedef struct ConvertedOutput
+{
+	char *co_filename_s;
+
+	/*
+	 * The size of the converted file or 0 if the output is only
+	 * held in memory, e.g. the job's own output in its archive format.
+	 */
+	uint64 co_disk_size;
+
+	/* The converted output if it is held in memory */
+	char *co_data_s;
+
+	uint64 co_memory_size;
+
+	/* When the output was last asked for */
+	time_t co_last_access;
+
+	struct ConvertedOutput *co_prev_p;
+
+	struct ConvertedOutput *co_next_p;
+} ConvertedOutput;
+
+
+static bool IsConvertedOutputFilename (const char *name_s);
+
+static void StripCompressedSuffix (char *filename_s);
+
+
+
+ConvertedOutputCache *ConvertedOutputCache :: coc_shared_cache_p = 0;
+
+uint32 ConvertedOutputCache :: coc_shared_cache_count = 0;
+
+pthread_mutex_t ConvertedOutputCache :: coc_shared_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+ConvertedOutputCache *ConvertedOutputCache :: GetSharedConvertedOutputCache (const uint64 disk_budget, const uint64 memory_budget)
+{
+	ConvertedOutputCache *cache_p = 0;
+
+	pthread_mutex_lock (&coc_shared_cache_mutex);
+
+	if (!coc_shared_cache_p)
+		{
+			try
+				{
+					coc_shared_cache_p = new ConvertedOutputCache (disk_budget, memory_budget);
+
+					#if CONVERTED_OUTPUT_CACHE_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared ConvertedOutputCache with disk budget " UINT64_FMT " and memory budget " UINT64_FMT, disk_budget, memory_budget);
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create ConvertedOutputCache");
+				}
+		}
+
+	if (coc_shared_cache_p)
+		{
+			++ coc_shared_cache_count;
+			cache_p = coc_shared_cache_p;
+		}
+
+	pthread_mutex_unlock (&coc_shared_cache_mutex);
+
+	return cache_p;
+}
+
+
+void ConvertedOutputCache :: ReleaseSharedConvertedOutputCache ()
+{
+	ConvertedOutputCache *cache_to_free_p = 0;
+
+	pthread_mutex_lock (&coc_shared_cache_mutex);
+
+	if (coc_shared_cache_count > 0)
+		{
+			-- coc_shared_cache_count;
+
+			if (coc_shared_cache_count == 0)
+				{
+					cache_to_free_p = coc_shared_cache_p;
+					coc_shared_cache_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&coc_shared_cache_mutex);
+
+	if (cache_to_free_p)
+		{
+			delete cache_to_free_p;
+		}
+}
+
+
+ConvertedOutputCache :: ConvertedOutputCache (const uint64 disk_budget, const uint64 memory_budget)
+	: coc_first_output_p (0),
+		coc_last_output_p (0),
+		coc_disk_budget (disk_budget),
+		coc_memory_budget (memory_budget),
+		coc_disk_size (0),
+		coc_memory_size (0)
+{
+	if (pthread_mutex_init (&coc_mutex, NULL) != 0)
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+ConvertedOutputCache :: ~ConvertedOutputCache ()
+{
+	while (coc_first_output_p)
+		{
+			RemoveOutput (coc_first_output_p);
+		}
+
+	pthread_mutex_destroy (&coc_mutex);
+}
+
+
+void ConvertedOutputCache :: IndexDirectory (const char *directory_s)
+{
+	DIR *dir_p = opendir (directory_s);
+
+	if (dir_p)
+		{
+			struct dirent *entry_p;
+			uint32 num_files = 0;
+
+			pthread_mutex_lock (&coc_mutex);
+
+			while ((entry_p = readdir (dir_p)) != NULL)
+				{
+					if (IsConvertedOutputFilename (entry_p -> d_name))
+						{
+							char *filename_s = MakeFilename (directory_s, entry_p -> d_name);
+
+							if (filename_s)
+								{
+									struct stat st;
+
+									/* Compressed outputs are indexed under the name that they were converted to */
+									StripCompressedSuffix (filename_s);
+
+									if ((stat (filename_s, &st) != 0) || (!S_ISREG (st.st_mode)))
+										{
+											char *compressed_filename_s = GetCompressedBlastFilename (filename_s);
+
+											if (compressed_filename_s)
+												{
+													if (stat (compressed_filename_s, &st) != 0)
+														{
+															st.st_mode = 0;
+														}
+
+													FreeCopiedString (compressed_filename_s);
+												}
+											else
+												{
+													st.st_mode = 0;
+												}
+										}
+
+									if ((S_ISREG (st.st_mode)) && (!FindOutput (filename_s)))
+										{
+											/* We don't know when these were last used, so go by when they were made */
+											if (AddOutput (filename_s, (uint64) st.st_size, st.st_mtime))
+												{
+													++ num_files;
+												}
+										}
+
+									FreeCopiedString (filename_s);
+								}
+						}
+				}
+
+			Trim ();
+
+			#if CONVERTED_OUTPUT_CACHE_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Indexed " UINT32_FMT " converted outputs in \"%s\", " UINT64_FMT " bytes on disk", num_files, directory_s, coc_disk_size);
+			#endif
+
+			pthread_mutex_unlock (&coc_mutex);
+
+			closedir (dir_p);
+		}		/* if (dir_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open \"%s\" to index its converted outputs, errno %d", directory_s, errno);
+		}
+}
+
+
+char *ConvertedOutputCache :: GetConvertedOutput (const char *output_filename_s, const uint32 output_format_code, const char *custom_format_s)
+{
+	char *result_s = NULL;
+	BlastResultBuffer *buffer_p = GetConvertedOutputBuffer (output_filename_s, output_format_code, custom_format_s);
+
+	if (buffer_p)
+		{
+			result_s = buffer_p -> CopyToString ();
+			delete buffer_p;
+		}
+
+	return result_s;
+}
+
+
+BlastResultBuffer *ConvertedOutputCache :: GetConvertedOutputBuffer (const char *output_filename_s, const uint32 output_format_code, const char *custom_format_s)
+{
+	BlastResultBuffer *buffer_p = NULL;
+	char *filename_s = BlastFormatter :: GetConvertedOutputFilename (output_filename_s, output_format_code, custom_format_s);
+
+	if (filename_s)
+		{
+			bool read_flag = false;
+			char *result_s = NULL;
+			ConvertedOutput *output_p;
+
+			pthread_mutex_lock (&coc_mutex);
+
+			output_p = FindOutput (filename_s);
+
+			if (output_p)
+				{
+					output_p -> co_last_access = time (NULL);
+					MoveToFront (output_p);
+
+					if (output_p -> co_data_s)
+						{
+							result_s = EasyCopyToNewString (output_p -> co_data_s);
+						}
+					else
+						{
+							read_flag = (output_p -> co_disk_size > 0);
+						}
+				}
+			else
+				{
+					/* The output might have been converted before it could be indexed */
+					read_flag = true;
+				}
+
+			pthread_mutex_unlock (&coc_mutex);
+
+			if (result_s)
+				{
+					buffer_p = BlastResultBuffer :: AdoptString (result_s);
+
+					if (!buffer_p)
+						{
+							FreeCopiedString (result_s);
+						}
+				}
+
+			/*
+			 * Read the file without holding the lock so that the other requests
+			 * aren't held up by the disk. If the file has been evicted in the
+			 * meantime, it'll just be converted again and if it is evicted
+			 * afterwards, the mapping stays valid until the buffer is freed.
+			 */
+			if (read_flag)
+				{
+					buffer_p = ReadBlastFile (filename_s);
+
+					if (buffer_p)
+						{
+							uint64 disk_size = (uint64) buffer_p -> GetLength ();
+
+							GetStoredBlastFileSize (filename_s, &disk_size);
+
+							pthread_mutex_lock (&coc_mutex);
+
+							output_p = FindOutput (filename_s);
+
+							if (!output_p)
+								{
+									output_p = AddOutput (filename_s, disk_size, time (NULL));
+								}
+
+							if (output_p)
+								{
+									KeepInMemory (output_p, buffer_p -> GetData (), buffer_p -> GetLength ());
+									Trim ();
+								}
+
+							pthread_mutex_unlock (&coc_mutex);
+						}
+				}
+
+			#if CONVERTED_OUTPUT_CACHE_DEBUG >= STM_LEVEL_FINER
+			PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Converted output \"%s\" was %s", filename_s, buffer_p ? (read_flag ? "read from disk" : "in memory") : "not found");
+			#endif
+
+			FreeCopiedString (filename_s);
+		}		/* if (filename_s) */
+
+	return buffer_p;
+}
+
+
+bool ConvertedOutputCache :: AddConvertedOutput (const char *output_filename_s, const uint32 output_format_code, const char *custom_format_s, const char *converted_output_s)
+{
+	bool success_flag = false;
+	char *filename_s = BlastFormatter :: GetConvertedOutputFilename (output_filename_s, output_format_code, custom_format_s);
+
+	if (filename_s)
+		{
+			uint64 disk_size = 0;
+			ConvertedOutput *output_p;
+
+			GetStoredBlastFileSize (filename_s, &disk_size);
+
+			pthread_mutex_lock (&coc_mutex);
+
+			output_p = FindOutput (filename_s);
+
+			if (output_p)
+				{
+					/* The file may have been rewritten */
+					coc_disk_size -= output_p -> co_disk_size;
+					output_p -> co_disk_size = disk_size;
+					coc_disk_size += disk_size;
+
+					output_p -> co_last_access = time (NULL);
+					MoveToFront (output_p);
+				}
+			else
+				{
+					output_p = AddOutput (filename_s, disk_size, time (NULL));
+				}
+
+			if (output_p)
+				{
+					KeepInMemory (output_p, converted_output_s, strlen (converted_output_s));
+					Trim ();
+
+					success_flag = true;
+				}
+
+			pthread_mutex_unlock (&coc_mutex);
+
+			FreeCopiedString (filename_s);
+		}		/* if (filename_s) */
+
+	return success_flag;
+}
+
+
+ConvertedOutput *ConvertedOutputCache :: FindOutput (const char *filename_s)
+{
+	ConvertedOutput *output_p = coc_first_output_p;
+
+	while (output_p)
+		{
+			if (strcmp (output_p -> co_filename_s, filename_s) == 0)
+				{
+					return output_p;
+				}
+
+			output_p = output_p -> co_next_p;
+		}
+
+	return NULL;
+}
+
+
+ConvertedOutput *ConvertedOutputCache :: AddOutput (const char *filename_s, const uint64 disk_size, const time_t last_access)
+{
+	ConvertedOutput *output_p = (ConvertedOutput *) AllocMemory (sizeof (ConvertedOutput));
+
+	if (output_p)
+		{
+			output_p -> co_filename_s = EasyCopyToNewString (filename_s);
+
+			if (output_p -> co_filename_s)
+				{
+					ConvertedOutput *next_p = coc_first_output_p;
+
+					output_p -> co_disk_size = disk_size;
+					output_p -> co_data_s = NULL;
+					output_p -> co_memory_size = 0;
+					output_p -> co_last_access = last_access;
+
+					/* Keep the list in order of when the outputs were last used */
+					while (next_p && (next_p -> co_last_access > last_access))
+						{
+							next_p = next_p -> co_next_p;
+						}
+
+					output_p -> co_next_p = next_p;
+
+					if (next_p)
+						{
+							output_p -> co_prev_p = next_p -> co_prev_p;
+							next_p -> co_prev_p = output_p;
+						}
+					else
+						{
+							output_p -> co_prev_p = coc_last_output_p;
+							coc_last_output_p = output_p;
+						}
+
+					if (output_p -> co_prev_p)
+						{
+							output_p -> co_prev_p -> co_next_p = output_p;
+						}
+					else
+						{
+							coc_first_output_p = output_p;
+						}
+
+					coc_disk_size += disk_size;
+
+					return output_p;
+				}		/* if (output_p -> co_filename_s) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy converted output filename \"%s\"", filename_s);
+				}
+
+			FreeMemory (output_p);
+		}		/* if (output_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate converted output for \"%s\"", filename_s);
+		}
+
+	return NULL;
+}
+
+
+void ConvertedOutputCache :: MoveToFront (ConvertedOutput *output_p)
+{
+	if (output_p != coc_first_output_p)
+		{
+			/* Unlink it */
+			output_p -> co_prev_p -> co_next_p = output_p -> co_next_p;
+
+			if (output_p -> co_next_p)
+				{
+					output_p -> co_next_p -> co_prev_p = output_p -> co_prev_p;
+				}
+			else
+				{
+					coc_last_output_p = output_p -> co_prev_p;
+				}
+
+			output_p -> co_prev_p = NULL;
+			output_p -> co_next_p = coc_first_output_p;
+			coc_first_output_p -> co_prev_p = output_p;
+			coc_first_output_p = output_p;
+		}
+}
+
+
+void ConvertedOutputCache :: RemoveOutput (ConvertedOutput *output_p)
+{
+	if (output_p -> co_prev_p)
+		{
+			output_p -> co_prev_p -> co_next_p = output_p -> co_next_p;
+		}
+	else
+		{
+			coc_first_output_p = output_p -> co_next_p;
+		}
+
+	if (output_p -> co_next_p)
+		{
+			output_p -> co_next_p -> co_prev_p = output_p -> co_prev_p;
+		}
+	else
+		{
+			coc_last_output_p = output_p -> co_prev_p;
+		}
+
+	coc_disk_size -= output_p -> co_disk_size;
+
+	if (output_p -> co_data_s)
+		{
+			coc_memory_size -= output_p -> co_memory_size;
+			FreeCopiedString (output_p -> co_data_s);
+		}
+
+	FreeCopiedString (output_p -> co_filename_s);
+	FreeMemory (output_p);
+}
+
+
+void ConvertedOutputCache :: KeepInMemory (ConvertedOutput *output_p, const char *data_s, const size_t length)
+{
+	const uint64 size = (uint64) length;
+
+	if (output_p -> co_data_s)
+		{
+			coc_memory_size -= output_p -> co_memory_size;
+			FreeCopiedString (output_p -> co_data_s);
+			output_p -> co_data_s = NULL;
+			output_p -> co_memory_size = 0;
+		}
+
+	/* Outputs that would take up all of the memory budget by themselves aren't kept */
+	if (size <= coc_memory_budget)
+		{
+			output_p -> co_data_s = CopyToNewString (data_s, length, false);
+
+			if (output_p -> co_data_s)
+				{
+					output_p -> co_memory_size = size;
+					coc_memory_size += size;
+				}
+		}
+}
+
+
+void ConvertedOutputCache :: Trim ()
+{
+	ConvertedOutput *output_p = coc_last_output_p;
+
+	/* The most recently used output is always kept */
+	while (output_p && (output_p != coc_first_output_p) && (((coc_disk_budget > 0) && (coc_disk_size > coc_disk_budget)) || (coc_memory_size > coc_memory_budget)))
+		{
+			ConvertedOutput *prev_p = output_p -> co_prev_p;
+
+			if ((coc_disk_budget > 0) && (coc_disk_size > coc_disk_budget) && (output_p -> co_disk_size > 0))
+				{
+					if (RemoveBlastFile (output_p -> co_filename_s))
+						{
+							#if CONVERTED_OUTPUT_CACHE_DEBUG >= STM_LEVEL_FINE
+							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Deleted converted output \"%s\" of " UINT64_FMT " bytes", output_p -> co_filename_s, output_p -> co_disk_size);
+							#endif
+
+							coc_disk_size -= output_p -> co_disk_size;
+							output_p -> co_disk_size = 0;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to delete converted output \"%s\", errno %d", output_p -> co_filename_s, errno);
+						}
+				}
+
+			if ((coc_memory_size > coc_memory_budget) && (output_p -> co_data_s))
+				{
+					coc_memory_size -= output_p -> co_memory_size;
+					FreeCopiedString (output_p -> co_data_s);
+					output_p -> co_data_s = NULL;
+					output_p -> co_memory_size = 0;
+				}
+
+			/* An output that is neither on disk nor in memory is no longer needed */
+			if ((output_p -> co_disk_size == 0) && (! (output_p -> co_data_s)))
+				{
+					RemoveOutput (output_p);
+				}
+
+			output_p = prev_p;
+		}
+}
+
+
+/*
+ * Is a file one of the converted outputs, i.e. <job id>.output.<format code>
+ * with an optional hash of its custom columns, that may have been compressed?
+ */
+static bool IsConvertedOutputFilename (const char *name_s)
+{
+	const char *suffix_p = strstr (name_s, BS_OUTPUT_SUFFIX_S);
+
+	if (suffix_p)
+		{
+			const char *c_p = suffix_p + strlen (BS_OUTPUT_SUFFIX_S);
+
+			if ((*c_p == '.') && (isdigit (* (c_p + 1))))
+				{
+					c_p += 2;
+
+					while (isdigit (*c_p))
+						{
+							++ c_p;
+						}
+
+					if (*c_p == '.')
+						{
+							++ c_p;
+
+							while (isxdigit (*c_p))
+								{
+									++ c_p;
+								}
+						}
+
+					return ((*c_p == '\0') || (strcmp (c_p, BS_COMPRESSED_SUFFIX_S) == 0));
+				}
+		}
+
+	return false;
+}
+
+
+static void StripCompressedSuffix (char *filename_s)
+{
+	const size_t length = strlen (filename_s);
+	const size_t suffix_length = strlen (BS_COMPRESSED_SUFFIX_S);
+
+	if ((length > suffix_length) && (strcmp (filename_s + length - suffix_length, BS_COMPRESSED_SUFFIX_S) == 0))
+		{
+			* (filename_s + length - suffix_length) = '\0';
+		}
+}
@@ -0,0 +1,510 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * drmaa_array_job.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "drmaa.h"
+
+#include "drmaa_array_job.hpp"
+
+#include "byte_buffer.h"
+#include "filesystem_utils.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define DRMAA_ARRAY_JOB_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define DRMAA_ARRAY_JOB_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+static bool AppendQuotedArgument (ByteBuffer *buffer_p, const char *arg_s);
+
+static bool SetTemplateAttribute (drmaa_job_template_t *template_p, const char *name_s, const char *value_s);
+
+
+DrmaaArrayJob *DrmaaArrayJob :: Create (const BlastServiceData *data_p, const char *array_id_s, uint32 max_num_tasks)
+{
+	DrmaaArrayJob *array_p = 0;
+
+	try
+		{
+			array_p = new DrmaaArrayJob (data_p, array_id_s, max_num_tasks);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create DrmaaArrayJob for \"%s\"", array_id_s);
+		}
+
+	return array_p;
+}
+
+
+DrmaaArrayJob :: DrmaaArrayJob (const BlastServiceData *data_p, const char *array_id_s, uint32 max_num_tasks)
+	: daj_service_data_p (data_p),
+		daj_task_ids_ss (0),
+		daj_num_tasks (0),
+		daj_max_num_tasks (max_num_tasks),
+		daj_queue_s (0),
+		daj_native_spec_s (0),
+		daj_email_s (0),
+		daj_cores (0),
+		daj_submitted_flag (false)
+{
+	char *stem_s = MakeFilename (data_p -> bsd_working_dir_s, array_id_s);
+
+	daj_task_filenames_ss = (char **) AllocMemoryArray (max_num_tasks, sizeof (char *));
+	daj_task_stem_s = stem_s ? ConcatenateStrings (stem_s, ".task.") : NULL;
+	daj_input_path_s = daj_task_stem_s ? ConcatenateVarargsStrings (":", daj_task_stem_s, DRMAA_PLACEHOLDER_INCR, NULL) : NULL;
+	daj_job_name_s = ConcatenateVarargsStrings ("blast-", array_id_s, NULL);
+
+	if (stem_s)
+		{
+			FreeCopiedString (stem_s);
+		}
+
+	if (! (daj_task_filenames_ss && daj_task_stem_s && daj_input_path_s && daj_job_name_s))
+		{
+			if (daj_task_filenames_ss)
+				{
+					FreeMemory (daj_task_filenames_ss);
+				}
+
+			if (daj_task_stem_s)
+				{
+					FreeCopiedString (daj_task_stem_s);
+				}
+
+			if (daj_input_path_s)
+				{
+					FreeCopiedString (daj_input_path_s);
+				}
+
+			if (daj_job_name_s)
+				{
+					FreeCopiedString (daj_job_name_s);
+				}
+
+			throw std :: bad_alloc ();
+		}
+}
+
+
+DrmaaArrayJob :: ~DrmaaArrayJob ()
+{
+	uint32 i;
+
+	for (i = 0; i < daj_num_tasks; ++ i)
+		{
+			char *filename_s = * (daj_task_filenames_ss + i);
+
+			/* Once submitted, each task file belongs to the DrmaaBlastTool that runs it */
+			if (!daj_submitted_flag)
+				{
+					remove (filename_s);
+				}
+
+			FreeCopiedString (filename_s);
+
+			if (daj_task_ids_ss && * (daj_task_ids_ss + i))
+				{
+					FreeCopiedString (* (daj_task_ids_ss + i));
+				}
+		}
+
+	FreeMemory (daj_task_filenames_ss);
+
+	if (daj_task_ids_ss)
+		{
+			FreeMemory (daj_task_ids_ss);
+		}
+
+	FreeCopiedString (daj_task_stem_s);
+	FreeCopiedString (daj_input_path_s);
+	FreeCopiedString (daj_job_name_s);
+}
+
+
+uint32 DrmaaArrayJob :: AddTask (const char *program_s, char **args_ss, const char *log_filename_s)
+{
+	uint32 index = 0;
+
+	if ((daj_num_tasks < daj_max_num_tasks) && (!daj_submitted_flag))
+		{
+			char *index_s = ConvertUnsignedIntegerToString (daj_num_tasks + 1);
+
+			if (index_s)
+				{
+					char *filename_s = ConcatenateStrings (daj_task_stem_s, index_s);
+
+					if (filename_s)
+						{
+							ByteBuffer *buffer_p = AllocateByteBuffer (1024);
+
+							if (buffer_p)
+								{
+									bool success_flag = AppendStringToByteBuffer (buffer_p, "#!/bin/sh\nexec >> ") && AppendQuotedArgument (buffer_p, log_filename_s) && AppendStringToByteBuffer (buffer_p, " 2>&1\nexec ") && AppendQuotedArgument (buffer_p, program_s);
+									char **arg_ss = args_ss;
+
+									while (success_flag && arg_ss && *arg_ss)
+										{
+											success_flag = AppendStringToByteBuffer (buffer_p, " ") && AppendQuotedArgument (buffer_p, *arg_ss);
+											++ arg_ss;
+										}
+
+									if (success_flag)
+										{
+											success_flag = AppendStringToByteBuffer (buffer_p, " < /dev/null\n");
+										}
+
+									if (success_flag)
+										{
+											FILE *task_f = fopen (filename_s, "w");
+
+											if (task_f)
+												{
+													success_flag = (fputs (GetByteBufferData (buffer_p), task_f) >= 0);
+
+													if (fclose (task_f) != 0)
+														{
+															success_flag = false;
+														}
+
+													if (success_flag)
+														{
+															* (daj_task_filenames_ss + daj_num_tasks) = filename_s;
+															filename_s = NULL;
+
+															++ daj_num_tasks;
+															index = daj_num_tasks;
+														}
+													else
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write drmaa task file \"%s\"", filename_s);
+															remove (filename_s);
+														}
+												}
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to open drmaa task file \"%s\" for writing", filename_s);
+												}
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to build command line for drmaa task \"%s\"", filename_s);
+										}
+
+									FreeByteBuffer (buffer_p);
+								}		/* if (buffer_p) */
+
+							if (filename_s)
+								{
+									FreeCopiedString (filename_s);
+								}
+
+						}		/* if (filename_s) */
+
+					FreeCopiedString (index_s);
+				}		/* if (index_s) */
+
+		}		/* if ((daj_num_tasks < daj_max_num_tasks) && (!daj_submitted_flag)) */
+
+	return index;
+}
+
+
+uint32 DrmaaArrayJob :: GetNumTasks () const
+{
+	return daj_num_tasks;
+}
+
+
+void DrmaaArrayJob :: SetQueueName (const char *queue_s)
+{
+	daj_queue_s = queue_s;
+}
+
+
+void DrmaaArrayJob :: SetCoresPerTask (uint32 cores)
+{
+	daj_cores = cores;
+}
+
+
+void DrmaaArrayJob :: SetNativeSpecification (const char *spec_s)
+{
+	daj_native_spec_s = spec_s;
+}
+
+
+void DrmaaArrayJob :: SetEmailNotifications (const char *email_s)
+{
+	daj_email_s = email_s;
+}
+
+
+bool DrmaaArrayJob :: Submit ()
+{
+	bool success_flag = false;
+
+	if ((daj_num_tasks > 0) && (!daj_submitted_flag))
+		{
+			char error_s [DRMAA_ERROR_STRING_BUFFER];
+			drmaa_job_template_t *template_p = NULL;
+
+			daj_task_ids_ss = (char **) AllocMemoryArray (daj_num_tasks, sizeof (char *));
+
+			if (daj_task_ids_ss)
+				{
+					if (drmaa_allocate_job_template (&template_p, error_s, DRMAA_ERROR_STRING_BUFFER) == DRMAA_ERRNO_SUCCESS)
+						{
+							char *native_spec_s = GetNativeSpecification ();
+
+							/*
+							 * Each task runs its own script which redirects its output to the
+							 * log file of its search, so the scheduler's copy isn't needed.
+							 */
+							bool set_flag = SetTemplateAttribute (template_p, DRMAA_REMOTE_COMMAND, "/bin/sh") &&
+								SetTemplateAttribute (template_p, DRMAA_INPUT_PATH, daj_input_path_s) &&
+								SetTemplateAttribute (template_p, DRMAA_OUTPUT_PATH, ":/dev/null") &&
+								SetTemplateAttribute (template_p, DRMAA_JOIN_FILES, "y") &&
+								SetTemplateAttribute (template_p, DRMAA_WD, daj_service_data_p -> bsd_working_dir_s) &&
+								SetTemplateAttribute (template_p, DRMAA_JOB_NAME, daj_job_name_s);
+
+							if (set_flag && native_spec_s)
+								{
+									set_flag = SetTemplateAttribute (template_p, DRMAA_NATIVE_SPECIFICATION, native_spec_s);
+								}
+
+							if (set_flag && daj_email_s)
+								{
+									const char *addresses_ss [2];
+
+									*addresses_ss = daj_email_s;
+									* (addresses_ss + 1) = NULL;
+
+									if (drmaa_set_vector_attribute (template_p, DRMAA_V_EMAIL, addresses_ss, error_s, DRMAA_ERROR_STRING_BUFFER) != DRMAA_ERRNO_SUCCESS)
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to set email notifications for drmaa array \"%s\": %s", daj_job_name_s, error_s);
+										}
+								}
+
+							if (set_flag)
+								{
+									drmaa_job_ids_t *ids_p = NULL;
+
+									if (drmaa_run_bulk_jobs (&ids_p, template_p, 1, (int) daj_num_tasks, 1, error_s, DRMAA_ERROR_STRING_BUFFER) == DRMAA_ERRNO_SUCCESS)
+										{
+											char id_s [DRMAA_JOBNAME_BUFFER];
+											uint32 i = 0;
+
+											/* The ids are in the same order as the task indexes */
+											while ((i < daj_num_tasks) && (drmaa_get_next_job_id (ids_p, id_s, DRMAA_JOBNAME_BUFFER) == DRMAA_ERRNO_SUCCESS))
+												{
+													* (daj_task_ids_ss + i) = EasyCopyToNewString (id_s);
+
+													if (! (* (daj_task_ids_ss + i)))
+														{
+															PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy drmaa job id \"%s\"", id_s);
+														}
+
+													++ i;
+												}
+
+											if (i < daj_num_tasks)
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Only got " UINT32_FMT " job ids for drmaa array \"%s\" with " UINT32_FMT " tasks", i, daj_job_name_s, daj_num_tasks);
+												}
+
+											drmaa_release_job_ids (ids_p);
+
+											/* The tasks are running now, so their files must be kept whatever happens */
+											daj_submitted_flag = true;
+											success_flag = true;
+
+											#if DRMAA_ARRAY_JOB_DEBUG >= STM_LEVEL_FINER
+											PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Submitted drmaa array \"%s\" with " UINT32_FMT " tasks", daj_job_name_s, daj_num_tasks);
+											#endif
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to submit drmaa array \"%s\": %s", daj_job_name_s, error_s);
+										}
+								}		/* if (set_flag) */
+
+							if (native_spec_s)
+								{
+									FreeCopiedString (native_spec_s);
+								}
+
+							drmaa_delete_job_template (template_p, error_s, DRMAA_ERROR_STRING_BUFFER);
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate drmaa job template for \"%s\": %s", daj_job_name_s, error_s);
+						}
+
+				}		/* if (daj_task_ids_ss) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate " UINT32_FMT " job ids for drmaa array \"%s\"", daj_num_tasks, daj_job_name_s);
+				}
+
+		}		/* if ((daj_num_tasks > 0) && (!daj_submitted_flag)) */
+
+	return success_flag;
+}
+
+
+const char *DrmaaArrayJob :: GetTaskId (uint32 index) const
+{
+	const char *id_s = NULL;
+
+	if (daj_submitted_flag && (index > 0) && (index <= daj_num_tasks))
+		{
+			id_s = * (daj_task_ids_ss + (index - 1));
+		}
+
+	return id_s;
+}
+
+
+const char *DrmaaArrayJob :: GetTaskFilename (uint32 index) const
+{
+	const char *filename_s = NULL;
+
+	if ((index > 0) && (index <= daj_num_tasks))
+		{
+			filename_s = * (daj_task_filenames_ss + (index - 1));
+		}
+
+	return filename_s;
+}
+
+
+/*
+ * Each DRM has its own syntax for choosing the queue and the number of
+ * cores, so this follows whichever one the service was built against.
+ */
+char *DrmaaArrayJob :: GetNativeSpecification () const
+{
+	char *spec_s = NULL;
+
+	if (daj_native_spec_s)
+		{
+			spec_s = EasyCopyToNewString (daj_native_spec_s);
+		}
+	else
+		{
+			#if defined (SLURM_DRMAA_ENABLED) || defined (LSF_DRMAA_ENABLED) || defined (LOCAL_DRMAA_ENABLED)
+			ByteBuffer *buffer_p = AllocateByteBuffer (64);
+
+			if (buffer_p)
+				{
+					bool success_flag = true;
+
+					#if defined (LSF_DRMAA_ENABLED)
+					const char * const queue_option_s = "-q ";
+					const char * const cores_option_s = "-n ";
+					#else
+					const char * const queue_option_s = "-p ";
+					const char * const cores_option_s = "-c ";
+					#endif
+
+					if (daj_queue_s)
+						{
+							success_flag = AppendStringsToByteBuffer (buffer_p, queue_option_s, daj_queue_s, NULL);
+						}
+
+					if (success_flag && (daj_cores > 0))
+						{
+							char *cores_s = ConvertUnsignedIntegerToString (daj_cores);
+
+							if (cores_s)
+								{
+									success_flag = AppendStringsToByteBuffer (buffer_p, (buffer_p -> bb_current_index > 0) ? " " : "", cores_option_s, cores_s, NULL);
+									FreeCopiedString (cores_s);
+								}
+							else
+								{
+									success_flag = false;
+								}
+						}
+
+					if (success_flag && (buffer_p -> bb_current_index > 0))
+						{
+							spec_s = DetachByteBufferData (buffer_p);
+						}
+					else
+						{
+							FreeByteBuffer (buffer_p);
+						}
+				}
+			#endif
+		}
+
+	return spec_s;
+}
+
+
+/*
+ * Add an argument to a shell command line, quoting it so that
+ * the shell passes it through unchanged.
+ */
+static bool AppendQuotedArgument (ByteBuffer *buffer_p, const char *arg_s)
+{
+	bool success_flag = AppendStringToByteBuffer (buffer_p, "'");
+	const char *quote_s;
+
+	while (success_flag && ((quote_s = strchr (arg_s, '\'')) != NULL))
+		{
+			success_flag = AppendToByteBuffer (buffer_p, arg_s, quote_s - arg_s) && AppendStringToByteBuffer (buffer_p, "'\\''");
+			arg_s = quote_s + 1;
+		}
+
+	if (success_flag)
+		{
+			success_flag = AppendStringsToByteBuffer (buffer_p, arg_s, "'", NULL);
+		}
+
+	return success_flag;
+}
+
+
+static bool SetTemplateAttribute (drmaa_job_template_t *template_p, const char *name_s, const char *value_s)
+{
+	char error_s [DRMAA_ERROR_STRING_BUFFER];
+	bool success_flag = (drmaa_set_attribute (template_p, name_s, value_s, error_s, DRMAA_ERROR_STRING_BUFFER) == DRMAA_ERRNO_SUCCESS);
+
+	if (!success_flag)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set drmaa attribute \"%s\" to \"%s\": %s", name_s, value_s, error_s);
+		}
+
+	return success_flag;
+}
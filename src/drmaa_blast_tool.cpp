@@ -24,14 +24,23 @@
 
 #include <new>
 #include <cstring>
+#include <ctime>
 #include <stdexcept>
 
+#include <unistd.h>
+
+#include "drmaa.h"
+
 #include "blast_service_job.h"
+#include "blast_file_compression.hpp"
 #include "drmaa_tool_args_processor.hpp"
+#include "drmaa_array_job.hpp"
+#include "drmaa_status_poller.hpp"
 #include "streams.h"
 #include "string_utils.h"
 #include "jobs_manager.h"
 #include "alloc_failure.hpp"
+#include "filesystem_utils.h"
 
 #include "uuid_util.h"
 
@@ -45,6 +54,12 @@
 
 const char * const DrmaaBlastTool :: DBT_DRMAA_S = "drmaa";
 
+const char * const DrmaaBlastTool :: DBT_DEADLINE_S = "deadline";
+
+const char * const DrmaaBlastTool :: DBT_ARRAY_TASK_ID_S = "array_task_id";
+
+const char * const DrmaaBlastTool :: DBT_ARRAY_TASK_FILE_S = "array_task_file";
+
 
 
 
@@ -61,7 +76,11 @@ void DrmaaBlastTool :: SetDrmaaOptions (DrmaaTool *drmaa_p, bool async_flag)
 
 
 DrmaaBlastTool :: DrmaaBlastTool (BlastServiceJob *job_p, const char *name_s, const char *factory_s, const BlastServiceData *data_p, const char *blast_program_name_s, const char *queue_name_s, const char *const output_path_s, bool async_flag)
-: ExternalBlastTool (job_p, name_s, factory_s, data_p, blast_program_name_s, async_flag)
+: ExternalBlastTool (job_p, name_s, factory_s, data_p, blast_program_name_s, async_flag),
+	dbt_deadline (0),
+	dbt_task_id_s (0),
+	dbt_task_filename_s (0),
+	dbt_poller_p (0)
 {
 	const char *error_s = 0;
 	GrassrootsServer *grassroots_p = GetGrassrootsServerFromService (job_p -> bsj_job.sj_service_p);
@@ -114,9 +133,45 @@ DrmaaBlastTool :: DrmaaBlastTool (BlastServiceJob *job_p, const char *name_s, co
 
 
 DrmaaBlastTool :: DrmaaBlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p, const json_t *root_p)
-	: ExternalBlastTool (job_p, data_p, root_p)
+	: ExternalBlastTool (job_p, data_p, root_p),
+	dbt_deadline (0),
+	dbt_task_id_s (0),
+	dbt_task_filename_s (0),
+	dbt_poller_p (0)
 {
 	json_t *drmaa_json_p = json_object_get (root_p, DBT_DRMAA_S);
+	json_int_t deadline;
+	const char *value_s;
+
+	if (GetJSONInteger (root_p, DBT_DEADLINE_S, &deadline))
+		{
+			dbt_deadline = (time_t) deadline;
+		}
+
+	value_s = GetJSONString (root_p, DBT_ARRAY_TASK_ID_S);
+
+	if (value_s)
+		{
+			dbt_task_id_s = EasyCopyToNewString (value_s);
+
+			if (!dbt_task_id_s)
+				{
+					throw std :: bad_alloc ();
+				}
+
+			value_s = GetJSONString (root_p, DBT_ARRAY_TASK_FILE_S);
+
+			if (value_s)
+				{
+					dbt_task_filename_s = EasyCopyToNewString (value_s);
+
+					if (!dbt_task_filename_s)
+						{
+							FreeCopiedString (dbt_task_id_s);
+							throw std :: bad_alloc ();
+						}
+				}
+		}
 
 	if (drmaa_json_p)
 		{
@@ -157,6 +212,16 @@ DrmaaBlastTool :: ~DrmaaBlastTool ()
 
 	delete dbt_args_processor_p;
 
+	if (dbt_task_id_s)
+		{
+			FreeCopiedString (dbt_task_id_s);
+		}
+
+	if (dbt_task_filename_s)
+		{
+			FreeCopiedString (dbt_task_filename_s);
+		}
+
 
 	#if DRMAA_BLAST_TOOL_DEBUG >= STM_LEVEL_FINEST
 	PrintLog (STM_LEVEL_FINEST, __FILE__, __LINE__, "Exiting ~DrmaaBlastTool for %s", uuid_s);
@@ -191,6 +256,7 @@ OperationStatus DrmaaBlastTool :: Run ()
 			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create job filename for ", uuid_s);
 		}
 
+	SetDeadline ();
 
 	if (RunDrmaaTool (dbt_drmaa_tool_p, ebt_async_flag, job_id_filename_s))
 		{
@@ -258,7 +324,29 @@ OperationStatus DrmaaBlastTool :: GetStatus (bool update_flag)
 
 	if (update_flag)
 		{
-			status = GetDrmaaToolStatus (dbt_drmaa_tool_p);
+			status = (dbt_task_id_s || dbt_poller_p) ? GetDrmaaJobStatus () : GetDrmaaToolStatus (dbt_drmaa_tool_p);
+
+			/* The job is stopped the first time that its status is checked after its deadline */
+			if (((status == OS_PENDING) || (status == OS_STARTED)) && (dbt_deadline != 0) && (time (NULL) >= dbt_deadline))
+				{
+					char *time_limit_s = ConvertUnsignedIntegerToString (GetBlastJobTimeLimit (bt_service_data_p, NULL));
+					char *reason_s = time_limit_s ? ConcatenateVarargsStrings ("The search exceeded its time limit of ", time_limit_s, " seconds", NULL) : NULL;
+
+					if (Terminate (reason_s ? reason_s : "The search exceeded its time limit"))
+						{
+							status = OS_FAILED;
+						}
+
+					if (reason_s)
+						{
+							FreeCopiedString (reason_s);
+						}
+
+					if (time_limit_s)
+						{
+							FreeCopiedString (time_limit_s);
+						}
+				}
 
 			SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
 
@@ -277,6 +365,54 @@ OperationStatus DrmaaBlastTool :: GetStatus (bool update_flag)
 
 
 
+bool DrmaaBlastTool :: Cancel ()
+{
+	bool success_flag = Terminate ("The search was cancelled");
+
+	if (success_flag)
+		{
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_FAILED);
+		}
+
+	return success_flag;
+}
+
+
+bool DrmaaBlastTool :: Terminate (const char *reason_s)
+{
+	bool success_flag = false;
+	const char *job_id_s = GetDrmaaJobId ();
+
+	if (job_id_s)
+		{
+			char error_s [DRMAA_ERROR_STRING_BUFFER];
+
+			/* The scheduler stops the job's whole process tree on its execution host */
+			if (drmaa_control (job_id_s, DRMAA_CONTROL_TERMINATE, error_s, DRMAA_ERROR_STRING_BUFFER) == DRMAA_ERRNO_SUCCESS)
+				{
+					/* Make sure that the next status check doesn't get the state from before it was stopped */
+					if (dbt_poller_p)
+						{
+							dbt_poller_p -> Forget (job_id_s);
+						}
+
+					if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), reason_s))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", reason_s);
+						}
+
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to terminate drmaa job \"%s\": %s", job_id_s, error_s);
+				}
+		}
+
+	return success_flag;
+}
+
+
 bool DrmaaBlastTool :: SetUpOutputFile ()
 {
 	bool success_flag = false;
@@ -336,6 +472,29 @@ bool DrmaaBlastTool :: AddToJSON (json_t *root_p)
 					if (json_object_set_new (root_p, DBT_DRMAA_S, drmaa_json_p) == 0)
 						{
 							success_flag = true;
+
+							if (dbt_deadline != 0)
+								{
+									if (json_object_set_new (root_p, DBT_DEADLINE_S, json_integer ((json_int_t) dbt_deadline)) != 0)
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add deadline for %s", uuid_s);
+											success_flag = false;
+										}
+								}
+
+							if (success_flag && dbt_task_id_s)
+								{
+									if (!SetJSONString (root_p, DBT_ARRAY_TASK_ID_S, dbt_task_id_s))
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add array task id \"%s\" for %s", dbt_task_id_s, uuid_s);
+											success_flag = false;
+										}
+									else if (dbt_task_filename_s && (!SetJSONString (root_p, DBT_ARRAY_TASK_FILE_S, dbt_task_filename_s)))
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add array task file \"%s\" for %s", dbt_task_filename_s, uuid_s);
+											success_flag = false;
+										}
+								}
 						}		/* if (json_object_set_new (root_p, DBT_DRMAA_S, drmaa_json_p) == 0) */
 					else
 						{
@@ -366,6 +525,202 @@ ArgsProcessor *DrmaaBlastTool :: GetArgsProcessor ()
 }
 
 
+uint32 DrmaaBlastTool :: AddToDrmaaArrayJob (DrmaaArrayJob *array_p)
+{
+	uint32 index = 0;
+	char **args_ss = dbt_args_processor_p -> GetArgsAsStrings ();
+
+	if (args_ss)
+		{
+			char uuid_s [UUID_STRING_BUFFER_SIZE];
+			char sep_s [2];
+			char *logfile_s;
+
+			*sep_s = GetFileSeparatorChar ();
+			* (sep_s + 1) = '\0';
+
+			ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+			/* This is the same file that GetLog reads */
+			logfile_s = ConcatenateVarargsStrings (ebt_working_directory_s, sep_s, uuid_s, BS_LOG_SUFFIX_S, NULL);
+
+			if (logfile_s)
+				{
+					index = array_p -> AddTask (ebt_blast_s, args_ss, logfile_s);
+					FreeCopiedString (logfile_s);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get logfile name for \"%s\"", bt_name_s);
+				}
+
+			FreeMemory (args_ss);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get arguments for \"%s\"", bt_name_s);
+		}
+
+	return index;
+}
+
+
+bool DrmaaBlastTool :: SetDrmaaArrayTask (const DrmaaArrayJob *array_p, uint32 index)
+{
+	bool success_flag = false;
+	const char *task_id_s = array_p -> GetTaskId (index);
+
+	if (task_id_s)
+		{
+			dbt_task_id_s = EasyCopyToNewString (task_id_s);
+
+			if (dbt_task_id_s)
+				{
+					const char *task_filename_s = array_p -> GetTaskFilename (index);
+
+					/* Not having the task file just means that it won't get cleaned up */
+					if (task_filename_s)
+						{
+							dbt_task_filename_s = EasyCopyToNewString (task_filename_s);
+						}
+
+					SetDeadline ();
+
+					#if DRMAA_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Added drmaa blast tool %s as array task %s", bt_name_s, dbt_task_id_s);
+					#endif
+
+					success_flag = true;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to copy array task id \"%s\" for \"%s\"", task_id_s, bt_name_s);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "No array task id for index " UINT32_FMT " for \"%s\"", index, bt_name_s);
+		}
+
+	return success_flag;
+}
+
+
+void DrmaaBlastTool :: SetDeadline ()
+{
+	/*
+	 * The job's arguments aren't available to look up its task,
+	 * so only the service-wide time limit applies.
+	 */
+	uint32 time_limit = GetBlastJobTimeLimit (bt_service_data_p, NULL);
+
+	if (time_limit > 0)
+		{
+			dbt_deadline = time (NULL) + (time_t) time_limit;
+		}
+}
+
+
+const char *DrmaaBlastTool :: GetDrmaaJobId () const
+{
+	return dbt_task_id_s ? dbt_task_id_s : dbt_drmaa_tool_p -> dt_id_s;
+}
+
+
+void DrmaaBlastTool :: SetStatusPoller (DrmaaStatusPoller *poller_p)
+{
+	dbt_poller_p = poller_p;
+}
+
+
+/*
+ * Array tasks aren't known to the DrmaaTool, so their status is
+ * checked directly. This is also used for all jobs when there is
+ * a DrmaaStatusPoller so that their states can be cached.
+ */
+OperationStatus DrmaaBlastTool :: GetDrmaaJobStatus ()
+{
+	OperationStatus status = OS_ERROR;
+	const char *job_id_s = GetDrmaaJobId ();
+	int drmaa_status = DRMAA_PS_UNDETERMINED;
+	int res = DRMAA_ERRNO_INTERNAL_ERROR;
+
+	if (!job_id_s)
+		{
+			/* The job hasn't been submitted yet */
+			return GetDrmaaToolStatus (dbt_drmaa_tool_p);
+		}
+
+	if (! (dbt_poller_p && (dbt_poller_p -> GetJobStatus (job_id_s, &drmaa_status, &res))))
+		{
+			char error_s [DRMAA_ERROR_STRING_BUFFER];
+
+			res = drmaa_job_ps (job_id_s, &drmaa_status, error_s, DRMAA_ERROR_STRING_BUFFER);
+
+			if ((res == DRMAA_ERRNO_SUCCESS) || (res == DRMAA_ERRNO_INVALID_JOB))
+				{
+					if (dbt_poller_p)
+						{
+							dbt_poller_p -> SetJobStatus (job_id_s, drmaa_status, res);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get status of drmaa job \"%s\": %s", job_id_s, error_s);
+				}
+		}
+
+	if (res == DRMAA_ERRNO_SUCCESS)
+		{
+			switch (drmaa_status)
+				{
+					case DRMAA_PS_QUEUED_ACTIVE:
+					case DRMAA_PS_SYSTEM_ON_HOLD:
+					case DRMAA_PS_USER_ON_HOLD:
+					case DRMAA_PS_USER_SYSTEM_ON_HOLD:
+						status = OS_PENDING;
+						break;
+
+					case DRMAA_PS_RUNNING:
+					case DRMAA_PS_SYSTEM_SUSPENDED:
+					case DRMAA_PS_USER_SUSPENDED:
+					case DRMAA_PS_USER_SYSTEM_SUSPENDED:
+						status = OS_STARTED;
+						break;
+
+					case DRMAA_PS_DONE:
+						status = OS_SUCCEEDED;
+						break;
+
+					case DRMAA_PS_FAILED:
+						status = OS_FAILED;
+						break;
+
+					default:
+						PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Undetermined drmaa status %d for drmaa job \"%s\"", drmaa_status, job_id_s);
+						break;
+				}
+		}
+	else if (res == DRMAA_ERRNO_INVALID_JOB)
+		{
+			/*
+			 * The scheduler has forgotten about the job as it finished
+			 * a while ago, so go by whether it wrote any results.
+			 */
+			status = (ebt_results_filename_s && DoesBlastFileExist (ebt_results_filename_s)) ? OS_SUCCEEDED : OS_FAILED;
+		}
+
+	if (((status == OS_SUCCEEDED) || (status == OS_FAILED)) && dbt_task_filename_s)
+		{
+			remove (dbt_task_filename_s);
+			FreeCopiedString (dbt_task_filename_s);
+			dbt_task_filename_s = NULL;
+		}
+
+	return status;
+}
+
+
 static bool UpdateDrmaaBlastServiceJob (struct ServiceJob *job_p)
 {
 	BlastServiceJob *blast_job_p = reinterpret_cast <BlastServiceJob *> (job_p);
@@ -23,8 +23,11 @@
 #include "drmaa_blast_tool_factory.hpp"
 
 #include "drmaa_blast_tool.hpp"
+#include "drmaa_array_job.hpp"
+#include "drmaa_status_poller.hpp"
 #include "json_util.h"
 #include "streams.h"
+#include "uuid_util.h"
 
 
 
@@ -48,14 +51,36 @@ DrmaaBlastToolFactory	*DrmaaBlastToolFactory :: CreateDrmaaBlastToolFactory (con
 
 
 DrmaaBlastToolFactory :: DrmaaBlastToolFactory (const json_t *service_config_p)
-	: ExternalBlastToolFactory (service_config_p)
+	: ExternalBlastToolFactory (service_config_p),
+		dbtf_poller_p (0)
 {
+	const json_t *drmaa_blast_tool_config_p = json_object_get (service_config_p, "drmaa_blast_tool_config");
+	json_int_t interval = 10;
 
+	if (drmaa_blast_tool_config_p)
+		{
+			GetJSONInteger (drmaa_blast_tool_config_p, "status_poll_interval", &interval);
+		}
+
+	/* Without a poller, each status check goes straight to the scheduler */
+	if (interval > 0)
+		{
+			dbtf_poller_p = DrmaaStatusPoller :: GetSharedDrmaaStatusPoller ((uint32) interval);
+
+			if (!dbtf_poller_p)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get DrmaaStatusPoller, drmaa job statuses will not be cached");
+				}
+		}
 }
 
 
 DrmaaBlastToolFactory :: ~DrmaaBlastToolFactory ()
 {
+	if (dbtf_poller_p)
+		{
+			DrmaaStatusPoller :: ReleaseSharedDrmaaStatusPoller ();
+		}
 
 }
 
@@ -92,6 +117,9 @@ BlastTool *DrmaaBlastToolFactory :: CreateBlastTool (BlastServiceJob *job_p, con
 					if (drmaa_tool_p)
 						{
 							json_int_t i = 0;
+
+							drmaa_tool_p -> SetStatusPoller (dbtf_poller_p);
+
 							const char *value_s = NULL;
 
 							/* Set the number of cores per job */
@@ -144,6 +172,97 @@ Synchronicity DrmaaBlastToolFactory :: GetToolsSynchronicity () const
 }
 
 
+bool DrmaaBlastToolFactory :: RunBlastToolsTogether (BlastTool **tools_pp, const uint32 num_tools, const BlastServiceData *data_p)
+{
+	bool success_flag = false;
+	const json_t *drmaa_blast_tool_config_p = json_object_get (data_p -> bsd_base_data.sd_config_p, "drmaa_blast_tool_config");
+
+	if (drmaa_blast_tool_config_p && (num_tools > 1))
+		{
+			bool async_flag = true;
+			bool array_flag = true;
+
+			GetJSONBoolean (drmaa_blast_tool_config_p, ExternalBlastTool :: EBT_ASYNC_S, &async_flag);
+			GetJSONBoolean (drmaa_blast_tool_config_p, "array_jobs", &array_flag);
+
+			/* A synchronous DrmaaBlastTool waits for its own job, so it can't be part of an array */
+			if (async_flag && array_flag)
+				{
+					char array_id_s [UUID_STRING_BUFFER_SIZE];
+					DrmaaArrayJob *array_p;
+
+					ConvertUUIDToString ((*tools_pp) -> GetUUID (), array_id_s);
+
+					array_p = DrmaaArrayJob :: Create (data_p, array_id_s, num_tools);
+
+					if (array_p)
+						{
+							json_int_t cores = 0;
+							uint32 i;
+							bool added_flag = true;
+
+							array_p -> SetQueueName (GetJSONString (drmaa_blast_tool_config_p, "queue"));
+							array_p -> SetNativeSpecification (GetJSONString (drmaa_blast_tool_config_p, "native_specification"));
+							array_p -> SetEmailNotifications (GetJSONString (drmaa_blast_tool_config_p, "email_notifications"));
+
+							if (GetJSONInteger (drmaa_blast_tool_config_p, "drmaa_cores_per_search", &cores) && (cores > 0))
+								{
+									array_p -> SetCoresPerTask ((uint32) cores);
+								}
+
+							/* The tasks are numbered in the order that they are added */
+							for (i = 0; (i < num_tools) && added_flag; ++ i)
+								{
+									DrmaaBlastTool *tool_p = static_cast <DrmaaBlastTool *> (* (tools_pp + i));
+
+									added_flag = (tool_p -> AddToDrmaaArrayJob (array_p) == i + 1);
+								}
+
+							if (added_flag)
+								{
+									for (i = 0; i < num_tools; ++ i)
+										{
+											(* (tools_pp + i)) -> PreRun ();
+										}
+
+									if (array_p -> Submit ())
+										{
+											for (i = 0; i < num_tools; ++ i)
+												{
+													DrmaaBlastTool *tool_p = static_cast <DrmaaBlastTool *> (* (tools_pp + i));
+
+													/* The task is running regardless, but there's no way to follow it */
+													if (!tool_p -> SetDrmaaArrayTask (array_p, i + 1))
+														{
+															tool_p -> CompleteRun (OS_ERROR);
+														}
+
+													tool_p -> PostRun ();
+												}
+
+											success_flag = true;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to submit array job for \"%s\", submitting its " UINT32_FMT " searches separately", array_id_s, num_tools);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add search " UINT32_FMT " to array job for \"%s\", submitting its searches separately", i, array_id_s);
+								}
+
+							delete array_p;
+						}		/* if (array_p) */
+
+				}		/* if (async_flag && array_flag) */
+
+		}		/* if (drmaa_blast_tool_config_p && (num_tools > 1)) */
+
+	return success_flag;
+}
+
+
 const char *DrmaaBlastToolFactory :: GetName ()
 {
 	return "Drmaa Blast Tool Factory";
@@ -154,6 +273,8 @@ BlastTool *DrmaaBlastToolFactory :: CreateBlastTool (const json_t *root_p, Blast
 {
 	DrmaaBlastTool *tool_p = new DrmaaBlastTool (blast_job_p, service_data_p, root_p);
 
+	tool_p -> SetStatusPoller (dbtf_poller_p);
+
 	return tool_p;
 }
 
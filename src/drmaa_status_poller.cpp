@@ -0,0 +1,550 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * drmaa_status_poller.cpp
+ *
+ *  Created on: 19 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <errno.h>
+#include <string.h>
+
+#include "drmaa.h"
+
+#include "drmaa_status_poller.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define DRMAA_STATUS_POLLER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define DRMAA_STATUS_POLLER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A DRMAA job whose state is cached by a DrmaaStatusPoller.
+ */
+typedef struct PolledJob
+{
+	char *pj_job_id_s;
+
+	/* The state from the last successful call to drmaa_job_ps */
+	int pj_drmaa_status;
+
+	/*
+	 * The result of the last successful call to drmaa_job_ps, which is
+	 * either DRMAA_ERRNO_SUCCESS or DRMAA_ERRNO_INVALID_JOB if the
+	 * scheduler no longer knows about the job.
+	 */
+	int pj_res;
+
+	/* Has the job's state been got yet? */
+	bool pj_cached_flag;
+
+	/* Has the job finished, so its state won't change? */
+	bool pj_finished_flag;
+
+	/* When the job's state was last asked for */
+	time_t pj_last_read;
+
+	struct PolledJob *pj_prev_p;
+
+	struct PolledJob *pj_next_p;
+} PolledJob;
+
+
+/*
+ * The job id and the results of querying its state
+ * during a refresh.
+ */
+typedef struct PolledState
+{
+	char *ps_job_id_s;
+
+	int ps_drmaa_status;
+
+	int ps_res;
+} PolledState;
+
+
+static bool IsFinishedState (int drmaa_status, int res);
+
+static void FreePolledJob (PolledJob *job_p);
+
+
+
+DrmaaStatusPoller *DrmaaStatusPoller :: dsp_shared_poller_p = 0;
+
+uint32 DrmaaStatusPoller :: dsp_shared_poller_count = 0;
+
+pthread_mutex_t DrmaaStatusPoller :: dsp_shared_poller_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+const time_t DrmaaStatusPoller :: DSP_EXPIRY_TIME = 600;
+
+
+
+DrmaaStatusPoller *DrmaaStatusPoller :: GetSharedDrmaaStatusPoller (uint32 interval)
+{
+	DrmaaStatusPoller *poller_p = 0;
+
+	pthread_mutex_lock (&dsp_shared_poller_mutex);
+
+	if (!dsp_shared_poller_p)
+		{
+			try
+				{
+					dsp_shared_poller_p = new DrmaaStatusPoller (interval);
+
+					#if DRMAA_STATUS_POLLER_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Created shared DrmaaStatusPoller refreshing every " UINT32_FMT " seconds", interval);
+					#endif
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create DrmaaStatusPoller");
+				}
+		}
+
+	if (dsp_shared_poller_p)
+		{
+			++ dsp_shared_poller_count;
+			poller_p = dsp_shared_poller_p;
+		}
+
+	pthread_mutex_unlock (&dsp_shared_poller_mutex);
+
+	return poller_p;
+}
+
+
+void DrmaaStatusPoller :: ReleaseSharedDrmaaStatusPoller ()
+{
+	DrmaaStatusPoller *poller_to_free_p = 0;
+
+	pthread_mutex_lock (&dsp_shared_poller_mutex);
+
+	if (dsp_shared_poller_count > 0)
+		{
+			-- dsp_shared_poller_count;
+
+			if (dsp_shared_poller_count == 0)
+				{
+					poller_to_free_p = dsp_shared_poller_p;
+					dsp_shared_poller_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&dsp_shared_poller_mutex);
+
+	/* Wait for the thread outside of the lock */
+	if (poller_to_free_p)
+		{
+			delete poller_to_free_p;
+		}
+}
+
+
+DrmaaStatusPoller :: DrmaaStatusPoller (uint32 interval)
+	: dsp_jobs_p (0),
+		dsp_num_jobs (0),
+		dsp_interval (interval > 0 ? interval : 1),
+		dsp_running_flag (true)
+{
+	if (pthread_mutex_init (&dsp_mutex, NULL) != 0)
+		{
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&dsp_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&dsp_mutex);
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_create (&dsp_thread, NULL, RunPollerThread, this) != 0)
+		{
+			pthread_cond_destroy (&dsp_cond);
+			pthread_mutex_destroy (&dsp_mutex);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+DrmaaStatusPoller :: ~DrmaaStatusPoller ()
+{
+	PolledJob *job_p;
+
+	pthread_mutex_lock (&dsp_mutex);
+	dsp_running_flag = false;
+	pthread_cond_signal (&dsp_cond);
+	pthread_mutex_unlock (&dsp_mutex);
+
+	pthread_join (dsp_thread, NULL);
+
+	job_p = dsp_jobs_p;
+
+	while (job_p)
+		{
+			PolledJob *next_p = job_p -> pj_next_p;
+
+			FreePolledJob (job_p);
+			job_p = next_p;
+		}
+
+	pthread_cond_destroy (&dsp_cond);
+	pthread_mutex_destroy (&dsp_mutex);
+}
+
+
+bool DrmaaStatusPoller :: GetJobStatus (const char *job_id_s, int *drmaa_status_p, int *res_p)
+{
+	bool cached_flag = false;
+	PolledJob *job_p;
+
+	pthread_mutex_lock (&dsp_mutex);
+
+	job_p = FindJob (job_id_s);
+
+	if (!job_p)
+		{
+			job_p = AddJob (job_id_s);
+		}
+
+	if (job_p)
+		{
+			job_p -> pj_last_read = time (NULL);
+
+			if (job_p -> pj_cached_flag)
+				{
+					*drmaa_status_p = job_p -> pj_drmaa_status;
+					*res_p = job_p -> pj_res;
+					cached_flag = true;
+				}
+		}
+
+	pthread_mutex_unlock (&dsp_mutex);
+
+	return cached_flag;
+}
+
+
+void DrmaaStatusPoller :: SetJobStatus (const char *job_id_s, int drmaa_status, int res)
+{
+	PolledJob *job_p;
+
+	pthread_mutex_lock (&dsp_mutex);
+
+	job_p = FindJob (job_id_s);
+
+	if (!job_p)
+		{
+			job_p = AddJob (job_id_s);
+		}
+
+	if (job_p)
+		{
+			job_p -> pj_drmaa_status = drmaa_status;
+			job_p -> pj_res = res;
+			job_p -> pj_cached_flag = true;
+			job_p -> pj_finished_flag = IsFinishedState (drmaa_status, res);
+			job_p -> pj_last_read = time (NULL);
+		}
+
+	pthread_mutex_unlock (&dsp_mutex);
+}
+
+
+void DrmaaStatusPoller :: Forget (const char *job_id_s)
+{
+	PolledJob *job_p;
+
+	pthread_mutex_lock (&dsp_mutex);
+
+	job_p = FindJob (job_id_s);
+
+	if (job_p)
+		{
+			RemoveJob (job_p);
+		}
+
+	pthread_mutex_unlock (&dsp_mutex);
+
+	if (job_p)
+		{
+			FreePolledJob (job_p);
+		}
+}
+
+
+void *DrmaaStatusPoller :: RunPollerThread (void *data_p)
+{
+	DrmaaStatusPoller *poller_p = static_cast <DrmaaStatusPoller *> (data_p);
+
+	poller_p -> Run ();
+
+	return NULL;
+}
+
+
+void DrmaaStatusPoller :: Run ()
+{
+	pthread_mutex_lock (&dsp_mutex);
+
+	while (dsp_running_flag)
+		{
+			struct timespec wake_time;
+			int res = 0;
+
+			clock_gettime (CLOCK_REALTIME, &wake_time);
+			wake_time.tv_sec += dsp_interval;
+
+			while (dsp_running_flag && (res != ETIMEDOUT))
+				{
+					res = pthread_cond_timedwait (&dsp_cond, &dsp_mutex, &wake_time);
+				}
+
+			if (dsp_running_flag)
+				{
+					/* Don't hold the lock while waiting for the scheduler */
+					pthread_mutex_unlock (&dsp_mutex);
+					Refresh ();
+					pthread_mutex_lock (&dsp_mutex);
+				}
+		}
+
+	pthread_mutex_unlock (&dsp_mutex);
+}
+
+
+/*
+ * DRMAA can only query one job at a time, so the ids of all of the
+ * outstanding jobs are copied and then queried one after another
+ * before their states are stored in a single pass.
+ */
+void DrmaaStatusPoller :: Refresh ()
+{
+	PolledState *states_p = NULL;
+	uint32 num_states = 0;
+	uint32 i;
+	PolledJob *job_p;
+	time_t now = time (NULL);
+
+	pthread_mutex_lock (&dsp_mutex);
+
+	job_p = dsp_jobs_p;
+
+	while (job_p)
+		{
+			PolledJob *next_p = job_p -> pj_next_p;
+
+			if (now - job_p -> pj_last_read > DSP_EXPIRY_TIME)
+				{
+					RemoveJob (job_p);
+					FreePolledJob (job_p);
+				}
+			else if (!job_p -> pj_finished_flag)
+				{
+					++ num_states;
+				}
+
+			job_p = next_p;
+		}
+
+	if (num_states > 0)
+		{
+			states_p = (PolledState *) AllocMemoryArray (num_states, sizeof (PolledState));
+
+			if (states_p)
+				{
+					PolledState *state_p = states_p;
+
+					for (job_p = dsp_jobs_p; job_p; job_p = job_p -> pj_next_p)
+						{
+							if (!job_p -> pj_finished_flag)
+								{
+									state_p -> ps_job_id_s = EasyCopyToNewString (job_p -> pj_job_id_s);
+									++ state_p;
+								}
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate states for " UINT32_FMT " drmaa jobs", num_states);
+				}
+		}
+
+	pthread_mutex_unlock (&dsp_mutex);
+
+	if (states_p)
+		{
+			PolledState *state_p = states_p;
+
+			for (i = 0; i < num_states; ++ i, ++ state_p)
+				{
+					if (state_p -> ps_job_id_s)
+						{
+							char error_s [DRMAA_ERROR_STRING_BUFFER];
+
+							state_p -> ps_res = drmaa_job_ps (state_p -> ps_job_id_s, & (state_p -> ps_drmaa_status), error_s, DRMAA_ERROR_STRING_BUFFER);
+
+							if ((state_p -> ps_res != DRMAA_ERRNO_SUCCESS) && (state_p -> ps_res != DRMAA_ERRNO_INVALID_JOB))
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get status of drmaa job \"%s\": %s", state_p -> ps_job_id_s, error_s);
+								}
+						}
+				}
+
+			pthread_mutex_lock (&dsp_mutex);
+
+			for (i = 0, state_p = states_p; i < num_states; ++ i, ++ state_p)
+				{
+					if (state_p -> ps_job_id_s)
+						{
+							/* Keep the previous state if the scheduler couldn't be reached */
+							if ((state_p -> ps_res == DRMAA_ERRNO_SUCCESS) || (state_p -> ps_res == DRMAA_ERRNO_INVALID_JOB))
+								{
+									job_p = FindJob (state_p -> ps_job_id_s);
+
+									/* The job may have been forgotten in the meantime */
+									if (job_p)
+										{
+											job_p -> pj_drmaa_status = state_p -> ps_drmaa_status;
+											job_p -> pj_res = state_p -> ps_res;
+											job_p -> pj_cached_flag = true;
+											job_p -> pj_finished_flag = IsFinishedState (state_p -> ps_drmaa_status, state_p -> ps_res);
+										}
+								}
+						}
+				}
+
+			pthread_mutex_unlock (&dsp_mutex);
+
+			#if DRMAA_STATUS_POLLER_DEBUG >= STM_LEVEL_FINER
+			PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Refreshed the states of " UINT32_FMT " drmaa jobs", num_states);
+			#endif
+
+			for (i = 0, state_p = states_p; i < num_states; ++ i, ++ state_p)
+				{
+					if (state_p -> ps_job_id_s)
+						{
+							FreeCopiedString (state_p -> ps_job_id_s);
+						}
+				}
+
+			FreeMemory (states_p);
+		}		/* if (states_p) */
+}
+
+
+PolledJob *DrmaaStatusPoller :: FindJob (const char *job_id_s) const
+{
+	PolledJob *job_p;
+
+	for (job_p = dsp_jobs_p; job_p; job_p = job_p -> pj_next_p)
+		{
+			if (strcmp (job_p -> pj_job_id_s, job_id_s) == 0)
+				{
+					return job_p;
+				}
+		}
+
+	return NULL;
+}
+
+
+PolledJob *DrmaaStatusPoller :: AddJob (const char *job_id_s)
+{
+	PolledJob *job_p = (PolledJob *) AllocMemory (sizeof (PolledJob));
+
+	if (job_p)
+		{
+			memset (job_p, 0, sizeof (PolledJob));
+
+			job_p -> pj_job_id_s = EasyCopyToNewString (job_id_s);
+
+			if (job_p -> pj_job_id_s)
+				{
+					job_p -> pj_last_read = time (NULL);
+
+					job_p -> pj_next_p = dsp_jobs_p;
+
+					if (dsp_jobs_p)
+						{
+							dsp_jobs_p -> pj_prev_p = job_p;
+						}
+
+					dsp_jobs_p = job_p;
+					++ dsp_num_jobs;
+
+					return job_p;
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to copy drmaa job id \"%s\"", job_id_s);
+				}
+
+			FreeMemory (job_p);
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate polled job for \"%s\"", job_id_s);
+		}
+
+	return NULL;
+}
+
+
+void DrmaaStatusPoller :: RemoveJob (PolledJob *job_p)
+{
+	if (job_p -> pj_prev_p)
+		{
+			job_p -> pj_prev_p -> pj_next_p = job_p -> pj_next_p;
+		}
+	else
+		{
+			dsp_jobs_p = job_p -> pj_next_p;
+		}
+
+	if (job_p -> pj_next_p)
+		{
+			job_p -> pj_next_p -> pj_prev_p = job_p -> pj_prev_p;
+		}
+
+	job_p -> pj_prev_p = NULL;
+	job_p -> pj_next_p = NULL;
+
+	-- dsp_num_jobs;
+}
+
+
+static bool IsFinishedState (int drmaa_status, int res)
+{
+	return ((res == DRMAA_ERRNO_INVALID_JOB) || (drmaa_status == DRMAA_PS_DONE) || (drmaa_status == DRMAA_PS_FAILED));
+}
+
+
+static void FreePolledJob (PolledJob *job_p)
+{
+	FreeCopiedString (job_p -> pj_job_id_s);
+	FreeMemory (job_p);
+}
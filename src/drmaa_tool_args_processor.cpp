@@ -34,13 +34,13 @@
 DrmaaToolArgsProcessor :: DrmaaToolArgsProcessor (DrmaaTool *drmaa_p)
 	: dtap_drmaa_p (drmaa_p)
 {
-
+	dtap_args_p = new StringsArgsProcessor ();
 }
 
 
 DrmaaToolArgsProcessor :: ~DrmaaToolArgsProcessor ()
 {
-
+	delete dtap_args_p;
 }
 
 
@@ -67,5 +67,16 @@ bool DrmaaToolArgsProcessor :: AddArg (const char *arg_s, const bool hyphen_flag
 			success_flag = AddDrmaaToolArgument (dtap_drmaa_p, arg_s);
 		}
 
+	if (success_flag)
+		{
+			success_flag = dtap_args_p -> AddArg (arg_s, hyphen_flag);
+		}
+
 	return success_flag;
 }
+
+
+char **DrmaaToolArgsProcessor :: GetArgsAsStrings ()
+{
+	return dtap_args_p -> GetArgsAsStrings ();
+}
@@ -23,11 +23,15 @@
 #include "external_blast_tool.hpp"
 
 #include <cstring>
+#include <ctime>
 #include <stdexcept>
 
 #include "blast_service_job.h"
 #include "blast_service_params.h"
 #include "blast_util.h"
+#include "blast_progress_tracker.hpp"
+#include "blast_result_buffer.hpp"
+#include "blast_file_compression.hpp"
 #include "string_utils.h"
 #include "temp_file.hpp"
 #include "math_utils.h"
@@ -47,6 +51,22 @@ const char * const ExternalBlastTool :: EBT_RESULTS_FILE_S = "output_file";
 
 const char * const ExternalBlastTool :: EBT_ASYNC_S = "async";
 
+const char * const ExternalBlastTool :: EBT_NUM_QUERIES_S = "num_queries";
+
+const char * const ExternalBlastTool :: EBT_PROGRESS_QUERIES_COMPLETED_S = "queries_completed";
+const char * const ExternalBlastTool :: EBT_PROGRESS_QUERIES_TOTAL_S = "queries_total";
+const char * const ExternalBlastTool :: EBT_PROGRESS_ELAPSED_S = "elapsed";
+const char * const ExternalBlastTool :: EBT_PROGRESS_ETA_S = "eta";
+const char * const ExternalBlastTool :: EBT_PROGRESS_POLL_INTERVAL_S = "suggested_poll_interval";
+const char * const ExternalBlastTool :: EBT_PROGRESS_MESSAGE_S = "message";
+
+
+/** The shortest time, in seconds, that clients will be asked to wait between progress checks. */
+#define EBT_MIN_POLL_INTERVAL	(2)
+
+/** The longest time, in seconds, that clients will be asked to wait between progress checks. */
+#define EBT_MAX_POLL_INTERVAL	(60)
+
 
 
 char *ExternalBlastTool :: GetJobFilename (const char * const prefix_s, const char * const suffix_s)
@@ -76,6 +96,8 @@ ExternalBlastTool :: ExternalBlastTool (BlastServiceJob *job_p, const char *name
 		}
 
 	ebt_async_flag = async_flag;
+	ebt_query_size = 0;
+	ebt_num_queries = 0;
 }
 
 
@@ -84,11 +106,17 @@ ExternalBlastTool :: ExternalBlastTool (BlastServiceJob *job_p, const BlastServi
 	: BlastTool (job_p, data_p, root_p)
 {
 	ebt_async_flag = true;
+	ebt_query_size = 0;
+
 	if (!GetJSONBoolean (root_p, EBT_ASYNC_S, &ebt_async_flag))
 		{
 			PrintJSONToErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, root_p, "Failed to get aysnc flag from json");
 		}
 
+	json_int_t num_queries = 0;
+	GetJSONInteger (root_p, EBT_NUM_QUERIES_S, &num_queries);
+	ebt_num_queries = (uint32) num_queries;
+
 
 
 	ebt_blast_s = GetCopiedJSONString (root_p, EBT_COMMAND_LINE_EXECUTABLE_S);
@@ -144,35 +172,61 @@ ExternalBlastTool :: ~ExternalBlastTool ()
 char *ExternalBlastTool :: GetResults (BlastFormatter *formatter_p)
 {
 	char *results_s = NULL;
+	BlastResultBuffer *buffer_p = GetResultsBuffer (formatter_p);
+
+	if (buffer_p)
+		{
+			results_s = buffer_p -> CopyToString ();
+			delete buffer_p;
+		}
+
+	return results_s;
+}
+
+
+BlastResultBuffer *ExternalBlastTool :: GetResultsBuffer (BlastFormatter *formatter_p)
+{
+	BlastResultBuffer *buffer_p = NULL;
 
 	if (ebt_results_filename_s)
 		{
-			if (formatter_p && (bt_output_format != BS_DEFAULT_OUTPUT_FORMAT))
+			if (formatter_p && (bt_output_format != formatter_p -> GetArchiveOutputFormat ()))
 				{
 					char uuid_s [UUID_STRING_BUFFER_SIZE];
+					char *results_s;
 
 					ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
 
-					results_s = formatter_p -> GetConvertedOutput (uuid_s, bt_output_format, bt_custom_output_columns_s, bt_service_data_p);
+					results_s = ConvertBlastResult (bt_service_data_p, formatter_p, uuid_s, ebt_results_filename_s, bt_output_format, bt_custom_output_columns_s);
 
-					if (!results_s)
+					if (results_s)
+						{
+							buffer_p = BlastResultBuffer :: AdoptString (results_s);
+
+							if (!buffer_p)
+								{
+									FreeCopiedString (results_s);
+								}
+						}
+					else
 						{
 							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to format %s to " UINT32_FMT, ebt_results_filename_s, bt_output_format);
 						}
 
-				}		/* if (formatter_p && (bt_output_format != BS_DEFAULT_OUTPUT_FORMAT)) */
+				}		/* if (formatter_p && (bt_output_format != formatter_p -> GetArchiveOutputFormat ())) */
 			else
 				{
-					if (IsPathValid (ebt_results_filename_s))
+					if (DoesBlastFileExist (ebt_results_filename_s))
 						{
-							results_s = GetFileContentsAsStringByFilename (ebt_results_filename_s);
+							/* The job has finished so its output won't change while it is mapped */
+							buffer_p = ReadBlastFile (ebt_results_filename_s);
 
-							if (!results_s)
+							if (!buffer_p)
 								{
 									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to read data from  %s", ebt_results_filename_s);
 								}
 
-						}		/* if (IsPathValid (ebt_results_filename_s)) */
+						}		/* if (DoesBlastFileExist (ebt_results_filename_s)) */
 					else
 						{
 							PrintErrors (STM_LEVEL_INFO, __FILE__, __LINE__, "File %s does not exist", ebt_results_filename_s);
@@ -188,7 +242,7 @@ char *ExternalBlastTool :: GetResults (BlastFormatter *formatter_p)
 			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Results output object is NULL for \"%s\"", uuid_s);
 		}
 
-	return results_s;
+	return buffer_p;
 }
 
 
@@ -215,8 +269,9 @@ bool ExternalBlastTool :: ParseParameters (ParameterSet *params_p, BlastAppParam
 													if (GetAndAddBlastArgs (params_p, BS_EXPECT_THRESHOLD.npt_name_s, false, args_processor_p))
 														{
 															/* Output Format
-															 * If we have a BlastFormatter then the output is always set to 11 which is ASN and
-															 * from that we can convert into any other format using a BlastFormatter tool
+															 * If we have a BlastFormatter then the output is always set to its archive format,
+															 * e.g. 11 which is ASN, and from that we can convert into any other format using
+															 * the BlastFormatter
 															 */
 															const uint32 *out_fmt_p = NULL;
 
@@ -256,7 +311,18 @@ bool ExternalBlastTool :: ParseParameters (ParameterSet *params_p, BlastAppParam
 
 																	if (bt_service_data_p -> bsd_formatter_p)
 																		{
-																			success_flag = AddBlastArgsPair (BS_OUTPUT_FORMAT.npt_name_s, BS_DEFAULT_OUTPUT_FORMAT_S);
+																			const uint32 archive_format = bt_service_data_p -> bsd_formatter_p -> GetArchiveOutputFormat ();
+																			char *archive_format_s = ConvertUnsignedIntegerToString (archive_format);
+
+																			if (archive_format_s)
+																				{
+																					success_flag = AddBlastArgsPair (BS_OUTPUT_FORMAT.npt_name_s, archive_format_s);
+																					FreeCopiedString (archive_format_s);
+																				}
+																			else
+																				{
+																					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to convert output format \"" UINT32_FMT "\" to string", archive_format);
+																				}
 																		}
 																	else
 																		{
@@ -508,6 +574,12 @@ bool ExternalBlastTool :: SetInputFilename (const char * const filename_s)
 	if (filename_s)
 		{
 			success_flag = AddBlastArgsPair ("query", filename_s);
+
+			if (success_flag)
+				{
+					ebt_query_size = GetBlastFileSize (filename_s);
+					ebt_num_queries = CountBlastQueries (filename_s);
+				}
 		}
 
 	return success_flag;
@@ -529,7 +601,12 @@ bool ExternalBlastTool :: AddToJSON (json_t *root_p)
 								{
 									if (json_object_set_new (root_p, EBT_ASYNC_S, ebt_async_flag ? json_true () : json_false ()) == 0)
 										{
-											success_flag = true;
+											success_flag = SetJSONInteger (root_p, EBT_NUM_QUERIES_S, ebt_num_queries);
+
+											if (!success_flag)
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add %s:" UINT32_FMT " to ExternalBlastTool json", EBT_NUM_QUERIES_S, ebt_num_queries);
+												}
 										}		/* if (json_object_set_new (root_p, DBT_ASYNC_S, dbt_async_flag ? json_true () : json_false ()) == 0) */
 									else
 										{
@@ -566,27 +643,22 @@ bool ExternalBlastTool :: AddToJSON (json_t *root_p)
 
 char *ExternalBlastTool :: GetLog ()
 {
-	char *log_file_s = NULL;
-	char sep_s [2];
-	char uuid_s [UUID_STRING_BUFFER_SIZE];
-
-	*sep_s = GetFileSeparatorChar ();
-	* (sep_s + 1) = '\0';
-
-	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
-
-	log_file_s = ConcatenateVarargsStrings (ebt_working_directory_s, sep_s, uuid_s, BS_LOG_SUFFIX_S, NULL);
+	char *log_file_s = GetLogFilename ();
 
 	if (log_file_s)
 		{
-			FILE *log_f = fopen (log_file_s, "r");
+			/* The log of a finished job may have been compressed */
+			BlastResultBuffer *log_p = ReadBlastFile (log_file_s);
 
-			if (log_f)
+			if (log_p)
 				{
-					char *log_data_s = GetFileContentsAsString (log_f);
+					char *log_data_s = log_p -> CopyToString ();
+
+					delete log_p;
 
 					if (log_data_s)
 						{
+							FreeCopiedString (log_file_s);
 							return log_data_s;
 						}
 					else
@@ -594,7 +666,7 @@ char *ExternalBlastTool :: GetLog ()
 							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open log file %s", log_file_s);
 						}
 
-				}		/* if (log_f) */
+				}		/* if (log_p) */
 			else
 				{
 					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to open log file %s", log_file_s);
@@ -604,9 +676,127 @@ char *ExternalBlastTool :: GetLog ()
 		}		/* if (log_file_s) */
 	else
 		{
+			char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+			ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
 			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to get log filename for %s", uuid_s);
 		}
 
 	return NULL;
 }
 
+
+char *ExternalBlastTool :: GetLogFilename () const
+{
+	char sep_s [2];
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	*sep_s = GetFileSeparatorChar ();
+	* (sep_s + 1) = '\0';
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+	return ConcatenateVarargsStrings (ebt_working_directory_s, sep_s, uuid_s, BS_LOG_SUFFIX_S, NULL);
+}
+
+
+json_t *ExternalBlastTool :: GetProgressAsJSON ()
+{
+	json_t *progress_p = NULL;
+	BlastProgressTracker *tracker_p = bt_service_data_p -> bsd_progress_tracker_p;
+
+	if (tracker_p && (GetCachedServiceJobStatus (& (bt_job_p -> bsj_job)) == OS_STARTED))
+		{
+			char uuid_s [UUID_STRING_BUFFER_SIZE];
+			char *log_file_s = GetLogFilename ();
+			BlastProgress progress;
+
+			/*
+			 * If there is a BlastFormatter, the results are written in its
+			 * archive format and only converted when they are asked for.
+			 */
+			const uint32 output_format = (bt_service_data_p -> bsd_formatter_p) ? bt_service_data_p -> bsd_formatter_p -> GetArchiveOutputFormat () : bt_output_format;
+
+			ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+			if (tracker_p -> GetProgress (uuid_s, ebt_results_filename_s, output_format, log_file_s, &progress))
+				{
+					progress_p = json_object ();
+
+					if (progress_p)
+						{
+							const time_t elapsed = (bt_start_time > 0) ? time (NULL) - bt_start_time : 0;
+							time_t eta = -1;
+							time_t poll_interval;
+							bool success_flag = SetJSONInteger (progress_p, EBT_PROGRESS_ELAPSED_S, (json_int_t) elapsed);
+
+							if (success_flag && (ebt_num_queries > 0))
+								{
+									success_flag = SetJSONInteger (progress_p, EBT_PROGRESS_QUERIES_TOTAL_S, ebt_num_queries);
+								}
+
+							if (success_flag && progress.bp_counted_flag)
+								{
+									success_flag = SetJSONInteger (progress_p, EBT_PROGRESS_QUERIES_COMPLETED_S, progress.bp_queries_completed);
+
+									/*
+									 * Blast writes each query's results once it has finished
+									 * with it, so estimate the time left from the average so far.
+									 */
+									if (success_flag && (progress.bp_queries_completed > 0) && (progress.bp_queries_completed <= ebt_num_queries))
+										{
+											eta = (elapsed * (time_t) (ebt_num_queries - progress.bp_queries_completed)) / (time_t) progress.bp_queries_completed;
+											success_flag = SetJSONInteger (progress_p, EBT_PROGRESS_ETA_S, (json_int_t) eta);
+										}
+								}
+
+							if (success_flag && (*progress.bp_message_s != '\0'))
+								{
+									success_flag = SetJSONString (progress_p, EBT_PROGRESS_MESSAGE_S, progress.bp_message_s);
+								}
+
+							/*
+							 * Suggest how long the client should wait before asking again
+							 * so that short searches are checked often and long ones aren't.
+							 */
+							poll_interval = (eta >= 0) ? (eta / 4) : (elapsed / 10);
+
+							if (poll_interval < EBT_MIN_POLL_INTERVAL)
+								{
+									poll_interval = EBT_MIN_POLL_INTERVAL;
+								}
+							else if (poll_interval > EBT_MAX_POLL_INTERVAL)
+								{
+									poll_interval = EBT_MAX_POLL_INTERVAL;
+								}
+
+							if (success_flag)
+								{
+									success_flag = SetJSONInteger (progress_p, EBT_PROGRESS_POLL_INTERVAL_S, (json_int_t) poll_interval);
+								}
+
+							if (!success_flag)
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add progress details to json for %s", uuid_s);
+									json_decref (progress_p);
+									progress_p = NULL;
+								}
+
+						}		/* if (progress_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create progress json for %s", uuid_s);
+						}
+
+				}		/* if (tracker_p -> GetProgress (uuid_s, ebt_results_filename_s, output_format, log_file_s, &progress)) */
+
+			if (log_file_s)
+				{
+					FreeCopiedString (log_file_s);
+				}
+
+		}		/* if (tracker_p && (GetCachedServiceJobStatus (& (bt_job_p -> bsj_job)) == OS_STARTED)) */
+
+	return progress_p;
+}
+
@@ -0,0 +1,1618 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * native_blast_formatter.cpp
+ *
+ *  Created on: 22 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "native_blast_formatter.h"
+#include "blast_service.h"
+#include "blast_result_buffer.hpp"
+#include "blast_file_compression.hpp"
+#include "blast_service_params.h"
+#include "blast_util.h"
+
+#include "byte_buffer.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+/* The number of residues on each line of a pairwise alignment */
+#define NBF_ALIGNMENT_LINE_LENGTH	(60)
+
+/* The width of the subject titles in the pairwise summary of the hits */
+#define NBF_SUMMARY_TITLE_WIDTH	(67)
+
+/* The size of the buffers used to print each value */
+#define NBF_VALUE_BUFFER_SIZE	(64)
+
+
+/*
+ * The columns that can be used in the tabular
+ * formats, in the same order as S_COLUMNS.
+ */
+typedef enum NativeColumnType
+{
+	NCT_QSEQID,
+	NCT_QACC,
+	NCT_QACCVER,
+	NCT_QLEN,
+	NCT_SSEQID,
+	NCT_SALLSEQID,
+	NCT_SACC,
+	NCT_SACCVER,
+	NCT_SLEN,
+	NCT_QSTART,
+	NCT_QEND,
+	NCT_SSTART,
+	NCT_SEND,
+	NCT_QSEQ,
+	NCT_SSEQ,
+	NCT_EVALUE,
+	NCT_BITSCORE,
+	NCT_SCORE,
+	NCT_LENGTH,
+	NCT_PIDENT,
+	NCT_NIDENT,
+	NCT_MISMATCH,
+	NCT_POSITIVE,
+	NCT_GAPOPEN,
+	NCT_GAPS,
+	NCT_PPOS,
+	NCT_QFRAME,
+	NCT_SFRAME,
+	NCT_STAXID,
+	NCT_SSCINAME,
+	NCT_STITLE,
+	NCT_SALLTITLES,
+	NCT_SSTRAND,
+	NCT_QCOVS,
+	NCT_QCOVHSP,
+	NCT_NUM_TYPES
+} NativeColumnType;
+
+
+typedef struct NativeColumn
+{
+	/* The name used to select the column with -outfmt */
+	const char *nc_name_s;
+
+	/* The name used on the "# Fields:" line of the tabular with comments format */
+	const char *nc_title_s;
+
+	NativeColumnType nc_type;
+} NativeColumn;
+
+
+static const NativeColumn S_COLUMNS [NCT_NUM_TYPES] =
+{
+	{ "qseqid", "query id", NCT_QSEQID },
+	{ "qacc", "query acc.", NCT_QACC },
+	{ "qaccver", "query acc.ver", NCT_QACCVER },
+	{ "qlen", "query length", NCT_QLEN },
+	{ "sseqid", "subject id", NCT_SSEQID },
+	{ "sallseqid", "subject ids", NCT_SALLSEQID },
+	{ "sacc", "subject acc.", NCT_SACC },
+	{ "saccver", "subject acc.ver", NCT_SACCVER },
+	{ "slen", "subject length", NCT_SLEN },
+	{ "qstart", "q. start", NCT_QSTART },
+	{ "qend", "q. end", NCT_QEND },
+	{ "sstart", "s. start", NCT_SSTART },
+	{ "send", "s. end", NCT_SEND },
+	{ "qseq", "query seq", NCT_QSEQ },
+	{ "sseq", "subject seq", NCT_SSEQ },
+	{ "evalue", "evalue", NCT_EVALUE },
+	{ "bitscore", "bit score", NCT_BITSCORE },
+	{ "score", "score", NCT_SCORE },
+	{ "length", "alignment length", NCT_LENGTH },
+	{ "pident", "% identity", NCT_PIDENT },
+	{ "nident", "identical", NCT_NIDENT },
+	{ "mismatch", "mismatches", NCT_MISMATCH },
+	{ "positive", "positives", NCT_POSITIVE },
+	{ "gapopen", "gap opens", NCT_GAPOPEN },
+	{ "gaps", "gaps", NCT_GAPS },
+	{ "ppos", "% positives", NCT_PPOS },
+	{ "qframe", "query frame", NCT_QFRAME },
+	{ "sframe", "sbjct frame", NCT_SFRAME },
+	{ "staxid", "subject tax id", NCT_STAXID },
+	{ "ssciname", "subject sci name", NCT_SSCINAME },
+	{ "stitle", "subject title", NCT_STITLE },
+	{ "salltitles", "subject titles", NCT_SALLTITLES },
+	{ "sstrand", "subject strand", NCT_SSTRAND },
+	{ "qcovs", "% query coverage per subject", NCT_QCOVS },
+	{ "qcovhsp", "% query coverage per hsp", NCT_QCOVHSP }
+};
+
+
+/* The columns used when none are given or for "std" */
+static const NativeColumnType S_DEFAULT_COLUMNS [] =
+{
+	NCT_QACCVER,
+	NCT_SACCVER,
+	NCT_PIDENT,
+	NCT_LENGTH,
+	NCT_MISMATCH,
+	NCT_GAPOPEN,
+	NCT_QSTART,
+	NCT_QEND,
+	NCT_SSTART,
+	NCT_SEND,
+	NCT_EVALUE,
+	NCT_BITSCORE
+};
+
+
+#define NBF_NUM_DEFAULT_COLUMNS	(sizeof (S_DEFAULT_COLUMNS) / sizeof (S_DEFAULT_COLUMNS [0]))
+
+
+/*
+ * The ids that Blast gives to the sequences in databases
+ * that were made without the -parse_seqids option.
+ */
+static const char * const S_LOCAL_ID_PREFIX_S = "gnl|BL_ORD_ID|";
+
+
+/*
+ * The hit and hsp that are being written
+ * as a row of tabular output.
+ */
+typedef struct AlignmentRow
+{
+	const json_t *ar_search_p;
+
+	const json_t *ar_hit_p;
+
+	/* The first of the hit's descriptions */
+	const json_t *ar_description_p;
+
+	const json_t *ar_hsp_p;
+
+	/* The percentage of the query covered by all of the hit's hsps */
+	uint32 ar_query_coverage;
+} AlignmentRow;
+
+
+/*
+ * STATIC DECLARATIONS
+ */
+
+static const NativeColumn **GetColumns (const char *custom_format_s, uint32 *num_columns_p);
+
+static bool IsJSONArchive (const char *archive_s, const size_t length);
+
+static bool SaveConvertedOutput (const char *input_filename_s, const uint32 output_format_code, const char *custom_format_s, const char *output_s);
+
+static bool AppendTabularReport (ByteBuffer *buffer_p, const json_t *report_p, const uint32 output_format_code, const NativeColumn **columns_pp, const uint32 num_columns);
+
+static bool AppendColumnValue (ByteBuffer *buffer_p, const NativeColumn *column_p, const AlignmentRow *row_p);
+
+static bool AppendPairwiseReport (ByteBuffer *buffer_p, const json_t *report_p);
+
+static bool AppendPairwiseHsp (ByteBuffer *buffer_p, const json_t *hsp_p, const char *program_s);
+
+static bool AppendAlignmentLine (ByteBuffer *buffer_p, const char *label_s, const char *seq_s, const size_t offset, const size_t length, int64 *position_p, const int64 direction, const int64 factor, const int width);
+
+static bool AppendFirstWord (ByteBuffer *buffer_p, const char *value_s);
+
+static bool AppendQueryId (ByteBuffer *buffer_p, const json_t *search_p, const bool version_flag);
+
+static bool AppendSubjectId (ByteBuffer *buffer_p, const json_t *description_p, const NativeColumnType type);
+
+static bool AppendAllDescriptions (ByteBuffer *buffer_p, const json_t *hit_p, const NativeColumnType type);
+
+static bool AppendInteger (ByteBuffer *buffer_p, const int64 value);
+
+static void GetScoreStrings (const double evalue, const double bit_score, char *evalue_s, char *bit_score_s);
+
+static const json_t *GetSearch (const json_t *report_p);
+
+static int64 GetInteger (const json_t *json_p, const char * const key_s);
+
+static double GetNumber (const json_t *json_p, const char * const key_s);
+
+static int64 GetFrame (const json_t *hsp_p, const char * const frame_key_s, const char * const strand_key_s);
+
+static uint32 CountGapOpenings (const char *seq_s);
+
+static uint32 GetQueryCoverage (const json_t *hit_p, const int64 query_length);
+
+static uint32 GetPercentage (const int64 value, const int64 total);
+
+
+/*
+ * METHOD DEFINITIONS
+ */
+
+NativeBlastFormatter *NativeBlastFormatter :: Create (const json_t *system_config_p)
+{
+	NativeBlastFormatter *formatter_p = 0;
+	SystemBlastFormatter *fallback_formatter_p = 0;
+
+	if (system_config_p)
+		{
+			fallback_formatter_p = SystemBlastFormatter :: Create (system_config_p);
+
+			if (!fallback_formatter_p)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create SystemBlastFormatter for the formats that can't be converted natively");
+				}
+		}
+
+	try
+		{
+			formatter_p = new NativeBlastFormatter (fallback_formatter_p);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate NativeBlastFormatter");
+
+			if (fallback_formatter_p)
+				{
+					delete fallback_formatter_p;
+				}
+		}
+
+	return formatter_p;
+}
+
+
+NativeBlastFormatter :: NativeBlastFormatter (SystemBlastFormatter *fallback_formatter_p)
+ : BlastFormatter ()
+{
+	nbf_fallback_formatter_p = fallback_formatter_p;
+}
+
+
+NativeBlastFormatter :: ~NativeBlastFormatter ()
+{
+	if (nbf_fallback_formatter_p)
+		{
+			delete nbf_fallback_formatter_p;
+		}
+}
+
+
+uint32 NativeBlastFormatter :: GetArchiveOutputFormat () const
+{
+	return BOF_SINGLE_FILE_JSON_BLAST;
+}
+
+
+BlastResultBuffer *NativeBlastFormatter :: GetArchiveOutput (const char *job_output_filename_s)
+{
+	BlastResultBuffer *buffer_p = ReadBlastFile (job_output_filename_s);
+
+	if (buffer_p)
+		{
+			/* Jobs that were run before this became the formatter will have ASN.1 archives */
+			if (!IsJSONArchive (buffer_p -> GetData (), buffer_p -> GetLength ()))
+				{
+					delete buffer_p;
+					buffer_p = NULL;
+				}
+		}
+
+	return buffer_p;
+}
+
+
+bool NativeBlastFormatter :: CanConvertOutputFormat (const uint32 output_format_code, const char *custom_format_s)
+{
+	bool can_convert_flag = false;
+
+	switch (output_format_code)
+		{
+			case BOF_PAIRWISE:
+			case BOF_SINGLE_FILE_JSON_BLAST:
+				can_convert_flag = true;
+				break;
+
+			case BOF_TABULAR:
+			case BOF_TABULAR_WITH_COMMENTS:
+			case BOF_CSV:
+				{
+					uint32 num_columns = 0;
+					const NativeColumn **columns_pp = GetColumns (custom_format_s, &num_columns);
+
+					if (columns_pp)
+						{
+							can_convert_flag = true;
+							FreeMemory (columns_pp);
+						}
+				}
+				break;
+
+			default:
+				break;
+		}
+
+	return can_convert_flag;
+}
+
+
+char *NativeBlastFormatter :: ConvertJSONOutput (const json_t *blast_output_p, const uint32 output_format_code, const char *custom_format_s)
+{
+	char *result_s = NULL;
+	const json_t *reports_p = json_object_get (blast_output_p, "BlastOutput2");
+
+	if (json_is_array (reports_p))
+		{
+			const NativeColumn **columns_pp = NULL;
+			uint32 num_columns = 0;
+			bool success_flag = true;
+
+			if (BlastFormatter :: IsCustomisableOutputFormat (output_format_code))
+				{
+					columns_pp = GetColumns (custom_format_s, &num_columns);
+
+					if (!columns_pp)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Can't natively convert to custom output format \"%s\"", custom_format_s ? custom_format_s : "");
+							success_flag = false;
+						}
+				}
+
+			if (success_flag)
+				{
+					ByteBuffer *buffer_p = AllocateByteBuffer (1024);
+
+					if (buffer_p)
+						{
+							const size_t num_reports = json_array_size (reports_p);
+							size_t i;
+
+							for (i = 0; (i < num_reports) && success_flag; ++ i)
+								{
+									const json_t *report_p = json_object_get (json_array_get (reports_p, i), "report");
+
+									if (report_p)
+										{
+											if (output_format_code == BOF_PAIRWISE)
+												{
+													success_flag = AppendPairwiseReport (buffer_p, report_p);
+												}
+											else
+												{
+													success_flag = AppendTabularReport (buffer_p, report_p, output_format_code, columns_pp, num_columns);
+												}
+										}
+								}
+
+							if (success_flag && (output_format_code == BOF_TABULAR_WITH_COMMENTS))
+								{
+									success_flag = AppendStringToByteBuffer (buffer_p, "# BLAST processed ") &&
+										AppendInteger (buffer_p, (int64) num_reports) &&
+										AppendStringToByteBuffer (buffer_p, " queries\n");
+								}
+
+							if (success_flag)
+								{
+									result_s = DetachByteBufferData (buffer_p);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to convert blast output to format " UINT32_FMT, output_format_code);
+									FreeByteBuffer (buffer_p);
+								}
+
+						}		/* if (buffer_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate buffer to convert blast output");
+						}
+
+				}		/* if (success_flag) */
+
+			if (columns_pp)
+				{
+					FreeMemory (columns_pp);
+				}
+
+		}		/* if (json_is_array (reports_p)) */
+	else
+		{
+			PrintJSONToErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, blast_output_p, "Blast output has no BlastOutput2 array");
+		}
+
+	return result_s;
+}
+
+
+char *NativeBlastFormatter :: GetConvertedOutput (const char *job_id_s, const uint32 output_format_code, const char *custom_format_s, const BlastServiceData *data_p)
+{
+	char *result_s = NULL;
+	bool native_flag = false;
+
+	if (CanConvertOutputFormat (output_format_code, custom_format_s))
+		{
+			char *input_filename_s = GetBlastJobFilename (data_p -> bsd_working_dir_s, job_id_s, BS_OUTPUT_SUFFIX_S);
+
+			if (input_filename_s)
+				{
+					BlastResultBuffer *archive_p = ReadBlastFile (input_filename_s);
+
+					if (archive_p)
+						{
+							/*
+							 * Jobs that were run before this became the formatter
+							 * will have their results as ASN.1 archives
+							 */
+							if (IsJSONArchive (archive_p -> GetData (), archive_p -> GetLength ()))
+								{
+									native_flag = true;
+
+									if (output_format_code == BOF_SINGLE_FILE_JSON_BLAST)
+										{
+											result_s = archive_p -> CopyToString ();
+										}
+									else
+										{
+											json_error_t err;
+											json_t *blast_output_p = archive_p -> ParseAsJSON (&err);
+
+											if (blast_output_p)
+												{
+													result_s = ConvertJSONOutput (blast_output_p, output_format_code, custom_format_s);
+
+													if (result_s)
+														{
+															if (!SaveConvertedOutput (input_filename_s, output_format_code, custom_format_s, result_s))
+																{
+																	PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save converted output for \"%s\" with format code " UINT32_FMT, input_filename_s, output_format_code);
+																}
+														}
+
+													json_decref (blast_output_p);
+												}		/* if (blast_output_p) */
+											else
+												{
+													PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to parse \"%s\": \"%s\" at line %d column %d", input_filename_s, err.text, err.line, err.column);
+												}
+										}
+
+								}		/* if (IsJSONArchive (archive_p -> GetData (), archive_p -> GetLength ())) */
+
+							delete archive_p;
+
+						}		/* if (archive_p) */
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read \"%s\"", input_filename_s);
+						}
+
+					FreeCopiedString (input_filename_s);
+				}		/* if (input_filename_s) */
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get create input filename for job \"%s\"", job_id_s);
+				}
+
+		}		/* if (CanConvertOutputFormat (output_format_code, custom_format_s)) */
+
+	if (!native_flag)
+		{
+			if (nbf_fallback_formatter_p)
+				{
+					result_s = nbf_fallback_formatter_p -> GetConvertedOutput (job_id_s, output_format_code, custom_format_s, data_p);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Can't convert job \"%s\" to format code " UINT32_FMT " natively and there is no system formatter", job_id_s, output_format_code);
+				}
+		}
+
+	return result_s;
+}
+
+
+/*
+ * STATIC DEFINITIONS
+ */
+
+static const NativeColumn **GetColumns (const char *custom_format_s, uint32 *num_columns_p)
+{
+	const NativeColumn **columns_pp = NULL;
+	const char *format_s = custom_format_s;
+	uint32 num_words = 0;
+	const char *c_p;
+
+	if (!format_s)
+		{
+			format_s = "std";
+		}
+
+	/* Count the words so we know the most columns that there can be */
+	c_p = format_s;
+	while (*c_p)
+		{
+			if ((!isspace (*c_p)) && ((c_p == format_s) || (isspace (* (c_p - 1)))))
+				{
+					++ num_words;
+				}
+
+			++ c_p;
+		}
+
+	if (num_words == 0)
+		{
+			format_s = "std";
+			num_words = 1;
+		}
+
+	columns_pp = (const NativeColumn **) AllocMemory (num_words * NBF_NUM_DEFAULT_COLUMNS * sizeof (const NativeColumn *));
+
+	if (columns_pp)
+		{
+			uint32 num_columns = 0;
+			bool success_flag = true;
+
+			c_p = format_s;
+
+			while (*c_p && success_flag)
+				{
+					while (isspace (*c_p))
+						{
+							++ c_p;
+						}
+
+					if (*c_p)
+						{
+							const size_t length = strcspn (c_p, " \t\r\n");
+
+							if ((length == 3) && (strncmp (c_p, "std", 3) == 0))
+								{
+									size_t i;
+
+									for (i = 0; i < NBF_NUM_DEFAULT_COLUMNS; ++ i)
+										{
+											* (columns_pp + num_columns) = S_COLUMNS + S_DEFAULT_COLUMNS [i];
+											++ num_columns;
+										}
+								}
+							else
+								{
+									const NativeColumn *column_p = NULL;
+									uint32 i;
+
+									for (i = 0; i < NCT_NUM_TYPES; ++ i)
+										{
+											if ((strlen (S_COLUMNS [i].nc_name_s) == length) && (strncmp (S_COLUMNS [i].nc_name_s, c_p, length) == 0))
+												{
+													column_p = S_COLUMNS + i;
+													i = NCT_NUM_TYPES;
+												}
+										}
+
+									if (column_p)
+										{
+											* (columns_pp + num_columns) = column_p;
+											++ num_columns;
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+
+							c_p += length;
+						}		/* if (*c_p) */
+
+				}		/* while (*c_p && success_flag) */
+
+			if (success_flag)
+				{
+					*num_columns_p = num_columns;
+				}
+			else
+				{
+					FreeMemory (columns_pp);
+					columns_pp = NULL;
+				}
+
+		}		/* if (columns_pp) */
+
+	return columns_pp;
+}
+
+
+static bool IsJSONArchive (const char *archive_s, const size_t length)
+{
+	const char * const end_s = archive_s + length;
+
+	while ((archive_s < end_s) && (isspace (*archive_s)))
+		{
+			++ archive_s;
+		}
+
+	return ((archive_s < end_s) && (*archive_s == '{'));
+}
+
+
+static bool SaveConvertedOutput (const char *input_filename_s, const uint32 output_format_code, const char *custom_format_s, const char *output_s)
+{
+	bool success_flag = false;
+	char *output_filename_s = BlastFormatter :: GetConvertedOutputFilename (input_filename_s, output_format_code, custom_format_s);
+
+	if (output_filename_s)
+		{
+			FILE *output_f = fopen (output_filename_s, "w");
+
+			if (output_f)
+				{
+					success_flag = (fputs (output_s, output_f) >= 0);
+
+					if (fclose (output_f) != 0)
+						{
+							success_flag = false;
+						}
+				}
+
+			FreeCopiedString (output_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendTabularReport (ByteBuffer *buffer_p, const json_t *report_p, const uint32 output_format_code, const NativeColumn **columns_pp, const uint32 num_columns)
+{
+	bool success_flag = true;
+	const json_t *search_p = GetSearch (report_p);
+	const json_t *hits_p = json_object_get (search_p, "hits");
+	const char * const sep_s = (output_format_code == BOF_CSV) ? "," : "\t";
+
+	if (output_format_code == BOF_TABULAR_WITH_COMMENTS)
+		{
+			const char *version_s = GetJSONString (report_p, "version");
+			const char *query_s = GetJSONString (search_p, "query_title");
+			const char *db_s = GetJSONString (json_object_get (report_p, "search_target"), "db");
+			int64 num_hsps = 0;
+			size_t i;
+
+			for (i = 0; i < json_array_size (hits_p); ++ i)
+				{
+					num_hsps += json_array_size (json_object_get (json_array_get (hits_p, i), "hsps"));
+				}
+
+			success_flag = AppendStringsToByteBuffer (buffer_p, "# ", version_s ? version_s : "BLAST", "\n# Query: ", query_s ? query_s : "", "\n", NULL);
+
+			if (success_flag && db_s)
+				{
+					success_flag = AppendStringsToByteBuffer (buffer_p, "# Database: ", db_s, "\n", NULL);
+				}
+
+			if (success_flag && (num_hsps > 0))
+				{
+					uint32 j;
+
+					success_flag = AppendStringToByteBuffer (buffer_p, "# Fields: ");
+
+					for (j = 0; (j < num_columns) && success_flag; ++ j)
+						{
+							success_flag = AppendStringsToByteBuffer (buffer_p, (j > 0) ? ", " : "", (* (columns_pp + j)) -> nc_title_s, NULL);
+						}
+
+					if (success_flag)
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+						}
+				}
+
+			if (success_flag)
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, "# ") &&
+						AppendInteger (buffer_p, num_hsps) &&
+						AppendStringToByteBuffer (buffer_p, " hits found\n");
+				}
+
+		}		/* if (output_format_code == BOF_TABULAR_WITH_COMMENTS) */
+
+	if (success_flag && hits_p)
+		{
+			const int64 query_length = GetInteger (search_p, "query_len");
+			const size_t num_hits = json_array_size (hits_p);
+			size_t i;
+			AlignmentRow row;
+
+			row.ar_search_p = search_p;
+
+			for (i = 0; (i < num_hits) && success_flag; ++ i)
+				{
+					const json_t *hsps_p;
+					size_t num_hsps;
+					size_t j;
+
+					row.ar_hit_p = json_array_get (hits_p, i);
+					row.ar_description_p = json_array_get (json_object_get (row.ar_hit_p, "description"), 0);
+					row.ar_query_coverage = GetQueryCoverage (row.ar_hit_p, query_length);
+
+					hsps_p = json_object_get (row.ar_hit_p, "hsps");
+					num_hsps = json_array_size (hsps_p);
+
+					for (j = 0; (j < num_hsps) && success_flag; ++ j)
+						{
+							uint32 k;
+
+							row.ar_hsp_p = json_array_get (hsps_p, j);
+
+							for (k = 0; (k < num_columns) && success_flag; ++ k)
+								{
+									if (k > 0)
+										{
+											success_flag = AppendStringToByteBuffer (buffer_p, sep_s);
+										}
+
+									if (success_flag)
+										{
+											success_flag = AppendColumnValue (buffer_p, * (columns_pp + k), &row);
+										}
+								}
+
+							if (success_flag)
+								{
+									success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+								}
+
+						}		/* for (j = 0; (j < num_hsps) && success_flag; ++ j) */
+
+				}		/* for (i = 0; (i < num_hits) && success_flag; ++ i) */
+
+		}		/* if (success_flag && hits_p) */
+
+	return success_flag;
+}
+
+
+static bool AppendColumnValue (ByteBuffer *buffer_p, const NativeColumn *column_p, const AlignmentRow *row_p)
+{
+	bool success_flag = false;
+	const json_t *hsp_p = row_p -> ar_hsp_p;
+	char value_s [NBF_VALUE_BUFFER_SIZE];
+
+	switch (column_p -> nc_type)
+		{
+			case NCT_QSEQID:
+			case NCT_QACCVER:
+				success_flag = AppendQueryId (buffer_p, row_p -> ar_search_p, true);
+				break;
+
+			case NCT_QACC:
+				success_flag = AppendQueryId (buffer_p, row_p -> ar_search_p, false);
+				break;
+
+			case NCT_QLEN:
+				success_flag = AppendInteger (buffer_p, GetInteger (row_p -> ar_search_p, "query_len"));
+				break;
+
+			case NCT_SSEQID:
+			case NCT_SACC:
+			case NCT_SACCVER:
+				success_flag = AppendSubjectId (buffer_p, row_p -> ar_description_p, column_p -> nc_type);
+				break;
+
+			case NCT_SALLSEQID:
+			case NCT_SALLTITLES:
+				success_flag = AppendAllDescriptions (buffer_p, row_p -> ar_hit_p, column_p -> nc_type);
+				break;
+
+			case NCT_SLEN:
+				success_flag = AppendInteger (buffer_p, GetInteger (row_p -> ar_hit_p, "len"));
+				break;
+
+			case NCT_QSTART:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "query_from"));
+				break;
+
+			case NCT_QEND:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "query_to"));
+				break;
+
+			case NCT_SSTART:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "hit_from"));
+				break;
+
+			case NCT_SEND:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "hit_to"));
+				break;
+
+			case NCT_QSEQ:
+				{
+					const char *seq_s = GetJSONString (hsp_p, "qseq");
+					success_flag = AppendStringToByteBuffer (buffer_p, seq_s ? seq_s : "");
+				}
+				break;
+
+			case NCT_SSEQ:
+				{
+					const char *seq_s = GetJSONString (hsp_p, "hseq");
+					success_flag = AppendStringToByteBuffer (buffer_p, seq_s ? seq_s : "");
+				}
+				break;
+
+			case NCT_EVALUE:
+			case NCT_BITSCORE:
+				{
+					char bit_score_s [NBF_VALUE_BUFFER_SIZE];
+					const char *score_s;
+
+					GetScoreStrings (GetNumber (hsp_p, "evalue"), GetNumber (hsp_p, "bit_score"), value_s, bit_score_s);
+					score_s = (column_p -> nc_type == NCT_EVALUE) ? value_s : bit_score_s;
+
+					/* The tabular formats don't pad the scores */
+					while (*score_s == ' ')
+						{
+							++ score_s;
+						}
+
+					success_flag = AppendStringToByteBuffer (buffer_p, score_s);
+				}
+				break;
+
+			case NCT_SCORE:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "score"));
+				break;
+
+			case NCT_LENGTH:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "align_len"));
+				break;
+
+			case NCT_PIDENT:
+			case NCT_PPOS:
+				{
+					const int64 align_length = GetInteger (hsp_p, "align_len");
+
+					/* Nucleotide searches only have the number of identities */
+					const char *key_s = ((column_p -> nc_type == NCT_PPOS) && json_object_get (hsp_p, "positive")) ? "positive" : "identity";
+					const int64 count = GetInteger (hsp_p, key_s);
+					const double percentage = (align_length > 0) ? (100.0 * count) / align_length : 0.0;
+
+					snprintf (value_s, NBF_VALUE_BUFFER_SIZE, (column_p -> nc_type == NCT_PIDENT) ? "%.3f" : "%.2f", percentage);
+					success_flag = AppendStringToByteBuffer (buffer_p, value_s);
+				}
+				break;
+
+			case NCT_NIDENT:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "identity"));
+				break;
+
+			case NCT_MISMATCH:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "align_len") - GetInteger (hsp_p, "identity") - GetInteger (hsp_p, "gaps"));
+				break;
+
+			case NCT_POSITIVE:
+				{
+					/* Nucleotide searches only have the number of identities */
+					const json_t *positive_p = json_object_get (hsp_p, "positive");
+					success_flag = AppendInteger (buffer_p, positive_p ? json_integer_value (positive_p) : GetInteger (hsp_p, "identity"));
+				}
+				break;
+
+			case NCT_GAPOPEN:
+				success_flag = AppendInteger (buffer_p, CountGapOpenings (GetJSONString (hsp_p, "qseq")) + CountGapOpenings (GetJSONString (hsp_p, "hseq")));
+				break;
+
+			case NCT_GAPS:
+				success_flag = AppendInteger (buffer_p, GetInteger (hsp_p, "gaps"));
+				break;
+
+			case NCT_QFRAME:
+				success_flag = AppendInteger (buffer_p, GetFrame (hsp_p, "query_frame", "query_strand"));
+				break;
+
+			case NCT_SFRAME:
+				success_flag = AppendInteger (buffer_p, GetFrame (hsp_p, "hit_frame", "hit_strand"));
+				break;
+
+			case NCT_STAXID:
+				success_flag = AppendInteger (buffer_p, GetInteger (row_p -> ar_description_p, "taxid"));
+				break;
+
+			case NCT_SSCINAME:
+				{
+					const char *name_s = GetJSONString (row_p -> ar_description_p, "sciname");
+					success_flag = AppendStringToByteBuffer (buffer_p, name_s ? name_s : "N/A");
+				}
+				break;
+
+			case NCT_STITLE:
+				{
+					const char *title_s = GetJSONString (row_p -> ar_description_p, "title");
+					success_flag = AppendStringToByteBuffer (buffer_p, title_s ? title_s : "");
+				}
+				break;
+
+			case NCT_SSTRAND:
+				{
+					const char *strand_s = GetJSONString (hsp_p, "hit_strand");
+
+					if (strand_s)
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, (Stricmp (strand_s, "Minus") == 0) ? "minus" : "plus");
+						}
+					else
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, "N/A");
+						}
+				}
+				break;
+
+			case NCT_QCOVS:
+				success_flag = AppendInteger (buffer_p, row_p -> ar_query_coverage);
+				break;
+
+			case NCT_QCOVHSP:
+				{
+					const int64 from = GetInteger (hsp_p, "query_from");
+					const int64 to = GetInteger (hsp_p, "query_to");
+					const int64 length = ((to >= from) ? (to - from) : (from - to)) + 1;
+
+					success_flag = AppendInteger (buffer_p, GetPercentage (length, GetInteger (row_p -> ar_search_p, "query_len")));
+				}
+				break;
+
+			default:
+				break;
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendPairwiseReport (ByteBuffer *buffer_p, const json_t *report_p)
+{
+	const json_t *search_p = GetSearch (report_p);
+	const json_t *hits_p = json_object_get (search_p, "hits");
+	const size_t num_hits = json_array_size (hits_p);
+	const char *version_s = GetJSONString (report_p, "version");
+	const char *program_s = GetJSONString (report_p, "program");
+	const char *db_s = GetJSONString (json_object_get (report_p, "search_target"), "db");
+	const char *query_s = GetJSONString (search_p, "query_title");
+	bool success_flag = AppendStringsToByteBuffer (buffer_p, version_s ? version_s : "BLAST", "\n\n\n", NULL);
+
+	if (success_flag && db_s)
+		{
+			success_flag = AppendStringsToByteBuffer (buffer_p, "Database: ", db_s, "\n\n", NULL);
+		}
+
+	if (success_flag)
+		{
+			success_flag = AppendStringsToByteBuffer (buffer_p, "Query= ", query_s ? query_s : "", "\n\nLength=", NULL) &&
+				AppendInteger (buffer_p, GetInteger (search_p, "query_len")) &&
+				AppendStringToByteBuffer (buffer_p, "\n\n\n");
+		}
+
+	if (success_flag)
+		{
+			if (num_hits > 0)
+				{
+					size_t i;
+					char title_s [NBF_SUMMARY_TITLE_WIDTH + 1];
+
+					snprintf (title_s, NBF_SUMMARY_TITLE_WIDTH + 1, "%-*s", NBF_SUMMARY_TITLE_WIDTH, "Sequences producing significant alignments:");
+					success_flag = AppendStringsToByteBuffer (buffer_p, title_s, "   Score     E\n", NULL);
+
+					if (success_flag)
+						{
+							snprintf (title_s, NBF_SUMMARY_TITLE_WIDTH + 1, "%-*s", NBF_SUMMARY_TITLE_WIDTH, "");
+							success_flag = AppendStringsToByteBuffer (buffer_p, title_s, "  (Bits)  Value\n\n", NULL);
+						}
+
+					/* The summary line for each hit, using the scores of its best hsp */
+					for (i = 0; (i < num_hits) && success_flag; ++ i)
+						{
+							const json_t *hit_p = json_array_get (hits_p, i);
+							const json_t *description_p = json_array_get (json_object_get (hit_p, "description"), 0);
+							const json_t *hsp_p = json_array_get (json_object_get (hit_p, "hsps"), 0);
+							const char *hit_title_s = GetJSONString (description_p, "title");
+							char evalue_s [NBF_VALUE_BUFFER_SIZE];
+							char bit_score_s [NBF_VALUE_BUFFER_SIZE];
+							char line_s [NBF_SUMMARY_TITLE_WIDTH + (2 * NBF_VALUE_BUFFER_SIZE) + 8];
+
+							GetScoreStrings (GetNumber (hsp_p, "evalue"), GetNumber (hsp_p, "bit_score"), evalue_s, bit_score_s);
+							snprintf (line_s, sizeof (line_s), "%-*.*s  %6s  %6s\n", NBF_SUMMARY_TITLE_WIDTH, NBF_SUMMARY_TITLE_WIDTH, hit_title_s ? hit_title_s : "", bit_score_s, evalue_s);
+
+							success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+						}
+
+					if (success_flag)
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, "\n\n");
+						}
+
+					for (i = 0; (i < num_hits) && success_flag; ++ i)
+						{
+							const json_t *hit_p = json_array_get (hits_p, i);
+							const json_t *description_p = json_array_get (json_object_get (hit_p, "description"), 0);
+							const json_t *hsps_p = json_object_get (hit_p, "hsps");
+							const size_t num_hsps = json_array_size (hsps_p);
+							const char *hit_title_s = GetJSONString (description_p, "title");
+							size_t j;
+
+							success_flag = AppendStringsToByteBuffer (buffer_p, "> ", hit_title_s ? hit_title_s : "", "\nLength=", NULL) &&
+								AppendInteger (buffer_p, GetInteger (hit_p, "len")) &&
+								AppendStringToByteBuffer (buffer_p, "\n\n");
+
+							for (j = 0; (j < num_hsps) && success_flag; ++ j)
+								{
+									success_flag = AppendPairwiseHsp (buffer_p, json_array_get (hsps_p, j), program_s);
+								}
+						}
+
+				}		/* if (num_hits > 0) */
+			else
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, "\n***** No hits found *****\n\n\n");
+				}
+
+		}		/* if (success_flag) */
+
+	return success_flag;
+}
+
+
+static bool AppendPairwiseHsp (ByteBuffer *buffer_p, const json_t *hsp_p, const char *program_s)
+{
+	bool success_flag = false;
+	const char *qseq_s = GetJSONString (hsp_p, "qseq");
+	const char *hseq_s = GetJSONString (hsp_p, "hseq");
+	const char *midline_s = GetJSONString (hsp_p, "midline");
+	const int64 align_length = GetInteger (hsp_p, "align_len");
+	const int64 identities = GetInteger (hsp_p, "identity");
+	const int64 gaps = GetInteger (hsp_p, "gaps");
+	const json_t *positive_p = json_object_get (hsp_p, "positive");
+	char evalue_s [NBF_VALUE_BUFFER_SIZE];
+	char bit_score_s [NBF_VALUE_BUFFER_SIZE];
+	char line_s [256];
+
+	GetScoreStrings (GetNumber (hsp_p, "evalue"), GetNumber (hsp_p, "bit_score"), evalue_s, bit_score_s);
+
+	snprintf (line_s, sizeof (line_s), " Score = %s bits (" INT64_FMT "),  Expect = %s\n", bit_score_s, GetInteger (hsp_p, "score"), evalue_s);
+
+	if (AppendStringToByteBuffer (buffer_p, line_s))
+		{
+			snprintf (line_s, sizeof (line_s), " Identities = " INT64_FMT "/" INT64_FMT " (" UINT32_FMT "%%),", identities, align_length, GetPercentage (identities, align_length));
+
+			if (AppendStringToByteBuffer (buffer_p, line_s))
+				{
+					success_flag = true;
+
+					if (positive_p)
+						{
+							const int64 positives = json_integer_value (positive_p);
+
+							snprintf (line_s, sizeof (line_s), " Positives = " INT64_FMT "/" INT64_FMT " (" UINT32_FMT "%%),", positives, align_length, GetPercentage (positives, align_length));
+							success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+						}
+
+					if (success_flag)
+						{
+							snprintf (line_s, sizeof (line_s), " Gaps = " INT64_FMT "/" INT64_FMT " (" UINT32_FMT "%%)\n", gaps, align_length, GetPercentage (gaps, align_length));
+							success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+						}
+				}
+		}
+
+	if (success_flag)
+		{
+			const char *query_strand_s = GetJSONString (hsp_p, "query_strand");
+			const char *hit_strand_s = GetJSONString (hsp_p, "hit_strand");
+			const json_t *query_frame_p = json_object_get (hsp_p, "query_frame");
+			const json_t *hit_frame_p = json_object_get (hsp_p, "hit_frame");
+
+			if (query_frame_p || hit_frame_p)
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, " Frame = ");
+
+					if (success_flag && query_frame_p)
+						{
+							snprintf (line_s, sizeof (line_s), "%+d", (int) json_integer_value (query_frame_p));
+							success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+						}
+
+					if (success_flag && hit_frame_p)
+						{
+							snprintf (line_s, sizeof (line_s), "%s%+d", query_frame_p ? "/" : "", (int) json_integer_value (hit_frame_p));
+							success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+						}
+
+					if (success_flag)
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+						}
+				}
+			else if (query_strand_s && hit_strand_s)
+				{
+					success_flag = AppendStringsToByteBuffer (buffer_p, " Strand=", query_strand_s, "/", hit_strand_s, "\n", NULL);
+				}
+
+			if (success_flag)
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+				}
+		}
+
+	if (success_flag && qseq_s && hseq_s)
+		{
+			/* The translated sequences cover 3 bases for each residue */
+			const int64 query_factor = (program_s && ((strcmp (program_s, "blastx") == 0) || (strcmp (program_s, "tblastx") == 0))) ? 3 : 1;
+			const int64 hit_factor = (program_s && ((strcmp (program_s, "tblastn") == 0) || (strcmp (program_s, "tblastx") == 0))) ? 3 : 1;
+			int64 query_position = GetInteger (hsp_p, "query_from");
+			int64 hit_position = GetInteger (hsp_p, "hit_from");
+			const int64 query_direction = (GetInteger (hsp_p, "query_to") >= query_position) ? 1 : -1;
+			const int64 hit_direction = (GetInteger (hsp_p, "hit_to") >= hit_position) ? 1 : -1;
+			const size_t length = strlen (qseq_s);
+			int64 max_position = GetInteger (hsp_p, "query_to");
+			int width = 1;
+			size_t offset;
+
+			if (query_position > max_position)
+				{
+					max_position = query_position;
+				}
+
+			if (GetInteger (hsp_p, "hit_to") > max_position)
+				{
+					max_position = GetInteger (hsp_p, "hit_to");
+				}
+
+			if (hit_position > max_position)
+				{
+					max_position = hit_position;
+				}
+
+			while (max_position >= 10)
+				{
+					max_position /= 10;
+					++ width;
+				}
+
+			for (offset = 0; (offset < length) && success_flag; offset += NBF_ALIGNMENT_LINE_LENGTH)
+				{
+					const size_t line_length = ((length - offset) > NBF_ALIGNMENT_LINE_LENGTH) ? NBF_ALIGNMENT_LINE_LENGTH : (length - offset);
+
+					success_flag = AppendAlignmentLine (buffer_p, "Query", qseq_s, offset, line_length, &query_position, query_direction, query_factor, width);
+
+					if (success_flag)
+						{
+							snprintf (line_s, sizeof (line_s), "%-5s  %-*s  ", "", width, "");
+							success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+
+							if (success_flag && midline_s && (strlen (midline_s) >= offset + line_length))
+								{
+									success_flag = AppendToByteBuffer (buffer_p, midline_s + offset, line_length);
+								}
+
+							if (success_flag)
+								{
+									success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+								}
+						}
+
+					if (success_flag)
+						{
+							success_flag = AppendAlignmentLine (buffer_p, "Sbjct", hseq_s, offset, line_length, &hit_position, hit_direction, hit_factor, width) &&
+								AppendStringToByteBuffer (buffer_p, "\n");
+						}
+
+				}		/* for (offset = 0; (offset < length) && success_flag; offset += NBF_ALIGNMENT_LINE_LENGTH) */
+
+			if (success_flag)
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, "\n");
+				}
+
+		}		/* if (success_flag && qseq_s && hseq_s) */
+
+	return success_flag;
+}
+
+
+static bool AppendAlignmentLine (ByteBuffer *buffer_p, const char *label_s, const char *seq_s, const size_t offset, const size_t length, int64 *position_p, const int64 direction, const int64 factor, const int width)
+{
+	bool success_flag = false;
+	const size_t seq_length = strlen (seq_s);
+	int64 num_residues = 0;
+	int64 start;
+	int64 end;
+	size_t i;
+	char start_s [NBF_VALUE_BUFFER_SIZE];
+	char line_s [2 * NBF_VALUE_BUFFER_SIZE];
+
+	if (seq_length < offset + length)
+		{
+			return false;
+		}
+
+	for (i = offset; i < offset + length; ++ i)
+		{
+			if (* (seq_s + i) != '-')
+				{
+					++ num_residues;
+				}
+		}
+
+	if (num_residues > 0)
+		{
+			start = *position_p;
+			end = start + direction * ((num_residues * factor) - 1);
+			*position_p = end + direction;
+		}
+	else
+		{
+			/* A line of just gaps shows where the last one finished */
+			start = end = *position_p - direction;
+		}
+
+	snprintf (start_s, sizeof (start_s), INT64_FMT, start);
+	snprintf (line_s, sizeof (line_s), "%-5s  %-*s  ", label_s, width, start_s);
+
+	if (AppendStringToByteBuffer (buffer_p, line_s))
+		{
+			if (AppendToByteBuffer (buffer_p, seq_s + offset, length))
+				{
+					snprintf (line_s, sizeof (line_s), "  " INT64_FMT "\n", end);
+					success_flag = AppendStringToByteBuffer (buffer_p, line_s);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendFirstWord (ByteBuffer *buffer_p, const char *value_s)
+{
+	return AppendToByteBuffer (buffer_p, value_s, strcspn (value_s, " \t"));
+}
+
+
+static bool AppendQueryId (ByteBuffer *buffer_p, const json_t *search_p, const bool version_flag)
+{
+	bool success_flag = false;
+	const char *title_s = GetJSONString (search_p, "query_title");
+
+	/*
+	 * Unless the ids of the queries have been parsed, Blast gives them ids
+	 * such as "Query_1" and the tabular formats use the start of the title
+	 */
+	if (title_s)
+		{
+			size_t length = strcspn (title_s, " \t");
+
+			if (!version_flag)
+				{
+					const char *dot_p = (const char *) memchr (title_s, '.', length);
+
+					if (dot_p)
+						{
+							const char *c_p = dot_p + 1;
+
+							while ((c_p < title_s + length) && isdigit (*c_p))
+								{
+									++ c_p;
+								}
+
+							if ((c_p == title_s + length) && (c_p > dot_p + 1))
+								{
+									length = dot_p - title_s;
+								}
+						}
+				}
+
+			success_flag = AppendToByteBuffer (buffer_p, title_s, length);
+		}
+	else
+		{
+			const char *id_s = GetJSONString (search_p, "query_id");
+
+			success_flag = AppendStringToByteBuffer (buffer_p, id_s ? id_s : "");
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendSubjectId (ByteBuffer *buffer_p, const json_t *description_p, const NativeColumnType type)
+{
+	bool success_flag = false;
+	const char *id_s = GetJSONString (description_p, "id");
+	const char *accession_s = GetJSONString (description_p, "accession");
+
+	if ((!id_s) || (strncmp (id_s, S_LOCAL_ID_PREFIX_S, strlen (S_LOCAL_ID_PREFIX_S)) == 0))
+		{
+			/* The database was made without -parse_seqids so use the start of the title */
+			const char *title_s = GetJSONString (description_p, "title");
+
+			success_flag = AppendFirstWord (buffer_p, title_s ? title_s : "");
+		}
+	else if ((type == NCT_SSEQID) || (!accession_s))
+		{
+			success_flag = AppendStringToByteBuffer (buffer_p, id_s);
+		}
+	else if (type == NCT_SACC)
+		{
+			success_flag = AppendStringToByteBuffer (buffer_p, accession_s);
+		}
+	else
+		{
+			/* The versioned accession is in the id, e.g. "ref|XM_001.2|" */
+			const char *accession_p = strstr (id_s, accession_s);
+
+			if (accession_p && (* (accession_p + strlen (accession_s)) == '.'))
+				{
+					success_flag = AppendToByteBuffer (buffer_p, accession_p, strcspn (accession_p, "|"));
+				}
+			else
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, accession_s);
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendAllDescriptions (ByteBuffer *buffer_p, const json_t *hit_p, const NativeColumnType type)
+{
+	bool success_flag = true;
+	const json_t *descriptions_p = json_object_get (hit_p, "description");
+	const size_t num_descriptions = json_array_size (descriptions_p);
+	const char * const sep_s = (type == NCT_SALLSEQID) ? ";" : "<>";
+	size_t i;
+
+	for (i = 0; (i < num_descriptions) && success_flag; ++ i)
+		{
+			const json_t *description_p = json_array_get (descriptions_p, i);
+
+			if (i > 0)
+				{
+					success_flag = AppendStringToByteBuffer (buffer_p, sep_s);
+				}
+
+			if (success_flag)
+				{
+					if (type == NCT_SALLSEQID)
+						{
+							success_flag = AppendSubjectId (buffer_p, description_p, NCT_SSEQID);
+						}
+					else
+						{
+							const char *title_s = GetJSONString (description_p, "title");
+							success_flag = AppendStringToByteBuffer (buffer_p, title_s ? title_s : "");
+						}
+				}
+		}
+
+	return success_flag;
+}
+
+
+static bool AppendInteger (ByteBuffer *buffer_p, const int64 value)
+{
+	char value_s [NBF_VALUE_BUFFER_SIZE];
+
+	snprintf (value_s, NBF_VALUE_BUFFER_SIZE, INT64_FMT, value);
+
+	return AppendStringToByteBuffer (buffer_p, value_s);
+}
+
+
+/*
+ * Print the scores in the same way as Blast does
+ */
+static void GetScoreStrings (const double evalue, const double bit_score, char *evalue_s, char *bit_score_s)
+{
+	if (evalue < 1.0e-180)
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "0.0");
+		}
+	else if (evalue < 1.0e-99)
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "%2.0le", evalue);
+		}
+	else if (evalue < 0.0009)
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "%3.0le", evalue);
+		}
+	else if (evalue < 0.1)
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "%4.3lf", evalue);
+		}
+	else if (evalue < 1.0)
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "%3.2lf", evalue);
+		}
+	else if (evalue < 10.0)
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "%2.1lf", evalue);
+		}
+	else
+		{
+			snprintf (evalue_s, NBF_VALUE_BUFFER_SIZE, "%5.0lf", evalue);
+		}
+
+	if (bit_score > 9999)
+		{
+			snprintf (bit_score_s, NBF_VALUE_BUFFER_SIZE, "%4.3le", bit_score);
+		}
+	else if (bit_score > 99.9)
+		{
+			snprintf (bit_score_s, NBF_VALUE_BUFFER_SIZE, "%3.0ld", (long) bit_score);
+		}
+	else
+		{
+			snprintf (bit_score_s, NBF_VALUE_BUFFER_SIZE, "%2.1lf", bit_score);
+		}
+}
+
+
+static const json_t *GetSearch (const json_t *report_p)
+{
+	return json_object_get (json_object_get (report_p, "results"), "search");
+}
+
+
+static int64 GetInteger (const json_t *json_p, const char * const key_s)
+{
+	return (int64) json_number_value (json_object_get (json_p, key_s));
+}
+
+
+static double GetNumber (const json_t *json_p, const char * const key_s)
+{
+	return json_number_value (json_object_get (json_p, key_s));
+}
+
+
+static int64 GetFrame (const json_t *hsp_p, const char * const frame_key_s, const char * const strand_key_s)
+{
+	int64 frame = 1;
+	const json_t *frame_p = json_object_get (hsp_p, frame_key_s);
+
+	if (frame_p)
+		{
+			frame = json_integer_value (frame_p);
+		}
+	else
+		{
+			const char *strand_s = GetJSONString (hsp_p, strand_key_s);
+
+			if (!strand_s)
+				{
+					/* A protein sequence */
+					frame = 0;
+				}
+			else if (Stricmp (strand_s, "Minus") == 0)
+				{
+					frame = -1;
+				}
+		}
+
+	return frame;
+}
+
+
+static uint32 CountGapOpenings (const char *seq_s)
+{
+	uint32 count = 0;
+
+	if (seq_s)
+		{
+			char prev_c = '\0';
+
+			while (*seq_s)
+				{
+					if ((*seq_s == '-') && (prev_c != '-'))
+						{
+							++ count;
+						}
+
+					prev_c = *seq_s;
+					++ seq_s;
+				}
+		}
+
+	return count;
+}
+
+
+/*
+ * Get the percentage of the query that is covered
+ * by the union of all of a hit's hsps
+ */
+static uint32 GetQueryCoverage (const json_t *hit_p, const int64 query_length)
+{
+	uint32 coverage = 0;
+	const json_t *hsps_p = json_object_get (hit_p, "hsps");
+	const size_t num_hsps = json_array_size (hsps_p);
+
+	if ((num_hsps > 0) && (query_length > 0))
+		{
+			int64 *ranges_p = (int64 *) AllocMemory (2 * num_hsps * sizeof (int64));
+
+			if (ranges_p)
+				{
+					int64 covered = 0;
+					int64 end = 0;
+					size_t i;
+
+					/* Add each range in order of its start */
+					for (i = 0; i < num_hsps; ++ i)
+						{
+							const json_t *hsp_p = json_array_get (hsps_p, i);
+							int64 from = GetInteger (hsp_p, "query_from");
+							int64 to = GetInteger (hsp_p, "query_to");
+							size_t j = i;
+
+							if (from > to)
+								{
+									const int64 temp = from;
+
+									from = to;
+									to = temp;
+								}
+
+							while ((j > 0) && (* (ranges_p + (2 * (j - 1))) > from))
+								{
+									* (ranges_p + (2 * j)) = * (ranges_p + (2 * (j - 1)));
+									* (ranges_p + (2 * j) + 1) = * (ranges_p + (2 * (j - 1)) + 1);
+									-- j;
+								}
+
+							* (ranges_p + (2 * j)) = from;
+							* (ranges_p + (2 * j) + 1) = to;
+						}
+
+					for (i = 0; i < num_hsps; ++ i)
+						{
+							int64 from = * (ranges_p + (2 * i));
+							const int64 to = * (ranges_p + (2 * i) + 1);
+
+							if (from <= end)
+								{
+									from = end + 1;
+								}
+
+							if (to >= from)
+								{
+									covered += to - from + 1;
+									end = to;
+								}
+						}
+
+					coverage = GetPercentage (covered, query_length);
+
+					FreeMemory (ranges_p);
+				}		/* if (ranges_p) */
+
+		}		/* if ((num_hsps > 0) && (query_length > 0)) */
+
+	return coverage;
+}
+
+
+static uint32 GetPercentage (const int64 value, const int64 total)
+{
+	return (total > 0) ? (uint32) (((100.0 * value) / total) + 0.5) : 0;
+}
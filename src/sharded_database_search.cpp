@@ -0,0 +1,585 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * sharded_database_search.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sharded_database_search.hpp"
+
+#include "blast_util.h"
+#include "json_util.h"
+#include "math_utils.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define SHARDED_DATABASE_SEARCH_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define SHARDED_DATABASE_SEARCH_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * One of the volumes of a ShardedDatabaseSearch. The volume name
+ * belongs to the service's configuration, which outlives the search.
+ */
+typedef struct DatabaseShard
+{
+	const char *ds_volume_s;
+
+	char *ds_output_filename_s;
+
+	/* The ordinal id within the whole database of this shard's first sequence */
+	uint32 ds_first_oid;
+
+	uint32 ds_num_sequences;
+
+	uint64 ds_length;
+
+	/* The single-file JSON output of this shard's search */
+	json_t *ds_output_p;
+
+	/* The hits array of the report currently being merged */
+	json_t *ds_hits_p;
+
+	/* The index of the first hit in ds_hits_p that hasn't been merged yet */
+	size_t ds_next_hit;
+} DatabaseShard;
+
+
+static void GetHitScores (const json_t *hit_p, double *evalue_p, double *bit_score_p);
+
+static void FreeAndRemoveFile (char *filename_s);
+
+
+
+const char * const ShardedDatabaseSearch :: SDS_ORDINAL_ID_PREFIX_S = "gnl|BL_ORD_ID|";
+
+
+ShardedDatabaseSearch *ShardedDatabaseSearch :: Create (const DatabaseInfo *db_p, const char *output_filename_s)
+{
+	ShardedDatabaseSearch *search_p = 0;
+
+	try
+		{
+			search_p = new ShardedDatabaseSearch (db_p, output_filename_s);
+		}
+	catch (std :: bad_alloc &alloc_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create ShardedDatabaseSearch for \"%s\"", db_p -> di_filename_s);
+		}
+
+	if (search_p)
+		{
+			if (!search_p -> ReadStatistics ())
+				{
+					delete search_p;
+					search_p = 0;
+				}
+		}
+
+	return search_p;
+}
+
+
+ShardedDatabaseSearch :: ShardedDatabaseSearch (const DatabaseInfo *db_p, const char *output_filename_s)
+	: sds_db_filename_s (db_p -> di_filename_s),
+		sds_output_filename_s (output_filename_s),
+		sds_num_shards (0),
+		sds_num_sequences (0),
+		sds_total_length (0),
+		sds_database_size (0)
+{
+	const size_t num_shards = json_array_size (db_p -> di_shards_p);
+
+	sds_shards_p = (DatabaseShard *) AllocMemoryArray (num_shards, sizeof (DatabaseShard));
+
+	if (sds_shards_p)
+		{
+			DatabaseShard *shard_p = sds_shards_p;
+			bool success_flag = true;
+
+			while ((sds_num_shards < num_shards) && success_flag)
+				{
+					char index_s [16];
+
+					sprintf (index_s, UINT32_FMT, sds_num_shards);
+
+					shard_p -> ds_volume_s = json_string_value (json_array_get (db_p -> di_shards_p, sds_num_shards));
+					shard_p -> ds_output_filename_s = ConcatenateVarargsStrings (output_filename_s, ".shard.", index_s, NULL);
+					shard_p -> ds_first_oid = 0;
+					shard_p -> ds_num_sequences = 0;
+					shard_p -> ds_length = 0;
+					shard_p -> ds_output_p = NULL;
+					shard_p -> ds_hits_p = NULL;
+					shard_p -> ds_next_hit = 0;
+
+					if (shard_p -> ds_output_filename_s)
+						{
+							++ sds_num_shards;
+							++ shard_p;
+						}
+					else
+						{
+							success_flag = false;
+						}
+				}
+
+			if (!success_flag)
+				{
+					for (shard_p = sds_shards_p; sds_num_shards > 0; -- sds_num_shards, ++ shard_p)
+						{
+							FreeCopiedString (shard_p -> ds_output_filename_s);
+						}
+
+					FreeMemory (sds_shards_p);
+					throw std :: bad_alloc ();
+				}
+		}
+	else
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+ShardedDatabaseSearch :: ~ShardedDatabaseSearch ()
+{
+	uint32 i;
+	DatabaseShard *shard_p = sds_shards_p;
+
+	for (i = 0; i < sds_num_shards; ++ i, ++ shard_p)
+		{
+			if (shard_p -> ds_output_p)
+				{
+					json_decref (shard_p -> ds_output_p);
+				}
+
+			FreeAndRemoveFile (shard_p -> ds_output_filename_s);
+		}
+
+	FreeMemory (sds_shards_p);
+}
+
+
+uint32 ShardedDatabaseSearch :: GetNumShards () const
+{
+	return sds_num_shards;
+}
+
+
+const char *ShardedDatabaseSearch :: GetShardName (uint32 index) const
+{
+	return (sds_shards_p + index) -> ds_volume_s;
+}
+
+
+const char *ShardedDatabaseSearch :: GetShardOutputFilename (uint32 index) const
+{
+	return (sds_shards_p + index) -> ds_output_filename_s;
+}
+
+
+uint64 ShardedDatabaseSearch :: GetDatabaseSize () const
+{
+	return sds_database_size;
+}
+
+
+uint64 ShardedDatabaseSearch :: GetTotalLength () const
+{
+	return sds_total_length;
+}
+
+
+/*
+ * We need the number of residues in the whole database for "-dbsize" and
+ * the number of sequences in each shard to map their ordinal ids back
+ * onto the whole database.
+ */
+bool ShardedDatabaseSearch :: ReadStatistics ()
+{
+	bool success_flag = true;
+	uint32 i;
+	DatabaseShard *shard_p = sds_shards_p;
+
+	for (i = 0; (i < sds_num_shards) && success_flag; ++ i, ++ shard_p)
+		{
+			if (GetBlastDatabaseStatistics (shard_p -> ds_volume_s, & (shard_p -> ds_num_sequences), & (shard_p -> ds_length)))
+				{
+					shard_p -> ds_first_oid = sds_num_sequences;
+
+					sds_num_sequences += shard_p -> ds_num_sequences;
+					sds_total_length += shard_p -> ds_length;
+					sds_database_size += GetBlastDatabaseSize (shard_p -> ds_volume_s);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to read the index of shard \"%s\" so \"%s\" will be searched as a whole", shard_p -> ds_volume_s, sds_db_filename_s);
+					success_flag = false;
+				}
+		}
+
+	#if SHARDED_DATABASE_SEARCH_DEBUG >= STM_LEVEL_FINE
+	if (success_flag)
+		{
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "\"%s\" has " UINT32_FMT " shards with " UINT32_FMT " sequences and " UINT64_FMT " residues", sds_db_filename_s, sds_num_shards, sds_num_sequences, sds_total_length);
+		}
+	#endif
+
+	return success_flag;
+}
+
+
+/*
+ * The first shard's output is used as the base for the merged results
+ * since each of the shards has the same query and search parameters.
+ */
+bool ShardedDatabaseSearch :: Merge (uint32 max_target_seqs)
+{
+	bool success_flag = false;
+
+	if (LoadShardOutputs ())
+		{
+			json_t *reports_p = json_object_get (sds_shards_p -> ds_output_p, "BlastOutput2");
+			size_t i;
+			json_t *entry_p;
+
+			success_flag = true;
+
+			json_array_foreach (reports_p, i, entry_p)
+				{
+					if (success_flag)
+						{
+							success_flag = MergeReport (entry_p, i, max_target_seqs);
+						}
+				}
+
+			if (success_flag)
+				{
+					if (json_dump_file (sds_shards_p -> ds_output_p, sds_output_filename_s, JSON_INDENT (2)) != 0)
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to write merged results to \"%s\"", sds_output_filename_s);
+							success_flag = false;
+						}
+				}
+
+		}		/* if (LoadShardOutputs ()) */
+
+	return success_flag;
+}
+
+
+bool ShardedDatabaseSearch :: LoadShardOutputs ()
+{
+	bool success_flag = true;
+	uint32 i;
+	DatabaseShard *shard_p = sds_shards_p;
+	size_t num_reports = 0;
+
+	for (i = 0; (i < sds_num_shards) && success_flag; ++ i, ++ shard_p)
+		{
+			json_error_t err;
+
+			shard_p -> ds_output_p = json_load_file (shard_p -> ds_output_filename_s, 0, &err);
+
+			if (shard_p -> ds_output_p)
+				{
+					const json_t *reports_p = json_object_get (shard_p -> ds_output_p, "BlastOutput2");
+
+					if (reports_p && json_is_array (reports_p))
+						{
+							if (i == 0)
+								{
+									num_reports = json_array_size (reports_p);
+								}
+							else if (json_array_size (reports_p) != num_reports)
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Shard output \"%s\" has " SIZET_FMT " results instead of " SIZET_FMT, shard_p -> ds_output_filename_s, json_array_size (reports_p), num_reports);
+									success_flag = false;
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Shard output \"%s\" has no BlastOutput2 array", shard_p -> ds_output_filename_s);
+							success_flag = false;
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to load shard output \"%s\", error at line %d: %s", shard_p -> ds_output_filename_s, err.line, err.text);
+					success_flag = false;
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Each shard was searched with the size of the whole database, so their
+ * expect values can be compared directly. Each shard's hits are already
+ * in order and each of them kept up to max_target_seqs hits, so a k-way
+ * merge of them gives the same best hits as a search of the whole database.
+ */
+bool ShardedDatabaseSearch :: MergeReport (json_t *entry_p, const size_t index, const uint32 max_target_seqs)
+{
+	bool success_flag = false;
+	json_t *search_p = GetCompoundJSONObject (entry_p, "report.results.search");
+	json_t *target_p = GetCompoundJSONObject (entry_p, "report.search_target");
+
+	if (search_p && target_p)
+		{
+			json_t *merged_hits_p = json_array ();
+
+			if (merged_hits_p)
+				{
+					uint32 i;
+					DatabaseShard *shard_p = sds_shards_p;
+					bool loop_flag = true;
+
+					for (i = 0; i < sds_num_shards; ++ i, ++ shard_p)
+						{
+							shard_p -> ds_hits_p = GetShardHits (json_object_get (shard_p -> ds_output_p, "BlastOutput2"), index);
+							shard_p -> ds_next_hit = 0;
+						}
+
+					success_flag = true;
+
+					while (loop_flag && success_flag && ((max_target_seqs == 0) || (json_array_size (merged_hits_p) < max_target_seqs)))
+						{
+							DatabaseShard *best_shard_p = NULL;
+							json_t *best_hit_p = NULL;
+
+							for (i = 0, shard_p = sds_shards_p; i < sds_num_shards; ++ i, ++ shard_p)
+								{
+									json_t *hit_p = json_array_get (shard_p -> ds_hits_p, shard_p -> ds_next_hit);
+
+									if (hit_p && ((!best_hit_p) || IsBetterHit (hit_p, best_hit_p)))
+										{
+											best_hit_p = hit_p;
+											best_shard_p = shard_p;
+										}
+								}
+
+							if (best_hit_p)
+								{
+									++ (best_shard_p -> ds_next_hit);
+
+									if ((json_object_set_new (best_hit_p, "num", json_integer (json_array_size (merged_hits_p) + 1)) == 0) && OffsetOrdinalIds (best_hit_p, best_shard_p -> ds_first_oid))
+										{
+											success_flag = (json_array_append (merged_hits_p, best_hit_p) == 0);
+										}
+									else
+										{
+											success_flag = false;
+										}
+								}
+							else
+								{
+									loop_flag = false;
+								}
+
+						}		/* while (loop_flag && success_flag ... */
+
+					if (success_flag)
+						{
+							/* This takes ownership of merged_hits_p even if it fails */
+							success_flag = (json_object_set_new (search_p, "hits", merged_hits_p) == 0);
+						}
+					else
+						{
+							json_decref (merged_hits_p);
+						}
+
+					if (success_flag)
+						{
+							json_t *stat_p = json_object_get (search_p, "stat");
+
+							success_flag = (json_object_set_new (target_p, "db", json_string (sds_db_filename_s)) == 0);
+
+							if (stat_p)
+								{
+									json_object_set_new (stat_p, "db_num", json_integer (sds_num_sequences));
+									json_object_set_new (stat_p, "db_len", json_integer ((json_int_t) sds_total_length));
+								}
+
+							/* The first shard might not have had any hits of its own */
+							if (json_array_size (json_object_get (search_p, "hits")) > 0)
+								{
+									json_object_del (search_p, "message");
+								}
+						}
+
+				}		/* if (merged_hits_p) */
+
+		}		/* if (search_p && target_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Shard output \"%s\" has a report without any search results", sds_shards_p -> ds_output_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+json_t *ShardedDatabaseSearch :: GetShardHits (const json_t *reports_p, const size_t index)
+{
+	json_t *hits_p = NULL;
+	const json_t *search_p = GetCompoundJSONObject (json_array_get (reports_p, index), "report.results.search");
+
+	if (search_p)
+		{
+			hits_p = json_object_get (search_p, "hits");
+
+			if (hits_p && !json_is_array (hits_p))
+				{
+					hits_p = NULL;
+				}
+		}
+
+	return hits_p;
+}
+
+
+bool ShardedDatabaseSearch :: IsBetterHit (const json_t *hit_p, const json_t *other_hit_p)
+{
+	double evalue;
+	double bit_score;
+	double other_evalue;
+	double other_bit_score;
+
+	GetHitScores (hit_p, &evalue, &bit_score);
+	GetHitScores (other_hit_p, &other_evalue, &other_bit_score);
+
+	return ((evalue < other_evalue) || ((evalue == other_evalue) && (bit_score > other_bit_score)));
+}
+
+
+/*
+ * Blast numbers the sequences of databases built without parsed sequence
+ * ids from 0 within each volume, so move them to their place within the
+ * whole database. It uses the same number as the accession too.
+ */
+bool ShardedDatabaseSearch :: OffsetOrdinalIds (json_t *hit_p, const uint32 offset)
+{
+	bool success_flag = true;
+
+	if (offset > 0)
+		{
+			json_t *descriptions_p = json_object_get (hit_p, "description");
+
+			if (descriptions_p && json_is_array (descriptions_p))
+				{
+					const size_t prefix_length = strlen (SDS_ORDINAL_ID_PREFIX_S);
+					size_t i;
+					json_t *description_p;
+
+					json_array_foreach (descriptions_p, i, description_p)
+						{
+							const char *id_s = GetJSONString (description_p, "id");
+
+							if (success_flag && id_s && (strncmp (id_s, SDS_ORDINAL_ID_PREFIX_S, prefix_length) == 0))
+								{
+									const char *accession_s = GetJSONString (description_p, "accession");
+									const bool accession_flag = (accession_s && (strcmp (accession_s, id_s + prefix_length) == 0));
+									char *oid_s = ConvertUnsignedIntegerToString (((uint32) strtoul (id_s + prefix_length, NULL, 10)) + offset);
+
+									success_flag = false;
+
+									if (oid_s)
+										{
+											char *new_id_s = ConcatenateStrings (SDS_ORDINAL_ID_PREFIX_S, oid_s);
+
+											if (new_id_s)
+												{
+													if (json_object_set_new (description_p, "id", json_string (new_id_s)) == 0)
+														{
+															success_flag = true;
+
+															if (accession_flag)
+																{
+																	success_flag = (json_object_set_new (description_p, "accession", json_string (oid_s)) == 0);
+																}
+														}
+
+													FreeCopiedString (new_id_s);
+												}
+
+											FreeCopiedString (oid_s);
+										}
+
+								}		/* if (success_flag && id_s && ... */
+
+						}		/* json_array_foreach (descriptions_p, i, description_p) */
+
+				}		/* if (descriptions_p && json_is_array (descriptions_p)) */
+
+		}		/* if (offset > 0) */
+
+	return success_flag;
+}
+
+
+/*
+ * A hit's hsps are in order so its first one has its best scores.
+ */
+static void GetHitScores (const json_t *hit_p, double *evalue_p, double *bit_score_p)
+{
+	const json_t *hsp_p = json_array_get (json_object_get (hit_p, "hsps"), 0);
+
+	*evalue_p = HUGE_VAL;
+	*bit_score_p = 0.0;
+
+	if (hsp_p)
+		{
+			const json_t *evalue_value_p = json_object_get (hsp_p, "evalue");
+			const json_t *bit_score_value_p = json_object_get (hsp_p, "bit_score");
+
+			if (evalue_value_p && json_is_number (evalue_value_p))
+				{
+					*evalue_p = json_number_value (evalue_value_p);
+				}
+
+			if (bit_score_value_p && json_is_number (bit_score_value_p))
+				{
+					*bit_score_p = json_number_value (bit_score_value_p);
+				}
+		}
+}
+
+
+static void FreeAndRemoveFile (char *filename_s)
+{
+	if (filename_s)
+		{
+			unlink (filename_s);
+			FreeCopiedString (filename_s);
+		}
+}
@@ -0,0 +1,405 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * single_flight_converter.cpp
+ *
+ *  Created on: 24 Oct 2026
+ *      Author: billy
+ */
+
+#include <new>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "single_flight_converter.hpp"
+
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+
+
+#ifdef _DEBUG
+	#define SINGLE_FLIGHT_CONVERTER_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define SINGLE_FLIGHT_CONVERTER_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/*
+ * A conversion that is currently running along
+ * with the calls that are waiting for its result.
+ */
+typedef struct ConversionFlight
+{
+	char *cf_key_s;
+
+	/* The number of calls waiting for the result */
+	uint32 cf_num_waiters;
+
+	/* Has the conversion finished? */
+	bool cf_landed_flag;
+
+	/* The result to share with the waiting calls */
+	char *cf_result_s;
+
+	json_t *cf_result_p;
+
+	struct ConversionFlight *cf_next_p;
+} ConversionFlight;
+
+
+static void FreeConversionFlight (ConversionFlight *flight_p);
+
+
+
+SingleFlightConverter *SingleFlightConverter :: sfc_shared_converter_p = 0;
+
+uint32 SingleFlightConverter :: sfc_shared_converter_count = 0;
+
+pthread_mutex_t SingleFlightConverter :: sfc_shared_converter_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+SingleFlightConverter *SingleFlightConverter :: GetSharedSingleFlightConverter ()
+{
+	SingleFlightConverter *converter_p = 0;
+
+	pthread_mutex_lock (&sfc_shared_converter_mutex);
+
+	if (!sfc_shared_converter_p)
+		{
+			try
+				{
+					sfc_shared_converter_p = new SingleFlightConverter ();
+				}
+			catch (std :: bad_alloc &alloc_r)
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create SingleFlightConverter");
+				}
+		}
+
+	if (sfc_shared_converter_p)
+		{
+			++ sfc_shared_converter_count;
+			converter_p = sfc_shared_converter_p;
+		}
+
+	pthread_mutex_unlock (&sfc_shared_converter_mutex);
+
+	return converter_p;
+}
+
+
+void SingleFlightConverter :: ReleaseSharedSingleFlightConverter ()
+{
+	SingleFlightConverter *converter_to_free_p = 0;
+
+	pthread_mutex_lock (&sfc_shared_converter_mutex);
+
+	if (sfc_shared_converter_count > 0)
+		{
+			-- sfc_shared_converter_count;
+
+			if (sfc_shared_converter_count == 0)
+				{
+					converter_to_free_p = sfc_shared_converter_p;
+					sfc_shared_converter_p = 0;
+				}
+		}
+
+	pthread_mutex_unlock (&sfc_shared_converter_mutex);
+
+	if (converter_to_free_p)
+		{
+			delete converter_to_free_p;
+		}
+}
+
+
+char *SingleFlightConverter :: MakeFlightKey (const char *job_id_s, const uint32 output_format_code, const char *custom_format_s)
+{
+	char code_s [16];
+
+	snprintf (code_s, sizeof (code_s), UINT32_FMT, output_format_code);
+
+	return ConcatenateVarargsStrings (job_id_s, ":", code_s, ":", custom_format_s ? custom_format_s : "", NULL);
+}
+
+
+SingleFlightConverter :: SingleFlightConverter ()
+	: sfc_flights_p (0)
+{
+	if (pthread_mutex_init (&sfc_mutex, NULL) != 0)
+		{
+			throw std :: bad_alloc ();
+		}
+
+	if (pthread_cond_init (&sfc_landed_cond, NULL) != 0)
+		{
+			pthread_mutex_destroy (&sfc_mutex);
+			throw std :: bad_alloc ();
+		}
+}
+
+
+SingleFlightConverter :: ~SingleFlightConverter ()
+{
+	/* The last service has gone so nothing can still be waiting */
+	while (sfc_flights_p)
+		{
+			ConversionFlight *next_p = sfc_flights_p -> cf_next_p;
+
+			FreeConversionFlight (sfc_flights_p);
+			sfc_flights_p = next_p;
+		}
+
+	pthread_cond_destroy (&sfc_landed_cond);
+	pthread_mutex_destroy (&sfc_mutex);
+}
+
+
+char *SingleFlightConverter :: ConvertOutput (const char *key_s, ConvertOutputCallback convert_fn, void *callback_data_p)
+{
+	char *result_s = NULL;
+	bool leader_flag = false;
+	ConversionFlight *flight_p = JoinFlight (key_s, &leader_flag);
+
+	if (flight_p)
+		{
+			if (leader_flag)
+				{
+					result_s = convert_fn (callback_data_p);
+					LandFlight (flight_p, result_s, NULL);
+				}
+			else
+				{
+					WaitForFlight (flight_p, &result_s, NULL);
+				}
+		}
+	else
+		{
+			/* We couldn't keep track of the conversion so just run it */
+			result_s = convert_fn (callback_data_p);
+		}
+
+	return result_s;
+}
+
+
+json_t *SingleFlightConverter :: MarkUpOutput (const char *key_s, MarkUpOutputCallback markup_fn, void *callback_data_p)
+{
+	json_t *result_p = NULL;
+	bool leader_flag = false;
+	ConversionFlight *flight_p = JoinFlight (key_s, &leader_flag);
+
+	if (flight_p)
+		{
+			if (leader_flag)
+				{
+					result_p = markup_fn (callback_data_p);
+					LandFlight (flight_p, NULL, result_p);
+				}
+			else
+				{
+					WaitForFlight (flight_p, NULL, &result_p);
+				}
+		}
+	else
+		{
+			result_p = markup_fn (callback_data_p);
+		}
+
+	return result_p;
+}
+
+
+ConversionFlight *SingleFlightConverter :: JoinFlight (const char *key_s, bool *leader_flag_p)
+{
+	ConversionFlight *flight_p = NULL;
+
+	pthread_mutex_lock (&sfc_mutex);
+
+	flight_p = sfc_flights_p;
+
+	while (flight_p && (strcmp (flight_p -> cf_key_s, key_s) != 0))
+		{
+			flight_p = flight_p -> cf_next_p;
+		}
+
+	if (flight_p)
+		{
+			++ (flight_p -> cf_num_waiters);
+			*leader_flag_p = false;
+
+			#if SINGLE_FLIGHT_CONVERTER_DEBUG >= STM_LEVEL_FINER
+			PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Waiting for conversion \"%s\", " UINT32_FMT " waiting", key_s, flight_p -> cf_num_waiters);
+			#endif
+		}
+	else
+		{
+			flight_p = (ConversionFlight *) AllocMemory (sizeof (ConversionFlight));
+
+			if (flight_p)
+				{
+					flight_p -> cf_key_s = EasyCopyToNewString (key_s);
+
+					if (flight_p -> cf_key_s)
+						{
+							flight_p -> cf_num_waiters = 0;
+							flight_p -> cf_landed_flag = false;
+							flight_p -> cf_result_s = NULL;
+							flight_p -> cf_result_p = NULL;
+							flight_p -> cf_next_p = sfc_flights_p;
+
+							sfc_flights_p = flight_p;
+							*leader_flag_p = true;
+						}
+					else
+						{
+							FreeMemory (flight_p);
+							flight_p = NULL;
+						}
+				}
+
+			if (!flight_p)
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to allocate flight for conversion \"%s\"", key_s);
+				}
+		}
+
+	pthread_mutex_unlock (&sfc_mutex);
+
+	return flight_p;
+}
+
+
+void SingleFlightConverter :: LandFlight (ConversionFlight *flight_p, const char *result_s, const json_t *result_p)
+{
+	ConversionFlight **flight_pp;
+
+	pthread_mutex_lock (&sfc_mutex);
+
+	/* Any later calls for this key start a new conversion */
+	flight_pp = &sfc_flights_p;
+
+	while (*flight_pp != flight_p)
+		{
+			flight_pp = & ((*flight_pp) -> cf_next_p);
+		}
+
+	*flight_pp = flight_p -> cf_next_p;
+
+	if (flight_p -> cf_num_waiters > 0)
+		{
+			/* The caller keeps its own result so the waiting calls share a copy of it */
+			if (result_s)
+				{
+					flight_p -> cf_result_s = EasyCopyToNewString (result_s);
+
+					if (!flight_p -> cf_result_s)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to copy result of conversion \"%s\"", flight_p -> cf_key_s);
+						}
+				}
+
+			if (result_p)
+				{
+					flight_p -> cf_result_p = json_deep_copy (result_p);
+
+					if (!flight_p -> cf_result_p)
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to copy result of markup \"%s\"", flight_p -> cf_key_s);
+						}
+				}
+
+			#if SINGLE_FLIGHT_CONVERTER_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Sharing conversion \"%s\" with " UINT32_FMT " waiting", flight_p -> cf_key_s, flight_p -> cf_num_waiters);
+			#endif
+
+			flight_p -> cf_landed_flag = true;
+			pthread_cond_broadcast (&sfc_landed_cond);
+		}
+	else
+		{
+			FreeConversionFlight (flight_p);
+		}
+
+	pthread_mutex_unlock (&sfc_mutex);
+}
+
+
+void SingleFlightConverter :: WaitForFlight (ConversionFlight *flight_p, char **result_ss, json_t **result_pp)
+{
+	pthread_mutex_lock (&sfc_mutex);
+
+	while (! (flight_p -> cf_landed_flag))
+		{
+			pthread_cond_wait (&sfc_landed_cond, &sfc_mutex);
+		}
+
+	-- (flight_p -> cf_num_waiters);
+
+	if (flight_p -> cf_num_waiters == 0)
+		{
+			/* We're the last one waiting so we can take the shared result */
+			if (result_ss)
+				{
+					*result_ss = flight_p -> cf_result_s;
+					flight_p -> cf_result_s = NULL;
+				}
+
+			if (result_pp)
+				{
+					*result_pp = flight_p -> cf_result_p;
+					flight_p -> cf_result_p = NULL;
+				}
+
+			FreeConversionFlight (flight_p);
+		}
+	else
+		{
+			if (result_ss && (flight_p -> cf_result_s))
+				{
+					*result_ss = EasyCopyToNewString (flight_p -> cf_result_s);
+				}
+
+			if (result_pp && (flight_p -> cf_result_p))
+				{
+					*result_pp = json_deep_copy (flight_p -> cf_result_p);
+				}
+		}
+
+	pthread_mutex_unlock (&sfc_mutex);
+}
+
+
+static void FreeConversionFlight (ConversionFlight *flight_p)
+{
+	FreeCopiedString (flight_p -> cf_key_s);
+
+	if (flight_p -> cf_result_s)
+		{
+			FreeCopiedString (flight_p -> cf_result_s);
+		}
+
+	if (flight_p -> cf_result_p)
+		{
+			json_decref (flight_p -> cf_result_p);
+		}
+
+	FreeMemory (flight_p);
+}
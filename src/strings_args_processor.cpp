@@ -20,8 +20,11 @@
  *      Author: billy
  */
 
+#include <cstring>
+
 #include "strings_args_processor.hpp"
 
+#include "byte_buffer.h"
 #include "string_utils.h"
 #include "alloc_failure.hpp"
 
@@ -32,7 +35,7 @@ StringsArgsProcessor ::	StringsArgsProcessor ()
 
 	if (!sap_args_p)
 		{
-			throw new AllocFailure ("Couldn't allocate StringLinkedList");
+			throw AllocFailure ("Couldn't allocate StringLinkedList");
 		}
 
 }
@@ -46,31 +49,20 @@ StringsArgsProcessor :: ~StringsArgsProcessor ()
 
 bool StringsArgsProcessor :: AddArg (const char *arg_s, const bool hyphen_flag)
 {
-	bool success_flag = true;
-	const bool add_quotes_flag = DoesStringContainWhitespace (arg_s);
+	bool success_flag = false;
 	char *value_s = NULL;
 
+	/*
+	 * These values are passed straight through as entries in an argv
+	 * array rather than via a shell, so they must not be quoted.
+	 */
 	if (hyphen_flag)
 		{
-			if (add_quotes_flag)
-				{
-					value_s = ConcatenateVarargsStrings ("-\"", arg_s, "\"", NULL);
-				}
-			else
-				{
-					value_s = ConcatenateVarargsStrings ("-", arg_s, NULL);
-				}
+			value_s = ConcatenateVarargsStrings ("-", arg_s, NULL);
 		}
 	else
 		{
-			if (add_quotes_flag)
-				{
-					value_s = ConcatenateVarargsStrings ("\"", arg_s, "\"", NULL);
-				}
-			else
-				{
-					value_s = CopyToNewString (arg_s, 0, false);
-				}
+			value_s = CopyToNewString (arg_s, 0, false);
 		}
 
 
@@ -83,6 +75,10 @@ bool StringsArgsProcessor :: AddArg (const char *arg_s, const bool hyphen_flag)
 					LinkedListAddTail (sap_args_p, & (node_p -> sln_node));
 					success_flag = true;
 				}
+			else
+				{
+					FreeCopiedString (value_s);
+				}
 		}
 
 	return success_flag;
@@ -114,3 +110,102 @@ char **StringsArgsProcessor :: GetArgsAsStrings ()
 }
 
 
+char *StringsArgsProcessor :: GetArgsAsString ()
+{
+	char *command_line_s = NULL;
+	ByteBuffer *buffer_p = AllocateByteBuffer (1024);
+
+	if (buffer_p)
+		{
+			bool success_flag = true;
+			StringListNode *node_p = reinterpret_cast <StringListNode *> (sap_args_p -> ll_head_p);
+
+			while (node_p && success_flag)
+				{
+					if (buffer_p -> bb_current_index != 0)
+						{
+							success_flag = AppendStringToByteBuffer (buffer_p, " ");
+						}
+
+					if (success_flag)
+						{
+							if (DoesStringContainWhitespace (node_p -> sln_string_s))
+								{
+									success_flag = AppendStringsToByteBuffer (buffer_p, "\"", node_p -> sln_string_s, "\"", NULL);
+								}
+							else
+								{
+									success_flag = AppendStringToByteBuffer (buffer_p, node_p -> sln_string_s);
+								}
+						}
+
+					node_p = reinterpret_cast <StringListNode *> (node_p -> sln_node.ln_next_p);
+				}		/* while (node_p && success_flag) */
+
+			if (success_flag)
+				{
+					command_line_s = DetachByteBufferData (buffer_p);
+				}
+			else
+				{
+					FreeByteBuffer (buffer_p);
+				}
+		}		/* if (buffer_p) */
+
+	return command_line_s;
+}
+
+
+bool StringsArgsProcessor :: ReplaceArgValue (const char *arg_s, const char *value_s)
+{
+	bool success_flag = false;
+	bool loop_flag = true;
+	StringListNode *node_p = reinterpret_cast <StringListNode *> (sap_args_p -> ll_head_p);
+
+	while (node_p && loop_flag)
+		{
+			StringListNode *next_node_p = reinterpret_cast <StringListNode *> (node_p -> sln_node.ln_next_p);
+
+			if (next_node_p && (strcmp (node_p -> sln_string_s, arg_s) == 0))
+				{
+					char *copied_value_s = EasyCopyToNewString (value_s);
+
+					if (copied_value_s)
+						{
+							FreeCopiedString (next_node_p -> sln_string_s);
+							next_node_p -> sln_string_s = copied_value_s;
+
+							success_flag = true;
+						}
+
+					loop_flag = false;
+				}
+			else
+				{
+					node_p = next_node_p;
+				}
+		}		/* while (node_p && loop_flag) */
+
+	return success_flag;
+}
+
+
+const char *StringsArgsProcessor :: GetArgValue (const char *arg_s) const
+{
+	const char *value_s = NULL;
+	const StringListNode *node_p = reinterpret_cast <const StringListNode *> (sap_args_p -> ll_head_p);
+
+	while (node_p && !value_s)
+		{
+			const StringListNode *next_node_p = reinterpret_cast <const StringListNode *> (node_p -> sln_node.ln_next_p);
+
+			if (next_node_p && (strcmp (node_p -> sln_string_s, arg_s) == 0))
+				{
+					value_s = next_node_p -> sln_string_s;
+				}
+
+			node_p = next_node_p;
+		}		/* while (node_p && !value_s) */
+
+	return value_s;
+}
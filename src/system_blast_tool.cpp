@@ -20,12 +20,28 @@
  *      Author: tyrrells
  */
 
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
 #include "system_blast_tool.hpp"
 
 #include "blast_service_job.h"
 #include "streams.h"
 #include "string_utils.h"
 #include "blast_util.h"
+#include "blast_process.h"
+#include "blast_process_monitor.hpp"
+#include "blast_process_envelope.hpp"
+#include "blast_scheduler.hpp"
+#include "blast_batcher.hpp"
+#include "combined_database_search.hpp"
+#include "sharded_database_search.hpp"
+#include "chunked_query_search.hpp"
+#include "blast_service_params.h"
+#include "byte_buffer.h"
+#include "memory_allocations.h"
+#include "math_utils.h"
 
 #include "uuid_util.h"
 
@@ -36,10 +52,19 @@
 #endif
 
 
+/* The expect threshold that Blast uses if none is given */
+static const char * const S_DEFAULT_EXPECT_THRESHOLD_S = "10";
+
+/* The maximum number of hits per query that Blast keeps if none is given */
+static const uint32 S_DEFAULT_MAX_TARGET_SEQS = 500;
+
 
 
 SystemBlastTool :: SystemBlastTool (BlastServiceJob *job_p, const char *name_s, const char *factory_s, const BlastServiceData *data_p, const char *blast_program_name_s)
-: ExternalBlastTool (job_p, name_s, factory_s, data_p, blast_program_name_s, false)
+: ExternalBlastTool (job_p, name_s, factory_s, data_p, blast_program_name_s, false),
+	sbt_deadline (0),
+	sbt_stop (BPS_NONE),
+	sbt_num_batched_jobs (1)
 {
 	#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINER
 	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Creating SystemBlastTool %.16X for job \"%s\" at %.16X", this, job_p -> bsj_job.sj_name_s, job_p);
@@ -53,7 +78,10 @@ if (!Init (blast_program_name_s))
 
 
 SystemBlastTool :: SystemBlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p, const json_t *root_p)
-	: ExternalBlastTool (job_p, data_p, root_p),  sbt_args_processor_p (0)
+	: ExternalBlastTool (job_p, data_p, root_p),  sbt_args_processor_p (0),
+	sbt_deadline (0),
+	sbt_stop (BPS_NONE),
+	sbt_num_batched_jobs (1)
 {
 	#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINER
 	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Creating SystemBlastTool %.16X for job \"%s\" at %.16X", this, job_p -> bsj_job.sj_name_s, job_p);
@@ -70,7 +98,7 @@ bool SystemBlastTool :: Init (const char *prog_s)
 {
 	bool success_flag = false;
 
-	sbt_args_processor_p = new ByteBufferArgsProcessor ();
+	sbt_args_processor_p = new StringsArgsProcessor ();
 
 	#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINER
 	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "SystemBlastTool at %.16X has sbt_args_processor_p at %.16X", this, sbt_args_processor_p);
@@ -99,36 +127,6 @@ SystemBlastTool :: ~SystemBlastTool ()
 }
 
 
-bool SystemBlastTool :: ParseParameters (ParameterSet *params_p, BlastAppParameters *app_params_p)
-{
-	bool success_flag = false;
-
-	if (ExternalBlastTool :: ParseParameters (params_p, app_params_p))
-		{
-			char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
-
-			if (logfile_s)
-				{
-					if (AddBlastArg (">>", false))
-						{
-							if (AddBlastArg (logfile_s, false))
-								{
-									if (AddBlastArg ("2>&1", false))
-										{
-											success_flag = true;
-										}
-								}
-						}
-
-					FreeCopiedString (logfile_s);
-				}
-
-		}		/* if (ExternalBlastTool :: ParseParameters (params_p)) */
-
-	return success_flag;
-}
-
-
 ArgsProcessor *SystemBlastTool :: GetArgsProcessor ()
 {
 	return sbt_args_processor_p;
@@ -160,28 +158,99 @@ bool SystemBlastTool :: SaveCommandLine (const char *command_line_s)
 
 OperationStatus SystemBlastTool :: Run ()
 {
-	int res;
 	OperationStatus status = OS_FAILED_TO_START;
-	const char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
-	OperationStatus cached_status;
+	const DatabaseInfo *db_p = GetMatchingDatabaseByFilename (bt_service_data_p, bt_name_s);
+	ShardedDatabaseSearch *sharded_search_p = NULL;
 
-	#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
-	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "About to run SystemBlastTool with \"%s\"", command_line_s);
-	#endif
-
-	status = OS_STARTED;
+	/* The shards' results can only be merged if they are in single-file JSON format */
+	if (db_p && (db_p -> di_shards_p) && HasSingleFileJSONOutput ())
+		{
+			sharded_search_p = ShardedDatabaseSearch :: Create (db_p, ebt_results_filename_s);
+		}
 
-	if (!SaveCommandLine (command_line_s))
+	if (sharded_search_p)
+		{
+			status = RunShardedSearch (sharded_search_p);
+			delete sharded_search_p;
+		}
+	else
 		{
-			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+			ChunkedQuerySearch *chunked_search_p = GetChunkedQuerySearch ();
+
+			if (chunked_search_p)
+				{
+					status = RunChunkedSearch (chunked_search_p);
+					delete chunked_search_p;
+				}
+			else
+				{
+					BlastBatcher *batcher_p = bt_service_data_p -> bsd_batcher_p;
+					char *batch_key_s = NULL;
+					const char *query_filename_s = NULL;
+					const char *output_filename_s = NULL;
+
+					if (batcher_p)
+						{
+							batch_key_s = GetBatchKey (&query_filename_s, &output_filename_s);
+						}
+
+					if (batch_key_s)
+						{
+							char job_id_s [UUID_STRING_BUFFER_SIZE];
+							char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+							char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+							bool cancelled_flag = false;
+
+							ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, job_id_s);
+
+							/*
+							 * Only the job that launches the batch writes its command line, so
+							 * store the search that this job would have run on its own
+							 */
+							if (command_line_s)
+								{
+									if (!SaveCommandLine (command_line_s))
+										{
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+										}
+
+									FreeCopiedString (command_line_s);
+								}
+
+							if (logfile_s)
+								{
+									status = batcher_p -> RunBatched (batch_key_s, job_id_s, query_filename_s, output_filename_s, logfile_s, SystemBlastTool :: RunBatchedBlastCommand, this, &cancelled_flag);
+									FreeCopiedString (logfile_s);
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to create log filename for %s", job_id_s);
+								}
+
+							FreeCopiedString (batch_key_s);
+
+							if (cancelled_flag)
+								{
+									sbt_stop = BPS_CANCELLED;
+								}
+						}
+					else
+						{
+							status = RunBlastCommand (NULL, GetBlastDatabaseSize (bt_name_s));
+						}
+				}
 		}
 
-	res = system (command_line_s);
+	return CompleteRun (status);
+}
 
-	if (res == 0)
-		{
-			status = OS_SUCCEEDED;
 
+OperationStatus SystemBlastTool :: CompleteRun (OperationStatus status)
+{
+	OperationStatus cached_status;
+
+	if (status == OS_SUCCEEDED)
+		{
 			SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
 
 			if (!DetermineBlastResult (bt_job_p))
@@ -194,12 +263,16 @@ OperationStatus SystemBlastTool :: Run ()
 					status = OS_FAILED;
 				}
 		}
-	else
+	else if ((status == OS_FAILED) || (status == OS_FAILED_TO_START))
 		{
-			char *log_s = GetLog ();
+			char *log_s;
+
+			if (sbt_stop != BPS_NONE)
+				{
+					AddStopErrorDetails ();
+				}
 
-			status = OS_FAILED;
-			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" returned %d", command_line_s, res);
+			log_s = GetLog ();
 
 			if (log_s)
 				{
@@ -223,20 +296,898 @@ OperationStatus SystemBlastTool :: Run ()
 }
 
 
-OperationStatus SystemBlastTool :: GetStatus (bool update_flag)
+bool SystemBlastTool :: HasSingleFileJSONOutput () const
 {
-	OperationStatus status = OS_ERROR;
+	const char *output_format_s = sbt_args_processor_p -> GetArgValue ("-outfmt");
 
-	if (update_flag)
+	return (output_format_s && (atoi (output_format_s) == BOF_SINGLE_FILE_JSON_BLAST) && ebt_results_filename_s);
+}
+
+
+bool SystemBlastTool :: AddToCombinedDatabaseSearch (CombinedDatabaseSearch *search_p)
+{
+	bool success_flag = false;
+
+	/* The combined results can only be split up between the databases if they are in single-file JSON format */
+	if (HasSingleFileJSONOutput ())
 		{
-			status = GetServiceJobStatus (& (bt_job_p -> bsj_job));
+			success_flag = search_p -> AddDatabase (bt_name_s, ebt_results_filename_s);
+		}
+
+	return success_flag;
+}
+
+
+OperationStatus SystemBlastTool :: RunCombinedDatabaseSearch (CombinedDatabaseSearch *search_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	const char *max_target_seqs_s = sbt_args_processor_p -> GetArgValue ("-max_target_seqs");
+	const char *evalue_s = sbt_args_processor_p -> GetArgValue ("-evalue");
+	char *combined_max_target_seqs_s = NULL;
+	char *combined_evalue_s = NULL;
+	const char *replacements_ss [] = { "-db", search_p -> GetAliasName (), "-out", search_p -> GetOutputFilename (), "-evalue", NULL, NULL, NULL, NULL };
+
+	/* The expect threshold can only be replaced if it is there, so add Blast's default if needed */
+	if (!evalue_s)
+		{
+			if (AddBlastArgsPair ("evalue", S_DEFAULT_EXPECT_THRESHOLD_S))
+				{
+					evalue_s = S_DEFAULT_EXPECT_THRESHOLD_S;
+				}
+		}
+
+	/*
+	 * Each database's expect values are scaled down afterwards, so raise the
+	 * threshold of the combined search so that it still finds all of the
+	 * hits that the smallest of the databases would find on its own
+	 */
+	if (evalue_s)
+		{
+			search_p -> SetExpectThreshold (atof (evalue_s));
+			combined_evalue_s = ConvertDoubleToString (search_p -> GetCombinedExpectThreshold ());
 		}
+
+	if (combined_evalue_s)
+		{
+			replacements_ss [5] = combined_evalue_s;
+
+			/*
+			 * The limit on the number of hits applies to the combined search as
+			 * a whole, so raise it to allow each database to still get its share.
+			 * Without -max_target_seqs, Blast's default would apply to all of the
+			 * databases between them, so add it in order to replace it.
+			 */
+			if (!max_target_seqs_s)
+				{
+					char *default_max_target_seqs_s = ConvertUnsignedIntegerToString (S_DEFAULT_MAX_TARGET_SEQS);
+
+					if (default_max_target_seqs_s)
+						{
+							if (AddBlastArgsPair ("max_target_seqs", default_max_target_seqs_s))
+								{
+									max_target_seqs_s = sbt_args_processor_p -> GetArgValue ("-max_target_seqs");
+								}
+
+							FreeCopiedString (default_max_target_seqs_s);
+						}
+				}
+
+			if (max_target_seqs_s)
+				{
+					const uint32 max_target_seqs = (uint32) atoi (max_target_seqs_s);
+
+					search_p -> SetMaxTargetSequences (max_target_seqs);
+					combined_max_target_seqs_s = ConvertUnsignedIntegerToString (max_target_seqs * (search_p -> GetNumDatabases ()));
+
+					if (combined_max_target_seqs_s)
+						{
+							replacements_ss [6] = "-max_target_seqs";
+							replacements_ss [7] = combined_max_target_seqs_s;
+						}
+				}
+
+			status = RunBlastCommand (replacements_ss, search_p -> GetDatabasesSize ());
+
+			if (combined_max_target_seqs_s)
+				{
+					FreeCopiedString (combined_max_target_seqs_s);
+				}
+
+			FreeCopiedString (combined_evalue_s);
+		}		/* if (combined_evalue_s) */
 	else
 		{
-			status = GetCachedServiceJobStatus (& (bt_job_p -> bsj_job));
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to set the expect threshold for the combined search against \"%s\"", search_p -> GetAliasName ());
+		}
+
+	return status;
+}
+
+
+OperationStatus SystemBlastTool :: RunBatchedBlastCommand (void *data_p, const char *query_filename_s, const char *output_filename_s, uint32 num_jobs)
+{
+	SystemBlastTool *tool_p = static_cast <SystemBlastTool *> (data_p);
+	const char *replacements_ss [] = { "-query", query_filename_s, "-out", output_filename_s, NULL };
+
+	/* The limits are for a single job so scale them up to cover the whole batch */
+	tool_p -> sbt_num_batched_jobs = num_jobs;
+
+	return tool_p -> RunBlastCommand (replacements_ss, GetBlastDatabaseSize (tool_p -> bt_name_s));
+}
+
+
+char *SystemBlastTool :: GetBatchKey (const char **query_filename_ss, const char **output_filename_ss)
+{
+	char *key_s = NULL;
+	char **args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+
+	if (args_ss)
+		{
+			ByteBuffer *buffer_p = AllocateByteBuffer (1024);
+
+			if (buffer_p)
+				{
+					char **arg_ss = args_ss;
+					bool success_flag = true;
+					bool json_flag = false;
+
+					*query_filename_ss = NULL;
+					*output_filename_ss = NULL;
+
+					while (*arg_ss && success_flag)
+						{
+							const char *arg_s = *arg_ss;
+							const char *value_s = * (arg_ss + 1);
+
+							if ((strcmp (arg_s, "-query") == 0) && value_s)
+								{
+									*query_filename_ss = value_s;
+									++ arg_ss;
+								}
+							else if ((strcmp (arg_s, "-out") == 0) && value_s)
+								{
+									*output_filename_ss = value_s;
+									++ arg_ss;
+								}
+							else if (strcmp (arg_s, "-query_loc") == 0)
+								{
+									/* A query location only makes sense for a single query */
+									success_flag = false;
+								}
+							else
+								{
+									if ((strcmp (arg_s, "-outfmt") == 0) && value_s && (atoi (value_s) == BOF_SINGLE_FILE_JSON_BLAST))
+										{
+											json_flag = true;
+										}
+
+									success_flag = AppendStringsToByteBuffer (buffer_p, arg_s, "\n", NULL);
+								}
+
+							++ arg_ss;
+						}		/* while (*arg_ss && success_flag) */
+
+					/*
+					 * We can only split the combined results back up if they
+					 * are in single-file JSON format.
+					 */
+					if (success_flag && json_flag && (*query_filename_ss) && (*output_filename_ss))
+						{
+							key_s = DetachByteBufferData (buffer_p);
+						}
+					else
+						{
+							FreeByteBuffer (buffer_p);
+						}
+
+				}		/* if (buffer_p) */
+
+			FreeMemory (args_ss);
+		}		/* if (args_ss) */
+
+	return key_s;
+}
+
+
+bool SystemBlastTool :: AddNumThreadsArg (uint32 num_threads)
+{
+	bool success_flag = false;
+	char *value_s = ConvertUnsignedIntegerToString (num_threads);
+
+	if (value_s)
+		{
+			/* If this job has been launched before, just update the existing value */
+			success_flag = sbt_args_processor_p -> ReplaceArgValue ("-num_threads", value_s) || AddBlastArgsPair ("num_threads", value_s);
+			FreeCopiedString (value_s);
+		}
+
+	return success_flag;
+}
+
+
+OperationStatus SystemBlastTool :: RunBlastCommand (const char **replacements_ss, uint64 db_size)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	BlastScheduler *scheduler_p = bt_service_data_p -> bsd_scheduler_p;
+
+	if (scheduler_p -> ReserveQueueSlot ())
+		{
+			uint32 num_threads = scheduler_p -> GetNumThreadsForJob (ebt_query_size, db_size, bt_service_data_p -> bsd_max_threads_per_search);
+
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_PENDING);
+
+			num_threads = scheduler_p -> WaitForCores (num_threads);
+
+			if (AddNumThreadsArg (num_threads))
+				{
+					status = LaunchBlastProcess (replacements_ss);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set the number of threads to " UINT32_FMT, num_threads);
+				}
+
+			scheduler_p -> ReleaseCores (num_threads);
+		}		/* if (scheduler_p -> ReserveQueueSlot ()) */
+	else
+		{
+			if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), BlastScheduler :: BS_QUEUE_FULL_S))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", BlastScheduler :: BS_QUEUE_FULL_S);
+				}
+		}
+
+	return status;
+}
+
+
+OperationStatus SystemBlastTool :: LaunchBlastProcess (const char **replacements_ss)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	char **args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+	char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+	char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+
+	#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "About to run SystemBlastTool with \"%s\"", command_line_s);
+	#endif
+
+	if (args_ss && command_line_s && logfile_s)
+		{
+			BlastProcessResult result;
+			pid_t pid;
+
+			if (!SaveCommandLine (command_line_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+				}
+
+			/* Swap in any replacement values for just this run */
+			if (replacements_ss)
+				{
+					ReplaceBlastProcessArgValues (args_ss, replacements_ss);
+				}
+
+			status = OS_STARTED;
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
+
+			pid = SpawnTrackedBlastProcess (args_ss, logfile_s);
+
+			if ((pid != -1) && (WaitForTrackedBlastProcess (pid, &result)))
+				{
+					#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "\"%s\" used %ld.%06lds user %ld.%06lds sys and %ld KB max rss", command_line_s,
+										(long) result.bpr_usage.ru_utime.tv_sec, (long) result.bpr_usage.ru_utime.tv_usec,
+										(long) result.bpr_usage.ru_stime.tv_sec, (long) result.bpr_usage.ru_stime.tv_usec,
+										result.bpr_usage.ru_maxrss);
+					#endif
+
+					if (DidBlastProcessSucceed (&result))
+						{
+							status = OS_SUCCEEDED;
+						}
+					else
+						{
+							status = OS_FAILED;
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "\"%s\" returned %d with signal %d", command_line_s, result.bpr_exit_code, result.bpr_signal);
+						}
+				}
+			else
+				{
+					status = OS_FAILED_TO_START;
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run \"%s\"", command_line_s);
+				}
+
+		}		/* if (args_ss && command_line_s && logfile_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the command line arguments and log file to run blast job");
+		}
+
+	if (logfile_s)
+		{
+			FreeCopiedString (logfile_s);
+		}
+
+	if (command_line_s)
+		{
+			FreeCopiedString (command_line_s);
+		}
+
+	if (args_ss)
+		{
+			FreeMemory (args_ss);
 		}
 
 	return status;
 }
 
 
+OperationStatus SystemBlastTool :: RunShardedSearch (ShardedDatabaseSearch *search_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	BlastScheduler *scheduler_p = bt_service_data_p -> bsd_scheduler_p;
+
+	if (scheduler_p -> ReserveQueueSlot ())
+		{
+			const uint32 num_shards = search_p -> GetNumShards ();
+			uint32 num_threads = scheduler_p -> GetNumThreadsForJob (ebt_query_size, search_p -> GetDatabaseSize (), bt_service_data_p -> bsd_max_threads_per_search);
+			uint32 threads_per_shard;
+			uint32 max_running_shards;
+			char dbsize_s [32];
+
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_PENDING);
+
+			num_threads = scheduler_p -> WaitForCores (num_threads);
+			threads_per_shard = BlastScheduler :: ShareCores (num_threads, num_shards, &max_running_shards);
+
+			/* Give each shard the size of the whole database so that their expect values can be compared */
+			sprintf (dbsize_s, UINT64_FMT, search_p -> GetTotalLength ());
+
+			if (AddNumThreadsArg (threads_per_shard))
+				{
+					if (sbt_args_processor_p -> ReplaceArgValue ("-dbsize", dbsize_s) || AddBlastArgsPair ("dbsize", dbsize_s))
+						{
+							#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Searching \"%s\" as " UINT32_FMT " shards, " UINT32_FMT " at a time with " UINT32_FMT " threads each", bt_name_s, num_shards, max_running_shards, threads_per_shard);
+							#endif
+
+							status = LaunchShardProcesses (search_p, max_running_shards);
+
+							if (status == OS_SUCCEEDED)
+								{
+									/* Without -max_target_seqs, each shard is limited to Blast's default so the merge must be too */
+									const char *max_target_seqs_s = sbt_args_processor_p -> GetArgValue ("-max_target_seqs");
+									const uint32 max_target_seqs = max_target_seqs_s ? (uint32) atoi (max_target_seqs_s) : S_DEFAULT_MAX_TARGET_SEQS;
+
+									if (!search_p -> Merge (max_target_seqs))
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to merge the results of the shards of \"%s\"", bt_name_s);
+											status = OS_FAILED;
+										}
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set the database size to %s", dbsize_s);
+						}
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set the number of threads to " UINT32_FMT, threads_per_shard);
+				}
+
+			scheduler_p -> ReleaseCores (num_threads);
+		}		/* if (scheduler_p -> ReserveQueueSlot ()) */
+	else
+		{
+			if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), BlastScheduler :: BS_QUEUE_FULL_S))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", BlastScheduler :: BS_QUEUE_FULL_S);
+				}
+		}
+
+	return status;
+}
+
+
+OperationStatus SystemBlastTool :: LaunchShardProcesses (ShardedDatabaseSearch *search_p, uint32 max_running_shards)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	char **args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+	char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+	char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+	pid_t *pids_p = (pid_t *) AllocMemoryArray (max_running_shards, sizeof (pid_t));
+	uint32 *shards_p = (uint32 *) AllocMemoryArray (max_running_shards, sizeof (uint32));
+
+	if (args_ss && command_line_s && logfile_s && pids_p && shards_p)
+		{
+			const uint32 num_shards = search_p -> GetNumShards ();
+			uint32 next_shard = 0;
+			uint32 num_running = 0;
+
+			if (!SaveCommandLine (command_line_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+				}
+
+			status = OS_STARTED;
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
+
+			/*
+			 * The shards can take very different times, so rather than running them
+			 * in waves, the next one is launched as soon as any of them finishes.
+			 * Once one fails, no more are launched but the rest are still waited
+			 * for so that none are left running.
+			 */
+			while ((num_running > 0) || ((status == OS_STARTED) && (next_shard < num_shards)))
+				{
+					/* The arguments are copied when each process is spawned so they can be changed for the next one straight away */
+					while ((status == OS_STARTED) && (num_running < max_running_shards) && (next_shard < num_shards))
+						{
+							const char *replacements_ss [] = { "-db", search_p -> GetShardName (next_shard), "-out", search_p -> GetShardOutputFilename (next_shard), NULL };
+							pid_t pid;
+
+							ReplaceBlastProcessArgValues (args_ss, replacements_ss);
+							pid = SpawnTrackedBlastProcess (args_ss, logfile_s);
+
+							if (pid > 0)
+								{
+									* (pids_p + num_running) = pid;
+									* (shards_p + num_running) = next_shard;
+									++ num_running;
+								}
+							else
+								{
+									status = OS_FAILED;
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run shard \"%s\"", search_p -> GetShardName (next_shard));
+								}
+
+							++ next_shard;
+						}
+
+					if (num_running > 0)
+						{
+							int32 index = WaitForAnyBlastProcess (pids_p, num_running);
+							uint32 shard;
+							BlastProcessResult result;
+
+							/* If that failed, just wait for the oldest one */
+							if (index < 0)
+								{
+									index = 0;
+								}
+
+							shard = * (shards_p + index);
+
+							if (WaitForTrackedBlastProcess (* (pids_p + index), &result))
+								{
+									if (!DidBlastProcessSucceed (&result))
+										{
+											status = OS_FAILED;
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Shard \"%s\" returned %d with signal %d", search_p -> GetShardName (shard), result.bpr_exit_code, result.bpr_signal);
+										}
+								}
+							else
+								{
+									status = OS_FAILED;
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to wait for shard \"%s\"", search_p -> GetShardName (shard));
+								}
+
+							/* Move the most recently launched shard into the free slot */
+							-- num_running;
+							* (pids_p + index) = * (pids_p + num_running);
+							* (shards_p + index) = * (shards_p + num_running);
+						}		/* if (num_running > 0) */
+
+				}		/* while ((num_running > 0) || ((status == OS_STARTED) && (next_shard < num_shards))) */
+
+			if (status == OS_STARTED)
+				{
+					status = OS_SUCCEEDED;
+				}
+
+		}		/* if (args_ss && command_line_s && logfile_s && pids_p && shards_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the command line arguments and log file to run sharded blast job");
+		}
+
+	if (shards_p)
+		{
+			FreeMemory (shards_p);
+		}
+
+	if (pids_p)
+		{
+			FreeMemory (pids_p);
+		}
+
+	if (logfile_s)
+		{
+			FreeCopiedString (logfile_s);
+		}
+
+	if (command_line_s)
+		{
+			FreeCopiedString (command_line_s);
+		}
+
+	if (args_ss)
+		{
+			FreeMemory (args_ss);
+		}
+
+	return status;
+}
+
+
+ChunkedQuerySearch *SystemBlastTool :: GetChunkedQuerySearch ()
+{
+	ChunkedQuerySearch *search_p = NULL;
+
+	/*
+	 * The chunks' results can only be joined back together if they are
+	 * in single-file JSON format and a query location only makes sense
+	 * for a single query.
+	 */
+	if ((bt_service_data_p -> bsd_max_query_chunks > 1) && HasSingleFileJSONOutput () && ! (sbt_args_processor_p -> GetArgValue ("-query_loc")))
+		{
+			const char *query_filename_s = sbt_args_processor_p -> GetArgValue ("-query");
+
+			if (query_filename_s)
+				{
+					search_p = ChunkedQuerySearch :: Create (query_filename_s, ebt_results_filename_s, bt_service_data_p -> bsd_max_query_chunks);
+				}
+		}
+
+	return search_p;
+}
+
+
+OperationStatus SystemBlastTool :: RunChunkedSearch (ChunkedQuerySearch *search_p)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	BlastScheduler *scheduler_p = bt_service_data_p -> bsd_scheduler_p;
+
+	if (scheduler_p -> ReserveQueueSlot ())
+		{
+			uint32 num_threads = scheduler_p -> GetNumThreadsForJob (ebt_query_size, GetBlastDatabaseSize (bt_name_s), bt_service_data_p -> bsd_max_threads_per_search);
+			uint32 threads_per_chunk;
+			uint32 max_running_chunks;
+
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), OS_PENDING);
+
+			num_threads = scheduler_p -> WaitForCores (num_threads);
+			threads_per_chunk = BlastScheduler :: ShareCores (num_threads, search_p -> GetNumChunks (), &max_running_chunks);
+
+			if (AddNumThreadsArg (threads_per_chunk))
+				{
+					#if SYSTEM_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+					PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Searching " UINT32_FMT " query chunks against \"%s\", " UINT32_FMT " at a time with " UINT32_FMT " threads each", search_p -> GetNumChunks (), bt_name_s, max_running_chunks, threads_per_chunk);
+					#endif
+
+					status = LaunchChunkProcesses (search_p, max_running_chunks);
+				}
+			else
+				{
+					PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to set the number of threads to " UINT32_FMT, threads_per_chunk);
+				}
+
+			scheduler_p -> ReleaseCores (num_threads);
+		}		/* if (scheduler_p -> ReserveQueueSlot ()) */
+	else
+		{
+			if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), BlastScheduler :: BS_QUEUE_FULL_S))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", BlastScheduler :: BS_QUEUE_FULL_S);
+				}
+		}
+
+	return status;
+}
+
+
+OperationStatus SystemBlastTool :: LaunchChunkProcesses (ChunkedQuerySearch *search_p, uint32 max_running_chunks)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	char **args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+	char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+	char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+
+	/* The running chunks' process ids, indexed by the chunk number modulo max_running_chunks */
+	pid_t *pids_p = (pid_t *) AllocMemoryArray (max_running_chunks, sizeof (pid_t));
+
+	if (args_ss && command_line_s && logfile_s && pids_p)
+		{
+			const uint32 num_chunks = search_p -> GetNumChunks ();
+			uint32 next_chunk = 0;
+			uint32 oldest_chunk = 0;
+
+			if (!SaveCommandLine (command_line_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+				}
+
+			status = OS_STARTED;
+			SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
+
+			/* Once anything has failed, don't launch any more chunks but still wait for the running ones */
+			while ((oldest_chunk < next_chunk) || ((status == OS_STARTED) && (next_chunk < num_chunks)))
+				{
+					while ((status == OS_STARTED) && (next_chunk < num_chunks) && (next_chunk - oldest_chunk < max_running_chunks))
+						{
+							const char *replacements_ss [] = { "-query", search_p -> GetChunkQueryFilename (next_chunk), "-out", search_p -> GetChunkOutputFilename (next_chunk), NULL };
+
+							ReplaceBlastProcessArgValues (args_ss, replacements_ss);
+							* (pids_p + (next_chunk % max_running_chunks)) = SpawnTrackedBlastProcess (args_ss, logfile_s);
+
+							++ next_chunk;
+						}
+
+					/*
+					 * The chunks are about the same size, so the oldest one should
+					 * be the first to finish and waiting for it means that the
+					 * results are merged in the order of the queries.
+					 */
+					if (oldest_chunk < next_chunk)
+						{
+							const pid_t pid = * (pids_p + (oldest_chunk % max_running_chunks));
+
+							if (pid > 0)
+								{
+									BlastProcessResult result;
+
+									if (WaitForTrackedBlastProcess (pid, &result))
+										{
+											if (DidBlastProcessSucceed (&result))
+												{
+													if ((status == OS_STARTED) && (!search_p -> SetChunkSucceeded (oldest_chunk)))
+														{
+															status = OS_FAILED;
+														}
+												}
+											else
+												{
+													status = OS_FAILED;
+													PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Query chunk \"%s\" returned %d with signal %d", search_p -> GetChunkQueryFilename (oldest_chunk), result.bpr_exit_code, result.bpr_signal);
+												}
+										}
+									else
+										{
+											status = OS_FAILED;
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to wait for query chunk \"%s\"", search_p -> GetChunkQueryFilename (oldest_chunk));
+										}
+								}
+							else
+								{
+									status = OS_FAILED;
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run query chunk \"%s\"", search_p -> GetChunkQueryFilename (oldest_chunk));
+								}
+
+							++ oldest_chunk;
+						}		/* if (oldest_chunk < next_chunk) */
+
+				}		/* while ((oldest_chunk < next_chunk) || ... */
+
+			if (status == OS_STARTED)
+				{
+					status = OS_SUCCEEDED;
+				}
+
+		}		/* if (args_ss && command_line_s && logfile_s && pids_p) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the command line arguments and log file to run chunked blast job");
+		}
+
+	if (pids_p)
+		{
+			FreeMemory (pids_p);
+		}
+
+	if (logfile_s)
+		{
+			FreeCopiedString (logfile_s);
+		}
+
+	if (command_line_s)
+		{
+			FreeCopiedString (command_line_s);
+		}
+
+	if (args_ss)
+		{
+			FreeMemory (args_ss);
+		}
+
+	return status;
+}
+
+
+OperationStatus SystemBlastTool :: GetStatus (bool update_flag)
+{
+	OperationStatus status = OS_ERROR;
+
+	if (update_flag)
+		{
+			status = GetServiceJobStatus (& (bt_job_p -> bsj_job));
+		}
+	else
+		{
+			status = GetCachedServiceJobStatus (& (bt_job_p -> bsj_job));
+		}
+
+	return status;
+}
+
+
+bool SystemBlastTool :: Cancel ()
+{
+	char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+	return CancelJob (bt_service_data_p, uuid_s);
+}
+
+
+bool SystemBlastTool :: CancelJob (const BlastServiceData *data_p, const char *job_id_s)
+{
+	bool success_flag = false;
+	BlastProcessMonitor *monitor_p = data_p -> bsd_monitor_p;
+	char batch_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	/*
+	 * A batched job shares its Blast process with the other jobs in the batch,
+	 * so it is only detached from the batch. The process is only stopped if
+	 * none of the jobs in the batch want its results any more.
+	 */
+	if ((data_p -> bsd_batcher_p) && (data_p -> bsd_batcher_p -> CancelBatched (job_id_s, batch_job_id_s)))
+		{
+			success_flag = true;
+
+			if ((*batch_job_id_s != '\0') && monitor_p)
+				{
+					monitor_p -> Cancel (batch_job_id_s);
+				}
+		}
+	else if (monitor_p)
+		{
+			success_flag = monitor_p -> Cancel (job_id_s);
+		}
+
+	return success_flag;
+}
+
+
+uint32 SystemBlastTool :: GetTimeLimit () const
+{
+	return GetBlastJobTimeLimit (bt_service_data_p, sbt_args_processor_p -> GetArgValue ("-task")) * sbt_num_batched_jobs;
+}
+
+
+time_t SystemBlastTool :: GetDeadline ()
+{
+	if (sbt_deadline == 0)
+		{
+			const uint32 time_limit = GetTimeLimit ();
+
+			if (time_limit > 0)
+				{
+					sbt_deadline = time (NULL) + (time_t) time_limit;
+				}
+		}
+
+	return sbt_deadline;
+}
+
+
+pid_t SystemBlastTool :: SpawnTrackedBlastProcess (char **args_ss, const char *logfile_s)
+{
+	pid_t pid;
+
+	/* If the limits can't be applied, the process isn't run at all */
+	if (bt_service_data_p -> bsd_envelope_p)
+		{
+			pid = bt_service_data_p -> bsd_envelope_p -> Spawn (args_ss, logfile_s, sbt_num_batched_jobs);
+		}
+	else
+		{
+			pid = SpawnBlastProcess (args_ss, logfile_s);
+		}
+
+	if (pid != -1)
+		{
+			BlastProcessMonitor *monitor_p = bt_service_data_p -> bsd_monitor_p;
+
+			if (monitor_p)
+				{
+					char uuid_s [UUID_STRING_BUFFER_SIZE];
+
+					ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, uuid_s);
+
+					/* The process can still be waited for if this fails, it just can't be stopped */
+					if (!monitor_p -> Track (pid, uuid_s, GetDeadline ()))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to track process %d for uuid %s", pid, uuid_s);
+						}
+				}
+		}
+
+	return pid;
+}
+
+
+bool SystemBlastTool :: WaitForTrackedBlastProcess (pid_t pid, BlastProcessResult *result_p)
+{
+	bool success_flag;
+	BlastProcessMonitor *monitor_p = bt_service_data_p -> bsd_monitor_p;
+
+	if (monitor_p)
+		{
+			success_flag = monitor_p -> Wait (pid, result_p);
+
+			if (result_p -> bpr_stop != BPS_NONE)
+				{
+					sbt_stop = result_p -> bpr_stop;
+				}
+		}
+	else
+		{
+			success_flag = WaitForBlastProcess (pid, result_p);
+		}
+
+	if (success_flag && (bt_service_data_p -> bsd_envelope_p))
+		{
+			bt_service_data_p -> bsd_envelope_p -> Leave (pid, result_p);
+
+			if (result_p -> bpr_stop == BPS_MEMORY_LIMIT)
+				{
+					sbt_stop = BPS_MEMORY_LIMIT;
+				}
+		}
+
+	return success_flag;
+}
+
+
+void SystemBlastTool :: AddStopErrorDetails ()
+{
+	char *error_s = NULL;
+
+	if (sbt_stop == BPS_CANCELLED)
+		{
+			error_s = CopyToNewString ("The search was cancelled", 0, false);
+		}
+	else if (sbt_stop == BPS_TIMED_OUT)
+		{
+			char *time_limit_s = ConvertUnsignedIntegerToString (GetTimeLimit ());
+
+			if (time_limit_s)
+				{
+					error_s = ConcatenateVarargsStrings ("The search exceeded its time limit of ", time_limit_s, " seconds", NULL);
+					FreeCopiedString (time_limit_s);
+				}
+		}
+	else if (sbt_stop == BPS_MEMORY_LIMIT)
+		{
+			char *memory_limit_s = ConvertUnsignedIntegerToString ((uint32) ((bt_service_data_p -> bsd_envelope_p -> GetMemoryLimit () * sbt_num_batched_jobs) >> 20));
+
+			if (memory_limit_s)
+				{
+					error_s = ConcatenateVarargsStrings ("The search was stopped as it went over its memory limit of ", memory_limit_s, " MB", NULL);
+					FreeCopiedString (memory_limit_s);
+				}
+		}
+
+	if (error_s)
+		{
+			if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), error_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", error_s);
+				}
+
+			FreeCopiedString (error_s);
+		}
+}
@@ -0,0 +1,1027 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * threaded_blast_tool.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "threaded_blast_tool.hpp"
+
+#include "blast_service_job.h"
+#include "blast_process.h"
+#include "blast_process_monitor.hpp"
+#include "blast_process_envelope.hpp"
+#include "blast_scheduler.hpp"
+#include "blast_util.h"
+#include "chunked_query_search.hpp"
+#include "linked_list.h"
+#include "memory_allocations.h"
+#include "streams.h"
+#include "string_utils.h"
+#include "uuid_util.h"
+
+
+#ifdef _DEBUG
+	#define THREADED_BLAST_TOOL_DEBUG	(STM_LEVEL_FINER)
+#else
+	#define THREADED_BLAST_TOOL_DEBUG	(STM_LEVEL_NONE)
+#endif
+
+
+/**
+ * The maximum number of finished jobs whose statuses are kept
+ * in memory before the oldest ones are discarded.
+ */
+#define TBT_MAX_NUM_FINISHED_JOBS	(1024)
+
+
+/*
+ * The details needed to run a blast job on one of the threads of
+ * a BlastThreadPool. These are copies of the ThreadedBlastTool's values
+ * and its own references to the shared scheduler and monitor as the tool,
+ * and the service that it belongs to, may have been freed by the time
+ * that the job runs.
+ */
+typedef struct ThreadedBlastJob
+{
+	/*
+	 * This has space after the arguments for the "-num_threads"
+	 * key and value which are filled in just before the job runs.
+	 */
+	char **tbj_args_ss;
+
+	size_t tbj_num_args;
+
+	uint64 tbj_query_size;
+
+	uint64 tbj_db_size;
+
+	uint32 tbj_max_threads;
+
+	char *tbj_log_filename_s;
+
+	char tbj_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	BlastScheduler *tbj_scheduler_p;
+
+	BlastProcessMonitor *tbj_monitor_p;
+
+	/* The job's own copy of the limits for the process or NULL if it runs without any */
+	BlastProcessEnvelope *tbj_envelope_p;
+
+	/* The number of seconds that the process can run for or 0 for no limit */
+	uint32 tbj_time_limit;
+
+	/* Has the BlastThreadPool started to run the job? */
+	bool tbj_started_flag;
+
+	/* The chunks of the queries if they are searched by separate processes or NULL */
+	ChunkedQuerySearch *tbj_chunked_search_p;
+} ThreadedBlastJob;
+
+
+/*
+ * The current status of a blast job that has been
+ * added to a BlastThreadPool.
+ */
+typedef struct ThreadedBlastJobNode
+{
+	ListItem tbjn_node;
+
+	char tbjn_job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	OperationStatus tbjn_status;
+
+	/* Why the job's process was stopped, if it was */
+	BlastProcessStop tbjn_stop;
+
+	/* Has the job been cancelled? */
+	bool tbjn_cancelled_flag;
+} ThreadedBlastJobNode;
+
+
+static LinkedList *s_threaded_jobs_p = NULL;
+
+static pthread_mutex_t s_threaded_jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+static ThreadedBlastJob *AllocateThreadedBlastJob (char **args_ss, const char *log_filename_s, const char *job_id_s, const BlastServiceData *data_p);
+
+static void FreeThreadedBlastJob (ThreadedBlastJob *job_p);
+
+static void RunThreadedBlastJob (void *data_p);
+
+static void StopThreadedBlastJob (void *data_p);
+
+static void ReleaseThreadedBlastJob (void *data_p);
+
+static OperationStatus RunThreadedBlastProcess (ThreadedBlastJob *job_p, const time_t deadline);
+
+static OperationStatus RunThreadedBlastChunks (ThreadedBlastJob *job_p, const uint32 max_running_chunks, const time_t deadline);
+
+static pid_t SpawnThreadedBlastProcess (ThreadedBlastJob *job_p, char **args_ss, const time_t deadline);
+
+static bool WaitForThreadedBlastProcess (ThreadedBlastJob *job_p, const pid_t pid, BlastProcessResult *result_p);
+
+static bool SetThreadedBlastJobStatus (const char *job_id_s, OperationStatus status);
+
+static void SetThreadedBlastJobStop (const char *job_id_s, BlastProcessStop stop);
+
+static bool GetThreadedBlastJobStatus (const char *job_id_s, OperationStatus *status_p, BlastProcessStop *stop_p);
+
+static void RemoveThreadedBlastJobStatus (const char *job_id_s);
+
+static bool SetThreadedBlastJobCancelled (const char *job_id_s);
+
+static bool IsThreadedBlastJobCancelled (const char *job_id_s);
+
+static void FailCancelledThreadedBlastJob (const char *job_id_s);
+
+static ThreadedBlastJobNode *FindThreadedBlastJobNode (const char *job_id_s);
+
+static bool IsThreadedBlastJobFinished (const OperationStatus status);
+
+static void FreeThreadedBlastJobNode (ListItem * const node_p);
+
+
+
+ThreadedBlastTool :: ThreadedBlastTool (BlastServiceJob *job_p, const char *name_s, const char *factory_s, const BlastServiceData *data_p, const char *blast_program_name_s, BlastThreadPool *pool_p)
+: SystemBlastTool (job_p, name_s, factory_s, data_p, blast_program_name_s),
+	tbt_pool_p (pool_p)
+{
+	#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINER
+	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Creating ThreadedBlastTool %.16X for job \"%s\" at %.16X", this, job_p -> bsj_job.sj_name_s, job_p);
+	#endif
+
+	ebt_async_flag = true;
+}
+
+
+ThreadedBlastTool :: ThreadedBlastTool (BlastServiceJob *job_p, const BlastServiceData *data_p, const json_t *root_p, BlastThreadPool *pool_p)
+: SystemBlastTool (job_p, data_p, root_p),
+	tbt_pool_p (pool_p)
+{
+	#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINER
+	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Creating ThreadedBlastTool %.16X for job \"%s\" at %.16X", this, job_p -> bsj_job.sj_name_s, job_p);
+	#endif
+
+	ebt_async_flag = true;
+}
+
+
+ThreadedBlastTool :: ~ThreadedBlastTool ()
+{
+	#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINER
+	PrintLog (STM_LEVEL_FINER, __FILE__, __LINE__, "Destroying ThreadedBlastTool at %.16X", this);
+	#endif
+}
+
+
+OperationStatus ThreadedBlastTool :: Run ()
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	char **args_ss = sbt_args_processor_p -> GetArgsAsStrings ();
+	char *command_line_s = sbt_args_processor_p -> GetArgsAsString ();
+	char *logfile_s = GetJobFilename (ebt_working_directory_s, BS_LOG_SUFFIX_S);
+	char job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, job_id_s);
+
+	#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "About to queue ThreadedBlastTool job \"%s\" with \"%s\"", job_id_s, command_line_s);
+	#endif
+
+	if (args_ss && command_line_s && logfile_s)
+		{
+			BlastScheduler *scheduler_p = bt_service_data_p -> bsd_scheduler_p;
+
+			if (!SaveCommandLine (command_line_s))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to save command line \"%s\" to file", command_line_s);
+				}
+
+			if (scheduler_p -> ReserveQueueSlot ())
+				{
+					ThreadedBlastJob *threaded_job_p = AllocateThreadedBlastJob (args_ss, logfile_s, job_id_s, bt_service_data_p);
+
+					if (threaded_job_p)
+						{
+							threaded_job_p -> tbj_query_size = ebt_query_size;
+							threaded_job_p -> tbj_db_size = GetBlastDatabaseSize (bt_name_s);
+							threaded_job_p -> tbj_time_limit = GetTimeLimit ();
+							threaded_job_p -> tbj_chunked_search_p = GetChunkedQuerySearch ();
+
+							/*
+							 * Register the job before queuing it so that a fast
+							 * worker thread cannot update a status that doesn't exist yet.
+							 */
+							if (SetThreadedBlastJobStatus (job_id_s, OS_PENDING))
+								{
+									if (tbt_pool_p -> AddTask (RunThreadedBlastJob, StopThreadedBlastJob, ReleaseThreadedBlastJob, threaded_job_p))
+										{
+											status = OS_PENDING;
+										}
+									else
+										{
+											PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to add job \"%s\" to the thread pool", job_id_s);
+
+											RemoveThreadedBlastJobStatus (job_id_s);
+											FreeThreadedBlastJob (threaded_job_p);
+										}
+								}
+							else
+								{
+									PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to store status for job \"%s\"", job_id_s);
+									FreeThreadedBlastJob (threaded_job_p);
+								}
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate threaded job for \"%s\"", job_id_s);
+						}
+
+					if (status != OS_PENDING)
+						{
+							scheduler_p -> CancelQueueSlot ();
+						}
+
+				}		/* if (scheduler_p -> ReserveQueueSlot ()) */
+			else
+				{
+					if (!AddGeneralErrorMessageToServiceJob (& (bt_job_p -> bsj_job), BlastScheduler :: BS_QUEUE_FULL_S))
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to add error \"%s\" to service job", BlastScheduler :: BS_QUEUE_FULL_S);
+						}
+				}
+
+		}		/* if (args_ss && command_line_s && logfile_s) */
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to get the command line arguments and log file to run blast job");
+		}
+
+	if (logfile_s)
+		{
+			FreeCopiedString (logfile_s);
+		}
+
+	if (command_line_s)
+		{
+			FreeCopiedString (command_line_s);
+		}
+
+	if (args_ss)
+		{
+			FreeMemory (args_ss);
+		}
+
+	SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
+
+	return status;
+}
+
+
+OperationStatus ThreadedBlastTool :: GetStatus (bool update_flag)
+{
+	OperationStatus status = GetCachedServiceJobStatus (& (bt_job_p -> bsj_job));
+
+	if (update_flag)
+		{
+			char job_id_s [UUID_STRING_BUFFER_SIZE];
+			OperationStatus threaded_status;
+			BlastProcessStop stop;
+
+			ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, job_id_s);
+
+			/*
+			 * If the job isn't in our list, then it either ran in a previous
+			 * instance of the server or it finished long enough ago to have
+			 * been discarded, so the cached value is the best that we have.
+			 */
+			if (GetThreadedBlastJobStatus (job_id_s, &threaded_status, &stop))
+				{
+					if (threaded_status != status)
+						{
+							#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+							PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Job \"%s\" changed from %d to %d", job_id_s, status, threaded_status);
+							#endif
+
+							if ((threaded_status == OS_FAILED) && (stop != BPS_NONE))
+								{
+									sbt_stop = stop;
+									AddStopErrorDetails ();
+								}
+
+							status = threaded_status;
+							SetServiceJobStatus (& (bt_job_p -> bsj_job), status);
+						}
+				}
+		}
+
+	return status;
+}
+
+
+bool ThreadedBlastTool :: Cancel ()
+{
+	char job_id_s [UUID_STRING_BUFFER_SIZE];
+
+	ConvertUUIDToString (bt_job_p -> bsj_job.sj_id, job_id_s);
+
+	return CancelJob (bt_service_data_p, job_id_s);
+}
+
+
+bool ThreadedBlastTool :: CancelJob (const BlastServiceData *data_p, const char *job_id_s)
+{
+	/*
+	 * Mark the job first so that if it hasn't got its process yet, it
+	 * will fail rather than start it. If it is already running, the
+	 * monitor stops its process.
+	 */
+	bool success_flag = SetThreadedBlastJobCancelled (job_id_s);
+
+	if (SystemBlastTool :: CancelJob (data_p, job_id_s))
+		{
+			success_flag = true;
+		}
+
+	return success_flag;
+}
+
+
+
+static ThreadedBlastJob *AllocateThreadedBlastJob (char **args_ss, const char *log_filename_s, const char *job_id_s, const BlastServiceData *data_p)
+{
+	ThreadedBlastJob *job_p = (ThreadedBlastJob *) AllocMemory (sizeof (ThreadedBlastJob));
+
+	if (job_p)
+		{
+			size_t num_args = 0;
+			char **arg_ss = args_ss;
+
+			job_p -> tbj_log_filename_s = NULL;
+			job_p -> tbj_args_ss = NULL;
+			job_p -> tbj_time_limit = 0;
+			job_p -> tbj_max_threads = data_p -> bsd_max_threads_per_search;
+			job_p -> tbj_query_size = 0;
+			job_p -> tbj_db_size = 0;
+			job_p -> tbj_envelope_p = NULL;
+			job_p -> tbj_started_flag = false;
+			job_p -> tbj_chunked_search_p = NULL;
+
+			/*
+			 * The job may still be queued on the shared BlastThreadPool after the
+			 * service has been freed, so it holds its own references to these.
+			 */
+			job_p -> tbj_scheduler_p = BlastScheduler :: GetSharedBlastScheduler (0, 0);
+			job_p -> tbj_monitor_p = BlastProcessMonitor :: GetSharedBlastProcessMonitor ();
+
+			if (! ((job_p -> tbj_scheduler_p) && (job_p -> tbj_monitor_p)))
+				{
+					FreeThreadedBlastJob (job_p);
+					return NULL;
+				}
+
+			if (data_p -> bsd_envelope_p)
+				{
+					job_p -> tbj_envelope_p = BlastProcessEnvelope :: Clone (data_p -> bsd_envelope_p);
+
+					if (! (job_p -> tbj_envelope_p))
+						{
+							FreeThreadedBlastJob (job_p);
+							return NULL;
+						}
+				}
+
+			while (*arg_ss)
+				{
+					++ num_args;
+					++ arg_ss;
+				}
+
+			job_p -> tbj_num_args = num_args;
+
+			/* Leave room for "-num_threads", its value and the terminating NULL */
+			job_p -> tbj_args_ss = (char **) AllocMemoryArray (num_args + 3, sizeof (char *));
+
+			if (job_p -> tbj_args_ss)
+				{
+					job_p -> tbj_log_filename_s = EasyCopyToNewString (log_filename_s);
+
+					if (job_p -> tbj_log_filename_s)
+						{
+							size_t i;
+							bool success_flag = true;
+
+							for (i = 0; i < num_args; ++ i)
+								{
+									if ((* (job_p -> tbj_args_ss + i) = EasyCopyToNewString (* (args_ss + i))) == NULL)
+										{
+											success_flag = false;
+											i = num_args;
+										}
+								}
+
+							if (success_flag)
+								{
+									strcpy (job_p -> tbj_job_id_s, job_id_s);
+
+									return job_p;
+								}
+
+							FreeCopiedString (job_p -> tbj_log_filename_s);
+							job_p -> tbj_log_filename_s = NULL;
+						}		/* if (job_p -> tbj_log_filename_s) */
+
+				}		/* if (job_p -> tbj_args_ss) */
+
+			FreeThreadedBlastJob (job_p);
+		}		/* if (job_p) */
+
+	return NULL;
+}
+
+
+static void FreeThreadedBlastJob (ThreadedBlastJob *job_p)
+{
+	if (job_p -> tbj_args_ss)
+		{
+			char **arg_ss = job_p -> tbj_args_ss;
+
+			while (*arg_ss)
+				{
+					FreeCopiedString (*arg_ss);
+					++ arg_ss;
+				}
+
+			FreeMemory (job_p -> tbj_args_ss);
+		}
+
+	if (job_p -> tbj_log_filename_s)
+		{
+			FreeCopiedString (job_p -> tbj_log_filename_s);
+		}
+
+	if (job_p -> tbj_envelope_p)
+		{
+			delete (job_p -> tbj_envelope_p);
+		}
+
+	if (job_p -> tbj_chunked_search_p)
+		{
+			delete (job_p -> tbj_chunked_search_p);
+		}
+
+	if (job_p -> tbj_monitor_p)
+		{
+			BlastProcessMonitor :: ReleaseSharedBlastProcessMonitor ();
+		}
+
+	if (job_p -> tbj_scheduler_p)
+		{
+			BlastScheduler :: ReleaseSharedBlastScheduler ();
+		}
+
+	FreeMemory (job_p);
+}
+
+
+static void RunThreadedBlastJob (void *data_p)
+{
+	ThreadedBlastJob *job_p = (ThreadedBlastJob *) data_p;
+	OperationStatus status;
+	char num_threads_s [16];
+	uint32 num_threads = job_p -> tbj_scheduler_p -> GetNumThreadsForJob (job_p -> tbj_query_size, job_p -> tbj_db_size, job_p -> tbj_max_threads);
+	uint32 threads_per_process;
+	uint32 max_running_chunks = 1;
+	time_t deadline;
+
+	job_p -> tbj_started_flag = true;
+
+	if (IsThreadedBlastJobCancelled (job_p -> tbj_job_id_s))
+		{
+			job_p -> tbj_scheduler_p -> CancelQueueSlot ();
+			FailCancelledThreadedBlastJob (job_p -> tbj_job_id_s);
+
+			return;
+		}
+
+	/* The job stays pending until there are enough free cores to run it */
+	num_threads = job_p -> tbj_scheduler_p -> WaitForCores (num_threads);
+
+	/* It may have been cancelled whilst it was waiting */
+	if (IsThreadedBlastJobCancelled (job_p -> tbj_job_id_s))
+		{
+			job_p -> tbj_scheduler_p -> ReleaseCores (num_threads);
+			FailCancelledThreadedBlastJob (job_p -> tbj_job_id_s);
+
+			return;
+		}
+
+	if (job_p -> tbj_chunked_search_p)
+		{
+			threads_per_process = BlastScheduler :: ShareCores (num_threads, job_p -> tbj_chunked_search_p -> GetNumChunks (), &max_running_chunks);
+		}
+	else
+		{
+			threads_per_process = num_threads;
+		}
+
+	sprintf (num_threads_s, UINT32_FMT, threads_per_process);
+	* (job_p -> tbj_args_ss + job_p -> tbj_num_args) = (char *) "-num_threads";
+	* (job_p -> tbj_args_ss + job_p -> tbj_num_args + 1) = num_threads_s;
+
+	/* The time limit only starts once the job has its cores */
+	deadline = (job_p -> tbj_time_limit > 0) ? time (NULL) + (time_t) (job_p -> tbj_time_limit) : 0;
+
+	SetThreadedBlastJobStatus (job_p -> tbj_job_id_s, OS_STARTED);
+
+	if (job_p -> tbj_chunked_search_p)
+		{
+			#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Searching " UINT32_FMT " query chunks for job \"%s\", " UINT32_FMT " at a time with " UINT32_FMT " threads each", job_p -> tbj_chunked_search_p -> GetNumChunks (), job_p -> tbj_job_id_s, max_running_chunks, threads_per_process);
+			#endif
+
+			status = RunThreadedBlastChunks (job_p, max_running_chunks, deadline);
+		}
+	else
+		{
+			status = RunThreadedBlastProcess (job_p, deadline);
+		}
+
+	job_p -> tbj_scheduler_p -> ReleaseCores (num_threads);
+
+	/* These weren't allocated so remove them before the job is freed */
+	* (job_p -> tbj_args_ss + job_p -> tbj_num_args) = NULL;
+	* (job_p -> tbj_args_ss + job_p -> tbj_num_args + 1) = NULL;
+
+	SetThreadedBlastJobStatus (job_p -> tbj_job_id_s, status);
+}
+
+
+static OperationStatus RunThreadedBlastProcess (ThreadedBlastJob *job_p, const time_t deadline)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	BlastProcessResult result;
+	pid_t pid = SpawnThreadedBlastProcess (job_p, job_p -> tbj_args_ss, deadline);
+
+	if ((pid != -1) && (WaitForThreadedBlastProcess (job_p, pid, &result)))
+		{
+			#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+			PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Job \"%s\" used %ld.%06lds user %ld.%06lds sys and %ld KB max rss", job_p -> tbj_job_id_s,
+								(long) result.bpr_usage.ru_utime.tv_sec, (long) result.bpr_usage.ru_utime.tv_usec,
+								(long) result.bpr_usage.ru_stime.tv_sec, (long) result.bpr_usage.ru_stime.tv_usec,
+								result.bpr_usage.ru_maxrss);
+			#endif
+
+			if (DidBlastProcessSucceed (&result))
+				{
+					status = OS_SUCCEEDED;
+				}
+			else
+				{
+					status = OS_FAILED;
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Job \"%s\" returned %d with signal %d", job_p -> tbj_job_id_s, result.bpr_exit_code, result.bpr_signal);
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run job \"%s\"", job_p -> tbj_job_id_s);
+		}
+
+	return status;
+}
+
+
+/*
+ * Search each of the chunks of the queries with its own process, keeping up
+ * to max_running_chunks of them running at a time. As in SystemBlastTool,
+ * the oldest chunk is waited for first so that the results are merged in the
+ * order of the queries and can be streamed as soon as each chunk is merged.
+ */
+static OperationStatus RunThreadedBlastChunks (ThreadedBlastJob *job_p, const uint32 max_running_chunks, const time_t deadline)
+{
+	OperationStatus status = OS_FAILED_TO_START;
+	ChunkedQuerySearch *search_p = job_p -> tbj_chunked_search_p;
+
+	/* The chunks' values are swapped into a copy as the job owns the strings in tbj_args_ss */
+	char **args_ss = (char **) AllocMemoryArray (job_p -> tbj_num_args + 3, sizeof (char *));
+
+	/* The running chunks' process ids, indexed by the chunk number modulo max_running_chunks */
+	pid_t *pids_p = (pid_t *) AllocMemoryArray (max_running_chunks, sizeof (pid_t));
+
+	if (args_ss && pids_p)
+		{
+			const uint32 num_chunks = search_p -> GetNumChunks ();
+			uint32 next_chunk = 0;
+			uint32 oldest_chunk = 0;
+
+			memcpy (args_ss, job_p -> tbj_args_ss, (job_p -> tbj_num_args + 2) * sizeof (char *));
+
+			status = OS_STARTED;
+
+			/* Once anything has failed, don't launch any more chunks but still wait for the running ones */
+			while ((oldest_chunk < next_chunk) || ((status == OS_STARTED) && (next_chunk < num_chunks)))
+				{
+					if ((status == OS_STARTED) && (IsThreadedBlastJobCancelled (job_p -> tbj_job_id_s)))
+						{
+							status = OS_FAILED;
+							SetThreadedBlastJobStop (job_p -> tbj_job_id_s, BPS_CANCELLED);
+						}
+
+					while ((status == OS_STARTED) && (next_chunk < num_chunks) && (next_chunk - oldest_chunk < max_running_chunks))
+						{
+							const char *replacements_ss [] = { "-query", search_p -> GetChunkQueryFilename (next_chunk), "-out", search_p -> GetChunkOutputFilename (next_chunk), NULL };
+
+							ReplaceBlastProcessArgValues (args_ss, replacements_ss);
+							* (pids_p + (next_chunk % max_running_chunks)) = SpawnThreadedBlastProcess (job_p, args_ss, deadline);
+
+							++ next_chunk;
+						}
+
+					if (oldest_chunk < next_chunk)
+						{
+							const pid_t pid = * (pids_p + (oldest_chunk % max_running_chunks));
+							BlastProcessResult result;
+
+							if ((pid != -1) && (WaitForThreadedBlastProcess (job_p, pid, &result)))
+								{
+									if (DidBlastProcessSucceed (&result))
+										{
+											if ((status == OS_STARTED) && (!search_p -> SetChunkSucceeded (oldest_chunk)))
+												{
+													status = OS_FAILED;
+												}
+										}
+									else
+										{
+											status = OS_FAILED;
+											PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Query chunk \"%s\" of job \"%s\" returned %d with signal %d", search_p -> GetChunkQueryFilename (oldest_chunk), job_p -> tbj_job_id_s, result.bpr_exit_code, result.bpr_signal);
+										}
+								}
+							else
+								{
+									status = OS_FAILED;
+									PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to run query chunk \"%s\" of job \"%s\"", search_p -> GetChunkQueryFilename (oldest_chunk), job_p -> tbj_job_id_s);
+								}
+
+							++ oldest_chunk;
+						}		/* if (oldest_chunk < next_chunk) */
+
+				}		/* while ((oldest_chunk < next_chunk) || ... */
+
+			if (status == OS_STARTED)
+				{
+					status = OS_SUCCEEDED;
+				}
+		}
+	else
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to allocate the arguments to run the query chunks of job \"%s\"", job_p -> tbj_job_id_s);
+		}
+
+	if (pids_p)
+		{
+			FreeMemory (pids_p);
+		}
+
+	if (args_ss)
+		{
+			FreeMemory (args_ss);
+		}
+
+	return status;
+}
+
+
+static pid_t SpawnThreadedBlastProcess (ThreadedBlastJob *job_p, char **args_ss, const time_t deadline)
+{
+	pid_t pid;
+
+	if (job_p -> tbj_envelope_p)
+		{
+			pid = job_p -> tbj_envelope_p -> Spawn (args_ss, job_p -> tbj_log_filename_s);
+		}
+	else
+		{
+			pid = SpawnBlastProcess (args_ss, job_p -> tbj_log_filename_s);
+		}
+
+	if (pid != -1)
+		{
+			if (!job_p -> tbj_monitor_p -> Track (pid, job_p -> tbj_job_id_s, deadline))
+				{
+					PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Failed to track process %d for job \"%s\"", pid, job_p -> tbj_job_id_s);
+				}
+
+			/*
+			 * If the job was cancelled after it was last checked but before this
+			 * process was tracked, the monitor couldn't stop it then so do it now.
+			 */
+			if (IsThreadedBlastJobCancelled (job_p -> tbj_job_id_s))
+				{
+					job_p -> tbj_monitor_p -> Cancel (job_p -> tbj_job_id_s);
+				}
+		}
+
+	return pid;
+}
+
+
+static bool WaitForThreadedBlastProcess (ThreadedBlastJob *job_p, const pid_t pid, BlastProcessResult *result_p)
+{
+	bool success_flag = job_p -> tbj_monitor_p -> Wait (pid, result_p);
+
+	if (success_flag)
+		{
+			if (job_p -> tbj_envelope_p)
+				{
+					job_p -> tbj_envelope_p -> Leave (pid, result_p);
+				}
+
+			if (result_p -> bpr_stop != BPS_NONE)
+				{
+					SetThreadedBlastJobStop (job_p -> tbj_job_id_s, result_p -> bpr_stop);
+				}
+		}
+
+	return success_flag;
+}
+
+
+/*
+ * Called by the BlastThreadPool when it is shutting down, either for
+ * a job that is running or one that will now never be run.
+ */
+static void StopThreadedBlastJob (void *data_p)
+{
+	ThreadedBlastJob *job_p = (ThreadedBlastJob *) data_p;
+
+	SetThreadedBlastJobCancelled (job_p -> tbj_job_id_s);
+	job_p -> tbj_monitor_p -> Cancel (job_p -> tbj_job_id_s);
+}
+
+
+static void ReleaseThreadedBlastJob (void *data_p)
+{
+	ThreadedBlastJob *job_p = (ThreadedBlastJob *) data_p;
+
+	/* If the job was never run, it still has its place in the queue */
+	if (!job_p -> tbj_started_flag)
+		{
+			job_p -> tbj_scheduler_p -> CancelQueueSlot ();
+			FailCancelledThreadedBlastJob (job_p -> tbj_job_id_s);
+		}
+
+	FreeThreadedBlastJob (job_p);
+}
+
+
+static bool SetThreadedBlastJobStatus (const char *job_id_s, OperationStatus status)
+{
+	bool success_flag = false;
+
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (!s_threaded_jobs_p)
+		{
+			s_threaded_jobs_p = AllocateLinkedList (FreeThreadedBlastJobNode);
+		}
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p)
+				{
+					node_p -> tbjn_status = status;
+					success_flag = true;
+				}
+			else
+				{
+					node_p = (ThreadedBlastJobNode *) AllocMemory (sizeof (ThreadedBlastJobNode));
+
+					if (node_p)
+						{
+							ThreadedBlastJobNode *old_node_p = (ThreadedBlastJobNode *) (s_threaded_jobs_p -> ll_head_p);
+
+							memset (& (node_p -> tbjn_node), 0, sizeof (ListItem));
+							strcpy (node_p -> tbjn_job_id_s, job_id_s);
+							node_p -> tbjn_status = status;
+							node_p -> tbjn_stop = BPS_NONE;
+							node_p -> tbjn_cancelled_flag = false;
+
+							LinkedListAddTail (s_threaded_jobs_p, & (node_p -> tbjn_node));
+							success_flag = true;
+
+							/* Discard the oldest finished jobs if we have too many */
+							while (old_node_p && (s_threaded_jobs_p -> ll_size > TBT_MAX_NUM_FINISHED_JOBS))
+								{
+									ThreadedBlastJobNode *next_node_p = (ThreadedBlastJobNode *) (old_node_p -> tbjn_node.ln_next_p);
+
+									if (IsThreadedBlastJobFinished (old_node_p -> tbjn_status))
+										{
+											LinkedListRemove (s_threaded_jobs_p, & (old_node_p -> tbjn_node));
+											FreeThreadedBlastJobNode (& (old_node_p -> tbjn_node));
+										}
+
+									old_node_p = next_node_p;
+								}
+						}
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+
+	return success_flag;
+}
+
+
+static void SetThreadedBlastJobStop (const char *job_id_s, BlastProcessStop stop)
+{
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p)
+				{
+					node_p -> tbjn_stop = stop;
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+}
+
+
+static bool GetThreadedBlastJobStatus (const char *job_id_s, OperationStatus *status_p, BlastProcessStop *stop_p)
+{
+	bool success_flag = false;
+
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p)
+				{
+					*status_p = node_p -> tbjn_status;
+					*stop_p = node_p -> tbjn_stop;
+					success_flag = true;
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+
+	return success_flag;
+}
+
+
+static void RemoveThreadedBlastJobStatus (const char *job_id_s)
+{
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p)
+				{
+					LinkedListRemove (s_threaded_jobs_p, & (node_p -> tbjn_node));
+					FreeThreadedBlastJobNode (& (node_p -> tbjn_node));
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+}
+
+
+/*
+ * Mark a job as cancelled so that it won't start its process. This returns
+ * false if the job isn't one of ours or has already finished.
+ */
+static bool SetThreadedBlastJobCancelled (const char *job_id_s)
+{
+	bool success_flag = false;
+
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p && (!IsThreadedBlastJobFinished (node_p -> tbjn_status)))
+				{
+					node_p -> tbjn_cancelled_flag = true;
+					success_flag = true;
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+
+	return success_flag;
+}
+
+
+static bool IsThreadedBlastJobCancelled (const char *job_id_s)
+{
+	bool cancelled_flag = false;
+
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p)
+				{
+					cancelled_flag = node_p -> tbjn_cancelled_flag;
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+
+	return cancelled_flag;
+}
+
+
+/*
+ * Fail a job that was cancelled before its process was started. The stop
+ * reason is set along with the status so that GetStatus adds the
+ * cancellation message to the job.
+ */
+static void FailCancelledThreadedBlastJob (const char *job_id_s)
+{
+	#if THREADED_BLAST_TOOL_DEBUG >= STM_LEVEL_FINE
+	PrintLog (STM_LEVEL_FINE, __FILE__, __LINE__, "Job \"%s\" was cancelled before it started", job_id_s);
+	#endif
+
+	pthread_mutex_lock (&s_threaded_jobs_mutex);
+
+	if (s_threaded_jobs_p)
+		{
+			ThreadedBlastJobNode *node_p = FindThreadedBlastJobNode (job_id_s);
+
+			if (node_p)
+				{
+					node_p -> tbjn_stop = BPS_CANCELLED;
+					node_p -> tbjn_status = OS_FAILED;
+				}
+		}
+
+	pthread_mutex_unlock (&s_threaded_jobs_mutex);
+}
+
+
+/* This must be called with s_threaded_jobs_mutex held */
+static ThreadedBlastJobNode *FindThreadedBlastJobNode (const char *job_id_s)
+{
+	ThreadedBlastJobNode *node_p = (ThreadedBlastJobNode *) (s_threaded_jobs_p -> ll_head_p);
+
+	while (node_p)
+		{
+			if (strcmp (node_p -> tbjn_job_id_s, job_id_s) == 0)
+				{
+					return node_p;
+				}
+
+			node_p = (ThreadedBlastJobNode *) (node_p -> tbjn_node.ln_next_p);
+		}
+
+	return NULL;
+}
+
+
+static bool IsThreadedBlastJobFinished (const OperationStatus status)
+{
+	return ((status != OS_IDLE) && (status != OS_PENDING) && (status != OS_STARTED));
+}
+
+
+static void FreeThreadedBlastJobNode (ListItem * const node_p)
+{
+	FreeMemory (node_p);
+}
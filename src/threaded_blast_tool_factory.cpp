@@ -0,0 +1,131 @@
+/*
+** Copyright 2014-2016 The Earlham Institute
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+/*
+ * threaded_blast_tool_factory.cpp
+ *
+ *  Created on: 16 Oct 2026
+ *      Author: billy
+ */
+
+#include "threaded_blast_tool_factory.hpp"
+
+#include <stdexcept>
+
+#include "threaded_blast_tool.hpp"
+#include "json_util.h"
+#include "streams.h"
+
+
+
+ThreadedBlastToolFactory *ThreadedBlastToolFactory :: CreateThreadedBlastToolFactory (const json_t *service_config_p)
+{
+	ThreadedBlastToolFactory *factory_p = 0;
+
+	try
+		{
+			factory_p = new ThreadedBlastToolFactory (service_config_p);
+		}
+	catch (std :: exception &e_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create new ThreadedBlastToolFactory, error \"%s\"", e_r.what ());
+		}
+
+	return factory_p;
+}
+
+
+ThreadedBlastToolFactory :: ThreadedBlastToolFactory (const json_t *service_config_p)
+	: ExternalBlastToolFactory (service_config_p)
+{
+	uint32 num_threads = 0;
+	const json_t *threaded_blast_tool_config_p = json_object_get (service_config_p, "threaded_blast_tool_config");
+
+	if (threaded_blast_tool_config_p)
+		{
+			json_int_t i;
+
+			if (GetJSONInteger (threaded_blast_tool_config_p, "num_threads", &i))
+				{
+					if (i > 0)
+						{
+							num_threads = (uint32) i;
+						}
+					else
+						{
+							PrintErrors (STM_LEVEL_WARNING, __FILE__, __LINE__, "Invalid num_threads " "%" JSON_INTEGER_FORMAT ", using the number of processors instead", i);
+						}
+				}
+		}
+
+	tbtf_pool_p = BlastThreadPool :: GetSharedBlastThreadPool (num_threads);
+
+	if (!tbtf_pool_p)
+		{
+			throw std :: bad_alloc ();
+		}
+}
+
+
+ThreadedBlastToolFactory :: ~ThreadedBlastToolFactory ()
+{
+	BlastThreadPool :: ReleaseSharedBlastThreadPool ();
+}
+
+
+BlastTool *ThreadedBlastToolFactory :: CreateBlastTool (BlastServiceJob *job_p, const char *name_s, const BlastServiceData *data_p)
+{
+	BlastTool *tool_p = 0;
+
+	try
+		{
+			tool_p = new ThreadedBlastTool (job_p, name_s, GetName (), data_p, ebtf_program_name_s, tbtf_pool_p);
+		}
+	catch (std :: exception &e_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create new ThreadedBlastTool, error \"%s\"", e_r.what ());
+		}
+
+	return tool_p;
+}
+
+
+BlastTool *ThreadedBlastToolFactory :: CreateBlastTool (const json_t *json_p,  BlastServiceJob *blast_job_p, BlastServiceData *service_data_p)
+{
+	BlastTool *tool_p = 0;
+
+	try
+		{
+			tool_p = new ThreadedBlastTool (blast_job_p, service_data_p, json_p, tbtf_pool_p);
+		}
+	catch (std :: exception &e_r)
+		{
+			PrintErrors (STM_LEVEL_SEVERE, __FILE__, __LINE__, "Failed to create new ThreadedBlastTool, error \"%s\"", e_r.what ());
+		}
+
+	return tool_p;
+}
+
+
+Synchronicity ThreadedBlastToolFactory :: GetToolsSynchronicity () const
+{
+	return SY_ASYNCHRONOUS_DETACHED;
+}
+
+
+const char *ThreadedBlastToolFactory :: GetName ()
+{
+	return "Threaded Blast Tool Factory";
+}